@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file acquire_benchmark.cpp
+ *
+ * @brief Overhead of vkAcquireNextImageKHR when an image is free, in nanoseconds.
+ *
+ * Creates --swapchains FIFO swapchains of --images images on headless surfaces and presents --frames frames to each
+ * of them in turn, from one thread. Acquires are made with a timeout of 0 and retried until they return an image,
+ * only the call that returns it is timed, so the samples are the cost of the layer picking a free image rather than
+ * of waiting for the presentation engine. One JSON object is printed on stdout with the percentiles (ns) of the
+ * successful acquires, and the number of acquires that found no free image.
+ *
+ * Usage:
+ *
+ *    wsi_acquire_benchmark [--swapchains <count>] [--frames <count>] [--images <count>] [--enable-layer]
+ *
+ * The layer is expected to be installed as an implicit layer, --enable-layer enables it explicitly instead.
+ */
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+#define VK_CHECK(expression)                                                                                \
+   do                                                                                                       \
+   {                                                                                                        \
+      VkResult check_result = (expression);                                                                 \
+      if (check_result < VK_SUCCESS)                                                                        \
+      {                                                                                                     \
+         std::fprintf(stderr, "%s:%d: %s failed with %d\n", __FILE__, __LINE__, #expression, check_result); \
+         std::exit(EXIT_FAILURE);                                                                           \
+      }                                                                                                     \
+   } while (0)
+
+[[noreturn]] void fail(const char *message)
+{
+   std::fprintf(stderr, "%s\n", message);
+   std::exit(EXIT_FAILURE);
+}
+
+/* Size of the swapchain images, small so the GPU work of a frame is negligible. */
+constexpr uint32_t IMAGE_SIZE = 64;
+
+/* Frames submitted ahead of the one being presented, per swapchain. */
+constexpr uint32_t FRAMES_IN_FLIGHT = 2;
+
+struct options
+{
+   uint32_t swapchains = 4;
+   uint32_t frames = 600;
+   uint32_t image_count = 3;
+   bool enable_layer = false;
+};
+
+bool parse_options(int argc, char **argv, options *opts)
+{
+   for (int i = 1; i < argc; i++)
+   {
+      const char *arg = argv[i];
+      const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+      if (!std::strcmp(arg, "--swapchains") && value != nullptr)
+      {
+         opts->swapchains = static_cast<uint32_t>(std::max(1l, std::strtol(value, nullptr, 10)));
+         i++;
+      }
+      else if (!std::strcmp(arg, "--frames") && value != nullptr)
+      {
+         opts->frames = static_cast<uint32_t>(std::max(1l, std::strtol(value, nullptr, 10)));
+         i++;
+      }
+      else if (!std::strcmp(arg, "--images") && value != nullptr)
+      {
+         opts->image_count = static_cast<uint32_t>(std::max(1l, std::strtol(value, nullptr, 10)));
+         i++;
+      }
+      else if (!std::strcmp(arg, "--enable-layer"))
+      {
+         opts->enable_layer = true;
+      }
+      else
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+struct device_context
+{
+   VkInstance instance = VK_NULL_HANDLE;
+   VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+   VkDevice device = VK_NULL_HANDLE;
+   VkQueue queue = VK_NULL_HANDLE;
+   uint32_t queue_family = 0;
+   PFN_vkCreateHeadlessSurfaceEXT create_headless_surface = nullptr;
+};
+
+VkSurfaceKHR create_surface(const device_context &ctx)
+{
+   VkHeadlessSurfaceCreateInfoEXT create_info = {};
+   create_info.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+   VkSurfaceKHR surface = VK_NULL_HANDLE;
+   VK_CHECK(ctx.create_headless_surface(ctx.instance, &create_info, nullptr, &surface));
+   return surface;
+}
+
+void create_device(device_context &ctx)
+{
+   VkSurfaceKHR surface = create_surface(ctx);
+
+   uint32_t family_count = 0;
+   vkGetPhysicalDeviceQueueFamilyProperties(ctx.physical_device, &family_count, nullptr);
+   std::vector<VkQueueFamilyProperties> families(family_count);
+   vkGetPhysicalDeviceQueueFamilyProperties(ctx.physical_device, &family_count, families.data());
+   bool found = false;
+   for (uint32_t i = 0; i < family_count && !found; i++)
+   {
+      VkBool32 supported = VK_FALSE;
+      VK_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(ctx.physical_device, i, surface, &supported));
+      if (supported && (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+      {
+         ctx.queue_family = i;
+         found = true;
+      }
+   }
+   vkDestroySurfaceKHR(ctx.instance, surface, nullptr);
+   if (!found)
+   {
+      fail("No graphics queue can present to headless surfaces");
+   }
+
+   const char *extensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+   const float priority = 1.0f;
+   VkDeviceQueueCreateInfo queue_info = {};
+   queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+   queue_info.queueFamilyIndex = ctx.queue_family;
+   queue_info.queueCount = 1;
+   queue_info.pQueuePriorities = &priority;
+
+   VkDeviceCreateInfo device_info = {};
+   device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+   device_info.queueCreateInfoCount = 1;
+   device_info.pQueueCreateInfos = &queue_info;
+   device_info.enabledExtensionCount = 1;
+   device_info.ppEnabledExtensionNames = extensions;
+   VK_CHECK(vkCreateDevice(ctx.physical_device, &device_info, nullptr, &ctx.device));
+   vkGetDeviceQueue(ctx.device, ctx.queue_family, 0, &ctx.queue);
+}
+
+/**
+ * @brief A swapchain on its own surface, with a command buffer per image moving it to the present layout.
+ */
+struct swapchain_context
+{
+   VkSurfaceKHR surface = VK_NULL_HANDLE;
+   VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+   VkCommandPool pool = VK_NULL_HANDLE;
+   std::vector<VkCommandBuffer> command_buffers;
+   VkSemaphore acquire_semaphores[FRAMES_IN_FLIGHT] = {};
+   VkFence fences[FRAMES_IN_FLIGHT] = {};
+   /* One per image, as a present may still wait on the semaphore when the frame slot is reused. */
+   std::vector<VkSemaphore> render_semaphores;
+   uint32_t frame = 0;
+};
+
+void create_swapchain(const device_context &ctx, const options &opts, swapchain_context &sc)
+{
+   sc.surface = create_surface(ctx);
+
+   VkSurfaceCapabilitiesKHR caps = {};
+   VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(ctx.physical_device, sc.surface, &caps));
+   uint32_t format_count = 1;
+   VkSurfaceFormatKHR format = {};
+   VkResult result = vkGetPhysicalDeviceSurfaceFormatsKHR(ctx.physical_device, sc.surface, &format_count, &format);
+   if ((result != VK_SUCCESS && result != VK_INCOMPLETE) || format_count == 0)
+   {
+      fail("The surface has no format");
+   }
+
+   VkSwapchainCreateInfoKHR info = {};
+   info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+   info.surface = sc.surface;
+   info.minImageCount = std::max(caps.minImageCount, opts.image_count);
+   if (caps.maxImageCount != 0)
+   {
+      info.minImageCount = std::min(info.minImageCount, caps.maxImageCount);
+   }
+   info.imageFormat = format.format;
+   info.imageColorSpace = format.colorSpace;
+   info.imageExtent = { std::clamp(IMAGE_SIZE, caps.minImageExtent.width, caps.maxImageExtent.width),
+                        std::clamp(IMAGE_SIZE, caps.minImageExtent.height, caps.maxImageExtent.height) };
+   info.imageArrayLayers = 1;
+   info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+   info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+   info.preTransform = caps.currentTransform;
+   info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+   info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+   info.clipped = VK_TRUE;
+   VK_CHECK(vkCreateSwapchainKHR(ctx.device, &info, nullptr, &sc.swapchain));
+
+   uint32_t image_count = 0;
+   VK_CHECK(vkGetSwapchainImagesKHR(ctx.device, sc.swapchain, &image_count, nullptr));
+   std::vector<VkImage> images(image_count);
+   VK_CHECK(vkGetSwapchainImagesKHR(ctx.device, sc.swapchain, &image_count, images.data()));
+
+   VkCommandPoolCreateInfo pool_info = {};
+   pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+   pool_info.queueFamilyIndex = ctx.queue_family;
+   VK_CHECK(vkCreateCommandPool(ctx.device, &pool_info, nullptr, &sc.pool));
+
+   VkCommandBufferAllocateInfo alloc_info = {};
+   alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+   alloc_info.commandPool = sc.pool;
+   alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+   alloc_info.commandBufferCount = image_count;
+   sc.command_buffers.resize(image_count);
+   VK_CHECK(vkAllocateCommandBuffers(ctx.device, &alloc_info, sc.command_buffers.data()));
+
+   for (uint32_t i = 0; i < image_count; i++)
+   {
+      VkCommandBufferBeginInfo begin_info = {};
+      begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      VK_CHECK(vkBeginCommandBuffer(sc.command_buffers[i], &begin_info));
+      VkImageMemoryBarrier image_barrier = {};
+      image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+      image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      image_barrier.image = images[i];
+      image_barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+      image_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+      image_barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+      vkCmdPipelineBarrier(sc.command_buffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                           VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+      VK_CHECK(vkEndCommandBuffer(sc.command_buffers[i]));
+   }
+
+   VkSemaphoreCreateInfo semaphore_info = {};
+   semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+   VkFenceCreateInfo fence_info = {};
+   fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+   fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+   for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+   {
+      VK_CHECK(vkCreateSemaphore(ctx.device, &semaphore_info, nullptr, &sc.acquire_semaphores[i]));
+      VK_CHECK(vkCreateFence(ctx.device, &fence_info, nullptr, &sc.fences[i]));
+   }
+   sc.render_semaphores.resize(image_count);
+   for (VkSemaphore &semaphore : sc.render_semaphores)
+   {
+      VK_CHECK(vkCreateSemaphore(ctx.device, &semaphore_info, nullptr, &semaphore));
+   }
+}
+
+void destroy_swapchain(const device_context &ctx, swapchain_context &sc)
+{
+   VK_CHECK(vkWaitForFences(ctx.device, FRAMES_IN_FLIGHT, sc.fences, VK_TRUE, UINT64_MAX));
+   vkDestroySwapchainKHR(ctx.device, sc.swapchain, nullptr);
+   for (VkSemaphore semaphore : sc.render_semaphores)
+   {
+      vkDestroySemaphore(ctx.device, semaphore, nullptr);
+   }
+   for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+   {
+      vkDestroySemaphore(ctx.device, sc.acquire_semaphores[i], nullptr);
+      vkDestroyFence(ctx.device, sc.fences[i], nullptr);
+   }
+   vkDestroyCommandPool(ctx.device, sc.pool, nullptr);
+   vkDestroySurfaceKHR(ctx.instance, sc.surface, nullptr);
+   sc = swapchain_context{};
+}
+
+/**
+ * @brief Acquire an image of @p sc and present it, adding the duration of the acquire that returned it to @p samples.
+ *
+ * @return The number of acquires that found no free image.
+ */
+uint64_t present_frame(const device_context &ctx, swapchain_context &sc, std::vector<uint64_t> &samples)
+{
+   /* The fence of the slot also completes the wait on its acquire semaphore, which can then be signalled again. */
+   const uint32_t slot = sc.frame++ % FRAMES_IN_FLIGHT;
+   VK_CHECK(vkWaitForFences(ctx.device, 1, &sc.fences[slot], VK_TRUE, UINT64_MAX));
+   VK_CHECK(vkResetFences(ctx.device, 1, &sc.fences[slot]));
+   VkSemaphore acquire_semaphore = sc.acquire_semaphores[slot];
+
+   uint64_t misses = 0;
+   uint32_t image_index = 0;
+   while (true)
+   {
+      const auto start = std::chrono::steady_clock::now();
+      const VkResult result =
+         vkAcquireNextImageKHR(ctx.device, sc.swapchain, 0, acquire_semaphore, VK_NULL_HANDLE, &image_index);
+      const auto end = std::chrono::steady_clock::now();
+      if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)
+      {
+         samples.push_back(
+            static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+         break;
+      }
+      if (result != VK_NOT_READY && result != VK_TIMEOUT)
+      {
+         VK_CHECK(result);
+      }
+      misses++;
+   }
+
+   const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+   VkSubmitInfo submit_info = {};
+   submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+   submit_info.waitSemaphoreCount = 1;
+   submit_info.pWaitSemaphores = &acquire_semaphore;
+   submit_info.pWaitDstStageMask = &wait_stage;
+   submit_info.commandBufferCount = 1;
+   submit_info.pCommandBuffers = &sc.command_buffers[image_index];
+   submit_info.signalSemaphoreCount = 1;
+   submit_info.pSignalSemaphores = &sc.render_semaphores[image_index];
+   VK_CHECK(vkQueueSubmit(ctx.queue, 1, &submit_info, sc.fences[slot]));
+
+   VkPresentInfoKHR present_info = {};
+   present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+   present_info.waitSemaphoreCount = 1;
+   present_info.pWaitSemaphores = &sc.render_semaphores[image_index];
+   present_info.swapchainCount = 1;
+   present_info.pSwapchains = &sc.swapchain;
+   present_info.pImageIndices = &image_index;
+   VK_CHECK(vkQueuePresentKHR(ctx.queue, &present_info));
+   return misses;
+}
+
+uint64_t percentile(const std::vector<uint64_t> &sorted, size_t permille)
+{
+   return sorted[std::min(sorted.size() - 1, sorted.size() * permille / 1000)];
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+   options opts;
+   if (!parse_options(argc, argv, &opts))
+   {
+      std::fprintf(stderr, "usage: %s [--swapchains <count>] [--frames <count>] [--images <count>] [--enable-layer]\n",
+                   argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   const char *instance_extensions[] = { VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME };
+   const char *layer_name = "VK_LAYER_window_system_integration";
+
+   VkApplicationInfo app_info = {};
+   app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+   app_info.pApplicationName = "wsi_acquire_benchmark";
+   app_info.apiVersion = VK_API_VERSION_1_1;
+
+   VkInstanceCreateInfo instance_info = {};
+   instance_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+   instance_info.pApplicationInfo = &app_info;
+   instance_info.enabledExtensionCount = 2;
+   instance_info.ppEnabledExtensionNames = instance_extensions;
+   instance_info.enabledLayerCount = opts.enable_layer ? 1 : 0;
+   instance_info.ppEnabledLayerNames = &layer_name;
+
+   device_context ctx;
+   VK_CHECK(vkCreateInstance(&instance_info, nullptr, &ctx.instance));
+
+   uint32_t physical_device_count = 1;
+   VkResult result = vkEnumeratePhysicalDevices(ctx.instance, &physical_device_count, &ctx.physical_device);
+   if ((result != VK_SUCCESS && result != VK_INCOMPLETE) || physical_device_count == 0)
+   {
+      fail("No physical device");
+   }
+
+   ctx.create_headless_surface = reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(
+      vkGetInstanceProcAddr(ctx.instance, "vkCreateHeadlessSurfaceEXT"));
+   if (ctx.create_headless_surface == nullptr)
+   {
+      fail("VK_EXT_headless_surface is not available");
+   }
+   create_device(ctx);
+
+   std::vector<swapchain_context> swapchains(opts.swapchains);
+   for (swapchain_context &sc : swapchains)
+   {
+      create_swapchain(ctx, opts, sc);
+   }
+
+   std::vector<uint64_t> samples;
+   samples.reserve(static_cast<size_t>(opts.frames) * opts.swapchains);
+   uint64_t misses = 0;
+   for (uint32_t frame = 0; frame < opts.frames; frame++)
+   {
+      for (swapchain_context &sc : swapchains)
+      {
+         misses += present_frame(ctx, sc, samples);
+      }
+   }
+
+   for (swapchain_context &sc : swapchains)
+   {
+      destroy_swapchain(ctx, sc);
+   }
+   vkDestroyDevice(ctx.device, nullptr);
+   vkDestroyInstance(ctx.instance, nullptr);
+
+   uint64_t total = 0;
+   for (uint64_t sample : samples)
+   {
+      total += sample;
+   }
+   std::sort(samples.begin(), samples.end());
+   std::printf("{\"swapchains\":%u,\"images\":%u,\"acquires\":%zu,\"not_ready\":%llu,\"acquire_ns\":{\"mean\":%llu,"
+               "\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu}}\n",
+               opts.swapchains, opts.image_count, samples.size(), static_cast<unsigned long long>(misses),
+               static_cast<unsigned long long>(total / samples.size()),
+               static_cast<unsigned long long>(percentile(samples, 500)),
+               static_cast<unsigned long long>(percentile(samples, 900)),
+               static_cast<unsigned long long>(percentile(samples, 990)),
+               static_cast<unsigned long long>(samples.back()));
+   return EXIT_SUCCESS;
+}
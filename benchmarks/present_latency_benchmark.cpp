@@ -0,0 +1,1284 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file present_latency_benchmark.cpp
+ *
+ * @brief End to end benchmark of presenting through the layer.
+ *
+ * Creates a surface on one of the backends, then for every present mode of the surface creates a swapchain and
+ * presents a number of frames, each cleared a configurable number of times on the GPU. For every present mode a
+ * JSON object is printed on its own line of stdout with statistics (us) of:
+ * - acquire: duration of vkAcquireNextImageKHR.
+ * - present: duration of vkQueuePresentKHR.
+ * - present_to_display: time from the return of vkQueuePresentKHR to the return of vkWaitForPresentKHR for the
+ *   same present, when the device supports VK_KHR_present_wait. The wait serializes the frames, as in an
+ *   application pacing its frames on presentation, so --no-present-wait measures the throughput without it.
+ * - frame_time: time between the returns of two consecutive vkQueuePresentKHR calls.
+ *
+ * Usage:
+ *
+ *    wsi_present_benchmark [--backend headless|xcb|wayland|display] [--frames <count>] [--gpu-load <clears>]
+ *                          [--mode fifo|fifo_relaxed|mailbox|immediate] [--size <width>x<height>]
+ *                          [--images <count>] [--no-present-wait] [--enable-layer] [--replay <capture>]
+ *
+ * The layer is expected to be installed as an implicit layer, --enable-layer enables it explicitly instead.
+ *
+ * --replay makes the swapchain calls recorded in a capture of the layer (see util/api_capture.hpp) instead, with the
+ * same timing, and prints the statistics of the captured and replayed acquire, present and present wait durations.
+ * --size, --images and --mode are then taken from the capture.
+ */
+
+#if BENCHMARK_XCB
+#define VK_USE_PLATFORM_XCB_KHR 1
+#include <xcb/xcb.h>
+#endif
+#if BENCHMARK_WAYLAND
+#define VK_USE_PLATFORM_WAYLAND_KHR 1
+#include <wayland-client.h>
+#include "xdg-shell-client-protocol.h"
+#endif
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "util/api_capture.hpp"
+
+namespace
+{
+
+#define VK_CHECK(expression)                                                                                \
+   do                                                                                                       \
+   {                                                                                                        \
+      VkResult check_result = (expression);                                                                 \
+      if (check_result < VK_SUCCESS)                                                                        \
+      {                                                                                                     \
+         std::fprintf(stderr, "%s:%d: %s failed with %d\n", __FILE__, __LINE__, #expression, check_result); \
+         std::exit(EXIT_FAILURE);                                                                           \
+      }                                                                                                     \
+   } while (0)
+
+[[noreturn]] void fail(const char *message)
+{
+   std::fprintf(stderr, "%s\n", message);
+   std::exit(EXIT_FAILURE);
+}
+
+enum class backend
+{
+   headless,
+   xcb,
+   wayland,
+   display,
+};
+
+struct options
+{
+   backend selected_backend = backend::headless;
+   uint32_t frames = 300;
+   uint32_t gpu_load = 0;
+   uint32_t width = 1280;
+   uint32_t height = 720;
+   uint32_t image_count = 3;
+   bool present_wait = true;
+   bool enable_layer = false;
+   /* Capture file to replay instead of presenting with every mode. */
+   const char *replay_file = nullptr;
+   /* All the modes of the surface when empty. */
+   std::vector<VkPresentModeKHR> modes;
+};
+
+const char *present_mode_name(VkPresentModeKHR mode)
+{
+   switch (mode)
+   {
+   case VK_PRESENT_MODE_FIFO_KHR:
+      return "fifo";
+   case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+      return "fifo_relaxed";
+   case VK_PRESENT_MODE_MAILBOX_KHR:
+      return "mailbox";
+   case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      return "immediate";
+   default:
+      return nullptr;
+   }
+}
+
+const char *backend_name(backend value)
+{
+   switch (value)
+   {
+   case backend::headless:
+      return "headless";
+   case backend::xcb:
+      return "xcb";
+   case backend::wayland:
+      return "wayland";
+   case backend::display:
+      return "display";
+   }
+   return "unknown";
+}
+
+bool parse_options(int argc, char **argv, options *opts)
+{
+   for (int i = 1; i < argc; i++)
+   {
+      const char *arg = argv[i];
+      const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+      if (!std::strcmp(arg, "--backend") && value != nullptr)
+      {
+         bool found = false;
+         for (backend candidate : { backend::headless, backend::xcb, backend::wayland, backend::display })
+         {
+            if (!std::strcmp(value, backend_name(candidate)))
+            {
+               opts->selected_backend = candidate;
+               found = true;
+            }
+         }
+         if (!found)
+         {
+            return false;
+         }
+         i++;
+      }
+      else if (!std::strcmp(arg, "--frames") && value != nullptr)
+      {
+         opts->frames = static_cast<uint32_t>(std::max(1l, std::strtol(value, nullptr, 10)));
+         i++;
+      }
+      else if (!std::strcmp(arg, "--gpu-load") && value != nullptr)
+      {
+         opts->gpu_load = static_cast<uint32_t>(std::max(0l, std::strtol(value, nullptr, 10)));
+         i++;
+      }
+      else if (!std::strcmp(arg, "--images") && value != nullptr)
+      {
+         opts->image_count = static_cast<uint32_t>(std::max(1l, std::strtol(value, nullptr, 10)));
+         i++;
+      }
+      else if (!std::strcmp(arg, "--size") && value != nullptr)
+      {
+         if (std::sscanf(value, "%ux%u", &opts->width, &opts->height) != 2 || opts->width == 0 || opts->height == 0)
+         {
+            return false;
+         }
+         i++;
+      }
+      else if (!std::strcmp(arg, "--mode") && value != nullptr)
+      {
+         bool found = false;
+         for (VkPresentModeKHR mode : { VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+                                        VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR })
+         {
+            if (!std::strcmp(value, present_mode_name(mode)))
+            {
+               opts->modes.push_back(mode);
+               found = true;
+            }
+         }
+         if (!found)
+         {
+            return false;
+         }
+         i++;
+      }
+      else if (!std::strcmp(arg, "--replay") && value != nullptr)
+      {
+         opts->replay_file = value;
+         i++;
+      }
+      else if (!std::strcmp(arg, "--no-present-wait"))
+      {
+         opts->present_wait = false;
+      }
+      else if (!std::strcmp(arg, "--enable-layer"))
+      {
+         opts->enable_layer = true;
+      }
+      else
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+ * @brief Window system objects the surface is created for.
+ */
+class native_window
+{
+public:
+   native_window() = default;
+   native_window(const native_window &) = delete;
+   native_window &operator=(const native_window &) = delete;
+
+   ~native_window()
+   {
+#if BENCHMARK_XCB
+      if (m_connection != nullptr)
+      {
+         xcb_destroy_window(m_connection, m_window);
+         xcb_disconnect(m_connection);
+      }
+#endif
+#if BENCHMARK_WAYLAND
+      if (m_toplevel != nullptr)
+      {
+         xdg_toplevel_destroy(m_toplevel);
+      }
+      if (m_xdg_surface != nullptr)
+      {
+         xdg_surface_destroy(m_xdg_surface);
+      }
+      if (m_surface != nullptr)
+      {
+         wl_surface_destroy(m_surface);
+      }
+      if (m_wm_base != nullptr)
+      {
+         xdg_wm_base_destroy(m_wm_base);
+      }
+      if (m_compositor != nullptr)
+      {
+         wl_compositor_destroy(m_compositor);
+      }
+      if (m_registry != nullptr)
+      {
+         wl_registry_destroy(m_registry);
+      }
+      if (m_display != nullptr)
+      {
+         wl_display_disconnect(m_display);
+      }
+#endif
+   }
+
+   /**
+    * @brief Create the window and its surface, or exit when the backend is not available.
+    */
+   VkSurfaceKHR create_surface(VkInstance instance, VkPhysicalDevice physical_device, const options &opts)
+   {
+      VkSurfaceKHR surface = VK_NULL_HANDLE;
+      switch (opts.selected_backend)
+      {
+      case backend::headless:
+      {
+         auto create_headless = reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(
+            vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT"));
+         if (create_headless == nullptr)
+         {
+            fail("VK_EXT_headless_surface is not available");
+         }
+         VkHeadlessSurfaceCreateInfoEXT create_info = {};
+         create_info.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+         VK_CHECK(create_headless(instance, &create_info, nullptr, &surface));
+         break;
+      }
+      case backend::xcb:
+#if BENCHMARK_XCB
+      {
+         m_connection = xcb_connect(nullptr, nullptr);
+         if (xcb_connection_has_error(m_connection))
+         {
+            fail("Cannot connect to the X server");
+         }
+         xcb_screen_t *screen = xcb_setup_roots_iterator(xcb_get_setup(m_connection)).data;
+         m_window = xcb_generate_id(m_connection);
+         xcb_create_window(m_connection, XCB_COPY_FROM_PARENT, m_window, screen->root, 0, 0,
+                           static_cast<uint16_t>(opts.width), static_cast<uint16_t>(opts.height), 0,
+                           XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual, 0, nullptr);
+         xcb_map_window(m_connection, m_window);
+         xcb_flush(m_connection);
+
+         VkXcbSurfaceCreateInfoKHR create_info = {};
+         create_info.sType = VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR;
+         create_info.connection = m_connection;
+         create_info.window = m_window;
+         VK_CHECK(vkCreateXcbSurfaceKHR(instance, &create_info, nullptr, &surface));
+         break;
+      }
+#else
+         fail("Built without the xcb backend");
+#endif
+      case backend::wayland:
+#if BENCHMARK_WAYLAND
+      {
+         create_wayland_window(opts);
+         VkWaylandSurfaceCreateInfoKHR create_info = {};
+         create_info.sType = VK_STRUCTURE_TYPE_WAYLAND_SURFACE_CREATE_INFO_KHR;
+         create_info.display = m_display;
+         create_info.surface = m_surface;
+         VK_CHECK(vkCreateWaylandSurfaceKHR(instance, &create_info, nullptr, &surface));
+         break;
+      }
+#else
+         fail("Built without the wayland backend");
+#endif
+      case backend::display:
+         surface = create_display_surface(instance, physical_device);
+         break;
+      }
+      return surface;
+   }
+
+   /**
+    * @brief Handle the window system events received since the last call.
+    */
+   void dispatch_events()
+   {
+#if BENCHMARK_XCB
+      if (m_connection != nullptr)
+      {
+         while (xcb_generic_event_t *event = xcb_poll_for_event(m_connection))
+         {
+            std::free(event);
+         }
+      }
+#endif
+#if BENCHMARK_WAYLAND
+      if (m_display != nullptr)
+      {
+         wl_display_dispatch_pending(m_display);
+      }
+#endif
+   }
+
+private:
+   static VkSurfaceKHR create_display_surface(VkInstance instance, VkPhysicalDevice physical_device)
+   {
+      uint32_t display_count = 1;
+      VkDisplayPropertiesKHR display_props = {};
+      VkResult result = vkGetPhysicalDeviceDisplayPropertiesKHR(physical_device, &display_count, &display_props);
+      if ((result != VK_SUCCESS && result != VK_INCOMPLETE) || display_count == 0)
+      {
+         fail("No display is available");
+      }
+
+      uint32_t mode_count = 1;
+      VkDisplayModePropertiesKHR mode_props = {};
+      result = vkGetDisplayModePropertiesKHR(physical_device, display_props.display, &mode_count, &mode_props);
+      if ((result != VK_SUCCESS && result != VK_INCOMPLETE) || mode_count == 0)
+      {
+         fail("The display has no mode");
+      }
+
+      uint32_t plane_count = 0;
+      VK_CHECK(vkGetPhysicalDeviceDisplayPlanePropertiesKHR(physical_device, &plane_count, nullptr));
+      for (uint32_t plane = 0; plane < plane_count; plane++)
+      {
+         uint32_t supported_count = 0;
+         VK_CHECK(vkGetDisplayPlaneSupportedDisplaysKHR(physical_device, plane, &supported_count, nullptr));
+         std::vector<VkDisplayKHR> supported(supported_count);
+         VK_CHECK(vkGetDisplayPlaneSupportedDisplaysKHR(physical_device, plane, &supported_count, supported.data()));
+         if (std::find(supported.begin(), supported.end(), display_props.display) == supported.end())
+         {
+            continue;
+         }
+
+         VkDisplaySurfaceCreateInfoKHR create_info = {};
+         create_info.sType = VK_STRUCTURE_TYPE_DISPLAY_SURFACE_CREATE_INFO_KHR;
+         create_info.displayMode = mode_props.displayMode;
+         create_info.planeIndex = plane;
+         create_info.transform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+         create_info.globalAlpha = 1.0f;
+         create_info.alphaMode = VK_DISPLAY_PLANE_ALPHA_OPAQUE_BIT_KHR;
+         create_info.imageExtent = mode_props.parameters.visibleRegion;
+
+         VkSurfaceKHR surface = VK_NULL_HANDLE;
+         VK_CHECK(vkCreateDisplayPlaneSurfaceKHR(instance, &create_info, nullptr, &surface));
+         return surface;
+      }
+
+      fail("No plane can show the display");
+   }
+
+#if BENCHMARK_XCB
+   xcb_connection_t *m_connection = nullptr;
+   xcb_window_t m_window = 0;
+#endif
+
+#if BENCHMARK_WAYLAND
+   void create_wayland_window(const options &opts)
+   {
+      m_display = wl_display_connect(nullptr);
+      if (m_display == nullptr)
+      {
+         fail("Cannot connect to the Wayland compositor");
+      }
+
+      static const wl_registry_listener registry_listener = {
+         [](void *data, wl_registry *registry, uint32_t name, const char *interface, uint32_t) {
+            auto *window = static_cast<native_window *>(data);
+            if (!std::strcmp(interface, wl_compositor_interface.name))
+            {
+               window->m_compositor =
+                  static_cast<wl_compositor *>(wl_registry_bind(registry, name, &wl_compositor_interface, 1));
+            }
+            else if (!std::strcmp(interface, xdg_wm_base_interface.name))
+            {
+               window->m_wm_base =
+                  static_cast<xdg_wm_base *>(wl_registry_bind(registry, name, &xdg_wm_base_interface, 1));
+            }
+         },
+         [](void *, wl_registry *, uint32_t) {},
+      };
+      m_registry = wl_display_get_registry(m_display);
+      wl_registry_add_listener(m_registry, &registry_listener, this);
+      wl_display_roundtrip(m_display);
+      if (m_compositor == nullptr || m_wm_base == nullptr)
+      {
+         fail("The compositor does not support xdg_wm_base");
+      }
+
+      static const xdg_wm_base_listener wm_base_listener = {
+         [](void *, xdg_wm_base *wm_base, uint32_t serial) { xdg_wm_base_pong(wm_base, serial); },
+      };
+      xdg_wm_base_add_listener(m_wm_base, &wm_base_listener, this);
+
+      static const xdg_surface_listener surface_listener = {
+         [](void *data, xdg_surface *surface, uint32_t serial) {
+            xdg_surface_ack_configure(surface, serial);
+            static_cast<native_window *>(data)->m_configured = true;
+         },
+      };
+      /* Set member by member, the listener grows with the protocol version. */
+      static xdg_toplevel_listener toplevel_listener = {};
+      toplevel_listener.configure = [](void *, xdg_toplevel *, int32_t, int32_t, wl_array *) {};
+      toplevel_listener.close = [](void *, xdg_toplevel *) {};
+
+      m_surface = wl_compositor_create_surface(m_compositor);
+      m_xdg_surface = xdg_wm_base_get_xdg_surface(m_wm_base, m_surface);
+      xdg_surface_add_listener(m_xdg_surface, &surface_listener, this);
+      m_toplevel = xdg_surface_get_toplevel(m_xdg_surface);
+      xdg_toplevel_add_listener(m_toplevel, &toplevel_listener, this);
+      xdg_toplevel_set_title(m_toplevel, "wsi_present_benchmark");
+      xdg_toplevel_set_min_size(m_toplevel, static_cast<int32_t>(opts.width), static_cast<int32_t>(opts.height));
+      wl_surface_commit(m_surface);
+      while (!m_configured && wl_display_dispatch(m_display) >= 0)
+      {
+      }
+   }
+
+   wl_display *m_display = nullptr;
+   wl_registry *m_registry = nullptr;
+   wl_compositor *m_compositor = nullptr;
+   xdg_wm_base *m_wm_base = nullptr;
+   wl_surface *m_surface = nullptr;
+   xdg_surface *m_xdg_surface = nullptr;
+   xdg_toplevel *m_toplevel = nullptr;
+   bool m_configured = false;
+#endif
+};
+
+const char *surface_extension_name(backend value)
+{
+   switch (value)
+   {
+   case backend::headless:
+      return VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME;
+   case backend::xcb:
+      return "VK_KHR_xcb_surface";
+   case backend::wayland:
+      return "VK_KHR_wayland_surface";
+   case backend::display:
+      return VK_KHR_DISPLAY_EXTENSION_NAME;
+   }
+   return nullptr;
+}
+
+bool has_extension(const std::vector<VkExtensionProperties> &extensions, const char *name)
+{
+   return std::any_of(extensions.begin(), extensions.end(),
+                      [name](const VkExtensionProperties &ext) { return !std::strcmp(ext.extensionName, name); });
+}
+
+/**
+ * @brief Samples of one metric, in microseconds.
+ */
+class metric
+{
+public:
+   void add(std::chrono::steady_clock::duration sample)
+   {
+      m_samples.push_back(std::chrono::duration<double, std::micro>(sample).count());
+   }
+
+   /**
+    * @brief Print the statistics as a JSON object, null when there is no sample.
+    */
+   void print(const char *name) const
+   {
+      if (m_samples.empty())
+      {
+         std::printf("\"%s\":null", name);
+         return;
+      }
+
+      std::vector<double> sorted = m_samples;
+      std::sort(sorted.begin(), sorted.end());
+      double sum = 0.0;
+      for (double sample : sorted)
+      {
+         sum += sample;
+      }
+      const double mean = sum / static_cast<double>(sorted.size());
+      double variance = 0.0;
+      for (double sample : sorted)
+      {
+         variance += (sample - mean) * (sample - mean);
+      }
+      variance /= static_cast<double>(sorted.size());
+
+      auto percentile = [&sorted](size_t percent) {
+         return sorted[std::min(sorted.size() - 1, sorted.size() * percent / 100)];
+      };
+      std::printf("\"%s\":{\"mean\":%.1f,\"stddev\":%.1f,\"min\":%.1f,\"p50\":%.1f,\"p99\":%.1f,\"max\":%.1f}", name,
+                  mean, std::sqrt(variance), sorted.front(), percentile(50), percentile(99), sorted.back());
+   }
+
+private:
+   std::vector<double> m_samples;
+};
+
+struct device_context
+{
+   VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+   VkDevice device = VK_NULL_HANDLE;
+   uint32_t queue_family = 0;
+   VkQueue queue = VK_NULL_HANDLE;
+   bool present_wait = false;
+   PFN_vkWaitForPresentKHR wait_for_present = nullptr;
+};
+
+device_context create_device(VkPhysicalDevice physical_device, VkSurfaceKHR surface, const options &opts)
+{
+   device_context ctx;
+   ctx.physical_device = physical_device;
+
+   uint32_t family_count = 0;
+   vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, nullptr);
+   std::vector<VkQueueFamilyProperties> families(family_count);
+   vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families.data());
+   bool found = false;
+   for (uint32_t i = 0; i < family_count && !found; i++)
+   {
+      VkBool32 supported = VK_FALSE;
+      VK_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, surface, &supported));
+      if (supported && (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+      {
+         ctx.queue_family = i;
+         found = true;
+      }
+   }
+   if (!found)
+   {
+      fail("No graphics queue can present to the surface");
+   }
+
+   uint32_t ext_count = 0;
+   VK_CHECK(vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &ext_count, nullptr));
+   std::vector<VkExtensionProperties> extensions(ext_count);
+   VK_CHECK(vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &ext_count, extensions.data()));
+
+   std::vector<const char *> enabled = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+
+   VkPhysicalDevicePresentIdFeaturesKHR present_id_features = {};
+   present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+   VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features = {};
+   present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+   present_wait_features.pNext = &present_id_features;
+   VkPhysicalDeviceFeatures2 features = {};
+   features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+   features.pNext = &present_wait_features;
+
+   if (opts.present_wait && has_extension(extensions, VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+       has_extension(extensions, VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+   {
+      vkGetPhysicalDeviceFeatures2(physical_device, &features);
+      ctx.present_wait = present_id_features.presentId && present_wait_features.presentWait;
+   }
+   if (ctx.present_wait)
+   {
+      enabled.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+      enabled.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+   }
+
+   const float priority = 1.0f;
+   VkDeviceQueueCreateInfo queue_info = {};
+   queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+   queue_info.queueFamilyIndex = ctx.queue_family;
+   queue_info.queueCount = 1;
+   queue_info.pQueuePriorities = &priority;
+
+   VkDeviceCreateInfo device_info = {};
+   device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+   device_info.pNext = ctx.present_wait ? &present_wait_features : nullptr;
+   device_info.queueCreateInfoCount = 1;
+   device_info.pQueueCreateInfos = &queue_info;
+   device_info.enabledExtensionCount = static_cast<uint32_t>(enabled.size());
+   device_info.ppEnabledExtensionNames = enabled.data();
+   VK_CHECK(vkCreateDevice(physical_device, &device_info, nullptr, &ctx.device));
+
+   vkGetDeviceQueue(ctx.device, ctx.queue_family, 0, &ctx.queue);
+   if (ctx.present_wait)
+   {
+      ctx.wait_for_present =
+         reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(ctx.device, "vkWaitForPresentKHR"));
+      ctx.present_wait = ctx.wait_for_present != nullptr;
+   }
+   return ctx;
+}
+
+/* Frames recorded and submitted ahead of the one being presented. */
+constexpr uint32_t FRAMES_IN_FLIGHT = 2;
+
+/**
+ * @brief Fill @p info for a swapchain on @p surface with the first format of the surface and FIFO.
+ *
+ * @param extent Used when the surface does not decide the extent, clamped to the limits of the surface.
+ */
+void fill_swapchain_info(const device_context &ctx, VkSurfaceKHR surface, VkExtent2D extent, uint32_t image_count,
+                         VkSwapchainCreateInfoKHR *info)
+{
+   VkSurfaceCapabilitiesKHR caps = {};
+   VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(ctx.physical_device, surface, &caps));
+
+   if (caps.currentExtent.width != UINT32_MAX)
+   {
+      extent = caps.currentExtent;
+   }
+   else
+   {
+      extent.width = std::clamp(extent.width, caps.minImageExtent.width, caps.maxImageExtent.width);
+      extent.height = std::clamp(extent.height, caps.minImageExtent.height, caps.maxImageExtent.height);
+   }
+
+   uint32_t format_count = 0;
+   VK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(ctx.physical_device, surface, &format_count, nullptr));
+   std::vector<VkSurfaceFormatKHR> formats(format_count);
+   VK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(ctx.physical_device, surface, &format_count, formats.data()));
+   if (formats.empty())
+   {
+      fail("The surface has no format");
+   }
+
+   const bool can_clear = (caps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0;
+
+   *info = {};
+   info->sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+   info->surface = surface;
+   info->minImageCount = std::max(caps.minImageCount, image_count);
+   if (caps.maxImageCount != 0)
+   {
+      info->minImageCount = std::min(info->minImageCount, caps.maxImageCount);
+   }
+   info->imageFormat = formats[0].format;
+   info->imageColorSpace = formats[0].colorSpace;
+   info->imageExtent = extent;
+   info->imageArrayLayers = 1;
+   info->imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (can_clear ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : 0);
+   info->imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+   info->preTransform = caps.currentTransform;
+   info->compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+   if (!(caps.supportedCompositeAlpha & VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR))
+   {
+      info->compositeAlpha = VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR;
+   }
+   info->presentMode = VK_PRESENT_MODE_FIFO_KHR;
+   info->clipped = VK_TRUE;
+}
+
+/**
+ * @brief A swapchain and the objects its frames are rendered with.
+ */
+struct swapchain_context
+{
+   VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+   std::vector<VkImage> images;
+   /* Whether the frames are cleared, which needs VK_IMAGE_USAGE_TRANSFER_DST_BIT. */
+   bool can_clear = false;
+   VkCommandPool pool = VK_NULL_HANDLE;
+   VkCommandBuffer command_buffers[FRAMES_IN_FLIGHT] = {};
+   VkSemaphore acquire_semaphores[FRAMES_IN_FLIGHT] = {};
+   VkFence fences[FRAMES_IN_FLIGHT] = {};
+   /* One per image, as a present may still wait on the semaphore when the frame slot is reused. */
+   std::vector<VkSemaphore> render_semaphores;
+};
+
+/**
+ * @brief Create the swapchain described by @p info, returns the result of vkCreateSwapchainKHR.
+ */
+VkResult create_swapchain_context(const device_context &ctx, const VkSwapchainCreateInfoKHR &info,
+                                  swapchain_context *sc)
+{
+   VkResult result = vkCreateSwapchainKHR(ctx.device, &info, nullptr, &sc->swapchain);
+   if (result != VK_SUCCESS)
+   {
+      return result;
+   }
+   sc->can_clear = (info.imageUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0;
+
+   uint32_t image_count = 0;
+   VK_CHECK(vkGetSwapchainImagesKHR(ctx.device, sc->swapchain, &image_count, nullptr));
+   sc->images.resize(image_count);
+   VK_CHECK(vkGetSwapchainImagesKHR(ctx.device, sc->swapchain, &image_count, sc->images.data()));
+
+   VkCommandPoolCreateInfo pool_info = {};
+   pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+   pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+   pool_info.queueFamilyIndex = ctx.queue_family;
+   VK_CHECK(vkCreateCommandPool(ctx.device, &pool_info, nullptr, &sc->pool));
+
+   VkCommandBufferAllocateInfo alloc_info = {};
+   alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+   alloc_info.commandPool = sc->pool;
+   alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+   alloc_info.commandBufferCount = FRAMES_IN_FLIGHT;
+   VK_CHECK(vkAllocateCommandBuffers(ctx.device, &alloc_info, sc->command_buffers));
+
+   VkSemaphoreCreateInfo semaphore_info = {};
+   semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+   VkFenceCreateInfo fence_info = {};
+   fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+   fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+   for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+   {
+      VK_CHECK(vkCreateSemaphore(ctx.device, &semaphore_info, nullptr, &sc->acquire_semaphores[i]));
+      VK_CHECK(vkCreateFence(ctx.device, &fence_info, nullptr, &sc->fences[i]));
+   }
+   sc->render_semaphores.resize(image_count);
+   for (VkSemaphore &semaphore : sc->render_semaphores)
+   {
+      VK_CHECK(vkCreateSemaphore(ctx.device, &semaphore_info, nullptr, &semaphore));
+   }
+   return VK_SUCCESS;
+}
+
+void destroy_swapchain_context(const device_context &ctx, swapchain_context *sc)
+{
+   VK_CHECK(vkDeviceWaitIdle(ctx.device));
+   for (VkSemaphore semaphore : sc->render_semaphores)
+   {
+      vkDestroySemaphore(ctx.device, semaphore, nullptr);
+   }
+   for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+   {
+      vkDestroySemaphore(ctx.device, sc->acquire_semaphores[i], nullptr);
+      vkDestroyFence(ctx.device, sc->fences[i], nullptr);
+   }
+   vkDestroyCommandPool(ctx.device, sc->pool, nullptr);
+   vkDestroySwapchainKHR(ctx.device, sc->swapchain, nullptr);
+   *sc = swapchain_context{};
+}
+
+/**
+ * @brief Record and submit the rendering of @p image_index in frame slot @p slot, which signals the render semaphore
+ *        of the image once the acquire semaphore of the slot is signaled.
+ */
+void submit_frame(const device_context &ctx, const swapchain_context &sc, uint32_t slot, uint32_t image_index,
+                  uint32_t frame, uint32_t gpu_load)
+{
+   VK_CHECK(vkResetFences(ctx.device, 1, &sc.fences[slot]));
+
+   VkCommandBuffer cmd = sc.command_buffers[slot];
+   VK_CHECK(vkResetCommandBuffer(cmd, 0));
+   VkCommandBufferBeginInfo begin_info = {};
+   begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+   begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+   VK_CHECK(vkBeginCommandBuffer(cmd, &begin_info));
+
+   VkImageMemoryBarrier barrier = {};
+   barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+   barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+   barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+   barrier.image = sc.images[image_index];
+   barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+   barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+   if (sc.can_clear)
+   {
+      barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+      barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                           nullptr, 1, &barrier);
+
+      /* The workload: the first clear gives the frame its content, the others only keep the GPU busy. */
+      for (uint32_t clear = 0; clear <= gpu_load; clear++)
+      {
+         const float shade = static_cast<float>((frame + clear) % 64) / 63.0f;
+         VkClearColorValue color = { { shade, 0.5f, 1.0f - shade, 1.0f } };
+         vkCmdClearColorImage(cmd, sc.images[image_index], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1,
+                              &barrier.subresourceRange);
+      }
+
+      barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = 0;
+   }
+   barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+   vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0,
+                        nullptr, 1, &barrier);
+   VK_CHECK(vkEndCommandBuffer(cmd));
+
+   const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+   VkSubmitInfo submit_info = {};
+   submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+   submit_info.waitSemaphoreCount = 1;
+   submit_info.pWaitSemaphores = &sc.acquire_semaphores[slot];
+   submit_info.pWaitDstStageMask = &wait_stage;
+   submit_info.commandBufferCount = 1;
+   submit_info.pCommandBuffers = &cmd;
+   submit_info.signalSemaphoreCount = 1;
+   submit_info.pSignalSemaphores = &sc.render_semaphores[image_index];
+   VK_CHECK(vkQueueSubmit(ctx.queue, 1, &submit_info, sc.fences[slot]));
+}
+
+/**
+ * @brief Present @p image_index of @p sc, with @p present_id when it is not 0 and present IDs are enabled.
+ */
+VkResult present_frame(const device_context &ctx, const swapchain_context &sc, uint32_t image_index,
+                       uint64_t present_id)
+{
+   VkPresentIdKHR present_id_info = {};
+   present_id_info.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+   present_id_info.swapchainCount = 1;
+   present_id_info.pPresentIds = &present_id;
+
+   VkPresentInfoKHR present_info = {};
+   present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+   present_info.pNext = (ctx.present_wait && present_id != 0) ? &present_id_info : nullptr;
+   present_info.waitSemaphoreCount = 1;
+   present_info.pWaitSemaphores = &sc.render_semaphores[image_index];
+   present_info.swapchainCount = 1;
+   present_info.pSwapchains = &sc.swapchain;
+   present_info.pImageIndices = &image_index;
+   return vkQueuePresentKHR(ctx.queue, &present_info);
+}
+
+/**
+ * @brief Present @p opts.frames frames with @p mode and print the statistics.
+ */
+void run_present_mode(const device_context &ctx, VkSurfaceKHR surface, VkPresentModeKHR mode, const options &opts,
+                      native_window &window)
+{
+   VkSwapchainCreateInfoKHR swapchain_info = {};
+   fill_swapchain_info(ctx, surface, { opts.width, opts.height }, opts.image_count, &swapchain_info);
+   swapchain_info.presentMode = mode;
+
+   swapchain_context sc;
+   VK_CHECK(create_swapchain_context(ctx, swapchain_info, &sc));
+
+   metric acquire;
+   metric present;
+   metric present_to_display;
+   metric frame_time;
+   std::chrono::steady_clock::time_point previous_present = {};
+   uint32_t out_of_date = 0;
+
+   for (uint32_t frame = 0; frame < opts.frames; frame++)
+   {
+      window.dispatch_events();
+
+      const uint32_t slot = frame % FRAMES_IN_FLIGHT;
+      VK_CHECK(vkWaitForFences(ctx.device, 1, &sc.fences[slot], VK_TRUE, UINT64_MAX));
+
+      uint32_t image_index = 0;
+      const auto acquire_start = std::chrono::steady_clock::now();
+      VkResult result = vkAcquireNextImageKHR(ctx.device, sc.swapchain, UINT64_MAX, sc.acquire_semaphores[slot],
+                                              VK_NULL_HANDLE, &image_index);
+      acquire.add(std::chrono::steady_clock::now() - acquire_start);
+      if (result == VK_ERROR_OUT_OF_DATE_KHR)
+      {
+         out_of_date++;
+         break;
+      }
+      VK_CHECK(result);
+
+      submit_frame(ctx, sc, slot, image_index, frame, opts.gpu_load);
+
+      const uint64_t present_id = frame + 1;
+      const auto present_start = std::chrono::steady_clock::now();
+      result = present_frame(ctx, sc, image_index, present_id);
+      const auto present_end = std::chrono::steady_clock::now();
+      present.add(present_end - present_start);
+      if (frame > 0)
+      {
+         frame_time.add(present_end - previous_present);
+      }
+      previous_present = present_end;
+      if (result == VK_ERROR_OUT_OF_DATE_KHR)
+      {
+         out_of_date++;
+         break;
+      }
+      VK_CHECK(result);
+
+      if (ctx.present_wait)
+      {
+         result = ctx.wait_for_present(ctx.device, sc.swapchain, present_id, 1000000000ull);
+         if (result == VK_SUCCESS)
+         {
+            present_to_display.add(std::chrono::steady_clock::now() - present_end);
+         }
+      }
+   }
+
+   VK_CHECK(vkDeviceWaitIdle(ctx.device));
+
+   std::printf("{\"backend\":\"%s\",\"present_mode\":\"%s\",\"width\":%u,\"height\":%u,\"images\":%u,"
+               "\"gpu_load\":%u,\"frames\":%u,\"out_of_date\":%u,",
+               backend_name(opts.selected_backend), present_mode_name(mode), swapchain_info.imageExtent.width,
+               swapchain_info.imageExtent.height, static_cast<uint32_t>(sc.images.size()), opts.gpu_load,
+               opts.frames, out_of_date);
+   acquire.print("acquire");
+   std::printf(",");
+   present.print("present");
+   std::printf(",");
+   present_to_display.print("present_to_display");
+   std::printf(",");
+   frame_time.print("frame_time");
+   std::printf("}\n");
+   std::fflush(stdout);
+
+   destroy_swapchain_context(ctx, &sc);
+}
+
+/**
+ * @brief Read the records of the capture file at @p path, or exit when it is not a capture.
+ */
+std::vector<util::capture::record> read_capture(const char *path)
+{
+   std::FILE *file = std::fopen(path, "rb");
+   if (file == nullptr)
+   {
+      fail("Cannot open the capture file");
+   }
+
+   util::capture::file_header header = {};
+   if (std::fread(&header, sizeof(header), 1, file) != 1 ||
+       std::memcmp(header.magic, util::capture::FILE_MAGIC, sizeof(header.magic)) != 0 ||
+       header.version != util::capture::FILE_VERSION || header.record_size != sizeof(util::capture::record))
+   {
+      fail("The file is not a capture of this version of the layer");
+   }
+
+   std::vector<util::capture::record> records;
+   util::capture::record rec;
+   while (std::fread(&rec, sizeof(rec), 1, file) == 1)
+   {
+      records.push_back(rec);
+   }
+   std::fclose(file);
+   return records;
+}
+
+/**
+ * @brief State of a captured swapchain during the replay.
+ */
+struct replayed_swapchain
+{
+   swapchain_context sc;
+   /* Acquisitions not presented yet, in acquire order, as frame slot and image index. */
+   std::deque<std::pair<uint32_t, uint32_t>> acquired;
+   uint32_t acquire_count = 0;
+};
+
+/**
+ * @brief Replay the calls captured in @p opts.replay_file on @p surface and print the statistics of the captured and
+ *        replayed calls.
+ *
+ * The calls are made no earlier than they were in the capture relative to its first call, so the time the application
+ * spent between them is kept, and later when the replay falls behind. The frames are the images acquired in the
+ * replay, in acquire order, as the layer may hand out other images than it did in the capture.
+ */
+void run_replay(const device_context &ctx, VkSurfaceKHR surface, const options &opts, native_window &window)
+{
+   const std::vector<util::capture::record> records = read_capture(opts.replay_file);
+   if (records.empty())
+   {
+      fail("The capture has no record");
+   }
+
+   uint32_t mode_count = 0;
+   VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(ctx.physical_device, surface, &mode_count, nullptr));
+   std::vector<VkPresentModeKHR> modes(mode_count);
+   VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(ctx.physical_device, surface, &mode_count, modes.data()));
+
+   uint32_t format_count = 0;
+   VK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(ctx.physical_device, surface, &format_count, nullptr));
+   std::vector<VkSurfaceFormatKHR> formats(format_count);
+   VK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(ctx.physical_device, surface, &format_count, formats.data()));
+
+   enum call
+   {
+      CALL_ACQUIRE,
+      CALL_PRESENT,
+      CALL_PRESENT_WAIT,
+      CALL_COUNT,
+   };
+   static constexpr const char *call_names[CALL_COUNT] = { "acquire", "present", "present_wait" };
+   metric captured[CALL_COUNT];
+   metric replayed[CALL_COUNT];
+   uint32_t result_mismatches = 0;
+   uint32_t skipped = 0;
+
+   std::unordered_map<uint64_t, replayed_swapchain> swapchains;
+   const uint64_t capture_start_ns = records.front().timestamp_ns;
+   const auto replay_start = std::chrono::steady_clock::now();
+
+   for (const util::capture::record &rec : records)
+   {
+      window.dispatch_events();
+      std::this_thread::sleep_until(replay_start + std::chrono::nanoseconds(rec.timestamp_ns - capture_start_ns));
+
+      auto it = swapchains.find(rec.swapchain);
+      if (rec.type != util::capture::record_type::create_swapchain && it == swapchains.end())
+      {
+         skipped++;
+         continue;
+      }
+
+      VkResult result = VK_SUCCESS;
+      const auto call_start = std::chrono::steady_clock::now();
+      switch (rec.type)
+      {
+      case util::capture::record_type::create_swapchain:
+      {
+         if (rec.result != VK_SUCCESS)
+         {
+            skipped++;
+            continue;
+         }
+         const VkExtent2D extent = { static_cast<uint32_t>(rec.args[0]), static_cast<uint32_t>(rec.args[0] >> 32) };
+         VkSwapchainCreateInfoKHR info = {};
+         fill_swapchain_info(ctx, surface, extent, static_cast<uint32_t>(rec.args[2]), &info);
+
+         /* Keep the defaults for what the surface of the replay does not support. */
+         const auto format = static_cast<VkFormat>(static_cast<uint32_t>(rec.args[1]));
+         for (const VkSurfaceFormatKHR &candidate : formats)
+         {
+            if (candidate.format == format)
+            {
+               info.imageFormat = candidate.format;
+               info.imageColorSpace = candidate.colorSpace;
+               break;
+            }
+         }
+         const auto mode = static_cast<VkPresentModeKHR>(static_cast<uint32_t>(rec.args[1] >> 32));
+         if (std::find(modes.begin(), modes.end(), mode) != modes.end())
+         {
+            info.presentMode = mode;
+         }
+         auto old = swapchains.find(rec.args[3]);
+         if (old != swapchains.end())
+         {
+            info.oldSwapchain = old->second.sc.swapchain;
+         }
+
+         replayed_swapchain replay;
+         result = create_swapchain_context(ctx, info, &replay.sc);
+         if (result == VK_SUCCESS)
+         {
+            swapchains[rec.swapchain] = std::move(replay);
+         }
+         break;
+      }
+      case util::capture::record_type::destroy_swapchain:
+         destroy_swapchain_context(ctx, &it->second.sc);
+         swapchains.erase(it);
+         break;
+      case util::capture::record_type::acquire:
+      {
+         replayed_swapchain &replay = it->second;
+         const uint32_t slot = replay.acquire_count % FRAMES_IN_FLIGHT;
+         VK_CHECK(vkWaitForFences(ctx.device, 1, &replay.sc.fences[slot], VK_TRUE, UINT64_MAX));
+
+         uint32_t image_index = 0;
+         const auto acquire_start = std::chrono::steady_clock::now();
+         result = vkAcquireNextImageKHR(ctx.device, replay.sc.swapchain, rec.args[0],
+                                        replay.sc.acquire_semaphores[slot], VK_NULL_HANDLE, &image_index);
+         replayed[CALL_ACQUIRE].add(std::chrono::steady_clock::now() - acquire_start);
+         captured[CALL_ACQUIRE].add(std::chrono::nanoseconds(rec.duration_ns));
+         if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)
+         {
+            replay.acquired.emplace_back(slot, image_index);
+            replay.acquire_count++;
+         }
+         break;
+      }
+      case util::capture::record_type::present:
+      {
+         replayed_swapchain &replay = it->second;
+         if (replay.acquired.empty())
+         {
+            skipped++;
+            continue;
+         }
+         const auto [slot, image_index] = replay.acquired.front();
+         replay.acquired.pop_front();
+         submit_frame(ctx, replay.sc, slot, image_index, replay.acquire_count, opts.gpu_load);
+
+         const auto present_start = std::chrono::steady_clock::now();
+         result = present_frame(ctx, replay.sc, image_index, rec.args[1]);
+         replayed[CALL_PRESENT].add(std::chrono::steady_clock::now() - present_start);
+         captured[CALL_PRESENT].add(std::chrono::nanoseconds(rec.duration_ns));
+         break;
+      }
+      case util::capture::record_type::wait_for_present:
+         if (!ctx.present_wait)
+         {
+            skipped++;
+            continue;
+         }
+         result = ctx.wait_for_present(ctx.device, it->second.sc.swapchain, rec.args[0], rec.args[1]);
+         replayed[CALL_PRESENT_WAIT].add(std::chrono::steady_clock::now() - call_start);
+         captured[CALL_PRESENT_WAIT].add(std::chrono::nanoseconds(rec.duration_ns));
+         break;
+      default:
+         skipped++;
+         continue;
+      }
+
+      if (static_cast<int32_t>(result) != rec.result)
+      {
+         result_mismatches++;
+      }
+   }
+
+   for (auto &entry : swapchains)
+   {
+      destroy_swapchain_context(ctx, &entry.second.sc);
+   }
+
+   std::printf("{\"backend\":\"%s\",\"replay\":\"%s\",\"records\":%zu,\"skipped\":%u,\"result_mismatches\":%u",
+               backend_name(opts.selected_backend), opts.replay_file, records.size(), skipped, result_mismatches);
+   auto print_calls = [](const char *name, const metric *metrics) {
+      std::printf(",\"%s\":{", name);
+      for (uint32_t i = 0; i < CALL_COUNT; i++)
+      {
+         std::printf(i == 0 ? "" : ",");
+         metrics[i].print(call_names[i]);
+      }
+      std::printf("}");
+   };
+   print_calls("captured", captured);
+   print_calls("replayed", replayed);
+   std::printf("}\n");
+   std::fflush(stdout);
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+   options opts;
+   if (!parse_options(argc, argv, &opts))
+   {
+      std::fprintf(stderr,
+                   "usage: %s [--backend headless|xcb|wayland|display] [--frames <count>] [--gpu-load <clears>]\n"
+                   "          [--mode fifo|fifo_relaxed|mailbox|immediate] [--size <width>x<height>]\n"
+                   "          [--images <count>] [--no-present-wait] [--enable-layer] [--replay <capture>]\n",
+                   argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   const char *instance_extensions[] = { VK_KHR_SURFACE_EXTENSION_NAME,
+                                         surface_extension_name(opts.selected_backend) };
+   const char *layer_name = "VK_LAYER_window_system_integration";
+
+   VkApplicationInfo app_info = {};
+   app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+   app_info.pApplicationName = "wsi_present_benchmark";
+   app_info.apiVersion = VK_API_VERSION_1_1;
+
+   VkInstanceCreateInfo instance_info = {};
+   instance_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+   instance_info.pApplicationInfo = &app_info;
+   instance_info.enabledExtensionCount = 2;
+   instance_info.ppEnabledExtensionNames = instance_extensions;
+   instance_info.enabledLayerCount = opts.enable_layer ? 1 : 0;
+   instance_info.ppEnabledLayerNames = &layer_name;
+
+   VkInstance instance = VK_NULL_HANDLE;
+   VK_CHECK(vkCreateInstance(&instance_info, nullptr, &instance));
+
+   uint32_t physical_device_count = 1;
+   VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+   VkResult result = vkEnumeratePhysicalDevices(instance, &physical_device_count, &physical_device);
+   if ((result != VK_SUCCESS && result != VK_INCOMPLETE) || physical_device_count == 0)
+   {
+      fail("No physical device");
+   }
+
+   {
+      native_window window;
+      VkSurfaceKHR surface = window.create_surface(instance, physical_device, opts);
+      device_context ctx = create_device(physical_device, surface, opts);
+      if (opts.replay_file != nullptr)
+      {
+         run_replay(ctx, surface, opts, window);
+      }
+      else
+      {
+         uint32_t mode_count = 0;
+         VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &mode_count, nullptr));
+         std::vector<VkPresentModeKHR> modes(mode_count);
+         VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &mode_count, modes.data()));
+
+         for (VkPresentModeKHR mode : modes)
+         {
+            const bool selected =
+               opts.modes.empty() || std::find(opts.modes.begin(), opts.modes.end(), mode) != opts.modes.end();
+            /* Shared presentable image modes need a different frame loop. */
+            if (selected && present_mode_name(mode) != nullptr)
+            {
+               run_present_mode(ctx, surface, mode, opts, window);
+            }
+         }
+      }
+
+      vkDestroyDevice(ctx.device, nullptr);
+      vkDestroySurfaceKHR(instance, surface, nullptr);
+   }
+
+   vkDestroyInstance(instance, nullptr);
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,772 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file swapchain_scaling_benchmark.cpp
+ *
+ * @brief Scaling of the layer with the number of threads creating, acquiring from and presenting to swapchains at once.
+ *
+ * For every number of threads (1, 2, 4, ... up to --threads) and of swapchains (1, 2, 4, ... up to --swapchains, at
+ * least one per thread), each thread creates its share of the swapchains on headless surfaces, presents --frames
+ * frames to each of them in turn and destroys them, all the threads at the same time. Each phase starts on all the
+ * threads together. For every configuration a JSON object is printed on its own line of stdout with:
+ * - presents_per_second: presents of all the threads over the duration of the frame loops.
+ * - create_surface, create_swapchain, acquire, present and destroy_swapchain: percentiles (us) of the durations of
+ *   vkCreateHeadlessSurfaceEXT, vkCreateSwapchainKHR, vkAcquireNextImageKHR, vkQueuePresentKHR and
+ *   vkDestroySwapchainKHR.
+ * - acquire_overhead: mean time (us) vkAcquireNextImageKHR spent other than waiting for a free image, from the acquire
+ *   wait statistics of vkGetSwapchainFrameStatisticsARM. Null when the layer does not provide the statistics.
+ * - contended: the calls that slowed down more than CONTENTION_FACTOR times over one thread presenting to the same
+ *   number of swapchains: the p99 of acquire and present, and the acquire overhead. Time spent in the layer that is
+ *   not waiting on the presentation engine grows with the threads when they wait on the locks of the layer
+ *   (the global dispatch data lock, the surface and swapchain lists of the instance and device, and the mutexes of
+ *   the swapchains).
+ *
+ * Threads share the queues of the device, up to one each, and only time the layer calls once they own their queue.
+ *
+ * Usage:
+ *
+ *    wsi_scaling_benchmark [--threads <count>] [--swapchains <count>] [--frames <count>] [--size <width>x<height>]
+ *                          [--images <count>] [--enable-layer]
+ *
+ * The layer is expected to be installed as an implicit layer, --enable-layer enables it explicitly instead.
+ */
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "layer/wsi_layer_experimental.hpp"
+
+namespace
+{
+
+#define VK_CHECK(expression)                                                                                \
+   do                                                                                                       \
+   {                                                                                                        \
+      VkResult check_result = (expression);                                                                 \
+      if (check_result < VK_SUCCESS)                                                                        \
+      {                                                                                                     \
+         std::fprintf(stderr, "%s:%d: %s failed with %d\n", __FILE__, __LINE__, #expression, check_result); \
+         std::exit(EXIT_FAILURE);                                                                           \
+      }                                                                                                     \
+   } while (0)
+
+[[noreturn]] void fail(const char *message)
+{
+   std::fprintf(stderr, "%s\n", message);
+   std::exit(EXIT_FAILURE);
+}
+
+/* Slowdown over one thread above which a call is reported as contended. */
+constexpr double CONTENTION_FACTOR = 2.0;
+
+/* Frames submitted ahead of the one being presented, per swapchain. */
+constexpr uint32_t FRAMES_IN_FLIGHT = 2;
+
+struct options
+{
+   uint32_t threads = 8;
+   uint32_t swapchains = 32;
+   uint32_t frames = 200;
+   uint32_t width = 640;
+   uint32_t height = 480;
+   uint32_t image_count = 3;
+   bool enable_layer = false;
+};
+
+bool parse_options(int argc, char **argv, options *opts)
+{
+   for (int i = 1; i < argc; i++)
+   {
+      const char *arg = argv[i];
+      const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+      if (!std::strcmp(arg, "--threads") && value != nullptr)
+      {
+         opts->threads = static_cast<uint32_t>(std::max(1l, std::strtol(value, nullptr, 10)));
+         i++;
+      }
+      else if (!std::strcmp(arg, "--swapchains") && value != nullptr)
+      {
+         opts->swapchains = static_cast<uint32_t>(std::max(1l, std::strtol(value, nullptr, 10)));
+         i++;
+      }
+      else if (!std::strcmp(arg, "--frames") && value != nullptr)
+      {
+         opts->frames = static_cast<uint32_t>(std::max(1l, std::strtol(value, nullptr, 10)));
+         i++;
+      }
+      else if (!std::strcmp(arg, "--images") && value != nullptr)
+      {
+         opts->image_count = static_cast<uint32_t>(std::max(1l, std::strtol(value, nullptr, 10)));
+         i++;
+      }
+      else if (!std::strcmp(arg, "--size") && value != nullptr)
+      {
+         if (std::sscanf(value, "%ux%u", &opts->width, &opts->height) != 2 || opts->width == 0 || opts->height == 0)
+         {
+            return false;
+         }
+         i++;
+      }
+      else if (!std::strcmp(arg, "--enable-layer"))
+      {
+         opts->enable_layer = true;
+      }
+      else
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+ * @brief Samples of one call, in microseconds.
+ */
+class metric
+{
+public:
+   void add(std::chrono::steady_clock::duration sample)
+   {
+      m_samples.push_back(std::chrono::duration<double, std::micro>(sample).count());
+   }
+
+   void merge(const metric &other)
+   {
+      m_samples.insert(m_samples.end(), other.m_samples.begin(), other.m_samples.end());
+   }
+
+   size_t count() const
+   {
+      return m_samples.size();
+   }
+
+   double total() const
+   {
+      double sum = 0.0;
+      for (double sample : m_samples)
+      {
+         sum += sample;
+      }
+      return sum;
+   }
+
+   /**
+    * @brief Sort the samples, before reading the percentiles.
+    */
+   void sort()
+   {
+      std::sort(m_samples.begin(), m_samples.end());
+   }
+
+   /**
+    * @brief Percentile of the sorted samples, in tenths of a percent.
+    */
+   double percentile(size_t permille) const
+   {
+      if (m_samples.empty())
+      {
+         return 0.0;
+      }
+      return m_samples[std::min(m_samples.size() - 1, m_samples.size() * permille / 1000)];
+   }
+
+   /**
+    * @brief Print the statistics of the sorted samples as a JSON object, null when there is no sample.
+    */
+   void print(const char *name) const
+   {
+      if (m_samples.empty())
+      {
+         std::printf("\"%s\":null", name);
+         return;
+      }
+      std::printf("\"%s\":{\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}", name,
+                  total() / static_cast<double>(m_samples.size()), percentile(500), percentile(900), percentile(990),
+                  percentile(999), m_samples.back());
+   }
+
+private:
+   std::vector<double> m_samples;
+};
+
+/**
+ * @brief Reusable barrier, the threads of a configuration start each phase together.
+ */
+class barrier
+{
+public:
+   explicit barrier(uint32_t count)
+      : m_count(count)
+   {
+   }
+
+   void arrive_and_wait()
+   {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      const uint64_t generation = m_generation;
+      if (++m_arrived == m_count)
+      {
+         m_arrived = 0;
+         m_generation++;
+         m_condition.notify_all();
+         return;
+      }
+      m_condition.wait(lock, [&]() { return m_generation != generation; });
+   }
+
+private:
+   std::mutex m_mutex;
+   std::condition_variable m_condition;
+   const uint32_t m_count;
+   uint32_t m_arrived = 0;
+   uint64_t m_generation = 0;
+};
+
+/**
+ * @brief A queue of the device, shared by the threads using it.
+ */
+struct shared_queue
+{
+   VkQueue queue = VK_NULL_HANDLE;
+   std::mutex mutex;
+};
+
+struct device_context
+{
+   VkInstance instance = VK_NULL_HANDLE;
+   VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+   VkDevice device = VK_NULL_HANDLE;
+   uint32_t queue_family = 0;
+   std::vector<std::unique_ptr<shared_queue>> queues;
+   PFN_vkCreateHeadlessSurfaceEXT create_headless_surface = nullptr;
+#if VULKAN_WSI_LAYER_EXPERIMENTAL
+   PFN_vkGetSwapchainFrameStatisticsARM get_frame_statistics = nullptr;
+#endif
+};
+
+VkSurfaceKHR create_surface(const device_context &ctx)
+{
+   VkHeadlessSurfaceCreateInfoEXT create_info = {};
+   create_info.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+   VkSurfaceKHR surface = VK_NULL_HANDLE;
+   VK_CHECK(ctx.create_headless_surface(ctx.instance, &create_info, nullptr, &surface));
+   return surface;
+}
+
+/**
+ * @brief Create the device with up to @p max_queues queues of a family that presents to headless surfaces.
+ */
+void create_device(device_context &ctx, uint32_t max_queues)
+{
+   VkSurfaceKHR surface = create_surface(ctx);
+
+   uint32_t family_count = 0;
+   vkGetPhysicalDeviceQueueFamilyProperties(ctx.physical_device, &family_count, nullptr);
+   std::vector<VkQueueFamilyProperties> families(family_count);
+   vkGetPhysicalDeviceQueueFamilyProperties(ctx.physical_device, &family_count, families.data());
+   uint32_t queue_count = 0;
+   for (uint32_t i = 0; i < family_count && queue_count == 0; i++)
+   {
+      VkBool32 supported = VK_FALSE;
+      VK_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(ctx.physical_device, i, surface, &supported));
+      if (supported && (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+      {
+         ctx.queue_family = i;
+         queue_count = std::min(families[i].queueCount, max_queues);
+      }
+   }
+   vkDestroySurfaceKHR(ctx.instance, surface, nullptr);
+   if (queue_count == 0)
+   {
+      fail("No graphics queue can present to headless surfaces");
+   }
+
+   const char *extensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+   std::vector<float> priorities(queue_count, 1.0f);
+   VkDeviceQueueCreateInfo queue_info = {};
+   queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+   queue_info.queueFamilyIndex = ctx.queue_family;
+   queue_info.queueCount = queue_count;
+   queue_info.pQueuePriorities = priorities.data();
+
+   VkDeviceCreateInfo device_info = {};
+   device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+   device_info.queueCreateInfoCount = 1;
+   device_info.pQueueCreateInfos = &queue_info;
+   device_info.enabledExtensionCount = 1;
+   device_info.ppEnabledExtensionNames = extensions;
+   VK_CHECK(vkCreateDevice(ctx.physical_device, &device_info, nullptr, &ctx.device));
+
+   for (uint32_t i = 0; i < queue_count; i++)
+   {
+      ctx.queues.push_back(std::make_unique<shared_queue>());
+      vkGetDeviceQueue(ctx.device, ctx.queue_family, i, &ctx.queues.back()->queue);
+   }
+
+#if VULKAN_WSI_LAYER_EXPERIMENTAL
+   ctx.get_frame_statistics = reinterpret_cast<PFN_vkGetSwapchainFrameStatisticsARM>(
+      vkGetDeviceProcAddr(ctx.device, "vkGetSwapchainFrameStatisticsARM"));
+#endif
+}
+
+/**
+ * @brief A swapchain on its own surface, with a command buffer per image moving it to the present layout.
+ */
+struct swapchain_context
+{
+   VkSurfaceKHR surface = VK_NULL_HANDLE;
+   VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+   VkCommandPool pool = VK_NULL_HANDLE;
+   std::vector<VkCommandBuffer> command_buffers;
+   VkSemaphore acquire_semaphores[FRAMES_IN_FLIGHT] = {};
+   VkFence fences[FRAMES_IN_FLIGHT] = {};
+   /* One per image, as a present may still wait on the semaphore when the frame slot is reused. */
+   std::vector<VkSemaphore> render_semaphores;
+};
+
+/**
+ * @brief Calls timed by a thread.
+ */
+struct thread_results
+{
+   metric create_surface;
+   metric create_swapchain;
+   metric acquire;
+   metric present;
+   metric destroy_swapchain;
+   /* Time spent in vkAcquireNextImageKHR waiting for a free image, from the frame statistics of the layer. */
+   uint64_t acquire_wait_ns = 0;
+   bool has_statistics = false;
+};
+
+void create_swapchain(const device_context &ctx, const options &opts, swapchain_context &sc, thread_results &results)
+{
+   auto start = std::chrono::steady_clock::now();
+   sc.surface = create_surface(ctx);
+   results.create_surface.add(std::chrono::steady_clock::now() - start);
+
+   VkSurfaceCapabilitiesKHR caps = {};
+   VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(ctx.physical_device, sc.surface, &caps));
+   uint32_t format_count = 1;
+   VkSurfaceFormatKHR format = {};
+   VkResult result = vkGetPhysicalDeviceSurfaceFormatsKHR(ctx.physical_device, sc.surface, &format_count, &format);
+   if ((result != VK_SUCCESS && result != VK_INCOMPLETE) || format_count == 0)
+   {
+      fail("The surface has no format");
+   }
+
+   VkSwapchainCreateInfoKHR info = {};
+   info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+   info.surface = sc.surface;
+   info.minImageCount = std::max(caps.minImageCount, opts.image_count);
+   if (caps.maxImageCount != 0)
+   {
+      info.minImageCount = std::min(info.minImageCount, caps.maxImageCount);
+   }
+   info.imageFormat = format.format;
+   info.imageColorSpace = format.colorSpace;
+   info.imageExtent = { std::clamp(opts.width, caps.minImageExtent.width, caps.maxImageExtent.width),
+                        std::clamp(opts.height, caps.minImageExtent.height, caps.maxImageExtent.height) };
+   info.imageArrayLayers = 1;
+   info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+   info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+   info.preTransform = caps.currentTransform;
+   info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+   info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+   info.clipped = VK_TRUE;
+
+   start = std::chrono::steady_clock::now();
+   VK_CHECK(vkCreateSwapchainKHR(ctx.device, &info, nullptr, &sc.swapchain));
+   results.create_swapchain.add(std::chrono::steady_clock::now() - start);
+
+   uint32_t image_count = 0;
+   VK_CHECK(vkGetSwapchainImagesKHR(ctx.device, sc.swapchain, &image_count, nullptr));
+   std::vector<VkImage> images(image_count);
+   VK_CHECK(vkGetSwapchainImagesKHR(ctx.device, sc.swapchain, &image_count, images.data()));
+
+   VkCommandPoolCreateInfo pool_info = {};
+   pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+   pool_info.queueFamilyIndex = ctx.queue_family;
+   VK_CHECK(vkCreateCommandPool(ctx.device, &pool_info, nullptr, &sc.pool));
+
+   VkCommandBufferAllocateInfo alloc_info = {};
+   alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+   alloc_info.commandPool = sc.pool;
+   alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+   alloc_info.commandBufferCount = image_count;
+   sc.command_buffers.resize(image_count);
+   VK_CHECK(vkAllocateCommandBuffers(ctx.device, &alloc_info, sc.command_buffers.data()));
+
+   /* The frames have no content, the command buffers are recorded once and only move the image to the present
+    * layout. */
+   for (uint32_t i = 0; i < image_count; i++)
+   {
+      VkCommandBufferBeginInfo begin_info = {};
+      begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      VK_CHECK(vkBeginCommandBuffer(sc.command_buffers[i], &begin_info));
+      VkImageMemoryBarrier image_barrier = {};
+      image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+      image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      image_barrier.image = images[i];
+      image_barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+      image_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+      image_barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+      vkCmdPipelineBarrier(sc.command_buffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                           VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+      VK_CHECK(vkEndCommandBuffer(sc.command_buffers[i]));
+   }
+
+   VkSemaphoreCreateInfo semaphore_info = {};
+   semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+   VkFenceCreateInfo fence_info = {};
+   fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+   fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+   for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+   {
+      VK_CHECK(vkCreateSemaphore(ctx.device, &semaphore_info, nullptr, &sc.acquire_semaphores[i]));
+      VK_CHECK(vkCreateFence(ctx.device, &fence_info, nullptr, &sc.fences[i]));
+   }
+   sc.render_semaphores.resize(image_count);
+   for (VkSemaphore &semaphore : sc.render_semaphores)
+   {
+      VK_CHECK(vkCreateSemaphore(ctx.device, &semaphore_info, nullptr, &semaphore));
+   }
+}
+
+void destroy_swapchain(const device_context &ctx, swapchain_context &sc, thread_results &results)
+{
+   VK_CHECK(vkWaitForFences(ctx.device, FRAMES_IN_FLIGHT, sc.fences, VK_TRUE, UINT64_MAX));
+
+   const auto start = std::chrono::steady_clock::now();
+   vkDestroySwapchainKHR(ctx.device, sc.swapchain, nullptr);
+   results.destroy_swapchain.add(std::chrono::steady_clock::now() - start);
+
+   for (VkSemaphore semaphore : sc.render_semaphores)
+   {
+      vkDestroySemaphore(ctx.device, semaphore, nullptr);
+   }
+   for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+   {
+      vkDestroySemaphore(ctx.device, sc.acquire_semaphores[i], nullptr);
+      vkDestroyFence(ctx.device, sc.fences[i], nullptr);
+   }
+   vkDestroyCommandPool(ctx.device, sc.pool, nullptr);
+   vkDestroySurfaceKHR(ctx.instance, sc.surface, nullptr);
+   sc = swapchain_context{};
+}
+
+/**
+ * @brief Present frame @p frame of @p sc, submitting and presenting on @p queue.
+ */
+void present_frame(const device_context &ctx, swapchain_context &sc, shared_queue &queue, uint32_t frame,
+                   thread_results &results)
+{
+   const uint32_t slot = frame % FRAMES_IN_FLIGHT;
+   VK_CHECK(vkWaitForFences(ctx.device, 1, &sc.fences[slot], VK_TRUE, UINT64_MAX));
+   VK_CHECK(vkResetFences(ctx.device, 1, &sc.fences[slot]));
+
+   uint32_t image_index = 0;
+   const auto acquire_start = std::chrono::steady_clock::now();
+   VK_CHECK(vkAcquireNextImageKHR(ctx.device, sc.swapchain, UINT64_MAX, sc.acquire_semaphores[slot], VK_NULL_HANDLE,
+                                  &image_index));
+   results.acquire.add(std::chrono::steady_clock::now() - acquire_start);
+
+   const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+   VkSubmitInfo submit_info = {};
+   submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+   submit_info.waitSemaphoreCount = 1;
+   submit_info.pWaitSemaphores = &sc.acquire_semaphores[slot];
+   submit_info.pWaitDstStageMask = &wait_stage;
+   submit_info.commandBufferCount = 1;
+   submit_info.pCommandBuffers = &sc.command_buffers[image_index];
+   submit_info.signalSemaphoreCount = 1;
+   submit_info.pSignalSemaphores = &sc.render_semaphores[image_index];
+
+   VkPresentInfoKHR present_info = {};
+   present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+   present_info.waitSemaphoreCount = 1;
+   present_info.pWaitSemaphores = &sc.render_semaphores[image_index];
+   present_info.swapchainCount = 1;
+   present_info.pSwapchains = &sc.swapchain;
+   present_info.pImageIndices = &image_index;
+
+   /* Queues are externally synchronized, only the layer call is timed once the queue is owned. */
+   std::lock_guard<std::mutex> lock(queue.mutex);
+   VK_CHECK(vkQueueSubmit(queue.queue, 1, &submit_info, sc.fences[slot]));
+   const auto present_start = std::chrono::steady_clock::now();
+   VK_CHECK(vkQueuePresentKHR(queue.queue, &present_info));
+   results.present.add(std::chrono::steady_clock::now() - present_start);
+}
+
+/**
+ * @brief Add the time the swapchain spent waiting for free images in vkAcquireNextImageKHR to @p results.
+ */
+void read_frame_statistics(const device_context &ctx, const swapchain_context &sc, thread_results &results)
+{
+#if VULKAN_WSI_LAYER_EXPERIMENTAL
+   if (ctx.get_frame_statistics == nullptr)
+   {
+      return;
+   }
+   VkSwapchainFrameStatisticsARM statistics = {};
+   statistics.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_FRAME_STATISTICS_ARM;
+   if (ctx.get_frame_statistics(ctx.device, sc.swapchain, &statistics) == VK_SUCCESS)
+   {
+      /* Stage 0 is the acquire wait. */
+      results.acquire_wait_ns += statistics.stages[0].totalNs;
+      results.has_statistics = true;
+   }
+#else
+   (void)ctx;
+   (void)sc;
+   (void)results;
+#endif
+}
+
+/**
+ * @brief Results of a configuration, merged from its threads.
+ */
+struct configuration_results
+{
+   thread_results calls;
+   double presents_per_second = 0.0;
+   /* Mean acquire time outside the acquire wait (us), negative without frame statistics. */
+   double acquire_overhead = -1.0;
+};
+
+configuration_results run_configuration(const device_context &ctx, const options &opts, uint32_t thread_count,
+                                        uint32_t swapchain_count)
+{
+   std::vector<thread_results> results(thread_count);
+   barrier phase(thread_count + 1);
+
+   std::vector<std::thread> threads;
+   for (uint32_t t = 0; t < thread_count; t++)
+   {
+      threads.emplace_back([&, t]() {
+         /* Swapchains are spread round robin over the threads. */
+         std::vector<swapchain_context> swapchains((swapchain_count - t + thread_count - 1) / thread_count);
+         shared_queue &queue = *ctx.queues[t % ctx.queues.size()];
+
+         phase.arrive_and_wait();
+         for (swapchain_context &sc : swapchains)
+         {
+            create_swapchain(ctx, opts, sc, results[t]);
+         }
+
+         phase.arrive_and_wait();
+         for (uint32_t frame = 0; frame < opts.frames; frame++)
+         {
+            for (swapchain_context &sc : swapchains)
+            {
+               present_frame(ctx, sc, queue, frame, results[t]);
+            }
+         }
+         phase.arrive_and_wait();
+
+         for (swapchain_context &sc : swapchains)
+         {
+            read_frame_statistics(ctx, sc, results[t]);
+         }
+         phase.arrive_and_wait();
+         for (swapchain_context &sc : swapchains)
+         {
+            destroy_swapchain(ctx, sc, results[t]);
+         }
+      });
+   }
+
+   /* Creation, frame loops, statistics and destruction. */
+   phase.arrive_and_wait();
+   phase.arrive_and_wait();
+   const auto frames_start = std::chrono::steady_clock::now();
+   phase.arrive_and_wait();
+   const auto frames_end = std::chrono::steady_clock::now();
+   phase.arrive_and_wait();
+   for (std::thread &thread : threads)
+   {
+      thread.join();
+   }
+
+   configuration_results merged;
+   bool has_statistics = true;
+   for (const thread_results &thread : results)
+   {
+      merged.calls.create_surface.merge(thread.create_surface);
+      merged.calls.create_swapchain.merge(thread.create_swapchain);
+      merged.calls.acquire.merge(thread.acquire);
+      merged.calls.present.merge(thread.present);
+      merged.calls.destroy_swapchain.merge(thread.destroy_swapchain);
+      merged.calls.acquire_wait_ns += thread.acquire_wait_ns;
+      has_statistics = has_statistics && thread.has_statistics;
+   }
+
+   const double seconds = std::chrono::duration<double>(frames_end - frames_start).count();
+   merged.presents_per_second = seconds > 0.0 ? static_cast<double>(merged.calls.present.count()) / seconds : 0.0;
+   if (has_statistics && merged.calls.acquire.count() != 0)
+   {
+      const double overhead_us =
+         merged.calls.acquire.total() - static_cast<double>(merged.calls.acquire_wait_ns) / 1000.0;
+      merged.acquire_overhead = std::max(0.0, overhead_us) / static_cast<double>(merged.calls.acquire.count());
+   }
+
+   merged.calls.create_surface.sort();
+   merged.calls.create_swapchain.sort();
+   merged.calls.acquire.sort();
+   merged.calls.present.sort();
+   merged.calls.destroy_swapchain.sort();
+   return merged;
+}
+
+/**
+ * @brief Print the results of a configuration, comparing them with @p baseline, one thread with the same number of
+ *        swapchains.
+ */
+void print_configuration(uint32_t thread_count, uint32_t swapchain_count, const options &opts,
+                         const configuration_results &results, const configuration_results &baseline)
+{
+   std::printf("{\"threads\":%u,\"swapchains\":%u,\"frames\":%u,\"presents_per_second\":%.0f,", thread_count,
+               swapchain_count, opts.frames, results.presents_per_second);
+   results.calls.create_surface.print("create_surface");
+   std::printf(",");
+   results.calls.create_swapchain.print("create_swapchain");
+   std::printf(",");
+   results.calls.acquire.print("acquire");
+   std::printf(",");
+   results.calls.present.print("present");
+   std::printf(",");
+   results.calls.destroy_swapchain.print("destroy_swapchain");
+   if (results.acquire_overhead >= 0.0)
+   {
+      std::printf(",\"acquire_overhead\":%.2f", results.acquire_overhead);
+   }
+   else
+   {
+      std::printf(",\"acquire_overhead\":null");
+   }
+
+   auto slower = [](double value, double reference) {
+      return reference > 0.0 && value > reference * CONTENTION_FACTOR;
+   };
+   std::printf(",\"contended\":[");
+   const char *separator = "";
+   if (slower(results.calls.acquire.percentile(990), baseline.calls.acquire.percentile(990)))
+   {
+      std::printf("%s\"acquire\"", separator);
+      separator = ",";
+   }
+   if (slower(results.calls.present.percentile(990), baseline.calls.present.percentile(990)))
+   {
+      std::printf("%s\"present\"", separator);
+      separator = ",";
+   }
+   if (results.acquire_overhead >= 0.0 && slower(results.acquire_overhead, baseline.acquire_overhead))
+   {
+      std::printf("%s\"acquire_overhead\"", separator);
+   }
+   std::printf("]}\n");
+   std::fflush(stdout);
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+   options opts;
+   if (!parse_options(argc, argv, &opts))
+   {
+      std::fprintf(stderr,
+                   "usage: %s [--threads <count>] [--swapchains <count>] [--frames <count>] [--size <width>x<height>]\n"
+                   "          [--images <count>] [--enable-layer]\n",
+                   argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   const char *instance_extensions[] = { VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME };
+   const char *layer_name = "VK_LAYER_window_system_integration";
+
+   VkApplicationInfo app_info = {};
+   app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+   app_info.pApplicationName = "wsi_scaling_benchmark";
+   app_info.apiVersion = VK_API_VERSION_1_1;
+
+   VkInstanceCreateInfo instance_info = {};
+   instance_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+   instance_info.pApplicationInfo = &app_info;
+   instance_info.enabledExtensionCount = 2;
+   instance_info.ppEnabledExtensionNames = instance_extensions;
+   instance_info.enabledLayerCount = opts.enable_layer ? 1 : 0;
+   instance_info.ppEnabledLayerNames = &layer_name;
+
+   device_context ctx;
+   VK_CHECK(vkCreateInstance(&instance_info, nullptr, &ctx.instance));
+
+   uint32_t physical_device_count = 1;
+   VkResult result = vkEnumeratePhysicalDevices(ctx.instance, &physical_device_count, &ctx.physical_device);
+   if ((result != VK_SUCCESS && result != VK_INCOMPLETE) || physical_device_count == 0)
+   {
+      fail("No physical device");
+   }
+
+   ctx.create_headless_surface = reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(
+      vkGetInstanceProcAddr(ctx.instance, "vkCreateHeadlessSurfaceEXT"));
+   if (ctx.create_headless_surface == nullptr)
+   {
+      fail("VK_EXT_headless_surface is not available");
+   }
+   create_device(ctx, opts.threads);
+
+   for (uint32_t swapchain_count = 1; swapchain_count <= opts.swapchains; swapchain_count *= 2)
+   {
+      configuration_results baseline;
+      for (uint32_t thread_count = 1; thread_count <= std::min(opts.threads, swapchain_count); thread_count *= 2)
+      {
+         configuration_results results = run_configuration(ctx, opts, thread_count, swapchain_count);
+         if (thread_count == 1)
+         {
+            baseline = results;
+         }
+         print_configuration(thread_count, swapchain_count, opts, results, baseline);
+      }
+   }
+
+   vkDestroyDevice(ctx.device, nullptr);
+   vkDestroyInstance(ctx.instance, nullptr);
+   return EXIT_SUCCESS;
+}
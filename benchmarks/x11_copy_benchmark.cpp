@@ -0,0 +1,431 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file x11_copy_benchmark.cpp
+ *
+ * @brief Microbenchmarks of the kernels the X11 SHM presenter copies, scales and converts frames with.
+ *
+ * Each case copies a frame from a cached source buffer into a destination buffer of the kind the X server reads,
+ * repeatedly, and reports the throughput of the frame data and the per frame latency. Usage:
+ *
+ *    wsi_benchmarks [--frames <count>] [--filter <substring>]
+ *
+ * --frames sets how many frames each case copies (default 50), --filter only runs the cases whose name contains
+ * the substring, e.g. "1920x1080" or "memfd".
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <unistd.h>
+
+#include "wsi/x11/copy_kernels.hpp"
+#include "wsi/x11/copy_worker_pool.hpp"
+#include "wsi/x11/image_scaler.hpp"
+#include "wsi/x11/pixel_convert.hpp"
+
+namespace
+{
+
+using namespace wsi::x11;
+
+/**
+ * @brief Kind of memory a buffer is allocated from.
+ */
+enum class memory_kind
+{
+   heap,  /* cached anonymous memory */
+   sysv,  /* SysV shared memory, as attached with MIT-SHM */
+   memfd, /* memfd mapping, as passed with xcb_shm_attach_fd */
+};
+
+const char *memory_kind_name(memory_kind kind)
+{
+   switch (kind)
+   {
+   case memory_kind::heap:
+      return "heap";
+   case memory_kind::sysv:
+      return "sysv";
+   case memory_kind::memfd:
+      return "memfd";
+   }
+   return "unknown";
+}
+
+/**
+ * @brief Page aligned buffer of one of the memory kinds.
+ */
+class buffer
+{
+public:
+   buffer(memory_kind kind, size_t size)
+      : m_kind(kind)
+      , m_size(size)
+   {
+      switch (kind)
+      {
+      case memory_kind::heap:
+      {
+         void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+         m_base = (ptr == MAP_FAILED) ? nullptr : static_cast<uint8_t *>(ptr);
+         break;
+      }
+      case memory_kind::sysv:
+      {
+         int shm_id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+         if (shm_id >= 0)
+         {
+            void *ptr = shmat(shm_id, nullptr, 0);
+            m_base = (ptr == reinterpret_cast<void *>(-1)) ? nullptr : static_cast<uint8_t *>(ptr);
+            /* The segment goes away with its last attachment. */
+            shmctl(shm_id, IPC_RMID, nullptr);
+         }
+         break;
+      }
+      case memory_kind::memfd:
+      {
+         int fd = memfd_create("wsi-benchmark", MFD_CLOEXEC);
+         if (fd >= 0)
+         {
+            if (ftruncate(fd, static_cast<off_t>(size)) == 0)
+            {
+               void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+               m_base = (ptr == MAP_FAILED) ? nullptr : static_cast<uint8_t *>(ptr);
+            }
+            close(fd);
+         }
+         break;
+      }
+      }
+
+      if (m_base != nullptr)
+      {
+         /* Fault the pages in so the first frame is not slower than the others. */
+         std::memset(m_base, 0x5a, size);
+      }
+   }
+
+   ~buffer()
+   {
+      if (m_base == nullptr)
+      {
+         return;
+      }
+      if (m_kind == memory_kind::sysv)
+      {
+         shmdt(m_base);
+      }
+      else
+      {
+         munmap(m_base, m_size);
+      }
+   }
+
+   buffer(const buffer &) = delete;
+   buffer &operator=(const buffer &) = delete;
+
+   uint8_t *data() const
+   {
+      return m_base;
+   }
+
+private:
+   memory_kind m_kind;
+   size_t m_size;
+   uint8_t *m_base = nullptr;
+};
+
+struct resolution
+{
+   uint32_t width;
+   uint32_t height;
+};
+
+struct options
+{
+   uint32_t frames = 50;
+   const char *filter = nullptr;
+};
+
+/**
+ * @brief Time @p frames calls of @p copy_frame and print a result line.
+ *
+ * @param name        Name of the case.
+ * @param frame_bytes Bytes of pixel data the destination receives per frame.
+ */
+template <typename CopyFunction>
+void run_case(const options &opts, const std::string &name, size_t frame_bytes, CopyFunction &&copy_frame)
+{
+   if (opts.filter != nullptr && name.find(opts.filter) == std::string::npos)
+   {
+      return;
+   }
+
+   /* Warm up the caches and the worker threads. */
+   copy_frame();
+
+   std::vector<double> latencies_ms;
+   latencies_ms.reserve(opts.frames);
+   double total_s = 0.0;
+   for (uint32_t i = 0; i < opts.frames; i++)
+   {
+      const auto start = std::chrono::steady_clock::now();
+      copy_frame();
+      const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      total_s += elapsed.count();
+      latencies_ms.push_back(elapsed.count() * 1000.0);
+   }
+
+   std::sort(latencies_ms.begin(), latencies_ms.end());
+   const double median_ms = latencies_ms[latencies_ms.size() / 2];
+   const double p99_ms = latencies_ms[std::min(latencies_ms.size() - 1, latencies_ms.size() * 99 / 100)];
+   const double gb_per_s = (static_cast<double>(frame_bytes) * opts.frames) / total_s / 1e9;
+
+   std::printf("%-64s %8.2f GB/s %9.3f ms median %9.3f ms p99\n", name.c_str(), gb_per_s, median_ms, p99_ms);
+}
+
+/**
+ * @brief Copy rows with one memcpy each, the baseline every kernel is compared with.
+ */
+void copy_rows_memcpy(const uint32_t *src_pixels, uint32_t *dst_pixels, uint32_t src_stride_pixels, uint32_t dst_width,
+                      uint32_t height)
+{
+   for (uint32_t row = 0; row < height; row++)
+   {
+      std::memcpy(dst_pixels + static_cast<size_t>(row) * dst_width,
+                  src_pixels + static_cast<size_t>(row) * src_stride_pixels, dst_width * sizeof(uint32_t));
+   }
+}
+
+struct band_copy
+{
+   copy_rows_function copy_rows;
+   const uint32_t *src;
+   uint32_t *dst;
+   uint32_t src_stride_pixels;
+   uint32_t width;
+   uint32_t height;
+};
+
+/**
+ * @brief Copy one band of rows, split the same way as the SHM presenter splits frames across its workers.
+ */
+void copy_band(void *context, uint32_t band_index, uint32_t band_count)
+{
+   const auto *job = static_cast<const band_copy *>(context);
+   const uint32_t row_begin = job->height * band_index / band_count;
+   const uint32_t row_end = job->height * (band_index + 1) / band_count;
+   job->copy_rows(job->src + static_cast<size_t>(row_begin) * job->src_stride_pixels,
+                  job->dst + static_cast<size_t>(row_begin) * job->width, job->src_stride_pixels, job->width,
+                  row_end - row_begin);
+}
+
+std::string case_name(const char *path, const char *kernel, const resolution &res, const char *stride,
+                      const char *alignment, memory_kind kind)
+{
+   char name[128];
+   std::snprintf(name, sizeof(name), "%s/%s/%ux%u/%s/%s/%s", path, kernel, res.width, res.height, stride, alignment,
+                 memory_kind_name(kind));
+   return name;
+}
+
+bool parse_options(int argc, char **argv, options *opts)
+{
+   for (int i = 1; i < argc; i++)
+   {
+      if (!std::strcmp(argv[i], "--frames") && i + 1 < argc)
+      {
+         opts->frames = static_cast<uint32_t>(std::max(1l, std::strtol(argv[++i], nullptr, 10)));
+      }
+      else if (!std::strcmp(argv[i], "--filter") && i + 1 < argc)
+      {
+         opts->filter = argv[++i];
+      }
+      else
+      {
+         std::fprintf(stderr, "usage: %s [--frames <count>] [--filter <substring>]\n", argv[0]);
+         return false;
+      }
+   }
+   return true;
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+   options opts;
+   if (!parse_options(argc, argv, &opts))
+   {
+      return EXIT_FAILURE;
+   }
+
+   static constexpr resolution resolutions[] = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+   static constexpr memory_kind memory_kinds[] = { memory_kind::heap, memory_kind::sysv, memory_kind::memfd };
+
+   struct stride_variant
+   {
+      const char *name;
+      uint32_t padding_pixels;
+   };
+   /* Tight rows, rows padded to a 256 byte pitch as drivers usually align linear images, and an odd pitch. */
+   static constexpr stride_variant strides[] = { { "tight", 0 }, { "pad256", 64 }, { "odd", 1 } };
+
+   struct alignment_variant
+   {
+      const char *name;
+      size_t offset;
+   };
+   static constexpr alignment_variant alignments[] = { { "aligned", 0 }, { "offset4", 4 } };
+
+   const copy_kernel kernels[] = { { copy_rows_memcpy, "memcpy" }, select_copy_kernel(),
+                                   select_streaming_copy_kernel() };
+
+   /* Same worker count as the SHM presenter picks on this machine, without its affinity settings. */
+   const uint32_t thread_count = std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+   copy_worker_pool workers;
+   const bool threaded = thread_count > 1 && workers.start(thread_count - 1);
+
+   std::printf("copy kernel: %s, streaming kernel: %s, copy threads: %u\n", kernels[1].name, kernels[2].name,
+               threaded ? thread_count : 1);
+
+   for (const resolution &res : resolutions)
+   {
+      const uint32_t max_stride = res.width + 64;
+      const size_t src_size = static_cast<size_t>(max_stride) * res.height * sizeof(uint32_t) + 64;
+      const size_t frame_bytes = static_cast<size_t>(res.width) * res.height * sizeof(uint32_t);
+
+      /* Scaling to a window of 1.5 times and 0.5 times the size of the image. */
+      const resolution scaled_sizes[] = { { res.width * 3 / 2, res.height * 3 / 2 },
+                                          { res.width / 2, res.height / 2 } };
+      size_t dst_size = frame_bytes;
+      for (const resolution &scaled : scaled_sizes)
+      {
+         dst_size = std::max(dst_size, static_cast<size_t>(scaled.width) * scaled.height * sizeof(uint32_t));
+      }
+
+      buffer src(memory_kind::heap, src_size);
+      if (src.data() == nullptr)
+      {
+         std::fprintf(stderr, "failed to allocate the %ux%u source\n", res.width, res.height);
+         return EXIT_FAILURE;
+      }
+
+      for (memory_kind kind : memory_kinds)
+      {
+         /* Large enough for the biggest scaled frame, and for the offset copies. */
+         buffer dst(kind, dst_size + 64);
+         if (dst.data() == nullptr)
+         {
+            std::fprintf(stderr, "skipping %s destinations: allocation failed\n", memory_kind_name(kind));
+            continue;
+         }
+
+         for (const stride_variant &stride : strides)
+         {
+            const uint32_t src_stride_pixels = res.width + stride.padding_pixels;
+            for (const alignment_variant &alignment : alignments)
+            {
+               const auto *src_pixels = reinterpret_cast<const uint32_t *>(src.data() + alignment.offset);
+               auto *dst_pixels = reinterpret_cast<uint32_t *>(dst.data() + alignment.offset);
+
+               for (const copy_kernel &kernel : kernels)
+               {
+                  run_case(opts, case_name("copy", kernel.name, res, stride.name, alignment.name, kind), frame_bytes,
+                           [&]() {
+                              kernel.copy_rows(src_pixels, dst_pixels, src_stride_pixels, res.width, res.height);
+                           });
+               }
+
+               if (threaded)
+               {
+                  band_copy job = { kernels[1].copy_rows, src_pixels, dst_pixels, src_stride_pixels, res.width,
+                                    res.height };
+                  run_case(opts, case_name("threaded", kernels[1].name, res, stride.name, alignment.name, kind),
+                           frame_bytes, [&]() { workers.run(copy_band, &job); });
+               }
+            }
+         }
+
+         const auto *src_pixels = reinterpret_cast<const uint32_t *>(src.data());
+         auto *dst_pixels = reinterpret_cast<uint32_t *>(dst.data());
+
+         for (const resolution &scaled : scaled_sizes)
+         {
+            image_scaler scaler;
+            if (!scaler.configure(res.width, res.height, scaled.width, scaled.height))
+            {
+               continue;
+            }
+            char scaled_name[32];
+            std::snprintf(scaled_name, sizeof(scaled_name), "to%ux%u", scaled.width, scaled.height);
+            run_case(opts, case_name("scaled", scaler.get_kernel_name(), res, scaled_name, "aligned", kind),
+                     static_cast<size_t>(scaled.width) * scaled.height * sizeof(uint32_t), [&]() {
+                        scaler.scale_rows(src_pixels, res.width, dst_pixels, scaled.width, 0, scaled.height);
+                     });
+         }
+
+         struct conversion
+         {
+            VkFormat format;
+            shm_pixel_format pixel_format;
+         };
+         static constexpr conversion conversions[] = {
+            { VK_FORMAT_R8G8B8A8_UNORM, shm_pixel_format::XRGB8888 },
+            { VK_FORMAT_B8G8R8A8_UNORM, shm_pixel_format::RGB565 },
+            { VK_FORMAT_B8G8R8A8_UNORM, shm_pixel_format::XRGB2101010 },
+         };
+         for (const conversion &conv : conversions)
+         {
+            pixel_converter converter{};
+            if (!select_pixel_converter(conv.format, conv.pixel_format, &converter) ||
+                converter.convert_rows == nullptr)
+            {
+               continue;
+            }
+            const size_t dst_stride = static_cast<size_t>(res.width) * converter.dst_bytes_per_pixel;
+            run_case(opts, case_name("convert", converter.name, res, "tight", "aligned", kind),
+                     dst_stride * res.height, [&]() {
+                        converter.convert_rows(src.data(), static_cast<size_t>(res.width) * sizeof(uint32_t),
+                                               dst.data(), dst_stride, res.width, res.height);
+                     });
+         }
+      }
+   }
+
+   workers.stop();
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file frame_statistics_api.cpp
+ *
+ * @brief Contains the Vulkan entrypoint for the layer's frame statistics.
+ */
+#include <cassert>
+#include "wsi_layer_experimental.hpp"
+
+#include <wsi/swapchain_base.hpp>
+#include "private_data.hpp"
+#include "util/helpers.hpp"
+#include "util/log.hpp"
+#include "util/macros.hpp"
+
+#if VULKAN_WSI_LAYER_EXPERIMENTAL
+static_assert(VK_SWAPCHAIN_FRAME_STAGE_COUNT_ARM == static_cast<uint32_t>(util::frame_stage::count),
+              "Frame stage count mismatch");
+static_assert(VK_SWAPCHAIN_LATENCY_HISTOGRAM_BUCKET_COUNT_ARM == util::latency_histogram::BUCKET_COUNT,
+              "Histogram bucket count mismatch");
+static_assert(VK_SWAPCHAIN_ALLOCATION_STAGE_COUNT_ARM == static_cast<uint32_t>(util::allocation_stage::count),
+              "Allocation stage count mismatch");
+static_assert(VK_HOST_MEMORY_CATEGORY_COUNT_ARM == static_cast<uint32_t>(util::memory_category::count),
+              "Memory category count mismatch");
+
+static void fill_histogram(const util::latency_histogram::snapshot &snapshot, VkSwapchainLatencyHistogramARM &histogram)
+{
+   histogram.count = snapshot.count;
+   histogram.totalNs = snapshot.total_ns;
+   histogram.maxNs = snapshot.max_ns;
+   for (uint32_t bucket = 0; bucket < VK_SWAPCHAIN_LATENCY_HISTOGRAM_BUCKET_COUNT_ARM; bucket++)
+   {
+      histogram.buckets[bucket] = snapshot.buckets[bucket];
+   }
+}
+
+static void fill_memory_counters(const util::memory_accounting &accounting, VkHostMemoryCountersARM *counters)
+{
+   for (uint32_t category = 0; category < VK_HOST_MEMORY_CATEGORY_COUNT_ARM; category++)
+   {
+      const auto read = accounting.read(static_cast<util::memory_category>(category));
+      counters[category].currentBytes = read.current;
+      counters[category].peakBytes = read.peak;
+      counters[category].allocationCount = read.allocations;
+   }
+}
+
+/**
+ * @brief Implements vkGetSwapchainFrameStatisticsARM entrypoint.
+ */
+VWL_VKAPI_CALL(VkResult)
+wsi_layer_vkGetSwapchainFrameStatisticsARM(VkDevice device, VkSwapchainKHR swapchain,
+                                           VkSwapchainFrameStatisticsARM *pStatistics) VWL_API_POST
+{
+   assert(swapchain != VK_NULL_HANDLE);
+   assert(pStatistics != nullptr);
+
+   auto &device_data = layer::device_private_data::get(device);
+   if (!device_data.layer_owns_swapchain(swapchain))
+   {
+      /* Only the layer collects these, there is nothing to forward the call to. */
+      return VK_ERROR_EXTENSION_NOT_PRESENT;
+   }
+
+   /* The structure types are placeholders, reject a structure that is not the one the layer defines. */
+   if (pStatistics->sType != VK_STRUCTURE_TYPE_SWAPCHAIN_FRAME_STATISTICS_ARM)
+   {
+      WSI_LOG_ERROR("vkGetSwapchainFrameStatisticsARM called with structure type %d.", pStatistics->sType);
+      return VK_ERROR_VALIDATION_FAILED_EXT;
+   }
+
+   auto *sc = reinterpret_cast<wsi::swapchain_base *>(swapchain);
+   for (uint32_t stage = 0; stage < VK_SWAPCHAIN_FRAME_STAGE_COUNT_ARM; stage++)
+   {
+      fill_histogram(sc->get_frame_stats().read(static_cast<util::frame_stage>(stage)), pStatistics->stages[stage]);
+   }
+
+   auto *allocation_statistics = util::find_extension<VkSwapchainAllocationStatisticsARM>(
+      VK_STRUCTURE_TYPE_SWAPCHAIN_ALLOCATION_STATISTICS_ARM, pStatistics->pNext);
+   if (allocation_statistics != nullptr)
+   {
+      const auto &stats = device_data.get_allocation_stats();
+      for (uint32_t stage = 0; stage < VK_SWAPCHAIN_ALLOCATION_STAGE_COUNT_ARM; stage++)
+      {
+         const auto allocation_stage = static_cast<util::allocation_stage>(stage);
+         fill_histogram(stats.read(allocation_stage), allocation_statistics->stages[stage]);
+         allocation_statistics->bytes[stage] = stats.read_bytes(allocation_stage);
+      }
+   }
+
+   auto *memory_statistics = util::find_extension<VkSwapchainMemoryStatisticsARM>(
+      VK_STRUCTURE_TYPE_SWAPCHAIN_MEMORY_STATISTICS_ARM, pStatistics->pNext);
+   if (memory_statistics != nullptr)
+   {
+      fill_memory_counters(sc->get_memory_accounting(), memory_statistics->swapchain);
+      fill_memory_counters(device_data.get_memory_accounting(), memory_statistics->device);
+      fill_memory_counters(device_data.instance_data.get_memory_accounting(), memory_statistics->instance);
+   }
+   return VK_SUCCESS;
+}
+#endif
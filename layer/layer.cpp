@@ -22,10 +22,12 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstring>
 #include <array>
+#include <optional>
 
 #include <vulkan/vk_layer.h>
 #include <vulkan/vulkan.h>
@@ -36,11 +38,13 @@
 #include "swapchain_api.hpp"
 #include "swapchain_maintenance_api.hpp"
 #include "util/extension_list.hpp"
+#include "util/string_hash.hpp"
 #include "util/custom_allocator.hpp"
 #include "wsi/wsi_factory.hpp"
 #include "util/log.hpp"
 #include "util/macros.hpp"
 #include "util/helpers.hpp"
+#include "util/tuning_profile.hpp"
 #include "wsi/unsupported_surfaces.hpp"
 
 #define VK_LAYER_API_VERSION VK_MAKE_VERSION(1, 2, VK_HEADER_VERSION)
@@ -98,6 +102,108 @@ static T get_device_proc_addr(PFN_vkGetDeviceProcAddr fp_get_device_proc_addr, c
    return func;
 }
 
+/**
+ * @brief Location of the queue the layer adds to a device for its own submissions.
+ */
+struct layer_queue_location
+{
+   uint32_t family_index;
+   uint32_t queue_index;
+};
+
+/**
+ * @brief Add a queue reserved for the layer to the queues the application creates.
+ *
+ * A family the application does not create queues from is preferred, as its queue does not share a hardware ring
+ * with the application's queues. Otherwise a spare queue of a family the application uses is added to its request.
+ *
+ * @param inst_data       The instance the device is created from.
+ * @param physical_device The physical device the device is created from.
+ * @param create_info     The device create info of the application.
+ * @param allocator       The allocator for temporary data.
+ * @param queue_infos     Filled with the queue create infos to create the device with.
+ * @param priorities      Storage for the queue priorities of an extended queue create info.
+ *
+ * @return The location of the added queue, or std::nullopt when the device has no queue to spare.
+ */
+static std::optional<layer_queue_location> add_layer_queue(instance_private_data &inst_data,
+                                                           VkPhysicalDevice physical_device,
+                                                           const VkDeviceCreateInfo &create_info,
+                                                           const util::allocator &allocator,
+                                                           util::vector<VkDeviceQueueCreateInfo> &queue_infos,
+                                                           util::vector<float> &priorities)
+{
+   uint32_t family_count = 0;
+   inst_data.disp.GetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, nullptr);
+   util::vector<VkQueueFamilyProperties> families{ allocator };
+   if (family_count == 0 || !families.try_resize(family_count))
+   {
+      return std::nullopt;
+   }
+   inst_data.disp.GetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families.data());
+
+   const VkDeviceQueueCreateInfo *app_infos_begin = create_info.pQueueCreateInfos;
+   const VkDeviceQueueCreateInfo *app_infos_end = app_infos_begin + create_info.queueCreateInfoCount;
+   if (!queue_infos.try_push_back_many(app_infos_begin, app_infos_end))
+   {
+      return std::nullopt;
+   }
+
+   /* Queues created with flags come from the same pool as the others, so count every create info of the family. */
+   auto used_queue_count = [&](uint32_t family_index) {
+      uint32_t count = 0;
+      for (const auto *info = app_infos_begin; info != app_infos_end; ++info)
+      {
+         count += (info->queueFamilyIndex == family_index) ? info->queueCount : 0;
+      }
+      return count;
+   };
+
+   constexpr VkQueueFlags submit_flags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+   static const float layer_queue_priority = 1.0f;
+   for (uint32_t i = 0; i < family_count; ++i)
+   {
+      if ((families[i].queueFlags & submit_flags) == 0 || families[i].queueCount == 0 || used_queue_count(i) != 0)
+      {
+         continue;
+      }
+
+      VkDeviceQueueCreateInfo info = {};
+      info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+      info.queueFamilyIndex = i;
+      info.queueCount = 1;
+      info.pQueuePriorities = &layer_queue_priority;
+      if (!queue_infos.try_push_back(info))
+      {
+         return std::nullopt;
+      }
+      return layer_queue_location{ i, 0 };
+   }
+
+   for (auto &info : queue_infos)
+   {
+      if (info.flags != 0 || info.queueFamilyIndex >= family_count ||
+          used_queue_count(info.queueFamilyIndex) >= families[info.queueFamilyIndex].queueCount)
+      {
+         continue;
+      }
+
+      if (!priorities.try_reserve(info.queueCount + 1) ||
+          !priorities.try_push_back_many(info.pQueuePriorities, info.pQueuePriorities + info.queueCount) ||
+          !priorities.try_push_back(layer_queue_priority))
+      {
+         return std::nullopt;
+      }
+
+      const uint32_t queue_index = info.queueCount;
+      info.queueCount++;
+      info.pQueuePriorities = priorities.data();
+      return layer_queue_location{ info.queueFamilyIndex, queue_index };
+   }
+
+   return std::nullopt;
+}
+
 /* This is where the layer is initialised and the instance dispatch table is constructed. */
 VKAPI_ATTR VkResult create_instance(const VkInstanceCreateInfo *pCreateInfo, const VkAllocationCallbacks *pAllocator,
                                     VkInstance *pInstance)
@@ -125,6 +231,11 @@ VKAPI_ATTR VkResult create_instance(const VkInstanceCreateInfo *pCreateInfo, con
       return VK_ERROR_INITIALIZATION_FAILED;
    }
 
+   /* The first instance of the process picks the tuning profile every swapchain uses. */
+   util::tuning_profile::select(pCreateInfo->pApplicationInfo != nullptr ?
+                                   pCreateInfo->pApplicationInfo->pApplicationName :
+                                   nullptr);
+
    /* For instances handled by the layer, we need to enable extra extensions, therefore take a copy of pCreateInfo. */
    VkInstanceCreateInfo modified_info = *pCreateInfo;
 
@@ -310,8 +421,60 @@ VKAPI_ATTR VkResult create_device(VkPhysicalDevice physicalDevice, const VkDevic
       }
    }
 
+   /* Swapchain images can only be created with a compression control when the device has the feature enabled. */
+   bool auto_fixed_rate_compression = false;
+   VkPhysicalDeviceImageCompressionControlFeaturesEXT compression_control;
+
+   if (util::tuning_profile::get().auto_fixed_rate_compression != 0 &&
+       enabled_extensions.contains(VK_EXT_IMAGE_COMPRESSION_CONTROL_EXTENSION_NAME) &&
+       inst_data.has_image_compression_support(physicalDevice))
+   {
+      const auto *application_compression_control_features =
+         util::find_extension<VkPhysicalDeviceImageCompressionControlFeaturesEXT>(
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_COMPRESSION_CONTROL_FEATURES_EXT, pCreateInfo->pNext);
+
+      if (application_compression_control_features)
+      {
+         /* Modified in place, as the frame boundary features above. */
+         auto *compression_control_features_non_const =
+            const_cast<VkPhysicalDeviceImageCompressionControlFeaturesEXT *>(application_compression_control_features);
+         compression_control_features_non_const->imageCompressionControl = VK_TRUE;
+      }
+      else
+      {
+         compression_control.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_COMPRESSION_CONTROL_FEATURES_EXT;
+         compression_control.pNext = const_cast<void *>(modified_info.pNext);
+         compression_control.imageCompressionControl = VK_TRUE;
+
+         modified_info.pNext = &compression_control;
+      }
+
+      auto_fixed_rate_compression = true;
+   }
+
+   util::vector<VkDeviceQueueCreateInfo> modified_queue_infos{ allocator };
+   util::vector<float> modified_queue_priorities{ allocator };
+   std::optional<layer_queue_location> layer_queue =
+      add_layer_queue(inst_data, physicalDevice, *pCreateInfo, allocator, modified_queue_infos,
+                      modified_queue_priorities);
+   if (layer_queue.has_value())
+   {
+      modified_info.pQueueCreateInfos = modified_queue_infos.data();
+      modified_info.queueCreateInfoCount = static_cast<uint32_t>(modified_queue_infos.size());
+   }
+
    /* Now call create device on the chain further down the list. */
-   TRY_LOG(fpCreateDevice(physicalDevice, &modified_info, pAllocator, pDevice), "Failed to create the device");
+   VkResult create_result = fpCreateDevice(physicalDevice, &modified_info, pAllocator, pDevice);
+   if (create_result != VK_SUCCESS && layer_queue.has_value())
+   {
+      /* The extra queue may be what the implementation rejects, e.g. the global priority it inherits. */
+      WSI_LOG_WARNING("Failed to create the device with a queue for the layer, retrying without it.");
+      layer_queue.reset();
+      modified_info.pQueueCreateInfos = pCreateInfo->pQueueCreateInfos;
+      modified_info.queueCreateInfoCount = pCreateInfo->queueCreateInfoCount;
+      create_result = fpCreateDevice(physicalDevice, &modified_info, pAllocator, pDevice);
+   }
+   TRY_LOG(create_result, "Failed to create the device");
 
    auto fn_destroy_device = get_device_proc_addr<PFN_vkDestroyDevice>(fpGetDeviceProcAddr, "vkDestroyDevice", *pDevice);
    /* This should never be nullptr */
@@ -351,6 +514,7 @@ VKAPI_ATTR VkResult create_device(VkPhysicalDevice physicalDevice, const VkDevic
     */
    auto &device_data = layer::device_private_data::get(*pDevice);
    device_data.set_layer_frame_boundary_handling_enabled(should_layer_handle_frame_boundary_events);
+   device_data.set_auto_fixed_rate_compression_enabled(auto_fixed_rate_compression);
 
    result = device_data.set_device_enabled_extensions(modified_info.ppEnabledExtensionNames,
                                                       modified_info.enabledExtensionCount);
@@ -386,6 +550,60 @@ VKAPI_ATTR VkResult create_device(VkPhysicalDevice physicalDevice, const VkDevic
          physical_device_swapchain_maintenance1_features->swapchainMaintenance1);
    }
 
+   const uint32_t first_family = pCreateInfo->pQueueCreateInfos[0].queueFamilyIndex;
+   const bool single_family =
+      std::all_of(pCreateInfo->pQueueCreateInfos, pCreateInfo->pQueueCreateInfos + pCreateInfo->queueCreateInfoCount,
+                  [first_family](const VkDeviceQueueCreateInfo &info) {
+                     return info.queueFamilyIndex == first_family;
+                  });
+   device_data.set_single_queue_family(single_family ? std::optional<uint32_t>(first_family) : std::nullopt);
+
+   /* Without a queue of its own the layer shares the first queue the application created without flags. */
+   const VkDeviceQueueCreateInfo *app_queue_info =
+      std::find_if(pCreateInfo->pQueueCreateInfos, pCreateInfo->pQueueCreateInfos + pCreateInfo->queueCreateInfoCount,
+                   [](const VkDeviceQueueCreateInfo &info) { return info.flags == 0; });
+   if (app_queue_info == pCreateInfo->pQueueCreateInfos + pCreateInfo->queueCreateInfoCount)
+   {
+      app_queue_info = pCreateInfo->pQueueCreateInfos;
+   }
+   const layer_queue_location layer_queue_loc =
+      layer_queue.value_or(layer_queue_location{ app_queue_info->queueFamilyIndex, 0 });
+   /* A queue created with flags can only be retrieved with the same flags, through vkGetDeviceQueue2. */
+   const VkDeviceQueueCreateFlags queue_flags = layer_queue.has_value() ? 0 : app_queue_info->flags;
+   VkQueue queue = VK_NULL_HANDLE;
+   if (queue_flags != 0 && device_data.disp.get_GetDeviceQueue2() != nullptr)
+   {
+      VkDeviceQueueInfo2 queue_info = {};
+      queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_INFO_2;
+      queue_info.flags = queue_flags;
+      queue_info.queueFamilyIndex = layer_queue_loc.family_index;
+      queue_info.queueIndex = layer_queue_loc.queue_index;
+      device_data.disp.GetDeviceQueue2(*pDevice, &queue_info, &queue);
+   }
+   else
+   {
+      device_data.disp.GetDeviceQueue(*pDevice, layer_queue_loc.family_index, layer_queue_loc.queue_index, &queue);
+   }
+   result = device_data.SetDeviceLoaderData(*pDevice, queue);
+   if (result != VK_SUCCESS)
+   {
+      layer::device_private_data::disassociate(*pDevice);
+      fn_destroy_device(*pDevice, pAllocator);
+      return result;
+   }
+   device_data.set_layer_queue(queue, layer_queue.has_value());
+
+   device_data.set_sync_fd_import_supported(device_data.disp.get_ImportFenceFdKHR() != nullptr &&
+                                            device_data.disp.get_ImportSemaphoreFdKHR() != nullptr);
+
+   const auto *timeline_semaphore_features = util::find_extension<VkPhysicalDeviceTimelineSemaphoreFeatures>(
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES, pCreateInfo->pNext);
+   const auto *vulkan_12_features = util::find_extension<VkPhysicalDeviceVulkan12Features>(
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES, pCreateInfo->pNext);
+   device_data.set_timeline_semaphore_enabled(
+      (timeline_semaphore_features != nullptr && timeline_semaphore_features->timelineSemaphore) ||
+      (vulkan_12_features != nullptr && vulkan_12_features->timelineSemaphore));
+
    return VK_SUCCESS;
 }
 
@@ -406,16 +624,15 @@ wsi_layer_vkDestroyInstance(VkInstance instance, const VkAllocationCallbacks *pA
       return;
    }
 
-   auto fn_destroy_instance =
-      layer::instance_private_data::get(instance).disp.get_fn<PFN_vkDestroyInstance>("vkDestroyInstance");
+   auto fn_destroy_instance = layer::instance_private_data::get(instance).disp.get_DestroyInstance();
 
    /* Call disassociate() before doing vkDestroyInstance as an instance may be created by a different thread
     * just after we call vkDestroyInstance() and it could get the same address if we are unlucky.
     */
    layer::instance_private_data::disassociate(instance);
 
-   assert(fn_destroy_instance.has_value());
-   (*fn_destroy_instance)(instance, pAllocator);
+   assert(fn_destroy_instance != nullptr);
+   fn_destroy_instance(instance, pAllocator);
 }
 
 VWL_VKAPI_CALL(void)
@@ -426,15 +643,15 @@ wsi_layer_vkDestroyDevice(VkDevice device, const VkAllocationCallbacks *pAllocat
       return;
    }
 
-   auto fn_destroy_device = layer::device_private_data::get(device).disp.get_fn<PFN_vkDestroyDevice>("vkDestroyDevice");
+   auto fn_destroy_device = layer::device_private_data::get(device).disp.get_DestroyDevice();
 
    /* Call disassociate() before doing vkDestroyDevice as a device may be created by a different thread
     * just after we call vkDestroyDevice().
     */
    layer::device_private_data::disassociate(device);
 
-   assert(fn_destroy_device.has_value());
-   (*fn_destroy_device)(device, pAllocator);
+   assert(fn_destroy_device != nullptr);
+   fn_destroy_device(device, pAllocator);
 }
 
 VWL_VKAPI_CALL(VkResult)
@@ -477,13 +694,6 @@ wsi_layer_vkGetPhysicalDeviceFeatures2KHR(VkPhysicalDevice physicalDevice,
                                           VkPhysicalDeviceFeatures2 *pFeatures) VWL_API_POST
 {
    auto &instance = layer::instance_private_data::get(physicalDevice);
-   auto *physical_device_swapchain_maintenance1_features =
-      util::find_extension<VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT>(
-         VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT, pFeatures->pNext);
-   if (physical_device_swapchain_maintenance1_features != nullptr)
-   {
-      physical_device_swapchain_maintenance1_features->swapchainMaintenance1 = false;
-   }
    instance.disp.GetPhysicalDeviceFeatures2KHR(physicalDevice, pFeatures);
 
    auto *image_compression_control_swapchain_features =
@@ -502,6 +712,17 @@ wsi_layer_vkGetPhysicalDeviceFeatures2KHR(VkPhysicalDevice physicalDevice,
       present_id_features->presentId = true;
    }
 
+   auto *present_wait_features = util::find_extension<VkPhysicalDevicePresentWaitFeaturesKHR>(
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR, pFeatures->pNext);
+   if (present_wait_features != nullptr)
+   {
+      present_wait_features->presentWait = true;
+   }
+
+   /* The layer implements the swapchains, whatever the driver reported. */
+   auto *physical_device_swapchain_maintenance1_features =
+      util::find_extension<VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT>(
+         VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT, pFeatures->pNext);
    wsi::set_swapchain_maintenance1_state(physicalDevice, physical_device_swapchain_maintenance1_features);
 
 #if VULKAN_WSI_LAYER_EXPERIMENTAL
@@ -516,95 +737,120 @@ wsi_layer_vkGetPhysicalDeviceFeatures2KHR(VkPhysicalDevice physicalDevice,
 #endif
 }
 
-#define GET_PROC_ADDR(func)      \
-   if (!strcmp(funcName, #func)) \
-      return (PFN_vkVoidFunction)&wsi_layer_##func;
+/* The names below are matched with a switch over their hash, see util::string_hash. An entrypoint is only returned
+ * when its condition holds, otherwise the query goes on to the next lookup. */
+#define GET_PROC_ADDR(func, condition)                 \
+   case util::string_hash(#func):                      \
+      if (!strcmp(funcName, #func) && (condition))     \
+      {                                                \
+         return (PFN_vkVoidFunction)&wsi_layer_##func; \
+      }                                                \
+      break;
 
 VWL_VKAPI_CALL(PFN_vkVoidFunction)
 wsi_layer_vkGetDeviceProcAddr(VkDevice device, const char *funcName) VWL_API_POST
 {
-   if (layer::device_private_data::get(device).is_device_extension_enabled(VK_KHR_SWAPCHAIN_EXTENSION_NAME))
-   {
-      GET_PROC_ADDR(vkCreateSwapchainKHR);
-      GET_PROC_ADDR(vkDestroySwapchainKHR);
-      GET_PROC_ADDR(vkGetSwapchainImagesKHR);
-      GET_PROC_ADDR(vkAcquireNextImageKHR);
-      GET_PROC_ADDR(vkQueuePresentKHR);
-      GET_PROC_ADDR(vkAcquireNextImage2KHR);
-      GET_PROC_ADDR(vkGetDeviceGroupPresentCapabilitiesKHR);
-      GET_PROC_ADDR(vkGetDeviceGroupSurfacePresentModesKHR);
-   }
-   if (layer::device_private_data::get(device).is_device_extension_enabled(
-          VK_KHR_SHARED_PRESENTABLE_IMAGE_EXTENSION_NAME))
-   {
-      GET_PROC_ADDR(vkGetSwapchainStatusKHR);
-   }
+   auto &device_data = layer::device_private_data::get(device);
+   auto swapchain_enabled = [&device_data]() {
+      return device_data.is_device_extension_enabled(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+   };
+
+   switch (util::string_hash(funcName))
+   {
+   GET_PROC_ADDR(vkCreateSwapchainKHR, swapchain_enabled());
+   GET_PROC_ADDR(vkDestroySwapchainKHR, swapchain_enabled());
+   GET_PROC_ADDR(vkGetSwapchainImagesKHR, swapchain_enabled());
+   GET_PROC_ADDR(vkAcquireNextImageKHR, swapchain_enabled());
+   GET_PROC_ADDR(vkQueuePresentKHR, swapchain_enabled());
+   GET_PROC_ADDR(vkAcquireNextImage2KHR, swapchain_enabled());
+   GET_PROC_ADDR(vkGetDeviceGroupPresentCapabilitiesKHR, swapchain_enabled());
+   GET_PROC_ADDR(vkGetDeviceGroupSurfacePresentModesKHR, swapchain_enabled());
+   GET_PROC_ADDR(vkGetSwapchainStatusKHR,
+                 device_data.is_device_extension_enabled(VK_KHR_SHARED_PRESENTABLE_IMAGE_EXTENSION_NAME));
 #if VULKAN_WSI_LAYER_EXPERIMENTAL
-   if (layer::device_private_data::get(device).is_device_extension_enabled(VK_EXT_PRESENT_TIMING_EXTENSION_NAME))
-   {
-      GET_PROC_ADDR(vkSetSwapchainPresentTimingQueueSizeEXT);
-      GET_PROC_ADDR(vkGetSwapchainTimingPropertiesEXT);
-      GET_PROC_ADDR(vkGetSwapchainTimeDomainPropertiesEXT);
-      GET_PROC_ADDR(vkGetPastPresentationTimingEXT);
-   }
+   GET_PROC_ADDR(vkSetSwapchainPresentTimingQueueSizeEXT,
+                 device_data.is_device_extension_enabled(VK_EXT_PRESENT_TIMING_EXTENSION_NAME));
+   GET_PROC_ADDR(vkGetSwapchainTimingPropertiesEXT,
+                 device_data.is_device_extension_enabled(VK_EXT_PRESENT_TIMING_EXTENSION_NAME));
+   GET_PROC_ADDR(vkGetSwapchainTimeDomainPropertiesEXT,
+                 device_data.is_device_extension_enabled(VK_EXT_PRESENT_TIMING_EXTENSION_NAME));
+   GET_PROC_ADDR(vkGetPastPresentationTimingEXT,
+                 device_data.is_device_extension_enabled(VK_EXT_PRESENT_TIMING_EXTENSION_NAME));
+   GET_PROC_ADDR(vkGetSwapchainFrameStatisticsARM, true);
 #endif
-   GET_PROC_ADDR(vkDestroyDevice);
+   GET_PROC_ADDR(vkDestroyDevice, true);
 
-   GET_PROC_ADDR(vkCreateImage);
-   GET_PROC_ADDR(vkBindImageMemory2);
+   GET_PROC_ADDR(vkCreateImage, true);
+   GET_PROC_ADDR(vkBindImageMemory2, true);
 
    /* VK_EXT_swapchain_maintenance1 */
-   if (layer::device_private_data::get(device).is_device_extension_enabled(
-          VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME))
-   {
-      GET_PROC_ADDR(vkReleaseSwapchainImagesEXT);
+   GET_PROC_ADDR(vkReleaseSwapchainImagesEXT,
+                 device_data.is_device_extension_enabled(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME));
+
+   /* VK_KHR_present_wait */
+   GET_PROC_ADDR(vkWaitForPresentKHR, device_data.is_device_extension_enabled(VK_KHR_PRESENT_WAIT_EXTENSION_NAME));
+   default:
+      break;
    }
 
-   return layer::device_private_data::get(device).disp.get_user_enabled_entrypoint(
-      device, layer::device_private_data::get(device).instance_data.api_version, funcName);
+   return device_data.disp.get_user_enabled_entrypoint(device, device_data.instance_data.api_version, funcName);
 }
 
 VWL_VKAPI_CALL(PFN_vkVoidFunction)
 wsi_layer_vkGetInstanceProcAddr(VkInstance instance, const char *funcName) VWL_API_POST
 {
-   GET_PROC_ADDR(vkGetDeviceProcAddr);
-   GET_PROC_ADDR(vkGetInstanceProcAddr);
-   GET_PROC_ADDR(vkCreateInstance);
-   GET_PROC_ADDR(vkDestroyInstance);
-   GET_PROC_ADDR(vkCreateDevice);
-   GET_PROC_ADDR(vkGetPhysicalDevicePresentRectanglesKHR);
-
-   if (!strcmp(funcName, "vkGetPhysicalDeviceFeatures2"))
-   {
-      return (PFN_vkVoidFunction)wsi_layer_vkGetPhysicalDeviceFeatures2KHR;
+   const uint32_t name_hash = util::string_hash(funcName);
+
+   /* Entrypoints that can be queried without an instance. */
+   switch (name_hash)
+   {
+   GET_PROC_ADDR(vkGetDeviceProcAddr, true);
+   GET_PROC_ADDR(vkGetInstanceProcAddr, true);
+   GET_PROC_ADDR(vkCreateInstance, true);
+   GET_PROC_ADDR(vkDestroyInstance, true);
+   GET_PROC_ADDR(vkCreateDevice, true);
+   GET_PROC_ADDR(vkGetPhysicalDevicePresentRectanglesKHR, true);
+   case util::string_hash("vkGetPhysicalDeviceFeatures2"):
+      if (!strcmp(funcName, "vkGetPhysicalDeviceFeatures2"))
+      {
+         return (PFN_vkVoidFunction)wsi_layer_vkGetPhysicalDeviceFeatures2KHR;
+      }
+      break;
+   default:
+      break;
    }
 
    auto &instance_data = layer::instance_private_data::get(instance);
+   const bool surface_enabled = instance_data.is_instance_extension_enabled(VK_KHR_SURFACE_EXTENSION_NAME);
 
-   if (instance_data.is_instance_extension_enabled(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME))
-   {
-      GET_PROC_ADDR(vkGetPhysicalDeviceFeatures2KHR);
-   }
-
-   if (instance_data.is_instance_extension_enabled(VK_KHR_SURFACE_EXTENSION_NAME))
+   if (surface_enabled)
    {
       PFN_vkVoidFunction wsi_func = wsi::get_proc_addr(funcName, instance_data);
       if (wsi_func)
       {
          return wsi_func;
       }
+   }
+
+   switch (name_hash)
+   {
+   GET_PROC_ADDR(vkGetPhysicalDeviceFeatures2KHR, instance_data.is_instance_extension_enabled(
+                                                     VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME));
 
-      GET_PROC_ADDR(vkGetPhysicalDeviceSurfaceSupportKHR);
-      GET_PROC_ADDR(vkGetPhysicalDeviceSurfaceCapabilitiesKHR);
-      GET_PROC_ADDR(vkGetPhysicalDeviceSurfaceFormatsKHR);
-      GET_PROC_ADDR(vkGetPhysicalDeviceSurfacePresentModesKHR);
-      GET_PROC_ADDR(vkDestroySurfaceKHR);
+   GET_PROC_ADDR(vkGetPhysicalDeviceSurfaceSupportKHR, surface_enabled);
+   GET_PROC_ADDR(vkGetPhysicalDeviceSurfaceCapabilitiesKHR, surface_enabled);
+   GET_PROC_ADDR(vkGetPhysicalDeviceSurfaceFormatsKHR, surface_enabled);
+   GET_PROC_ADDR(vkGetPhysicalDeviceSurfacePresentModesKHR, surface_enabled);
+   GET_PROC_ADDR(vkDestroySurfaceKHR, surface_enabled);
 
-      if (instance_data.is_instance_extension_enabled(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME))
-      {
-         GET_PROC_ADDR(vkGetPhysicalDeviceSurfaceCapabilities2KHR);
-         GET_PROC_ADDR(vkGetPhysicalDeviceSurfaceFormats2KHR);
-      }
+   GET_PROC_ADDR(vkGetPhysicalDeviceSurfaceCapabilities2KHR,
+                 surface_enabled && instance_data.is_instance_extension_enabled(
+                                       VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME));
+   GET_PROC_ADDR(vkGetPhysicalDeviceSurfaceFormats2KHR,
+                 surface_enabled && instance_data.is_instance_extension_enabled(
+                                       VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME));
+   default:
+      break;
    }
 
    return instance_data.disp.get_user_enabled_entrypoint(instance, instance_data.api_version, funcName);
@@ -28,6 +28,8 @@
 #include "wsi/wsi_factory.hpp"
 #include "wsi/surface.hpp"
 #include "util/unordered_map.hpp"
+#include "util/lookup_table.hpp"
+#include "util/string_hash.hpp"
 #include "util/log.hpp"
 #include "util/helpers.hpp"
 #include "util/macros.hpp"
@@ -44,32 +46,101 @@ static std::mutex g_data_lock;
 static util::unordered_map<void *, instance_private_data *> g_instance_data{ util::allocator::get_generic() };
 static util::unordered_map<void *, device_private_data *> g_device_data{ util::allocator::get_generic() };
 
-VkResult instance_dispatch_table::populate(VkInstance instance, PFN_vkGetInstanceProcAddr get_proc)
-{
-   static constexpr entrypoint entrypoints_init[] = {
+/* Copies of the dictionaries above looked up without g_data_lock, which is only taken by the entries that do not fit.
+ * Only written with g_data_lock held. */
+static constexpr size_t LOOKUP_TABLE_CAPACITY = 64;
+static util::lookup_table<instance_private_data, LOOKUP_TABLE_CAPACITY> g_instance_lookup;
+static util::lookup_table<device_private_data, LOOKUP_TABLE_CAPACITY> g_device_lookup;
+
+static constexpr entrypoint instance_entrypoints_init[] = {
 #define DISPATCH_TABLE_ENTRY(name, ext_name, api_version, required) \
    { "vk" #name, ext_name, nullptr, api_version, false, required },
-      INSTANCE_ENTRYPOINTS_LIST(DISPATCH_TABLE_ENTRY)
+   INSTANCE_ENTRYPOINTS_LIST(DISPATCH_TABLE_ENTRY)
 #undef DISPATCH_TABLE_ENTRY
-   };
+};
+
+static constexpr entrypoint device_entrypoints_init[] = {
+#define DISPATCH_TABLE_ENTRY(name, ext_name, api_version, required) \
+   { "vk" #name, ext_name, nullptr, api_version, false, required },
+   DEVICE_ENTRYPOINTS_LIST(DISPATCH_TABLE_ENTRY)
+#undef DISPATCH_TABLE_ENTRY
+};
 
-   static constexpr auto num_entrypoints = std::distance(std::begin(entrypoints_init), std::end(entrypoints_init));
+/* The index enums and the tables above are generated from the same lists. */
+static_assert(std::size(instance_entrypoints_init) == instance_dispatch_table::entrypoint_index::count);
+static_assert(std::size(device_entrypoints_init) == device_dispatch_table::entrypoint_index::count);
+
+/* Names are resolved with a switch over their hash, the case labels being generated from the entrypoint lists.
+ * A hash collision between two entrypoints of a list is a duplicate case label, so it fails to compile. */
+#define DISPATCH_TABLE_CASE(name, unused1, unused2, unused3) \
+   case util::string_hash("vk" #name):                        \
+      index = entrypoint_index::name;                         \
+      break;
+
+std::optional<size_t> instance_dispatch_table::find_index(const char *fn_name)
+{
+   size_t index;
+   switch (util::string_hash(fn_name))
+   {
+   INSTANCE_ENTRYPOINTS_LIST(DISPATCH_TABLE_CASE)
+   default:
+      return std::nullopt;
+   }
+
+   /* Names outside the list can have the same hash as one in it. */
+   if (strcmp(fn_name, instance_entrypoints_init[index].name) != 0)
+   {
+      return std::nullopt;
+   }
+   return index;
+}
+
+std::optional<size_t> device_dispatch_table::find_index(const char *fn_name)
+{
+   size_t index;
+   switch (util::string_hash(fn_name))
+   {
+   DEVICE_ENTRYPOINTS_LIST(DISPATCH_TABLE_CASE)
+   default:
+      return std::nullopt;
+   }
+
+   /* Names outside the list can have the same hash as one in it. */
+   if (strcmp(fn_name, device_entrypoints_init[index].name) != 0)
+   {
+      return std::nullopt;
+   }
+   return index;
+}
+
+#undef DISPATCH_TABLE_CASE
+
+/**
+ * @brief Fill @p entrypoints with the entries of @p entrypoints_init, in the same order.
+ */
+template <typename GetProcType, typename Dispatchable, size_t N>
+static VkResult populate_entrypoints(dispatch_table::entrypoint_list &entrypoints,
+                                     const entrypoint (&entrypoints_init)[N], Dispatchable dispatchable,
+                                     GetProcType get_proc)
+{
+   if (!entrypoints.try_reserve(N))
+   {
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
 
-   for (size_t i = 0; i < num_entrypoints; i++)
+   for (const entrypoint &entrypoint : entrypoints_init)
    {
-      const entrypoint *entrypoint = &entrypoints_init[i];
-      PFN_vkVoidFunction ret = get_proc(instance, entrypoint->name);
-      if (!ret && entrypoint->required)
+      PFN_vkVoidFunction ret = get_proc(dispatchable, entrypoint.name);
+      if (!ret && entrypoint.required)
       {
          return VK_ERROR_INITIALIZATION_FAILED;
       }
-      struct entrypoint e = *entrypoint;
+      struct entrypoint e = entrypoint;
       e.fn = ret;
       e.user_visible = false;
 
-      if (!m_entrypoints->try_insert(std::make_pair(e.name, e)).has_value())
+      if (!entrypoints.try_push_back(e))
       {
-         WSI_LOG_ERROR("Failed to allocate memory for instance dispatch table entry.");
          return VK_ERROR_OUT_OF_HOST_MEMORY;
       }
    }
@@ -77,15 +148,25 @@ VkResult instance_dispatch_table::populate(VkInstance instance, PFN_vkGetInstanc
    return VK_SUCCESS;
 }
 
+VkResult instance_dispatch_table::populate(VkInstance instance, PFN_vkGetInstanceProcAddr get_proc)
+{
+   VkResult result = populate_entrypoints(*m_entrypoints, instance_entrypoints_init, instance, get_proc);
+   if (result == VK_ERROR_OUT_OF_HOST_MEMORY)
+   {
+      WSI_LOG_ERROR("Failed to allocate memory for instance dispatch table.");
+   }
+   return result;
+}
+
 void dispatch_table::set_user_enabled_extensions(const char *const *extension_names, size_t extension_count)
 {
    for (size_t i = 0; i < extension_count; i++)
    {
       for (auto &entrypoint : *m_entrypoints)
       {
-         if (!strcmp(entrypoint.second.ext_name, extension_names[i]))
+         if (!strcmp(entrypoint.ext_name, extension_names[i]))
          {
-            entrypoint.second.user_visible = true;
+            entrypoint.user_visible = true;
          }
       }
    }
@@ -94,15 +175,14 @@ void dispatch_table::set_user_enabled_extensions(const char *const *extension_na
 PFN_vkVoidFunction instance_dispatch_table::get_user_enabled_entrypoint(VkInstance instance, uint32_t api_version,
                                                                         const char *fn_name) const
 {
-   auto item = m_entrypoints->find(fn_name);
-   if (item != m_entrypoints->end())
+   const entrypoint *item = find_entrypoint(fn_name);
+   if (item != nullptr)
    {
       /* An entrypoint is allowed to use if it has been enabled by the user or is included in the core specficiation of the API version.
        * Entrypoints included in API version 1.0 are allowed by default. */
-      if (item->second.user_visible || item->second.api_version <= api_version ||
-          item->second.api_version == VK_API_VERSION_1_0)
+      if (item->user_visible || item->api_version <= api_version || item->api_version == VK_API_VERSION_1_0)
       {
-         return item->second.fn;
+         return item->fn;
       }
       else
       {
@@ -115,48 +195,25 @@ PFN_vkVoidFunction instance_dispatch_table::get_user_enabled_entrypoint(VkInstan
 
 VkResult device_dispatch_table::populate(VkDevice dev, PFN_vkGetDeviceProcAddr get_proc_fn)
 {
-   static constexpr entrypoint entrypoints_init[] = {
-#define DISPATCH_TABLE_ENTRY(name, ext_name, api_version, required) \
-   { "vk" #name, ext_name, nullptr, api_version, false, required },
-      DEVICE_ENTRYPOINTS_LIST(DISPATCH_TABLE_ENTRY)
-#undef DISPATCH_TABLE_ENTRY
-   };
-   static constexpr auto num_entrypoints = std::distance(std::begin(entrypoints_init), std::end(entrypoints_init));
-
-   for (size_t i = 0; i < num_entrypoints; i++)
+   VkResult result = populate_entrypoints(*m_entrypoints, device_entrypoints_init, dev, get_proc_fn);
+   if (result == VK_ERROR_OUT_OF_HOST_MEMORY)
    {
-      const entrypoint entrypoint = entrypoints_init[i];
-      PFN_vkVoidFunction ret = get_proc_fn(dev, entrypoint.name);
-      if (!ret && entrypoint.required)
-      {
-         return VK_ERROR_INITIALIZATION_FAILED;
-      }
-      struct entrypoint e = entrypoint;
-      e.fn = ret;
-      e.user_visible = false;
-
-      if (!m_entrypoints->try_insert(std::make_pair(e.name, e)).has_value())
-      {
-         WSI_LOG_ERROR("Failed to allocate memory for device dispatch table entry.");
-         return VK_ERROR_OUT_OF_HOST_MEMORY;
-      }
+      WSI_LOG_ERROR("Failed to allocate memory for device dispatch table.");
    }
-
-   return VK_SUCCESS;
+   return result;
 }
 
 PFN_vkVoidFunction device_dispatch_table::get_user_enabled_entrypoint(VkDevice device, uint32_t api_version,
                                                                       const char *fn_name) const
 {
-   auto item = m_entrypoints->find(fn_name);
-   if (item != m_entrypoints->end())
+   const entrypoint *item = find_entrypoint(fn_name);
+   if (item != nullptr)
    {
       /* An entrypoint is allowed to use if it has been enabled by the user or is included in the core specficiation of the API version.
        * Entrypoints included in API version 1.0 are allowed by default. */
-      if (item->second.user_visible || item->second.api_version <= api_version ||
-          item->second.api_version == VK_API_VERSION_1_0)
+      if (item->user_visible || item->api_version <= api_version || item->api_version == VK_API_VERSION_1_0)
       {
-         return item->second.fn;
+         return item->fn;
       }
       else
       {
@@ -174,8 +231,9 @@ instance_private_data::instance_private_data(instance_dispatch_table table, PFN_
    , api_version{ api_version }
    , SetInstanceLoaderData{ set_loader_data }
    , enabled_layer_platforms{ enabled_layer_platforms }
-   , allocator{ alloc }
+   , allocator{ alloc, alloc.m_scope, nullptr, util::memory_accounting::is_enabled() ? &memory_accounting : nullptr }
    , surfaces{ alloc }
+   , format_queries{ alloc }
    , enabled_extensions{ allocator }
 {
 }
@@ -215,6 +273,7 @@ VkResult instance_private_data::associate(VkInstance instance, instance_dispatch
    {
       WSI_LOG_WARNING("Hash collision when adding new instance (%p)", reinterpret_cast<void *>(instance));
 
+      g_instance_lookup.erase(key);
       destroy(it->second);
       g_instance_data.erase(it);
    }
@@ -222,6 +281,7 @@ VkResult instance_private_data::associate(VkInstance instance, instance_dispatch
    auto result = g_instance_data.try_insert(std::make_pair(key, instance_data.get()));
    if (result.has_value())
    {
+      g_instance_lookup.insert(key, instance_data.get());
       instance_data.release(); // NOLINT(bugprone-unused-return-value)
       return VK_SUCCESS;
    }
@@ -248,6 +308,7 @@ void instance_private_data::disassociate(VkInstance instance)
       }
 
       instance_data = it->second;
+      g_instance_lookup.erase(it->first);
       g_instance_data.erase(it);
    }
 
@@ -257,8 +318,14 @@ void instance_private_data::disassociate(VkInstance instance)
 template <typename dispatchable_type>
 static instance_private_data &get_instance_private_data(dispatchable_type dispatchable_object)
 {
+   const auto key = get_key(dispatchable_object);
+   if (instance_private_data *instance_data = g_instance_lookup.find(key))
+   {
+      return *instance_data;
+   }
+
    scoped_mutex lock(g_data_lock);
-   return *g_instance_data.at(get_key(dispatchable_object));
+   return *g_instance_data.at(key);
 }
 
 instance_private_data &instance_private_data::get(VkInstance instance)
@@ -331,7 +398,8 @@ void instance_private_data::destroy(instance_private_data *instance_data)
 {
    assert(instance_data);
 
-   auto alloc = instance_data->get_allocator();
+   /* The object was not counted in its own accounting, which is gone by the time it is freed. */
+   util::allocator alloc{ instance_data->get_allocator(), instance_data->get_allocator().m_scope, nullptr, nullptr };
    alloc.destroy<instance_private_data>(1, instance_data);
 }
 
@@ -411,12 +479,17 @@ device_private_data::device_private_data(instance_private_data &inst_data, VkPhy
    , SetDeviceLoaderData{ set_loader_data }
    , physical_device{ phys_dev }
    , device{ dev }
-   , allocator{ alloc }
+   , allocator{ alloc, alloc.m_scope, nullptr, util::memory_accounting::is_enabled() ? &memory_accounting : nullptr }
    , swapchains{ allocator } /* clang-format off */
    , enabled_extensions{ allocator }
    , compression_control_enabled{ false }
    , present_id_enabled { false }
    , swapchain_maintenance1_enabled{ false }
+   , single_queue_family{}
+   , sync_fd_import_supported{ false }
+   , timeline_semaphore_enabled{ false }
+   , layer_queue{ VK_NULL_HANDLE }
+   , layer_queue_dedicated{ false }
 #if VULKAN_WSI_LAYER_EXPERIMENTAL
    , present_timing_enabled { true }
 #endif
@@ -445,6 +518,7 @@ VkResult device_private_data::associate(VkDevice dev, instance_private_data &ins
    if (it != g_device_data.end())
    {
       WSI_LOG_WARNING("Hash collision when adding new device (%p)", reinterpret_cast<void *>(dev));
+      g_device_lookup.erase(key);
       destroy(it->second);
       g_device_data.erase(it);
    }
@@ -452,6 +526,7 @@ VkResult device_private_data::associate(VkDevice dev, instance_private_data &ins
    auto result = g_device_data.try_insert(std::make_pair(key, device_data.get()));
    if (result.has_value())
    {
+      g_device_lookup.insert(key, device_data.get());
       device_data.release(); // NOLINT(bugprone-unused-return-value)
       return VK_SUCCESS;
    }
@@ -478,6 +553,7 @@ void device_private_data::disassociate(VkDevice dev)
       }
 
       device_data = it->second;
+      g_device_lookup.erase(it->first);
       g_device_data.erase(it);
    }
 
@@ -487,9 +563,14 @@ void device_private_data::disassociate(VkDevice dev)
 template <typename dispatchable_type>
 static device_private_data &get_device_private_data(dispatchable_type dispatchable_object)
 {
-   scoped_mutex lock(g_data_lock);
+   const auto key = get_key(dispatchable_object);
+   if (device_private_data *device_data = g_device_lookup.find(key))
+   {
+      return *device_data;
+   }
 
-   return *g_device_data.at(get_key(dispatchable_object));
+   scoped_mutex lock(g_data_lock);
+   return *g_device_data.at(key);
 }
 
 device_private_data &device_private_data::get(VkDevice device)
@@ -506,7 +587,16 @@ VkResult device_private_data::add_layer_swapchain(VkSwapchainKHR swapchain)
 {
    scoped_mutex lock(swapchains_lock);
    auto result = swapchains.try_insert(swapchain);
-   return result.has_value() ? VK_SUCCESS : VK_ERROR_OUT_OF_HOST_MEMORY;
+   if (!result.has_value())
+   {
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
+
+   if (!swapchain_lookup.insert(reinterpret_cast<const void *>(swapchain), reinterpret_cast<void *>(swapchain)))
+   {
+      untabled_swapchains.fetch_add(1, std::memory_order_release);
+   }
+   return VK_SUCCESS;
 }
 
 void device_private_data::remove_layer_swapchain(VkSwapchainKHR swapchain)
@@ -516,14 +606,35 @@ void device_private_data::remove_layer_swapchain(VkSwapchainKHR swapchain)
    if (it != swapchains.end())
    {
       swapchains.erase(swapchain);
+
+      const void *key = reinterpret_cast<const void *>(swapchain);
+      if (swapchain_lookup.find(key) != nullptr)
+      {
+         swapchain_lookup.erase(key);
+      }
+      else
+      {
+         untabled_swapchains.fetch_sub(1, std::memory_order_release);
+      }
    }
 }
 
 bool device_private_data::layer_owns_all_swapchains(const VkSwapchainKHR *swapchain, uint32_t swapchain_count) const
 {
-   scoped_mutex lock(swapchains_lock);
    for (uint32_t i = 0; i < swapchain_count; i++)
    {
+      if (swapchain_lookup.find(reinterpret_cast<const void *>(swapchain[i])) != nullptr)
+      {
+         continue;
+      }
+
+      /* Swapchains of the ICD are not in the table either, only look further when some layer swapchains are not. */
+      if (untabled_swapchains.load(std::memory_order_acquire) == 0)
+      {
+         return false;
+      }
+
+      scoped_mutex lock(swapchains_lock);
       if (swapchains.find(swapchain[i]) == swapchains.end())
       {
          return false;
@@ -540,7 +651,7 @@ bool device_private_data::should_layer_create_swapchain(VkSurfaceKHR vk_surface)
 bool device_private_data::can_icds_create_swapchain(VkSurfaceKHR vk_surface)
 {
    UNUSED(vk_surface);
-   return disp.get_fn<PFN_vkCreateSwapchainKHR>("vkCreateSwapchainKHR").has_value();
+   return disp.get_CreateSwapchainKHR() != nullptr;
 }
 
 VkResult device_private_data::set_device_enabled_extensions(const char *const *extension_names, size_t extension_count)
@@ -557,7 +668,8 @@ void device_private_data::destroy(device_private_data *device_data)
 {
    assert(device_data);
 
-   auto alloc = device_data->get_allocator();
+   /* The object was not counted in its own accounting, which is gone by the time it is freed. */
+   util::allocator alloc{ device_data->get_allocator(), device_data->get_allocator().m_scope, nullptr, nullptr };
    alloc.destroy<device_private_data>(1, device_data);
 }
 
@@ -571,6 +683,16 @@ bool device_private_data::is_swapchain_compression_control_enabled() const
    return compression_control_enabled;
 }
 
+void device_private_data::set_auto_fixed_rate_compression_enabled(bool enable)
+{
+   auto_fixed_rate_compression_enabled = enable;
+}
+
+bool device_private_data::is_auto_fixed_rate_compression_enabled() const
+{
+   return auto_fixed_rate_compression_enabled;
+}
+
 void device_private_data::set_layer_frame_boundary_handling_enabled(bool enable)
 {
    handle_frame_boundary_events = enable;
@@ -601,4 +723,55 @@ bool device_private_data::is_swapchain_maintenance1_enabled() const
    return swapchain_maintenance1_enabled;
 }
 
+void device_private_data::set_single_queue_family(std::optional<uint32_t> family_index)
+{
+   single_queue_family = family_index;
+}
+
+std::optional<uint32_t> device_private_data::get_single_queue_family() const
+{
+   return single_queue_family;
+}
+
+void device_private_data::set_sync_fd_import_supported(bool enable)
+{
+   sync_fd_import_supported = enable;
+}
+
+bool device_private_data::is_sync_fd_import_supported() const
+{
+   return sync_fd_import_supported;
+}
+
+void device_private_data::set_timeline_semaphore_enabled(bool enable)
+{
+   timeline_semaphore_enabled = enable;
+}
+
+bool device_private_data::is_timeline_semaphore_enabled() const
+{
+   return timeline_semaphore_enabled;
+}
+
+void device_private_data::set_layer_queue(VkQueue queue, bool dedicated)
+{
+   layer_queue = queue;
+   layer_queue_dedicated = dedicated;
+}
+
+VkQueue device_private_data::get_layer_queue() const
+{
+   return layer_queue;
+}
+
+bool device_private_data::is_layer_queue_dedicated() const
+{
+   return layer_queue_dedicated;
+}
+
+std::mutex &device_private_data::get_layer_queue_lock()
+{
+   return layer_queue_lock;
+}
+
 } /* namespace layer */
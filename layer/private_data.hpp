@@ -31,6 +31,10 @@
 #include <util/unordered_set.hpp>
 #include <util/unordered_map.hpp>
 #include <util/extension_list.hpp>
+#include <util/allocation_stats.hpp>
+#include <util/format_query_cache.hpp>
+#include <util/memory_type_cache.hpp>
+#include <util/lookup_table.hpp>
 
 #include <vulkan/vulkan.h>
 #include <vulkan/vk_layer.h>
@@ -44,9 +48,11 @@
 #include <memory>
 #include <unordered_set>
 #include <cassert>
+#include <atomic>
 #include <mutex>
 #include <limits>
 #include <cstring>
+#include <optional>
 using scoped_mutex = std::lock_guard<std::mutex>;
 
 /** Forward declare stored objects */
@@ -79,15 +85,21 @@ struct entrypoint
 class dispatch_table
 {
 public:
-   using entrypoint_list = util::unordered_map<std::string, entrypoint>;
+   /** @brief Entrypoints in the order of the list the table is generated from. */
+   using entrypoint_list = util::vector<entrypoint>;
+
+   /** @brief Function returning the index of an entrypoint in the list from its name, or std::nullopt. */
+   using find_index_fn = std::optional<size_t> (*)(const char *fn_name);
 
    /**
     * @brief Construct a new dispatch table object
     *
     * @param allocator Pre-allocated entrypoint storage container
+    * @param find_index Name lookup for the entrypoints the table is generated from.
     */
-   dispatch_table(util::unique_ptr<entrypoint_list> entrypoints)
+   dispatch_table(util::unique_ptr<entrypoint_list> entrypoints, find_index_fn find_index)
       : m_entrypoints(std::move(entrypoints))
+      , m_find_index(find_index)
    {
       /* This pointer is expected to be valid */
       assert(m_entrypoints != nullptr);
@@ -103,10 +115,10 @@ public:
    template <typename FunctionType>
    std::optional<FunctionType> get_fn(const char *fn_name) const
    {
-      auto fn = m_entrypoints->find(fn_name);
-      if (fn != m_entrypoints->end())
+      auto index = m_find_index(fn_name);
+      if (index.has_value())
       {
-         return reinterpret_cast<FunctionType>(fn->second.fn);
+         return get_fn_at<FunctionType>(*index);
       }
 
       return std::nullopt;
@@ -121,12 +133,43 @@ public:
    void set_user_enabled_extensions(const char *const *extension_names, size_t extension_count);
 
 protected:
+   /**
+    * @brief Get the function object from the entrypoints by its index in the list the table is generated from.
+    *
+    * @return the requested function pointer, or std::nullopt if the table was not populated up to @p index.
+    */
+   template <typename FunctionType>
+   std::optional<FunctionType> get_fn_at(size_t index) const
+   {
+      if (index < m_entrypoints->size())
+      {
+         return reinterpret_cast<FunctionType>((*m_entrypoints)[index].fn);
+      }
+
+      return std::nullopt;
+   }
+
+   /**
+    * @brief Get the entry of the entrypoint called @p fn_name, or nullptr if the table does not contain it.
+    */
+   const entrypoint *find_entrypoint(const char *fn_name) const
+   {
+      auto index = m_find_index(fn_name);
+      if (index.has_value() && *index < m_entrypoints->size())
+      {
+         return &(*m_entrypoints)[*index];
+      }
+
+      return nullptr;
+   }
+
    /**
     * @brief Call function from the dispatch table entrypoints.
     *
     * @tparam FunctionType The signature of the function to call.
     * @tparam Args Argument types of the function to call.
     *
+    * @param index Index of the function in the list the table is generated from.
     * @param fn_name Name of the function to call.
     * @param args Arguments to the function to call.
     * @return function return value or std::nullopt if function is not present in entrypoints
@@ -134,10 +177,10 @@ protected:
    template <
       typename FunctionType, class... Args, typename ReturnType = std::invoke_result_t<FunctionType, Args...>,
       std::enable_if_t<!std::is_void<ReturnType>::value && !std::is_same<ReturnType, VkResult>::value, bool> = true>
-   std::optional<ReturnType> call_fn(const char *fn_name, Args &&...args) const
+   std::optional<ReturnType> call_fn(size_t index, const char *fn_name, Args &&...args) const
    {
-      auto fn = get_fn<FunctionType>(fn_name);
-      if (fn.has_value())
+      auto fn = get_fn_at<FunctionType>(index);
+      if (fn.has_value() && *fn != nullptr)
       {
          return (*fn)(std::forward<Args>(args)...);
       }
@@ -154,15 +197,16 @@ protected:
     * @tparam FunctionType The signature of the function to call.
     * @tparam Args Argument types of the function to call.
     *
+    * @param index Index of the function in the list the table is generated from.
     * @param fn_name Name of the function to call.
     * @param args Arguments to the function to call.
     */
    template <typename FunctionType, class... Args, typename ReturnType = std::invoke_result_t<FunctionType, Args...>,
              std::enable_if_t<std::is_void<ReturnType>::value, bool> = true>
-   void call_fn(const char *fn_name, Args &&...args) const
+   void call_fn(size_t index, const char *fn_name, Args &&...args) const
    {
-      auto fn = get_fn<FunctionType>(fn_name);
-      if (fn.has_value())
+      auto fn = get_fn_at<FunctionType>(index);
+      if (fn.has_value() && *fn != nullptr)
       {
          return (*fn)(std::forward<Args>(args)...);
       }
@@ -177,16 +221,17 @@ protected:
     * @tparam FunctionType The signature of the function to call.
     * @tparam Args Argument types of the function to call.
     *
+    * @param index Index of the function in the list the table is generated from.
     * @param fn_name Name of the function to call.
     * @param args Arguments to the function to call.
     * @return function return value or VK_ERROR_EXTENSION_NOT_PRESENT if function is not present in entrypoints
     */
    template <typename FunctionType, class... Args, typename ReturnType = std::invoke_result_t<FunctionType, Args...>,
              std::enable_if_t<std::is_same<ReturnType, VkResult>::value, bool> = true>
-   VkResult call_fn(const char *fn_name, Args &&...args) const
+   VkResult call_fn(size_t index, const char *fn_name, Args &&...args) const
    {
-      auto fn = get_fn<FunctionType>(fn_name);
-      if (fn.has_value())
+      auto fn = get_fn_at<FunctionType>(index);
+      if (fn.has_value() && *fn != nullptr)
       {
          return (*fn)(std::forward<Args>(args)...);
       }
@@ -198,6 +243,8 @@ protected:
 
    /** @brief Vector that holds the entrypoints of the dispatch table */
    util::unique_ptr<entrypoint_list> m_entrypoints;
+
+   find_index_fn m_find_index;
 };
 
 /* Represents the maximum possible Vulkan API version. */
@@ -220,6 +267,7 @@ static constexpr uint32_t API_VERSION_MAX = UINT32_MAX;
    EP(DestroyInstance, "", VK_API_VERSION_1_0, true)                                                                 \
    EP(GetPhysicalDeviceProperties, "", VK_API_VERSION_1_0, true)                                                     \
    EP(GetPhysicalDeviceImageFormatProperties, "", VK_API_VERSION_1_0, true)                                          \
+   EP(GetPhysicalDeviceQueueFamilyProperties, "", VK_API_VERSION_1_0, true)                                          \
    EP(EnumerateDeviceExtensionProperties, "", VK_API_VERSION_1_0, true)                                              \
    /* VK_KHR_surface */                                                                                              \
    EP(DestroySurfaceKHR, VK_KHR_SURFACE_EXTENSION_NAME, API_VERSION_MAX, false)                                      \
@@ -265,6 +313,8 @@ static constexpr uint32_t API_VERSION_MAX = UINT32_MAX;
    EP(GetPhysicalDeviceExternalFencePropertiesKHR, VK_KHR_EXTERNAL_FENCE_CAPABILITIES_EXTENSION_NAME,                \
       VK_API_VERSION_1_1, false)                                                                                     \
    EP(GetPhysicalDeviceExternalBufferPropertiesKHR, VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME,              \
+      VK_API_VERSION_1_1, false)                                                                                     \
+   EP(GetPhysicalDeviceExternalSemaphorePropertiesKHR, VK_KHR_EXTERNAL_SEMAPHORE_CAPABILITIES_EXTENSION_NAME,        \
       VK_API_VERSION_1_1, false)
 
 /**
@@ -273,6 +323,21 @@ static constexpr uint32_t API_VERSION_MAX = UINT32_MAX;
 class instance_dispatch_table : public dispatch_table
 {
 public:
+   /**
+    * @brief Position of each entrypoint of INSTANCE_ENTRYPOINTS_LIST in the table, named as the entrypoint without the
+    *        "vk" prefix.
+    */
+   struct entrypoint_index
+   {
+      enum : size_t
+      {
+#define DISPATCH_TABLE_INDEX(name, unused1, unused2, unused3) name,
+         INSTANCE_ENTRYPOINTS_LIST(DISPATCH_TABLE_INDEX)
+#undef DISPATCH_TABLE_INDEX
+         count
+      };
+   };
+
    static std::optional<instance_dispatch_table> create(const util::allocator &allocator)
    {
       auto entrypoints = allocator.make_unique<dispatch_table::entrypoint_list>(allocator);
@@ -311,16 +376,30 @@ public:
     *    disp.GetInstanceProcAddr(instance, fn_name);
     * The result type will be matching the function signature, so there is no need for casting.
     */
-#define DISPATCH_TABLE_SHORTCUT(name, unused1, unused2, unused3)             \
-   template <class... Args>                                                  \
-   auto name(Args &&...args) const                                           \
-   {                                                                         \
-      return call_fn<PFN_vk##name>("vk" #name, std::forward<Args>(args)...); \
+#define DISPATCH_TABLE_SHORTCUT(name, unused1, unused2, unused3)                                       \
+   template <class... Args>                                                                            \
+   auto name(Args &&...args) const                                                                     \
+   {                                                                                                   \
+      return call_fn<PFN_vk##name>(entrypoint_index::name, "vk" #name, std::forward<Args>(args)...); \
    };
 
    INSTANCE_ENTRYPOINTS_LIST(DISPATCH_TABLE_SHORTCUT)
 #undef DISPATCH_TABLE_SHORTCUT
 
+   /* Generate typed getters of the dispatch table entrypoints, named as the entrypoint with "get_" instead of the "vk"
+    * prefix. They return nullptr for entrypoints the next layer does not provide, so optional entrypoints are checked
+    * without looking them up by name:
+    *    if (disp.get_GetPhysicalDeviceSurfaceSupportKHR() != nullptr)
+    */
+#define DISPATCH_TABLE_GETTER(name, unused1, unused2, unused3)                  \
+   PFN_vk##name get_##name() const                                              \
+   {                                                                            \
+      return get_fn_at<PFN_vk##name>(entrypoint_index::name).value_or(nullptr); \
+   }
+
+   INSTANCE_ENTRYPOINTS_LIST(DISPATCH_TABLE_GETTER)
+#undef DISPATCH_TABLE_GETTER
+
 private:
    /**
     * @brief Construct instance dispatch table object
@@ -328,9 +407,14 @@ private:
     * @param table Pre-allocated dispatch table
     */
    instance_dispatch_table(util::unique_ptr<dispatch_table::entrypoint_list> table)
-      : dispatch_table{ std::move(table) }
+      : dispatch_table{ std::move(table), find_index }
    {
    }
+
+   /**
+    * @brief Index of the entrypoint called @p fn_name in INSTANCE_ENTRYPOINTS_LIST, or std::nullopt.
+    */
+   static std::optional<size_t> find_index(const char *fn_name);
 };
 
 /* List of device entrypoints in the layer's device dispatch table.
@@ -350,10 +434,13 @@ private:
  */
 
 #if VULKAN_WSI_LAYER_EXPERIMENTAL
-#define DEVICE_ENTRYPOINTS_LIST_EXPERIMENTAL(EP)                                                         \
-   EP(GetSwapchainTimeDomainPropertiesEXT, VK_EXT_PRESENT_TIMING_EXTENSION_NAME, API_VERSION_MAX, false) \
-   EP(GetSwapchainTimingPropertiesEXT, VK_EXT_PRESENT_TIMING_EXTENSION_NAME, API_VERSION_MAX, false)     \
-   EP(SetSwapchainPresentTimingQueueSizeEXT, VK_EXT_PRESENT_TIMING_EXTENSION_NAME, API_VERSION_MAX, false)
+#define DEVICE_ENTRYPOINTS_LIST_EXPERIMENTAL(EP)                                                           \
+   EP(GetSwapchainTimeDomainPropertiesEXT, VK_EXT_PRESENT_TIMING_EXTENSION_NAME, API_VERSION_MAX, false)   \
+   EP(GetSwapchainTimingPropertiesEXT, VK_EXT_PRESENT_TIMING_EXTENSION_NAME, API_VERSION_MAX, false)       \
+   EP(SetSwapchainPresentTimingQueueSizeEXT, VK_EXT_PRESENT_TIMING_EXTENSION_NAME, API_VERSION_MAX, false) \
+   EP(GetPastPresentationTimingEXT, VK_EXT_PRESENT_TIMING_EXTENSION_NAME, API_VERSION_MAX, false)          \
+   EP(GetCalibratedTimestampsKHR, VK_KHR_CALIBRATED_TIMESTAMPS_EXTENSION_NAME, API_VERSION_MAX, false)     \
+   EP(GetCalibratedTimestampsEXT, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME, API_VERSION_MAX, false)
 #else
 #define DEVICE_ENTRYPOINTS_LIST_EXPERIMENTAL(EP)
 #endif
@@ -365,6 +452,7 @@ private:
    /* Vulkan 1.0 */                                                                                                \
    EP(GetDeviceProcAddr, "", VK_API_VERSION_1_0, true)                                                             \
    EP(GetDeviceQueue, "", VK_API_VERSION_1_0, true)                                                                \
+   EP(GetDeviceQueue2, "", VK_API_VERSION_1_1, false)                                                              \
    EP(QueueSubmit, "", VK_API_VERSION_1_0, true)                                                                   \
    EP(QueueWaitIdle, "", VK_API_VERSION_1_0, true)                                                                 \
    EP(CreateCommandPool, "", VK_API_VERSION_1_0, true)                                                             \
@@ -383,12 +471,26 @@ private:
    EP(MapMemory, "", VK_API_VERSION_1_0, true)                                                                     \
    EP(UnmapMemory, "", VK_API_VERSION_1_0, true)                                                                   \
    EP(GetImageSubresourceLayout, "", VK_API_VERSION_1_0, true)                                                     \
+   EP(CreateBuffer, "", VK_API_VERSION_1_0, true)                                                                  \
+   EP(DestroyBuffer, "", VK_API_VERSION_1_0, true)                                                                 \
+   EP(GetBufferMemoryRequirements, "", VK_API_VERSION_1_0, true)                                                   \
+   EP(BindBufferMemory, "", VK_API_VERSION_1_0, true)                                                              \
+   EP(InvalidateMappedMemoryRanges, "", VK_API_VERSION_1_0, true)                                                  \
+   EP(CmdPipelineBarrier, "", VK_API_VERSION_1_0, true)                                                            \
+   EP(CmdCopyImageToBuffer, "", VK_API_VERSION_1_0, true)                                                          \
+   EP(CmdCopyImage, "", VK_API_VERSION_1_0, true)                                                                  \
+   EP(CmdBlitImage, "", VK_API_VERSION_1_0, true)                                                                  \
    EP(CreateFence, "", VK_API_VERSION_1_0, true)                                                                   \
    EP(DestroyFence, "", VK_API_VERSION_1_0, true)                                                                  \
    EP(CreateSemaphore, "", VK_API_VERSION_1_0, true)                                                               \
    EP(DestroySemaphore, "", VK_API_VERSION_1_0, true)                                                              \
    EP(ResetFences, "", VK_API_VERSION_1_0, true)                                                                   \
    EP(WaitForFences, "", VK_API_VERSION_1_0, true)                                                                 \
+   /* VK_KHR_timeline_semaphore or */ /* 1.2 (without KHR suffix) */                                               \
+   EP(WaitSemaphores, "", VK_API_VERSION_1_2, false)                                                               \
+   EP(GetSemaphoreCounterValue, "", VK_API_VERSION_1_2, false)                                                     \
+   EP(WaitSemaphoresKHR, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, API_VERSION_MAX, false)                         \
+   EP(GetSemaphoreCounterValueKHR, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, API_VERSION_MAX, false)               \
    EP(DestroyDevice, "", VK_API_VERSION_1_0, true)                                                                 \
    /* VK_KHR_swapchain */                                                                                          \
    EP(CreateSwapchainKHR, VK_KHR_SWAPCHAIN_EXTENSION_NAME, API_VERSION_MAX, false)                                 \
@@ -406,6 +508,8 @@ private:
       false) /* VK_KHR_external_memory_fd */                                                                       \
    EP(GetMemoryFdKHR, VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME, API_VERSION_MAX, false)                            \
    EP(GetMemoryFdPropertiesKHR, VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME, API_VERSION_MAX, false)                  \
+   /* VK_EXT_external_memory_host */                                                                               \
+   EP(GetMemoryHostPointerPropertiesEXT, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME, API_VERSION_MAX, false)       \
    /* VK_KHR_bind_memory2 or */ /* 1.1 (without KHR suffix) */                                                     \
    EP(BindImageMemory2KHR, VK_KHR_BIND_MEMORY_2_EXTENSION_NAME, VK_API_VERSION_1_1, false)                         \
    EP(BindBufferMemory2KHR, VK_KHR_BIND_MEMORY_2_EXTENSION_NAME, VK_API_VERSION_1_1,                               \
@@ -428,6 +532,8 @@ private:
    EP(GetImageSparseMemoryRequirements2KHR, VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME, VK_API_VERSION_1_1,   \
       false)                                                                                                       \
    EP(ReleaseSwapchainImagesEXT, VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME, VK_API_VERSION_1_1, false)         \
+   /* VK_KHR_present_wait */                                                                                       \
+   EP(WaitForPresentKHR, VK_KHR_PRESENT_WAIT_EXTENSION_NAME, API_VERSION_MAX, false)                               \
    /* Custom entrypoints */                                                                                        \
    DEVICE_ENTRYPOINTS_LIST_EXPANSION(EP)
 
@@ -437,6 +543,21 @@ private:
 class device_dispatch_table : public dispatch_table
 {
 public:
+   /**
+    * @brief Position of each entrypoint of DEVICE_ENTRYPOINTS_LIST in the table, named as the entrypoint without the
+    *        "vk" prefix.
+    */
+   struct entrypoint_index
+   {
+      enum : size_t
+      {
+#define DISPATCH_TABLE_INDEX(name, unused1, unused2, unused3) name,
+         DEVICE_ENTRYPOINTS_LIST(DISPATCH_TABLE_INDEX)
+#undef DISPATCH_TABLE_INDEX
+         count
+      };
+   };
+
    static std::optional<device_dispatch_table> create(const util::allocator &allocator)
    {
       auto entrypoints = allocator.make_unique<dispatch_table::entrypoint_list>(allocator);
@@ -475,16 +596,30 @@ public:
     *    disp.GetDeviceProcAddr(instance, fn_name);
     * The result type will be matching the function signature, so there is no need for casting.
     */
-#define DISPATCH_TABLE_SHORTCUT(name, unused1, unused2, unused3)             \
-   template <class... Args>                                                  \
-   auto name(Args &&...args) const                                           \
-   {                                                                         \
-      return call_fn<PFN_vk##name>("vk" #name, std::forward<Args>(args)...); \
+#define DISPATCH_TABLE_SHORTCUT(name, unused1, unused2, unused3)                                       \
+   template <class... Args>                                                                            \
+   auto name(Args &&...args) const                                                                     \
+   {                                                                                                   \
+      return call_fn<PFN_vk##name>(entrypoint_index::name, "vk" #name, std::forward<Args>(args)...); \
    };
 
    DEVICE_ENTRYPOINTS_LIST(DISPATCH_TABLE_SHORTCUT)
 #undef DISPATCH_TABLE_SHORTCUT
 
+   /* Generate typed getters of the dispatch table entrypoints, named as the entrypoint with "get_" instead of the "vk"
+    * prefix. They return nullptr for entrypoints the next layer does not provide, so optional entrypoints are checked
+    * without looking them up by name:
+    *    if (disp.get_ImportFenceFdKHR() != nullptr)
+    */
+#define DISPATCH_TABLE_GETTER(name, unused1, unused2, unused3)                  \
+   PFN_vk##name get_##name() const                                              \
+   {                                                                            \
+      return get_fn_at<PFN_vk##name>(entrypoint_index::name).value_or(nullptr); \
+   }
+
+   DEVICE_ENTRYPOINTS_LIST(DISPATCH_TABLE_GETTER)
+#undef DISPATCH_TABLE_GETTER
+
 private:
    /**
     * @brief Construct instance dispatch table object
@@ -492,9 +627,14 @@ private:
     * @param table Pre-allocated dispatch table
     */
    device_dispatch_table(util::unique_ptr<dispatch_table::entrypoint_list> table)
-      : dispatch_table{ std::move(table) }
+      : dispatch_table{ std::move(table), find_index }
    {
    }
+
+   /**
+    * @brief Index of the entrypoint called @p fn_name in DEVICE_ENTRYPOINTS_LIST, or std::nullopt.
+    */
+   static std::optional<size_t> find_index(const char *fn_name);
 };
 
 /**
@@ -631,6 +771,22 @@ public:
       return allocator;
    }
 
+   /**
+    * @brief Host memory held by this instance, see util::memory_accounting.
+    */
+   const util::memory_accounting &get_memory_accounting() const
+   {
+      return memory_accounting;
+   }
+
+   /**
+    * @brief Format queries of the physical devices of this instance, see util::get_image_format_properties.
+    */
+   util::format_query_cache &get_format_queries()
+   {
+      return format_queries;
+   }
+
    /**
     * @brief Store the enabled instance extensions.
     *
@@ -700,6 +856,8 @@ private:
 
    const PFN_vkSetInstanceLoaderData SetInstanceLoaderData;
    const util::wsi_platform_set enabled_layer_platforms;
+   /* Declared before the allocator counting into it, so it outlives the containers using the allocator. */
+   util::memory_accounting memory_accounting;
    const util::allocator allocator;
 
    /**
@@ -715,6 +873,11 @@ private:
     */
    std::mutex surfaces_lock;
 
+   /**
+    * @brief Format queries answered by the physical devices of the instance, see @ref get_format_queries.
+    */
+   util::format_query_cache format_queries;
+
    /**
     * @brief List with the names of the enabled instance extensions.
     */
@@ -848,6 +1011,21 @@ public:
     */
    bool is_swapchain_compression_control_enabled() const;
 
+   /**
+    * @brief Set whether the layer enabled image compression control on the device, to pick a fixed-rate compression
+    *        for the swapchains the application chooses none for.
+    *
+    * @param enable true if swapchains should pick one.
+    */
+   void set_auto_fixed_rate_compression_enabled(bool enable);
+
+   /**
+    * @brief Check whether swapchains pick a fixed-rate compression when the application chooses none.
+    *
+    * @return true if enabled, false otherwise.
+    */
+   bool is_auto_fixed_rate_compression_enabled() const;
+
    /**
     * @brief Set whether we should handle frame boundary events.
     *
@@ -890,6 +1068,102 @@ public:
     */
    bool is_swapchain_maintenance1_enabled() const;
 
+   /**
+    * @brief Set the queue family all the queues of this device were created from.
+    *
+    * @param family_index Value to set single_queue_family member variable, empty when the queues span families.
+    */
+   void set_single_queue_family(std::optional<uint32_t> family_index);
+
+   /**
+    * @brief Get the queue family all the queues of this device belong to, so layer command buffers allocated for
+    *        that family can be submitted to any queue the application presents on.
+    *
+    * @return The family index, or an empty optional if the queues belong to several families.
+    */
+   std::optional<uint32_t> get_single_queue_family() const;
+
+   /**
+    * @brief Set whether the device can import sync FDs into fences and semaphores.
+    *
+    * @param enable Value to set sync_fd_import_supported member variable.
+    */
+   void set_sync_fd_import_supported(bool enable);
+
+   /**
+    * @brief Check whether vkImportFenceFdKHR and vkImportSemaphoreFdKHR are both available, resolved once at
+    *        device creation so acquire does not look them up by name.
+    *
+    * @return true if so, false otherwise.
+    */
+   bool is_sync_fd_import_supported() const;
+
+   /**
+    * @brief Set whether the application enabled the timelineSemaphore feature on this device.
+    *
+    * @param enable Value to set timeline_semaphore_enabled member variable.
+    */
+   void set_timeline_semaphore_enabled(bool enable);
+
+   /**
+    * @brief Check whether timeline semaphores can be used for present synchronization on this device.
+    *
+    * @return true if enabled, false otherwise.
+    */
+   bool is_timeline_semaphore_enabled() const;
+
+   /**
+    * @brief Set the queue the layer submits its own work to.
+    *
+    * @param queue     The queue, already initialized with SetDeviceLoaderData.
+    * @param dedicated Whether the layer added the queue to the device, rather than sharing one of the application.
+    */
+   void set_layer_queue(VkQueue queue, bool dedicated);
+
+   /**
+    * @brief The queue for the layer's own submissions, such as signalling the synchronization objects of acquires.
+    *
+    * Submissions must hold @ref get_layer_queue_lock, as the queue is shared by every swapchain of the device.
+    */
+   VkQueue get_layer_queue() const;
+
+   /**
+    * @brief Check whether the layer queue was added by the layer, so submissions to it never wait for the
+    *        application's work on the same queue.
+    *
+    * @return true if so, false when the layer shares a queue of the application.
+    */
+   bool is_layer_queue_dedicated() const;
+
+   /**
+    * @brief Lock serializing the layer's submissions to the layer queue.
+    */
+   std::mutex &get_layer_queue_lock();
+
+   /**
+    * @brief Statistics of the allocations made for the swapchain images of this device.
+    */
+   util::allocation_stats &get_allocation_stats()
+   {
+      return allocation_stats;
+   }
+
+   /**
+    * @brief Host memory held by this device, see util::memory_accounting.
+    */
+   const util::memory_accounting &get_memory_accounting() const
+   {
+      return memory_accounting;
+   }
+
+   /**
+    * @brief Memory types chosen for the external buffers imported into this device.
+    */
+   util::memory_type_cache &get_import_memory_types()
+   {
+      return import_memory_types;
+   }
+
 private:
    /* Allow util::allocator to access the private constructor */
    friend util::allocator;
@@ -916,9 +1190,21 @@ private:
     */
    static void destroy(device_private_data *device_data);
 
+   /* Declared before the allocator counting into it, so it outlives the containers using the allocator. */
+   util::memory_accounting memory_accounting;
    const util::allocator allocator;
    util::unordered_set<VkSwapchainKHR> swapchains;
    mutable std::mutex swapchains_lock;
+   /**
+    * @brief The swapchains, looked up without swapchains_lock by @ref layer_owns_all_swapchains.
+    *
+    * Values are unused, the table is a set. Written with swapchains_lock held.
+    */
+   util::lookup_table<void, 64> swapchain_lookup;
+   /**
+    * @brief Number of swapchains that did not fit in swapchain_lookup, only looked up with swapchains_lock held.
+    */
+   std::atomic<uint32_t> untabled_swapchains{ 0 };
 
    /**
     * @brief List with the names of the enabled device extensions.
@@ -931,6 +1217,11 @@ private:
     */
    bool compression_control_enabled;
 
+   /**
+    * @brief Stores whether swapchains pick a fixed-rate compression when the application chooses none.
+    */
+   bool auto_fixed_rate_compression_enabled{ false };
+
    /**
     * @brief Stores whether the layer should handle frame boundary events.
     */
@@ -947,6 +1238,43 @@ private:
     */
    bool swapchain_maintenance1_enabled;
 
+   /**
+    * @brief Stores the queue family all the queues of the device were created from, if there is only one.
+    */
+   std::optional<uint32_t> single_queue_family;
+
+   /**
+    * @brief Stores whether the device can import sync FDs into fences and semaphores.
+    */
+   bool sync_fd_import_supported;
+
+   /**
+    * @brief Stores whether the device has enabled the timelineSemaphore feature.
+    */
+   bool timeline_semaphore_enabled;
+
+   /**
+    * @brief Queue the layer submits its own work to, see @ref get_layer_queue.
+    */
+   VkQueue layer_queue;
+
+   /**
+    * @brief Stores whether the layer queue was added to the device by the layer.
+    */
+   bool layer_queue_dedicated;
+
+   std::mutex layer_queue_lock;
+
+   /**
+    * @brief Allocation statistics of the swapchains of the device, see @ref get_allocation_stats.
+    */
+   util::allocation_stats allocation_stats;
+
+   /**
+    * @brief Import memory types of the swapchains of the device, see @ref get_import_memory_types.
+    */
+   util::memory_type_cache import_memory_types;
+
 #if VULKAN_WSI_LAYER_EXPERIMENTAL
    /**
     * @brief Stores whether the device has enabled support for the present timing features.
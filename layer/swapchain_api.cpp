@@ -31,17 +31,61 @@
 #include <cassert>
 #include <cstdlib>
 #include <new>
+#include <optional>
 
 #include "private_data.hpp"
 #include "swapchain_api.hpp"
 
+#include <util/api_capture.hpp>
 #include <util/helpers.hpp>
+#include <util/scratch_allocator.hpp>
 
 #include <wsi/synchronization.hpp>
 #include <wsi/wsi_factory.hpp>
 #include <wsi/extensions/frame_boundary.hpp>
 #include "util/macros.hpp"
 
+/**
+ * @brief Append a call on a swapchain of the layer to the capture, which started at @p start_ns.
+ */
+static void capture_call(util::capture::record_type type, VkSwapchainKHR swapchain, VkResult result,
+                         uint64_t start_ns, uint64_t arg0 = 0, uint64_t arg1 = 0, uint64_t arg2 = 0,
+                         uint64_t arg3 = 0)
+{
+   util::capture::record rec = {};
+   rec.type = type;
+   rec.result = static_cast<int32_t>(result);
+   rec.timestamp_ns = start_ns;
+   rec.duration_ns = util::frame_stats::now_ns() - start_ns;
+   rec.swapchain = reinterpret_cast<uint64_t>(swapchain);
+   rec.args[0] = arg0;
+   rec.args[1] = arg1;
+   rec.args[2] = arg2;
+   rec.args[3] = arg3;
+   util::capture::write(rec);
+}
+
+static VkResult create_layer_swapchain(layer::device_private_data &device_data, VkDevice device,
+                                       const VkSwapchainCreateInfoKHR *pSwapchainCreateInfo,
+                                       const VkAllocationCallbacks *pAllocator, VkSwapchainKHR *pSwapchain)
+{
+   auto sc = wsi::allocate_surface_swapchain(pSwapchainCreateInfo->surface, device_data, pAllocator);
+   if (sc == nullptr)
+   {
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
+
+   VkSwapchainCreateInfoKHR my_create_info = *pSwapchainCreateInfo;
+   my_create_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+   TRY_LOG(sc->init(device, &my_create_info), "Failed to initialise swapchain");
+
+   TRY_LOG(device_data.add_layer_swapchain(reinterpret_cast<VkSwapchainKHR>(sc.get())),
+           "Failed to associate swapchain with the layer");
+
+   *pSwapchain = reinterpret_cast<VkSwapchainKHR>(sc.release());
+   return VK_SUCCESS;
+}
+
 VWL_VKAPI_CALL(VkResult)
 wsi_layer_vkCreateSwapchainKHR(VkDevice device, const VkSwapchainCreateInfoKHR *pSwapchainCreateInfo,
                                const VkAllocationCallbacks *pAllocator, VkSwapchainKHR *pSwapchain) VWL_API_POST
@@ -59,21 +103,20 @@ wsi_layer_vkCreateSwapchainKHR(VkDevice device, const VkSwapchainCreateInfoKHR *
       return device_data.disp.CreateSwapchainKHR(device_data.device, pSwapchainCreateInfo, pAllocator, pSwapchain);
    }
 
-   auto sc = wsi::allocate_surface_swapchain(surface, device_data, pAllocator);
-   if (sc == nullptr)
+   if (!util::capture::is_enabled())
    {
-      return VK_ERROR_OUT_OF_HOST_MEMORY;
+      return create_layer_swapchain(device_data, device, pSwapchainCreateInfo, pAllocator, pSwapchain);
    }
 
-   VkSwapchainCreateInfoKHR my_create_info = *pSwapchainCreateInfo;
-   my_create_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
-   TRY_LOG(sc->init(device, &my_create_info), "Failed to initialise swapchain");
-
-   TRY_LOG(device_data.add_layer_swapchain(reinterpret_cast<VkSwapchainKHR>(sc.get())),
-           "Failed to associate swapchain with the layer");
-
-   *pSwapchain = reinterpret_cast<VkSwapchainKHR>(sc.release());
-   return VK_SUCCESS;
+   const uint64_t start_ns = util::frame_stats::now_ns();
+   VkResult result = create_layer_swapchain(device_data, device, pSwapchainCreateInfo, pAllocator, pSwapchain);
+   const VkSwapchainCreateInfoKHR &info = *pSwapchainCreateInfo;
+   capture_call(util::capture::record_type::create_swapchain, result == VK_SUCCESS ? *pSwapchain : VK_NULL_HANDLE,
+                result, start_ns, util::capture::pack(info.imageExtent.width, info.imageExtent.height),
+                util::capture::pack(info.imageFormat, info.presentMode),
+                util::capture::pack(info.minImageCount, info.imageUsage),
+                reinterpret_cast<uint64_t>(info.oldSwapchain));
+   return result;
 }
 
 VWL_VKAPI_CALL(void)
@@ -91,7 +134,14 @@ wsi_layer_vkDestroySwapchainKHR(VkDevice device, VkSwapchainKHR swapc,
    device_data.remove_layer_swapchain(swapc);
 
    auto *sc = reinterpret_cast<wsi::swapchain_base *>(swapc);
+   const uint64_t start_ns = util::frame_stats::now_ns();
    wsi::destroy_surface_swapchain(sc, device_data, pAllocator);
+   if (util::capture::is_enabled())
+   {
+      capture_call(util::capture::record_type::destroy_swapchain, swapc, VK_SUCCESS, start_ns);
+      /* Applications often exit right after destroying their swapchain, without running the exit handlers. */
+      util::capture::flush();
+   }
 }
 
 VWL_VKAPI_CALL(VkResult)
@@ -126,14 +176,24 @@ wsi_layer_vkAcquireNextImageKHR(VkDevice device, VkSwapchainKHR swapc, uint64_t
    assert(semaphore != VK_NULL_HANDLE || fence != VK_NULL_HANDLE);
    assert(pImageIndex != nullptr);
    auto *sc = reinterpret_cast<wsi::swapchain_base *>(swapc);
-   return sc->acquire_next_image(timeout, semaphore, fence, pImageIndex);
+   if (!util::capture::is_enabled())
+   {
+      return sc->acquire_next_image(timeout, semaphore, fence, pImageIndex);
+   }
+
+   const uint64_t start_ns = util::frame_stats::now_ns();
+   VkResult result = sc->acquire_next_image(timeout, semaphore, fence, pImageIndex);
+   capture_call(util::capture::record_type::acquire, swapc, result, start_ns, timeout,
+                result >= VK_SUCCESS ? *pImageIndex : UINT32_MAX);
+   return result;
 }
 
 static VkResult submit_wait_request(VkQueue queue, const VkPresentInfoKHR &present_info,
-                                    layer::device_private_data &device_data, bool &frame_boundary_event_handled)
+                                    layer::device_private_data &device_data, bool &frame_boundary_event_handled,
+                                    wsi::present_batch &batch)
 {
-   util::vector<VkSemaphore> swapchain_semaphores{ util::allocator(device_data.get_allocator(),
-                                                                   VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) };
+   util::scratch_scope scratch(device_data.get_allocator());
+   util::vector<VkSemaphore> swapchain_semaphores{ scratch.get_allocator() };
    if (!swapchain_semaphores.try_resize(present_info.swapchainCount))
    {
       return VK_ERROR_OUT_OF_HOST_MEMORY;
@@ -159,7 +219,9 @@ static VkResult submit_wait_request(VkQueue queue, const VkPresentInfoKHR &prese
    /* Notify that we don't want to pass any further frame boundary events */
    frame_boundary_event_handled = submission_pnext != nullptr;
 
-   TRY(wsi::sync_queue_submit(device_data, queue, VK_NULL_HANDLE, semaphores, submission_pnext));
+   /* The semaphore array goes when this returns, the batch keeps a copy. */
+   TRY(wsi::sync_queue_submit(device_data, queue, VK_NULL_HANDLE, semaphores, submission_pnext, VK_NULL_HANDLE,
+                              &batch));
    return VK_SUCCESS;
 }
 
@@ -169,6 +231,7 @@ wsi_layer_vkQueuePresentKHR(VkQueue queue, const VkPresentInfoKHR *pPresentInfo)
    assert(queue != VK_NULL_HANDLE);
    assert(pPresentInfo != nullptr);
 
+   const uint64_t queue_time_ns = util::frame_stats::now_ns();
    layer::device_private_data &device_data = layer::device_private_data::get(queue);
 
    if (!device_data.layer_owns_all_swapchains(pPresentInfo->pSwapchains, pPresentInfo->swapchainCount))
@@ -180,9 +243,13 @@ wsi_layer_vkQueuePresentKHR(VkQueue queue, const VkPresentInfoKHR *pPresentInfo)
    const VkPresentInfoKHR *present_info = pPresentInfo;
    bool use_image_present_semaphore = false;
    bool frame_boundary_event_handled = true;
+   /* With several swapchains, the wait request and the payloads of all of them go in as few submissions as
+    * possible. */
+   std::optional<wsi::present_batch> batch;
    if (pPresentInfo->swapchainCount > 1)
    {
-      TRY_LOG_CALL(submit_wait_request(queue, *pPresentInfo, device_data, frame_boundary_event_handled));
+      batch.emplace(device_data, queue);
+      TRY_LOG_CALL(submit_wait_request(queue, *pPresentInfo, device_data, frame_boundary_event_handled, *batch));
       use_image_present_semaphore = true;
    }
 
@@ -193,6 +260,10 @@ wsi_layer_vkQueuePresentKHR(VkQueue queue, const VkPresentInfoKHR *pPresentInfo)
       VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT, present_info->pNext);
    const auto swapchain_present_mode_info = util::find_extension<VkSwapchainPresentModeInfoEXT>(
       VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_MODE_INFO_EXT, present_info->pNext);
+   const auto *present_regions =
+      util::find_extension<VkPresentRegionsKHR>(VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR, pPresentInfo->pNext);
+   const auto *display_present_info =
+      util::find_extension<VkDisplayPresentInfoKHR>(VK_STRUCTURE_TYPE_DISPLAY_PRESENT_INFO_KHR, pPresentInfo->pNext);
 #if VULKAN_WSI_LAYER_EXPERIMENTAL
    const auto present_timings_info =
       util::find_extension<VkPresentTimingsInfoEXT>(VK_STRUCTURE_TYPE_PRESENT_TIMINGS_INFO_EXT, present_info->pNext);
@@ -223,29 +294,81 @@ wsi_layer_vkQueuePresentKHR(VkQueue queue, const VkPresentInfoKHR *pPresentInfo)
 
       present_params.pending_present.image_index = pPresentInfo->pImageIndices[i];
       present_params.pending_present.present_id = present_id;
+      present_params.pending_present.queue_time_ns = queue_time_ns;
+      if (present_regions && present_regions->pRegions &&
+          present_regions->swapchainCount == pPresentInfo->swapchainCount)
+      {
+         present_params.pending_present.damage.set(present_regions->pRegions[i]);
+      }
+      if (display_present_info != nullptr)
+      {
+         present_params.pending_present.display_src_rect = display_present_info->srcRect;
+         present_params.pending_present.display_dst_rect = display_present_info->dstRect;
+      }
 
       present_params.use_image_present_semaphore = use_image_present_semaphore;
       present_params.handle_present_frame_boundary_event = frame_boundary_event_handled;
+      present_params.batch = batch.has_value() ? &batch.value() : nullptr;
 
 #if VULKAN_WSI_LAYER_EXPERIMENTAL
       if (present_timings_info)
       {
          present_params.m_present_timing_info = present_timings_info->pTimingInfos[i];
          present_params.m_present_timing_info.pNext = nullptr;
+         present_params.pending_present.target_time = present_params.m_present_timing_info.time.targetPresentTime;
+         present_params.pending_present.target_time_relative =
+            present_params.m_present_timing_info.presentAtRelativeTime;
+         present_params.pending_present.target_time_nearest =
+            present_params.m_present_timing_info.presentAtNearestRefreshCycle;
       }
 #endif
+      const uint64_t present_start_ns = util::capture::is_enabled() ? util::frame_stats::now_ns() : 0;
       VkResult res = sc->queue_present(queue, present_info, present_params);
+      if (util::capture::is_enabled())
+      {
+         capture_call(util::capture::record_type::present, swapc, res, present_start_ns,
+                      present_params.pending_present.image_index, present_id,
+                      present_params.switch_presentation_mode ? static_cast<uint64_t>(present_params.present_mode)
+                                                              : UINT32_MAX,
+                      present_params.pending_present.target_time);
+      }
       if (pPresentInfo->pResults != nullptr)
       {
          pPresentInfo->pResults[i] = res;
       }
 
-      if (res != VK_SUCCESS && ret == VK_SUCCESS)
+      /* Errors take precedence over VK_SUBOPTIMAL_KHR. */
+      if (res != VK_SUCCESS && (ret == VK_SUCCESS || (ret == VK_SUBOPTIMAL_KHR && res < 0)))
       {
          ret = res;
       }
    }
 
+   if (batch.has_value())
+   {
+      /* The remaining submissions hold the payloads of every swapchain that succeeded so far. A flush that failed
+       * in a swapchain's queue_present lost the payloads of the swapchains before it too. */
+      VkResult res = batch->flush();
+      if (res == VK_SUCCESS)
+      {
+         res = batch->get_error();
+      }
+      if (res != VK_SUCCESS)
+      {
+         WSI_LOG_ERROR("Failed to submit the batched present payloads.");
+         for (uint32_t i = 0; i < pPresentInfo->swapchainCount; ++i)
+         {
+            /* Their page flip threads would otherwise wait forever for the payloads. */
+            reinterpret_cast<wsi::swapchain_base *>(pPresentInfo->pSwapchains[i])->abandon_present_payloads(res);
+            if (pPresentInfo->pResults != nullptr && pPresentInfo->pResults[i] >= VK_SUCCESS)
+            {
+               pPresentInfo->pResults[i] = res;
+            }
+         }
+         ret = res;
+      }
+   }
+
    return ret;
 }
 
@@ -349,8 +472,17 @@ wsi_layer_vkAcquireNextImage2KHR(VkDevice device, const VkAcquireNextImageInfoKH
    }
 
    auto *sc = reinterpret_cast<wsi::swapchain_base *>(pAcquireInfo->swapchain);
+   if (!util::capture::is_enabled())
+   {
+      return sc->acquire_next_image(pAcquireInfo->timeout, pAcquireInfo->semaphore, pAcquireInfo->fence, pImageIndex);
+   }
 
-   return sc->acquire_next_image(pAcquireInfo->timeout, pAcquireInfo->semaphore, pAcquireInfo->fence, pImageIndex);
+   const uint64_t start_ns = util::frame_stats::now_ns();
+   VkResult result =
+      sc->acquire_next_image(pAcquireInfo->timeout, pAcquireInfo->semaphore, pAcquireInfo->fence, pImageIndex);
+   capture_call(util::capture::record_type::acquire, pAcquireInfo->swapchain, result, start_ns, pAcquireInfo->timeout,
+                result >= VK_SUCCESS ? *pImageIndex : UINT32_MAX);
+   return result;
 }
 
 VWL_VKAPI_CALL(VkResult)
@@ -438,3 +570,26 @@ wsi_layer_vkGetSwapchainStatusKHR(VkDevice device, VkSwapchainKHR swapchain) VWL
 
    return sc->get_swapchain_status();
 }
+
+VWL_VKAPI_CALL(VkResult)
+wsi_layer_vkWaitForPresentKHR(VkDevice device, VkSwapchainKHR swapchain, uint64_t presentId,
+                              uint64_t timeout) VWL_API_POST
+{
+   auto &device_data = layer::device_private_data::get(device);
+
+   if (!device_data.layer_owns_swapchain(swapchain))
+   {
+      return device_data.disp.WaitForPresentKHR(device, swapchain, presentId, timeout);
+   }
+
+   auto *sc = reinterpret_cast<wsi::swapchain_base *>(swapchain);
+   if (!util::capture::is_enabled())
+   {
+      return sc->wait_for_present(presentId, timeout);
+   }
+
+   const uint64_t start_ns = util::frame_stats::now_ns();
+   VkResult result = sc->wait_for_present(presentId, timeout);
+   capture_call(util::capture::record_type::wait_for_present, swapchain, result, start_ns, presentId, timeout);
+   return result;
+}
@@ -79,3 +79,7 @@ wsi_layer_vkBindImageMemory2(VkDevice device, uint32_t bindInfoCount,
 
 VWL_VKAPI_CALL(VkResult)
 wsi_layer_vkGetSwapchainStatusKHR(VkDevice device, VkSwapchainKHR swapchain) VWL_API_POST;
+
+VWL_VKAPI_CALL(VkResult)
+wsi_layer_vkWaitForPresentKHR(VkDevice device, VkSwapchainKHR swapchain, uint64_t presentId,
+                              uint64_t timeout) VWL_API_POST;
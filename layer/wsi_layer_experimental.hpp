@@ -181,6 +181,10 @@ typedef VkResult(VKAPI_PTR *PFN_vkGetSwapchainTimingPropertiesEXT)(
 typedef VkResult(VKAPI_PTR *PFN_vkSetSwapchainPresentTimingQueueSizeEXT)(VkDevice device, VkSwapchainKHR swapchain,
                                                                          uint32_t size);
 
+typedef VkResult(VKAPI_PTR *PFN_vkGetPastPresentationTimingEXT)(
+   VkDevice device, const VkPastPresentationTimingInfoEXT *pPastPresentationTimingInfo,
+   VkPastPresentationTimingPropertiesEXT *pPastPresentationTimingProperties);
+
 VWL_VKAPI_CALL(VkResult)
 wsi_layer_vkSetSwapchainPresentTimingQueueSizeEXT(VkDevice device, VkSwapchainKHR swapchain,
                                                   uint32_t size) VWL_API_POST;
@@ -199,4 +203,82 @@ wsi_layer_vkGetPastPresentationTimingEXT(
    VkDevice device, const VkPastPresentationTimingInfoEXT *pPastPresentationTimingInfo,
    VkPastPresentationTimingPropertiesEXT *pPastPresentationTimingProperties) VWL_API_POST;
 
+/*
+ * Layer specific frame statistics, not part of any extension. The VK_STRUCTURE_TYPE_SWAPCHAIN_*_STATISTICS_ARM values
+ * are placeholders in the range of extension number 1000, which the registry has not allocated. They are not stable:
+ * they change if the structures are ever registered, and may collide with a future extension. The layer checks the
+ * structure type of the statistics it is given and ignores chained structures it does not recognise.
+ */
+#define VK_STRUCTURE_TYPE_SWAPCHAIN_FRAME_STATISTICS_ARM ((VkStructureType)1000999000)
+#define VK_SWAPCHAIN_FRAME_STAGE_COUNT_ARM 4
+#define VK_SWAPCHAIN_LATENCY_HISTOGRAM_BUCKET_COUNT_ARM 32
+
+/**
+ * Bucket i counts the durations in [2^i, 2^(i+1)) nanoseconds. Stages are, in order: acquire wait, present fence
+ * wait, backend present and vkQueuePresentKHR to on screen.
+ */
+typedef struct VkSwapchainLatencyHistogramARM
+{
+   uint64_t count;
+   uint64_t totalNs;
+   uint64_t maxNs;
+   uint64_t buckets[VK_SWAPCHAIN_LATENCY_HISTOGRAM_BUCKET_COUNT_ARM];
+} VkSwapchainLatencyHistogramARM;
+
+typedef struct VkSwapchainFrameStatisticsARM
+{
+   VkStructureType sType;
+   void *pNext;
+   VkSwapchainLatencyHistogramARM stages[VK_SWAPCHAIN_FRAME_STAGE_COUNT_ARM];
+} VkSwapchainFrameStatisticsARM;
+
+/* Chained to VkSwapchainFrameStatisticsARM, found by its placeholder structure type, see
+ * VK_STRUCTURE_TYPE_SWAPCHAIN_FRAME_STATISTICS_ARM. */
+#define VK_STRUCTURE_TYPE_SWAPCHAIN_ALLOCATION_STATISTICS_ARM ((VkStructureType)1000999001)
+#define VK_SWAPCHAIN_ALLOCATION_STAGE_COUNT_ARM 4
+
+/**
+ * Allocation statistics of the device of the swapchain, for the images of all its swapchains. Stages are, in order:
+ * buffer allocation, memory import, memory bind and DRM framebuffer creation.
+ */
+typedef struct VkSwapchainAllocationStatisticsARM
+{
+   VkStructureType sType;
+   void *pNext;
+   VkSwapchainLatencyHistogramARM stages[VK_SWAPCHAIN_ALLOCATION_STAGE_COUNT_ARM];
+   uint64_t bytes[VK_SWAPCHAIN_ALLOCATION_STAGE_COUNT_ARM];
+} VkSwapchainAllocationStatisticsARM;
+
+/* Chained to VkSwapchainFrameStatisticsARM. Placeholder structure type. */
+#define VK_STRUCTURE_TYPE_SWAPCHAIN_MEMORY_STATISTICS_ARM ((VkStructureType)1000999002)
+#define VK_HOST_MEMORY_CATEGORY_COUNT_ARM 7
+
+typedef struct VkHostMemoryCountersARM
+{
+   int64_t currentBytes;
+   int64_t peakBytes;
+   uint64_t allocationCount;
+} VkHostMemoryCountersARM;
+
+/**
+ * Host memory of the swapchain, its device and its instance, only counted with the memory_accounting tuning key.
+ * Categories are, in order: the command, object, cache, device and instance allocation scopes, SHM segments and host
+ * visible device memory.
+ */
+typedef struct VkSwapchainMemoryStatisticsARM
+{
+   VkStructureType sType;
+   void *pNext;
+   VkHostMemoryCountersARM swapchain[VK_HOST_MEMORY_CATEGORY_COUNT_ARM];
+   VkHostMemoryCountersARM device[VK_HOST_MEMORY_CATEGORY_COUNT_ARM];
+   VkHostMemoryCountersARM instance[VK_HOST_MEMORY_CATEGORY_COUNT_ARM];
+} VkSwapchainMemoryStatisticsARM;
+
+typedef VkResult(VKAPI_PTR *PFN_vkGetSwapchainFrameStatisticsARM)(VkDevice device, VkSwapchainKHR swapchain,
+                                                                  VkSwapchainFrameStatisticsARM *pStatistics);
+
+VWL_VKAPI_CALL(VkResult)
+wsi_layer_vkGetSwapchainFrameStatisticsARM(VkDevice device, VkSwapchainKHR swapchain,
+                                           VkSwapchainFrameStatisticsARM *pStatistics) VWL_API_POST;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file allocation_stats.cpp
+ *
+ * @brief Implementation of the per device allocation statistics.
+ */
+
+#include "allocation_stats.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+
+namespace util
+{
+
+/* Marks used buffer kinds, so a kind of fourcc 0 and flags 0 is not mistaken for an unused one. */
+static constexpr uint64_t BUFFER_KIND_USED = 1ull << 63;
+
+void allocation_stats::record(allocation_stage stage, uint64_t start_ns, uint64_t bytes)
+{
+   const uint64_t now = frame_stats::now_ns();
+   auto &counters = m_stages[static_cast<uint32_t>(stage)];
+   counters.histogram.record(now > start_ns ? now - start_ns : 0);
+   counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void allocation_stats::record_buffer_allocation(uint32_t fourcc, uint64_t flags, uint64_t start_ns, uint64_t bytes)
+{
+   const uint64_t now = frame_stats::now_ns();
+   const uint64_t duration_ns = now > start_ns ? now - start_ns : 0;
+   auto &counters = m_stages[static_cast<uint32_t>(allocation_stage::buffer_allocation)];
+   counters.histogram.record(duration_ns);
+   counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+   const uint64_t key = BUFFER_KIND_USED | ((flags & 0x7fffffffu) << 32) | fourcc;
+   for (auto &kind : m_buffer_kinds)
+   {
+      uint64_t kind_key = kind.key.load(std::memory_order_relaxed);
+      if (kind_key == 0 && kind.key.compare_exchange_strong(kind_key, key, std::memory_order_relaxed))
+      {
+         kind_key = key;
+      }
+      if (kind_key == key)
+      {
+         kind.count.fetch_add(1, std::memory_order_relaxed);
+         kind.total_ns.fetch_add(duration_ns, std::memory_order_relaxed);
+         kind.bytes.fetch_add(bytes, std::memory_order_relaxed);
+         return;
+      }
+   }
+}
+
+void allocation_stats::dump(const void *owner) const
+{
+   static const char *const stage_names[] = { "buffer allocation", "memory import", "memory bind",
+                                              "framebuffer" };
+   static_assert(sizeof(stage_names) / sizeof(stage_names[0]) == static_cast<uint32_t>(allocation_stage::count),
+                 "Every allocation stage needs a name");
+
+   std::fprintf(stderr, "WSI allocation statistics of device %p (us):\n", owner);
+   for (uint32_t i = 0; i < static_cast<uint32_t>(allocation_stage::count); i++)
+   {
+      const auto stats = m_stages[i].histogram.read();
+      const uint64_t average_ns = stats.count != 0 ? stats.total_ns / stats.count : 0;
+      std::fprintf(stderr, "  %-18s count %8" PRIu64 "  avg %9.1f  max %9.1f  total %9.1f  MiB %9.1f\n",
+                   stage_names[i], stats.count, average_ns / 1e3, stats.max_ns / 1e3, stats.total_ns / 1e3,
+                   m_stages[i].bytes.load(std::memory_order_relaxed) / 1048576.0);
+   }
+
+   for (const auto &kind : m_buffer_kinds)
+   {
+      const uint64_t key = kind.key.load(std::memory_order_relaxed);
+      if (key == 0)
+      {
+         break;
+      }
+      const uint32_t fourcc = static_cast<uint32_t>(key);
+      const uint64_t count = kind.count.load(std::memory_order_relaxed);
+      const uint64_t average_ns = count != 0 ? kind.total_ns.load(std::memory_order_relaxed) / count : 0;
+      std::fprintf(stderr, "    %c%c%c%c flags 0x%02" PRIx64 "  count %8" PRIu64 "  avg %9.1f  MiB %9.1f\n",
+                   static_cast<char>(fourcc), static_cast<char>(fourcc >> 8), static_cast<char>(fourcc >> 16),
+                   static_cast<char>(fourcc >> 24), (key & ~BUFFER_KIND_USED) >> 32, count, average_ns / 1e3,
+                   kind.bytes.load(std::memory_order_relaxed) / 1048576.0);
+   }
+}
+
+} /* namespace util */
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file allocation_stats.hpp
+ *
+ * @brief Per device timings and sizes of the allocations the layer makes for swapchain images.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "frame_stats.hpp"
+
+namespace util
+{
+
+/**
+ * @brief Steps of setting up the memory of a swapchain image the layer measures.
+ */
+enum class allocation_stage : uint32_t
+{
+   /** The wsialloc allocation of a buffer. */
+   buffer_allocation,
+   /** Importing a buffer into the device, one vkAllocateMemory per plane memory. */
+   memory_import,
+   /** Binding the memory of a swapchain image. */
+   memory_bind,
+   /** Creating the DRM framebuffer of a swapchain image. */
+   framebuffer_creation,
+   count,
+};
+
+/**
+ * @brief Latency histograms and byte counts of every allocation_stage of a device.
+ *
+ * Buffer allocations are also counted per fourcc and allocation flags, which select the heap. Recording is lock free,
+ * like @ref frame_stats, and the statistics are printed with the frame statistics of the swapchains of the device.
+ */
+class allocation_stats
+{
+public:
+   /** Number of fourcc and flags combinations counted separately, the others are only in the totals. */
+   static constexpr uint32_t MAX_BUFFER_KINDS = 8;
+
+   /**
+    * @brief Record that @p stage took from @p start_ns, see frame_stats::now_ns, until now for @p bytes.
+    */
+   void record(allocation_stage stage, uint64_t start_ns, uint64_t bytes);
+
+   /**
+    * @brief Record a buffer allocation of @p fourcc made with the wsialloc @p flags.
+    */
+   void record_buffer_allocation(uint32_t fourcc, uint64_t flags, uint64_t start_ns, uint64_t bytes);
+
+   latency_histogram::snapshot read(allocation_stage stage) const
+   {
+      return m_stages[static_cast<uint32_t>(stage)].histogram.read();
+   }
+
+   uint64_t read_bytes(allocation_stage stage) const
+   {
+      return m_stages[static_cast<uint32_t>(stage)].bytes.load(std::memory_order_relaxed);
+   }
+
+   /**
+    * @brief Print the statistics to stderr.
+    *
+    * @param owner Printed to tell the devices apart.
+    */
+   void dump(const void *owner) const;
+
+private:
+   struct stage_counters
+   {
+      latency_histogram histogram;
+      std::atomic<uint64_t> bytes{ 0 };
+   };
+
+   struct buffer_kind
+   {
+      /* 0 while unused, otherwise the fourcc and flags the kind counts, see record_buffer_allocation. */
+      std::atomic<uint64_t> key{ 0 };
+      std::atomic<uint64_t> count{ 0 };
+      std::atomic<uint64_t> total_ns{ 0 };
+      std::atomic<uint64_t> bytes{ 0 };
+   };
+
+   std::array<stage_counters, static_cast<uint32_t>(allocation_stage::count)> m_stages;
+   std::array<buffer_kind, MAX_BUFFER_KINDS> m_buffer_kinds;
+};
+
+} /* namespace util */
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file api_capture.cpp
+ *
+ * @brief Implementation of the capture of the swapchain calls.
+ */
+
+#include "api_capture.hpp"
+#include "log.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+namespace util
+{
+namespace capture
+{
+
+/* Records are buffered, a capture must not add a write to every call of the application. */
+static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+static std::FILE *g_file = nullptr;
+static std::mutex g_file_mutex;
+
+bool open_file()
+{
+   const char *path = std::getenv("WSI_CAPTURE_FILE");
+   if (path == nullptr || path[0] == '\0')
+   {
+      return false;
+   }
+
+   g_file = std::fopen(path, "wbe");
+   if (g_file == nullptr)
+   {
+      WSI_LOG_WARNING("Cannot open the capture file %s.", path);
+      return false;
+   }
+   std::setvbuf(g_file, nullptr, _IOFBF, BUFFER_SIZE);
+
+   file_header header = {};
+   for (size_t i = 0; i < sizeof(FILE_MAGIC); i++)
+   {
+      header.magic[i] = FILE_MAGIC[i];
+   }
+   header.version = FILE_VERSION;
+   header.record_size = sizeof(record);
+   if (std::fwrite(&header, sizeof(header), 1, g_file) != 1)
+   {
+      WSI_LOG_WARNING("Cannot write the capture file %s.", path);
+      std::fclose(g_file);
+      g_file = nullptr;
+      return false;
+   }
+   WSI_LOG_INFO("Capturing the swapchain calls to %s.", path);
+   /* The stream is flushed and closed by exit(). */
+   return true;
+}
+
+void write(const record &rec)
+{
+   std::lock_guard<std::mutex> lock(g_file_mutex);
+   /* A failed write only loses records, it must not disturb presentation. */
+   static_cast<void>(std::fwrite(&rec, sizeof(rec), 1, g_file));
+}
+
+void flush()
+{
+   std::lock_guard<std::mutex> lock(g_file_mutex);
+   std::fflush(g_file);
+}
+
+} /* namespace capture */
+} /* namespace util */
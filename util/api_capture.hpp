@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file api_capture.hpp
+ *
+ * @brief Capture of the swapchain calls handled by the layer, for replaying them offline.
+ *
+ * When WSI_CAPTURE_FILE names a file, the layer appends one fixed size record to it for every swapchain creation
+ * and destruction, acquire, present and present wait of its swapchains, with the time of the call, its duration,
+ * result and parameters. wsi_present_benchmark --replay drives the layer with the same sequence of calls. The file is
+ * a header followed by the records, in the byte order of the capturing machine.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace util
+{
+namespace capture
+{
+
+/* File signature, followed by the version and the size of a record. */
+static constexpr char FILE_MAGIC[8] = { 'W', 'S', 'I', 'C', 'A', 'P', '0', '1' };
+static constexpr uint32_t FILE_VERSION = 1;
+
+struct file_header
+{
+   char magic[8];
+   uint32_t version;
+   uint32_t record_size;
+};
+
+enum class record_type : uint32_t
+{
+   /* args: width | height << 32, format | present mode << 32, min image count | image usage << 32, old swapchain. */
+   create_swapchain = 1,
+   /* No args. */
+   destroy_swapchain = 2,
+   /* args: timeout, image index or UINT32_MAX. */
+   acquire = 3,
+   /* args: image index, present ID, present mode switched to or UINT32_MAX, target present time. */
+   present = 4,
+   /* args: present ID, timeout. */
+   wait_for_present = 5,
+};
+
+struct record
+{
+   record_type type;
+   /* VkResult of the call. */
+   int32_t result;
+   /* CLOCK_MONOTONIC time the call was made at. */
+   uint64_t timestamp_ns;
+   uint64_t duration_ns;
+   /* Handle of the swapchain the call is on, only meaningful within the capture. */
+   uint64_t swapchain;
+   uint64_t args[4];
+};
+static_assert(sizeof(record) == 64, "The record layout is part of the file format");
+
+/**
+ * @brief Open the file named by WSI_CAPTURE_FILE, returns false when no capture is requested or it cannot be written.
+ */
+bool open_file();
+
+inline bool is_enabled()
+{
+   static const bool enabled = open_file();
+   return enabled;
+}
+
+/**
+ * @brief Append @p rec to the capture. Only call when is_enabled() is true.
+ */
+void write(const record &rec);
+
+/**
+ * @brief Write the buffered records to the file.
+ */
+void flush();
+
+inline uint64_t pack(uint32_t low, uint32_t high)
+{
+   return static_cast<uint64_t>(low) | (static_cast<uint64_t>(high) << 32);
+}
+
+} /* namespace capture */
+} /* namespace util */
@@ -52,8 +52,15 @@ const allocator &allocator::get_generic()
 }
 
 allocator::allocator(const allocator &other, VkSystemAllocationScope new_scope, const VkAllocationCallbacks *callbacks)
+   : allocator{ other, new_scope, callbacks, other.m_accounting }
+{
+}
+
+allocator::allocator(const allocator &other, VkSystemAllocationScope new_scope, const VkAllocationCallbacks *callbacks,
+                     memory_accounting *accounting)
    : allocator{ new_scope, callbacks == nullptr ? other.get_original_callbacks() : callbacks }
 {
+   m_accounting = accounting;
 }
 
 /* If callbacks is already populated by vulkan then use those specified as default. */
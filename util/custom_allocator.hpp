@@ -33,6 +33,7 @@
 #include <vulkan/vulkan.h>
 
 #include "helpers.hpp"
+#include "memory_accounting.hpp"
 
 #pragma once
 
@@ -85,6 +86,14 @@ public:
    allocator(const allocator &other, VkSystemAllocationScope new_scope,
              const VkAllocationCallbacks *callbacks = nullptr);
 
+   /**
+    * @brief Same as above, counting the allocations in @p accounting instead of the accounting of @p other.
+    *
+    * @param accounting Where the host memory allocated is counted, or @c nullptr not to count it.
+    */
+   allocator(const allocator &other, VkSystemAllocationScope new_scope, const VkAllocationCallbacks *callbacks,
+             memory_accounting *accounting);
+
    /**
     * @brief Get a pointer to the allocation callbacks provided while constructing this object.
     * @return a copy of the #VkAllocationCallback argument provided in the allocator constructor
@@ -114,6 +123,8 @@ public:
 
    VkAllocationCallbacks m_callbacks{};
    VkSystemAllocationScope m_scope;
+   /* Accounting of the object owning the allocations, nullptr when they are not counted. */
+   memory_accounting *m_accounting = nullptr;
 };
 
 /**
@@ -154,9 +165,14 @@ public:
       void *ret = cb.pfnAllocation(cb.pUserData, size, alignof(T), m_alloc.m_scope);
       if (ret == nullptr)
          throw std::bad_alloc();
+      if (m_alloc.m_accounting != nullptr)
+      {
+         m_alloc.m_accounting->add(static_cast<memory_category>(m_alloc.m_scope), size);
+      }
       return reinterpret_cast<pointer>(ret);
    }
 
+   /* Not counted in the memory accounting, as the size of @p ptr is unknown. */
    pointer allocate(size_t n, void *ptr) const
    {
       size_t size = n * sizeof(T);
@@ -172,9 +188,13 @@ public:
       return reinterpret_cast<pointer>(ret);
    }
 
-   void deallocate(void *ptr, size_t) const noexcept
+   void deallocate(void *ptr, size_t n) const noexcept
    {
       m_alloc.m_callbacks.pfnFree(m_alloc.m_callbacks.pUserData, ptr);
+      if (m_alloc.m_accounting != nullptr)
+      {
+         m_alloc.m_accounting->remove(static_cast<memory_category>(m_alloc.m_scope), n * sizeof(T));
+      }
    }
 
 private:
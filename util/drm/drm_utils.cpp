@@ -22,8 +22,11 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+
 #include "drm_utils.hpp"
 #include "format_table.h"
+#include "wsialloc.h"
 
 namespace util
 {
@@ -120,5 +123,67 @@ uint32_t drm_fourcc_format_get_num_planes(uint32_t format)
    }
 }
 
+uint32_t get_modifier_scanout_cost(uint64_t modifier, bool prefer_fixed_rate)
+{
+   enum : uint32_t
+   {
+      COST_FIXED_RATE_PREFERRED,
+      COST_FRAMEBUFFER_COMPRESSED,
+      COST_VENDOR_LAYOUT,
+      COST_LINEAR,
+      COST_FIXED_RATE,
+      COST_INVALID,
+   };
+
+   if (modifier == DRM_FORMAT_MOD_INVALID)
+   {
+      return COST_INVALID;
+   }
+   if (modifier == DRM_FORMAT_MOD_LINEAR)
+   {
+      return COST_LINEAR;
+   }
+
+   /* Bits 56-63 hold the vendor, and bits 52-55 the type of the Arm modifiers. */
+   if ((modifier >> 56) == DRM_FORMAT_MOD_VENDOR_ARM)
+   {
+      const uint64_t arm_type = (modifier >> 52) & 0xf;
+      if (arm_type == DRM_FORMAT_MOD_ARM_TYPE_AFBC)
+      {
+         return COST_FRAMEBUFFER_COMPRESSED;
+      }
+#ifdef DRM_FORMAT_MOD_ARM_TYPE_AFRC
+      if (arm_type == DRM_FORMAT_MOD_ARM_TYPE_AFRC)
+      {
+         return prefer_fixed_rate ? COST_FIXED_RATE_PREFERRED : COST_FIXED_RATE;
+      }
+#else
+      static_cast<void>(prefer_fixed_rate);
+#endif
+   }
+
+   return COST_VENDOR_LAYOUT;
+}
+
+bool is_fixed_rate_modifier(uint64_t modifier)
+{
+#ifdef DRM_FORMAT_MOD_ARM_TYPE_AFRC
+   return modifier != DRM_FORMAT_MOD_INVALID && (modifier >> 56) == DRM_FORMAT_MOD_VENDOR_ARM &&
+          ((modifier >> 52) & 0xf) == DRM_FORMAT_MOD_ARM_TYPE_AFRC;
+#else
+   static_cast<void>(modifier);
+   return false;
+#endif
+}
+
+void sort_formats_by_scanout_cost(wsialloc_format *formats, size_t format_count, bool prefer_fixed_rate)
+{
+   std::stable_sort(formats, formats + format_count,
+                    [prefer_fixed_rate](const wsialloc_format &a, const wsialloc_format &b) {
+                       return get_modifier_scanout_cost(a.modifier, prefer_fixed_rate) <
+                              get_modifier_scanout_cost(b.modifier, prefer_fixed_rate);
+                    });
+}
+
 } // namespace drm
 } // namespace util
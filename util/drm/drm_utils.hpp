@@ -24,8 +24,12 @@
 
 #pragma once
 
+#include <cstddef>
+
 #include <vulkan/vulkan.h>
 
+struct wsialloc_format;
+
 namespace util
 {
 namespace drm
@@ -36,5 +40,25 @@ VkFormat drm_to_vk_format(uint32_t drm_format);
 VkFormat drm_to_vk_srgb_format(uint32_t drm_format);
 uint32_t drm_fourcc_format_get_num_planes(uint32_t format);
 
+/**
+ * @brief Get the relative memory bandwidth cost of scanning out buffers with a DRM format modifier, lower is cheaper.
+ *
+ * Arm framebuffer compression (AFBC) comes first, then other vendor layouts, then linear. Fixed-rate compression
+ * (AFRC) is lossy, it only comes first when @p prefer_fixed_rate is set, and last otherwise.
+ */
+uint32_t get_modifier_scanout_cost(uint64_t modifier, bool prefer_fixed_rate);
+
+/**
+ * @brief Check whether a DRM format modifier is an Arm fixed-rate compression (AFRC) layout.
+ */
+bool is_fixed_rate_modifier(uint64_t modifier);
+
+/**
+ * @brief Order wsialloc formats by @ref get_modifier_scanout_cost, keeping the order of formats of equal cost.
+ *
+ * wsialloc allocates the first format it can, so the cheapest modifiers to scan out are tried first.
+ */
+void sort_formats_by_scanout_cost(wsialloc_format *formats, size_t format_count, bool prefer_fixed_rate);
+
 } // namespace drm
 } // namespace util
@@ -79,6 +79,16 @@ public:
       return fd_handle >= 0;
    }
 
+   /**
+    * Gives up ownership of the file descriptor without closing it.
+    *
+    * @return The file descriptor, now owned by the caller.
+    */
+   int release()
+   {
+      return std::exchange(fd_handle, -1);
+   }
+
 private:
    int fd_handle{ -1 };
 };
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2022, 2024 Arm Limited.
+ * Copyright (c) 2022, 2024-2025 Arm Limited.
  *
  * SPDX-License-Identifier: MIT
  *
@@ -23,6 +23,8 @@
  */
 
 #include "format_modifiers.hpp"
+#include "format_query_cache.hpp"
+#include "helpers.hpp"
 #include "layer/private_data.hpp"
 
 namespace util
@@ -32,6 +34,13 @@ VkResult get_drm_format_properties(VkPhysicalDevice physical_device, VkFormat fo
                                    util::vector<VkDrmFormatModifierPropertiesEXT> &format_props_list)
 {
    auto &instance_data = layer::instance_private_data::get(physical_device);
+   auto &cache = instance_data.get_format_queries();
+
+   auto cached = cache.find_drm_format_properties(physical_device, format, format_props_list);
+   if (cached.has_value())
+   {
+      return cached.value();
+   }
 
    VkDrmFormatModifierPropertiesListEXT format_modifier_props = {};
    format_modifier_props.sType = VK_STRUCTURE_TYPE_DRM_FORMAT_MODIFIER_PROPERTIES_LIST_EXT;
@@ -49,6 +58,155 @@ VkResult get_drm_format_properties(VkPhysicalDevice physical_device, VkFormat fo
 
    format_modifier_props.pDrmFormatModifierProperties = format_props_list.data();
    instance_data.disp.GetPhysicalDeviceFormatProperties2KHR(physical_device, format, &format_props);
+
+   cache.insert_drm_format_properties(physical_device, format, format_props_list);
    return VK_SUCCESS;
 }
+
+/**
+ * @brief Describe @p format_info as a query of the format cache.
+ *
+ * @return false if the chains carry a structure the cache does not know the meaning of, or the answer depends on
+ *         arrays the query does not capture, like the queue families of concurrently shared images.
+ */
+static bool get_cache_query(VkPhysicalDevice physical_device, const VkPhysicalDeviceImageFormatInfo2KHR &format_info,
+                            const VkImageFormatProperties2KHR &format_props, image_format_query &query)
+{
+   query.physical_device = physical_device;
+   query.format = format_info.format;
+   query.type = format_info.type;
+   query.tiling = format_info.tiling;
+   query.usage = format_info.usage;
+   query.flags = format_info.flags;
+
+   for (auto *in = static_cast<const VkBaseInStructure *>(format_info.pNext); in != nullptr; in = in->pNext)
+   {
+      uint32_t bit = 0;
+      switch (in->sType)
+      {
+      case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_DRM_FORMAT_MODIFIER_INFO_EXT:
+      {
+         auto *info = reinterpret_cast<const VkPhysicalDeviceImageDrmFormatModifierInfoEXT *>(in);
+         if (info->sharingMode != VK_SHARING_MODE_EXCLUSIVE)
+         {
+            return false;
+         }
+         query.drm_format_modifier = info->drmFormatModifier;
+         query.sharing_mode = info->sharingMode;
+         bit = image_format_query::DRM_FORMAT_MODIFIER_INFO;
+         break;
+      }
+      case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_IMAGE_FORMAT_INFO_KHR:
+      {
+         auto *info = reinterpret_cast<const VkPhysicalDeviceExternalImageFormatInfoKHR *>(in);
+         query.handle_type = info->handleType;
+         bit = image_format_query::EXTERNAL_IMAGE_FORMAT_INFO;
+         break;
+      }
+      case VK_STRUCTURE_TYPE_IMAGE_COMPRESSION_CONTROL_EXT:
+      {
+         auto *info = reinterpret_cast<const VkImageCompressionControlEXT *>(in);
+         if (info->compressionControlPlaneCount > 1)
+         {
+            return false;
+         }
+         query.compression_flags = info->flags;
+         if (info->compressionControlPlaneCount == 1 && info->pFixedRateFlags != nullptr)
+         {
+            query.compression_fixed_rate_flags = info->pFixedRateFlags[0];
+         }
+         bit = image_format_query::IMAGE_COMPRESSION_CONTROL;
+         break;
+      }
+      default:
+         return false;
+      }
+
+      if (query.chain & bit)
+      {
+         return false;
+      }
+      query.chain |= bit;
+   }
+
+   for (auto *out = static_cast<const VkBaseOutStructure *>(format_props.pNext); out != nullptr; out = out->pNext)
+   {
+      uint32_t bit = 0;
+      switch (out->sType)
+      {
+      case VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES_KHR:
+         bit = image_format_query::EXTERNAL_IMAGE_FORMAT_PROPERTIES;
+         break;
+      case VK_STRUCTURE_TYPE_IMAGE_COMPRESSION_PROPERTIES_EXT:
+         bit = image_format_query::IMAGE_COMPRESSION_PROPERTIES;
+         break;
+      default:
+         return false;
+      }
+
+      if (query.chain & bit)
+      {
+         return false;
+      }
+      query.chain |= bit;
+   }
+   return true;
+}
+
+VkResult get_image_format_properties(VkPhysicalDevice physical_device,
+                                     const VkPhysicalDeviceImageFormatInfo2KHR &format_info,
+                                     VkImageFormatProperties2KHR &format_props)
+{
+   auto &instance_data = layer::instance_private_data::get(physical_device);
+
+   image_format_query query;
+   if (!get_cache_query(physical_device, format_info, format_props, query))
+   {
+      return instance_data.disp.GetPhysicalDeviceImageFormatProperties2KHR(physical_device, &format_info,
+                                                                           &format_props);
+   }
+
+   auto *external_props = find_extension<VkExternalImageFormatPropertiesKHR>(
+      VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES_KHR, format_props.pNext);
+   auto *compression_props = find_extension<VkImageCompressionPropertiesEXT>(
+      VK_STRUCTURE_TYPE_IMAGE_COMPRESSION_PROPERTIES_EXT, format_props.pNext);
+
+   auto &cache = instance_data.get_format_queries();
+   image_format_result cached;
+   if (cache.find_image_format_properties(query, &cached))
+   {
+      format_props.imageFormatProperties = cached.properties;
+      if (external_props != nullptr)
+      {
+         external_props->externalMemoryProperties = cached.external_memory_properties;
+      }
+      if (compression_props != nullptr)
+      {
+         compression_props->imageCompressionFlags = cached.compression_flags;
+         compression_props->imageCompressionFixedRateFlags = cached.compression_fixed_rate_flags;
+      }
+      return cached.result;
+   }
+
+   cached.result =
+      instance_data.disp.GetPhysicalDeviceImageFormatProperties2KHR(physical_device, &format_info, &format_props);
+   if (cached.result != VK_SUCCESS && cached.result != VK_ERROR_FORMAT_NOT_SUPPORTED)
+   {
+      /* Running out of memory says nothing about the format. */
+      return cached.result;
+   }
+
+   cached.properties = format_props.imageFormatProperties;
+   if (external_props != nullptr)
+   {
+      cached.external_memory_properties = external_props->externalMemoryProperties;
+   }
+   if (compression_props != nullptr)
+   {
+      cached.compression_flags = compression_props->imageCompressionFlags;
+      cached.compression_fixed_rate_flags = compression_props->imageCompressionFixedRateFlags;
+   }
+   cache.insert_image_format_properties(query, cached);
+   return cached.result;
+}
 } /* namespace util */
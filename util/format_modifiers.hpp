@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2022 Arm Limited.
+ * Copyright (c) 2022, 2025 Arm Limited.
  *
  * SPDX-License-Identifier: MIT
  *
@@ -33,6 +33,8 @@ namespace util
 /**
  * @brief Get the properties a format has when combined with a DRM modifier.
  *
+ * The modifiers of a format are only queried from the driver once per instance.
+ *
  * @param      physical_device   The physical device
  * @param      format            The target format.
  * @param[out] format_props_list A vector which will store the supported properties
@@ -44,4 +46,20 @@ namespace util
 VkResult get_drm_format_properties(VkPhysicalDevice physical_device, VkFormat format,
                                    util::vector<VkDrmFormatModifierPropertiesEXT> &format_props_list);
 
+/**
+ * @brief Cached vkGetPhysicalDeviceImageFormatProperties2KHR.
+ *
+ * Queries whose chains only carry structures the layer itself uses to allocate swapchain images are answered from
+ * the cache of the instance, see util::format_query_cache. Any other query goes to the driver.
+ *
+ * @param      physical_device The physical device.
+ * @param      format_info     The query, as for vkGetPhysicalDeviceImageFormatProperties2KHR.
+ * @param[out] format_props    The properties of the image format.
+ *
+ * @return The result of vkGetPhysicalDeviceImageFormatProperties2KHR.
+ */
+VkResult get_image_format_properties(VkPhysicalDevice physical_device,
+                                     const VkPhysicalDeviceImageFormatInfo2KHR &format_info,
+                                     VkImageFormatProperties2KHR &format_props);
+
 } /* namespace util */
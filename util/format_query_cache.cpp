@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file format_query_cache.cpp
+ *
+ * @brief Implementation of the per instance cache of format queries.
+ */
+
+#include "format_query_cache.hpp"
+
+namespace util
+{
+
+/**
+ * @brief Fold @p value into the FNV-1a hash @p hash.
+ */
+static uint64_t hash_value(uint64_t hash, uint64_t value)
+{
+   for (int i = 0; i < 8; i++)
+   {
+      hash ^= (value >> (i * 8)) & 0xff;
+      hash *= 1099511628211ull;
+   }
+   return hash;
+}
+
+static constexpr uint64_t HASH_BASIS = 14695981039346656037ull;
+
+bool image_format_query::operator==(const image_format_query &other) const
+{
+   return physical_device == other.physical_device && format == other.format && type == other.type &&
+          tiling == other.tiling && usage == other.usage && flags == other.flags &&
+          drm_format_modifier == other.drm_format_modifier && sharing_mode == other.sharing_mode &&
+          handle_type == other.handle_type && compression_flags == other.compression_flags &&
+          compression_fixed_rate_flags == other.compression_fixed_rate_flags && chain == other.chain;
+}
+
+size_t format_query_cache::key_hasher::operator()(const drm_format_key &key) const
+{
+   uint64_t hash = hash_value(HASH_BASIS, reinterpret_cast<uintptr_t>(key.physical_device));
+   return static_cast<size_t>(hash_value(hash, key.format));
+}
+
+size_t format_query_cache::key_hasher::operator()(const image_format_query &query) const
+{
+   uint64_t hash = hash_value(HASH_BASIS, reinterpret_cast<uintptr_t>(query.physical_device));
+   hash = hash_value(hash, query.format);
+   hash = hash_value(hash, (static_cast<uint64_t>(query.type) << 32) | query.tiling);
+   hash = hash_value(hash, (static_cast<uint64_t>(query.usage) << 32) | query.flags);
+   hash = hash_value(hash, query.drm_format_modifier);
+   hash = hash_value(hash, (static_cast<uint64_t>(query.sharing_mode) << 32) | query.handle_type);
+   hash = hash_value(hash, (static_cast<uint64_t>(query.compression_flags) << 32) | query.compression_fixed_rate_flags);
+   return static_cast<size_t>(hash_value(hash, query.chain));
+}
+
+format_query_cache::format_query_cache(const util::allocator &alloc)
+   : m_drm_formats{ alloc }
+   , m_modifier_props{ alloc }
+   , m_image_formats{ alloc }
+{
+}
+
+std::optional<VkResult> format_query_cache::find_drm_format_properties(
+   VkPhysicalDevice physical_device, VkFormat format,
+   util::vector<VkDrmFormatModifierPropertiesEXT> &format_props_list) const
+{
+   std::lock_guard<std::mutex> lock(m_lock);
+   auto it = m_drm_formats.find(drm_format_key{ physical_device, format });
+   if (it == m_drm_formats.end())
+   {
+      return std::nullopt;
+   }
+
+   const modifier_range &range = it->second;
+   if (!format_props_list.try_resize(range.count))
+   {
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
+   for (size_t i = 0; i < range.count; i++)
+   {
+      format_props_list[i] = m_modifier_props[range.first + i];
+   }
+   return VK_SUCCESS;
+}
+
+void format_query_cache::insert_drm_format_properties(
+   VkPhysicalDevice physical_device, VkFormat format,
+   const util::vector<VkDrmFormatModifierPropertiesEXT> &format_props_list)
+{
+   std::lock_guard<std::mutex> lock(m_lock);
+   const drm_format_key key{ physical_device, format };
+   if (m_drm_formats.find(key) != m_drm_formats.end())
+   {
+      /* Another thread queried the same format first. */
+      return;
+   }
+
+   const modifier_range range{ m_modifier_props.size(), format_props_list.size() };
+   if (!m_modifier_props.try_reserve(range.first + range.count))
+   {
+      return;
+   }
+   for (const auto &props : format_props_list)
+   {
+      /* Cannot fail, the storage is reserved. */
+      m_modifier_props.try_push_back(props);
+   }
+
+   if (!m_drm_formats.try_insert(std::make_pair(key, range)).has_value())
+   {
+      m_modifier_props.erase(m_modifier_props.begin() + range.first, m_modifier_props.end());
+   }
+}
+
+bool format_query_cache::find_image_format_properties(const image_format_query &query,
+                                                      image_format_result *result) const
+{
+   std::lock_guard<std::mutex> lock(m_lock);
+   auto it = m_image_formats.find(query);
+   if (it == m_image_formats.end())
+   {
+      return false;
+   }
+   *result = it->second;
+   return true;
+}
+
+void format_query_cache::insert_image_format_properties(const image_format_query &query,
+                                                        const image_format_result &result)
+{
+   std::lock_guard<std::mutex> lock(m_lock);
+   /* Out of memory only leaves the query uncached. */
+   static_cast<void>(m_image_formats.try_insert(std::make_pair(query, result)));
+}
+
+} /* namespace util */
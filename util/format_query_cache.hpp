@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file format_query_cache.hpp
+ *
+ * @brief Per instance cache of the format queries the swapchains are created from.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <vulkan/vulkan.h>
+
+#include "custom_allocator.hpp"
+#include "unordered_map.hpp"
+
+namespace util
+{
+
+/**
+ * @brief Parameters of a vkGetPhysicalDeviceImageFormatProperties2KHR query that can be answered from the cache.
+ */
+struct image_format_query
+{
+   /** Structures found in the input and output chains of the query. */
+   enum chain_bits : uint32_t
+   {
+      DRM_FORMAT_MODIFIER_INFO = 1u << 0,
+      EXTERNAL_IMAGE_FORMAT_INFO = 1u << 1,
+      IMAGE_COMPRESSION_CONTROL = 1u << 2,
+      EXTERNAL_IMAGE_FORMAT_PROPERTIES = 1u << 3,
+      IMAGE_COMPRESSION_PROPERTIES = 1u << 4,
+   };
+
+   VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+   VkFormat format = VK_FORMAT_UNDEFINED;
+   VkImageType type = VK_IMAGE_TYPE_2D;
+   VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL;
+   VkImageUsageFlags usage = 0;
+   VkImageCreateFlags flags = 0;
+   uint64_t drm_format_modifier = 0;
+   VkSharingMode sharing_mode = VK_SHARING_MODE_EXCLUSIVE;
+   VkExternalMemoryHandleTypeFlagBits handle_type{};
+   VkImageCompressionFlagsEXT compression_flags = 0;
+   VkImageCompressionFixedRateFlagsEXT compression_fixed_rate_flags = 0;
+   uint32_t chain = 0;
+
+   bool operator==(const image_format_query &other) const;
+};
+
+/**
+ * @brief Answer of the driver to an @ref image_format_query.
+ */
+struct image_format_result
+{
+   VkResult result = VK_SUCCESS;
+   VkImageFormatProperties properties = {};
+   VkExternalMemoryProperties external_memory_properties = {};
+   VkImageCompressionFlagsEXT compression_flags = 0;
+   VkImageCompressionFixedRateFlagsEXT compression_fixed_rate_flags = 0;
+};
+
+/**
+ * @brief Format properties the physical devices of an instance reported.
+ *
+ * The properties of a format only depend on the physical device and the query, so they are asked for once per
+ * instance. Every swapchain creation otherwise repeats the same query for each modifier of its format. Entries live
+ * as long as the instance, failing to allocate one only means the query is not cached.
+ */
+class format_query_cache
+{
+public:
+   explicit format_query_cache(const util::allocator &alloc);
+
+   /**
+    * @brief Copy the modifiers cached for @p format of @p physical_device to @p format_props_list.
+    *
+    * @return std::nullopt if the format is not cached, otherwise VK_SUCCESS or VK_ERROR_OUT_OF_HOST_MEMORY.
+    */
+   std::optional<VkResult> find_drm_format_properties(
+      VkPhysicalDevice physical_device, VkFormat format,
+      util::vector<VkDrmFormatModifierPropertiesEXT> &format_props_list) const;
+
+   /**
+    * @brief Remember the modifiers @p physical_device supports for @p format.
+    */
+   void insert_drm_format_properties(VkPhysicalDevice physical_device, VkFormat format,
+                                     const util::vector<VkDrmFormatModifierPropertiesEXT> &format_props_list);
+
+   /**
+    * @brief Look up the answer to @p query.
+    *
+    * @return true and @p result set if the query is cached, false otherwise.
+    */
+   bool find_image_format_properties(const image_format_query &query, image_format_result *result) const;
+
+   /**
+    * @brief Remember the answer to @p query.
+    */
+   void insert_image_format_properties(const image_format_query &query, const image_format_result &result);
+
+private:
+   struct drm_format_key
+   {
+      VkPhysicalDevice physical_device;
+      VkFormat format;
+
+      bool operator==(const drm_format_key &other) const
+      {
+         return physical_device == other.physical_device && format == other.format;
+      }
+   };
+
+   /** Range of @ref m_modifier_props holding the modifiers of a format. */
+   struct modifier_range
+   {
+      size_t first;
+      size_t count;
+   };
+
+   struct key_hasher
+   {
+      size_t operator()(const drm_format_key &key) const;
+      size_t operator()(const image_format_query &query) const;
+   };
+
+   mutable std::mutex m_lock;
+   util::unordered_map<drm_format_key, modifier_range, key_hasher> m_drm_formats;
+   /* Modifiers of all the cached formats, stored back to back. */
+   util::vector<VkDrmFormatModifierPropertiesEXT> m_modifier_props;
+   util::unordered_map<image_format_query, image_format_result, key_hasher> m_image_formats;
+};
+
+} /* namespace util */
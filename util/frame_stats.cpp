@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file frame_stats.cpp
+ *
+ * @brief Implementation of the per swapchain frame statistics.
+ */
+
+#include "frame_stats.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+namespace util
+{
+
+void latency_histogram::record(uint64_t duration_ns)
+{
+   const uint32_t bucket =
+      duration_ns == 0 ? 0 : std::min<uint32_t>(63 - __builtin_clzll(duration_ns), BUCKET_COUNT - 1);
+   m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+   m_total_ns.fetch_add(duration_ns, std::memory_order_relaxed);
+   m_count.fetch_add(1, std::memory_order_relaxed);
+
+   uint64_t max_ns = m_max_ns.load(std::memory_order_relaxed);
+   while (duration_ns > max_ns && !m_max_ns.compare_exchange_weak(max_ns, duration_ns, std::memory_order_relaxed))
+   {
+   }
+}
+
+latency_histogram::snapshot latency_histogram::read() const
+{
+   snapshot result{};
+   result.count = m_count.load(std::memory_order_relaxed);
+   result.total_ns = m_total_ns.load(std::memory_order_relaxed);
+   result.max_ns = m_max_ns.load(std::memory_order_relaxed);
+   for (uint32_t i = 0; i < BUCKET_COUNT; i++)
+   {
+      result.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+   }
+   return result;
+}
+
+uint64_t latency_histogram::snapshot::percentile(double fraction) const
+{
+   uint64_t total = 0;
+   for (uint64_t bucket_count : buckets)
+   {
+      total += bucket_count;
+   }
+   if (total == 0)
+   {
+      return 0;
+   }
+
+   const uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * static_cast<double>(total)));
+   uint64_t seen = 0;
+   for (uint32_t i = 0; i < BUCKET_COUNT; i++)
+   {
+      seen += buckets[i];
+      if (seen >= target)
+      {
+         return (i == BUCKET_COUNT - 1) ? max_ns : (2ull << i) - 1;
+      }
+   }
+   return max_ns;
+}
+
+/**
+ * @brief Dump interval read from WSI_FRAME_STATS_INTERVAL, 0 when the statistics are not printed.
+ */
+static uint64_t get_dump_interval_ns()
+{
+   static const uint64_t interval_ns = []() -> uint64_t {
+      const char *env = std::getenv("WSI_FRAME_STATS_INTERVAL");
+      if (env == nullptr || env[0] == '\0')
+      {
+         return 0;
+      }
+      const double seconds = std::strtod(env, nullptr);
+      return seconds > 0.0 ? static_cast<uint64_t>(seconds * 1e9) : 0;
+   }();
+   return interval_ns;
+}
+
+bool frame_stats::dump_if_due(const void *owner)
+{
+   const uint64_t interval_ns = get_dump_interval_ns();
+   if (interval_ns == 0)
+   {
+      return false;
+   }
+
+   const uint64_t now = now_ns();
+   uint64_t next_dump = m_next_dump_ns.load(std::memory_order_relaxed);
+   if (next_dump == 0)
+   {
+      /* First frame, start the interval. */
+      m_next_dump_ns.compare_exchange_strong(next_dump, now + interval_ns, std::memory_order_relaxed);
+      return false;
+   }
+   if (now < next_dump || !m_next_dump_ns.compare_exchange_strong(next_dump, now + interval_ns,
+                                                                   std::memory_order_relaxed))
+   {
+      return false;
+   }
+
+   dump(owner);
+   return true;
+}
+
+void frame_stats::dump(const void *owner) const
+{
+   static const char *const stage_names[] = { "acquire wait", "present fence wait", "backend present",
+                                              "queue to screen" };
+   static_assert(sizeof(stage_names) / sizeof(stage_names[0]) == static_cast<uint32_t>(frame_stage::count),
+                 "Every frame stage needs a name");
+
+   /* Written directly rather than logged, so the statistics are also available in release builds. */
+   std::fprintf(stderr, "WSI frame statistics of swapchain %p (us):\n", owner);
+   for (uint32_t i = 0; i < static_cast<uint32_t>(frame_stage::count); i++)
+   {
+      const auto stats = m_histograms[i].read();
+      const uint64_t average_ns = stats.count != 0 ? stats.total_ns / stats.count : 0;
+      std::fprintf(stderr,
+                   "  %-18s count %8" PRIu64 "  avg %9.1f  p50 <%9.1f  p99 <%9.1f  max %9.1f\n", stage_names[i],
+                   stats.count, average_ns / 1e3, stats.percentile(0.5) / 1e3, stats.percentile(0.99) / 1e3,
+                   stats.max_ns / 1e3);
+   }
+}
+
+} /* namespace util */
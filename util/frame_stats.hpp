@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file frame_stats.hpp
+ *
+ * @brief Per swapchain latency histograms of the stages a frame goes through in the layer.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+
+namespace util
+{
+
+/**
+ * @brief Stages of a frame the layer measures the time of.
+ */
+enum class frame_stage : uint32_t
+{
+   /** vkAcquireNextImageKHR waiting for a free image. */
+   acquire_wait,
+   /** Waiting for the rendering of a presented image, see swapchain_base::image_wait_present. */
+   present_fence_wait,
+   /** The backend present: the SHM copy, the page flip or the surface commit. */
+   backend_present,
+   /** From vkQueuePresentKHR until the backend reports the image on screen. */
+   queue_to_screen,
+   count,
+};
+
+/**
+ * @brief Latency histogram with power of two buckets, recorded to without locks.
+ *
+ * Bucket i counts the durations in [2^i, 2^(i+1)) nanoseconds, the last one everything longer.
+ */
+class latency_histogram
+{
+public:
+   static constexpr uint32_t BUCKET_COUNT = 32;
+
+   /**
+    * @brief Copy of the histogram at one point in time.
+    */
+   struct snapshot
+   {
+      uint64_t count;
+      uint64_t total_ns;
+      uint64_t max_ns;
+      std::array<uint64_t, BUCKET_COUNT> buckets;
+
+      /**
+       * @brief Upper bound of the bucket the @p fraction percentile falls in, 0 for an empty histogram.
+       */
+      uint64_t percentile(double fraction) const;
+   };
+
+   void record(uint64_t duration_ns);
+
+   /**
+    * @brief Read the histogram. Concurrent records may be seen partially, which only skews the result by them.
+    */
+   snapshot read() const;
+
+private:
+   std::atomic<uint64_t> m_count{ 0 };
+   std::atomic<uint64_t> m_total_ns{ 0 };
+   std::atomic<uint64_t> m_max_ns{ 0 };
+   std::array<std::atomic<uint64_t>, BUCKET_COUNT> m_buckets{};
+};
+
+/**
+ * @brief Latency histograms of every frame_stage of a swapchain.
+ *
+ * Recording costs a CLOCK_MONOTONIC read, which the vDSO serves without a system call, and a few relaxed atomic
+ * additions, so the statistics are always collected. When WSI_FRAME_STATS_INTERVAL is set to a number of seconds
+ * they are also printed to stderr at that interval.
+ */
+class frame_stats
+{
+public:
+   /**
+    * @brief Timestamp to pass to @ref record.
+    */
+   static uint64_t now_ns()
+   {
+      timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+   }
+
+   /**
+    * @brief Record that @p stage took from @p start_ns until now.
+    */
+   void record(frame_stage stage, uint64_t start_ns)
+   {
+      const uint64_t now = now_ns();
+      m_histograms[static_cast<uint32_t>(stage)].record(now > start_ns ? now - start_ns : 0);
+   }
+
+   latency_histogram::snapshot read(frame_stage stage) const
+   {
+      return m_histograms[static_cast<uint32_t>(stage)].read();
+   }
+
+   /**
+    * @brief Print the statistics if the configured dump interval passed since the previous dump.
+    *
+    * @param owner Printed to tell the swapchains apart.
+    *
+    * @return Whether the statistics were printed.
+    */
+   bool dump_if_due(const void *owner);
+
+private:
+   void dump(const void *owner) const;
+
+   std::array<latency_histogram, static_cast<uint32_t>(frame_stage::count)> m_histograms;
+   std::atomic<uint64_t> m_next_dump_ns{ 0 };
+};
+
+} /* namespace util */
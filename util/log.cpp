@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2021-2023 Arm Limited.
+ * Copyright (c) 2021-2023, 2025 Arm Limited.
  *
  * SPDX-License-Identifier: MIT
  *
@@ -23,75 +23,329 @@
  */
 
 #include "log.hpp"
-#include <iostream>
 #include <charconv>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
-#include <string>
 #include <cstring>
+#include <chrono>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 namespace util
 {
 
-#ifndef NDEBUG
+int read_log_level()
+{
+   int level = WSI_DEFAULT_LOG_LEVEL;
+   if (const char *env = std::getenv("VULKAN_WSI_DEBUG_LEVEL"))
+   {
+      std::from_chars(env, env + std::strlen(env), level);
+   }
+   return level;
+}
+
+namespace
+{
+
+/* Messages a call site can log per window before it is rate limited. */
+constexpr uint32_t RATE_LIMIT_BURST = 10;
+constexpr uint64_t RATE_LIMIT_WINDOW_NS = 1000000000ull;
+
+/* Longest formatted message, longer ones are truncated and end with TRUNCATION_MARK. */
+constexpr size_t MAX_MESSAGE_LENGTH = 1024;
+constexpr char TRUNCATION_MARK[] = "...";
+
+/* Messages of this level or below are written before the call returns, so they are not lost if the process aborts
+ * right after. They may come out ahead of less severe messages still queued. */
+constexpr int SYNC_LOG_LEVEL = 1;
+
+/* Messages queued before the drain thread writes them, a power of two. */
+constexpr uint32_t QUEUE_CAPACITY = 256;
+
+struct log_record
+{
+   /* Slot state of the bounded queue, see log_queue. */
+   std::atomic<uint32_t> sequence{ 0 };
+   int level = 0;
+   const char *file = nullptr;
+   int line = 0;
+   uint32_t suppressed = 0;
+   char text[MAX_MESSAGE_LENGTH] = {};
+};
+
+void write_record(const log_record &record)
+{
+   const char *level_name = nullptr;
+   char level_buffer[16];
+   switch (record.level)
+   {
+   case 1:
+      level_name = "ERROR";
+      break;
+   case 2:
+      level_name = "WARNING";
+      break;
+   case 3:
+      level_name = "INFO";
+      break;
+   default:
+      std::snprintf(level_buffer, sizeof(level_buffer), "LEVEL_%d", record.level);
+      level_name = level_buffer;
+      break;
+   }
+
+   /* One call per message, so lines written by other threads are not interleaved with it. */
+   if (record.suppressed != 0)
+   {
+      std::fprintf(stderr, "%s(%s:%d): %s (%u similar messages suppressed)\n", level_name, record.file, record.line,
+                   record.text, record.suppressed);
+   }
+   else
+   {
+      std::fprintf(stderr, "%s(%s:%d): %s\n", level_name, record.file, record.line, record.text);
+   }
+}
 
 /**
- * @brief check if a log level is enabled, and print it
+ * @brief Bounded multi-producer, single-consumer queue of log records drained by a background thread.
+ *
+ * Each slot carries a sequence number telling whether it is free for the producer at a given position or holds the
+ * record of the consumer's position, so producers only contend on the atomic increment of the enqueue position and
+ * never wait: a full queue drops the message.
  */
-static bool check_and_print_log_level(int level)
+class log_queue
 {
-   struct log_state
+public:
+   log_queue()
    {
-      int level = WSI_DEFAULT_LOG_LEVEL;
-      log_state()
+      for (uint32_t i = 0; i < QUEUE_CAPACITY; i++)
       {
-         if (const char *env = std::getenv("VULKAN_WSI_DEBUG_LEVEL"))
+         m_records[i].sequence.store(i, std::memory_order_relaxed);
+      }
+   }
+
+   ~log_queue()
+   {
+      if (m_thread.joinable())
+      {
+         m_closed.store(true, std::memory_order_seq_cst);
+         wake_consumer();
+         m_thread.join();
+      }
+   }
+
+   /**
+    * @brief Claim the slot of the next record, or nullptr when the queue is full.
+    */
+   log_record *begin_push()
+   {
+      uint32_t position = m_enqueue_position.load(std::memory_order_relaxed);
+      while (true)
+      {
+         log_record &record = m_records[position & (QUEUE_CAPACITY - 1)];
+         const int32_t diff =
+            static_cast<int32_t>(record.sequence.load(std::memory_order_acquire) - position);
+         if (diff == 0)
          {
-            std::from_chars(env, env + std::strlen(env), level);
+            if (m_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+               return &record;
+            }
+         }
+         else if (diff < 0)
+         {
+            return nullptr;
+         }
+         else
+         {
+            position = m_enqueue_position.load(std::memory_order_relaxed);
          }
       }
-   };
-   static log_state state;
+   }
 
-   bool result = level <= state.level;
-   if (result)
+   /**
+    * @brief Publish a record filled after @ref begin_push returned it.
+    */
+   void end_push(log_record &record)
    {
-      switch (level)
+      record.sequence.fetch_add(1, std::memory_order_release);
+
+      /* Sequentially consistent with the load of m_waiting, see drain. */
+      m_signal.fetch_add(1, std::memory_order_seq_cst);
+      if (m_waiting.load(std::memory_order_seq_cst))
       {
-      case 0:
-         /* Reserved for no logging */
-         break;
-      case 1:
-         std::fprintf(stderr, "ERROR");
-         break;
-      case 2:
-         std::fprintf(stderr, "WARNING");
-         break;
-      case 3:
-         std::fprintf(stderr, "INFO");
-         break;
-      default:
-         std::fprintf(stderr, "LEVEL_%d", level);
-         break;
+         wake_consumer();
       }
    }
-   return result;
+
+   /**
+    * @brief Start the drain thread, or return false when it cannot be created.
+    */
+   bool start()
+   {
+      std::call_once(m_start_once, [this]() {
+         try
+         {
+            m_thread = std::thread(&log_queue::drain, this);
+         }
+         catch (const std::system_error &)
+         {
+         }
+      });
+      return m_thread.joinable();
+   }
+
+private:
+   void wake_consumer()
+   {
+      syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_signal), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+   }
+
+   bool pop_and_write()
+   {
+      log_record &record = m_records[m_dequeue_position & (QUEUE_CAPACITY - 1)];
+      if (record.sequence.load(std::memory_order_acquire) != m_dequeue_position + 1)
+      {
+         return false;
+      }
+
+      write_record(record);
+      record.sequence.store(m_dequeue_position + QUEUE_CAPACITY, std::memory_order_release);
+      m_dequeue_position++;
+      return true;
+   }
+
+   void drain()
+   {
+      pthread_setname_np(pthread_self(), "wsi-log");
+
+      while (true)
+      {
+         while (pop_and_write())
+         {
+         }
+
+         m_waiting.store(true, std::memory_order_seq_cst);
+
+         /* A push after this load changes m_signal, which makes FUTEX_WAIT return at once. */
+         const uint32_t signal = m_signal.load(std::memory_order_seq_cst);
+         const log_record &next = m_records[m_dequeue_position & (QUEUE_CAPACITY - 1)];
+         const bool empty = next.sequence.load(std::memory_order_acquire) != m_dequeue_position + 1;
+         if (empty && m_closed.load(std::memory_order_seq_cst))
+         {
+            break;
+         }
+         if (empty)
+         {
+            syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_signal), FUTEX_WAIT_PRIVATE, signal, nullptr, nullptr,
+                    0);
+         }
+         m_waiting.store(false, std::memory_order_relaxed);
+      }
+      std::fflush(stderr);
+   }
+
+   static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free,
+                 "futex words must be plain 32-bit integers");
+
+   log_record m_records[QUEUE_CAPACITY];
+
+   alignas(64) std::atomic<uint32_t> m_enqueue_position{ 0 };
+
+   /* Only used by the drain thread. */
+   alignas(64) uint32_t m_dequeue_position = 0;
+
+   /* Futex word the drain thread sleeps on, bumped after every push. */
+   std::atomic<uint32_t> m_signal{ 0 };
+   std::atomic<bool> m_waiting{ false };
+   std::atomic<bool> m_closed{ false };
+
+   std::once_flag m_start_once;
+   std::thread m_thread;
+};
+
+log_queue &get_log_queue()
+{
+   static log_queue queue;
+   return queue;
 }
 
-void wsi_log_message(int level, const char *file, int line, const char *format, ...)
+/**
+ * @brief Count a message against the rate limit of its call site.
+ *
+ * @return Whether the message should be logged.
+ */
+bool take_rate_limit(log_callsite &callsite)
 {
-   if (check_and_print_log_level(level))
+   const uint64_t now = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+         .count());
+
+   uint64_t window_start = callsite.window_start.load(std::memory_order_relaxed);
+   if (now - window_start >= RATE_LIMIT_WINDOW_NS &&
+       callsite.window_start.compare_exchange_strong(window_start, now, std::memory_order_relaxed))
    {
-      std::fprintf(stderr, "(%s:%d): ", file, line);
-      std::va_list args;
-      va_start(args, format);
-      std::vfprintf(stderr, format, args);
-      va_end(args);
-      std::putc('\n', stderr);
+      callsite.count.store(0, std::memory_order_relaxed);
    }
+
+   if (callsite.count.fetch_add(1, std::memory_order_relaxed) >= RATE_LIMIT_BURST)
+   {
+      callsite.suppressed.fetch_add(1, std::memory_order_relaxed);
+      return false;
+   }
+   return true;
 }
 
-#endif
+} /* namespace */
+
+void wsi_log_message(log_callsite &callsite, int level, const char *file, int line, const char *format, ...)
+{
+   /* Level 0 is reserved for no logging. */
+   if (level == 0 || !take_rate_limit(callsite))
+   {
+      return;
+   }
+
+   log_queue &queue = get_log_queue();
+   log_record sync_record;
+   const bool async = level > SYNC_LOG_LEVEL && queue.start();
+   log_record *record = async ? queue.begin_push() : &sync_record;
+   if (record == nullptr)
+   {
+      /* The queue is full, report the message with the next one of the call site. */
+      callsite.suppressed.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+
+   record->level = level;
+   record->file = file;
+   record->line = line;
+   record->suppressed = callsite.suppressed.exchange(0, std::memory_order_relaxed);
+
+   std::va_list args;
+   va_start(args, format);
+   const int length = std::vsnprintf(record->text, sizeof(record->text), format, args);
+   va_end(args);
+   if (length >= static_cast<int>(sizeof(record->text)))
+   {
+      std::memcpy(record->text + sizeof(record->text) - sizeof(TRUNCATION_MARK), TRUNCATION_MARK,
+                  sizeof(TRUNCATION_MARK));
+   }
+
+   if (async)
+   {
+      queue.end_push(*record);
+   }
+   else
+   {
+      write_record(*record);
+   }
+}
 
 } /* namespace util */
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2021-2023 Arm Limited.
+ * Copyright (c) 2021-2023, 2025 Arm Limited.
  *
  * SPDX-License-Identifier: MIT
  *
@@ -23,10 +23,43 @@
  */
 
 #pragma once
+
+#include <atomic>
+#include <cstdint>
+
 namespace util
 {
 #define WSI_DEFAULT_LOG_LEVEL 1
 
+/**
+ * @brief Per call site state of the log rate limit, see @ref WSI_LOG.
+ *
+ * Constant initialized, so the static instance of each call site costs no initialization guard.
+ */
+struct log_callsite
+{
+   /* Start of the current rate limit window (ns, steady clock). */
+   std::atomic<uint64_t> window_start{ 0 };
+   /* Messages logged from the call site in the window. */
+   std::atomic<uint32_t> count{ 0 };
+   /* Messages dropped since the last one that was logged. */
+   std::atomic<uint32_t> suppressed{ 0 };
+};
+
+/**
+ * @brief Read the log level from VULKAN_WSI_DEBUG_LEVEL.
+ */
+int read_log_level();
+
+/**
+ * @brief Log level set for the process, read once.
+ */
+inline int wsi_log_level()
+{
+   static const int level = read_log_level();
+   return level;
+}
+
 /**
  * @brief Log a message to a certain log level
  *
@@ -37,6 +70,12 @@ namespace util
  * is set to 2, messages with log level 1 and 2 are printed. Please note that
  * the newline character '\n' is automatically appended.
  *
+ * The message is formatted by the caller and queued to a background thread that writes it to stderr, so logging
+ * never blocks on the output. Messages are dropped when the queue is full, and after a burst from the same
+ * @p callsite; the next message written from it reports how many were suppressed. Errors are written before the call
+ * returns. Messages longer than 1024 bytes are truncated and end with "...".
+ *
+ * @param[in] callsite  Rate limit state of the call site.
  * @param[in] level     The log level of this message, you can set an arbitary
  *                      integer however please refer to the included macros for
  *                      the sensible defaults.
@@ -45,23 +84,24 @@ namespace util
  * @param[in] format    A C-style formatting string.
  */
 
-void wsi_log_message(int level, const char *file, int line, const char *format, ...)
+void wsi_log_message(log_callsite &callsite, int level, const char *file, int line, const char *format, ...)
 #ifdef __GNUC__
-   __attribute__((format(printf, 4, 5)))
+   __attribute__((format(printf, 5, 6)))
 #endif
    ;
 
-#ifdef NDEBUG
-static constexpr bool wsi_log_enable = false;
-#else
+/* Logging is kept in release builds, where it only costs a level check unless VULKAN_WSI_DEBUG_LEVEL asks for more
+ * than errors. */
 static constexpr bool wsi_log_enable = true;
-#endif
 
-#define WSI_LOG(level, ...)                                               \
-   do                                                                     \
-   {                                                                      \
-      if (::util::wsi_log_enable)                                         \
-         ::util::wsi_log_message(level, __FILE__, __LINE__, __VA_ARGS__); \
+#define WSI_LOG(level, ...)                                                                 \
+   do                                                                                       \
+   {                                                                                        \
+      if (::util::wsi_log_enable && (level) <= ::util::wsi_log_level())                     \
+      {                                                                                     \
+         static ::util::log_callsite wsi_log_callsite;                                      \
+         ::util::wsi_log_message(wsi_log_callsite, level, __FILE__, __LINE__, __VA_ARGS__); \
+      }                                                                                     \
    } while (0)
 
 #define WSI_LOG_ERROR(...) WSI_LOG(1, __VA_ARGS__)
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file lookup_table.hpp
+ *
+ * @brief Fixed size table of pointers keyed on pointers, with lock-free lookups.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace util
+{
+
+/**
+ * @brief Open addressing table mapping pointer keys to pointer values, read without locks.
+ *
+ * Meant for lookups on the hot path of data that rarely changes, e.g. the private data of the dispatchable objects of
+ * the layer. Writers, @ref insert and @ref erase, must be serialized by the caller. Readers do not take any lock,
+ * they may run concurrently with writers that change other keys.
+ *
+ * A slot freed by @ref erase becomes a tombstone, reused by later inserts but never emptied, so lookups of other keys
+ * do not stop early. The table has a fixed capacity, @ref insert fails once it is full and the caller has to keep the
+ * entry elsewhere.
+ *
+ * @tparam Value    Type pointed to by the values.
+ * @tparam Capacity Number of slots, a power of two.
+ */
+template <typename Value, size_t Capacity>
+class lookup_table
+{
+   static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+   /**
+    * @brief Find the value of @p key.
+    *
+    * @return The value, or nullptr if @p key is not in the table.
+    */
+   Value *find(const void *key) const
+   {
+      for (size_t probe = 0, index = hash(key); probe < Capacity; probe++, index = (index + 1) & (Capacity - 1))
+      {
+         const void *slot_key = m_slots[index].key.load(std::memory_order_acquire);
+         if (slot_key == key)
+         {
+            return m_slots[index].value.load(std::memory_order_relaxed);
+         }
+         if (slot_key == nullptr)
+         {
+            return nullptr;
+         }
+      }
+      return nullptr;
+   }
+
+   /**
+    * @brief Add @p key, or replace its value.
+    *
+    * @return false if the table is full.
+    */
+   bool insert(const void *key, Value *value)
+   {
+      size_t free_index = Capacity;
+      for (size_t probe = 0, index = hash(key); probe < Capacity; probe++, index = (index + 1) & (Capacity - 1))
+      {
+         const void *slot_key = m_slots[index].key.load(std::memory_order_relaxed);
+         if (slot_key == key)
+         {
+            m_slots[index].value.store(value, std::memory_order_relaxed);
+            return true;
+         }
+         if (slot_key == tombstone() && free_index == Capacity)
+         {
+            free_index = index;
+         }
+         if (slot_key == nullptr)
+         {
+            if (free_index == Capacity)
+            {
+               free_index = index;
+            }
+            break;
+         }
+      }
+
+      if (free_index == Capacity)
+      {
+         return false;
+      }
+      /* The value is published by the release store of the key, readers that find the key see it. */
+      m_slots[free_index].value.store(value, std::memory_order_relaxed);
+      m_slots[free_index].key.store(key, std::memory_order_release);
+      return true;
+   }
+
+   /**
+    * @brief Remove @p key if it is in the table.
+    */
+   void erase(const void *key)
+   {
+      for (size_t probe = 0, index = hash(key); probe < Capacity; probe++, index = (index + 1) & (Capacity - 1))
+      {
+         const void *slot_key = m_slots[index].key.load(std::memory_order_relaxed);
+         if (slot_key == key)
+         {
+            m_slots[index].key.store(tombstone(), std::memory_order_release);
+            return;
+         }
+         if (slot_key == nullptr)
+         {
+            return;
+         }
+      }
+   }
+
+private:
+   struct slot
+   {
+      /* nullptr for a slot never used, tombstone() for one freed by erase. */
+      std::atomic<const void *> key{ nullptr };
+      std::atomic<Value *> value{ nullptr };
+   };
+
+   static const void *tombstone()
+   {
+      static const char marker = 0;
+      return &marker;
+   }
+
+   static size_t hash(const void *key)
+   {
+      /* Keys are pointers to aligned structures, drop the low bits that are always 0 and mix the rest. */
+      const uint64_t bits = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(key)) >> 4;
+      return static_cast<size_t>((bits * 0x9e3779b97f4a7c15ull) >> 32) & (Capacity - 1);
+   }
+
+   std::array<slot, Capacity> m_slots;
+};
+
+} /* namespace util */
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "memory_accounting.hpp"
+#include "tuning_profile.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+
+namespace util
+{
+
+bool memory_accounting::is_enabled()
+{
+   return tuning_profile::get().memory_accounting != 0;
+}
+
+void memory_accounting::dump(const char *owner_kind, const void *owner) const
+{
+   static const char *const category_names[] = { "command", "object", "cache",       "device",
+                                                 "instance", "shm",   "host visible" };
+   static_assert(sizeof(category_names) / sizeof(category_names[0]) == static_cast<uint32_t>(memory_category::count),
+                 "Every memory category needs a name");
+
+   std::fprintf(stderr, "WSI host memory of %s %p (KiB):\n", owner_kind, owner);
+   for (uint32_t i = 0; i < static_cast<uint32_t>(memory_category::count); i++)
+   {
+      const counters stats = read(static_cast<memory_category>(i));
+      if (stats.allocations == 0)
+      {
+         continue;
+      }
+      std::fprintf(stderr, "  %-12s current %10.1f  peak %10.1f  allocations %8" PRIu64 "\n", category_names[i],
+                   stats.current / 1024.0, stats.peak / 1024.0, stats.allocations);
+   }
+}
+
+} /* namespace util */
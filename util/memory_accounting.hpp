@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file memory_accounting.hpp
+ *
+ * @brief Host memory held by an instance, device or swapchain of the layer.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+namespace util
+{
+
+/**
+ * @brief What host memory is counted as. The allocation scopes come first, with their VkSystemAllocationScope value.
+ */
+enum class memory_category : uint32_t
+{
+   command = VK_SYSTEM_ALLOCATION_SCOPE_COMMAND,
+   object = VK_SYSTEM_ALLOCATION_SCOPE_OBJECT,
+   cache = VK_SYSTEM_ALLOCATION_SCOPE_CACHE,
+   device = VK_SYSTEM_ALLOCATION_SCOPE_DEVICE,
+   instance = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE,
+   /** SHM segments the X11 presenter copies frames into. */
+   shm,
+   /** Host visible device memory the layer allocates for images the CPU reads. */
+   host_visible,
+   count,
+};
+
+/**
+ * @brief Current, peak and number of allocations of host memory of one owner, per memory_category.
+ *
+ * util::allocator counts into the accounting it is given, so the allocations of an object and of the allocators
+ * derived from its allocator add up in the accounting of the object. Counting is lock free, the peak may miss
+ * concurrent allocations by a few bytes. Only enabled with the memory_accounting tuning key, see @ref is_enabled.
+ */
+class memory_accounting
+{
+public:
+   struct counters
+   {
+      /* Signed, memory freed through another owner than the one that allocated it briefly makes it negative. */
+      int64_t current;
+      int64_t peak;
+      uint64_t allocations;
+   };
+
+   /**
+    * @brief Whether owners should account their memory, read from the tuning profile.
+    */
+   static bool is_enabled();
+
+   void add(memory_category category, size_t bytes)
+   {
+      auto &entry = m_categories[static_cast<uint32_t>(category)];
+      const int64_t current =
+         entry.current.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) + static_cast<int64_t>(bytes);
+      entry.allocations.fetch_add(1, std::memory_order_relaxed);
+
+      int64_t peak = entry.peak.load(std::memory_order_relaxed);
+      while (current > peak && !entry.peak.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+      {
+      }
+   }
+
+   void remove(memory_category category, size_t bytes)
+   {
+      m_categories[static_cast<uint32_t>(category)].current.fetch_sub(static_cast<int64_t>(bytes),
+                                                                       std::memory_order_relaxed);
+   }
+
+   counters read(memory_category category) const
+   {
+      const auto &entry = m_categories[static_cast<uint32_t>(category)];
+      return { entry.current.load(std::memory_order_relaxed), entry.peak.load(std::memory_order_relaxed),
+               entry.allocations.load(std::memory_order_relaxed) };
+   }
+
+   /**
+    * @brief Print the counters of the categories used so far to stderr.
+    *
+    * @param owner_kind "instance", "device" or "swapchain".
+    * @param owner      Printed to tell the owners apart.
+    */
+   void dump(const char *owner_kind, const void *owner) const;
+
+private:
+   struct entry
+   {
+      std::atomic<int64_t> current{ 0 };
+      std::atomic<int64_t> peak{ 0 };
+      std::atomic<uint64_t> allocations{ 0 };
+   };
+
+   std::array<entry, static_cast<uint32_t>(memory_category::count)> m_categories;
+};
+
+} /* namespace util */
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file memory_type_cache.cpp
+ *
+ * @brief Implementation of the per device cache of import memory types.
+ */
+
+#include "memory_type_cache.hpp"
+
+namespace util
+{
+
+bool memory_type_cache::find(VkExternalMemoryHandleTypeFlagBits handle_type, const void *source, uint64_t flags,
+                             uint32_t *memory_type_index) const
+{
+   std::lock_guard<std::mutex> lock(m_lock);
+   for (const auto &cached : m_entries)
+   {
+      if (cached.source == source && cached.flags == flags && cached.handle_type == handle_type)
+      {
+         *memory_type_index = cached.memory_type_index;
+         return true;
+      }
+   }
+   return false;
+}
+
+void memory_type_cache::insert(VkExternalMemoryHandleTypeFlagBits handle_type, const void *source, uint64_t flags,
+                               uint32_t memory_type_index)
+{
+   std::lock_guard<std::mutex> lock(m_lock);
+   entry *slot = &m_entries[m_next];
+   for (auto &cached : m_entries)
+   {
+      if (cached.source == source && cached.flags == flags && cached.handle_type == handle_type)
+      {
+         /* Another thread imported from the same source first. */
+         cached.memory_type_index = memory_type_index;
+         return;
+      }
+   }
+   slot->source = source;
+   slot->flags = flags;
+   slot->handle_type = handle_type;
+   slot->memory_type_index = memory_type_index;
+   m_next = (m_next + 1) % MAX_ENTRIES;
+}
+
+} /* namespace util */
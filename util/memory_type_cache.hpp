@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file memory_type_cache.hpp
+ *
+ * @brief Per device cache of the memory types external buffers are imported with.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vulkan/vulkan.h>
+
+namespace util
+{
+
+/**
+ * @brief Memory type indices chosen for the buffers of an allocation source.
+ *
+ * The memory types a driver accepts for an imported buffer only depend on where the buffer was allocated, so the
+ * memory type chosen for the first buffer of a source is reused for the following ones. A source is identified by
+ * the allocator that made the buffer and the flags it was allocated with. The cache is bounded, the oldest entry is
+ * replaced once it is full.
+ */
+class memory_type_cache
+{
+public:
+   /** Number of sources remembered. */
+   static constexpr uint32_t MAX_ENTRIES = 16;
+
+   /**
+    * @brief Look up the memory type chosen for buffers of @p source allocated with @p flags.
+    *
+    * @return true and @p memory_type_index set if the source is cached, false otherwise.
+    */
+   bool find(VkExternalMemoryHandleTypeFlagBits handle_type, const void *source, uint64_t flags,
+             uint32_t *memory_type_index) const;
+
+   /**
+    * @brief Remember @p memory_type_index for buffers of @p source allocated with @p flags.
+    */
+   void insert(VkExternalMemoryHandleTypeFlagBits handle_type, const void *source, uint64_t flags,
+               uint32_t memory_type_index);
+
+private:
+   struct entry
+   {
+      /* nullptr while unused. */
+      const void *source = nullptr;
+      uint64_t flags = 0;
+      VkExternalMemoryHandleTypeFlagBits handle_type{};
+      uint32_t memory_type_index = 0;
+   };
+
+   mutable std::mutex m_lock;
+   std::array<entry, MAX_ENTRIES> m_entries;
+   /* Entry replaced by the next insert once all are used. */
+   uint32_t m_next = 0;
+};
+
+} /* namespace util */
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file memory_type_policy.cpp
+ *
+ * @brief Implementation of the memory type selection policy.
+ */
+
+#include "memory_type_policy.hpp"
+
+#include <array>
+#include <cstdlib>
+
+namespace util
+{
+
+int score_memory_type(memory_access access, VkMemoryPropertyFlags flags)
+{
+   if (flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+   {
+      return -1;
+   }
+
+   const bool host_visible = (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+   const bool host_cached = (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0;
+   const bool host_coherent = (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+   const bool device_local = (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0;
+
+   int score = 0;
+   switch (access)
+   {
+   case memory_access::cpu_readback:
+      if (!host_visible)
+      {
+         return -1;
+      }
+      /* Reads from uncached memory are an order of magnitude slower, which nothing else makes up for. */
+      score += host_cached ? 8 : 0;
+      /* Coherent memory needs no invalidation before each read. */
+      score += host_coherent ? 2 : 0;
+      /* Host visible device memory is usually read across the bus. */
+      score += device_local ? 0 : 1;
+      break;
+   case memory_access::cpu_upload:
+      if (!host_visible)
+      {
+         return -1;
+      }
+      score += host_coherent ? 4 : 0;
+      /* Write-combined memory takes sequential writes at full speed without polluting the caches. */
+      score += host_cached ? 0 : 2;
+      score += device_local ? 1 : 0;
+      break;
+   case memory_access::scanout:
+   case memory_access::gpu_only:
+      score += device_local ? 4 : 0;
+      /* Memory the host cannot see is usually the GPU's fastest, rather than a window into it. */
+      score += host_visible ? 0 : 2;
+      score += host_cached ? 0 : 1;
+      break;
+   default:
+      return -1;
+   }
+   return score;
+}
+
+/**
+ * @brief Memory type indices set in the environment for each memory_access, -1 where none is set.
+ */
+static const std::array<int, static_cast<uint32_t>(memory_access::count)> &get_memory_type_overrides()
+{
+   static const std::array<int, static_cast<uint32_t>(memory_access::count)> overrides = []() {
+      static const char *const names[] = { "WSI_MEMORY_TYPE_READBACK", "WSI_MEMORY_TYPE_UPLOAD",
+                                           "WSI_MEMORY_TYPE_SCANOUT", "WSI_MEMORY_TYPE_GPU_ONLY" };
+      static_assert(sizeof(names) / sizeof(names[0]) == static_cast<uint32_t>(memory_access::count),
+                    "Every memory access needs an override variable");
+
+      std::array<int, static_cast<uint32_t>(memory_access::count)> indices;
+      for (uint32_t i = 0; i < indices.size(); i++)
+      {
+         indices[i] = -1;
+         const char *env = std::getenv(names[i]);
+         if (env == nullptr || env[0] == '\0')
+         {
+            continue;
+         }
+         char *end = nullptr;
+         const long index = std::strtol(env, &end, 10);
+         if (*end == '\0' && index >= 0 && index < VK_MAX_MEMORY_TYPES)
+         {
+            indices[i] = static_cast<int>(index);
+         }
+      }
+      return indices;
+   }();
+   return overrides;
+}
+
+/**
+ * @brief Whether memory type @p index can be considered for an allocation.
+ */
+static bool is_memory_type_allowed(const VkPhysicalDeviceMemoryProperties &memory_props, uint32_t type_bits,
+                                   VkMemoryPropertyFlags required, uint32_t index)
+{
+   if (index >= memory_props.memoryTypeCount || (type_bits & (1u << index)) == 0)
+   {
+      return false;
+   }
+   const VkMemoryPropertyFlags flags = memory_props.memoryTypes[index].propertyFlags;
+   if ((flags & required) != required)
+   {
+      return false;
+   }
+   /* Protected memory only suits resources created for it. */
+   return (flags & VK_MEMORY_PROPERTY_PROTECTED_BIT) == 0 || (required & VK_MEMORY_PROPERTY_PROTECTED_BIT) != 0;
+}
+
+uint32_t select_memory_type(const VkPhysicalDeviceMemoryProperties &memory_props, uint32_t type_bits,
+                            memory_access access, VkMemoryPropertyFlags required)
+{
+   const int override_index = get_memory_type_overrides()[static_cast<uint32_t>(access)];
+   if (override_index >= 0 &&
+       is_memory_type_allowed(memory_props, type_bits, required, static_cast<uint32_t>(override_index)))
+   {
+      return static_cast<uint32_t>(override_index);
+   }
+
+   uint32_t best_index = VK_MAX_MEMORY_TYPES;
+   int best_score = -1;
+   for (uint32_t i = 0; i < memory_props.memoryTypeCount; i++)
+   {
+      if (!is_memory_type_allowed(memory_props, type_bits, required, i))
+      {
+         continue;
+      }
+      const int score = score_memory_type(access, memory_props.memoryTypes[i].propertyFlags);
+      if (score > best_score)
+      {
+         best_score = score;
+         best_index = i;
+      }
+   }
+   return best_index;
+}
+
+} /* namespace util */
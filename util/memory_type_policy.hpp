@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file memory_type_policy.hpp
+ *
+ * @brief Choice of the memory type of the layer's allocations from how they are accessed.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+namespace util
+{
+
+/**
+ * @brief How the memory of an allocation is accessed, which decides the memory type best suited to it.
+ */
+enum class memory_access : uint32_t
+{
+   /** Written by the GPU and read by the CPU, e.g. images copied into SHM segments. */
+   cpu_readback,
+   /** Written by the CPU and read by the GPU. */
+   cpu_upload,
+   /** Rendered to by the GPU and read by a display controller or compositor. */
+   scanout,
+   /** Only ever accessed by the GPU. */
+   gpu_only,
+   count,
+};
+
+/**
+ * @brief Rank a memory type for @p access, higher is better and negative is unusable.
+ */
+int score_memory_type(memory_access access, VkMemoryPropertyFlags flags);
+
+/**
+ * @brief Select the memory type best suited to @p access.
+ *
+ * Only memory types in @p type_bits that have all the @p required flags are considered, and protected memory is only
+ * considered when required. WSI_MEMORY_TYPE_READBACK, WSI_MEMORY_TYPE_UPLOAD, WSI_MEMORY_TYPE_SCANOUT and
+ * WSI_MEMORY_TYPE_GPU_ONLY can be set to the index of the memory type to use for each access, which overrides the
+ * scores as long as the type is one of the considered ones.
+ *
+ * @return The index of the memory type, VK_MAX_MEMORY_TYPES if none is usable.
+ */
+uint32_t select_memory_type(const VkPhysicalDeviceMemoryProperties &memory_props, uint32_t type_bits,
+                            memory_access access, VkMemoryPropertyFlags required = 0);
+
+} /* namespace util */
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file scratch_allocator.cpp
+ *
+ * @brief Implementation of the per thread scratch allocator.
+ */
+
+#include "scratch_allocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace util
+{
+
+/* Every block starts with a header holding its size, the largest fundamental alignment keeps the data aligned. */
+static constexpr size_t BLOCK_ALIGNMENT = alignof(std::max_align_t);
+static constexpr size_t HEADER_SIZE = BLOCK_ALIGNMENT;
+
+struct scratch_arena
+{
+   alignas(BLOCK_ALIGNMENT) unsigned char data[scratch_scope::BUFFER_SIZE];
+   size_t top = 0;
+   /* Innermost scope of the thread. Only it allocates from the buffer or moves its top, so the blocks of an outer
+    * scope never end up above the mark of an inner one. */
+   scratch_scope *active = nullptr;
+
+   bool owns(const void *memory) const
+   {
+      auto *bytes = static_cast<const unsigned char *>(memory);
+      return bytes >= data && bytes < data + sizeof(data);
+   }
+
+   static size_t &block_size(void *memory)
+   {
+      return *reinterpret_cast<size_t *>(static_cast<unsigned char *>(memory) - HEADER_SIZE);
+   }
+
+   /* Whether @p memory is the last block allocated, which can be grown or released in place. */
+   bool is_last(void *memory) const
+   {
+      const size_t start = static_cast<size_t>(static_cast<unsigned char *>(memory) - data);
+      return start + round_up(block_size(memory)) == top;
+   }
+
+   static size_t round_up(size_t size)
+   {
+      return (size + BLOCK_ALIGNMENT - 1) & ~(BLOCK_ALIGNMENT - 1);
+   }
+};
+
+static thread_local scratch_arena g_arena;
+
+scratch_scope::scratch_scope(const allocator &parent)
+   : m_parent(parent)
+   , m_allocator(parent)
+   , m_arena(nullptr)
+   , m_previous(nullptr)
+   , m_mark(0)
+{
+   if (parent.get_original_callbacks() != nullptr)
+   {
+      return;
+   }
+
+   m_arena = &g_arena;
+   m_mark = m_arena->top;
+   m_previous = m_arena->active;
+   m_arena->active = this;
+
+   VkAllocationCallbacks callbacks = {};
+   callbacks.pUserData = this;
+   callbacks.pfnAllocation = allocate;
+   callbacks.pfnReallocation = reallocate;
+   callbacks.pfnFree = free;
+   m_allocator = allocator(VK_SYSTEM_ALLOCATION_SCOPE_COMMAND, &callbacks);
+   m_allocator.m_accounting = parent.m_accounting;
+}
+
+scratch_scope::~scratch_scope()
+{
+   if (m_arena != nullptr)
+   {
+      assert(m_arena->active == this);
+      m_arena->top = m_mark;
+      m_arena->active = m_previous;
+   }
+}
+
+void *scratch_scope::allocate(void *user_data, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+   auto *self = static_cast<scratch_scope *>(user_data);
+   scratch_arena &arena = *self->m_arena;
+
+   const size_t block = HEADER_SIZE + scratch_arena::round_up(size);
+   if (arena.active != self || alignment > BLOCK_ALIGNMENT || size > sizeof(arena.data) ||
+       block > sizeof(arena.data) - arena.top)
+   {
+      auto &cb = self->m_parent.m_callbacks;
+      return cb.pfnAllocation(cb.pUserData, size, alignment, scope);
+   }
+
+   void *memory = arena.data + arena.top + HEADER_SIZE;
+   scratch_arena::block_size(memory) = size;
+   arena.top += block;
+   return memory;
+}
+
+void *scratch_scope::reallocate(void *user_data, void *original, size_t size, size_t alignment,
+                                VkSystemAllocationScope scope)
+{
+   auto *self = static_cast<scratch_scope *>(user_data);
+   scratch_arena &arena = *self->m_arena;
+
+   if (original == nullptr)
+   {
+      return allocate(user_data, size, alignment, scope);
+   }
+   if (!arena.owns(original))
+   {
+      auto &cb = self->m_parent.m_callbacks;
+      return cb.pfnReallocation(cb.pUserData, original, size, alignment, scope);
+   }
+
+   const size_t old_size = scratch_arena::block_size(original);
+   if (arena.active == self && arena.is_last(original))
+   {
+      const size_t start = static_cast<size_t>(static_cast<unsigned char *>(original) - arena.data);
+      if (size <= sizeof(arena.data) - start)
+      {
+         scratch_arena::block_size(original) = size;
+         arena.top = start + scratch_arena::round_up(size);
+         return original;
+      }
+   }
+
+   void *memory = allocate(user_data, size, alignment, scope);
+   if (memory != nullptr)
+   {
+      std::memcpy(memory, original, std::min(old_size, size));
+      free(user_data, original);
+   }
+   return memory;
+}
+
+void scratch_scope::free(void *user_data, void *memory)
+{
+   auto *self = static_cast<scratch_scope *>(user_data);
+   scratch_arena &arena = *self->m_arena;
+
+   if (memory == nullptr)
+   {
+      return;
+   }
+   if (!arena.owns(memory))
+   {
+      auto &cb = self->m_parent.m_callbacks;
+      cb.pfnFree(cb.pUserData, memory);
+      return;
+   }
+
+   /* Blocks freed out of order are only released with the scope. */
+   if (arena.active == self && arena.is_last(memory))
+   {
+      arena.top = static_cast<size_t>(static_cast<unsigned char *>(memory) - arena.data) - HEADER_SIZE;
+   }
+}
+
+} /* namespace util */
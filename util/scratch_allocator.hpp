@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file scratch_allocator.hpp
+ *
+ * @brief Per thread bump allocator for the temporaries of a single call.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include "custom_allocator.hpp"
+#include "helpers.hpp"
+
+namespace util
+{
+
+struct scratch_arena;
+
+/**
+ * @brief Scope of the COMMAND temporaries of a call, allocated from a per thread scratch buffer.
+ *
+ * The scope marks the top of the scratch buffer of the calling thread, and everything allocated from it is released
+ * at once when the scope ends. get_allocator() returns a util::allocator bumping from the buffer, so the util::vectors
+ * a call builds and throws away do not reach the heap. Requests that do not fit, or that need a larger alignment, go to
+ * the parent allocator instead.
+ *
+ * When the parent has callbacks provided by the application, get_allocator() returns them unchanged: the
+ * application is told about every allocation of the layer.
+ *
+ * Containers using the allocator must be destroyed before the scope, on the thread that created it.
+ */
+class scratch_scope : private noncopyable
+{
+public:
+   /**
+    * @brief Size of the scratch buffer of each thread.
+    */
+   static constexpr size_t BUFFER_SIZE = 16 * 1024;
+
+   explicit scratch_scope(const allocator &parent);
+   ~scratch_scope();
+
+   const allocator &get_allocator() const
+   {
+      return m_allocator;
+   }
+
+private:
+   allocator m_parent;
+   allocator m_allocator;
+   /* Scratch buffer of the thread, nullptr when the parent callbacks are used. */
+   scratch_arena *m_arena;
+   /* Scope that was innermost on the thread before this one. */
+   scratch_scope *m_previous;
+   /* Top of the scratch buffer when the scope started. */
+   size_t m_mark;
+
+   static VKAPI_ATTR void *VKAPI_CALL allocate(void *user_data, size_t size, size_t alignment,
+                                               VkSystemAllocationScope scope);
+   static VKAPI_ATTR void *VKAPI_CALL reallocate(void *user_data, void *original, size_t size, size_t alignment,
+                                                 VkSystemAllocationScope scope);
+   static VKAPI_ATTR void VKAPI_CALL free(void *user_data, void *memory);
+};
+
+} /* namespace util */
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file spsc_ring.hpp
+ *
+ * @brief Contains a wait-free single-producer/single-consumer ring with a futex based wait.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <optional>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <vulkan/vulkan.h>
+
+namespace util
+{
+
+/**
+ * @brief Smallest power of two not lower than @p value.
+ */
+constexpr std::size_t next_power_of_two(std::size_t value)
+{
+   std::size_t result = 1;
+   while (result < value)
+   {
+      result <<= 1;
+   }
+   return result;
+}
+
+/**
+ * @brief Ring buffer handing items from one producer thread to one consumer thread.
+ *
+ * Pushing and popping never take a lock: each side only writes its own index, and the indices are free running
+ * counters masked with the power of two capacity. The consumer can block in @ref wait, which sleeps on a futex
+ * bumped by every push and by @ref close. The producer only makes the wake system call when the consumer is asleep.
+ *
+ * @tparam T Item type, copied in and out of the ring.
+ * @tparam N Capacity, a power of two.
+ */
+template <typename T, std::size_t N>
+class spsc_ring
+{
+   static_assert(N > 0 && (N & (N - 1)) == 0, "spsc_ring capacity must be a power of two");
+   static_assert(N <= std::numeric_limits<uint32_t>::max() / 2, "spsc_ring capacity does not fit the indices");
+
+public:
+   constexpr std::size_t capacity() const
+   {
+      return N;
+   }
+
+   /**
+    * @brief Append @p item. Producer only.
+    *
+    * @return false when the ring is full.
+    */
+   bool push(const T &item)
+   {
+      const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+      if (tail - m_head.load(std::memory_order_acquire) == N)
+      {
+         return false;
+      }
+
+      m_data[tail & (N - 1)] = item;
+
+      m_tail.store(tail + 1, std::memory_order_release);
+
+      /* Sequentially consistent with the load of m_waiting, see wait. */
+      m_signal.fetch_add(1, std::memory_order_seq_cst);
+      if (m_waiting.load(std::memory_order_seq_cst))
+      {
+         wake_consumer();
+      }
+      return true;
+   }
+
+   /**
+    * @brief Make the current and every later @ref wait return without sleeping. Any thread.
+    */
+   void close()
+   {
+      m_closed.store(true, std::memory_order_seq_cst);
+      m_signal.fetch_add(1, std::memory_order_seq_cst);
+      wake_consumer();
+   }
+
+   /**
+    * @brief Take the oldest item. Consumer only.
+    */
+   std::optional<T> pop()
+   {
+      const uint32_t head = m_head.load(std::memory_order_relaxed);
+      if (head == m_tail.load(std::memory_order_acquire))
+      {
+         return std::nullopt;
+      }
+
+      std::optional<T> item = m_data[head & (N - 1)];
+      m_head.store(head + 1, std::memory_order_release);
+      return item;
+   }
+
+   /**
+    * @brief Whether the ring holds no item. Exact on the consumer side only.
+    */
+   bool empty() const
+   {
+      return m_head.load(std::memory_order_relaxed) == m_tail.load(std::memory_order_acquire);
+   }
+
+   /**
+    * @brief Wait until the ring holds an item. Consumer only.
+    *
+    * @param timeout Time to wait (ns). 0 doesn't block, UINT64_MAX waits indefinitely.
+    * @retval VK_SUCCESS an item can be popped
+    * @retval VK_NOT_READY timeout was zero and the ring is empty
+    * @retval VK_TIMEOUT the ring is still empty: the timeout was reached, the wait was interrupted or the ring
+    *                    is closed
+    */
+   VkResult wait(uint64_t timeout)
+   {
+      const uint32_t head = m_head.load(std::memory_order_relaxed);
+      if (head != m_tail.load(std::memory_order_acquire))
+      {
+         return VK_SUCCESS;
+      }
+      if (timeout == 0)
+      {
+         return VK_NOT_READY;
+      }
+
+      m_waiting.store(true, std::memory_order_seq_cst);
+
+      /* A push or close after this load changes m_signal, which makes FUTEX_WAIT return at once. */
+      const uint32_t signal = m_signal.load(std::memory_order_seq_cst);
+      if (head == m_tail.load(std::memory_order_acquire) && !m_closed.load(std::memory_order_seq_cst))
+      {
+         timespec relative = {};
+         relative.tv_sec = static_cast<time_t>(timeout / 1000000000ull);
+         relative.tv_nsec = static_cast<long>(timeout % 1000000000ull);
+         syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_signal), FUTEX_WAIT_PRIVATE, signal,
+                 timeout == UINT64_MAX ? nullptr : &relative, nullptr, 0);
+      }
+
+      m_waiting.store(false, std::memory_order_relaxed);
+      return (head != m_tail.load(std::memory_order_acquire)) ? VK_SUCCESS : VK_TIMEOUT;
+   }
+
+private:
+   void wake_consumer()
+   {
+      syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_signal), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+   }
+
+   static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free,
+                 "futex words must be plain 32-bit integers");
+
+   T m_data[N]{};
+
+   /* Written by the consumer only. Kept on its own cache line so the two sides do not false share. */
+   alignas(64) std::atomic<uint32_t> m_head{ 0 };
+
+   /* Written by the producer only. */
+   alignas(64) std::atomic<uint32_t> m_tail{ 0 };
+
+   /* Futex word the consumer sleeps on, bumped after every change the consumer waits for. */
+   std::atomic<uint32_t> m_signal{ 0 };
+   std::atomic<bool> m_closed{ false };
+
+   /* Set by the consumer while it may be asleep in FUTEX_WAIT. */
+   std::atomic<bool> m_waiting{ false };
+};
+
+} /* namespace util */
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file string_hash.hpp
+ *
+ * @brief Hash of strings that can be evaluated at compile time.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace util
+{
+
+/**
+ * @brief 32-bit FNV-1a hash of a NUL terminated string.
+ *
+ * Being constexpr, the hash of a string literal can be used as a case label, so a switch over the hash of a name does
+ * the work of a chain of strcmp calls. Two labels with the same hash fail to compile, which makes the hash perfect
+ * for the set of names of the switch. Names outside the set can still collide with one of them, so a match has to be
+ * confirmed with a string comparison.
+ */
+constexpr uint32_t string_hash(const char *str)
+{
+   uint32_t hash = 2166136261u;
+   for (; *str != '\0'; str++)
+   {
+      hash ^= static_cast<uint8_t>(*str);
+      hash *= 16777619u;
+   }
+   return hash;
+}
+
+} /* namespace util */
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file thread_scheduling.cpp
+ *
+ * @brief Implementation of the presentation thread scheduling controls.
+ */
+
+#include "thread_scheduling.hpp"
+#include "log.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace util
+{
+
+/* Priority used by "fifo" without an explicit value, the lowest real-time priority. */
+static constexpr int DEFAULT_FIFO_PRIORITY = 1;
+
+/* Nice value tried when SCHED_FIFO is denied. */
+static constexpr int FALLBACK_NICE = -10;
+
+/* Longest thread name pthread_setname_np accepts, without the terminator. */
+static constexpr size_t MAX_THREAD_NAME = 15;
+
+/**
+ * @brief Scheduling configuration parsed from the environment.
+ */
+struct thread_scheduling_config
+{
+   bool fifo = false;
+   int fifo_priority = DEFAULT_FIFO_PRIORITY;
+   bool nice = false;
+   int nice_value = 0;
+
+   bool affinity = false;
+   cpu_set_t cpus;
+
+   thread_scheduling_config()
+   {
+      CPU_ZERO(&cpus);
+      parse_priority(std::getenv("WSI_PRESENT_THREAD_PRIORITY"));
+      parse_affinity(std::getenv("WSI_PRESENT_THREAD_AFFINITY"));
+   }
+
+   void parse_priority(const char *env)
+   {
+      if (env == nullptr || env[0] == '\0')
+      {
+         return;
+      }
+
+      if (std::strncmp(env, "fifo", 4) == 0 && (env[4] == '\0' || env[4] == ':'))
+      {
+         fifo = true;
+         if (env[4] == ':')
+         {
+            fifo_priority = static_cast<int>(std::strtol(env + 5, nullptr, 10));
+         }
+
+         const int min_priority = sched_get_priority_min(SCHED_FIFO);
+         const int max_priority = sched_get_priority_max(SCHED_FIFO);
+         if (fifo_priority < min_priority || fifo_priority > max_priority)
+         {
+            WSI_LOG_WARNING("SCHED_FIFO priority %d out of range [%d, %d], using %d", fifo_priority, min_priority,
+                            max_priority, DEFAULT_FIFO_PRIORITY);
+            fifo_priority = DEFAULT_FIFO_PRIORITY;
+         }
+      }
+      else if (std::strncmp(env, "nice:", 5) == 0)
+      {
+         nice = true;
+         nice_value = static_cast<int>(std::strtol(env + 5, nullptr, 10));
+      }
+      else
+      {
+         WSI_LOG_WARNING("Unknown WSI_PRESENT_THREAD_PRIORITY value '%s', expected fifo[:<priority>] or nice:<value>",
+                         env);
+      }
+   }
+
+   void parse_affinity(const char *env)
+   {
+      if (env == nullptr || env[0] == '\0')
+      {
+         return;
+      }
+
+      const char *cursor = env;
+      while (*cursor != '\0')
+      {
+         char *end = nullptr;
+         const long first = std::strtol(cursor, &end, 10);
+         long last = first;
+         if (end == cursor)
+         {
+            break;
+         }
+         if (*end == '-')
+         {
+            cursor = end + 1;
+            last = std::strtol(cursor, &end, 10);
+            if (end == cursor)
+            {
+               break;
+            }
+         }
+
+         for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+         {
+            if (cpu >= 0)
+            {
+               CPU_SET(static_cast<int>(cpu), &cpus);
+            }
+         }
+
+         cursor = end;
+         if (*cursor == ',')
+         {
+            cursor++;
+         }
+         else if (*cursor != '\0')
+         {
+            break;
+         }
+      }
+
+      if (*cursor != '\0' || CPU_COUNT(&cpus) == 0)
+      {
+         WSI_LOG_WARNING("Invalid WSI_PRESENT_THREAD_AFFINITY value '%s', expected a CPU list such as 4-7", env);
+         CPU_ZERO(&cpus);
+         return;
+      }
+      affinity = true;
+   }
+};
+
+static bool set_thread_nice(int value)
+{
+   /* On Linux the nice value is per thread when set through the thread id. */
+   const id_t tid = static_cast<id_t>(syscall(SYS_gettid));
+   return setpriority(PRIO_PROCESS, tid, value) == 0;
+}
+
+static const thread_scheduling_config &get_config()
+{
+   static const thread_scheduling_config config;
+   return config;
+}
+
+bool get_presentation_thread_affinity(cpu_set_t &cpus)
+{
+   const thread_scheduling_config &config = get_config();
+   if (!config.affinity)
+   {
+      return false;
+   }
+   cpus = config.cpus;
+   return true;
+}
+
+void configure_presentation_thread(const char *name)
+{
+   const thread_scheduling_config &config = get_config();
+
+   /* Report each kind of failure once, not for every thread of every swapchain. */
+   static std::atomic<bool> priority_warned{ false };
+   static std::atomic<bool> affinity_warned{ false };
+
+   char thread_name[MAX_THREAD_NAME + 1] = {};
+   std::strncpy(thread_name, name, MAX_THREAD_NAME);
+   pthread_setname_np(pthread_self(), thread_name);
+
+   if (config.fifo)
+   {
+      sched_param param = {};
+      param.sched_priority = config.fifo_priority;
+      const int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+      if (result != 0)
+      {
+         /* Without CAP_SYS_NICE or an RLIMIT_RTPRIO allowance, raise the thread as far as RLIMIT_NICE allows. */
+         const bool boosted = set_thread_nice(FALLBACK_NICE);
+         if (!priority_warned.exchange(true))
+         {
+            WSI_LOG_WARNING("SCHED_FIFO denied for presentation threads (error %d), %s", result,
+                            boosted ? "using a nice boost instead" : "keeping the default priority");
+         }
+      }
+   }
+   else if (config.nice && !set_thread_nice(config.nice_value) && !priority_warned.exchange(true))
+   {
+      WSI_LOG_WARNING("Failed to set nice %d on presentation threads: errno=%d", config.nice_value, errno);
+   }
+
+   if (config.affinity)
+   {
+      const int result = pthread_setaffinity_np(pthread_self(), sizeof(config.cpus), &config.cpus);
+      if (result != 0 && !affinity_warned.exchange(true))
+      {
+         WSI_LOG_WARNING("Failed to set the CPU affinity of presentation threads: error %d", result);
+      }
+   }
+}
+
+} /* namespace util */
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file thread_scheduling.hpp
+ *
+ * @brief Scheduling policy and CPU affinity of the threads the layer presents from.
+ */
+
+#pragma once
+
+#include <sched.h>
+
+namespace util
+{
+
+/**
+ * @brief Name the calling thread and apply the configured presentation thread scheduling to it.
+ *
+ * The configuration is read once from the environment:
+ * - WSI_PRESENT_THREAD_PRIORITY: "fifo" or "fifo:<priority>" runs the thread with SCHED_FIFO, falling back to
+ *   a nice boost when real-time scheduling is denied. "nice:<value>" only
+ *   sets the nice value, e.g. "nice:-10".
+ * - WSI_PRESENT_THREAD_AFFINITY: CPUs the thread may run on, as a list of indices and ranges such as "4-7" to
+ *   keep it on the big cores.
+ *
+ * Failures are logged and leave the thread with its default scheduling.
+ *
+ * @param name Thread name shown by debuggers and profilers, truncated to 15 characters.
+ */
+void configure_presentation_thread(const char *name);
+
+/**
+ * @brief Get the CPUs set with WSI_PRESENT_THREAD_AFFINITY, for helper threads pinned within them.
+ *
+ * @return false when no affinity is configured, @p cpus is left unchanged then.
+ */
+bool get_presentation_thread_affinity(cpu_set_t &cpus);
+
+} /* namespace util */
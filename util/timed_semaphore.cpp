@@ -22,149 +22,178 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include "timed_semaphore.hpp"
 
 namespace util
 {
 
-VkResult timed_semaphore::init(unsigned count)
-{
-   int res;
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free,
+              "The semaphore count is used as a futex word");
 
-   m_count = count;
+/* Spins every wait may take, and the most an adaptive spin may grow to. */
+static constexpr uint32_t MIN_SPINS = 16;
+static constexpr uint32_t MAX_SPINS = 2048;
 
-   pthread_condattr_t attr;
-   res = pthread_condattr_init(&attr);
-   /* the only failure that can occur is ENOMEM */
-   assert(res == 0 || res == ENOMEM);
-   if (res != 0)
-   {
-      return VK_ERROR_OUT_OF_HOST_MEMORY;
-   }
-
-   res = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
-   /* only programming error can cause _setclock to fail */
-   assert(res == 0);
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+   __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+   __asm__ volatile("yield");
+#endif
+}
 
-   res = pthread_cond_init(&m_cond, &attr);
-   /* the only failure that can occur that is not programming error is ENOMEM */
-   assert(res == 0 || res == ENOMEM);
-   if (res != 0)
+/**
+ * @brief Sleep while @p word holds @p expected, until @p deadline on CLOCK_MONOTONIC or forever if nullptr.
+ *
+ * @return 0 when woken up or the word changed, ETIMEDOUT once the deadline passed.
+ */
+static int futex_wait(std::atomic<uint32_t> &word, uint32_t expected, const struct timespec *deadline)
+{
+   /* FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC deadline, unlike FUTEX_WAIT. */
+   const long res = syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG,
+                            expected, deadline, nullptr, FUTEX_BITSET_MATCH_ANY);
+   if (res != 0 && errno == ETIMEDOUT)
    {
-      res = pthread_condattr_destroy(&attr);
-      assert(res == 0);
-      return VK_ERROR_OUT_OF_HOST_MEMORY;
+      return ETIMEDOUT;
    }
+   /* EAGAIN, the word changed before sleeping, and EINTR are retried by the caller. */
+   return 0;
+}
 
-   res = pthread_condattr_destroy(&attr);
-   /* only programming error can cause _destroy to fail */
-   assert(res == 0);
+static void futex_wake(std::atomic<uint32_t> &word, int count)
+{
+   syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE | FUTEX_PRIVATE_FLAG, count, nullptr, nullptr,
+           0);
+}
 
-   res = pthread_mutex_init(&m_mutex, nullptr);
-   /* only programming errors can result in failure */
-   assert(res == 0);
+VkResult timed_semaphore::init(unsigned count)
+{
+   m_count.store(count, std::memory_order_relaxed);
+   m_waiters.store(0, std::memory_order_relaxed);
+   m_spin_estimate.store(0, std::memory_order_relaxed);
 
    initialized = true;
 
    return VK_SUCCESS;
 }
 
-timed_semaphore::~timed_semaphore()
+bool timed_semaphore::try_take()
 {
-   int res;
-   (void)res; /* unused when NDEBUG */
-
-   if (initialized)
+   uint32_t count = m_count.load(std::memory_order_relaxed);
+   while (count > 0)
    {
-      res = pthread_cond_destroy(&m_cond);
-      assert(res == 0); /* only programming error (EBUSY, EINVAL) */
+      if (m_count.compare_exchange_weak(count, count - 1, std::memory_order_acquire, std::memory_order_relaxed))
+      {
+         return true;
+      }
+   }
+   return false;
+}
 
-      res = pthread_mutex_destroy(&m_mutex);
-      assert(res == 0); /* only programming error (EBUSY, EINVAL) */
+bool timed_semaphore::spin_take()
+{
+   const uint32_t estimate = m_spin_estimate.load(std::memory_order_relaxed);
+   const uint32_t limit = std::min(MAX_SPINS, 2 * estimate + MIN_SPINS);
+
+   uint32_t spins = 0;
+   bool taken = false;
+   for (; spins < limit; spins++)
+   {
+      cpu_relax();
+      if (m_count.load(std::memory_order_relaxed) > 0 && try_take())
+      {
+         taken = true;
+         break;
+      }
    }
+
+   /* Move the estimate an eighth of the way towards this wait. Failed spins pull it towards 0, so semaphores that
+    * are rarely posted soon after the wait, e.g. while a frame renders, only spin for MIN_SPINS. */
+   const int32_t sample = taken ? static_cast<int32_t>(spins) : 0;
+   const int32_t delta = (sample - static_cast<int32_t>(estimate)) / 8;
+   m_spin_estimate.store(static_cast<uint32_t>(static_cast<int32_t>(estimate) + delta), std::memory_order_relaxed);
+   return taken;
 }
 
 VkResult timed_semaphore::wait(uint64_t timeout)
 {
-   VkResult retval = VK_SUCCESS;
-   int res;
-
    assert(initialized);
 
-   res = pthread_mutex_lock(&m_mutex);
-   assert(res == 0); /* only fails with programming error (EINVAL) */
+   if (try_take())
+   {
+      return VK_SUCCESS;
+   }
+   if (timeout == 0)
+   {
+      return VK_NOT_READY;
+   }
+   if (spin_take())
+   {
+      return VK_SUCCESS;
+   }
 
-   if (m_count == 0)
+   struct timespec end = {};
+   const struct timespec *deadline = nullptr;
+   if (timeout != UINT64_MAX)
    {
-      switch (timeout)
+      struct timespec now = {};
+      int res = clock_gettime(CLOCK_MONOTONIC, &now);
+      assert(res == 0); /* only fails with programming error (EINVAL, EFAULT, EPERM) */
+      (void)res;
+
+      const uint64_t seconds = timeout / (1000 * 1000 * 1000);
+      /* add the timeout to now, handling overflow */
+      end.tv_sec = seconds > static_cast<uint64_t>(LONG_MAX - now.tv_sec) ? LONG_MAX :
+                                                                            now.tv_sec + static_cast<time_t>(seconds);
+      end.tv_nsec = now.tv_nsec + static_cast<long>(timeout % (1000 * 1000 * 1000));
+      if (end.tv_nsec >= 1000 * 1000 * 1000 && end.tv_sec != LONG_MAX)
       {
-      case 0:
-         retval = VK_NOT_READY;
-         break;
-      case UINT64_MAX:
-         res = pthread_cond_wait(&m_cond, &m_mutex);
-         assert(res == 0); /* only fails with programming error (EINVAL) */
-
-         break;
-      default:
-         struct timespec diff = { /* narrowing casts */
-                                  static_cast<time_t>(timeout / (1000 * 1000 * 1000)),
-                                  static_cast<long>(timeout % (1000 * 1000 * 1000))
-         };
-
-         struct timespec now = {};
-         res = clock_gettime(CLOCK_MONOTONIC, &now);
-         assert(res == 0); /* only fails with programming error (EINVAL, EFAULT, EPERM) */
-
-         /* add diff to now, handling overflow */
-         struct timespec end = { now.tv_sec + diff.tv_sec, now.tv_nsec + diff.tv_nsec };
-
-         if (end.tv_nsec >= 1000 * 1000 * 1000)
-         {
-            end.tv_nsec -= 1000 * 1000 * 1000;
-            end.tv_sec++;
-         }
-
-         res = pthread_cond_timedwait(&m_cond, &m_mutex, &end);
-         /* only fails with programming error, other than timeout */
-         assert(res == 0 || res == ETIMEDOUT);
-         if (res != 0)
-         {
-            retval = VK_TIMEOUT;
-         }
+         end.tv_nsec -= 1000 * 1000 * 1000;
+         end.tv_sec++;
       }
+      else if (end.tv_nsec >= 1000 * 1000 * 1000)
+      {
+         end.tv_nsec = 1000 * 1000 * 1000 - 1;
+      }
+      deadline = &end;
    }
-   if (retval == VK_SUCCESS)
+
+   /* Registering as a waiter before the last check pairs with post incrementing the count before checking for
+    * waiters, one of the two sees the other. */
+   m_waiters.fetch_add(1, std::memory_order_seq_cst);
+   VkResult retval = VK_SUCCESS;
+   while (!try_take())
    {
-      assert(m_count > 0);
-      m_count--;
+      if (futex_wait(m_count, 0, deadline) == ETIMEDOUT)
+      {
+         retval = try_take() ? VK_SUCCESS : VK_TIMEOUT;
+         break;
+      }
    }
-   res = pthread_mutex_unlock(&m_mutex);
-   assert(res == 0); /* only fails with programming error (EPERM) */
+   m_waiters.fetch_sub(1, std::memory_order_relaxed);
 
    return retval;
 }
 
 void timed_semaphore::post()
 {
-   int res;
-   (void)res; /* unused when NDEBUG */
-
    assert(initialized);
 
-   res = pthread_mutex_lock(&m_mutex);
-   assert(res == 0); /* only fails with programming error (EINVAL) */
-
-   m_count++;
-
-   res = pthread_cond_signal(&m_cond);
-   assert(res == 0); /* only fails with programming error (EINVAL) */
-
-   res = pthread_mutex_unlock(&m_mutex);
-   assert(res == 0); /* only fails with programming error (EPERM) */
+   m_count.fetch_add(1, std::memory_order_seq_cst);
+   if (m_waiters.load(std::memory_order_seq_cst) > 0)
+   {
+      futex_wake(m_count, 1);
+   }
 }
 
 } /* namespace util */
@@ -32,16 +32,16 @@
  * as the system time may change, resulting in an incorrect timeout period
  * (potentially by a significant amount).
  *
- * We therefore have to re-engineer semaphores using condition variables.
+ * We therefore re-engineer semaphores on top of a futex, waiting with
+ * CLOCK_MONOTONIC deadlines.
  *
  * This code does not use the C++ standard library to avoid exceptions.
  */
 
 #pragma once
 
-extern "C" {
-#include <pthread.h>
-}
+#include <atomic>
+#include <cstdint>
 
 #include <vulkan/vulkan.h>
 #include "helpers.hpp"
@@ -52,19 +52,14 @@ namespace util
 /**
  * brief semaphore with a safe relative timed wait
  *
- * sem_timedwait takes an absolute time, based on CLOCK_REALTIME. Simply
- * taking the current time and adding on a relative timeout is not correct,
- * as the system time may change, resulting in an incorrect timeout period
- * (potentially by a significant amount).
- *
- * We therefore have to re-engineer semaphores using condition variables.
- *
- * This code does not use the C++ standard library to avoid exceptions.
+ * The count is an atomic, so posts and waits that do not block stay in user space. A wait that finds the count at
+ * 0 first spins for a while, which catches the post of a thread running on another CPU, before sleeping on a
+ * futex. The spin length adapts to how often spinning succeeded recently.
  */
 class timed_semaphore : private noncopyable
 {
 public:
-   ~timed_semaphore();
+   ~timed_semaphore() = default;
    timed_semaphore()
       : initialized(false){};
 
@@ -72,7 +67,6 @@ public:
     * @brief initializes the semaphore
     *
     * @param count initial value of the semaphore
-    * @retval VK_ERROR_OUT_OF_HOST_MEMORY out of memory condition from pthread calls
     * @retval VK_SUCCESS on success
     */
    VkResult init(unsigned count);
@@ -93,19 +87,32 @@ public:
    void post();
 
 private:
+   /**
+    * @brief Decrement the count if it is not 0.
+    */
+   bool try_take();
+
+   /**
+    * @brief Spin trying to take the count, for up to the adaptive spin limit.
+    */
+   bool spin_take();
+
    /**
     * @brief true if the semaphore has been initialized
-    *
-    * Determines if the destructor should cleanup the mutex and cond.
     */
    bool initialized;
    /**
-    * @brief semaphore value
+    * @brief semaphore value, also the futex word
     */
-   unsigned m_count;
-
-   pthread_mutex_t m_mutex;
-   pthread_cond_t m_cond;
+   std::atomic<uint32_t> m_count{ 0 };
+   /**
+    * @brief number of threads sleeping, or about to sleep, on the futex
+    */
+   std::atomic<uint32_t> m_waiters{ 0 };
+   /**
+    * @brief average number of spins recent waits needed, see @ref spin_take
+    */
+   std::atomic<uint32_t> m_spin_estimate{ 0 };
 };
 
 } /* namespace util */
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "trace.hpp"
+
+#if WSI_ENABLE_TRACING
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace util
+{
+namespace trace
+{
+
+/* Longest event written, longer names are truncated. */
+static constexpr size_t MAX_EVENT_LENGTH = 128;
+
+static int g_marker_fd = -1;
+static int g_pid = 0;
+
+int open_marker()
+{
+   /* tracefs is mounted on its own or under debugfs depending on the system. */
+   for (const char *path : { "/sys/kernel/tracing/trace_marker", "/sys/kernel/debug/tracing/trace_marker" })
+   {
+      g_marker_fd = open(path, O_WRONLY | O_CLOEXEC);
+      if (g_marker_fd >= 0)
+      {
+         break;
+      }
+   }
+   g_pid = static_cast<int>(getpid());
+   return g_marker_fd;
+}
+
+static void write_event(const char *event, int length)
+{
+   if (length <= 0)
+   {
+      return;
+   }
+   const size_t size = std::min(static_cast<size_t>(length), MAX_EVENT_LENGTH - 1);
+   /* A single write is a single ftrace event. Failures are ignored, tracing must not disturb presentation. */
+   ssize_t res = write(g_marker_fd, event, size);
+   (void)res;
+}
+
+void begin(const char *name, uint64_t id)
+{
+   char event[MAX_EVENT_LENGTH];
+   const int length = (id != 0) ? std::snprintf(event, sizeof(event), "B|%d|%s %" PRIu64, g_pid, name, id)
+                                : std::snprintf(event, sizeof(event), "B|%d|%s", g_pid, name);
+   write_event(event, length);
+}
+
+void end()
+{
+   char event[MAX_EVENT_LENGTH];
+   write_event(event, std::snprintf(event, sizeof(event), "E|%d", g_pid));
+}
+
+void async_begin(const char *name, uint64_t cookie)
+{
+   char event[MAX_EVENT_LENGTH];
+   write_event(event, std::snprintf(event, sizeof(event), "S|%d|%s|%" PRIu64, g_pid, name, cookie));
+}
+
+void async_end(const char *name, uint64_t cookie)
+{
+   char event[MAX_EVENT_LENGTH];
+   write_event(event, std::snprintf(event, sizeof(event), "F|%d|%s|%" PRIu64, g_pid, name, cookie));
+}
+
+} /* namespace trace */
+} /* namespace util */
+
+#endif
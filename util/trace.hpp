@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file trace.hpp
+ *
+ * @brief Trace points of the presentation pipeline, written to the ftrace trace_marker.
+ *
+ * The events use the atrace text format, which Perfetto and systrace decode from the ftrace print events, so layer
+ * activity lines up with the GPU and compositor tracks captured in the same trace. The trace points are compiled in
+ * with the ENABLE_TRACING build option, and cost a load and a branch at run time when trace_marker cannot be opened.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace util
+{
+namespace trace
+{
+
+#if WSI_ENABLE_TRACING
+
+/**
+ * @brief File descriptor of trace_marker, opened on first use, or -1 when it is not writable.
+ */
+int open_marker();
+
+inline bool is_enabled()
+{
+   static const int marker_fd = open_marker();
+   return marker_fd >= 0;
+}
+
+/**
+ * @brief Start a slice on the track of the calling thread.
+ *
+ * @param id Appended to the name when not 0, e.g. the present ID of the frame the slice works on.
+ */
+void begin(const char *name, uint64_t id);
+
+/**
+ * @brief End the last slice started on the calling thread.
+ */
+void end();
+
+/**
+ * @brief Start an asynchronous slice, which may end on another thread.
+ *
+ * Slices with the same name and @p cookie pair up, so the stages of a frame can be followed across the threads of
+ * the layer with its present ID as the cookie.
+ */
+void async_begin(const char *name, uint64_t cookie);
+
+/**
+ * @brief End the asynchronous slice started with the same name and @p cookie.
+ */
+void async_end(const char *name, uint64_t cookie);
+
+/**
+ * @brief Slice lasting for the scope of the object.
+ */
+class scope
+{
+public:
+   scope(const char *name, uint64_t id)
+      : m_active(is_enabled())
+   {
+      if (m_active)
+      {
+         begin(name, id);
+      }
+   }
+
+   ~scope()
+   {
+      if (m_active)
+      {
+         end();
+      }
+   }
+
+   scope(const scope &) = delete;
+   scope &operator=(const scope &) = delete;
+
+private:
+   bool m_active;
+};
+
+#define WSI_TRACE_CONCAT_IMPL(a, b) a##b
+#define WSI_TRACE_CONCAT(a, b) WSI_TRACE_CONCAT_IMPL(a, b)
+
+#define WSI_TRACE_SCOPE(name) ::util::trace::scope WSI_TRACE_CONCAT(wsi_trace_scope_, __LINE__)(name, 0)
+#define WSI_TRACE_SCOPE_ID(name, id) ::util::trace::scope WSI_TRACE_CONCAT(wsi_trace_scope_, __LINE__)(name, id)
+
+#define WSI_TRACE_ASYNC_BEGIN(name, cookie)             \
+   do                                                   \
+   {                                                    \
+      if (::util::trace::is_enabled() && (cookie) != 0) \
+      {                                                 \
+         ::util::trace::async_begin(name, cookie);      \
+      }                                                 \
+   } while (0)
+
+#define WSI_TRACE_ASYNC_END(name, cookie)               \
+   do                                                   \
+   {                                                    \
+      if (::util::trace::is_enabled() && (cookie) != 0) \
+      {                                                 \
+         ::util::trace::async_end(name, cookie);        \
+      }                                                 \
+   } while (0)
+
+#else
+
+/* The arguments are not evaluated, sizeof only keeps variables passed to the trace points from being unused. */
+#define WSI_TRACE_SCOPE(name)
+#define WSI_TRACE_SCOPE_ID(name, id) static_cast<void>(sizeof(id))
+#define WSI_TRACE_ASYNC_BEGIN(name, cookie) static_cast<void>(sizeof(cookie))
+#define WSI_TRACE_ASYNC_END(name, cookie) static_cast<void>(sizeof(cookie))
+
+#endif
+
+} /* namespace trace */
+} /* namespace util */
@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file tuning_profile.cpp
+ *
+ * @brief Implementation of the per application tuning profiles.
+ */
+
+#include "tuning_profile.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+
+namespace util
+{
+
+/**
+ * @brief Name and range of a knob of the profile.
+ */
+struct tuning_key
+{
+   const char *name;
+   uint32_t tuning_profile::*member;
+   uint32_t min;
+   uint32_t max;
+};
+
+static constexpr std::array<tuning_key, 16> tuning_keys = { {
+   { "x11_threading_pixel_threshold", &tuning_profile::x11_threading_pixel_threshold, 0, UINT32_MAX },
+   { "x11_max_copy_threads", &tuning_profile::x11_max_copy_threads, 1, 64 },
+   { "x11_copy_autotune", &tuning_profile::x11_copy_autotune, 0, 1 },
+   { "x11_skip_unchanged", &tuning_profile::x11_skip_unchanged, 0, 1 },
+   { "x11_max_pending_completions", &tuning_profile::x11_max_pending_completions, 1, 1024 },
+   { "x11_reduced_footprint", &tuning_profile::x11_reduced_footprint, 0, 1 },
+   { "max_frames_in_flight", &tuning_profile::max_frames_in_flight, 0, 32 },
+   { "adaptive_frames_in_flight", &tuning_profile::adaptive_frames_in_flight, 0, 1 },
+   { "jit_acquire", &tuning_profile::jit_acquire, 0, 1 },
+   { "jit_acquire_margin_us", &tuning_profile::jit_acquire_margin_us, 0, 100000 },
+   { "max_swapchain_images", &tuning_profile::max_swapchain_images, 1, UINT32_MAX },
+   { "present_release_margin_percent", &tuning_profile::present_release_margin_percent, 0, 90 },
+   { "memory_accounting", &tuning_profile::memory_accounting, 0, 1 },
+   { "auto_fixed_rate_compression", &tuning_profile::auto_fixed_rate_compression, 0, 24 },
+   { "hidden_present_interval_ms", &tuning_profile::hidden_present_interval_ms, 0, 1000 },
+   { "wayland_fifo_presentation_thread", &tuning_profile::wayland_fifo_presentation_thread, 0, 1 },
+} };
+
+static tuning_profile selected_profile;
+
+const tuning_profile &tuning_profile::get()
+{
+   return selected_profile;
+}
+
+static void set_value(tuning_profile &profile, const tuning_key &key, const char *value, const char *source)
+{
+   if (std::strcmp(value, "true") == 0 || std::strcmp(value, "false") == 0)
+   {
+      profile.*key.member = std::clamp<uint32_t>(value[0] == 't' ? 1 : 0, key.min, key.max);
+      return;
+   }
+
+   char *end = nullptr;
+   errno = 0;
+   const unsigned long long parsed = std::strtoull(value, &end, 0);
+   if (end == value || *end != '\0' || errno != 0 || value[0] == '-')
+   {
+      WSI_LOG_WARNING("Ignoring %s value '%s' from %s, expected a number", key.name, value, source);
+      return;
+   }
+   profile.*key.member = static_cast<uint32_t>(std::clamp<unsigned long long>(parsed, key.min, key.max));
+}
+
+static char *trim(char *text)
+{
+   while (std::isspace(static_cast<unsigned char>(*text)))
+   {
+      text++;
+   }
+   char *end = text + std::strlen(text);
+   while (end > text && std::isspace(static_cast<unsigned char>(end[-1])))
+   {
+      end--;
+   }
+   *end = '\0';
+   return text;
+}
+
+/**
+ * @brief Path of the tuning file, empty when there is none.
+ */
+static std::string find_tuning_file()
+{
+   if (const char *env = std::getenv("WSI_TUNING_FILE"))
+   {
+      return env;
+   }
+
+   constexpr const char *relative_path = "/vulkan-wsi-layer/tuning.conf";
+   std::string user_path;
+   if (const char *config_home = std::getenv("XDG_CONFIG_HOME"); config_home != nullptr && config_home[0] != '\0')
+   {
+      user_path = std::string(config_home) + relative_path;
+   }
+   else if (const char *home = std::getenv("HOME"); home != nullptr && home[0] != '\0')
+   {
+      user_path = std::string(home) + "/.config" + relative_path;
+   }
+   if (!user_path.empty() && access(user_path.c_str(), R_OK) == 0)
+   {
+      return user_path;
+   }
+
+   const std::string system_path = std::string("/etc") + relative_path;
+   return access(system_path.c_str(), R_OK) == 0 ? system_path : std::string();
+}
+
+/**
+ * @brief Basename of the executable of the process, empty when unknown.
+ */
+static std::string get_executable_name()
+{
+   char path[4096];
+   const ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+   if (length <= 0)
+   {
+      return {};
+   }
+   path[length] = '\0';
+   const char *slash = std::strrchr(path, '/');
+   return slash != nullptr ? slash + 1 : path;
+}
+
+/**
+ * @brief Apply the sections of @p file named @p section to @p profile.
+ *
+ * @return Whether a section of that name was found.
+ */
+static bool apply_section(tuning_profile &profile, const std::string &file, const std::string &section)
+{
+   bool in_section = false;
+   bool found = false;
+   size_t line_start = 0;
+   while (line_start < file.size())
+   {
+      size_t line_end = file.find('\n', line_start);
+      if (line_end == std::string::npos)
+      {
+         line_end = file.size();
+      }
+      std::string line_buffer = file.substr(line_start, line_end - line_start);
+      line_start = line_end + 1;
+
+      char *line = trim(&line_buffer[0]);
+      if (line[0] == '\0' || line[0] == '#')
+      {
+         continue;
+      }
+
+      const size_t length = std::strlen(line);
+      if (line[0] == '[' && line[length - 1] == ']')
+      {
+         line[length - 1] = '\0';
+         in_section = section == trim(line + 1);
+         found = found || in_section;
+         continue;
+      }
+      if (!in_section)
+      {
+         continue;
+      }
+
+      char *equals = std::strchr(line, '=');
+      if (equals == nullptr)
+      {
+         WSI_LOG_WARNING("Ignoring tuning file line '%s', expected key = value", line);
+         continue;
+      }
+      *equals = '\0';
+      const char *name = trim(line);
+      const char *value = trim(equals + 1);
+
+      auto key = std::find_if(tuning_keys.begin(), tuning_keys.end(),
+                              [name](const tuning_key &candidate) { return std::strcmp(candidate.name, name) == 0; });
+      if (key == tuning_keys.end())
+      {
+         WSI_LOG_WARNING("Ignoring unknown tuning key '%s' in section [%s]", name, section.c_str());
+         continue;
+      }
+      set_value(profile, *key, value, "the tuning file");
+   }
+   return found;
+}
+
+static std::string read_file(const std::string &path)
+{
+   std::string contents;
+   FILE *file = std::fopen(path.c_str(), "r");
+   if (file == nullptr)
+   {
+      WSI_LOG_WARNING("Cannot open the tuning file %s", path.c_str());
+      return contents;
+   }
+
+   char buffer[4096];
+   size_t count = 0;
+   while ((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+   {
+      contents.append(buffer, count);
+   }
+   std::fclose(file);
+   return contents;
+}
+
+void tuning_profile::select(const char *application_name)
+{
+   static std::once_flag selected;
+   std::call_once(selected, [application_name]() {
+      tuning_profile profile;
+
+      const std::string path = find_tuning_file();
+      if (!path.empty())
+      {
+         const std::string file = read_file(path);
+         apply_section(profile, file, "default");
+
+         const std::string executable = get_executable_name();
+         if (!executable.empty() && apply_section(profile, file, "exe:" + executable))
+         {
+            WSI_LOG_INFO("Using the tuning profile of executable %s from %s", executable.c_str(), path.c_str());
+         }
+         if (application_name != nullptr && application_name[0] != '\0' &&
+             apply_section(profile, file, std::string("app:") + application_name))
+         {
+            WSI_LOG_INFO("Using the tuning profile of application %s from %s", application_name, path.c_str());
+         }
+      }
+
+      for (const tuning_key &key : tuning_keys)
+      {
+         std::string env_name = std::string("WSI_TUNING_") + key.name;
+         std::transform(env_name.begin(), env_name.end(), env_name.begin(),
+                        [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+         if (const char *value = std::getenv(env_name.c_str()); value != nullptr && value[0] != '\0')
+         {
+            set_value(profile, key, value, env_name.c_str());
+         }
+      }
+
+      /* Swapchains only read the profile after an instance exists, so nothing reads it while it is written. */
+      selected_profile = profile;
+   });
+}
+
+} /* namespace util */
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file tuning_profile.hpp
+ *
+ * @brief Performance knobs of the layer, selected per application at run time.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace util
+{
+
+/**
+ * @brief Latency and throughput trade-offs of the layer, so each application can pick its own from one build.
+ *
+ * The profile is selected once, by the first vkCreateInstance of the process, see @ref select. It starts from the
+ * defaults below and applies, in order:
+ * - the [default] section of the tuning file,
+ * - the [exe:<name>] sections matching the basename of the executable,
+ * - the [app:<name>] sections matching VkApplicationInfo::pApplicationName,
+ * - WSI_TUNING_<KEY> environment variables, e.g. WSI_TUNING_X11_MAX_COPY_THREADS=2.
+ *
+ * The tuning file is WSI_TUNING_FILE, or else vulkan-wsi-layer/tuning.conf in $XDG_CONFIG_HOME (~/.config when
+ * unset) or /etc. Sections hold one "key = value" per line, keys being the names of the members below, and lines
+ * starting with # are comments. Values out of range are clamped.
+ */
+struct tuning_profile
+{
+   /** X11 SHM presenter: frames with more pixels are copied by the worker threads, fewer on the presenting one. */
+   uint32_t x11_threading_pixel_threshold = 400 * 400;
+
+   /** X11 SHM presenter: most threads a frame copy is split across, including the presenting one. */
+   uint32_t x11_max_copy_threads = 8;
+
+   /**
+    * X11 SHM presenter: whether whole frames are copied with the strategy timed fastest on the first frames of their
+    * size, rather than split across threads above x11_threading_pixel_threshold.
+    */
+   uint32_t x11_copy_autotune = 1;
+
+   /**
+    * X11 SHM presenter: whether frames presented without VkPresentRegionsKHR are hashed tile by tile, so only what
+    * changed since the previous present is copied and put, and nothing at all for identical frames.
+    */
+   uint32_t x11_skip_unchanged = 0;
+
+   /** X11: presents of an image waiting for the X server to complete them before the next present blocks. */
+   uint32_t x11_max_pending_completions = 128;
+
+   /**
+    * X11 SHM presenter: whether swapchains trade copy slack for host memory, with the smallest segment ring and no
+    * readback buffer for images whose memory the CPU already reads through its caches.
+    */
+   uint32_t x11_reduced_footprint = 0;
+
+   /**
+    * Most images presented and not yet released by the presentation engine, the one on screen included, when
+    * vkAcquireNextImageKHR returns. Acquire waits for presents to complete beyond it, 1 gives one frame of latency.
+    * 0 leaves the queue as deep as the swapchain. Not applied to the shared present modes.
+    */
+   uint32_t max_frames_in_flight = 0;
+
+   /**
+    * Whether max_frames_in_flight is only the deepest the queue gets: swapchains lower their limit while the
+    * application keeps outrunning the display, and raise it again when frames stop queueing up.
+    */
+   uint32_t adaptive_frames_in_flight = 0;
+
+   /**
+    * Whether vkAcquireNextImageKHR holds the image back until the latest time rendering can start and still make the
+    * next vblank, predicted from the vblanks of the presentation engine and the time the application took from
+    * acquire to present on the previous frames. Best with max_frames_in_flight = 1.
+    */
+   uint32_t jit_acquire = 0;
+
+   /** Slack left by jit_acquire before the predicted vblank, in microseconds. */
+   uint32_t jit_acquire_margin_us = 1000;
+
+   /** Highest maxImageCount surfaces report, at most wsi::surface_properties::MAX_SWAPCHAIN_IMAGE_COUNT. */
+   uint32_t max_swapchain_images = UINT32_MAX;
+
+   /**
+    * Presents with a target time are released this share of a refresh, in percent, after the vblank before the one
+    * they target. Higher values lower the latency and the margin for a late wake up.
+    */
+   uint32_t present_release_margin_percent = 25;
+
+   /**
+    * Whether instances, devices and swapchains count the host memory they hold per allocation scope, with the SHM
+    * segments and host visible image memory, see util::memory_accounting.
+    */
+   uint32_t memory_accounting = 0;
+
+   /**
+    * Lowest bits per component of the fixed-rate compression swapchains pick for their images when the application
+    * chains no VkImageCompressionControlEXT, see wsi::wsi_ext_image_compression_control::create. Images are
+    * compressed at the lowest rate the device supports from this one up, and as usual when it supports none.
+    * 0 leaves the compression to the application.
+    */
+   uint32_t auto_fixed_rate_compression = 0;
+
+   /**
+    * Presents to a surface nothing of which is seen, an unmapped or fully obscured X11 window or a Wayland surface
+    * the compositor stopped sending frame events for, are completed without being shown, at most one every this many
+    * milliseconds. 0 presents them as any other.
+    */
+   uint32_t hidden_present_interval_ms = 0;
+
+   /**
+    * Wayland: whether FIFO presents go through the page flip thread when the compositor has no wp_fifo_v1, in builds
+    * with ENABLE_WAYLAND_FIFO_PRESENTATION_THREAD.
+    */
+   uint32_t wayland_fifo_presentation_thread = 1;
+
+   /**
+    * @brief Profile of the process, the defaults until @ref select is called.
+    */
+   static const tuning_profile &get();
+
+   /**
+    * @brief Select the profile of the process. Only the first call has an effect.
+    *
+    * @param application_name VkApplicationInfo::pApplicationName, may be nullptr.
+    */
+   static void select(const char *application_name);
+};
+
+} /* namespace util */
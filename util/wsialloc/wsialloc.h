@@ -64,8 +64,11 @@ extern "C" {
  * 2 - Added WSIALLOC_ALLOCATE_HIGHEST_FIXED_RATE_COMPRESSION
  * 3 - Grouped the return values of wsialloc_alloc to wsialloc_allocate_result and added another value for returning
  *     whether or not the allocation will be disjoint.
+ * 4 - Added wsialloc_free to give buffers back to the allocator for reuse.
+ * 5 - Added WSIALLOC_ALLOCATE_CPU_CACHED and WSIALLOC_ALLOCATE_CONTIGUOUS
+ * 6 - Added wsialloc_alloc_batch
  */
-#define WSIALLOC_INTERFACE_VERSION 3
+#define WSIALLOC_INTERFACE_VERSION 6
 
 #define WSIALLOC_CONCAT(x, y) x##y
 #define WSIALLOC_SYMBOL_VERSION(symbol, version) WSIALLOC_CONCAT(symbol, version)
@@ -154,6 +157,10 @@ enum wsialloc_allocate_flag
    WSIALLOC_ALLOCATE_NO_MEMORY = 0x2,
    /** Sets a preference for selecting the format with the highest fixed compression rate. */
    WSIALLOC_ALLOCATE_HIGHEST_FIXED_RATE_COMPRESSION = 0x4,
+   /** Sets a preference for memory cached by the CPU, for buffers mostly read by the CPU. */
+   WSIALLOC_ALLOCATE_CPU_CACHED = 0x8,
+   /** Sets a preference for physically contiguous memory, for buffers scanned out by a display controller. */
+   WSIALLOC_ALLOCATE_CONTIGUOUS = 0x10,
 };
 
 typedef struct wsialloc_format
@@ -246,6 +253,41 @@ typedef struct wsialloc_allocate_result
 wsialloc_error wsialloc_alloc(wsialloc_allocator *allocator, const wsialloc_allocate_info *info,
                               wsialloc_allocate_result *result);
 
+/**
+ * @brief Allocate several buffers of the same description from the WSI Allocator
+ *
+ * Behaves as @p count calls to wsialloc_alloc() with @p info, except that the format is selected once and all the
+ * buffers use the same format and layout. Implementations may allocate the buffers together.
+ *
+ * @pre @p count >= 1 and @p results points to @p count results, see wsialloc_alloc() for their requirements.
+ * @post On failure, none of the buffers is allocated.
+ *
+ * @param      allocator  The WSI Allocator to allocate from.
+ * @param      info       The requested allocation information, shared by all the buffers.
+ * @param      count      The number of buffers to allocate.
+ * @param[out] results    The allocation results, one per buffer.
+ *
+ * @retval WSIALLOC_ERROR_NONE on success, otherwise the error wsialloc_alloc() would return.
+ */
+wsialloc_error wsialloc_alloc_batch(wsialloc_allocator *allocator, const wsialloc_allocate_info *info, uint32_t count,
+                                    wsialloc_allocate_result *results);
+
+/**
+ * @brief Give a buffer back to the WSI Allocator
+ *
+ * Instead of closing the last file descriptor of a buffer from wsialloc_alloc(), the client may pass it to this
+ * function. The implementation may keep the buffer to satisfy a later allocation of a similar size without a kernel
+ * allocation, or close @p fd straight away. Kept buffers are bounded in number and total size, and released when
+ * they stay unused or allocations run out of memory.
+ *
+ * @pre No other reference to the buffer is in use, by the client or any device it was imported into.
+ * @post @p fd is owned by the implementation.
+ *
+ * @param allocator  The WSI Allocator the buffer was allocated from.
+ * @param fd         The file descriptor of the buffer.
+ */
+void wsialloc_free(wsialloc_allocator *allocator, int fd);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -43,7 +43,7 @@
  *
  * This should only be increased when this implementation is updated to match newer versions of wsialloc.h.
  */
-#define WSIALLOC_IMPLEMENTATION_VERSION 3
+#define WSIALLOC_IMPLEMENTATION_VERSION 6
 
 /* Ensure we are implementing the wsialloc version matching the wsialloc.h header we are using. */
 #if WSIALLOC_IMPLEMENTATION_VERSION != WSIALLOC_INTERFACE_VERSION
@@ -56,17 +56,30 @@ const uint32_t WSIALLOC_IMPLEMENTATION_VERSION_SYMBOL = WSIALLOC_IMPLEMENTATION_
 #define STR_EXPAND(tok...) #tok
 #define STR(tok) STR_EXPAND(tok)
 
+/**
+ * @brief An opened DMA-BUF heap.
+ */
+typedef struct heap
+{
+   /* File descriptor of the heap, -1 when the heap does not exist. */
+   int fd;
+   /* Name of the heap, which is the exporter name of its buffers. */
+   const char *name;
+} heap;
+
 struct wsialloc_allocator
 {
-   /* File descriptor for a DMA-BUF heap for allocating memory accessible to
-    * the windowing system (display, compositor, etc.)
-    */
-   int memory_fd;
-
-   /* File descriptor for a DMA-BUF heap for allocating protected memory
-    * accessible to the windowing system.
-    */
-   int protected_fd;
+   /* DMA-BUF heap for allocating memory accessible to the windowing system (display, compositor, etc.) */
+   heap memory;
+
+   /* DMA-BUF heap for allocating memory cached by the CPU, for WSIALLOC_ALLOCATE_CPU_CACHED. */
+   heap cached;
+
+   /* DMA-BUF heap for allocating physically contiguous memory, for WSIALLOC_ALLOCATE_CONTIGUOUS. */
+   heap contiguous;
+
+   /* DMA-BUF heap for allocating protected memory accessible to the windowing system. */
+   heap protected;
 };
 
 static int allocate(int fd, uint64_t size)
@@ -88,6 +101,26 @@ static int allocate(int fd, uint64_t size)
    return heap_data.fd;
 }
 
+/**
+ * @brief Pick the heap for allocations with @p flags. Preferred heaps that do not exist fall back to the memory heap.
+ */
+static const heap *select_heap(const wsialloc_allocator *allocator, uint64_t flags)
+{
+   if (flags & WSIALLOC_ALLOCATE_PROTECTED)
+   {
+      return &allocator->protected;
+   }
+   if ((flags & WSIALLOC_ALLOCATE_CONTIGUOUS) && allocator->contiguous.fd >= 0)
+   {
+      return &allocator->contiguous;
+   }
+   if ((flags & WSIALLOC_ALLOCATE_CPU_CACHED) && allocator->cached.fd >= 0)
+   {
+      return &allocator->cached;
+   }
+   return &allocator->memory;
+}
+
 static int dma_allocate(const wsialloc_allocator *allocator, const wsialloc_allocate_info *info, uint64_t size)
 {
    assert(allocator != NULL);
@@ -96,18 +129,34 @@ static int dma_allocate(const wsialloc_allocator *allocator, const wsialloc_allo
 
    /* The only error that can be encountered on allocations is lack of resources. Other parameter validation and
     * support checks are done on format selection. */
-   int alloc_fd = allocator->memory_fd;
-   if (info->flags & WSIALLOC_ALLOCATE_PROTECTED)
-   {
-      alloc_fd = allocator->protected_fd;
-   }
-   if (alloc_fd < 0)
+   const heap *alloc_heap = select_heap(allocator, info->flags);
+   if (alloc_heap->fd < 0)
    {
       assert(false);
       return -1;
    }
 
-   return allocate(alloc_fd, size);
+   int fd = allocate(alloc_heap->fd, size);
+   if (fd < 0 && alloc_heap != &allocator->memory && alloc_heap != &allocator->protected)
+   {
+      /* Contiguous heaps are small, the heaps are only preferences. */
+      fd = allocate(allocator->memory.fd, size);
+   }
+   return fd;
+}
+
+static void close_fd(int fd)
+{
+   if (fd >= 0)
+   {
+      close(fd);
+   }
+}
+
+static heap open_heap(const char *path, const char *name)
+{
+   heap opened = { open(path, O_RDWR | O_CLOEXEC), name };
+   return opened;
 }
 
 wsialloc_error wsialloc_new(wsialloc_allocator **allocator)
@@ -120,27 +169,30 @@ wsialloc_error wsialloc_new(wsialloc_allocator **allocator)
       return WSIALLOC_ERROR_NO_RESOURCE;
    }
 
-   dma_buf_heaps->memory_fd = open("/dev/dma_heap/" STR(WSIALLOC_MEMORY_HEAP_NAME), O_RDWR);
-   dma_buf_heaps->protected_fd = -1;
-
-   if (dma_buf_heaps->memory_fd < 0)
+   dma_buf_heaps->memory =
+      open_heap("/dev/dma_heap/" STR(WSIALLOC_MEMORY_HEAP_NAME), STR(WSIALLOC_MEMORY_HEAP_NAME));
+   if (dma_buf_heaps->memory.fd < 0)
    {
       free(dma_buf_heaps);
       return WSIALLOC_ERROR_NO_RESOURCE;
    }
 
+   /* The other heaps are optional. */
+   dma_buf_heaps->cached =
+      open_heap("/dev/dma_heap/" STR(WSIALLOC_CACHED_HEAP_NAME), STR(WSIALLOC_CACHED_HEAP_NAME));
+   dma_buf_heaps->contiguous =
+      open_heap("/dev/dma_heap/" STR(WSIALLOC_CONTIGUOUS_HEAP_NAME), STR(WSIALLOC_CONTIGUOUS_HEAP_NAME));
+#ifdef WSIALLOC_PROTECTED_HEAP_NAME
+   dma_buf_heaps->protected =
+      open_heap("/dev/dma_heap/" STR(WSIALLOC_PROTECTED_HEAP_NAME), STR(WSIALLOC_PROTECTED_HEAP_NAME));
+#else
+   dma_buf_heaps->protected = (heap){ -1, NULL };
+#endif
+
    *allocator = dma_buf_heaps;
    return WSIALLOC_ERROR_NONE;
 }
 
-static void close_fd(int fd)
-{
-   if (fd >= 0)
-   {
-      close(fd);
-   }
-}
-
 void wsialloc_delete(wsialloc_allocator *allocator)
 {
    assert(allocator != NULL);
@@ -149,26 +201,43 @@ void wsialloc_delete(wsialloc_allocator *allocator)
       return;
    }
 
-   close_fd(allocator->memory_fd);
-   close_fd(allocator->protected_fd);
+   close_fd(allocator->memory.fd);
+   close_fd(allocator->cached.fd);
+   close_fd(allocator->contiguous.fd);
+   close_fd(allocator->protected.fd);
 
-   allocator->memory_fd = -1;
-   allocator->protected_fd = -1;
+   allocator->memory.fd = -1;
+   allocator->cached.fd = -1;
+   allocator->contiguous.fd = -1;
+   allocator->protected.fd = -1;
 
    free(allocator);
 }
 
-wsialloc_error wsialloc_alloc(wsialloc_allocator *allocator, const wsialloc_allocate_info *info,
-                              wsialloc_allocate_result *result)
+wsialloc_error wsialloc_alloc_batch(wsialloc_allocator *allocator, const wsialloc_allocate_info *info, uint32_t count,
+                                    wsialloc_allocate_result *results)
 {
-   int fd_to_use = allocator->memory_fd;
-   if (info->flags & WSIALLOC_ALLOCATE_PROTECTED)
-   {
-      fd_to_use = allocator->protected_fd;
-   }
-   if (fd_to_use < 0)
+   const heap *alloc_heap = select_heap(allocator, info->flags);
+   if (alloc_heap->fd < 0)
    {
       return WSIALLOC_ERROR_NO_RESOURCE;
    }
-   return wsiallocp_alloc(allocator, dma_allocate, info, result);
+
+   /* Protected buffers are never reused, they cannot be cleared by the CPU. */
+   const char *heap_name = (info->flags & WSIALLOC_ALLOCATE_PROTECTED) ? NULL : alloc_heap->name;
+   return wsiallocp_alloc_batch(allocator, dma_allocate, heap_name, info, count, results);
+}
+
+wsialloc_error wsialloc_alloc(wsialloc_allocator *allocator, const wsialloc_allocate_info *info,
+                              wsialloc_allocate_result *result)
+{
+   return wsialloc_alloc_batch(allocator, info, 1, result);
+}
+
+void wsialloc_free(wsialloc_allocator *allocator, int fd)
+{
+   assert(allocator != NULL);
+   (void)allocator;
+
+   wsiallocp_cache_put(fd);
 }
@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file wsialloc_gbm.c
+ *
+ * @brief wsialloc implementation allocating through GBM, so the GPU driver picks the layout of the buffers.
+ */
+
+#include "wsialloc.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <gbm.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * @brief Version of the wsialloc interface we are implementing in this file.
+ *
+ * This should only be increased when this implementation is updated to match newer versions of wsialloc.h.
+ */
+#define WSIALLOC_IMPLEMENTATION_VERSION 6
+
+/* Ensure we are implementing the wsialloc version matching the wsialloc.h header we are using. */
+#if WSIALLOC_IMPLEMENTATION_VERSION != WSIALLOC_INTERFACE_VERSION
+#error "Version mismatch between wsialloc implementation and interface version"
+#endif
+
+const uint32_t WSIALLOC_IMPLEMENTATION_VERSION_SYMBOL = WSIALLOC_IMPLEMENTATION_VERSION;
+
+/** DRM device opened when WSIALLOC_GBM_DEVICE is not set */
+#define DEFAULT_DEVICE "/dev/dri/renderD128"
+/** Maximum image size allowed for each dimension */
+#define MAX_IMAGE_SIZE 128000
+
+struct wsialloc_allocator
+{
+   /* File descriptor of the DRM device the GBM device is created on. */
+   int fd;
+   struct gbm_device *device;
+};
+
+wsialloc_error wsialloc_new(wsialloc_allocator **allocator)
+{
+   assert(allocator != NULL);
+
+   wsialloc_allocator *gbm = malloc(sizeof(*gbm));
+   if (NULL == gbm)
+   {
+      return WSIALLOC_ERROR_NO_RESOURCE;
+   }
+
+   const char *path = getenv("WSIALLOC_GBM_DEVICE");
+   gbm->fd = open(path != NULL ? path : DEFAULT_DEVICE, O_RDWR | O_CLOEXEC);
+   if (gbm->fd < 0)
+   {
+      free(gbm);
+      return WSIALLOC_ERROR_NO_RESOURCE;
+   }
+
+   gbm->device = gbm_create_device(gbm->fd);
+   if (gbm->device == NULL)
+   {
+      close(gbm->fd);
+      free(gbm);
+      return WSIALLOC_ERROR_NO_RESOURCE;
+   }
+
+   *allocator = gbm;
+   return WSIALLOC_ERROR_NONE;
+}
+
+void wsialloc_delete(wsialloc_allocator *allocator)
+{
+   assert(allocator != NULL);
+   if (NULL == allocator)
+   {
+      return;
+   }
+
+   /* Buffers are exported as dma-bufs, which outlive the GBM device. */
+   gbm_device_destroy(allocator->device);
+   close(allocator->fd);
+
+   free(allocator);
+}
+
+static bool validate_parameters(const wsialloc_allocator *allocator, const wsialloc_allocate_info *info,
+                                wsialloc_allocate_result *result)
+{
+   if (allocator == NULL || result == NULL)
+   {
+      return false;
+   }
+   else if (info->format_count == 0 || info->formats == NULL)
+   {
+      return false;
+   }
+   else if (info->width < 1 || info->height < 1 || info->width > MAX_IMAGE_SIZE || info->height > MAX_IMAGE_SIZE)
+   {
+      return false;
+   }
+
+   return true;
+}
+
+static void close_planes(int *fds, uint32_t num_planes)
+{
+   for (uint32_t plane = 0; plane < num_planes; plane++)
+   {
+      /* Planes of the same buffer share the fd of the first plane of the buffer. */
+      bool first_use = fds[plane] >= 0;
+      for (uint32_t other = 0; other < plane && first_use; other++)
+      {
+         first_use = fds[other] != fds[plane];
+      }
+      if (first_use)
+      {
+         close(fds[plane]);
+      }
+   }
+}
+
+/**
+ * @brief Export the planes of @p bo, giving the planes of the same buffer object the same fd.
+ *
+ * @return false if a plane could not be exported.
+ */
+static bool export_planes(struct gbm_bo *bo, uint32_t num_planes, int *fds, bool *is_disjoint)
+{
+   *is_disjoint = false;
+   for (uint32_t plane = 0; plane < num_planes; plane++)
+   {
+      fds[plane] = -1;
+      const uint32_t handle = gbm_bo_get_handle_for_plane(bo, plane).u32;
+      for (uint32_t other = 0; other < plane; other++)
+      {
+         if (gbm_bo_get_handle_for_plane(bo, other).u32 == handle)
+         {
+            fds[plane] = fds[other];
+            break;
+         }
+      }
+
+      if (fds[plane] < 0)
+      {
+         fds[plane] = gbm_bo_get_fd_for_plane(bo, plane);
+         if (fds[plane] < 0)
+         {
+            close_planes(fds, plane);
+            return false;
+         }
+         *is_disjoint = *is_disjoint || plane > 0;
+      }
+   }
+   return true;
+}
+
+/**
+ * @brief Find the format of @p fourcc and @p modifier among the formats of @p info.
+ */
+static const wsialloc_format *find_format(const wsialloc_allocate_info *info, uint32_t fourcc, uint64_t modifier)
+{
+   for (unsigned i = 0; i < info->format_count; i++)
+   {
+      if (info->formats[i].fourcc == fourcc && info->formats[i].modifier == modifier)
+      {
+         return &info->formats[i];
+      }
+   }
+   return NULL;
+}
+
+/**
+ * @brief Create a buffer object of @p fourcc with the modifier GBM prefers among the modifiers listed for it.
+ */
+static struct gbm_bo *create_bo(const wsialloc_allocator *allocator, const wsialloc_allocate_info *info,
+                                uint32_t fourcc)
+{
+   uint64_t *modifiers = malloc(sizeof(*modifiers) * info->format_count);
+   if (modifiers == NULL)
+   {
+      return NULL;
+   }
+
+   unsigned modifier_count = 0;
+   for (unsigned i = 0; i < info->format_count; i++)
+   {
+      if (info->formats[i].fourcc == fourcc)
+      {
+         modifiers[modifier_count++] = info->formats[i].modifier;
+      }
+   }
+
+   uint32_t usage = GBM_BO_USE_RENDERING;
+   if (info->flags & WSIALLOC_ALLOCATE_PROTECTED)
+   {
+      usage |= GBM_BO_USE_PROTECTED;
+   }
+   if (info->flags & WSIALLOC_ALLOCATE_CONTIGUOUS)
+   {
+      usage |= GBM_BO_USE_SCANOUT;
+   }
+
+   struct gbm_bo *bo = gbm_bo_create_with_modifiers2(allocator->device, info->width, info->height, fourcc, modifiers,
+                                                     modifier_count, usage);
+   free(modifiers);
+   return bo;
+}
+
+/**
+ * @brief Allocate a buffer as wsialloc_alloc() does, also returning the number of planes of the buffer.
+ */
+static wsialloc_error allocate_buffer(wsialloc_allocator *allocator, const wsialloc_allocate_info *info,
+                                      wsialloc_allocate_result *result, uint32_t *num_buffer_planes)
+{
+   if (!validate_parameters(allocator, info, result))
+   {
+      return WSIALLOC_ERROR_INVALID;
+   }
+
+   /* GBM picks the modifier itself, so formats are tried per fourcc in the order of their first appearance. */
+   wsialloc_error err = WSIALLOC_ERROR_NOT_SUPPORTED;
+   for (unsigned i = 0; i < info->format_count; i++)
+   {
+      const uint32_t fourcc = info->formats[i].fourcc;
+      bool tried = false;
+      for (unsigned j = 0; j < i && !tried; j++)
+      {
+         tried = info->formats[j].fourcc == fourcc;
+      }
+      if (tried || !gbm_device_is_format_supported(allocator->device, fourcc, GBM_BO_USE_RENDERING))
+      {
+         continue;
+      }
+
+      struct gbm_bo *bo = create_bo(allocator, info, fourcc);
+      if (bo == NULL)
+      {
+         err = WSIALLOC_ERROR_NO_RESOURCE;
+         continue;
+      }
+
+      const wsialloc_format *format = find_format(info, fourcc, gbm_bo_get_modifier(bo));
+      const uint32_t num_planes = (uint32_t)gbm_bo_get_plane_count(bo);
+      int fds[WSIALLOC_MAX_PLANES] = { -1, -1, -1, -1 };
+      bool is_disjoint = false;
+      if (format == NULL || num_planes > WSIALLOC_MAX_PLANES || !export_planes(bo, num_planes, fds, &is_disjoint))
+      {
+         gbm_bo_destroy(bo);
+         err = WSIALLOC_ERROR_NO_RESOURCE;
+         continue;
+      }
+      if (is_disjoint && (format->flags & WSIALLOC_FORMAT_NON_DISJOINT))
+      {
+         close_planes(fds, num_planes);
+         gbm_bo_destroy(bo);
+         continue;
+      }
+
+      result->format = *format;
+      result->is_disjoint = is_disjoint;
+      for (uint32_t plane = 0; plane < num_planes; plane++)
+      {
+         result->average_row_strides[plane] = (int)gbm_bo_get_stride_for_plane(bo, plane);
+         result->offsets[plane] = gbm_bo_get_offset(bo, plane);
+      }
+
+      /* The layout is only known once a buffer object exists, drop it when no memory was asked for. */
+      if (info->flags & WSIALLOC_ALLOCATE_NO_MEMORY)
+      {
+         close_planes(fds, num_planes);
+      }
+      else
+      {
+         assert(result->buffer_fds != NULL);
+         for (uint32_t plane = 0; plane < num_planes; plane++)
+         {
+            result->buffer_fds[plane] = fds[plane];
+         }
+      }
+
+      /* The exported fds keep the buffer alive. */
+      gbm_bo_destroy(bo);
+      *num_buffer_planes = num_planes;
+      return WSIALLOC_ERROR_NONE;
+   }
+
+   return err;
+}
+
+wsialloc_error wsialloc_alloc(wsialloc_allocator *allocator, const wsialloc_allocate_info *info,
+                              wsialloc_allocate_result *result)
+{
+   uint32_t num_planes = 0;
+   return allocate_buffer(allocator, info, result, &num_planes);
+}
+
+wsialloc_error wsialloc_alloc_batch(wsialloc_allocator *allocator, const wsialloc_allocate_info *info, uint32_t count,
+                                    wsialloc_allocate_result *results)
+{
+   if (count == 0)
+   {
+      return WSIALLOC_ERROR_INVALID;
+   }
+
+   uint32_t num_planes = 0;
+   wsialloc_error err = allocate_buffer(allocator, info, &results[0], &num_planes);
+   if (err != WSIALLOC_ERROR_NONE)
+   {
+      return err;
+   }
+
+   /* GBM allocates one buffer object at a time, the others are pinned to the format GBM picked for the first. */
+   wsialloc_format selected_format = results[0].format;
+   wsialloc_allocate_info buffer_info = *info;
+   buffer_info.formats = &selected_format;
+   buffer_info.format_count = 1;
+   for (uint32_t i = 1; i < count; i++)
+   {
+      err = allocate_buffer(allocator, &buffer_info, &results[i], &num_planes);
+      if (err != WSIALLOC_ERROR_NONE)
+      {
+         for (uint32_t allocated = 0; allocated < i && !(info->flags & WSIALLOC_ALLOCATE_NO_MEMORY); allocated++)
+         {
+            close_planes(results[allocated].buffer_fds, num_planes);
+         }
+         return err;
+      }
+   }
+   return WSIALLOC_ERROR_NONE;
+}
+
+void wsialloc_free(wsialloc_allocator *allocator, int fd)
+{
+   assert(allocator != NULL);
+   (void)allocator;
+
+   /* Buffers are laid out for the modifier they were allocated with, so they are not reused. */
+   if (fd >= 0)
+   {
+      close(fd);
+   }
+}
@@ -26,12 +26,53 @@
 #include "format_table.h"
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/dma-buf.h>
 
 /** Default alignment */
 #define WSIALLOCP_MIN_ALIGN_SZ (64u)
 /** Maximum image size allowed for each dimension */
 #define MAX_IMAGE_SIZE 128000
 
+/** Maximum number of freed buffers kept for reuse */
+#define CACHE_MAX_ENTRIES 16
+/** Default limit in MiB of the total size of the freed buffers kept for reuse */
+#define CACHE_DEFAULT_SIZE_MIB 64
+/** Maximum length of the name of a dma-buf exporter */
+#define CACHE_EXPORTER_NAME_SIZE 32
+/** Time after which unused buffers are closed */
+#define CACHE_MAX_IDLE_NS (10ull * 1000 * 1000 * 1000)
+
+typedef struct cache_entry
+{
+   int fd;
+   uint64_t size;
+   uint64_t freed_ns;
+   /* Heap the buffer comes from, so buffers are only reused for allocations from the same heap. */
+   char exporter[CACHE_EXPORTER_NAME_SIZE];
+} cache_entry;
+
+/*
+ * Allocators are created per swapchain, so the cache is shared by the process to let an image freed by a swapchain
+ * back a swapchain that replaces it.
+ */
+static struct
+{
+   pthread_mutex_t mutex;
+   bool initialized;
+   uint64_t max_size;
+   uint64_t size;
+   uint32_t count;
+   cache_entry entries[CACHE_MAX_ENTRIES];
+} cache = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
 typedef struct wsialloc_format_descriptor
 {
    wsialloc_format format;
@@ -107,6 +148,222 @@ static const fmt_spec *find_format(uint32_t fourcc)
    return NULL;
 }
 
+static uint64_t get_time_ns(void)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/* Must be called with the cache mutex locked. */
+static void cache_init(void)
+{
+   if (cache.initialized)
+   {
+      return;
+   }
+
+   cache.max_size = (uint64_t)CACHE_DEFAULT_SIZE_MIB << 20;
+   const char *env = getenv("WSIALLOC_CACHE_SIZE");
+   if (env != NULL)
+   {
+      char *end = NULL;
+      unsigned long long mib = strtoull(env, &end, 10);
+      if (end != env && *end == '\0')
+      {
+         cache.max_size = (uint64_t)mib << 20;
+      }
+   }
+   cache.initialized = true;
+}
+
+/* Must be called with the cache mutex locked. */
+static void cache_remove(uint32_t index)
+{
+   assert(index < cache.count);
+   cache.size -= cache.entries[index].size;
+   cache.entries[index] = cache.entries[--cache.count];
+}
+
+/* Close the buffers freed before @p freed_before_ns. Must be called with the cache mutex locked. */
+static void cache_trim(uint64_t freed_before_ns)
+{
+   uint32_t i = 0;
+   while (i < cache.count)
+   {
+      if (cache.entries[i].freed_ns < freed_before_ns)
+      {
+         close(cache.entries[i].fd);
+         cache_remove(i);
+      }
+      else
+      {
+         i++;
+      }
+   }
+}
+
+static void cache_trim_idle(uint64_t now_ns)
+{
+   if (now_ns > CACHE_MAX_IDLE_NS)
+   {
+      cache_trim(now_ns - CACHE_MAX_IDLE_NS);
+   }
+}
+
+/* Clear a buffer taken from the cache so no content leaks between its users. */
+static bool clear_buffer(int fd, uint64_t size)
+{
+   void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (data == MAP_FAILED)
+   {
+      return false;
+   }
+
+   struct dma_buf_sync sync = { .flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_WRITE };
+   ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+   memset(data, 0, size);
+   sync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_WRITE;
+   ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+
+   munmap(data, size);
+   return true;
+}
+
+/**
+ * @brief Get the name of the exporter of the dma-buf @p fd, the heap name for dma-buf heaps.
+ *
+ * @return false when the name is unknown.
+ */
+static bool get_exporter_name(int fd, char name[CACHE_EXPORTER_NAME_SIZE])
+{
+   char path[64];
+   snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", fd);
+   FILE *fdinfo = fopen(path, "re");
+   if (fdinfo == NULL)
+   {
+      return false;
+   }
+
+   bool found = false;
+   char line[128];
+   while (!found && fgets(line, sizeof(line), fdinfo) != NULL)
+   {
+      found = sscanf(line, "exp_name: %31s", name) == 1;
+   }
+   fclose(fdinfo);
+   return found;
+}
+
+/**
+ * @brief Take the smallest buffer from @p exporter of at least @p size bytes, wasting at most half of @p size.
+ *
+ * @return The file descriptor of the buffer, -1 when none fits.
+ */
+static int cache_take(const char *exporter, uint64_t size)
+{
+   pthread_mutex_lock(&cache.mutex);
+   cache_trim_idle(get_time_ns());
+
+   int best = -1;
+   for (uint32_t i = 0; i < cache.count; i++)
+   {
+      const uint64_t entry_size = cache.entries[i].size;
+      if (entry_size >= size && entry_size - size <= size / 2 &&
+          (best < 0 || entry_size < cache.entries[best].size) && strcmp(cache.entries[i].exporter, exporter) == 0)
+      {
+         best = (int)i;
+      }
+   }
+
+   int fd = -1;
+   uint64_t fd_size = 0;
+   if (best >= 0)
+   {
+      fd = cache.entries[best].fd;
+      fd_size = cache.entries[best].size;
+      cache_remove((uint32_t)best);
+   }
+   pthread_mutex_unlock(&cache.mutex);
+
+   if (fd >= 0 && !clear_buffer(fd, fd_size))
+   {
+      close(fd);
+      fd = -1;
+   }
+   return fd;
+}
+
+void wsiallocp_cache_put(int fd)
+{
+   if (fd < 0)
+   {
+      return;
+   }
+
+   /* Buffers that cannot be mapped, such as protected ones, could not be cleared for their next user. */
+   cache_entry entry = { .fd = fd };
+   const off_t size = lseek(fd, 0, SEEK_END);
+   void *data = size > 0 ? mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+   if (data == MAP_FAILED || !get_exporter_name(fd, entry.exporter))
+   {
+      if (data != MAP_FAILED)
+      {
+         munmap(data, (size_t)size);
+      }
+      close(fd);
+      return;
+   }
+   munmap(data, (size_t)size);
+   entry.size = (uint64_t)size;
+
+   pthread_mutex_lock(&cache.mutex);
+   cache_init();
+
+   entry.freed_ns = get_time_ns();
+   cache_trim_idle(entry.freed_ns);
+
+   if ((uint64_t)size > cache.max_size)
+   {
+      pthread_mutex_unlock(&cache.mutex);
+      close(fd);
+      return;
+   }
+
+   /* Make room by closing the oldest buffers. */
+   while (cache.count == CACHE_MAX_ENTRIES || cache.size + (uint64_t)size > cache.max_size)
+   {
+      uint32_t oldest = 0;
+      for (uint32_t i = 1; i < cache.count; i++)
+      {
+         if (cache.entries[i].freed_ns < cache.entries[oldest].freed_ns)
+         {
+            oldest = i;
+         }
+      }
+      close(cache.entries[oldest].fd);
+      cache_remove(oldest);
+   }
+
+   cache.entries[cache.count++] = entry;
+   cache.size += entry.size;
+   pthread_mutex_unlock(&cache.mutex);
+}
+
+/**
+ * @brief Close all cached buffers, for when allocations run out of memory.
+ *
+ * @return Whether any buffer was closed.
+ */
+static bool cache_flush(void)
+{
+   pthread_mutex_lock(&cache.mutex);
+   const bool flushed = cache.count > 0;
+   cache_trim(UINT64_MAX);
+   pthread_mutex_unlock(&cache.mutex);
+   return flushed;
+}
+
 static bool validate_parameters(const wsialloc_allocator *allocator, const wsialloc_allocate_info *info,
                                 wsialloc_allocate_result *result)
 {
@@ -130,10 +387,43 @@ static bool validate_parameters(const wsialloc_allocator *allocator, const wsial
    return true;
 }
 
+/**
+ * @brief Allocate a buffer of @p size bytes, from the cache when possible.
+ *
+ * @return The file descriptor of the buffer, negative on failure.
+ */
+static int allocate_buffer(wsialloc_allocator *allocator, wsiallocp_alloc_callback fn_alloc, const char *heap_name,
+                           const wsialloc_allocate_info *info, uint64_t size)
+{
+   int fd = -1;
+   if (heap_name != NULL)
+   {
+      fd = cache_take(heap_name, size);
+   }
+   if (fd < 0)
+   {
+      fd = fn_alloc(allocator, info, size);
+   }
+   if (fd < 0 && cache_flush())
+   {
+      /* The heap may be out of memory, try again without the buffers kept for reuse. */
+      fd = fn_alloc(allocator, info, size);
+   }
+   return fd;
+}
+
 wsialloc_error wsiallocp_alloc(wsialloc_allocator *allocator, wsiallocp_alloc_callback fn_alloc,
-                               const wsialloc_allocate_info *info, wsialloc_allocate_result *result)
+                               const char *heap_name, const wsialloc_allocate_info *info,
+                               wsialloc_allocate_result *result)
+{
+   return wsiallocp_alloc_batch(allocator, fn_alloc, heap_name, info, 1, result);
+}
+
+wsialloc_error wsiallocp_alloc_batch(wsialloc_allocator *allocator, wsiallocp_alloc_callback fn_alloc,
+                                     const char *heap_name, const wsialloc_allocate_info *info, uint32_t count,
+                                     wsialloc_allocate_result *results)
 {
-   if (!validate_parameters(allocator, info, result))
+   if (count == 0 || !validate_parameters(allocator, info, results))
    {
       return WSIALLOC_ERROR_INVALID;
    }
@@ -171,29 +461,37 @@ wsialloc_error wsiallocp_alloc(wsialloc_allocator *allocator, wsiallocp_alloc_ca
       return err;
    }
 
-   int local_fds[WSIALLOC_MAX_PLANES] = { -1, -1, -1, -1 };
-   if (!(info->flags & WSIALLOC_ALLOCATE_NO_MEMORY))
+   /* The format and layout are the same for all the buffers, only the memory is allocated per buffer. */
+   for (uint32_t i = 0; i < count; i++)
    {
-      local_fds[0] = fn_alloc(allocator, info, total_size);
-      if (local_fds[0] < 0)
+      wsialloc_allocate_result *result = &results[i];
+      if (!(info->flags & WSIALLOC_ALLOCATE_NO_MEMORY))
       {
-         return WSIALLOC_ERROR_NO_RESOURCE;
-      }
+         const int fd = allocate_buffer(allocator, fn_alloc, heap_name, info, total_size);
+         if (fd < 0)
+         {
+            for (uint32_t allocated = 0; allocated < i; allocated++)
+            {
+               close(results[allocated].buffer_fds[0]);
+               results[allocated].buffer_fds[0] = -1;
+            }
+            return WSIALLOC_ERROR_NO_RESOURCE;
+         }
 
-      assert(result->buffer_fds != NULL);
-      result->buffer_fds[0] = local_fds[0];
-      for (size_t plane = 1; plane < selected_format_desc.format_spec.nr_planes; plane++)
+         assert(result->buffer_fds != NULL);
+         for (size_t plane = 0; plane < selected_format_desc.format_spec.nr_planes; plane++)
+         {
+            result->buffer_fds[plane] = fd;
+         }
+      }
+      result->format = selected_format_desc.format;
+      for (size_t plane = 0; plane < selected_format_desc.format_spec.nr_planes; plane++)
       {
-         result->buffer_fds[plane] = result->buffer_fds[0];
+         result->average_row_strides[plane] = local_strides[plane];
+         result->offsets[plane] = local_offsets[plane];
       }
-   }
-   result->format = selected_format_desc.format;
-   for (size_t plane = 0; plane < selected_format_desc.format_spec.nr_planes; plane++)
-   {
-      result->average_row_strides[plane] = local_strides[plane];
-      result->offsets[plane] = local_offsets[plane];
-   }
 
-   result->is_disjoint = false;
+      result->is_disjoint = false;
+   }
    return WSIALLOC_ERROR_NONE;
 }
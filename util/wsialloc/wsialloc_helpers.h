@@ -39,6 +39,9 @@ typedef int (*wsiallocp_alloc_callback)(const wsialloc_allocator *allocator, con
  *
  * @param      allocator               The wsialloc allocator
  * @param      fn_alloc                The function that will be called to perform the actual memory allocation
+ * @param      heap_name               Exporter name of the buffers @p fn_alloc allocates, buffers given back with
+ *                                     wsiallocp_cache_put() by the same exporter are reused before calling
+ *                                     @p fn_alloc. NULL never reuses buffers.
  * @param      info                    The requested allocation info
  * @param[out] result                  The allocation result.
  * @retval     WSIALLOC_ERROR_NONE            Indicates success
@@ -49,4 +52,29 @@ typedef int (*wsiallocp_alloc_callback)(const wsialloc_allocator *allocator, con
  *                                               * The allocator does not support allocating with the selected flags
  */
 wsialloc_error wsiallocp_alloc(wsialloc_allocator *allocator, wsiallocp_alloc_callback fn_alloc,
-                               const wsialloc_allocate_info *info, wsialloc_allocate_result *result);
\ No newline at end of file
+                               const char *heap_name, const wsialloc_allocate_info *info,
+                               wsialloc_allocate_result *result);
+
+/**
+ * @brief Allocate @p count buffers of the same description using the allocator
+ *
+ * Helper for implementing wsialloc_alloc_batch(), see wsiallocp_alloc(). The format is selected once for all the
+ * buffers. On failure, no buffer is left allocated.
+ *
+ * @param      count    Number of buffers to allocate, at least 1.
+ * @param[out] results  Array of @p count allocation results.
+ */
+wsialloc_error wsiallocp_alloc_batch(wsialloc_allocator *allocator, wsiallocp_alloc_callback fn_alloc,
+                                     const char *heap_name, const wsialloc_allocate_info *info, uint32_t count,
+                                     wsialloc_allocate_result *results);
+
+/**
+ * @brief Give a buffer back to the process wide cache of freed buffers
+ *
+ * Helper for implementing wsialloc_free(). Buffers are kept up to WSIALLOC_CACHE_SIZE MiB in total (default 64, 0
+ * disables the cache) and closed when they stay unused for a few seconds. wsiallocp_alloc() takes its buffers from
+ * the cache before calling its allocation callback, when they come from the same dma-buf exporter.
+ *
+ * @param fd The file descriptor of the buffer, closed if the buffer is not cached.
+ */
+void wsiallocp_cache_put(int fd);
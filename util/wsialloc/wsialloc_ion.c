@@ -44,7 +44,7 @@
  *
  * This should only be increased when this implementation is updated to match newer versions of wsialloc.h.
  */
-#define WSIALLOC_IMPLEMENTATION_VERSION 3
+#define WSIALLOC_IMPLEMENTATION_VERSION 6
 
 /* Ensure we are implementing the wsialloc version matching the wsialloc.h header we are using. */
 #if WSIALLOC_IMPLEMENTATION_VERSION != WSIALLOC_INTERFACE_VERSION
@@ -182,13 +182,29 @@ static int ion_allocate(const wsialloc_allocator *allocator, const wsialloc_allo
    return allocate(allocator->fd, size, alloc_heap_id);
 }
 
-wsialloc_error wsialloc_alloc(wsialloc_allocator *allocator, const wsialloc_allocate_info *info,
-                              wsialloc_allocate_result *result)
+wsialloc_error wsialloc_alloc_batch(wsialloc_allocator *allocator, const wsialloc_allocate_info *info, uint32_t count,
+                                    wsialloc_allocate_result *results)
 {
    if ((info->flags & WSIALLOC_ALLOCATE_PROTECTED) && (!allocator->protected_heap_exists))
    {
       return WSIALLOC_ERROR_NO_RESOURCE;
    }
 
-   return wsiallocp_alloc(allocator, ion_allocate, info, result);
+   /* ION ignores the heap preferences, the buffers of its heaps are all exported as "ion". */
+   const char *heap_name = (info->flags & WSIALLOC_ALLOCATE_PROTECTED) ? NULL : "ion";
+   return wsiallocp_alloc_batch(allocator, ion_allocate, heap_name, info, count, results);
+}
+
+wsialloc_error wsialloc_alloc(wsialloc_allocator *allocator, const wsialloc_allocate_info *info,
+                              wsialloc_allocate_result *result)
+{
+   return wsialloc_alloc_batch(allocator, info, 1, result);
+}
+
+void wsialloc_free(wsialloc_allocator *allocator, int fd)
+{
+   assert(allocator != NULL);
+   (void)allocator;
+
+   wsiallocp_cache_put(fd);
 }
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file backend_swapchain.hpp
+ *
+ * @brief Swapchain class of the backend the layer is built with, when it is built with a single one.
+ *
+ * Every swapchain is then of this class, so @ref swapchain_base calls the present path of the backend directly
+ * instead of through the vtable, and the backend implementation can be inlined into it.
+ */
+
+#pragma once
+
+#if WSI_SINGLE_BACKEND
+
+#if BUILD_WSI_HEADLESS
+#include "headless/swapchain.hpp"
+#elif BUILD_WSI_WAYLAND
+#include "wayland/swapchain.hpp"
+#elif BUILD_WSI_DISPLAY
+#include "display/swapchain.hpp"
+#elif BUILD_WSI_X11
+#include "x11/swapchain.hpp"
+#else
+#error "WSI_SINGLE_BACKEND is set without a backend"
+#endif
+
+namespace wsi
+{
+
+#if BUILD_WSI_HEADLESS
+using backend_swapchain = headless::swapchain;
+#elif BUILD_WSI_WAYLAND
+using backend_swapchain = wayland::swapchain;
+#elif BUILD_WSI_DISPLAY
+using backend_swapchain = display::swapchain;
+#elif BUILD_WSI_X11
+using backend_swapchain = x11::swapchain;
+#endif
+
+} /* namespace wsi */
+
+/* The backend swapchain is final, the call cannot resolve to anything else. */
+#define WSI_BACKEND_CALL(swapchain, method) \
+   static_cast<wsi::backend_swapchain &>(swapchain).wsi::backend_swapchain::method
+
+#else
+
+#define WSI_BACKEND_CALL(swapchain, method) (swapchain).method
+
+#endif
@@ -24,16 +24,26 @@
 
 #include "drm_display.hpp"
 #include "util/custom_allocator.hpp"
+#include "util/macros.hpp"
+#include "util/thread_scheduling.hpp"
 #include "wsi/surface.hpp"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <cerrno>
+#include <climits>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <assert.h>
 #include <mutex>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <atomic>
+#include <system_error>
 #include <drm_fourcc.h>
 namespace wsi
 {
@@ -44,36 +54,51 @@ namespace display
 const std::string default_dri_device_name{ "/dev/dri/card0" };
 
 drm_display::drm_display(util::fd_owner drm_fd, int crtc_id, drm_connector_owner drm_connector,
-                         util::unique_ptr<util::vector<drm_format_pair>> supported_formats,
+                         std::array<util::unique_ptr<util::vector<drm_format_pair>>, MAX_PLANES> plane_formats,
                          util::unique_ptr<drm_display_mode> display_modes, size_t num_display_modes, uint32_t max_width,
-                         uint32_t max_height, bool supports_fb_modifiers)
+                         uint32_t max_height, bool supports_fb_modifiers,
+                         std::optional<drm_atomic_properties> atomic_properties,
+                         util::unique_ptr<page_flip_state> page_flip,
+                         util::unique_ptr<framebuffer_cache> framebuffers)
    : m_drm_fd(std::move(drm_fd))
    , m_crtc_id(crtc_id)
    , m_drm_connector(std::move(drm_connector))
-   , m_supported_formats(std::move(supported_formats))
+   , m_plane_formats(std::move(plane_formats))
    , m_display_modes(std::move(display_modes))
    , m_num_display_modes(num_display_modes)
    , m_max_width(max_width)
    , m_max_height(max_height)
    , m_supports_fb_modifiers(supports_fb_modifiers)
+   , m_atomic_properties(atomic_properties)
+   , m_page_flip(std::move(page_flip))
+   , m_framebuffers(std::move(framebuffers))
 {
 }
 
 drm_display::~drm_display()
 {
-   if (m_drm_fd.is_valid())
+   /* DRM master is dropped with the last descriptor of the device, the other displays may still use it. */
+   stop_event_thread();
+
+   if (m_framebuffers != nullptr)
    {
-      /* Finish using the DRM device. */
-      drmDropMaster(m_drm_fd.get());
+      /* Only unreferenced framebuffers are left once the swapchains are gone. */
+      for (const auto &cached : m_framebuffers->entries)
+      {
+         assert(cached.refcount == 0);
+         drmModeRmFB(m_drm_fd.get(), cached.fb_id);
+      }
    }
 }
 
 /**
- * @brief Utility function to find a compatible CRTC to drive this display's connector.
+ * @brief Utility function to find a CRTC to drive this display's connector that no other display uses.
  *
- * @return An integer < 0 on failure, otherwise a valid CRTC id.
+ * @param used_crtcs Mask of the CRTCs of the DRM resources already driving other displays, bit i for CRTC i.
+ * @return An integer < 0 on failure, otherwise the index of the CRTC in the DRM resources.
  */
-static int find_compatible_crtc(int fd, drm_resources_owner &resources, drm_connector_owner &connector)
+static int find_compatible_crtc(int fd, drm_resources_owner &resources, drm_connector_owner &connector,
+                                uint32_t used_crtcs)
 {
    assert(resources);
    assert(connector);
@@ -88,18 +113,16 @@ static int find_compatible_crtc(int fd, drm_resources_owner &resources, drm_conn
       }
 
       /* Iterate over all global CRTCs. */
-      for (int j = 0; j < resources->count_crtcs; j++)
+      for (int j = 0; j < resources->count_crtcs && j < 32; j++)
       {
-         /* Is this encoder compatible with the CRTC? */
-         if (!(encoder->possible_crtcs & (1 << j)))
+         /* Is this encoder compatible with the CRTC, and is the CRTC free? */
+         if (!(encoder->possible_crtcs & (1u << j)) || (used_crtcs & (1u << j)))
          {
             /* Encoder not compatible, so skip this CRTC. */
             continue;
          }
 
-         /* Make the assumption that only one connector will be in use at a time so there is no
-          * need to check that any other connectors are being driven by this CRTC. */
-         return resources->crtcs[j];
+         return j;
       }
    }
 
@@ -109,12 +132,12 @@ static int find_compatible_crtc(int fd, drm_resources_owner &resources, drm_conn
 }
 
 static bool find_primary_plane(const util::fd_owner &drm_fd, const drm_plane_resources_owner &plane_res,
-                               drm_plane_owner &primary_plane, uint32_t &primary_plane_index)
+                               int crtc_index, drm_plane_owner &primary_plane, uint32_t &primary_plane_index)
 {
    for (uint32_t i = 0; i < plane_res->count_planes; i++)
    {
       drm_plane_owner temp_plane{ drmModeGetPlane(drm_fd.get(), plane_res->planes[i]) };
-      if (temp_plane != nullptr)
+      if (temp_plane != nullptr && (temp_plane->possible_crtcs & (1u << crtc_index)))
       {
          drm_object_properties_owner props{ drmModeObjectGetProperties(drm_fd.get(), plane_res->planes[i],
                                                                        DRM_MODE_OBJECT_PLANE) };
@@ -146,12 +169,12 @@ static bool find_primary_plane(const util::fd_owner &drm_fd, const drm_plane_res
    return false;
 }
 
-static bool fill_supported_formats(const drm_plane_owner &primary_plane,
+static bool fill_supported_formats(const drm_plane_owner &plane,
                                    util::vector<drm_format_pair> &supported_formats)
 {
-   for (uint32_t i = 0; i < primary_plane->count_formats; i++)
+   for (uint32_t i = 0; i < plane->count_formats; i++)
    {
-      if (!supported_formats.try_push_back(drm_format_pair{ primary_plane->formats[i], DRM_FORMAT_MOD_LINEAR }))
+      if (!supported_formats.try_push_back(drm_format_pair{ plane->formats[i], DRM_FORMAT_MOD_LINEAR }))
       {
          WSI_LOG_ERROR("Out of host memory.");
          return false;
@@ -161,12 +184,11 @@ static bool fill_supported_formats(const drm_plane_owner &primary_plane,
    return true;
 }
 
-static bool fill_supported_formats_with_modifiers(uint32_t primary_plane_index, const util::fd_owner &drm_fd,
-                                                  const drm_plane_resources_owner &plane_res,
+static bool fill_supported_formats_with_modifiers(uint32_t plane_id, const util::fd_owner &drm_fd,
                                                   util::vector<drm_format_pair> &supported_formats)
 {
-   drm_object_properties_owner object_properties{ drmModeObjectGetProperties(
-      drm_fd.get(), plane_res->planes[primary_plane_index], DRM_MODE_OBJECT_PLANE) };
+   drm_object_properties_owner object_properties{ drmModeObjectGetProperties(drm_fd.get(), plane_id,
+                                                                             DRM_MODE_OBJECT_PLANE) };
    if (object_properties == nullptr)
    {
       return false;
@@ -202,55 +224,262 @@ static bool fill_supported_formats_with_modifiers(uint32_t primary_plane_index,
    return true;
 }
 
-std::optional<drm_display> drm_display::make_display(const util::allocator &allocator, const char *drm_device)
+/**
+ * @brief Allocate the list of the formats and modifiers a plane can scan out, from its IN_FORMATS blob when
+ *        framebuffers with modifiers are supported, otherwise its linear formats.
+ *
+ * @return The formats, nullptr when out of memory or when the plane cannot be queried.
+ */
+static util::unique_ptr<util::vector<drm_format_pair>> get_plane_formats(const util::allocator &allocator,
+                                                                         const util::fd_owner &drm_fd,
+                                                                         uint32_t plane_id, bool supports_fb_modifiers)
 {
-   util::fd_owner drm_fd{ open(drm_device, O_RDWR | O_CLOEXEC, 0) };
+   auto formats = allocator.make_unique<util::vector<drm_format_pair>>(allocator);
+   if (formats == nullptr)
+   {
+      return nullptr;
+   }
 
-   if (!drm_fd.is_valid())
+   if (supports_fb_modifiers && fill_supported_formats_with_modifiers(plane_id, drm_fd, *formats) &&
+       !formats->empty())
    {
-      WSI_LOG_ERROR("Failed to open DRM device %s.", drm_device);
-      return std::nullopt;
+      return formats;
+   }
+
+   /* Fall back to the linear formats */
+   formats->clear();
+   drm_plane_owner plane{ drmModeGetPlane(drm_fd.get(), plane_id) };
+   if (plane == nullptr || !fill_supported_formats(plane, *formats))
+   {
+      return nullptr;
+   }
+   return formats;
+}
+
+/**
+ * @brief Utility function to find a KMS property of a DRM object.
+ *
+ * @return The property, nullptr when the object has no property called @p name.
+ */
+static drm_property_owner find_property(int fd, uint32_t object_id, uint32_t object_type, const char *name)
+{
+   drm_object_properties_owner props{ drmModeObjectGetProperties(fd, object_id, object_type) };
+   if (props == nullptr)
+   {
+      return nullptr;
    }
 
-   /* Get the DRM master permission so that mode can be set on the drm device later. */
-   if (!drmIsMaster(drm_fd.get()))
+   for (uint32_t i = 0; i < props->count_props; i++)
    {
-      if (drmSetMaster(drm_fd.get()) != 0)
+      drm_property_owner prop{ drmModeGetProperty(fd, props->props[i]) };
+      if (prop != nullptr && !strcmp(prop->name, name))
       {
-         WSI_LOG_ERROR("Failed to set DRM master: %s.", std::strerror(errno));
-         return std::nullopt;
+         return prop;
       }
    }
 
-   drm_resources_owner resources{ drmModeGetResources(drm_fd.get()) };
-   if (resources == nullptr)
+   return nullptr;
+}
+
+/**
+ * @brief Utility function to find the id of a KMS property of a DRM object.
+ *
+ * @return The property id, 0 when the object has no property called @p name.
+ */
+static uint32_t find_property_id(int fd, uint32_t object_id, uint32_t object_type, const char *name)
+{
+   drm_property_owner prop = find_property(fd, object_id, object_type, name);
+   return prop != nullptr ? prop->prop_id : 0;
+}
+
+/**
+ * @brief Utility function to read the current value of a KMS property of a DRM object.
+ *
+ * @return true on success, false when the object has no property called @p name.
+ */
+static bool get_property_value(int fd, uint32_t object_id, uint32_t object_type, const char *name, uint64_t &value)
+{
+   drm_object_properties_owner props{ drmModeObjectGetProperties(fd, object_id, object_type) };
+   if (props == nullptr)
    {
-      WSI_LOG_ERROR("Failed to get DRM resources.");
-      return std::nullopt;
+      return false;
    }
 
-   drm_connector_owner connector{ nullptr };
-   int crtc_id = -1;
-   for (int i = 0; i < resources->count_connectors; ++i)
+   for (uint32_t i = 0; i < props->count_props; i++)
    {
-      drm_connector_owner temp_connector{ drmModeGetConnector(drm_fd.get(), resources->connectors[i]) };
-      if (temp_connector != nullptr && temp_connector->connection == DRM_MODE_CONNECTED)
+      drm_property_owner prop{ drmModeGetProperty(fd, props->props[i]) };
+      if (prop != nullptr && !strcmp(prop->name, name))
       {
-         crtc_id = find_compatible_crtc(drm_fd.get(), resources, temp_connector);
-         if (crtc_id >= 0)
-         {
-            connector = std::move(temp_connector);
-            break;
-         }
+         value = props->prop_values[i];
+         return true;
       }
    }
 
-   if (connector == nullptr)
+   return false;
+}
+
+/**
+ * @brief Look up the properties atomic commits set on a plane.
+ *
+ * @return true when the plane has all the properties needed to show an image on it.
+ */
+static bool find_plane_properties(int fd, uint32_t plane_id, drm_plane_properties &props)
+{
+   props = {};
+   props.plane_id = plane_id;
+   props.fb_id = find_property_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID");
+   props.crtc_id = find_property_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_ID");
+   props.src_x = find_property_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "SRC_X");
+   props.src_y = find_property_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "SRC_Y");
+   props.src_w = find_property_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "SRC_W");
+   props.src_h = find_property_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "SRC_H");
+   props.crtc_x = find_property_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_X");
+   props.crtc_y = find_property_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_Y");
+   props.crtc_w = find_property_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_W");
+   props.crtc_h = find_property_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_H");
+   /* Optional, not part of the required properties below. */
+   props.in_fence_fd = find_property_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "IN_FENCE_FD");
+
+   /* Planes with an immutable zpos always stack the same way, there is nothing to commit. */
+   drm_property_owner zpos{ find_property(fd, plane_id, DRM_MODE_OBJECT_PLANE, "zpos") };
+   if (zpos != nullptr && (zpos->flags & DRM_MODE_PROP_IMMUTABLE) == 0 && (zpos->flags & DRM_MODE_PROP_RANGE) != 0 &&
+       zpos->count_values >= 2)
+   {
+      props.zpos = zpos->prop_id;
+      props.zpos_min = zpos->values[0];
+      props.zpos_max = zpos->values[1];
+   }
+
+   const uint32_t ids[] = { props.fb_id,  props.crtc_id, props.src_x,  props.src_y,  props.src_w,
+                            props.src_h,  props.crtc_x,  props.crtc_y, props.crtc_w, props.crtc_h };
+   return std::find(std::begin(ids), std::end(ids), 0) == std::end(ids);
+}
+
+/**
+ * @brief Enable atomic modesetting and look up the properties the swapchains commit.
+ *
+ * @param[out] primary_plane Properties of the primary plane, only valid when atomic modesetting is used.
+ *
+ * @return The connector and CRTC property ids, std::nullopt when the device only supports legacy modesetting.
+ */
+static std::optional<drm_atomic_properties> find_atomic_properties(int fd, uint32_t connector_id, uint32_t crtc_id,
+                                                                   uint32_t primary_plane_id,
+                                                                   drm_plane_properties &primary_plane)
+{
+   if (drmSetClientCap(fd, DRM_CLIENT_CAP_ATOMIC, 1) != 0)
+   {
+      WSI_LOG_INFO("DRM device does not support atomic modesetting, using legacy modesetting.");
+      return std::nullopt;
+   }
+
+   drm_atomic_properties props{};
+   props.connector_crtc_id = find_property_id(fd, connector_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID");
+   props.crtc_mode_id = find_property_id(fd, crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID");
+   props.crtc_active = find_property_id(fd, crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE");
+
+   const bool has_plane_properties = find_plane_properties(fd, primary_plane_id, primary_plane);
+   if (!has_plane_properties || props.connector_crtc_id == 0 || props.crtc_mode_id == 0 || props.crtc_active == 0)
    {
-      WSI_LOG_ERROR("Failed to find connector for DRM device.");
+      WSI_LOG_WARNING("DRM device is missing atomic modesetting properties, using legacy modesetting.");
+      drmSetClientCap(fd, DRM_CLIENT_CAP_ATOMIC, 0);
       return std::nullopt;
    }
 
+   /* The connector reports whether the connected panel supports adaptive sync, the CRTC whether it can drive it. */
+   uint64_t vrr_capable = 0;
+   if (get_property_value(fd, connector_id, DRM_MODE_OBJECT_CONNECTOR, "vrr_capable", vrr_capable) &&
+       vrr_capable != 0)
+   {
+      props.crtc_vrr_enabled = find_property_id(fd, crtc_id, DRM_MODE_OBJECT_CRTC, "VRR_ENABLED");
+   }
+   if (props.crtc_vrr_enabled != 0)
+   {
+      WSI_LOG_INFO("Display supports variable refresh rate.");
+   }
+
+   return props;
+}
+
+/**
+ * @brief Add the overlay planes that can be attached to the CRTC at @p crtc_index of the DRM resources after the
+ *        planes already in @p planes.
+ *
+ * @param claimed_planes Ids of the planes other displays of the device show their images on, they are skipped.
+ */
+static void find_overlay_planes(int fd, const drm_plane_resources_owner &plane_res, int crtc_index,
+                                const util::vector<uint32_t> &claimed_planes,
+                                std::array<drm_plane_properties, drm_display::MAX_PLANES> &planes,
+                                uint32_t &num_planes)
+{
+   for (uint32_t i = 0; i < plane_res->count_planes && num_planes < planes.size(); i++)
+   {
+      drm_plane_owner plane{ drmModeGetPlane(fd, plane_res->planes[i]) };
+      if (plane == nullptr || !(plane->possible_crtcs & (1u << crtc_index)) ||
+          std::find(claimed_planes.begin(), claimed_planes.end(), plane_res->planes[i]) != claimed_planes.end())
+      {
+         continue;
+      }
+
+      uint64_t type = 0;
+      if (!get_property_value(fd, plane_res->planes[i], DRM_MODE_OBJECT_PLANE, "type", type) ||
+          type != DRM_PLANE_TYPE_OVERLAY)
+      {
+         continue;
+      }
+
+      if (find_plane_properties(fd, plane_res->planes[i], planes[num_planes]))
+      {
+         num_planes++;
+      }
+   }
+}
+
+/**
+ * @brief Get a descriptor of the DRM device for a display that is not the first one of the device.
+ *
+ * The display's connector, CRTC and planes are leased from @p device_fd, so the display has its own DRM master and
+ * page flip events from the other heads. When the device does not support leases the descriptor is shared.
+ *
+ * @param shared Set when the descriptor is shared with the other displays of the device.
+ */
+static util::fd_owner lease_display_objects(const util::fd_owner &device_fd, uint32_t connector_id, uint32_t crtc_id,
+                                            const std::array<drm_plane_properties, drm_display::MAX_PLANES> &planes,
+                                            uint32_t num_planes, bool atomic, bool &shared)
+{
+   std::array<uint32_t, 2 + drm_display::MAX_PLANES> objects{};
+   uint32_t num_objects = 0;
+   objects[num_objects++] = connector_id;
+   objects[num_objects++] = crtc_id;
+   for (uint32_t i = 0; i < num_planes; i++)
+   {
+      objects[num_objects++] = planes[i].plane_id;
+   }
+
+   uint32_t lessee_id = 0;
+   util::fd_owner lease_fd{ drmModeCreateLease(device_fd.get(), objects.data(), static_cast<int>(num_objects),
+                                               O_CLOEXEC, &lessee_id) };
+   /* Client capabilities belong to the file, the lease needs them again. */
+   if (lease_fd.is_valid() && drmSetClientCap(lease_fd.get(), DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) == 0 &&
+       (!atomic || drmSetClientCap(lease_fd.get(), DRM_CLIENT_CAP_ATOMIC, 1) == 0))
+   {
+      shared = false;
+      return lease_fd;
+   }
+
+   WSI_LOG_WARNING("Failed to lease the objects of DRM connector %u, sharing the DRM device with the other displays.",
+                   connector_id);
+   shared = true;
+   return util::fd_owner{ fcntl(device_fd.get(), F_DUPFD_CLOEXEC, 0) };
+}
+
+std::optional<drm_display> drm_display::make_display(const util::allocator &allocator, const util::fd_owner &device_fd,
+                                                     bool duplicate_fd, drm_resources_owner &resources,
+                                                     const drm_plane_resources_owner &plane_res,
+                                                     drm_connector_owner connector, int crtc_index,
+                                                     util::vector<uint32_t> &claimed_planes)
+{
+   const int crtc_id = static_cast<int>(resources->crtcs[crtc_index]);
+
    uint32_t max_width = 0;
    uint32_t max_height = 0;
    util::vector<drm_display_mode> display_modes{ allocator };
@@ -283,22 +512,10 @@ std::optional<drm_display> drm_display::make_display(const util::allocator &allo
       return std::nullopt;
    }
 
-   /* Allow userspace to query native primary plane information */
-   if (drmSetClientCap(drm_fd.get(), DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) != 0)
-   {
-      return std::nullopt;
-   }
-
-   drm_plane_resources_owner plane_res{ drmModeGetPlaneResources(drm_fd.get()) };
-   if (plane_res == nullptr || plane_res->count_planes == 0)
-   {
-      return std::nullopt;
-   }
-
    uint32_t primary_plane_index = std::numeric_limits<uint32_t>::max();
    drm_plane_owner primary_plane{ nullptr };
 
-   if (!find_primary_plane(drm_fd, plane_res, primary_plane, primary_plane_index))
+   if (!find_primary_plane(device_fd, plane_res, crtc_index, primary_plane, primary_plane_index))
    {
       WSI_LOG_ERROR("Failed to find primary plane for display.");
       return std::nullopt;
@@ -311,143 +528,662 @@ std::optional<drm_display> drm_display::make_display(const util::allocator &allo
 
 #if WSI_DISPLAY_SUPPORT_FORMAT_MODIFIERS
    uint64_t addfb2_modifier_support = 0;
-   if (drmGetCap(drm_fd.get(), DRM_CAP_ADDFB2_MODIFIERS, &addfb2_modifier_support) == 0)
+   if (drmGetCap(device_fd.get(), DRM_CAP_ADDFB2_MODIFIERS, &addfb2_modifier_support) == 0)
    {
       supports_fb_modifiers = addfb2_modifier_support;
    }
 #endif
 
-   auto supported_formats = allocator.make_unique<util::vector<drm_format_pair>>(allocator);
+   auto page_flip = allocator.make_unique<page_flip_state>();
+   auto framebuffers = allocator.make_unique<framebuffer_cache>(allocator);
+   if (page_flip == nullptr || framebuffers == nullptr)
+   {
+      WSI_LOG_ERROR("Failed to allocate memory for the page flip state.");
+      return std::nullopt;
+   }
+
+   const uint32_t primary_plane_id = plane_res->planes[primary_plane_index];
+   auto atomic_properties = find_atomic_properties(device_fd.get(), connector->connector_id,
+                                                   static_cast<uint32_t>(crtc_id), primary_plane_id,
+                                                   page_flip->plane_properties[0]);
+   if (atomic_properties.has_value())
+   {
+      page_flip->num_planes = 1;
+      find_overlay_planes(device_fd.get(), plane_res, crtc_index, claimed_planes, page_flip->plane_properties,
+                          page_flip->num_planes);
+   }
+   else
+   {
+      /* Legacy page flips only show images on the primary plane. */
+      page_flip->plane_properties[0] = {};
+      page_flip->plane_properties[0].plane_id = primary_plane_id;
+      page_flip->num_planes = 1;
+   }
+
+   uint64_t monotonic_timestamps = 0;
+   if (drmGetCap(device_fd.get(), DRM_CAP_TIMESTAMP_MONOTONIC, &monotonic_timestamps) == 0)
+   {
+      page_flip->monotonic_timestamps = monotonic_timestamps != 0;
+   }
 
-   if (supports_fb_modifiers)
+   /* Overlays often scan out fewer formats and modifiers than the primary plane, each gets its own list. */
+   std::array<util::unique_ptr<util::vector<drm_format_pair>>, MAX_PLANES> plane_formats;
+   for (uint32_t i = 0; i < page_flip->num_planes; i++)
    {
-      if (!fill_supported_formats_with_modifiers(primary_plane_index, drm_fd, plane_res, *supported_formats))
+      plane_formats[i] =
+         get_plane_formats(allocator, device_fd, page_flip->plane_properties[i].plane_id, supports_fb_modifiers);
+      if (plane_formats[i] == nullptr)
       {
-         /* Fall back to the linear formats */
-         if (!fill_supported_formats(primary_plane, *supported_formats))
-         {
-            return std::nullopt;
-         }
+         WSI_LOG_ERROR("Failed to get the formats of display plane %u.", i);
+         return std::nullopt;
       }
    }
+
+   /* Each display gets its own descriptor, its DRM event thread only sees the page flip events of its CRTC. */
+   bool shared_fd = false;
+   util::fd_owner drm_fd;
+   if (duplicate_fd)
+   {
+      drm_fd = util::fd_owner{ fcntl(device_fd.get(), F_DUPFD_CLOEXEC, 0) };
+   }
    else
    {
-      if (!fill_supported_formats(primary_plane, *supported_formats))
+      drm_fd = lease_display_objects(device_fd, connector->connector_id, static_cast<uint32_t>(crtc_id),
+                                     page_flip->plane_properties, page_flip->num_planes, atomic_properties.has_value(),
+                                     shared_fd);
+   }
+   if (!drm_fd.is_valid())
+   {
+      WSI_LOG_ERROR("Failed to duplicate the DRM device descriptor: %s.", std::strerror(errno));
+      return std::nullopt;
+   }
+   if (shared_fd)
+   {
+      /* The event threads of the displays sharing the file race to read the events, the losers must not block. */
+      fcntl(drm_fd.get(), F_SETFL, fcntl(drm_fd.get(), F_GETFL) | O_NONBLOCK);
+   }
+   page_flip->drm_fd = drm_fd.get();
+   page_flip->crtc_id = static_cast<uint32_t>(crtc_id);
+
+   for (uint32_t i = 0; i < page_flip->num_planes; i++)
+   {
+      if (!claimed_planes.try_push_back(page_flip->plane_properties[i].plane_id))
       {
+         WSI_LOG_ERROR("Out of host memory.");
          return std::nullopt;
       }
    }
 
    std::copy(display_modes.begin(), display_modes.end(), display_modes_mem.get());
 
-   drm_display display{
-      std::move(drm_fd),    crtc_id,   std::move(connector), std::move(supported_formats), std::move(display_modes_mem),
-      display_modes.size(), max_width, max_height,           supports_fb_modifiers
-   };
+   drm_display display{ std::move(drm_fd),
+                        crtc_id,
+                        std::move(connector),
+                        std::move(plane_formats),
+                        std::move(display_modes_mem),
+                        display_modes.size(),
+                        max_width,
+                        max_height,
+                        supports_fb_modifiers,
+                        atomic_properties,
+                        std::move(page_flip),
+                        std::move(framebuffers) };
 
    return std::make_optional(std::move(display));
 }
 
-std::optional<drm_display> &drm_display::get_display()
-{
-   static std::once_flag flag{};
-   static std::optional<drm_display> display{ std::nullopt };
-
-   std::call_once(flag, []() {
-      const char *dri_device = std::getenv("WSI_DISPLAY_DRI_DEV");
-      if (!dri_device)
-      {
-         dri_device = default_dri_device_name.c_str();
-      }
-
-      display = drm_display::make_display(util::allocator::get_generic(), dri_device);
-   });
-   return display;
-}
-
-const util::vector<drm_format_pair> *drm_display::get_supported_formats() const
+/**
+ * @brief Get a connector without probing it when the kernel already knows its state. Probing reads the EDID of the
+ *        panel, which can take tens of milliseconds per connector.
+ */
+static drm_connector_owner get_connector_lazily(int fd, uint32_t connector_id)
 {
-   return m_supported_formats.get();
+   drm_connector_owner connector{ drmModeGetConnectorCurrent(fd, connector_id) };
+   if (connector == nullptr || connector->connection == DRM_MODE_UNKNOWNCONNECTION ||
+       (connector->connection == DRM_MODE_CONNECTED && connector->count_modes == 0))
+   {
+      connector = drm_connector_owner{ drmModeGetConnector(fd, connector_id) };
+   }
+   return connector;
 }
 
-bool drm_display::is_format_supported(const drm_format_pair &format) const
+/**
+ * @brief Open a socket receiving the uevents of the kernel, which reports connector hotplugs with them.
+ *
+ * @return The socket, invalid when uevents are not available.
+ */
+static util::fd_owner open_uevent_socket()
 {
-   auto supported_format =
-      std::find_if(m_supported_formats->begin(), m_supported_formats->end(), [format](const auto &supported_format) {
-         return format.fourcc == supported_format.fourcc && format.modifier == supported_format.modifier;
-      });
+   util::fd_owner uevent_fd{ socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT) };
+   if (!uevent_fd.is_valid())
+   {
+      WSI_LOG_WARNING("Failed to open the uevent socket, display hotplugs are not detected: %s.", std::strerror(errno));
+      return uevent_fd;
+   }
 
-   return supported_format != m_supported_formats->end();
+   struct sockaddr_nl address = {};
+   address.nl_family = AF_NETLINK;
+   /* The kernel's own multicast group, present without udev. */
+   address.nl_groups = 1;
+   if (bind(uevent_fd.get(), reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0)
+   {
+      WSI_LOG_WARNING("Failed to bind the uevent socket, display hotplugs are not detected: %s.", std::strerror(errno));
+      return util::fd_owner{};
+   }
+   return uevent_fd;
 }
 
-bool drm_display::supports_fb_modifiers() const
+/**
+ * @brief Read the uevents queued on @p uevent_fd.
+ *
+ * @return Whether one of them reports a DRM hotplug.
+ */
+static bool read_hotplug_events(int uevent_fd)
 {
-   return m_supports_fb_modifiers;
-}
+   bool hotplug = false;
+   std::array<char, 4096> buffer;
+   while (true)
+   {
+      ssize_t size = recv(uevent_fd, buffer.data(), buffer.size() - 1, 0);
+      if (size <= 0)
+      {
+         break;
+      }
+      buffer[size] = '\0';
 
-drm_display_mode::drm_display_mode()
-   : m_drm_mode_info{}
-   , m_preferred(false)
-{
+      /* An ACTION@DEVPATH header followed by NUL separated KEY=VALUE fields. */
+      bool drm_subsystem = false;
+      bool drm_hotplug = false;
+      for (const char *field = buffer.data(); field < buffer.data() + size; field += std::strlen(field) + 1)
+      {
+         drm_subsystem = drm_subsystem || std::strcmp(field, "SUBSYSTEM=drm") == 0;
+         drm_hotplug = drm_hotplug || std::strcmp(field, "HOTPLUG=1") == 0;
+      }
+      hotplug = hotplug || (drm_subsystem && drm_hotplug);
+   }
+   return hotplug;
 }
 
-uint16_t drm_display_mode::get_width() const
+/**
+ * @brief A DRM device with displays, kept open to probe its connectors again after hotplugs.
+ */
+struct drm_display::probed_device
 {
-   return m_drm_mode_info.hdisplay;
-}
+   probed_device(const util::allocator &allocator, util::fd_owner fd)
+      : drm_fd(std::move(fd))
+      , claimed_planes(allocator)
+      , displays(allocator)
+   {
+   }
 
-uint16_t drm_display_mode::get_height() const
-{
-   return m_drm_mode_info.vdisplay;
-}
+   /* DRM master, the displays lease their objects from it. */
+   util::fd_owner drm_fd;
+   /* False when another process, such as the X server, is DRM master, the displays need a lease from it to modeset. */
+   bool master{ true };
+   /* Mask of the CRTCs of the DRM resources driving displays. */
+   uint32_t used_crtcs{ 0 };
+   util::vector<uint32_t> claimed_planes;
+   util::vector<drm_display *> displays;
+};
 
-uint32_t drm_display_mode::get_refresh_rate() const
+/**
+ * @brief The displays of all the DRM devices.
+ *
+ * Displays are only added, by probes serialized with @p mutex. Readers see the first @p num_displays without locking.
+ */
+struct drm_display::registry
 {
-   /* DRM provides refresh rate in Hz and vulkan expects mHz */
-   return m_drm_mode_info.vrefresh * 1000;
-}
+   registry(const util::allocator &allocator)
+      : devices(allocator)
+   {
+   }
 
-drmModeModeInfo drm_display_mode::get_drm_mode() const
+   std::mutex mutex;
+   std::array<util::unique_ptr<drm_display>, MAX_DISPLAYS> displays;
+   std::array<std::atomic<bool>, MAX_DISPLAYS> connected{};
+   std::atomic<uint32_t> num_displays{ 0 };
+   /* State of the displays driven through a lease before they were leased, see drm_display::acquire_lease. */
+   std::array<util::unique_ptr<drm_display>, MAX_DISPLAYS> unleased;
+   util::vector<util::unique_ptr<probed_device>> devices;
+   util::fd_owner uevent_fd;
+};
+
+bool drm_display::add_device(const util::allocator &allocator, const char *drm_device, registry &displays)
 {
-   return m_drm_mode_info;
-}
+   util::fd_owner drm_fd{ open(drm_device, O_RDWR | O_CLOEXEC, 0) };
 
-void drm_display_mode::set_drm_mode(drmModeModeInfo mode)
-{
-   m_drm_mode_info = mode;
-}
+   if (!drm_fd.is_valid())
+   {
+      WSI_LOG_ERROR("Failed to open DRM device %s.", drm_device);
+      return true;
+   }
 
-bool drm_display_mode::is_preferred() const
-{
-   return m_preferred;
-}
+   drm_resources_owner resources{ drmModeGetResources(drm_fd.get()) };
+   if (resources == nullptr || resources->count_connectors == 0 || resources->count_crtcs == 0)
+   {
+      /* Render-only GPUs have no KMS resources. */
+      WSI_LOG_INFO("DRM device %s has no display outputs.", drm_device);
+      return true;
+   }
 
-void drm_display_mode::set_preferred(bool preferred)
-{
-   m_preferred = preferred;
-}
+   /* Get the DRM master permission so that mode can be set on the drm device later. Without it the displays are still
+    * listed, applications acquire them with a lease from the master, e.g. with vkAcquireXlibDisplayEXT. */
+   bool master = drmIsMaster(drm_fd.get()) || drmSetMaster(drm_fd.get()) == 0;
+   if (!master)
+   {
+      WSI_LOG_INFO("Not DRM master of %s (%s), its displays need to be acquired.", drm_device, std::strerror(errno));
+   }
 
-drm_display_mode *drm_display::get_display_modes_begin() const
-{
-   return m_display_modes.get();
-}
+   /* Allow userspace to query native primary plane information */
+   if (drmSetClientCap(drm_fd.get(), DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) != 0)
+   {
+      return true;
+   }
 
-drm_display_mode *drm_display::get_display_modes_end() const
-{
-   return m_display_modes.get() + m_num_display_modes;
-}
+   auto device = allocator.make_unique<probed_device>(allocator, std::move(drm_fd));
+   if (device == nullptr || !displays.devices.try_push_back(std::move(device)))
+   {
+      WSI_LOG_ERROR("Out of host memory.");
+      return false;
+   }
+   displays.devices.back()->master = master;
 
-size_t drm_display::get_num_display_modes() const
-{
-   return m_num_display_modes;
+   if (!probe_connectors(allocator, *displays.devices.back(), displays))
+   {
+      return false;
+   }
+   if (displays.devices.back()->displays.empty())
+   {
+      WSI_LOG_ERROR("Failed to find connector for DRM device %s.", drm_device);
+   }
+   return true;
 }
 
-int drm_display::get_drm_fd() const
+bool drm_display::probe_connectors(const util::allocator &allocator, probed_device &device, registry &displays)
 {
-   return m_drm_fd.get();
-}
+   drm_resources_owner resources{ drmModeGetResources(device.drm_fd.get()) };
+   drm_plane_resources_owner plane_res{ drmModeGetPlaneResources(device.drm_fd.get()) };
+   if (resources == nullptr || plane_res == nullptr || plane_res->count_planes == 0)
+   {
+      return true;
+   }
 
-uint32_t drm_display::get_connector_id() const
+   for (int i = 0; i < resources->count_connectors; ++i)
+   {
+      const uint32_t connector_id = resources->connectors[i];
+      auto existing =
+         std::find_if(device.displays.begin(), device.displays.end(),
+                      [connector_id](drm_display *display) { return display->get_connector_id() == connector_id; });
+      if (existing != device.displays.end())
+      {
+         /* After a hotplug the kernel already probed the connectors, their current state is up to date. */
+         drm_connector_owner connector{ drmModeGetConnectorCurrent(device.drm_fd.get(), connector_id) };
+         const bool connected = connector != nullptr && connector->connection == DRM_MODE_CONNECTED;
+         displays.connected[(*existing)->m_registry_index].store(connected, std::memory_order_release);
+         continue;
+      }
+
+      drm_connector_owner connector = get_connector_lazily(device.drm_fd.get(), connector_id);
+      if (connector == nullptr || connector->connection != DRM_MODE_CONNECTED)
+      {
+         continue;
+      }
+
+      const uint32_t index = displays.num_displays.load(std::memory_order_relaxed);
+      if (index >= MAX_DISPLAYS)
+      {
+         WSI_LOG_WARNING("Too many displays, DRM connector %u is ignored.", connector_id);
+         continue;
+      }
+
+      int crtc_index = find_compatible_crtc(device.drm_fd.get(), resources, connector, device.used_crtcs);
+      if (crtc_index < 0)
+      {
+         continue;
+      }
+
+      auto display = make_display(allocator, device.drm_fd, device.displays.empty() || !device.master, resources,
+                                  plane_res, std::move(connector), crtc_index, device.claimed_planes);
+      if (!display.has_value())
+      {
+         WSI_LOG_ERROR("Failed to create the display of DRM connector %u.", connector_id);
+         continue;
+      }
+      display->m_registry_index = index;
+
+      displays.displays[index] = allocator.make_unique<drm_display>(std::move(*display));
+      if (displays.displays[index] == nullptr || !device.displays.try_push_back(displays.displays[index].get()))
+      {
+         WSI_LOG_ERROR("Out of host memory.");
+         displays.displays[index].reset();
+         return false;
+      }
+      device.used_crtcs |= 1u << crtc_index;
+
+      /* Published last, readers do not lock. */
+      displays.connected[index].store(true, std::memory_order_release);
+      displays.num_displays.store(index + 1, std::memory_order_release);
+   }
+
+   return true;
+}
+
+drm_display::registry &drm_display::get_registry()
+{
+   static std::once_flag flag{};
+   static registry displays{ util::allocator::get_generic() };
+
+   std::call_once(flag, []() {
+      const util::allocator &allocator = util::allocator::get_generic();
+      std::lock_guard<std::mutex> lock(displays.mutex);
+
+      /* Opened before the first probe, so no hotplug is missed. */
+      displays.uevent_fd = open_uevent_socket();
+
+      const char *dri_devices = std::getenv("WSI_DISPLAY_DRI_DEV");
+      if (dri_devices != nullptr)
+      {
+         /* A colon separated list of the DRM devices to drive. */
+         while (*dri_devices != '\0')
+         {
+            const char *separator = std::strchr(dri_devices, ':');
+            const size_t length = separator != nullptr ? static_cast<size_t>(separator - dri_devices) :
+                                                         std::strlen(dri_devices);
+            char dri_device[PATH_MAX];
+            if (length > 0 && length < sizeof(dri_device))
+            {
+               std::memcpy(dri_device, dri_devices, length);
+               dri_device[length] = '\0';
+               if (!add_device(allocator, dri_device, displays))
+               {
+                  return;
+               }
+            }
+            dri_devices += separator != nullptr ? length + 1 : length;
+         }
+         return;
+      }
+
+      /* Without a list, every DRM device with display outputs is driven, so each GPU's heads can be presented to. */
+      int num_devices = drmGetDevices2(0, nullptr, 0);
+      util::vector<drmDevicePtr> devices{ allocator };
+      if (num_devices <= 0 || !devices.try_resize(static_cast<size_t>(num_devices)) ||
+          (num_devices = drmGetDevices2(0, devices.data(), num_devices)) <= 0)
+      {
+         add_device(allocator, default_dri_device_name.c_str(), displays);
+         return;
+      }
+
+      for (int i = 0; i < num_devices; i++)
+      {
+         if ((devices[i]->available_nodes & (1 << DRM_NODE_PRIMARY)) &&
+             !add_device(allocator, devices[i]->nodes[DRM_NODE_PRIMARY], displays))
+         {
+            break;
+         }
+      }
+      drmFreeDevices(devices.data(), num_devices);
+   });
+   return displays;
+}
+
+uint32_t drm_display::get_num_displays()
+{
+   registry &displays = get_registry();
+
+   /* Connector probes are cached until the kernel reports a hotplug. */
+   if (displays.uevent_fd.is_valid() && read_hotplug_events(displays.uevent_fd.get()))
+   {
+      std::lock_guard<std::mutex> lock(displays.mutex);
+      for (auto &device : displays.devices)
+      {
+         if (!probe_connectors(util::allocator::get_generic(), *device, displays))
+         {
+            break;
+         }
+      }
+   }
+
+   return displays.num_displays.load(std::memory_order_acquire);
+}
+
+drm_display &drm_display::get_display_at(uint32_t index)
+{
+   registry &displays = get_registry();
+   assert(index < displays.num_displays.load(std::memory_order_acquire));
+   return *displays.displays[index];
+}
+
+drm_display *drm_display::get_display(VkDisplayKHR display)
+{
+   registry &displays = get_registry();
+   const uint32_t num_displays = displays.num_displays.load(std::memory_order_acquire);
+   for (uint32_t i = 0; i < num_displays; i++)
+   {
+      if (displays.displays[i]->get_handle() == display)
+      {
+         return displays.displays[i].get();
+      }
+   }
+   return nullptr;
+}
+
+drm_display *drm_display::get_display(const drm_display_mode *mode)
+{
+   registry &displays = get_registry();
+   const uint32_t num_displays = displays.num_displays.load(std::memory_order_acquire);
+   for (uint32_t i = 0; i < num_displays; i++)
+   {
+      drm_display &candidate = *displays.displays[i];
+      if (mode >= candidate.get_display_modes_begin() && mode < candidate.get_display_modes_end())
+      {
+         return &candidate;
+      }
+   }
+   return nullptr;
+}
+
+drm_display *drm_display::find_plane(uint32_t plane_index, uint32_t &display_plane_index)
+{
+   registry &displays = get_registry();
+   const uint32_t num_displays = displays.num_displays.load(std::memory_order_acquire);
+   for (uint32_t i = 0; i < num_displays; i++)
+   {
+      drm_display &candidate = *displays.displays[i];
+      if (plane_index < candidate.get_num_planes())
+      {
+         display_plane_index = plane_index;
+         return &candidate;
+      }
+      plane_index -= candidate.get_num_planes();
+   }
+   return nullptr;
+}
+
+drm_display *drm_display::find_connector(uint32_t connector_id)
+{
+   const uint32_t num_displays = get_num_displays();
+   for (uint32_t i = 0; i < num_displays; i++)
+   {
+      drm_display &candidate = get_display_at(i);
+      if (candidate.get_connector_id() == connector_id)
+      {
+         return &candidate;
+      }
+   }
+   return nullptr;
+}
+
+VkResult drm_display::acquire_lease(util::fd_owner lease_fd)
+{
+   registry &displays = get_registry();
+   std::lock_guard<std::mutex> lock(displays.mutex);
+   const util::allocator &allocator = util::allocator::get_generic();
+
+   if (displays.unleased[m_registry_index] != nullptr)
+   {
+      WSI_LOG_ERROR("DRM connector %u is already leased.", get_connector_id());
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+
+   /* The lease only holds the leased objects, with the same ids as on the device. */
+   drmSetClientCap(lease_fd.get(), DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+   drm_resources_owner resources{ drmModeGetResources(lease_fd.get()) };
+   drm_plane_resources_owner plane_res{ drmModeGetPlaneResources(lease_fd.get()) };
+   drm_connector_owner connector{ drmModeGetConnector(lease_fd.get(), get_connector_id()) };
+   if (resources == nullptr || plane_res == nullptr || connector == nullptr)
+   {
+      WSI_LOG_ERROR("The lease of DRM connector %u does not hold the connector and its planes.", get_connector_id());
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+
+   const int crtc_index = find_compatible_crtc(lease_fd.get(), resources, connector, 0);
+   if (crtc_index < 0)
+   {
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+
+   util::vector<uint32_t> claimed_planes{ allocator };
+   auto leased = make_display(allocator, lease_fd, true, resources, plane_res, std::move(connector), crtc_index,
+                              claimed_planes);
+   if (!leased.has_value())
+   {
+      WSI_LOG_ERROR("Failed to drive DRM connector %u through its lease.", get_connector_id());
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+
+   stop_event_thread();
+   auto unleased = allocator.make_unique<drm_display>(std::move(*this));
+   if (unleased == nullptr)
+   {
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
+   *this = std::move(*leased);
+
+   /* The modes of the connector are the same through the lease, keep those the application has handles to. */
+   std::swap(m_display_modes, unleased->m_display_modes);
+   std::swap(m_num_display_modes, unleased->m_num_display_modes);
+   m_registry_index = unleased->m_registry_index;
+   displays.unleased[m_registry_index] = std::move(unleased);
+
+   WSI_LOG_INFO("DRM connector %u is driven through a lease.", get_connector_id());
+   return VK_SUCCESS;
+}
+
+void drm_display::release_lease()
+{
+   registry &displays = get_registry();
+   std::lock_guard<std::mutex> lock(displays.mutex);
+
+   auto &unleased = displays.unleased[m_registry_index];
+   if (unleased == nullptr)
+   {
+      return;
+   }
+
+   stop_event_thread();
+   std::swap(m_display_modes, unleased->m_display_modes);
+   std::swap(m_num_display_modes, unleased->m_num_display_modes);
+
+   /* Closing the last descriptor of the lease ends it. */
+   *this = std::move(*unleased);
+   unleased.reset();
+}
+
+bool drm_display::is_connected() const
+{
+   return get_registry().connected[m_registry_index].load(std::memory_order_acquire);
+}
+
+VkDisplayKHR drm_display::get_handle()
+{
+   return reinterpret_cast<VkDisplayKHR>(this);
+}
+
+const util::vector<drm_format_pair> *drm_display::get_supported_formats(uint32_t plane_index) const
+{
+   assert(plane_index < m_page_flip->num_planes);
+   return m_plane_formats[plane_index].get();
+}
+
+bool drm_display::is_format_supported(const drm_format_pair &format, uint32_t plane_index) const
+{
+   const util::vector<drm_format_pair> *formats = get_supported_formats(plane_index);
+   auto supported_format = std::find_if(formats->begin(), formats->end(), [format](const auto &supported_format) {
+      return format.fourcc == supported_format.fourcc && format.modifier == supported_format.modifier;
+   });
+
+   return supported_format != formats->end();
+}
+
+bool drm_display::supports_fb_modifiers() const
+{
+   return m_supports_fb_modifiers;
+}
+
+drm_display_mode::drm_display_mode()
+   : m_drm_mode_info{}
+   , m_preferred(false)
+{
+}
+
+uint16_t drm_display_mode::get_width() const
+{
+   return m_drm_mode_info.hdisplay;
+}
+
+uint16_t drm_display_mode::get_height() const
+{
+   return m_drm_mode_info.vdisplay;
+}
+
+uint32_t drm_display_mode::get_refresh_rate() const
+{
+   /* DRM provides refresh rate in Hz and vulkan expects mHz */
+   return m_drm_mode_info.vrefresh * 1000;
+}
+
+drmModeModeInfo drm_display_mode::get_drm_mode() const
+{
+   return m_drm_mode_info;
+}
+
+void drm_display_mode::set_drm_mode(drmModeModeInfo mode)
+{
+   m_drm_mode_info = mode;
+}
+
+bool drm_display_mode::is_preferred() const
+{
+   return m_preferred;
+}
+
+void drm_display_mode::set_preferred(bool preferred)
+{
+   m_preferred = preferred;
+}
+
+drm_display_mode *drm_display::get_display_modes_begin() const
+{
+   return m_display_modes.get();
+}
+
+drm_display_mode *drm_display::get_display_modes_end() const
+{
+   return m_display_modes.get() + m_num_display_modes;
+}
+
+size_t drm_display::get_num_display_modes() const
+{
+   return m_num_display_modes;
+}
+
+int drm_display::get_drm_fd() const
+{
+   return m_drm_fd.get();
+}
+
+uint32_t drm_display::get_connector_id() const
 {
    return m_drm_connector->connector_id;
 }
@@ -471,6 +1207,545 @@ uint32_t drm_display::get_max_height() const
    return m_max_height;
 }
 
+uint32_t drm_display::get_num_planes() const
+{
+   return m_page_flip->num_planes;
+}
+
+const drm_plane_properties &drm_display::get_plane(uint32_t plane_index) const
+{
+   assert(plane_index < m_page_flip->num_planes);
+   return m_page_flip->plane_properties[plane_index];
+}
+
+const drm_atomic_properties *drm_display::get_atomic_properties() const
+{
+   return m_atomic_properties.has_value() ? &*m_atomic_properties : nullptr;
+}
+
+bool drm_display::supports_vrr() const
+{
+   return m_atomic_properties.has_value() && m_atomic_properties->crtc_vrr_enabled != 0;
+}
+
+bool drm_display::has_monotonic_timestamps() const
+{
+   return m_page_flip->monotonic_timestamps;
+}
+
+int drm_display::get_crtc_sequence(drm_flip_time &time) const
+{
+   uint64_t sequence = 0;
+   uint64_t time_ns = 0;
+   int res = drmCrtcGetSequence(m_drm_fd.get(), static_cast<uint32_t>(m_crtc_id), &sequence, &time_ns);
+   if (res != 0)
+   {
+      return -errno;
+   }
+
+   time.sequence = sequence;
+   time.time_ns = time_ns;
+   return 0;
+}
+
+/**
+ * @brief Add the properties setting @p plane, a plane of @p crtc_id, to @p update to an atomic request.
+ */
+static bool append_plane_properties(drmModeAtomicReq *request, uint32_t crtc_id, const drm_plane_properties &plane,
+                                    const drm_plane_update &update)
+{
+   /* Source coordinates are 16.16 fixed point. */
+   bool ok = drmModeAtomicAddProperty(request, plane.plane_id, plane.fb_id, update.fb_id) >= 0 &&
+             drmModeAtomicAddProperty(request, plane.plane_id, plane.crtc_id, crtc_id) >= 0 &&
+             drmModeAtomicAddProperty(request, plane.plane_id, plane.src_x,
+                                      static_cast<uint64_t>(update.src.offset.x) << 16) >= 0 &&
+             drmModeAtomicAddProperty(request, plane.plane_id, plane.src_y,
+                                      static_cast<uint64_t>(update.src.offset.y) << 16) >= 0 &&
+             drmModeAtomicAddProperty(request, plane.plane_id, plane.src_w,
+                                      static_cast<uint64_t>(update.src.extent.width) << 16) >= 0 &&
+             drmModeAtomicAddProperty(request, plane.plane_id, plane.src_h,
+                                      static_cast<uint64_t>(update.src.extent.height) << 16) >= 0 &&
+             drmModeAtomicAddProperty(request, plane.plane_id, plane.crtc_x, update.dst.offset.x) >= 0 &&
+             drmModeAtomicAddProperty(request, plane.plane_id, plane.crtc_y, update.dst.offset.y) >= 0 &&
+             drmModeAtomicAddProperty(request, plane.plane_id, plane.crtc_w, update.dst.extent.width) >= 0 &&
+             drmModeAtomicAddProperty(request, plane.plane_id, plane.crtc_h, update.dst.extent.height) >= 0;
+
+   if (ok && plane.zpos != 0)
+   {
+      ok = drmModeAtomicAddProperty(request, plane.plane_id, plane.zpos, update.zpos) >= 0;
+   }
+
+   if (ok && plane.in_fence_fd != 0 && update.in_fence.is_valid())
+   {
+      ok = drmModeAtomicAddProperty(request, plane.plane_id, plane.in_fence_fd, update.in_fence.get()) >= 0;
+   }
+
+   return ok;
+}
+
+bool drm_display::add_plane_properties(drmModeAtomicReq *request, uint32_t plane_index,
+                                       const drm_plane_update &update) const
+{
+   return append_plane_properties(request, m_page_flip->crtc_id, get_plane(plane_index), update);
+}
+
+int drm_display::commit_queued_updates(page_flip_state *state)
+{
+   drm_atomic_req_owner request{ drmModeAtomicAlloc() };
+   if (request == nullptr)
+   {
+      return -ENOMEM;
+   }
+
+   bool queued = false;
+   for (uint32_t i = 0; i < state->num_planes; i++)
+   {
+      const auto &slot = state->planes[i];
+      if (!slot.queued.has_value())
+      {
+         continue;
+      }
+
+      if (!append_plane_properties(request.get(), state->crtc_id, state->plane_properties[i], *slot.queued))
+      {
+         return -ENOMEM;
+      }
+      queued = true;
+   }
+
+   if (!queued)
+   {
+      return 0;
+   }
+
+   int res = drmModeAtomicCommit(state->drm_fd, request.get(), DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT,
+                                 state);
+   if (res != 0)
+   {
+      WSI_LOG_ERROR("Atomic commit of the queued plane updates failed: %s\n", std::strerror(-res));
+      return res;
+   }
+
+   /* The in-fences were duplicated by the kernel, they can be closed now. */
+   for (auto &slot : state->planes)
+   {
+      if (slot.queued.has_value())
+      {
+         slot.in_flight = true;
+         slot.callback = slot.queued->callback;
+         slot.context = slot.queued->context;
+         slot.queued.reset();
+      }
+   }
+   state->pending = true;
+   return 0;
+}
+
+void drm_display::page_flip_event(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec,
+                                  void *user_data)
+{
+   UNUSED(fd);
+   auto *state = reinterpret_cast<page_flip_state *>(user_data);
+
+   struct callback_call
+   {
+      page_flip_callback callback;
+      void *context;
+      bool presented;
+   };
+   std::array<callback_call, 2 * MAX_PLANES> calls;
+   size_t num_calls = 0;
+
+   /* All the planes of a commit flip on the same vblank. */
+   drm_flip_time time;
+   time.sequence = sequence;
+   time.time_ns = static_cast<uint64_t>(tv_sec) * 1000000000 + static_cast<uint64_t>(tv_usec) * 1000;
+
+   std::unique_lock<std::mutex> lock(state->mutex);
+   state->pending = false;
+   state->dispatching = true;
+   for (auto &slot : state->planes)
+   {
+      if (slot.in_flight)
+      {
+         calls[num_calls++] = { slot.callback, slot.context, true };
+         slot.in_flight = false;
+         slot.callback = nullptr;
+         slot.context = nullptr;
+      }
+   }
+
+   /* The updates queued while the commit was in flight go together in the next one. */
+   if (commit_queued_updates(state) != 0)
+   {
+      for (auto &slot : state->planes)
+      {
+         if (slot.queued.has_value())
+         {
+            calls[num_calls++] = { slot.queued->callback, slot.queued->context, false };
+            slot.queued.reset();
+         }
+      }
+   }
+   lock.unlock();
+
+   /* Waiters are held back until the callbacks returned, so they can destroy what the contexts point to. */
+   for (size_t i = 0; i < num_calls; i++)
+   {
+      if (calls[i].callback != nullptr)
+      {
+         calls[i].callback(calls[i].context, calls[i].presented, time);
+      }
+   }
+
+   lock.lock();
+   state->dispatching = false;
+   state->flip_done.notify_all();
+}
+
+void drm_display::event_thread_main(page_flip_state *state, int drm_fd)
+{
+   util::configure_presentation_thread("wsi-drm-events");
+
+   drmEventContext ev = {};
+   ev.version = DRM_EVENT_CONTEXT_VERSION;
+   ev.page_flip_handler = page_flip_event;
+
+   while (true)
+   {
+      struct epoll_event events[2];
+      int count = epoll_wait(state->epoll_fd.get(), events, 2, -1);
+      if (count < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         WSI_LOG_ERROR("epoll_wait() failed: %s\n", std::strerror(errno));
+         break;
+      }
+
+      for (int i = 0; i < count; i++)
+      {
+         if (events[i].data.fd == state->wake_fd.get())
+         {
+            return;
+         }
+
+         /* With a descriptor shared between displays, another event thread may have read the events already. */
+         errno = 0;
+         if (drmHandleEvent(drm_fd, &ev) != 0 && errno != EAGAIN)
+         {
+            WSI_LOG_ERROR("drmHandleEvent failed: %s\n", std::strerror(errno));
+            break;
+         }
+      }
+   }
+
+   std::lock_guard<std::mutex> lock(state->mutex);
+   state->failed = true;
+   state->pending = false;
+   for (auto &slot : state->planes)
+   {
+      slot = {};
+   }
+   state->flip_done.notify_all();
+}
+
+bool drm_display::start_event_thread()
+{
+   if (m_page_flip->event_thread.joinable())
+   {
+      return !m_page_flip->failed;
+   }
+
+   m_page_flip->epoll_fd = util::fd_owner{ epoll_create1(EPOLL_CLOEXEC) };
+   m_page_flip->wake_fd = util::fd_owner{ eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK) };
+   if (!m_page_flip->epoll_fd.is_valid() || !m_page_flip->wake_fd.is_valid())
+   {
+      WSI_LOG_ERROR("Failed to create the DRM event thread descriptors: %s\n", std::strerror(errno));
+      return false;
+   }
+
+   for (int fd : { m_drm_fd.get(), m_page_flip->wake_fd.get() })
+   {
+      struct epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.fd = fd;
+      if (epoll_ctl(m_page_flip->epoll_fd.get(), EPOLL_CTL_ADD, fd, &event) != 0)
+      {
+         WSI_LOG_ERROR("epoll_ctl() failed: %s\n", std::strerror(errno));
+         return false;
+      }
+   }
+
+   try
+   {
+      m_page_flip->event_thread = std::thread(&drm_display::event_thread_main, m_page_flip.get(), m_drm_fd.get());
+   }
+   catch (const std::system_error &)
+   {
+      WSI_LOG_ERROR("Failed to start the DRM event thread.");
+      return false;
+   }
+
+   return true;
+}
+
+void drm_display::stop_event_thread()
+{
+   if (m_page_flip == nullptr || !m_page_flip->event_thread.joinable())
+   {
+      return;
+   }
+
+   const uint64_t wake = 1;
+   if (write(m_page_flip->wake_fd.get(), &wake, sizeof(wake)) != sizeof(wake))
+   {
+      WSI_LOG_ERROR("Failed to wake the DRM event thread: %s\n", std::strerror(errno));
+   }
+   m_page_flip->event_thread.join();
+}
+
+/**
+ * @brief Wait on @p flip_done while @p busy returns true, logging every second spent waiting.
+ */
+template <typename Predicate>
+static void wait_for_flips(std::condition_variable &flip_done, std::unique_lock<std::mutex> &lock, Predicate busy)
+{
+   while (busy())
+   {
+      if (flip_done.wait_for(lock, std::chrono::seconds(1)) == std::cv_status::timeout)
+      {
+         WSI_LOG_ERROR("Timed out, carrying on waiting for the page flip\n");
+      }
+   }
+}
+
+int drm_display::atomic_commit(drmModeAtomicReq *request, uint32_t flags)
+{
+   assert((flags & (DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT)) == 0);
+
+   std::unique_lock<std::mutex> lock(m_page_flip->mutex);
+   if ((flags & DRM_MODE_ATOMIC_TEST_ONLY) == 0)
+   {
+      /* A commit fails with EBUSY while a non-blocking one is in flight. */
+      wait_for_flips(m_page_flip->flip_done, lock,
+                     [this]() { return (m_page_flip->pending || m_page_flip->dispatching) && !m_page_flip->failed; });
+   }
+   return drmModeAtomicCommit(m_drm_fd.get(), request, flags, nullptr);
+}
+
+int drm_display::set_crtc(uint32_t fb_id, drmModeModeInfo &mode)
+{
+   std::unique_lock<std::mutex> lock(m_page_flip->mutex);
+   /* Overlay commits in flight still scan out buffers of the previous configuration. */
+   wait_for_flips(m_page_flip->flip_done, lock,
+                  [this]() { return (m_page_flip->pending || m_page_flip->dispatching) && !m_page_flip->failed; });
+
+   uint32_t connector_id = get_connector_id();
+   if (drmModeSetCrtc(m_drm_fd.get(), m_crtc_id, fb_id, 0, 0, &connector_id, 1, &mode) != 0)
+   {
+      return -errno;
+   }
+   return 0;
+}
+
+int drm_display::test_plane_update(uint32_t plane_index, const drm_plane_update &update)
+{
+   drm_atomic_req_owner request{ drmModeAtomicAlloc() };
+   if (request == nullptr || !add_plane_properties(request.get(), plane_index, update))
+   {
+      return -ENOMEM;
+   }
+
+   return atomic_commit(request.get(), DRM_MODE_ATOMIC_TEST_ONLY);
+}
+
+int drm_display::queue_plane_update(uint32_t plane_index, drm_plane_update update)
+{
+   assert(plane_index < m_page_flip->num_planes);
+
+   std::lock_guard<std::mutex> lock(m_page_flip->mutex);
+   auto &slot = m_page_flip->planes[plane_index];
+   if (slot.queued.has_value() || slot.in_flight)
+   {
+      return -EBUSY;
+   }
+
+   if (!start_event_thread())
+   {
+      return -ENODEV;
+   }
+
+   slot.queued = std::move(update);
+   if (m_page_flip->pending || m_page_flip->dispatching)
+   {
+      /* Committed by the event thread with the updates of the other planes once the flip in flight completes. */
+      return 0;
+   }
+
+   /* The event thread cannot see the flip before the mutex is released, so recording it after the commit is safe. */
+   int res = commit_queued_updates(m_page_flip.get());
+   if (res != 0)
+   {
+      slot.queued.reset();
+   }
+   return res;
+}
+
+int drm_display::acquire_framebuffer(const drm_framebuffer_desc &desc, uint32_t &fb_id)
+{
+   assert(desc.num_planes > 0 && desc.num_planes <= util::MAX_PLANES);
+
+   framebuffer_cache::entry entry{};
+   entry.desc = desc;
+   for (uint32_t plane = 0; plane < desc.num_planes; plane++)
+   {
+      struct stat buffer_stat = {};
+      if (fstat(desc.buffer_fds[plane], &buffer_stat) != 0)
+      {
+         return -errno;
+      }
+      entry.dev = buffer_stat.st_dev;
+      entry.inodes[plane] = buffer_stat.st_ino;
+   }
+
+   std::lock_guard<std::mutex> lock(m_framebuffers->mutex);
+   for (auto &cached : m_framebuffers->entries)
+   {
+      const drm_framebuffer_desc &cached_desc = cached.desc;
+      if (cached.dev == entry.dev && cached.inodes == entry.inodes && cached_desc.width == desc.width &&
+          cached_desc.height == desc.height && cached_desc.format.fourcc == desc.format.fourcc &&
+          cached_desc.format.modifier == desc.format.modifier && cached_desc.num_planes == desc.num_planes &&
+          cached_desc.strides == desc.strides && cached_desc.offsets == desc.offsets)
+      {
+         cached.refcount++;
+         fb_id = cached.fb_id;
+         return 0;
+      }
+   }
+
+   /* The handles are only needed to create the framebuffer, which holds its own references to the buffers. */
+   drm_gem_handle_array<util::MAX_PLANES> buffer_handles{ m_drm_fd.get() };
+   std::array<uint64_t, util::MAX_PLANES> modifiers{ 0, 0, 0, 0 };
+   for (uint32_t plane = 0; plane < desc.num_planes; plane++)
+   {
+      modifiers[plane] = desc.format.modifier;
+      if (drmPrimeFDToHandle(m_drm_fd.get(), desc.buffer_fds[plane], &buffer_handles[plane]) != 0)
+      {
+         return -errno;
+      }
+   }
+
+   int error = 0;
+   if (m_supports_fb_modifiers)
+   {
+      error = drmModeAddFB2WithModifiers(m_drm_fd.get(), desc.width, desc.height, desc.format.fourcc,
+                                         buffer_handles.data(), desc.strides.data(), desc.offsets.data(),
+                                         modifiers.data(), &entry.fb_id, DRM_MODE_FB_MODIFIERS);
+   }
+   else
+   {
+      error = drmModeAddFB2(m_drm_fd.get(), desc.width, desc.height, desc.format.fourcc, buffer_handles.data(),
+                            desc.strides.data(), desc.offsets.data(), &entry.fb_id, 0);
+   }
+   if (error != 0)
+   {
+      return -errno;
+   }
+
+   /* The buffer descriptors belong to the image, they are not kept. */
+   entry.desc.buffer_fds = {};
+   entry.refcount = 1;
+   if (!m_framebuffers->entries.try_push_back(entry))
+   {
+      drmModeRmFB(m_drm_fd.get(), entry.fb_id);
+      return -ENOMEM;
+   }
+
+   fb_id = entry.fb_id;
+   return 0;
+}
+
+void drm_display::release_framebuffer(uint32_t fb_id)
+{
+   std::lock_guard<std::mutex> lock(m_framebuffers->mutex);
+   auto cached = std::find_if(m_framebuffers->entries.begin(), m_framebuffers->entries.end(),
+                              [fb_id](const framebuffer_cache::entry &entry) { return entry.fb_id == fb_id; });
+   assert(cached != m_framebuffers->entries.end());
+   if (cached == m_framebuffers->entries.end() || --cached->refcount != 0)
+   {
+      return;
+   }
+   cached->released_at = ++m_framebuffers->release_count;
+
+   /* Keep the framebuffer for a swapchain re-importing the buffer, evicting the least recently released one. */
+   size_t idle_entries = 0;
+   auto oldest = m_framebuffers->entries.end();
+   for (auto it = m_framebuffers->entries.begin(); it != m_framebuffers->entries.end(); ++it)
+   {
+      if (it->refcount != 0)
+      {
+         continue;
+      }
+      idle_entries++;
+      if (oldest == m_framebuffers->entries.end() || it->released_at < oldest->released_at)
+      {
+         oldest = it;
+      }
+   }
+   if (idle_entries <= framebuffer_cache::max_idle_entries)
+   {
+      return;
+   }
+
+   int result = drmModeRmFB(m_drm_fd.get(), oldest->fb_id);
+   assert(result == 0);
+   UNUSED(result);
+   m_framebuffers->entries.erase(oldest);
+}
+
+int drm_display::page_flip(uint32_t fb_id, page_flip_callback callback, void *context)
+{
+   std::unique_lock<std::mutex> lock(m_page_flip->mutex);
+   if (!start_event_thread())
+   {
+      return -ENODEV;
+   }
+
+   /* Flips of other planes may hold the CRTC, legacy flips cannot be merged with them. */
+   wait_for_flips(m_page_flip->flip_done, lock,
+                  [this]() { return (m_page_flip->pending || m_page_flip->dispatching) && !m_page_flip->failed; });
+   if (m_page_flip->failed)
+   {
+      return -ENODEV;
+   }
+
+   int res = drmModePageFlip(m_drm_fd.get(), m_crtc_id, fb_id, DRM_MODE_PAGE_FLIP_EVENT, m_page_flip.get());
+   if (res == 0)
+   {
+      auto &slot = m_page_flip->planes[0];
+      slot.in_flight = true;
+      slot.callback = callback;
+      slot.context = context;
+      m_page_flip->pending = true;
+   }
+   return res;
+}
+
+bool drm_display::wait_for_plane(uint32_t plane_index)
+{
+   assert(plane_index < m_page_flip->num_planes);
+
+   std::unique_lock<std::mutex> lock(m_page_flip->mutex);
+   const auto &slot = m_page_flip->planes[plane_index];
+   wait_for_flips(m_page_flip->flip_done, lock,
+                  [&slot, this]() { return slot.queued.has_value() || slot.in_flight || m_page_flip->dispatching; });
+
+   return !m_page_flip->failed;
+}
+
 } /* namespace display */
 
 } /* namespace wsi */
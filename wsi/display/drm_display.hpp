@@ -27,10 +27,16 @@
 #include <vulkan/vulkan.h>
 #include <xf86drmMode.h>
 #include <xf86drm.h>
+#include <sys/types.h>
+#include <array>
+#include <condition_variable>
+#include <mutex>
 #include <optional>
+#include <thread>
 
 #include "util/custom_allocator.hpp"
 #include "util/file_descriptor.hpp"
+#include "util/helpers.hpp"
 #include "wsi/surface.hpp"
 
 namespace wsi
@@ -62,6 +68,7 @@ using drm_plane_resources_owner = drm_owner<_drmModePlaneRes, drmModeFreePlaneRe
 using drm_object_properties_owner = drm_owner<_drmModeObjectProperties, drmModeFreeObjectProperties>;
 using drm_property_owner = drm_owner<_drmModeProperty, drmModeFreeProperty>;
 using drm_property_blob_owner = drm_owner<_drmModePropertyBlob, drmModeFreePropertyBlob>;
+using drm_atomic_req_owner = drm_owner<_drmModeAtomicReq, drmModeAtomicFree>;
 
 /**
  * @brief Owner class for an array of DRM GEM buffer handles.
@@ -104,6 +111,99 @@ private:
 /* Forward declaration */
 class drm_display;
 
+/**
+ * @brief Ids of the connector and CRTC KMS properties set by atomic modesets, looked up once when the display is
+ *        created.
+ */
+struct drm_atomic_properties
+{
+   /* Connector properties */
+   uint32_t connector_crtc_id;
+
+   /* CRTC properties */
+   uint32_t crtc_mode_id;
+   uint32_t crtc_active;
+   /* 0 unless both the CRTC and the connected panel support variable refresh rate. */
+   uint32_t crtc_vrr_enabled;
+};
+
+/**
+ * @brief A plane of the display's CRTC and the ids of the KMS properties atomic commits set on it.
+ */
+struct drm_plane_properties
+{
+   uint32_t plane_id;
+
+   uint32_t fb_id;
+   uint32_t crtc_id;
+   uint32_t src_x;
+   uint32_t src_y;
+   uint32_t src_w;
+   uint32_t src_h;
+   uint32_t crtc_x;
+   uint32_t crtc_y;
+   uint32_t crtc_w;
+   uint32_t crtc_h;
+   /* 0 when the driver cannot wait for fences before flipping. */
+   uint32_t in_fence_fd;
+   /* 0 when the stacking order of the plane is fixed. */
+   uint32_t zpos;
+   /* Range of the zpos property, greater values stack above lower ones. */
+   uint64_t zpos_min;
+   uint64_t zpos_max;
+};
+
+/**
+ * @brief Vblank an update reached the screen on, as reported by its page flip event.
+ */
+struct drm_flip_time
+{
+   /* CRTC vblank counter. */
+   uint64_t sequence{ 0 };
+   /* Time of the vblank in nanoseconds, CLOCK_MONOTONIC unless drm_display::has_monotonic_timestamps is false. */
+   uint64_t time_ns{ 0 };
+};
+
+/**
+ * @brief Function called on the DRM event thread when a plane update completed, or failed to commit.
+ *
+ * @p time is only meaningful when @p presented is true.
+ */
+using page_flip_callback = void (*)(void *context, bool presented, const drm_flip_time &time);
+
+/**
+ * @brief New state of a plane, applied by the next atomic commit of the display.
+ */
+struct drm_plane_update
+{
+   uint32_t fb_id{ 0 };
+   /* Area of the framebuffer shown, in pixels. */
+   VkRect2D src{};
+   /* Area of the CRTC it is shown on. */
+   VkRect2D dst{};
+   /* Applied when the plane has a zpos property, within its range. */
+   uint64_t zpos{ 0 };
+   /* Sync FD of the rendering to the framebuffer, KMS waits for it before the update. Optional. */
+   util::fd_owner in_fence;
+
+   page_flip_callback callback{ nullptr };
+   void *context{ nullptr };
+};
+
+/**
+ * @brief Dma-buf planes of an image and their layout, wrapped in a framebuffer by drm_display::acquire_framebuffer.
+ */
+struct drm_framebuffer_desc
+{
+   uint32_t width{ 0 };
+   uint32_t height{ 0 };
+   drm_format_pair format{};
+   uint32_t num_planes{ 0 };
+   std::array<int, util::MAX_PLANES> buffer_fds{};
+   std::array<uint32_t, util::MAX_PLANES> strides{};
+   std::array<uint32_t, util::MAX_PLANES> offsets{};
+};
+
 /**
  * @brief The display mode object.
  * The drm_display_mode class stores information
@@ -184,14 +284,58 @@ class drm_display
 {
 public:
    /**
-    * @brief Construct and initialize a display object.
+    * @brief Maximum number of displays of all the DRM devices.
+    */
+   static constexpr uint32_t MAX_DISPLAYS = 16;
+
+   /**
+    * @brief Get the number of displays of the DRM devices, probed on first use.
     *
-    * @param allocator The allocator object that the display will use.
-    * @return std::optional<drm_display> containing a display if initialization went well, otherwise std::nullopt.
+    * Each connected connector of a device gets a display driven by its own CRTC. The devices are the colon separated
+    * list in WSI_DISPLAY_DRI_DEV, or every DRM device with display outputs when it is not set. Probes are cached
+    * until the kernel reports a hotplug, which probes the connectors again: newly connected connectors get displays
+    * and the displays of unplugged connectors report @ref is_connected false. The displays are never destroyed, their
+    * addresses are the VkDisplayKHR handles.
+    */
+   static uint32_t get_num_displays();
+
+   /**
+    * @brief Get the display at @p index, below @ref get_num_displays.
+    */
+   static drm_display &get_display_at(uint32_t index);
+
+   /**
+    * @brief Get the display of a VkDisplayKHR handle.
+    *
+    * @return The display, nullptr when @p display is not one of the displays.
+    */
+   static drm_display *get_display(VkDisplayKHR display);
+
+   /**
+    * @brief Get the display @p mode is a mode of.
+    *
+    * @return The display, nullptr when @p mode is not a mode of any display.
+    */
+   static drm_display *get_display(const drm_display_mode *mode);
+
+   /**
+    * @brief Find the display of a plane of the physical device. The planes of the displays are numbered one display
+    *        after the other, in the order of @ref get_display_at.
+    *
+    * @param[out] display_plane_index Index of the plane within the display, see @ref get_num_planes.
+    * @return The display, nullptr when @p plane_index is out of range.
+    */
+   static drm_display *find_plane(uint32_t plane_index, uint32_t &display_plane_index);
+
+   /**
+    * @brief Get the VkDisplayKHR handle of the display.
     */
-   static std::optional<drm_display> make_display(const util::allocator &allocator, const char *drm_device);
+   VkDisplayKHR get_handle();
 
-   static std::optional<drm_display> &get_display();
+   /**
+    * @brief Whether the connector of the display was connected when the DRM devices were last probed.
+    */
+   bool is_connected() const;
 
    drm_display(drm_display &&other) = default;
 
@@ -252,11 +396,12 @@ public:
    drmModeResPtr get_drm_resources() const;
 
    /**
-    * @brief Get the supported formats for the display.
+    * @brief Get the formats and modifiers a plane of the display can scan out, parsed from its IN_FORMATS blob.
     *
+    * @param plane_index The plane, see @ref get_num_planes. The primary plane by default.
     * @return Pointer to vector of supported formats.
     */
-   const util::vector<drm_format_pair> *get_supported_formats() const;
+   const util::vector<drm_format_pair> *get_supported_formats(uint32_t plane_index = 0) const;
 
    /**
     * @brief Query the display for support for adding framebuffers with format modifiers.
@@ -269,9 +414,10 @@ public:
     * @brief Query the display for support of a specific format and modifier combination.
     *
     * @param format The format to query support for.
+    * @param plane_index The plane the format is shown on, the primary plane by default.
     * @return true if the format is supported by the display, otherwise false.
     */
-   bool is_format_supported(const drm_format_pair &format) const;
+   bool is_format_supported(const drm_format_pair &format, uint32_t plane_index = 0) const;
 
    /**
     * @brief Returns a CRTC compatible with this display's connector.
@@ -290,16 +436,298 @@ public:
     */
    uint32_t get_max_height() const;
 
+   /**
+    * @brief Maximum number of planes of the CRTC exposed to applications.
+    */
+   static constexpr uint32_t MAX_PLANES = 8;
+
+   /**
+    * @brief Get the number of planes images can be shown on. Index 0 is the primary plane, the others overlays.
+    *
+    * Overlays need atomic modesetting, without it only the primary plane is available.
+    */
+   uint32_t get_num_planes() const;
+
+   /**
+    * @brief Get the plane at @p plane_index, see @ref get_num_planes.
+    */
+   const drm_plane_properties &get_plane(uint32_t plane_index) const;
+
+   /**
+    * @brief Get the KMS property ids used by atomic modesets.
+    *
+    * @return The property ids, or nullptr when the device does not support atomic modesetting.
+    */
+   const drm_atomic_properties *get_atomic_properties() const;
+
+   /**
+    * @brief Whether the panel can refresh as soon as a flip arrives within its refresh range, see
+    *        drm_atomic_properties::crtc_vrr_enabled.
+    */
+   bool supports_vrr() const;
+
+   /**
+    * @brief Whether the vblank times of the device are in CLOCK_MONOTONIC, DRM_CAP_TIMESTAMP_MONOTONIC.
+    */
+   bool has_monotonic_timestamps() const;
+
+   /**
+    * @brief Get the last vblank of the CRTC with drmCrtcGetSequence.
+    *
+    * @return 0 on success, a negative errno value otherwise.
+    */
+   int get_crtc_sequence(drm_flip_time &time) const;
+
+   /**
+    * @brief Add the properties setting the plane at @p plane_index to @p update to an atomic request.
+    *
+    * @return true on success, false when out of memory.
+    */
+   bool add_plane_properties(drmModeAtomicReq *request, uint32_t plane_index, const drm_plane_update &update) const;
+
+   /**
+    * @brief Apply a blocking atomic request to the display, once the flips queued on it completed. Test-only
+    *        requests do not wait.
+    *
+    * @return 0 on success, a negative errno value otherwise.
+    */
+   int atomic_commit(drmModeAtomicReq *request, uint32_t flags);
+
+   /**
+    * @brief Set the mode of the display with the legacy API, showing @p fb_id on the primary plane, once the flips
+    *        queued on it completed.
+    *
+    * @return 0 on success, a negative errno value otherwise.
+    */
+   int set_crtc(uint32_t fb_id, drmModeModeInfo &mode);
+
+   /**
+    * @brief Check with a test-only commit that the driver accepts @p update on the plane at @p plane_index.
+    *
+    * @return 0 when accepted, a negative errno value otherwise.
+    */
+   int test_plane_update(uint32_t plane_index, const drm_plane_update &update);
+
+   /**
+    * @brief Queue an update of the plane at @p plane_index without waiting for it.
+    *
+    * The updates of all the planes queued while a commit is in flight go in the next single commit, issued by the
+    * DRM event thread when the previous one completes. The completion calls @p update's callback on that thread.
+    *
+    * @return 0 on success, a negative errno value when the commit failed right away, the callback is not called then.
+    */
+   int queue_plane_update(uint32_t plane_index, drm_plane_update update);
+
+   /**
+    * @brief Get a framebuffer showing the image described by @p desc.
+    *
+    * Framebuffers are shared by the images wrapping the same dma-bufs with the same layout. A few framebuffers stay
+    * cached after their last release, so swapchains re-importing recycled buffers reuse them without any ioctl. Each
+    * successful call is matched by a @ref release_framebuffer.
+    *
+    * @param[out] fb_id The framebuffer id.
+    * @return 0 on success, a negative errno value otherwise.
+    */
+   int acquire_framebuffer(const drm_framebuffer_desc &desc, uint32_t &fb_id);
+
+   /**
+    * @brief Drop a reference taken by @ref acquire_framebuffer.
+    *
+    * The framebuffer stays cached without references, the least recently released one is removed once more than
+    * framebuffer_cache::max_idle_entries are unreferenced.
+    */
+   void release_framebuffer(uint32_t fb_id);
+
+   /**
+    * @brief Queue a legacy page flip of @p fb_id on the primary plane. Its page flip event calls @p callback on the
+    *        DRM event thread.
+    *
+    * @return 0 on success, a negative errno value otherwise.
+    */
+   int page_flip(uint32_t fb_id, page_flip_callback callback, void *context);
+
+   /**
+    * @brief Find the display of a KMS connector.
+    *
+    * @return The display, nullptr when no display has the connector.
+    */
+   static drm_display *find_connector(uint32_t connector_id);
+
+   /**
+    * @brief Drive the display through a DRM lease of its connector, for VK_EXT_acquire_xlib_display.
+    *
+    * Displays of devices another process is DRM master of, such as the X server, cannot modeset until they are leased.
+    * The display takes the CRTC and planes of the lease until @ref release_lease. Its VkDisplayKHR and
+    * VkDisplayModeKHR handles stay valid. Must not be called while swapchains present to the display.
+    *
+    * @param lease_fd DRM master descriptor of the lease, holding the connector of the display.
+    * @return VK_SUCCESS, VK_ERROR_INITIALIZATION_FAILED when the lease cannot drive the display or the display is
+    *         already leased.
+    */
+   VkResult acquire_lease(util::fd_owner lease_fd);
+
+   /**
+    * @brief End the lease of @ref acquire_lease, which gives the connector back to the lessor. Does nothing when the
+    *        display is not leased. Must not be called while swapchains present to the display.
+    */
+   void release_lease();
+
+   /**
+    * @brief Wait until the update queued on the plane at @p plane_index, if any, completed and its callback returned.
+    *
+    * @return false when the DRM event thread failed, true otherwise.
+    */
+   bool wait_for_plane(uint32_t plane_index);
+
 private:
+   /**
+    * @brief State of the page flip queued on the display, shared by the swapchains presenting to it, and of the
+    *        thread handling the DRM events of the display.
+    */
+   struct page_flip_state
+   {
+      /* Updates of a plane, waiting for the next commit and in the commit in flight. */
+      struct plane_slot
+      {
+         std::optional<drm_plane_update> queued;
+         bool in_flight{ false };
+         page_flip_callback callback{ nullptr };
+         void *context{ nullptr };
+      };
+
+      /* What the event thread needs to commit the queued updates, constant once the display is created. */
+      int drm_fd{ -1 };
+      uint32_t crtc_id{ 0 };
+      uint32_t num_planes{ 0 };
+      bool monotonic_timestamps{ false };
+      /* Planes of the CRTC, the primary plane first. */
+      std::array<drm_plane_properties, MAX_PLANES> plane_properties{};
+
+      std::mutex mutex;
+      std::condition_variable flip_done;
+      /* Whether a commit with a page flip event is in flight. */
+      bool pending{ false };
+      /* Set while the event thread calls the callbacks of a completed commit. */
+      bool dispatching{ false };
+      /* Set when the event thread stopped on an error, the pending flip never completes. */
+      bool failed{ false };
+      std::array<plane_slot, MAX_PLANES> planes;
+
+      /* The event thread is started by the first flip, it waits on the DRM fd and on wake_fd with epoll. */
+      std::thread event_thread;
+      util::fd_owner epoll_fd;
+      util::fd_owner wake_fd;
+   };
+
+   /**
+    * @brief Framebuffers created by @ref acquire_framebuffer, allocated so the display can be moved.
+    */
+   struct framebuffer_cache
+   {
+      struct entry
+      {
+         /* Identity of the dma-bufs of the planes, from fstat. */
+         dev_t dev;
+         std::array<ino_t, util::MAX_PLANES> inodes;
+         drm_framebuffer_desc desc;
+         uint32_t fb_id;
+         uint32_t refcount;
+         /* Value of release_count when the last reference was dropped, orders the unreferenced entries. */
+         uint64_t released_at;
+      };
+
+      /* The framebuffers hold references to their buffers, so the unreferenced ones keep their dma-bufs, and the
+       * inodes they are keyed by, alive. Bounded to about the images of one swapchain to limit the memory kept. */
+      static constexpr size_t max_idle_entries = 8;
+
+      framebuffer_cache(const util::allocator &allocator)
+         : entries(allocator)
+      {
+      }
+
+      std::mutex mutex;
+      util::vector<entry> entries;
+      uint64_t release_count = 0;
+   };
+
+   /**
+    * @brief Start the DRM event thread if it is not running yet. Called with the page flip mutex held.
+    */
+   bool start_event_thread();
+
+   /**
+    * @brief Stop the DRM event thread, when running.
+    */
+   void stop_event_thread();
+
+   /**
+    * @brief Body of the DRM event thread, dispatching the events of @p drm_fd until @p state's wake_fd is signalled.
+    */
+   static void event_thread_main(page_flip_state *state, int drm_fd);
+
+   /**
+    * @brief Commit the updates queued on @p state in a single non-blocking commit. Called with the page flip mutex
+    *        held.
+    *
+    * @return 0 on success or when nothing is queued, a negative errno value otherwise. The updates stay queued on
+    *         failure.
+    */
+   static int commit_queued_updates(page_flip_state *state);
+
+   static void page_flip_event(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec,
+                               void *user_data);
+
+   /**
+    * @brief Construct and initialize the display of @p connector, driven by the CRTC at @p crtc_index of the DRM
+    *        resources.
+    *
+    * @param device_fd      The DRM device.
+    * @param duplicate_fd   Whether the display uses a duplicate of @p device_fd rather than leasing its objects from
+    *                       it. Set for the first display of a device and when the layer is not DRM master of it.
+    * @param claimed_planes Ids of the planes of the other displays of the device, the planes of the new display are
+    *                       added on success.
+    * @return std::optional<drm_display> containing a display if initialization went well, otherwise std::nullopt.
+    */
+   static std::optional<drm_display> make_display(const util::allocator &allocator, const util::fd_owner &device_fd,
+                                                  bool duplicate_fd, drm_resources_owner &resources,
+                                                  const drm_plane_resources_owner &plane_res,
+                                                  drm_connector_owner connector, int crtc_index,
+                                                  util::vector<uint32_t> &claimed_planes);
+
+   struct probed_device;
+   struct registry;
+
+   /**
+    * @brief Get the displays, probing the DRM devices on first use.
+    */
+   static registry &get_registry();
+
+   /**
+    * @brief Open @p drm_device and add a display to @p displays for each of its connected connectors. Devices that
+    *        cannot be used are skipped.
+    *
+    * @return false when out of memory, true otherwise.
+    */
+   static bool add_device(const util::allocator &allocator, const char *drm_device, registry &displays);
+
+   /**
+    * @brief Update whether the connectors of @p device with displays are connected, and add a display to
+    *        @p displays for each newly connected connector.
+    *
+    * @return false when out of memory, true otherwise.
+    */
+   static bool probe_connectors(const util::allocator &allocator, probed_device &device, registry &displays);
+
    /**
     * @brief display constructor.
     *
     * @param allocator The allocator that the display will use.
     */
    drm_display(util::fd_owner drm_fd, int crtc_id, drm_connector_owner drm_connector,
-               util::unique_ptr<util::vector<drm_format_pair>> supported_formats,
+               std::array<util::unique_ptr<util::vector<drm_format_pair>>, MAX_PLANES> plane_formats,
                util::unique_ptr<drm_display_mode> display_modes, size_t num_display_modes, uint32_t max_width,
-               uint32_t max_height, bool supports_fb_modifiers);
+               uint32_t max_height, bool supports_fb_modifiers, std::optional<drm_atomic_properties> atomic_properties,
+               util::unique_ptr<page_flip_state> page_flip, util::unique_ptr<framebuffer_cache> framebuffers);
 
    /**
     * @brief File descriptor for the display device.
@@ -317,9 +745,9 @@ private:
    drm_connector_owner m_drm_connector;
 
    /**
-    * @brief Vector of supported formats for use with the display.
+    * @brief Vectors of supported formats for use with each plane of the display, see @ref get_num_planes.
     */
-   util::unique_ptr<util::vector<drm_format_pair>> m_supported_formats;
+   std::array<util::unique_ptr<util::vector<drm_format_pair>>, MAX_PLANES> m_plane_formats;
 
    /**
     * @brief Pointer to available display modes for the connected display.
@@ -345,6 +773,26 @@ private:
     * @brief Flag to indicate if the display supports framebuffers with format modifiers.
     */
    bool m_supports_fb_modifiers;
+
+   /**
+    * @brief Connector and CRTC property ids for atomic modesets, std::nullopt without atomic modesetting.
+    */
+   std::optional<drm_atomic_properties> m_atomic_properties;
+
+   /**
+    * @brief Planes, pending page flips and DRM event thread, allocated so the display can be moved.
+    */
+   util::unique_ptr<page_flip_state> m_page_flip;
+
+   /**
+    * @brief Framebuffers of the images shown on the display, see @ref acquire_framebuffer.
+    */
+   util::unique_ptr<framebuffer_cache> m_framebuffers;
+
+   /**
+    * @brief Index of the display, see @ref get_display_at.
+    */
+   uint32_t m_registry_index{ 0 };
 };
 
 } /* namespace display */
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file present_timing_handler.cpp
+ *
+ * @brief Contains the functionality to implement features for present timing extension.
+ */
+
+#include "present_timing_handler.hpp"
+
+wsi_ext_present_timing_display::wsi_ext_present_timing_display(const util::allocator &allocator)
+   : wsi_ext_present_timing(allocator)
+{
+}
+
+util::unique_ptr<wsi_ext_present_timing_display> wsi_ext_present_timing_display::create(
+   const util::allocator &allocator, bool monotonic_timestamps)
+{
+   /* Devices timing vblanks with CLOCK_REALTIME have no Vulkan time domain to calibrate against. */
+   const VkTimeDomainKHR vblank_domain =
+      monotonic_timestamps ? VK_TIME_DOMAIN_CLOCK_MONOTONIC_KHR : VK_TIME_DOMAIN_PRESENT_STAGE_LOCAL_EXT;
+
+   std::array<util::unique_ptr<wsi::vulkan_time_domain>, 2> time_domains_array = {
+      allocator.make_unique<wsi::vulkan_time_domain>(VK_PRESENT_STAGE_QUEUE_OPERATIONS_END_BIT_EXT,
+                                                     VK_TIME_DOMAIN_DEVICE_KHR),
+      allocator.make_unique<wsi::vulkan_time_domain>(VK_PRESENT_STAGE_IMAGE_FIRST_PIXEL_VISIBLE_BIT_EXT,
+                                                     vblank_domain)
+   };
+
+   return wsi_ext_present_timing::create<wsi_ext_present_timing_display>(allocator, time_domains_array);
+}
+
+VkResult wsi_ext_present_timing_display::get_swapchain_timing_properties(
+   uint64_t &timing_properties_counter, VkSwapchainTimingPropertiesEXT &timing_properties)
+{
+   std::lock_guard<std::mutex> lock(m_refresh_mutex);
+   timing_properties_counter = m_timing_properties_counter;
+   timing_properties.refreshDuration = m_refresh_duration;
+   timing_properties.variableRefreshDelay = m_variable_refresh ? UINT64_MAX : 0;
+
+   return VK_SUCCESS;
+}
+
+void wsi_ext_present_timing_display::update_refresh(uint64_t refresh_ns, bool variable)
+{
+   std::lock_guard<std::mutex> lock(m_refresh_mutex);
+   if (refresh_ns != m_refresh_duration || variable != m_variable_refresh)
+   {
+      m_refresh_duration = refresh_ns;
+      m_variable_refresh = variable;
+      m_timing_properties_counter++;
+   }
+}
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file randr_lease.cpp
+ *
+ * @brief Implementation of the DRM leases of RandR outputs.
+ */
+
+#include "randr_lease.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "util/log.hpp"
+
+namespace wsi
+{
+
+namespace display
+{
+
+namespace randr_lease
+{
+
+/* RRCreateLease was added in RandR 1.6. */
+static constexpr uint32_t RANDR_MAJOR_VERSION = 1;
+static constexpr uint32_t RANDR_MINOR_VERSION = 6;
+
+static xcb_atom_t get_connector_id_atom(xcb_connection_t *connection)
+{
+   static const char name[] = "CONNECTOR_ID";
+   xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(
+      connection, xcb_intern_atom(connection, 1, sizeof(name) - 1, name), nullptr);
+   const xcb_atom_t atom = reply != nullptr ? reply->atom : XCB_ATOM_NONE;
+   free(reply);
+   return atom;
+}
+
+static bool read_connector_id(xcb_connection_t *connection, xcb_randr_get_output_property_cookie_t cookie,
+                              uint32_t &connector_id)
+{
+   xcb_randr_get_output_property_reply_t *reply =
+      xcb_randr_get_output_property_reply(connection, cookie, nullptr);
+   const bool found = reply != nullptr && reply->format == 32 && reply->num_items == 1;
+   if (found)
+   {
+      std::memcpy(&connector_id, xcb_randr_get_output_property_data(reply), sizeof(connector_id));
+   }
+   free(reply);
+   return found;
+}
+
+static xcb_randr_get_output_property_cookie_t get_connector_id_property(xcb_connection_t *connection,
+                                                                        xcb_randr_output_t output, xcb_atom_t atom)
+{
+   return xcb_randr_get_output_property(connection, output, atom, XCB_ATOM_ANY, 0, 1, 0, 0);
+}
+
+bool get_connector_id(xcb_connection_t *connection, xcb_randr_output_t output, uint32_t &connector_id)
+{
+   const xcb_atom_t atom = get_connector_id_atom(connection);
+   if (atom == XCB_ATOM_NONE)
+   {
+      return false;
+   }
+   return read_connector_id(connection, get_connector_id_property(connection, output, atom), connector_id);
+}
+
+/**
+ * @brief Find the RandR output of a KMS connector among the outputs of the screen.
+ *
+ * @return The output, XCB_NONE when none has the connector.
+ */
+static xcb_randr_output_t find_output(xcb_connection_t *connection,
+                                      const xcb_randr_get_screen_resources_current_reply_t *resources,
+                                      uint32_t connector_id)
+{
+   const xcb_atom_t atom = get_connector_id_atom(connection);
+   if (atom == XCB_ATOM_NONE)
+   {
+      return XCB_NONE;
+   }
+
+   /* Send every property query before waiting for the first reply. */
+   const xcb_randr_output_t *outputs = xcb_randr_get_screen_resources_current_outputs(resources);
+   const int output_count = xcb_randr_get_screen_resources_current_outputs_length(resources);
+   std::vector<xcb_randr_get_output_property_cookie_t> cookies(output_count);
+   for (int i = 0; i < output_count; i++)
+   {
+      cookies[i] = get_connector_id_property(connection, outputs[i], atom);
+   }
+
+   xcb_randr_output_t found = XCB_NONE;
+   for (int i = 0; i < output_count; i++)
+   {
+      uint32_t output_connector_id = 0;
+      if (read_connector_id(connection, cookies[i], output_connector_id) && output_connector_id == connector_id &&
+          found == XCB_NONE)
+      {
+         found = outputs[i];
+      }
+   }
+   return found;
+}
+
+/**
+ * @brief Pick the CRTC leased with @p output: a CRTC that can drive it and no other output, so the rest of the screen
+ *        keeps its CRTCs, or else the CRTC driving the output.
+ *
+ * @return The CRTC, XCB_NONE when the output has none.
+ */
+static xcb_randr_crtc_t find_crtc(xcb_connection_t *connection, xcb_randr_output_t output, xcb_timestamp_t timestamp)
+{
+   xcb_randr_get_output_info_reply_t *info = xcb_randr_get_output_info_reply(
+      connection, xcb_randr_get_output_info(connection, output, timestamp), nullptr);
+   if (info == nullptr)
+   {
+      return XCB_NONE;
+   }
+
+   const xcb_randr_crtc_t *crtcs = xcb_randr_get_output_info_crtcs(info);
+   const int crtc_count = xcb_randr_get_output_info_crtcs_length(info);
+   xcb_randr_crtc_t found = info->crtc;
+   for (int i = 0; i < crtc_count; i++)
+   {
+      xcb_randr_get_crtc_info_reply_t *crtc_info = xcb_randr_get_crtc_info_reply(
+         connection, xcb_randr_get_crtc_info(connection, crtcs[i], timestamp), nullptr);
+      const bool unused = crtc_info != nullptr && crtc_info->num_outputs == 0;
+      free(crtc_info);
+      if (unused)
+      {
+         found = crtcs[i];
+         break;
+      }
+   }
+   free(info);
+   return found;
+}
+
+VkResult lease_connector(xcb_connection_t *connection, xcb_window_t root, uint32_t connector_id,
+                         util::fd_owner &lease_fd)
+{
+   const xcb_query_extension_reply_t *extension = xcb_get_extension_data(connection, &xcb_randr_id);
+   if (extension == nullptr || !extension->present)
+   {
+      WSI_LOG_ERROR("XRandR extension not available, the display cannot be leased.");
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+
+   xcb_randr_query_version_reply_t *version = xcb_randr_query_version_reply(
+      connection, xcb_randr_query_version(connection, RANDR_MAJOR_VERSION, RANDR_MINOR_VERSION), nullptr);
+   if (version == nullptr ||
+       (version->major_version == RANDR_MAJOR_VERSION && version->minor_version < RANDR_MINOR_VERSION))
+   {
+      WSI_LOG_ERROR("XRandR %u.%u is required to lease displays.", RANDR_MAJOR_VERSION, RANDR_MINOR_VERSION);
+      free(version);
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+   free(version);
+
+   xcb_randr_get_screen_resources_current_reply_t *resources = xcb_randr_get_screen_resources_current_reply(
+      connection, xcb_randr_get_screen_resources_current(connection, root), nullptr);
+   if (resources == nullptr)
+   {
+      WSI_LOG_ERROR("Failed to get XRandR screen resources.");
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+   xcb_randr_output_t output = find_output(connection, resources, connector_id);
+   xcb_randr_crtc_t crtc =
+      output != XCB_NONE ? find_crtc(connection, output, resources->config_timestamp) : XCB_NONE;
+   free(resources);
+   if (output == XCB_NONE || crtc == XCB_NONE)
+   {
+      WSI_LOG_ERROR("No XRandR output and CRTC drive DRM connector %u.", connector_id);
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+
+   xcb_generic_error_t *error = nullptr;
+   const xcb_randr_lease_t lease = xcb_generate_id(connection);
+   xcb_randr_create_lease_reply_t *reply = xcb_randr_create_lease_reply(
+      connection, xcb_randr_create_lease(connection, root, lease, 1, 1, &crtc, &output), &error);
+   if (reply == nullptr)
+   {
+      WSI_LOG_ERROR("The X server did not lease DRM connector %u, error %u.", connector_id,
+                    error != nullptr ? error->error_code : 0);
+      free(error);
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+
+   lease_fd = util::fd_owner{ xcb_randr_create_lease_reply_fds(connection, reply)[0] };
+   free(reply);
+   return VK_SUCCESS;
+}
+
+} /* namespace randr_lease */
+
+} /* namespace display */
+
+} /* namespace wsi */
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file randr_lease.hpp
+ *
+ * @brief DRM leases of RandR outputs, for VK_EXT_acquire_xlib_display.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vulkan/vulkan.h>
+#include <xcb/xcb.h>
+#include <xcb/randr.h>
+
+#include "util/file_descriptor.hpp"
+
+namespace wsi
+{
+
+namespace display
+{
+
+namespace randr_lease
+{
+
+/**
+ * @brief Get the KMS connector of a RandR output, from the CONNECTOR_ID output property of the modesetting drivers.
+ *
+ * @param[out] connector_id The connector id.
+ * @return false when the X server does not report the connector of @p output.
+ */
+bool get_connector_id(xcb_connection_t *connection, xcb_randr_output_t output, uint32_t &connector_id);
+
+/**
+ * @brief Lease the RandR output of a KMS connector and a CRTC that can drive it from the X server.
+ *
+ * The X server stops using the output until the lease ends, when the last descriptor of the lease is closed. The rest
+ * of the screen keeps running. Needs RandR 1.6.
+ *
+ * @param root         Root window of the screen the output belongs to.
+ * @param connector_id The connector, see @ref get_connector_id.
+ * @param[out] lease_fd DRM master descriptor of the leased connector, CRTC and planes.
+ * @return VK_SUCCESS, or VK_ERROR_INITIALIZATION_FAILED when the X server does not lease the output.
+ */
+VkResult lease_connector(xcb_connection_t *connection, xcb_window_t root, uint32_t connector_id,
+                         util::fd_owner &lease_fd);
+
+} /* namespace randr_lease */
+
+} /* namespace display */
+
+} /* namespace wsi */
@@ -35,9 +35,13 @@ namespace wsi
 namespace display
 {
 
-surface::surface(drm_display_mode *display_mode, VkExtent2D extent)
-   : m_display_mode(display_mode)
+surface::surface(drm_display &display, drm_display_mode *display_mode, VkExtent2D extent, uint32_t plane_index,
+                 uint32_t plane_stack_index)
+   : m_display(display)
+   , m_display_mode(display_mode)
    , m_extent(extent)
+   , m_plane_index(plane_index)
+   , m_plane_stack_index(plane_stack_index)
    , m_surface_properties(this)
 {
 }
@@ -59,10 +63,25 @@ VkExtent2D surface::get_extent() const
    return m_extent;
 }
 
+drm_display &surface::get_display()
+{
+   return m_display;
+}
+
 drm_display_mode *surface::get_display_mode()
 {
    return m_display_mode;
 }
 
+uint32_t surface::get_plane_index() const
+{
+   return m_plane_index;
+}
+
+uint32_t surface::get_plane_stack_index() const
+{
+   return m_plane_stack_index;
+}
+
 } /* namespace display */
 } /* namespace wsi */
@@ -43,10 +43,14 @@ public:
    /**
     * @brief Construct a new surface.
     *
+    * @param display The display the surface is shown on, the display @p mode belongs to.
     * @param mode The display mode to be used with the surface.
     * @param extent The extent of the surface.
+    * @param plane_index Index of the display plane the surface is shown on, within the planes of @p display.
+    * @param plane_stack_index Position of the plane in the stacking order.
     */
-   surface(drm_display_mode *mode, VkExtent2D extent);
+   surface(drm_display &display, drm_display_mode *mode, VkExtent2D extent, uint32_t plane_index,
+           uint32_t plane_stack_index);
 
    wsi::surface_properties &get_properties() override;
    util::unique_ptr<swapchain_base> allocate_swapchain(layer::device_private_data &dev_data,
@@ -57,12 +61,32 @@ public:
     */
    VkExtent2D get_extent() const;
 
+   /**
+    * @brief Get the display the surface is shown on.
+    */
+   drm_display &get_display();
+
    /**
     * @brief Get the display mode associated with this surface.
     */
    drm_display_mode *get_display_mode();
 
+   /**
+    * @brief Get the index of the display plane the surface is shown on, see drm_display::get_num_planes.
+    */
+   uint32_t get_plane_index() const;
+
+   /**
+    * @brief Get the position in the stacking order requested for the plane of the surface.
+    */
+   uint32_t get_plane_stack_index() const;
+
 private:
+   /**
+    * @brief The display the surface is shown on.
+    */
+   drm_display &m_display;
+
    /**
     * @brief Pointer to the DRM display mode used with this surface.
     */
@@ -73,6 +97,12 @@ private:
     */
    VkExtent2D m_extent;
 
+   /**
+    * @brief The planeIndex and planeStackIndex the surface was created with.
+    */
+   uint32_t m_plane_index;
+   uint32_t m_plane_stack_index;
+
    /**
     * @brief Surface properties instance specific to this surface.
     */
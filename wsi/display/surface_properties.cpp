@@ -29,6 +29,15 @@
 #include "surface.hpp"
 #include "util/macros.hpp"
 
+#if WSI_DISPLAY_XLIB_LEASE
+#include <X11/Xlib-xcb.h>
+#include <X11/extensions/Xrandr.h>
+#include <vulkan/vulkan_xlib.h>
+#include <vulkan/vulkan_xlib_xrandr.h>
+
+#include "randr_lease.hpp"
+#endif
+
 namespace wsi
 {
 
@@ -39,14 +48,18 @@ constexpr int max_core_1_0_formats = VK_FORMAT_ASTC_12x12_SRGB_BLOCK + 1;
 
 void surface_properties::populate_present_mode_compatibilities()
 {
-   std::array<present_mode_compatibility, 1> compatible_present_modes_list = { present_mode_compatibility{
-      VK_PRESENT_MODE_FIFO_KHR, 1, { VK_PRESENT_MODE_FIFO_KHR } } };
-   m_compatible_present_modes = compatible_present_modes<1>(compatible_present_modes_list);
+   /* FIFO_RELAXED enables variable refresh rate with the mode, switching to or from it needs a modeset. */
+   std::array<present_mode_compatibility, 3> compatible_present_modes_list = {
+      present_mode_compatibility{ VK_PRESENT_MODE_FIFO_KHR, 1, { VK_PRESENT_MODE_FIFO_KHR } },
+      present_mode_compatibility{ VK_PRESENT_MODE_FIFO_RELAXED_KHR, 1, { VK_PRESENT_MODE_FIFO_RELAXED_KHR } },
+      present_mode_compatibility{ VK_PRESENT_MODE_MAILBOX_KHR, 1, { VK_PRESENT_MODE_MAILBOX_KHR } },
+   };
+   m_compatible_present_modes = compatible_present_modes<3>(compatible_present_modes_list);
 }
 
 surface_properties::surface_properties(surface *wsi_surface)
    : m_specific_surface(wsi_surface)
-   , m_supported_modes({ VK_PRESENT_MODE_FIFO_KHR })
+   , m_supported_modes({ VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_MAILBOX_KHR })
 {
    populate_present_mode_compatibilities();
 }
@@ -84,6 +97,14 @@ VkResult surface_properties::get_surface_capabilities(VkPhysicalDevice physical_
                                                       VkSurfaceCapabilities2KHR *pSurfaceCapabilities)
 {
    TRY(check_surface_present_mode_query_is_supported(pSurfaceInfo, m_supported_modes));
+   auto surface_present_mode =
+      util::find_extension<VkSurfacePresentModeEXT>(VK_STRUCTURE_TYPE_SURFACE_PRESENT_MODE_EXT, pSurfaceInfo);
+   if (surface_present_mode != nullptr && surface_present_mode->presentMode == VK_PRESENT_MODE_FIFO_RELAXED_KHR &&
+       !supports_fifo_relaxed())
+   {
+      WSI_LOG_ERROR("Querying surface capability support for a present mode that is not supported by the surface");
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
 
    /* Image count limits */
    get_surface_capabilities(physical_device, &pSurfaceCapabilities->surfaceCapabilities);
@@ -106,13 +127,28 @@ VkResult surface_properties::get_surface_formats(VkPhysicalDevice physical_devic
                                                  VkSurfaceFormatKHR *surfaceFormats,
                                                  VkSurfaceFormat2KHR *extended_surface_formats)
 {
-   auto &display = drm_display::get_display();
-   if (!display.has_value())
+   /* Without a surface, report the formats of the first display. */
+   drm_display *display = nullptr;
+   if (m_specific_surface != nullptr)
+   {
+      display = &m_specific_surface->get_display();
+   }
+   else if (drm_display::get_num_displays() > 0)
+   {
+      display = &drm_display::get_display_at(0);
+   }
+   if (display == nullptr)
    {
       return VK_ERROR_SURFACE_LOST_KHR;
    }
 
-   auto display_formats = display->get_supported_formats();
+   /* Overlays may scan out fewer formats than the primary plane. */
+   uint32_t plane_index = m_specific_surface != nullptr ? m_specific_surface->get_plane_index() : 0;
+   if (plane_index >= display->get_num_planes())
+   {
+      plane_index = 0;
+   }
+   auto display_formats = display->get_supported_formats(plane_index);
 
    uint32_t format_count = 0;
 
@@ -182,7 +218,24 @@ VkResult surface_properties::get_surface_present_modes(VkPhysicalDevice physical
    UNUSED(physical_device);
    UNUSED(surface);
 
-   return get_surface_present_modes_common(pPresentModeCount, pPresentModes, m_supported_modes);
+   if (supports_fifo_relaxed())
+   {
+      return get_surface_present_modes_common(pPresentModeCount, pPresentModes, m_supported_modes);
+   }
+
+   const std::array<VkPresentModeKHR, 2> fixed_refresh_modes = { VK_PRESENT_MODE_FIFO_KHR,
+                                                                  VK_PRESENT_MODE_MAILBOX_KHR };
+   return get_surface_present_modes_common(pPresentModeCount, pPresentModes, fixed_refresh_modes);
+}
+
+bool surface_properties::supports_fifo_relaxed() const
+{
+   /* Without a surface, report the modes of the primary plane of the first display. */
+   if (m_specific_surface != nullptr)
+   {
+      return m_specific_surface->get_plane_index() == 0 && m_specific_surface->get_display().supports_vrr();
+   }
+   return drm_display::get_num_displays() > 0 && drm_display::get_display_at(0).supports_vrr();
 }
 
 VWL_VKAPI_CALL(VkResult)
@@ -201,7 +254,11 @@ CreateDisplayModeKHR(VkPhysicalDevice physicalDevice, VkDisplayKHR display,
    assert(pCreateInfo->pNext == NULL);
    assert(pCreateInfo->flags == 0);
 
-   drm_display *dpy = reinterpret_cast<drm_display *>(display);
+   drm_display *dpy = drm_display::get_display(display);
+   if (dpy == nullptr)
+   {
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
 
    const VkDisplayModeParametersKHR *params = &pCreateInfo->parameters;
 
@@ -234,11 +291,21 @@ CreateDisplayPlaneSurfaceKHR(VkInstance instance, const VkDisplaySurfaceCreateIn
 
    drm_display_mode *display_mode = reinterpret_cast<drm_display_mode *>(pCreateInfo->displayMode);
 
+   /* The plane index counts the planes of all the displays, the surface keeps the index within its display. */
+   drm_display *display = drm_display::get_display(display_mode);
+   uint32_t plane_index = 0;
+   if (display == nullptr || drm_display::find_plane(pCreateInfo->planeIndex, plane_index) != display)
+   {
+      WSI_LOG_ERROR("Display plane %u cannot show the display mode.", pCreateInfo->planeIndex);
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+
    VkResult res = instance_data.disp.CreateDisplayPlaneSurfaceKHR(instance, pCreateInfo, pAllocator, pSurface);
    if (res == VK_SUCCESS)
    {
 
-      auto wsi_surface = allocator.make_unique<surface>(display_mode, pCreateInfo->imageExtent);
+      auto wsi_surface = allocator.make_unique<surface>(*display, display_mode, pCreateInfo->imageExtent, plane_index,
+                                                        pCreateInfo->planeStackIndex);
       if (wsi_surface == nullptr)
       {
          return VK_ERROR_OUT_OF_HOST_MEMORY;
@@ -262,7 +329,7 @@ GetDisplayModePropertiesKHR(VkPhysicalDevice physicalDevice, VkDisplayKHR displa
    assert(display != VK_NULL_HANDLE);
    assert(pPropertyCount != nullptr);
 
-   drm_display *dpy = reinterpret_cast<drm_display *>(display);
+   drm_display *dpy = drm_display::get_display(display);
    assert(dpy != nullptr);
 
    drm_display_mode *modes{ dpy->get_display_modes_begin() };
@@ -304,7 +371,6 @@ GetDisplayPlaneCapabilitiesKHR(VkPhysicalDevice physicalDevice, VkDisplayModeKHR
                                VkDisplayPlaneCapabilitiesKHR *pCapabilities)
 {
    UNUSED(physicalDevice);
-   UNUSED(planeIndex);
    assert(physicalDevice != VK_NULL_HANDLE);
    assert(mode != VK_NULL_HANDLE);
    assert(pCapabilities != nullptr);
@@ -312,26 +378,15 @@ GetDisplayPlaneCapabilitiesKHR(VkPhysicalDevice physicalDevice, VkDisplayModeKHR
    drm_display_mode *display_mode = reinterpret_cast<drm_display_mode *>(mode);
    assert(display_mode != nullptr);
 
-   auto &display = drm_display::get_display();
-   if (!display.has_value())
+   /* Modes and planes belong to one display, the plane index counts the planes of all the displays. */
+   drm_display *display = drm_display::get_display(display_mode);
+   uint32_t display_plane_index = 0;
+   if (display == nullptr || drm_display::find_plane(planeIndex, display_plane_index) != display)
    {
-      WSI_LOG_ERROR("DRM display not available.");
+      WSI_LOG_ERROR("Display plane %u cannot show the display mode.", planeIndex);
       return VK_ERROR_OUT_OF_HOST_MEMORY;
    }
 
-   /* Implementation supports only one plane for presenting
-    * images. Therefore plane index must be 0. */
-   assert(planeIndex == 0);
-
-   auto valid_mode =
-      std::find_if(display->get_display_modes_begin(), display->get_display_modes_end(), [&display_mode](auto &mode) {
-         return (display_mode->get_width() == mode.get_width()) && (display_mode->get_height() == mode.get_height()) &&
-                (display_mode->get_refresh_rate() == mode.get_refresh_rate());
-      });
-
-   assert(valid_mode != display->get_display_modes_end());
-   UNUSED(valid_mode);
-
    VkDisplayPlaneCapabilitiesKHR planeCapabilities{};
    planeCapabilities.supportedAlpha = VK_DISPLAY_PLANE_ALPHA_OPAQUE_BIT_KHR;
    planeCapabilities.minSrcPosition = { 0, 0 };
@@ -339,9 +394,20 @@ GetDisplayPlaneCapabilitiesKHR(VkPhysicalDevice physicalDevice, VkDisplayModeKHR
    /* Implementation allows swapchains to be a subset of the display area. */
    planeCapabilities.minSrcExtent = { 0, 0 };
    planeCapabilities.maxSrcExtent = { display_mode->get_width(), display_mode->get_height() };
-   planeCapabilities.minDstPosition = { 0, 0 };
-   planeCapabilities.maxDstPosition = { 0, 0 };
-   planeCapabilities.minDstExtent = { display_mode->get_width(), display_mode->get_height() };
+   if (display_plane_index == 0)
+   {
+      /* The primary plane covers the whole display. */
+      planeCapabilities.minDstPosition = { 0, 0 };
+      planeCapabilities.maxDstPosition = { 0, 0 };
+      planeCapabilities.minDstExtent = { display_mode->get_width(), display_mode->get_height() };
+   }
+   else
+   {
+      /* Overlays can go anywhere on the display, each present is checked with a test-only commit. */
+      planeCapabilities.minDstPosition = { 0, 0 };
+      planeCapabilities.maxDstPosition = { display_mode->get_width(), display_mode->get_height() };
+      planeCapabilities.minDstExtent = { 1, 1 };
+   }
    planeCapabilities.maxDstExtent = { display_mode->get_width(), display_mode->get_height() };
 
    *pCapabilities = planeCapabilities;
@@ -354,25 +420,20 @@ GetDisplayPlaneSupportedDisplaysKHR(VkPhysicalDevice physicalDevice, uint32_t pl
                                     VkDisplayKHR *pDisplays)
 {
    UNUSED(physicalDevice);
-   UNUSED(planeIndex);
    assert(physicalDevice != VK_NULL_HANDLE);
    assert(pDisplayCount != nullptr);
 
-   auto &display = drm_display::get_display();
-   if (!display.has_value())
+   /* Each plane is attached to the CRTC of a single display. */
+   uint32_t display_plane_index = 0;
+   drm_display *display = drm_display::find_plane(planeIndex, display_plane_index);
+   if (display == nullptr)
    {
-      WSI_LOG_ERROR("DRM display not available.");
+      WSI_LOG_ERROR("Display plane %u not available.", planeIndex);
       return VK_ERROR_OUT_OF_HOST_MEMORY;
    }
 
-   /* Implementation supports only one plane for presenting
-    * images. Therefore plane index must be 0. */
-   assert(planeIndex == 0);
-
    if (pDisplays == nullptr)
    {
-      /* Implementation will expose just one (the main)
-       * plane for the application to use. */
       *pDisplayCount = 1;
       return VK_SUCCESS;
    }
@@ -382,7 +443,7 @@ GetDisplayPlaneSupportedDisplaysKHR(VkPhysicalDevice physicalDevice, uint32_t pl
       return VK_INCOMPLETE;
    }
 
-   *pDisplays = reinterpret_cast<VkDisplayKHR>(&display.value());
+   *pDisplays = display->get_handle();
    *pDisplayCount = 1;
 
    return VK_SUCCESS;
@@ -396,35 +457,44 @@ GetPhysicalDeviceDisplayPlanePropertiesKHR(VkPhysicalDevice physicalDevice, uint
    assert(physicalDevice != VK_NULL_HANDLE);
    assert(pPropertyCount != nullptr);
 
-   auto &display = drm_display::get_display();
-   if (!display.has_value())
+   /* For each display, its primary plane followed by the overlays of its CRTC when atomic modesetting is
+    * supported. */
+   const uint32_t num_displays = drm_display::get_num_displays();
+   uint32_t num_planes = 0;
+   for (uint32_t i = 0; i < num_displays; i++)
    {
-      WSI_LOG_ERROR("DRM display not available.");
-      return VK_ERROR_OUT_OF_HOST_MEMORY;
+      num_planes += drm_display::get_display_at(i).get_num_planes();
    }
 
    if (pProperties == nullptr)
    {
-      /* Implementation will expose just one (the main)
-       * plane for the application to use. */
-      *pPropertyCount = 1;
+      *pPropertyCount = num_planes;
       return VK_SUCCESS;
    }
 
-   if (*pPropertyCount == 0)
+   const uint32_t nr_properties = std::min(*pPropertyCount, num_planes);
+   uint32_t plane = 0;
+   for (uint32_t display_index = 0; display_index < num_displays; display_index++)
    {
-      return VK_INCOMPLETE;
-   }
+      auto &display = drm_display::get_display_at(display_index);
+      for (uint32_t i = 0; i < display.get_num_planes() && plane < nr_properties; i++, plane++)
+      {
+         /* The planes of unplugged displays keep their indices but are not on any display. */
+         VkDisplayPlanePropertiesKHR planeProperties{};
+         planeProperties.currentDisplay = display.is_connected() ? display.get_handle() : VK_NULL_HANDLE;
 
-   VkDisplayPlanePropertiesKHR planeProperties{};
-   planeProperties.currentDisplay = reinterpret_cast<VkDisplayKHR>(&display.value());
+         /* Planes stack in index order unless surfaces request otherwise with planeStackIndex. */
+         planeProperties.currentStackIndex = i;
 
-   /* Since the implementation is exposing just one plane the value for
-    * the current stack index must be 0.*/
-   planeProperties.currentStackIndex = 0;
+         pProperties[plane] = planeProperties;
+      }
+   }
+   *pPropertyCount = nr_properties;
 
-   *pProperties = planeProperties;
-   *pPropertyCount = 1;
+   if (nr_properties < num_planes)
+   {
+      return VK_INCOMPLETE;
+   }
 
    return VK_SUCCESS;
 }
@@ -437,40 +507,103 @@ GetPhysicalDeviceDisplayPropertiesKHR(VkPhysicalDevice physicalDevice, uint32_t
    assert(physicalDevice != VK_NULL_HANDLE);
    assert(pPropertyCount != nullptr);
 
-   auto &display = drm_display::get_display();
-
-   if (!display.has_value())
+   /* Displays of unplugged connectors are not reported until they are connected again. */
+   std::array<drm_display *, drm_display::MAX_DISPLAYS> displays;
+   uint32_t num_displays = 0;
+   const uint32_t num_probed_displays = drm_display::get_num_displays();
+   for (uint32_t i = 0; i < num_probed_displays; i++)
    {
-      *pPropertyCount = 0;
-      return VK_SUCCESS;
+      auto &display = drm_display::get_display_at(i);
+      if (display.is_connected())
+      {
+         displays[num_displays++] = &display;
+      }
    }
 
    if (pProperties == nullptr)
    {
-      *pPropertyCount = 1;
+      *pPropertyCount = num_displays;
       return VK_SUCCESS;
    }
 
-   if (*pPropertyCount == 0)
+   const uint32_t nr_properties = std::min(*pPropertyCount, num_displays);
+   for (uint32_t i = 0; i < nr_properties; i++)
+   {
+      auto &display = *displays[i];
+
+      VkDisplayPropertiesKHR display_properties = {};
+      display_properties.display = display.get_handle();
+      display_properties.displayName = "DRM display";
+      display_properties.physicalDimensions = { display.get_connector()->mmWidth, display.get_connector()->mmHeight };
+      display_properties.physicalResolution = { display.get_max_width(), display.get_max_height() };
+      display_properties.supportedTransforms = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+      display_properties.planeReorderPossible = VK_FALSE;
+      display_properties.persistentContent = VK_FALSE;
+
+      pProperties[i] = display_properties;
+   }
+   *pPropertyCount = nr_properties;
+
+   if (nr_properties < num_displays)
    {
       return VK_INCOMPLETE;
    }
 
-   *pPropertyCount = 1;
+   return VK_SUCCESS;
+}
+
+#if WSI_DISPLAY_XLIB_LEASE
+VWL_VKAPI_CALL(VkResult)
+GetRandROutputDisplayEXT(VkPhysicalDevice physicalDevice, Display *dpy, RROutput rrOutput, VkDisplayKHR *pDisplay)
+{
+   UNUSED(physicalDevice);
+   assert(dpy != nullptr);
+   assert(pDisplay != nullptr);
+
+   /* The displays are those of the KMS connectors, the modesetting drivers report the connector of each output. */
+   *pDisplay = VK_NULL_HANDLE;
+   uint32_t connector_id = 0;
+   if (randr_lease::get_connector_id(XGetXCBConnection(dpy), static_cast<xcb_randr_output_t>(rrOutput),
+                                     connector_id))
+   {
+      drm_display *display = drm_display::find_connector(connector_id);
+      if (display != nullptr)
+      {
+         *pDisplay = display->get_handle();
+      }
+   }
+   return VK_SUCCESS;
+}
+
+VWL_VKAPI_CALL(VkResult)
+AcquireXlibDisplayEXT(VkPhysicalDevice physicalDevice, Display *dpy, VkDisplayKHR display)
+{
+   UNUSED(physicalDevice);
+   assert(dpy != nullptr);
+   assert(display != VK_NULL_HANDLE);
+
+   drm_display *drm_dpy = drm_display::get_display(display);
+   assert(drm_dpy != nullptr);
 
-   VkDisplayPropertiesKHR display_properties = {};
-   display_properties.display = reinterpret_cast<VkDisplayKHR>(&display.value());
-   display_properties.displayName = "DRM display";
-   display_properties.physicalDimensions = { display->get_connector()->mmWidth, display->get_connector()->mmHeight };
-   display_properties.physicalResolution = { display->get_max_width(), display->get_max_height() };
-   display_properties.supportedTransforms = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-   display_properties.planeReorderPossible = VK_FALSE;
-   display_properties.persistentContent = VK_FALSE;
+   util::fd_owner lease_fd;
+   TRY(randr_lease::lease_connector(XGetXCBConnection(dpy), DefaultRootWindow(dpy), drm_dpy->get_connector_id(),
+                                    lease_fd));
+   return drm_dpy->acquire_lease(std::move(lease_fd));
+}
+
+VWL_VKAPI_CALL(VkResult)
+ReleaseDisplayEXT(VkPhysicalDevice physicalDevice, VkDisplayKHR display)
+{
+   UNUSED(physicalDevice);
+   assert(display != VK_NULL_HANDLE);
 
-   *pProperties = display_properties;
+   drm_display *drm_dpy = drm_display::get_display(display);
+   assert(drm_dpy != nullptr);
 
+   drm_dpy->release_lease();
    return VK_SUCCESS;
 }
+#endif
 
 PFN_vkVoidFunction surface_properties::get_proc_addr(const char *name)
 {
@@ -503,6 +636,20 @@ PFN_vkVoidFunction surface_properties::get_proc_addr(const char *name)
    {
       return reinterpret_cast<PFN_vkVoidFunction>(GetPhysicalDeviceDisplayPropertiesKHR);
    }
+#if WSI_DISPLAY_XLIB_LEASE
+   else if (strcmp(name, "vkGetRandROutputDisplayEXT") == 0)
+   {
+      return reinterpret_cast<PFN_vkVoidFunction>(GetRandROutputDisplayEXT);
+   }
+   else if (strcmp(name, "vkAcquireXlibDisplayEXT") == 0)
+   {
+      return reinterpret_cast<PFN_vkVoidFunction>(AcquireXlibDisplayEXT);
+   }
+   else if (strcmp(name, "vkReleaseDisplayEXT") == 0)
+   {
+      return reinterpret_cast<PFN_vkVoidFunction>(ReleaseDisplayEXT);
+   }
+#endif
 
    return nullptr;
 }
@@ -535,11 +682,13 @@ bool surface_properties::is_surface_extension_enabled(const layer::instance_priv
 void surface_properties::get_present_timing_surface_caps(
    VkPresentTimingSurfaceCapabilitiesEXT *present_timing_surface_caps)
 {
-   present_timing_surface_caps->presentTimingSupported = VK_FALSE;
-   present_timing_surface_caps->presentAtAbsoluteTimeSupported = VK_FALSE;
-   present_timing_surface_caps->presentAtRelativeTimeSupported = VK_FALSE;
-   present_timing_surface_caps->presentStageQueries = 0;
-   present_timing_surface_caps->presentStageTargets = 0;
+   /* Images show on the vblank of their page flip event, flips are held until the vblank before their target. */
+   present_timing_surface_caps->presentTimingSupported = VK_TRUE;
+   present_timing_surface_caps->presentAtAbsoluteTimeSupported = VK_TRUE;
+   present_timing_surface_caps->presentAtRelativeTimeSupported = VK_TRUE;
+   present_timing_surface_caps->presentStageQueries =
+      VK_PRESENT_STAGE_QUEUE_OPERATIONS_END_BIT_EXT | VK_PRESENT_STAGE_IMAGE_FIRST_PIXEL_VISIBLE_BIT_EXT;
+   present_timing_surface_caps->presentStageTargets = VK_PRESENT_STAGE_IMAGE_FIRST_PIXEL_VISIBLE_BIT_EXT;
 }
 #endif
 
@@ -77,11 +77,17 @@ public:
 private:
    surface *const m_specific_surface;
 
-   /* List of supported presentation modes */
-   std::array<VkPresentModeKHR, 1> m_supported_modes;
+   /* List of supported presentation modes, FIFO_RELAXED only with @ref supports_fifo_relaxed. */
+   std::array<VkPresentModeKHR, 3> m_supported_modes;
+
+   /**
+    * @brief Whether FIFO_RELAXED is supported: it is implemented with variable refresh rate, which the swapchains of
+    *        the primary plane of a display supporting it set with the mode.
+    */
+   bool supports_fifo_relaxed() const;
 
    /* Stores compatible presentation modes */
-   compatible_present_modes<1> m_compatible_present_modes;
+   compatible_present_modes<3> m_compatible_present_modes;
 
    void get_surface_present_scaling_and_gravity(VkSurfacePresentScalingCapabilitiesEXT *scaling_capabilities) override;
    void populate_present_mode_compatibilities() override;
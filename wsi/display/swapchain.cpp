@@ -31,13 +31,19 @@
 #include <vulkan/vk_icd.h>
 #include <vulkan/vulkan.h>
 #include <errno.h>
+#include <algorithm>
+#include <cstring>
 
 #include <util/macros.hpp>
+#include <util/scratch_allocator.hpp>
+#include <util/trace.hpp>
 #include <wsi/extensions/image_compression_control.hpp>
 #include <wsi/extensions/present_id.hpp>
+#include <wsi/extensions/swapchain_maintenance.hpp>
 #include <wsi/swapchain_base.hpp>
 
 #include "swapchain.hpp"
+#include "present_timing_handler.hpp"
 
 namespace wsi
 {
@@ -49,8 +55,12 @@ swapchain::swapchain(layer::device_private_data &dev_data, const VkAllocationCal
                      surface &wsi_surface)
    : wsi::swapchain_base(dev_data, pAllocator)
    , m_wsi_allocator(nullptr)
+   , m_wsialloc_batch(m_allocator, m_device_data.get_allocation_stats())
+   , m_display(wsi_surface.get_display())
    , m_display_mode(wsi_surface.get_display_mode())
    , m_image_creation_parameters({}, m_allocator, {}, {})
+   , m_plane_index(wsi_surface.get_plane_index())
+   , m_plane_stack_index(wsi_surface.get_plane_stack_index())
 {
    m_image_create_info.format = VK_FORMAT_UNDEFINED;
 }
@@ -68,16 +78,6 @@ swapchain::~swapchain()
    m_wsi_allocator = nullptr;
 }
 
-static void page_flip_event(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec, void *user_data)
-{
-   UNUSED(fd);
-   UNUSED(sequence);
-   UNUSED(tv_sec);
-   UNUSED(tv_usec);
-   bool *done = (bool *)user_data;
-   *done = true;
-}
-
 VkResult swapchain::add_required_extensions(VkDevice device, const VkSwapchainCreateInfoKHR *swapchain_create_info)
 {
    auto compression_control = wsi_ext_image_compression_control::create(device, swapchain_create_info);
@@ -97,6 +97,14 @@ VkResult swapchain::add_required_extensions(VkDevice device, const VkSwapchainCr
       }
    }
 
+   if (m_device_data.is_swapchain_maintenance1_enabled())
+   {
+      if (!add_swapchain_extension(m_allocator.make_unique<wsi_ext_swapchain_maintenance1>(m_allocator)))
+      {
+         return VK_ERROR_OUT_OF_HOST_MEMORY;
+      }
+   }
+
    if (m_device_data.should_layer_handle_frame_boundary_events())
    {
       if (!add_swapchain_extension(m_allocator.make_unique<wsi_ext_frame_boundary>(m_device_data)))
@@ -105,6 +113,18 @@ VkResult swapchain::add_required_extensions(VkDevice device, const VkSwapchainCr
       }
    }
 
+#if VULKAN_WSI_LAYER_EXPERIMENTAL
+   bool swapchain_support_enabled = swapchain_create_info->flags & VK_SWAPCHAIN_CREATE_PRESENT_TIMING_BIT_EXT;
+   if (swapchain_support_enabled)
+   {
+      if (!add_swapchain_extension(
+             wsi_ext_present_timing_display::create(m_allocator, m_display.has_monotonic_timestamps())))
+      {
+         return VK_ERROR_OUT_OF_HOST_MEMORY;
+      }
+   }
+#endif
+
    return VK_SUCCESS;
 }
 
@@ -113,7 +133,33 @@ VkResult swapchain::init_platform(VkDevice device, const VkSwapchainCreateInfoKH
 {
    UNUSED(device);
    UNUSED(swapchain_create_info);
-   UNUSED(use_presentation_thread);
+
+   /* Hotplugs are only seen by display queries, probe again in case the connector was unplugged. */
+   drm_display::get_num_displays();
+   if (!m_display.is_connected())
+   {
+      WSI_LOG_ERROR("The display of the surface is not connected.");
+      return VK_ERROR_SURFACE_LOST_KHR;
+   }
+
+   if (m_plane_index >= m_display.get_num_planes())
+   {
+      WSI_LOG_ERROR("Display plane %u not available.", m_plane_index);
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+   /* Only the primary plane is available without atomic modesetting. */
+   m_use_atomic = m_display.get_atomic_properties() != nullptr;
+   m_use_in_fence = m_use_atomic && m_display.get_plane(m_plane_index).in_fence_fd != 0;
+
+   /* A late frame flips as soon as it is ready within the refresh range of the panel, rather than on the next
+    * vblank. The primary plane's swapchain sets it with the mode. */
+   m_use_vrr =
+      m_plane_index == 0 && m_present_mode == VK_PRESENT_MODE_FIFO_RELAXED_KHR && m_display.supports_vrr();
+
+   /* Flips complete on the DRM event thread, a mailbox present replaces the one waiting for the flip before it. */
+   use_presentation_thread = true;
+   m_mailbox_slot_enabled = m_present_mode == VK_PRESENT_MODE_MAILBOX_KHR;
+
    WSIALLOC_ASSERT_VERSION();
    if (wsialloc_new(&m_wsi_allocator) != WSIALLOC_ERROR_NONE)
    {
@@ -141,18 +187,11 @@ VkResult swapchain::get_surface_compatible_formats(const VkImageCreateInfo &info
    TRY_LOG(util::get_drm_format_properties(m_device_data.physical_device, info.format, drm_format_props),
            "Failed to get format properties");
 
-   auto &display = drm_display::get_display();
-   if (!display.has_value())
-   {
-      WSI_LOG_ERROR("DRM display not available.");
-      return VK_ERROR_OUT_OF_HOST_MEMORY;
-   }
-
    for (const auto &prop : drm_format_props)
    {
       drm_format_pair drm_format{ util::drm::vk_to_drm_format(info.format), prop.drmFormatModifier };
 
-      if (!display->is_format_supported(drm_format))
+      if (!m_display.is_format_supported(drm_format, m_plane_index))
       {
          continue;
       }
@@ -189,22 +228,14 @@ VkResult swapchain::get_surface_compatible_formats(const VkImageCreateInfo &info
 
          VkImageCompressionControlEXT compression_control = {};
 
-         if (m_device_data.is_swapchain_compression_control_enabled())
+         auto *ext = get_swapchain_extension<wsi_ext_image_compression_control>();
+         if (ext)
          {
-            auto *ext = get_swapchain_extension<wsi_ext_image_compression_control>();
-            /* For Image compression control, additional requirements to be satisfied such as
-               existence of VkImageCompressionControlEXT in swaphain_create_info for
-               the ext to be added to the list. so we check whether we got a valid pointer
-               and proceed if yes. */
-            if (ext)
-            {
-               compression_control = ext->get_compression_control_properties();
-               compression_control.pNext = image_info.pNext;
-               image_info.pNext = &compression_control;
-            }
+            compression_control = ext->get_compression_control_properties();
+            compression_control.pNext = image_info.pNext;
+            image_info.pNext = &compression_control;
          }
-         result = m_device_data.instance_data.disp.GetPhysicalDeviceImageFormatProperties2KHR(
-            m_device_data.physical_device, &image_info, &format_props);
+         result = util::get_image_format_properties(m_device_data.physical_device, image_info, format_props);
       }
       if (result != VK_SUCCESS)
       {
@@ -257,27 +288,29 @@ VkResult swapchain::allocate_wsialloc(VkImageCreateInfo &image_create_info, disp
 {
    bool is_protected_memory = (image_create_info.flags & VK_IMAGE_CREATE_PROTECTED_BIT) != 0;
    uint64_t allocation_flags = is_protected_memory ? WSIALLOC_ALLOCATE_PROTECTED : 0;
+   /* Images are scanned out directly, which display controllers without an IOMMU can only do from contiguous memory. */
+   allocation_flags |= WSIALLOC_ALLOCATE_CONTIGUOUS;
    if (avoid_allocation)
    {
       allocation_flags |= WSIALLOC_ALLOCATE_NO_MEMORY;
    }
 
-   if (m_device_data.is_swapchain_compression_control_enabled())
+   /* The extension is only added when the application enabled swapchain compression control and chained a
+    * VkImageCompressionControlEXT, or when the layer picked a fixed-rate compression for it. The images are scanned
+    * out as they are, so a fixed rate is only requested when the plane takes one of the fixed-rate modifiers. */
+   auto *ext = get_swapchain_extension<wsi_ext_image_compression_control>();
+   if (ext != nullptr &&
+       (ext->get_bitmask_for_image_compression_flags() & VK_IMAGE_COMPRESSION_FIXED_RATE_EXPLICIT_EXT) &&
+       std::any_of(importable_formats.begin(), importable_formats.end(), [](const wsialloc_format &format) {
+          return util::drm::is_fixed_rate_modifier(format.modifier);
+       }))
    {
-      auto *ext = get_swapchain_extension<wsi_ext_image_compression_control>();
-      /* For Image compression control, additional requirements to be satisfied such as
-         existence of VkImageCompressionControlEXT in swaphain_create_info for
-         the ext to be added to the list. so we check whether we got a valid pointer
-         and proceed if yes. */
-      if (ext)
-      {
-         if (ext->get_bitmask_for_image_compression_flags() & VK_IMAGE_COMPRESSION_FIXED_RATE_EXPLICIT_EXT)
-         {
-            allocation_flags |= WSIALLOC_ALLOCATE_HIGHEST_FIXED_RATE_COMPRESSION;
-         }
-      }
+      allocation_flags |= WSIALLOC_ALLOCATE_HIGHEST_FIXED_RATE_COMPRESSION;
    }
 
+   util::drm::sort_formats_by_scanout_cost(importable_formats.data(), importable_formats.size(),
+                                           (allocation_flags & WSIALLOC_ALLOCATE_HIGHEST_FIXED_RATE_COMPRESSION) != 0);
+
    wsialloc_allocate_info alloc_info = { importable_formats.data(), static_cast<unsigned>(importable_formats.size()),
                                          image_create_info.extent.width, image_create_info.extent.height,
                                          allocation_flags };
@@ -292,7 +325,8 @@ VkResult swapchain::allocate_wsialloc(VkImageCreateInfo &image_create_info, disp
    {
       alloc_result.buffer_fds[i] = -1;
    }
-   const auto res = wsialloc_alloc(m_wsi_allocator, &alloc_info, &alloc_result);
+   const uint32_t batch_size = avoid_allocation ? 1 : get_pending_allocation_count();
+   const auto res = m_wsialloc_batch.allocate(m_wsi_allocator, alloc_info, batch_size, &alloc_result);
    if (res != WSIALLOC_ERROR_NONE)
    {
       WSI_LOG_ERROR("Failed allocation of DMA Buffer. WSI error: %d", static_cast<int>(res));
@@ -307,6 +341,11 @@ VkResult swapchain::allocate_wsialloc(VkImageCreateInfo &image_create_info, disp
    external_memory.set_strides(alloc_result.average_row_strides);
    external_memory.set_buffer_fds(alloc_result.buffer_fds);
    external_memory.set_offsets(alloc_result.offsets);
+   external_memory.set_memory_source(m_wsi_allocator, allocation_flags, is_protected_memory);
+   if (!alloc_result.is_disjoint)
+   {
+      external_memory.keep_recycle_fd();
+   }
 
    uint32_t num_planes = util::drm::drm_fourcc_format_get_num_planes(alloc_result.format.fourcc);
 
@@ -355,7 +394,8 @@ static VkResult fill_image_create_info(VkImageCreateInfo &image_create_info,
 
 VkResult swapchain::allocate_image(display_image_data *image_data)
 {
-   util::vector<wsialloc_format> importable_formats(util::allocator(m_allocator, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND));
+   util::scratch_scope scratch(m_allocator);
+   util::vector<wsialloc_format> importable_formats(scratch.get_allocator());
    auto &m_allocated_format = m_image_creation_parameters.m_allocated_format;
    if (!importable_formats.try_push_back(m_allocated_format))
    {
@@ -368,73 +408,51 @@ VkResult swapchain::allocate_image(display_image_data *image_data)
 
 VkResult swapchain::create_framebuffer(const VkImageCreateInfo &image_create_info, display_image_data *image_data)
 {
-   VkResult ret_code = VK_SUCCESS;
-   std::array<uint32_t, util::MAX_PLANES> strides{ 0, 0, 0, 0 };
-   std::array<uint64_t, util::MAX_PLANES> modifiers{ 0, 0, 0, 0 };
-   const drm_format_pair allocated_format{ m_image_creation_parameters.m_allocated_format.fourcc,
-                                           m_image_creation_parameters.m_allocated_format.modifier };
-
-   auto &display = drm_display::get_display();
-   if (!display.has_value())
-   {
-      return VK_ERROR_INITIALIZATION_FAILED;
-   }
-
-   drm_gem_handle_array<util::MAX_PLANES> buffer_handles{ display->get_drm_fd() };
-
-   const auto &buffer_fds = image_data->external_mem.get_buffer_fds();
-
-   for (uint32_t plane = 0; plane < image_data->external_mem.get_num_planes(); plane++)
+   drm_framebuffer_desc desc{};
+   desc.width = image_create_info.extent.width;
+   desc.height = image_create_info.extent.height;
+   desc.format = drm_format_pair{ m_image_creation_parameters.m_allocated_format.fourcc,
+                                  m_image_creation_parameters.m_allocated_format.modifier };
+   desc.num_planes = image_data->external_mem.get_num_planes();
+   desc.buffer_fds = image_data->external_mem.get_buffer_fds();
+   desc.offsets = image_data->external_mem.get_offsets();
+   for (uint32_t plane = 0; plane < desc.num_planes; plane++)
    {
       assert(image_data->external_mem.get_strides()[plane] > 0);
-      strides[plane] = image_data->external_mem.get_strides()[plane];
-      modifiers[plane] = allocated_format.modifier;
-      if (drmPrimeFDToHandle(display->get_drm_fd(), buffer_fds[plane], &buffer_handles[plane]) != 0)
-      {
-         WSI_LOG_ERROR("Failed to convert buffer FD to GEM handle: %s", std::strerror(errno));
-         return VK_ERROR_INITIALIZATION_FAILED;
-      }
+      desc.strides[plane] = image_data->external_mem.get_strides()[plane];
    }
 
-   if (!display->is_format_supported(allocated_format))
+   if (!m_display.is_format_supported(desc.format, m_plane_index))
    {
       WSI_LOG_ERROR("Format not supported.");
       return VK_ERROR_INITIALIZATION_FAILED;
    }
 
-   int error = 0;
-   if (display->supports_fb_modifiers())
-   {
-      error = drmModeAddFB2WithModifiers(
-         display->get_drm_fd(), image_create_info.extent.width, image_create_info.extent.height,
-         allocated_format.fourcc, buffer_handles.data(), strides.data(), image_data->external_mem.get_offsets().data(),
-         modifiers.data(), &image_data->fb_id, DRM_MODE_FB_MODIFIERS);
-   }
-   else
-   {
-      error = drmModeAddFB2(display->get_drm_fd(), image_create_info.extent.width, image_create_info.extent.height,
-                            allocated_format.fourcc, buffer_handles.data(), strides.data(),
-                            image_data->external_mem.get_offsets().data(), &image_data->fb_id, 0);
-   }
-
+   /* Images wrapping buffers the display already has a framebuffer for share it. */
+   const uint64_t framebuffer_start_ns = util::frame_stats::now_ns();
+   int error = m_display.acquire_framebuffer(desc, image_data->fb_id);
    if (error != 0)
    {
-      WSI_LOG_ERROR("Failed to create framebuffer: %s", strerror(errno));
-      return VK_ERROR_INITIALIZATION_FAILED;
+      WSI_LOG_ERROR("Failed to create framebuffer: %s", std::strerror(-error));
+      return error == -ENOMEM ? VK_ERROR_OUT_OF_HOST_MEMORY : VK_ERROR_INITIALIZATION_FAILED;
    }
+   m_device_data.get_allocation_stats().record(util::allocation_stage::framebuffer_creation, framebuffer_start_ns, 0);
 
-   return ret_code;
+   return VK_SUCCESS;
 }
 
 VkResult swapchain::allocate_and_bind_swapchain_image(VkImageCreateInfo image_create_info, swapchain_image &image)
 {
-   std::unique_lock<std::recursive_mutex> image_status_lock(m_image_status_mutex);
-   image.status = swapchain_image::FREE;
+   {
+      std::lock_guard<std::recursive_mutex> image_status_lock(m_image_status_mutex);
+      set_image_status(image, swapchain_image::FREE);
+   }
    assert(image.data != nullptr);
    auto image_data = static_cast<display_image_data *>(image.data);
-   TRY_LOG(allocate_image(image_data), "Failed to allocate image");
-
-   image_status_lock.unlock();
+   {
+      std::lock_guard<std::mutex> allocation_lock(m_image_allocation_mutex);
+      TRY_LOG(allocate_image(image_data), "Failed to allocate image");
+   }
 
    TRY_LOG(create_framebuffer(image_create_info, image_data), "Failed to create framebuffer");
 
@@ -464,13 +482,13 @@ VkResult swapchain::create_swapchain_image(VkImageCreateInfo image_create_info,
 
    if (m_image_create_info.format == VK_FORMAT_UNDEFINED)
    {
-      util::vector<wsialloc_format> importable_formats(
-         util::allocator(m_allocator, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND));
-      util::vector<uint64_t> exportable_modifiers(util::allocator(m_allocator, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND));
+      /* The format lists only live for the allocation of the first image. */
+      util::scratch_scope scratch(m_allocator);
+      util::vector<wsialloc_format> importable_formats(scratch.get_allocator());
+      util::vector<uint64_t> exportable_modifiers(scratch.get_allocator());
 
       /* Query supported modifers. */
-      util::vector<VkDrmFormatModifierPropertiesEXT> drm_format_props(
-         util::allocator(m_allocator, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND));
+      util::vector<VkDrmFormatModifierPropertiesEXT> drm_format_props(scratch.get_allocator());
 
       TRY_LOG_CALL(
          get_surface_compatible_formats(image_create_info, importable_formats, exportable_modifiers, drm_format_props));
@@ -505,127 +523,344 @@ VkResult swapchain::create_swapchain_image(VkImageCreateInfo image_create_info,
    return m_device_data.disp.CreateImage(m_device, &m_image_create_info, get_allocation_callbacks(), &image.image);
 }
 
-void swapchain::present_image(const pending_present_request &pending_present)
+drm_plane_update swapchain::make_plane_update(const drm_display &display, const pending_present_request &present,
+                                              uint32_t fb_id)
 {
-   int drm_res = 0;
-   display_image_data *image_data =
-      reinterpret_cast<display_image_data *>(m_swapchain_images[pending_present.image_index].data);
-   const auto &display = drm_display::get_display();
-   if (!display.has_value())
+   const VkRect2D image_rect = { { 0, 0 }, { m_image_create_info.extent.width, m_image_create_info.extent.height } };
+
+   drm_plane_update update{};
+   update.fb_id = fb_id;
+   update.src = present.display_src_rect.extent.width != 0 ? present.display_src_rect : image_rect;
+   update.dst = present.display_dst_rect.extent.width != 0 ? present.display_dst_rect : image_rect;
+
+   /* Planes stack by planeStackIndex within the zpos range of the plane. */
+   const drm_plane_properties &plane = display.get_plane(m_plane_index);
+   update.zpos = std::min(plane.zpos_min + m_plane_stack_index, plane.zpos_max);
+   update.callback = page_flip_done;
+   update.context = this;
+   return update;
+}
+
+VkResult swapchain::atomic_set_mode(const drm_display &display, const drm_plane_update &update)
+{
+   const drm_atomic_properties *props = display.get_atomic_properties();
+   drmModeModeInfo mode_info = m_display_mode->get_drm_mode();
+
+   uint32_t mode_blob_id = 0;
+   if (drmModeCreatePropertyBlob(display.get_drm_fd(), &mode_info, sizeof(mode_info), &mode_blob_id) != 0)
    {
-      set_error_state(VK_ERROR_SURFACE_LOST_KHR);
-      return;
+      WSI_LOG_ERROR("drmModeCreatePropertyBlob failed: %s\n", std::strerror(errno));
+      return VK_ERROR_SURFACE_LOST_KHR;
    }
 
-   if (m_first_present)
+   drm_atomic_req_owner request{ drmModeAtomicAlloc() };
+   const uint32_t crtc_id = display.get_crtc_id();
+   bool added = request != nullptr &&
+                drmModeAtomicAddProperty(request.get(), display.get_connector_id(), props->connector_crtc_id,
+                                         crtc_id) >= 0 &&
+                drmModeAtomicAddProperty(request.get(), crtc_id, props->crtc_mode_id, mode_blob_id) >= 0 &&
+                drmModeAtomicAddProperty(request.get(), crtc_id, props->crtc_active, 1) >= 0 &&
+                display.add_plane_properties(request.get(), m_plane_index, update);
+
+   /* Set either way, so a swapchain replacing one that enabled it returns to fixed refresh. */
+   if (added && props->crtc_vrr_enabled != 0)
    {
-      /* Now we can set the mode of the new swapchain. */
-      drmModeModeInfo modeInfo = m_display_mode->get_drm_mode();
-
-      uint32_t connector_id = display->get_connector_id();
-      drm_res = drmModeSetCrtc(display->get_drm_fd(), display->get_crtc_id(), image_data->fb_id, 0, 0, &connector_id, 1,
-                               &modeInfo);
+      added = drmModeAtomicAddProperty(request.get(), crtc_id, props->crtc_vrr_enabled, m_use_vrr ? 1 : 0) >= 0;
+   }
 
+   VkResult result = VK_SUCCESS;
+   if (!added)
+   {
+      WSI_LOG_ERROR("Failed to build the atomic modeset request.");
+      result = VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
+   else if (display.atomic_commit(request.get(), DRM_MODE_ATOMIC_TEST_ONLY | DRM_MODE_ATOMIC_ALLOW_MODESET) != 0)
+   {
+      /* Some drivers reject configurations through atomic that the legacy API accepts. */
+      WSI_LOG_WARNING("Atomic modeset rejected by the driver, using legacy modesetting.");
+      m_use_atomic = false;
+      m_use_in_fence = false;
+      m_use_vrr = false;
+   }
+   else
+   {
+      /* The modeset commit blocks, the first image is on screen when it returns. */
+      int drm_res = display.atomic_commit(request.get(), DRM_MODE_ATOMIC_ALLOW_MODESET);
       if (drm_res != 0)
       {
-         WSI_LOG_ERROR("drmModeSetCrtc failed: %s\n", std::strerror(errno));
-         set_error_state(VK_ERROR_SURFACE_LOST_KHR);
-         return;
+         WSI_LOG_ERROR("drmModeAtomicCommit failed: %s\n", std::strerror(-drm_res));
+         result = VK_ERROR_SURFACE_LOST_KHR;
       }
    }
-   /* The swapchain has already started presenting. */
-   else
-   {
-
-      bool page_flip_complete = false;
 
-      drm_res = drmModePageFlip(display->get_drm_fd(), display->get_crtc_id(), image_data->fb_id,
-                                DRM_MODE_PAGE_FLIP_EVENT, (void *)&page_flip_complete);
+   /* The CRTC state holds a reference to the mode, the blob id is not needed after the commit. */
+   drmModeDestroyPropertyBlob(display.get_drm_fd(), mode_blob_id);
+   return result;
+}
 
-      if (drm_res != 0)
+VkResult swapchain::set_mode(drm_display &display, const drm_plane_update &update)
+{
+   if (m_use_atomic)
+   {
+      TRY(atomic_set_mode(display, update));
+      if (m_use_atomic)
       {
-         WSI_LOG_ERROR("drmModePageFlip failed: %s\n", std::strerror(errno));
-         set_error_state(VK_ERROR_SURFACE_LOST_KHR);
-         return;
+         return VK_SUCCESS;
       }
+   }
 
-      fd_set fds;
-      FD_ZERO(&fds);
-      FD_SET(display->get_drm_fd(), &fds);
+   drmModeModeInfo mode_info = m_display_mode->get_drm_mode();
+   int drm_res = display.set_crtc(update.fb_id, mode_info);
+   if (drm_res != 0)
+   {
+      WSI_LOG_ERROR("drmModeSetCrtc failed: %s\n", std::strerror(-drm_res));
+      return VK_ERROR_SURFACE_LOST_KHR;
+   }
 
-      do
-      {
-         struct timeval t;
-         t.tv_sec = 1;
-         t.tv_usec = 0;
-         drm_res = select(display->get_drm_fd() + 1, &fds, NULL, NULL, &t);
+   return VK_SUCCESS;
+}
+
+VkResult swapchain::queue_page_flip(drm_display &display, display_image_data *image_data,
+                                    const pending_present_request &present)
+{
+   WSI_TRACE_SCOPE_ID("kms_queue_flip", present.present_id);
+   int drm_res = 0;
+   if (m_use_atomic)
+   {
+      drm_plane_update update = make_plane_update(display, present, image_data->fb_id);
 
-         if (drm_res < 0)
+      /* Overlays are not validated by a modeset, check the driver can show them where they were asked to be. */
+      if (m_plane_index != 0 && (!m_tested_plane_rects.has_value() ||
+                                 memcmp(&m_tested_plane_rects->first, &update.src, sizeof(VkRect2D)) != 0 ||
+                                 memcmp(&m_tested_plane_rects->second, &update.dst, sizeof(VkRect2D)) != 0))
+      {
+         drm_res = display.test_plane_update(m_plane_index, update);
+         if (drm_res != 0)
          {
-            if (errno != EINTR && errno != EAGAIN)
-            {
-               WSI_LOG_ERROR("select() failed with errno: %d\n", errno);
-               set_error_state(VK_ERROR_SURFACE_LOST_KHR);
-               break;
-            }
-            WSI_LOG_ERROR("select() failed with %d, carrying on with page flip\n", errno);
+            WSI_LOG_ERROR("Display plane %u rejected the present: %s\n", m_plane_index, std::strerror(-drm_res));
+            return VK_ERROR_SURFACE_LOST_KHR;
          }
-         else if (drm_res == 0)
+         m_tested_plane_rects = std::make_pair(update.src, update.dst);
+      }
+
+      /* The kernel takes its own reference to the fence, the sync FD only needs to live until the commit. */
+      if (m_use_in_fence)
+      {
+         std::optional<util::fd_owner> in_fence = image_data->present_fence.export_sync_fd();
+         if (!in_fence.has_value())
          {
-            WSI_LOG_ERROR("select() timed out, carrying on with page flip\n");
+            WSI_LOG_WARNING("Failed to export the present fence, waiting for it before the flip.");
+            TRY_LOG_CALL(image_data->present_fence.wait_payload(UINT64_MAX));
          }
          else
          {
-            int result = FD_ISSET(display->get_drm_fd(), &fds);
-            assert(result > 0);
-            UNUSED(result);
-            drmEventContext ev = {};
-            ev.version = DRM_EVENT_CONTEXT_VERSION;
-            ev.page_flip_handler = page_flip_event;
-
-            drmHandleEvent(display->get_drm_fd(), &ev);
+            /* An invalid sync FD means the fence already signalled, it is left out of the commit. */
+            update.in_fence = std::move(*in_fence);
          }
-      } while ((drm_res == -1 && (errno == EINTR || errno == EAGAIN)) || drm_res == 0 || !page_flip_complete);
+      }
+
+      drm_res = display.queue_plane_update(m_plane_index, std::move(update));
+      if (drm_res != 0)
+      {
+         WSI_LOG_ERROR("drmModeAtomicCommit failed: %s\n", std::strerror(-drm_res));
+         return VK_ERROR_SURFACE_LOST_KHR;
+      }
+   }
+   else
+   {
+      drm_res = display.page_flip(image_data->fb_id, page_flip_done, this);
+      if (drm_res != 0)
+      {
+         WSI_LOG_ERROR("drmModePageFlip failed: %s\n", std::strerror(-drm_res));
+         return VK_ERROR_SURFACE_LOST_KHR;
+      }
+   }
+
+   return VK_SUCCESS;
+}
+
+/**
+ * @brief Refresh interval of @p mode in nanoseconds, from its pixel clock rather than the rounded vrefresh.
+ */
+static uint64_t get_refresh_duration_ns(const drm_display_mode &mode)
+{
+   const drmModeModeInfo info = mode.get_drm_mode();
+   if (info.clock == 0 || info.htotal == 0 || info.vtotal == 0)
+   {
+      return info.vrefresh != 0 ? 1000000000 / info.vrefresh : 0;
+   }
+
+   /* The clock is in kHz. */
+   return static_cast<uint64_t>(info.htotal) * info.vtotal * 1000000 / info.clock;
+}
+
+void swapchain::page_flip_done(void *context, bool presented, const drm_flip_time &time)
+{
+   reinterpret_cast<swapchain *>(context)->complete_page_flip(presented, &time);
+}
+
+void swapchain::wait_for_present_slot()
+{
+   /* Failures are reported by present_image, which waits again. */
+   m_display.wait_for_plane(m_plane_index);
+}
+
+bool swapchain::get_vblank_timing(uint64_t *vblank_ns, uint64_t *refresh_ns)
+{
+   drm_flip_time vblank;
+   *refresh_ns = get_refresh_duration_ns(*m_display_mode);
+   if (m_use_vrr || *refresh_ns == 0 || !m_display.has_monotonic_timestamps() ||
+       m_display.get_crtc_sequence(vblank) != 0)
+   {
+      return false;
    }
 
-   /* Find currently presented image */
-   uint32_t presented_index = m_swapchain_images.size();
-   if (!m_first_present)
+   *vblank_ns = vblank.time_ns;
+   return true;
+}
+
+uint64_t swapchain::get_present_release_time(const pending_present_request &pending_present)
+{
+   /* Variable refresh shows a flip as soon as it lands, and vblanks timed with CLOCK_REALTIME cannot be compared
+    * with the target. */
+   drm_flip_time vblank;
+   const uint64_t refresh_ns = get_refresh_duration_ns(*m_display_mode);
+   if (m_use_vrr || refresh_ns == 0 || !m_display.has_monotonic_timestamps() ||
+       m_display.get_crtc_sequence(vblank) != 0)
+   {
+      return 0;
+   }
+
+   uint64_t target_ns = pending_present.target_time;
+   if (pending_present.target_time_relative)
    {
-      for (uint32_t i = 0; i < m_swapchain_images.size(); ++i)
+      const uint64_t last_visible_ns = m_last_visible_ns.load(std::memory_order_relaxed);
+      if (last_visible_ns == 0)
       {
-         if (m_swapchain_images[i].status == swapchain_image::PRESENTED)
-         {
-            presented_index = i;
-            break;
-         }
+         return 0;
+      }
+      target_ns += last_visible_ns;
+   }
+
+   /* A flip queued between two vblanks shows on the second one. */
+   const uint64_t count =
+      get_target_refresh_count(vblank.time_ns, refresh_ns, target_ns, pending_present.target_time_nearest);
+   return get_release_time_for_refresh(vblank.time_ns, refresh_ns, count);
+}
+
+void swapchain::complete_page_flip(bool presented, const drm_flip_time *time)
+{
+   if (!m_pending_flip.has_value())
+   {
+      return;
+   }
+
+#if VULKAN_WSI_LAYER_EXPERIMENTAL
+   auto *timing_ext = get_swapchain_extension<wsi_ext_present_timing_display>();
+   if (timing_ext != nullptr && m_pending_flip->present_id != 0)
+   {
+      if (presented && time != nullptr)
+      {
+         timing_ext->set_stage_time(m_pending_flip->present_id, VK_PRESENT_STAGE_IMAGE_FIRST_PIXEL_VISIBLE_BIT_EXT,
+                                    time->time_ns);
+         timing_ext->update_refresh(get_refresh_duration_ns(*m_display_mode), m_use_vrr);
       }
-      /* There should always be a presented image, unless there was an error */
-      assert(presented_index < m_swapchain_images.size());
+      timing_ext->complete_presentation_entry(m_pending_flip->present_id);
+   }
+#else
+   UNUSED(time);
+#endif
+
+   if (!presented)
+   {
+      /* The commit carrying the flip failed on the DRM event thread, the image never reached the screen. */
+      unpresent_image(m_pending_flip->image_index);
+      m_pending_flip.reset();
+      set_error_state(VK_ERROR_SURFACE_LOST_KHR);
+      return;
+   }
+
+   m_frame_stats.record(util::frame_stage::queue_to_screen, m_pending_flip->queue_time_ns);
+   if (time != nullptr)
+   {
+      m_last_visible_ns.store(time->time_ns, std::memory_order_relaxed);
    }
-   /* The image is on screen, change the image status to PRESENTED. */
-   m_swapchain_images[pending_present.image_index].status = swapchain_image::PRESENTED;
 
    if (m_device_data.is_present_id_enabled())
    {
       auto *ext = get_swapchain_extension<wsi_ext_present_id>(true);
-      ext->set_present_id(pending_present.present_id);
+      ext->set_present_id(m_pending_flip->present_id);
+   }
+
+   /* The flipped image replaced the one on screen, release the old one. */
+   if (m_displayed_index.has_value())
+   {
+      unpresent_image(*m_displayed_index);
+   }
+   m_displayed_index = m_pending_flip->image_index;
+   m_pending_flip.reset();
+}
+
+void swapchain::present_image(const pending_present_request &pending_present)
+{
+   display_image_data *image_data =
+      reinterpret_cast<display_image_data *>(m_swapchain_images[pending_present.image_index].data);
+   /* Only one flip can be queued on the plane. The one of the previous present, or of the swapchain being replaced,
+    * usually completed on the DRM event thread already. */
+   if (!m_display.wait_for_plane(m_plane_index))
+   {
+      unpresent_image(pending_present.image_index);
+      set_error_state(VK_ERROR_SURFACE_LOST_KHR);
+      return;
    }
 
-   /* And release the old one. */
-   if (presented_index < m_swapchain_images.size())
+   /* The image belongs to the display engine from now on, change the image status to PRESENTED. Both are set before
+    * the flip is queued, its completion can run on the DRM event thread before queue_page_flip returns. */
+   replace_image_status(m_swapchain_images[pending_present.image_index], swapchain_image::PRESENTED);
+   m_pending_flip = pending_present;
+
+   /* Overlays show on the mode set by the swapchain of the primary plane, they never modeset. */
+   if (m_first_present && m_plane_index == 0)
    {
-      unpresent_image(presented_index);
+      /* Now we can set the mode of the new swapchain, the modeset is complete when it returns. It does not carry
+       * the present fence, it may fall back to legacy modesetting. */
+      if (image_data->present_fence.wait_payload(UINT64_MAX) != VK_SUCCESS ||
+          set_mode(m_display, make_plane_update(m_display, pending_present, image_data->fb_id)) != VK_SUCCESS)
+      {
+         /* The image never reached the display engine, it can be acquired again. */
+         unpresent_image(pending_present.image_index);
+         m_pending_flip.reset();
+         set_error_state(VK_ERROR_SURFACE_LOST_KHR);
+         return;
+      }
+
+      /* A modeset has no page flip event, the image is on screen from the last vblank of the CRTC. */
+      drm_flip_time time;
+      complete_page_flip(true, m_display.get_crtc_sequence(time) == 0 ? &time : nullptr);
+   }
+   /* The swapchain has already started presenting. */
+   else if (queue_page_flip(m_display, image_data, pending_present) != VK_SUCCESS)
+   {
+      unpresent_image(pending_present.image_index);
+      m_pending_flip.reset();
+      set_error_state(VK_ERROR_SURFACE_LOST_KHR);
    }
+}
 
-   return;
+bool swapchain::adopt_ancestor_image(swapchain_base &ancestor, swapchain_image &ancestor_image)
+{
+   /* Framebuffers belong to the DRM device, not to the swapchain they were created for. */
+   move_image_data_accounting(ancestor, sizeof(display_image_data));
+   reinterpret_cast<display_image_data *>(ancestor_image.data)->external_mem.rebind_allocator(m_allocator);
+   return true;
 }
 
 VkResult swapchain::image_set_present_payload(swapchain_image &image, VkQueue queue,
-                                              const queue_submit_semaphores &semaphores, const void *submission_pnext)
+                                              const queue_submit_semaphores &semaphores, const void *submission_pnext,
+                                              present_batch *batch)
 {
    auto image_data = reinterpret_cast<display_image_data *>(image.data);
-   return image_data->present_fence.set_payload(queue, semaphores, submission_pnext);
+   return image_data->present_fence.set_payload(queue, semaphores, submission_pnext, VK_NULL_HANDLE, batch);
 }
 
 VkResult swapchain::image_wait_present(swapchain_image &image, uint64_t timeout)
@@ -634,9 +869,20 @@ VkResult swapchain::image_wait_present(swapchain_image &image, uint64_t timeout)
    return data->present_fence.wait_payload(timeout);
 }
 
+std::optional<util::fd_owner> swapchain::image_export_present_payload(swapchain_image &image)
+{
+   auto data = reinterpret_cast<display_image_data *>(image.data);
+   return data->present_fence.export_sync_fd();
+}
+
 void swapchain::destroy_image(swapchain_image &image)
 {
+   /* A queued flip may still scan out the framebuffer, and its completion may still release images. */
+   m_display.wait_for_plane(m_plane_index);
+
    std::unique_lock<std::recursive_mutex> image_status_lock(m_image_status_mutex);
+   /* Buffers the presentation engine may still read are not handed to the allocation cache. */
+   const bool buffer_reusable = !is_image_in_use(image.status);
 
    if (image.status != swapchain_image::INVALID)
    {
@@ -646,7 +892,7 @@ void swapchain::destroy_image(swapchain_image &image)
          image.image = VK_NULL_HANDLE;
       }
 
-      image.status = swapchain_image::INVALID;
+      set_image_status(image, swapchain_image::INVALID);
    }
 
    image_status_lock.unlock();
@@ -654,20 +900,20 @@ void swapchain::destroy_image(swapchain_image &image)
    if (image.data != nullptr)
    {
       auto image_data = reinterpret_cast<display_image_data *>(image.data);
-      auto &display = drm_display::get_display();
-      if (!display.has_value())
-      {
-         return;
-      }
       if (image_data->fb_id != std::numeric_limits<uint32_t>::max())
       {
-         int result = drmModeRmFB(display->get_drm_fd(), image_data->fb_id);
-         assert(result == 0);
-         UNUSED(result);
+         m_display.release_framebuffer(image_data->fb_id);
       }
 
+      const int recycle_fd = buffer_reusable ? image_data->external_mem.take_recycle_fd() : -1;
       m_allocator.destroy(1, image_data);
       image.data = nullptr;
+
+      /* The buffer is only handed back once the image memory imported from it is freed. */
+      if (recycle_fd >= 0)
+      {
+         wsialloc_free(m_wsi_allocator, recycle_fd);
+      }
    }
 }
 
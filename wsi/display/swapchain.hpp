@@ -32,10 +32,12 @@
 
 #include <vulkan/vk_icd.h>
 #include <vulkan/vulkan.h>
+#include <utility>
 
 #include "drm_display.hpp"
 #include "surface.hpp"
 #include <util/wsialloc/wsialloc.h>
+#include <wsi/wsialloc_batch.hpp>
 #include <wsi/external_memory.hpp>
 
 namespace wsi
@@ -78,8 +80,11 @@ struct image_creation_parameters
 /**
  * @brief Display swapchain class.
  */
-class swapchain : public wsi::swapchain_base
+class swapchain final : public wsi::swapchain_base
 {
+   /* Calls the present path directly when the layer is built with this backend only, see backend_swapchain.hpp. */
+   friend class wsi::swapchain_base;
+
 public:
    swapchain(layer::device_private_data &dev_data, const VkAllocationCallbacks *pAllocator, surface &wsi_surface);
    virtual ~swapchain();
@@ -102,14 +107,45 @@ public:
     */
    void present_image(const pending_present_request &pending_present) override;
 
+   /**
+    * @brief Wait for the flip queued on the plane, so mailbox presents pick the latest frame once it completed.
+    */
+   void wait_for_present_slot() override;
+
+   /**
+    * @brief Hold presents with a target time until the refresh before their target vblank, predicted from the last
+    *        vblank of the CRTC.
+    */
+   uint64_t get_present_release_time(const pending_present_request &pending_present) override;
+
+   /**
+    * @brief The vblanks of the CRTC, unless variable refresh shows flips as soon as they land.
+    */
+   bool get_vblank_timing(uint64_t *vblank_ns, uint64_t *refresh_ns) override;
+
+   /**
+    * @brief Flips carry the present fence with @ref m_use_in_fence, KMS waits for it rather than the page flip thread.
+    */
+   bool presents_wait_for_payload() const override
+   {
+      return m_use_in_fence;
+   }
+
    virtual VkResult image_set_present_payload(swapchain_image &image, VkQueue queue,
                                               const queue_submit_semaphores &semaphores,
-                                              const void *submission_pnext) override;
+                                              const void *submission_pnext, present_batch *batch) override;
 
    virtual VkResult image_wait_present(swapchain_image &image, uint64_t timeout) override;
 
+   std::optional<util::fd_owner> image_export_present_payload(swapchain_image &image) override;
+
    void destroy_image(swapchain_image &image) override;
 
+   /**
+    * @brief Take over an image of the swapchain being replaced, see swapchain_base::adopt_ancestor_image.
+    */
+   bool adopt_ancestor_image(swapchain_base &ancestor, swapchain_image &ancestor_image) override;
+
 private:
    VkResult allocate_image(display_image_data *image_data);
 
@@ -124,6 +160,51 @@ private:
 
    VkResult create_framebuffer(const VkImageCreateInfo &image_create_info, display_image_data *image_data);
 
+   /**
+    * @brief Build the update of the swapchain's plane showing @p fb_id for @p present.
+    *
+    * The image covers the plane unless VkDisplayPresentInfoKHR gave source or destination rectangles.
+    */
+   drm_plane_update make_plane_update(const drm_display &display, const pending_present_request &present,
+                                      uint32_t fb_id);
+
+   /**
+    * @brief Set the display mode and show @p update on the primary plane, in a single atomic commit when supported.
+    */
+   VkResult set_mode(drm_display &display, const drm_plane_update &update);
+
+   /**
+    * @brief Atomic path of @ref set_mode, validated with a test-only commit first.
+    *
+    * Clears @ref m_use_atomic when the driver rejects the configuration, so the legacy API is used instead.
+    */
+   VkResult atomic_set_mode(const drm_display &display, const drm_plane_update &update);
+
+   /**
+    * @brief Queue a flip to the framebuffer of @p image_data without waiting for it, see @ref complete_page_flip.
+    *
+    * With @ref m_use_in_fence the present fence goes with the flip, and KMS flips once rendering is done. Overlay
+    * updates are validated with a test-only commit whenever their rectangles change.
+    */
+   VkResult queue_page_flip(drm_display &display, display_image_data *image_data,
+                            const pending_present_request &present);
+
+   /**
+    * @brief Process the completion of the flip to the image of @ref m_pending_flip, releasing the image it replaced.
+    *
+    * The vblank time of the flip completes the present timing entry of the present, before present waits see its
+    * present ID.
+    *
+    * @param presented false when the commit of the flip failed, which loses the surface.
+    * @param time      Vblank the image was shown on, nullptr when unknown.
+    */
+   void complete_page_flip(bool presented, const drm_flip_time *time);
+
+   /**
+    * @brief drm_display::page_flip_callback completing the flips of the swapchain @p context.
+    */
+   static void page_flip_done(void *context, bool presented, const drm_flip_time &time);
+
    /**
     * @brief Adds required extensions to the extension list of the swapchain
     *
@@ -134,8 +215,65 @@ private:
    VkResult add_required_extensions(VkDevice device, const VkSwapchainCreateInfoKHR *swapchain_create_info) override;
 
    wsialloc_allocator *m_wsi_allocator;
+
+   /**
+    * @brief Buffers allocated ahead for the images that are not allocated yet.
+    */
+   wsialloc_batch m_wsialloc_batch;
+
+   /**
+    * @brief The display of the surface, the images are shown on its CRTC.
+    */
+   drm_display &m_display;
+
    drm_display_mode *m_display_mode;
    image_creation_parameters m_image_creation_parameters;
+
+   /**
+    * @brief Index of the plane the images are shown on, see drm_display::get_num_planes.
+    */
+   uint32_t m_plane_index;
+
+   /**
+    * @brief Requested position of the plane in the stacking order, the planeStackIndex of the surface.
+    */
+   uint32_t m_plane_stack_index;
+
+   /**
+    * @brief Source and destination rectangles of the last overlay update accepted by a test-only commit.
+    */
+   std::optional<std::pair<VkRect2D, VkRect2D>> m_tested_plane_rects;
+
+   /**
+    * @brief Whether modes and flips are applied with atomic commits rather than the legacy KMS API.
+    */
+   bool m_use_atomic{ false };
+
+   /**
+    * @brief Whether flips carry the present fence as the IN_FENCE_FD of the plane, rather than the page flip thread
+    *        waiting for it with @ref image_wait_present.
+    */
+   std::atomic<bool> m_use_in_fence{ false };
+
+   /**
+    * @brief Whether the modeset enables variable refresh rate, for FIFO_RELAXED swapchains on the primary plane.
+    */
+   bool m_use_vrr{ false };
+
+   /**
+    * @brief Vblank time of the last completed flip, the base of relative target times. Set on the DRM event thread.
+    */
+   std::atomic<uint64_t> m_last_visible_ns{ 0 };
+
+   /**
+    * @brief Present whose image is shown by a queued flip, until the flip completes on the DRM event thread.
+    */
+   std::optional<pending_present_request> m_pending_flip;
+
+   /**
+    * @brief Index of the image on screen.
+    */
+   std::optional<uint32_t> m_displayed_index;
 };
 } /* namespace display */
 
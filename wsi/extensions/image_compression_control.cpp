@@ -29,7 +29,9 @@
  */
 #include <cassert>
 
+#include <util/format_modifiers.hpp>
 #include <util/helpers.hpp>
+#include <util/tuning_profile.hpp>
 #include <wsi/swapchain_base.hpp>
 
 #include "image_compression_control.hpp"
@@ -61,6 +63,60 @@ VkImageCompressionFlagsEXT wsi_ext_image_compression_control::get_bitmask_for_im
    return m_compression_control.flags;
 }
 
+/**
+ * @brief Pick the fixed-rate compression of the images of a swapchain the application chose no compression for.
+ *
+ * The rates are the ones add_device_compression_support reports for the surface formats, for the usage of the
+ * swapchain. The lowest of at least auto_fixed_rate_compression bits per component is picked. On Wayland the images
+ * are only compressed with it when the compositor imports a modifier with fixed-rate compression.
+ *
+ * @return The rate, none when the device supports none of them for the images.
+ */
+static std::optional<VkImageCompressionFixedRateFlagsEXT> select_fixed_rate(
+   const layer::device_private_data &device_data, const VkSwapchainCreateInfoKHR &swapchain_create_info)
+{
+   /* Mutable format images may be viewed in formats the rate was not checked for, and protected ones were not
+    * checked at all. */
+   constexpr VkSwapchainCreateFlagsKHR unchecked_flags =
+      VK_SWAPCHAIN_CREATE_MUTABLE_FORMAT_BIT_KHR | VK_SWAPCHAIN_CREATE_PROTECTED_BIT_KHR;
+   if (swapchain_create_info.flags & unchecked_flags)
+   {
+      return std::nullopt;
+   }
+
+   VkImageCompressionControlEXT compression_control{ VK_STRUCTURE_TYPE_IMAGE_COMPRESSION_CONTROL_EXT, nullptr,
+                                                     VK_IMAGE_COMPRESSION_FIXED_RATE_DEFAULT_EXT, 0, nullptr };
+   VkPhysicalDeviceImageFormatInfo2KHR image_format_info{};
+   image_format_info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2_KHR;
+   image_format_info.pNext = &compression_control;
+   image_format_info.format = swapchain_create_info.imageFormat;
+   image_format_info.type = VK_IMAGE_TYPE_2D;
+   image_format_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+   image_format_info.usage = swapchain_create_info.imageUsage;
+
+   VkImageCompressionPropertiesEXT compression_props = { VK_STRUCTURE_TYPE_IMAGE_COMPRESSION_PROPERTIES_EXT, nullptr, 0,
+                                                         0 };
+   VkImageFormatProperties2KHR image_format_props{ VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2_KHR,
+                                                   &compression_props,
+                                                   {} };
+   if (util::get_image_format_properties(device_data.physical_device, image_format_info, image_format_props) !=
+          VK_SUCCESS ||
+       (compression_props.imageCompressionFlags & VK_IMAGE_COMPRESSION_FIXED_RATE_EXPLICIT_EXT) == 0)
+   {
+      return std::nullopt;
+   }
+
+   /* Bit i is the rate of i + 1 bits per component. */
+   const uint32_t min_bpc = util::tuning_profile::get().auto_fixed_rate_compression;
+   const VkImageCompressionFixedRateFlagsEXT rates =
+      compression_props.imageCompressionFixedRateFlags & ~((1u << (min_bpc - 1)) - 1);
+   if (rates == 0)
+   {
+      return std::nullopt;
+   }
+   return rates & (~rates + 1);
+}
+
 std::optional<wsi_ext_image_compression_control> wsi_ext_image_compression_control::create(
    VkDevice device, const VkSwapchainCreateInfoKHR *swapchain_create_info)
 {
@@ -73,6 +129,19 @@ std::optional<wsi_ext_image_compression_control> wsi_ext_image_compression_contr
       return wsi_ext_image_compression_control{ *image_compression_control };
    }
 
+   if (image_compression_control == nullptr && device_data.is_auto_fixed_rate_compression_enabled())
+   {
+      std::optional<VkImageCompressionFixedRateFlagsEXT> fixed_rate =
+         select_fixed_rate(device_data, *swapchain_create_info);
+      if (fixed_rate.has_value())
+      {
+         const VkImageCompressionControlEXT compression_control{ VK_STRUCTURE_TYPE_IMAGE_COMPRESSION_CONTROL_EXT,
+                                                                 nullptr, VK_IMAGE_COMPRESSION_FIXED_RATE_EXPLICIT_EXT,
+                                                                 1, &fixed_rate.value() };
+         return wsi_ext_image_compression_control{ compression_control };
+      }
+   }
+
    return std::nullopt;
 }
 
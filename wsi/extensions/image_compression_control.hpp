@@ -89,8 +89,8 @@ public:
     *
     * @param device The Vulkan device
     * @param swapchain_create_info Swapchain create info
-    * @return Valid wsi_ext_image_compression_control if requested by application,
-    * otherwise - an empty optional.
+    * @return Valid wsi_ext_image_compression_control if requested by application, or picked by the layer with
+    * auto_fixed_rate_compression when the application requested none, otherwise - an empty optional.
     */
    static std::optional<wsi_ext_image_compression_control> create(
       VkDevice device, const VkSwapchainCreateInfoKHR *swapchain_create_info);
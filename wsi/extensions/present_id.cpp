@@ -29,16 +29,74 @@
  */
 #include "present_id.hpp"
 
+#include <algorithm>
+#include <cstdint>
+
 namespace wsi
 {
 
 void wsi_ext_present_id::set_present_id(uint64_t value)
 {
-   if (value != 0)
+   std::lock_guard<std::mutex> lock(m_mutex);
+   /* A present that failed can be completed before the earlier ones the presentation engine still shows. */
+   if (value > m_present_id)
    {
-      assert(value > m_present_id);
       m_present_id = value;
+      m_update_count++;
+      m_cond.notify_all();
+   }
+}
+
+void wsi_ext_present_id::set_error_state(VkResult error)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   m_error_state = error;
+   m_update_count++;
+   m_cond.notify_all();
+}
+
+void wsi_ext_present_id::notify()
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   m_update_count++;
+   m_cond.notify_all();
+}
+
+VkResult wsi_ext_present_id::get_wait_result(uint64_t present_id) const
+{
+   if (m_present_id >= present_id)
+   {
+      return VK_SUCCESS;
+   }
+   return (m_error_state != VK_SUCCESS) ? m_error_state : VK_NOT_READY;
+}
+
+VkResult wsi_ext_present_id::wait_for_present_id(uint64_t present_id, uint64_t timeout)
+{
+   std::unique_lock<std::mutex> lock(m_mutex);
+   auto completed = [this, present_id]() { return get_wait_result(present_id) != VK_NOT_READY; };
+   if (timeout == UINT64_MAX)
+   {
+      m_cond.wait(lock, completed);
+   }
+   /* Keep far off timeouts from overflowing the steady clock. */
+   else if (!m_cond.wait_for(lock, std::chrono::nanoseconds(std::min<uint64_t>(timeout, INT64_MAX / 2)), completed))
+   {
+      return VK_TIMEOUT;
+   }
+   return get_wait_result(present_id);
+}
+
+VkResult wsi_ext_present_id::wait_for_update(uint64_t present_id, std::chrono::steady_clock::time_point deadline)
+{
+   std::unique_lock<std::mutex> lock(m_mutex);
+   const uint64_t update_count = m_update_count;
+   auto updated = [&]() { return m_update_count != update_count || get_wait_result(present_id) != VK_NOT_READY; };
+   if (!m_cond.wait_until(lock, deadline, updated))
+   {
+      return VK_TIMEOUT;
    }
+   return get_wait_result(present_id);
 }
 
-};
+} /* namespace wsi */
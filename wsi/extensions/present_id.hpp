@@ -30,6 +30,12 @@
 
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include <vulkan/vulkan.h>
+
 #include <util/custom_allocator.hpp>
 #include <util/macros.hpp>
 
@@ -42,7 +48,8 @@ namespace wsi
  * @brief Present ID extension class
  *
  * This class defines the present ID extension
- * features.
+ * features. It also implements VK_KHR_present_wait, as the present IDs are what
+ * vkWaitForPresentKHR waits for.
  */
 class wsi_ext_present_id : public wsi_ext
 {
@@ -55,15 +62,67 @@ public:
    /**
     * @brief Set the present ID for the swapchain.
     *
+    * Called by the backends once the present is on screen, which wakes up the threads waiting for it.
+    *
     * @param value Value to set for the present_id.
     */
    void set_present_id(uint64_t value);
 
+   /**
+    * @brief Wake up the threads waiting for presents that will now never complete.
+    *
+    * @param error The error state of the swapchain, returned to the waiters.
+    */
+   void set_error_state(VkResult error);
+
+   /**
+    * @brief Wait until the present with @p present_id, or a later one, is on screen.
+    *
+    * @param present_id The present ID to wait for.
+    * @param timeout    Timeout in nanoseconds.
+    *
+    * @return VK_SUCCESS once the present completed, VK_TIMEOUT or the error state of the swapchain otherwise.
+    */
+   VkResult wait_for_present_id(uint64_t present_id, uint64_t timeout);
+
+   /**
+    * @brief Wait until the present ID or the error state changes, or @ref notify is called.
+    *
+    * For backends that complete presents from events the waiting threads dispatch themselves: the threads that
+    * cannot dispatch sleep here until the dispatching one made progress.
+    *
+    * @param present_id The present ID to wait for.
+    * @param deadline   Time to give up at.
+    *
+    * @return The same as @ref wait_for_present_id, VK_NOT_READY when woken up before completion.
+    */
+   VkResult wait_for_update(uint64_t present_id, std::chrono::steady_clock::time_point deadline);
+
+   /**
+    * @brief Wake up the threads in @ref wait_for_update.
+    */
+   void notify();
+
 private:
+   /**
+    * @brief Get the result for a waiter of @p present_id, VK_NOT_READY if it has to keep waiting.
+    */
+   VkResult get_wait_result(uint64_t present_id) const;
+
+   std::mutex m_mutex;
+   std::condition_variable m_cond;
+
    /**
     * @brief Current present ID for this swapchain.
     */
    uint64_t m_present_id{ 0 };
+
+   /**
+    * @brief Number of times the waiters have been woken up, see @ref wait_for_update.
+    */
+   uint64_t m_update_count{ 0 };
+
+   VkResult m_error_state{ VK_SUCCESS };
 };
 
 } /* namespace wsi */
@@ -27,7 +27,9 @@
  *
  * @brief Contains the implentation for the VK_EXT_present_timing extension.
  */
+#include <algorithm>
 #include <cassert>
+#include <ctime>
 #include <wsi/swapchain_base.hpp>
 
 #include "present_timing.hpp"
@@ -49,52 +51,191 @@ wsi_ext_present_timing::~wsi_ext_present_timing()
 
 VkResult wsi_ext_present_timing::present_timing_queue_set_size(size_t queue_size)
 {
-   if (present_timing_get_num_outstanding_results() > queue_size)
+   std::lock_guard<std::mutex> lock(m_queue_mutex);
+   if (m_queue.size() > queue_size)
    {
       return VK_NOT_READY;
    }
-
-   util::vector<swapchain_presentation_entry> presentation_timing(
-      util::allocator(m_allocator, VK_SYSTEM_ALLOCATION_SCOPE_DEVICE));
-   if (!presentation_timing.try_reserve(queue_size))
+   if (!m_queue.try_set_capacity(queue_size))
    {
       return VK_ERROR_OUT_OF_HOST_MEMORY;
    }
-   for (auto iter : m_queue.m_timings)
+   return VK_SUCCESS;
+}
+
+size_t wsi_ext_present_timing::present_timing_get_num_outstanding_results()
+{
+   std::lock_guard<std::mutex> lock(m_queue_mutex);
+   return m_queue.size();
+}
+
+VkResult wsi_ext_present_timing::add_presentation_entry(const wsi::swapchain_presentation_entry &presentation_entry)
+{
+   std::lock_guard<std::mutex> lock(m_queue_mutex);
+   if (!m_queue.push(presentation_entry))
    {
-      if (iter.is_outstanding)
+      return VK_ERROR_PRESENT_TIMING_QUEUE_FULL_EXT;
+   }
+   return VK_SUCCESS;
+}
+
+void wsi_ext_present_timing::set_stage_time(uint64_t present_id, VkPresentStageFlagBitsEXT stage, uint64_t time)
+{
+   std::lock_guard<std::mutex> lock(m_queue_mutex);
+   m_queue.update(present_id, [stage, time](swapchain_presentation_entry &entry) {
+      if ((entry.requested_stages & stage) != 0)
       {
-         if (!presentation_timing.try_push_back(iter))
+         entry.completed_stages |= stage;
+         entry.stage_times[__builtin_ctz(stage)] = time;
+      }
+   });
+}
+
+void wsi_ext_present_timing::complete_presentation_entry(uint64_t present_id)
+{
+   std::lock_guard<std::mutex> lock(m_queue_mutex);
+   m_queue.update(present_id, [](swapchain_presentation_entry &entry) { entry.backend_done = true; });
+}
+
+VkResult wsi_ext_present_timing::get_past_presentation_timing(const layer::device_private_data &device_data,
+                                                              VkPastPresentationTimingPropertiesEXT &properties)
+{
+   VkSwapchainTimingPropertiesEXT timing_properties = {};
+   TRY(get_swapchain_timing_properties(properties.timingPropertiesCounter, timing_properties));
+   TRY(m_time_domains.get_swapchain_time_domain_properties(nullptr, &properties.timeDomainsCounter));
+
+   std::lock_guard<std::mutex> lock(m_queue_mutex);
+   const auto complete_count = static_cast<uint32_t>(m_queue.complete_count());
+   if (properties.pPresentationTimings == nullptr)
+   {
+      properties.presentationTimingCount = complete_count;
+      return VK_SUCCESS;
+   }
+
+   uint32_t written = 0;
+   m_queue.pop_complete(properties.presentationTimingCount, [&](const swapchain_presentation_entry &entry) {
+      VkPastPresentationTimingEXT &timing = properties.pPresentationTimings[written++];
+      timing.presentId = entry.present_id;
+      uint64_t time_domain_id = entry.time_domain_id;
+      if (!converts_to(device_data, entry, m_time_domains.get_time_domain(time_domain_id)))
+      {
+         for (uint64_t id = 0; id < m_time_domains.get_time_domain_count(); id++)
          {
-            return VK_ERROR_OUT_OF_HOST_MEMORY;
+            if (converts_to(device_data, entry, m_time_domains.get_time_domain(id)))
+            {
+               time_domain_id = id;
+               break;
+            }
          }
       }
-   }
-   m_queue.m_timings.swap(presentation_timing);
-   return VK_SUCCESS;
+      timing.timeDomain = m_time_domains.get_time_domain(time_domain_id);
+      timing.timeDomainId = time_domain_id;
+      timing.reportComplete = VK_TRUE;
+
+      uint32_t stage_count = 0;
+      for (uint32_t i = 0; i < swapchain_presentation_entry::STAGE_COUNT; i++)
+      {
+         const VkPresentStageFlagsEXT stage = 1u << i;
+         if ((entry.completed_stages & stage) == 0)
+         {
+            continue;
+         }
+
+         /* Every stage is timed in its own domain, see swapchain_time_domains. */
+         swapchain_calibrated_time stage_domain = {};
+         uint64_t time = 0;
+         if (m_time_domains.calibrate(static_cast<VkPresentStageFlagBitsEXT>(stage), &stage_domain) != VK_SUCCESS ||
+             !m_calibrator.convert(device_data, stage_domain.time_domain, timing.timeDomain, entry.stage_times[i],
+                                   &time))
+         {
+            continue;
+         }
+         if (timing.pPresentStages != nullptr && stage_count < timing.presentStageCount)
+         {
+            timing.pPresentStages[stage_count] = { stage, time };
+         }
+         stage_count++;
+      }
+      timing.presentStageCount =
+         timing.pPresentStages == nullptr ? stage_count : std::min(stage_count, timing.presentStageCount);
+   });
+   properties.presentationTimingCount = written;
+
+   return written < complete_count ? VK_INCOMPLETE : VK_SUCCESS;
 }
 
-size_t wsi_ext_present_timing::present_timing_get_num_outstanding_results()
+bool wsi_ext_present_timing::converts_to(const layer::device_private_data &device_data,
+                                         const swapchain_presentation_entry &entry, VkTimeDomainKHR time_domain)
 {
-   size_t num_outstanding = 0;
-
-   for (const auto &iter : m_queue.m_timings)
+   for (uint32_t i = 0; i < swapchain_presentation_entry::STAGE_COUNT; i++)
    {
-      if (iter.is_outstanding)
+      const VkPresentStageFlagsEXT stage = 1u << i;
+      if ((entry.completed_stages & stage) == 0)
       {
-         num_outstanding++;
+         continue;
+      }
+
+      swapchain_calibrated_time stage_domain = {};
+      uint64_t time = 0;
+      if (m_time_domains.calibrate(static_cast<VkPresentStageFlagBitsEXT>(stage), &stage_domain) != VK_SUCCESS ||
+          !m_calibrator.convert(device_data, stage_domain.time_domain, time_domain, entry.stage_times[i], &time))
+      {
+         return false;
       }
    }
-   return num_outstanding;
+   return true;
 }
 
-VkResult wsi_ext_present_timing::add_presentation_entry(const wsi::swapchain_presentation_entry &presentation_entry)
+bool timings_queue::try_set_capacity(size_t capacity)
 {
-   if (!m_queue.m_timings.try_push_back(presentation_entry))
+   if (capacity < m_count)
    {
-      return VK_ERROR_OUT_OF_HOST_MEMORY;
+      return false;
    }
-   return VK_SUCCESS;
+
+   util::vector<swapchain_presentation_entry> slots(m_slots.get_allocator());
+   if (!slots.try_resize(capacity))
+   {
+      return false;
+   }
+   for (size_t i = 0; i < m_count; i++)
+   {
+      slots[i] = at(i);
+   }
+   m_slots.swap(slots);
+   m_head = 0;
+   return true;
+}
+
+bool timings_queue::push(const swapchain_presentation_entry &entry)
+{
+   if (m_count == m_slots.size())
+   {
+      return false;
+   }
+   m_count++;
+   at(m_count - 1) = entry;
+   m_complete_count += entry.is_complete() ? 1 : 0;
+   return true;
+}
+
+swapchain_presentation_entry *timings_queue::find(uint64_t present_id)
+{
+   size_t first = 0;
+   size_t last = m_count;
+   while (first < last)
+   {
+      const size_t middle = first + (last - first) / 2;
+      if (at(middle).present_id < present_id)
+      {
+         first = middle + 1;
+      }
+      else
+      {
+         last = middle;
+      }
+   }
+   return (first < m_count && at(first).present_id == present_id) ? &at(first) : nullptr;
 }
 
 swapchain_time_domains &wsi_ext_present_timing::get_swapchain_time_domains()
@@ -117,9 +258,40 @@ VkResult swapchain_time_domains::calibrate(VkPresentStageFlagBitsEXT present_sta
    return VK_ERROR_OUT_OF_HOST_MEMORY;
 }
 
+bool swapchain_time_domains::is_first_of_its_kind(size_t index)
+{
+   const VkTimeDomainKHR domain = m_time_domains[index]->get_time_domain();
+   return std::none_of(m_time_domains.begin(), m_time_domains.begin() + index,
+                       [domain](auto &other) { return other->get_time_domain() == domain; });
+}
+
+VkTimeDomainKHR swapchain_time_domains::get_time_domain(uint64_t time_domain_id)
+{
+   uint64_t id = 0;
+   for (size_t i = 0; i < m_time_domains.size(); i++)
+   {
+      if (is_first_of_its_kind(i) && id++ == time_domain_id)
+      {
+         return m_time_domains[i]->get_time_domain();
+      }
+   }
+   return VK_TIME_DOMAIN_PRESENT_STAGE_LOCAL_EXT;
+}
+
+uint64_t swapchain_time_domains::get_time_domain_count()
+{
+   uint64_t count = 0;
+   for (size_t i = 0; i < m_time_domains.size(); i++)
+   {
+      count += is_first_of_its_kind(i) ? 1 : 0;
+   }
+   return count;
+}
+
 VkResult swapchain_time_domains::get_swapchain_time_domain_properties(
    VkSwapchainTimeDomainPropertiesEXT *pSwapchainTimeDomainProperties, uint64_t *pTimeDomainsCounter)
 {
+   /* The domains are set when the swapchain is created and never change. */
    if (pTimeDomainsCounter != nullptr)
    {
       *pTimeDomainsCounter = 1;
@@ -127,25 +299,178 @@ VkResult swapchain_time_domains::get_swapchain_time_domain_properties(
 
    if (pSwapchainTimeDomainProperties != nullptr)
    {
-      if ((pSwapchainTimeDomainProperties->pTimeDomains == nullptr &&
-           pSwapchainTimeDomainProperties->pTimeDomainIds == nullptr) ||
-          pSwapchainTimeDomainProperties->timeDomainCount == 0)
+      const bool query_count = (pSwapchainTimeDomainProperties->pTimeDomains == nullptr &&
+                                pSwapchainTimeDomainProperties->pTimeDomainIds == nullptr);
+      uint32_t count = 0;
+      for (size_t i = 0; i < m_time_domains.size(); i++)
       {
-         pSwapchainTimeDomainProperties->timeDomainCount = 1;
+         if (!is_first_of_its_kind(i))
+         {
+            continue;
+         }
+         if (!query_count && count < pSwapchainTimeDomainProperties->timeDomainCount)
+         {
+            if (pSwapchainTimeDomainProperties->pTimeDomains != nullptr)
+            {
+               pSwapchainTimeDomainProperties->pTimeDomains[count] = m_time_domains[i]->get_time_domain();
+            }
+            if (pSwapchainTimeDomainProperties->pTimeDomainIds != nullptr)
+            {
+               pSwapchainTimeDomainProperties->pTimeDomainIds[count] = count;
+            }
+         }
+         count++;
       }
-      else
+
+      if (!query_count && count > pSwapchainTimeDomainProperties->timeDomainCount)
       {
-         /* Since we only have a single time domain available we don't need to check
-          * timeDomainCount since it can only be >= 1 */
-         pSwapchainTimeDomainProperties->timeDomainCount = 1;
-         pSwapchainTimeDomainProperties->pTimeDomains[0] = VK_TIME_DOMAIN_PRESENT_STAGE_LOCAL_EXT;
-         pSwapchainTimeDomainProperties->pTimeDomainIds[0] = 0;
+         return VK_INCOMPLETE;
       }
+      pSwapchainTimeDomainProperties->timeDomainCount = count;
    }
 
    return VK_SUCCESS;
 }
 
+static uint64_t get_clock_ns(clockid_t clock)
+{
+   timespec ts;
+   clock_gettime(clock, &ts);
+   return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+bool time_domain_calibrator::sample(const layer::device_private_data &device_data, VkTimeDomainKHR domain,
+                                    uint64_t *domain_ns, uint64_t *monotonic_ns)
+{
+   PFN_vkGetCalibratedTimestampsKHR get_calibrated_timestamps = device_data.disp.get_GetCalibratedTimestampsKHR();
+   if (get_calibrated_timestamps == nullptr)
+   {
+      get_calibrated_timestamps = device_data.disp.get_GetCalibratedTimestampsEXT();
+   }
+
+   if (get_calibrated_timestamps != nullptr)
+   {
+      std::array<VkCalibratedTimestampInfoKHR, 2> infos = {};
+      infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_KHR;
+      infos[0].timeDomain = domain;
+      infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_KHR;
+      infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_KHR;
+      std::array<uint64_t, 2> timestamps = {};
+      uint64_t max_deviation = 0;
+      if (get_calibrated_timestamps(device_data.device, static_cast<uint32_t>(infos.size()), infos.data(),
+                                    timestamps.data(), &max_deviation) == VK_SUCCESS)
+      {
+         *domain_ns = domain == VK_TIME_DOMAIN_DEVICE_KHR ?
+                         static_cast<uint64_t>(static_cast<double>(timestamps[0]) * m_timestamp_period) :
+                         timestamps[0];
+         *monotonic_ns = timestamps[1];
+         return true;
+      }
+   }
+
+   /* Host clocks can be calibrated without the driver, from readings either side of the domain. */
+   if (domain == VK_TIME_DOMAIN_CLOCK_MONOTONIC_RAW_KHR)
+   {
+      const uint64_t before_ns = get_clock_ns(CLOCK_MONOTONIC);
+      *domain_ns = get_clock_ns(CLOCK_MONOTONIC_RAW);
+      const uint64_t after_ns = get_clock_ns(CLOCK_MONOTONIC);
+      *monotonic_ns = before_ns + (after_ns - before_ns) / 2;
+      return true;
+   }
+   return false;
+}
+
+bool time_domain_calibrator::get_offset(const layer::device_private_data &device_data, VkTimeDomainKHR domain,
+                                        uint64_t now_ns, int64_t *offset_ns)
+{
+   if (domain == VK_TIME_DOMAIN_CLOCK_MONOTONIC_KHR)
+   {
+      *offset_ns = 0;
+      return true;
+   }
+
+   calibration *cal = nullptr;
+   if (domain == VK_TIME_DOMAIN_DEVICE_KHR)
+   {
+      /* A period of 0 means the device has no timestamps. */
+      if (m_timestamp_period == 0.0)
+      {
+         return false;
+      }
+      cal = &m_device;
+   }
+   else if (domain == VK_TIME_DOMAIN_CLOCK_MONOTONIC_RAW_KHR)
+   {
+      cal = &m_monotonic_raw;
+   }
+   else
+   {
+      return false;
+   }
+
+   if (cal->sample_ns == 0 || now_ns - cal->sample_ns >= CALIBRATION_PERIOD_NS)
+   {
+      uint64_t domain_ns = 0;
+      uint64_t monotonic_ns = 0;
+      if (!sample(device_data, domain, &domain_ns, &monotonic_ns))
+      {
+         /* Keep extrapolating from an earlier calibration rather than failing. */
+         if (cal->sample_ns == 0)
+         {
+            return false;
+         }
+      }
+      else
+      {
+         const int64_t offset = static_cast<int64_t>(monotonic_ns - domain_ns);
+         if (cal->sample_ns != 0 && monotonic_ns > cal->sample_ns)
+         {
+            cal->drift =
+               static_cast<double>(offset - cal->offset_ns) / static_cast<double>(monotonic_ns - cal->sample_ns);
+         }
+         cal->sample_ns = monotonic_ns;
+         cal->offset_ns = offset;
+      }
+   }
+
+   const double elapsed_ns = static_cast<double>(static_cast<int64_t>(now_ns - cal->sample_ns));
+   *offset_ns = cal->offset_ns + static_cast<int64_t>(cal->drift * elapsed_ns);
+   return true;
+}
+
+bool time_domain_calibrator::convert(const layer::device_private_data &device_data, VkTimeDomainKHR from,
+                                     VkTimeDomainKHR to, uint64_t time, uint64_t *converted)
+{
+   if (from == to)
+   {
+      *converted = time;
+      return true;
+   }
+
+   if ((from == VK_TIME_DOMAIN_DEVICE_KHR || to == VK_TIME_DOMAIN_DEVICE_KHR) && m_timestamp_period == 0.0)
+   {
+      VkPhysicalDeviceProperties properties;
+      device_data.instance_data.disp.GetPhysicalDeviceProperties(device_data.physical_device, &properties);
+      m_timestamp_period = static_cast<double>(properties.limits.timestampPeriod);
+   }
+
+   const uint64_t now_ns = get_clock_ns(CLOCK_MONOTONIC);
+   int64_t from_offset_ns = 0;
+   int64_t to_offset_ns = 0;
+   if (!get_offset(device_data, from, now_ns, &from_offset_ns) || !get_offset(device_data, to, now_ns, &to_offset_ns))
+   {
+      return false;
+   }
+
+   const uint64_t from_ns =
+      from == VK_TIME_DOMAIN_DEVICE_KHR ? static_cast<uint64_t>(static_cast<double>(time) * m_timestamp_period) : time;
+   const uint64_t to_ns = from_ns + static_cast<uint64_t>(from_offset_ns - to_offset_ns);
+   *converted = (to == VK_TIME_DOMAIN_DEVICE_KHR && m_timestamp_period != 0.0) ?
+                   static_cast<uint64_t>(static_cast<double>(to_ns) / m_timestamp_period) :
+                   to_ns;
+   return true;
+}
+
 bool swapchain_time_domains::add_time_domain(util::unique_ptr<swapchain_time_domain> time_domain)
 {
    if (time_domain)
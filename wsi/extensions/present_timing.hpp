@@ -35,12 +35,19 @@
 #include <util/custom_allocator.hpp>
 #include <util/macros.hpp>
 
+#include <array>
 #include <iterator>
+#include <mutex>
 #include <type_traits>
 
 #include "wsi_extension.hpp"
 
 #if VULKAN_WSI_LAYER_EXPERIMENTAL
+namespace layer
+{
+class device_private_data;
+} /* namespace layer */
+
 namespace wsi
 {
 
@@ -53,29 +60,205 @@ namespace wsi
 struct swapchain_presentation_entry
 {
    /**
-    * Whether this entry is an outstanding result or not.
+    * Number of present stages, VkPresentStageFlagBitsEXT bit i is stored at index i of stage_times.
     */
-   bool is_outstanding{ false };
+   static constexpr uint32_t STAGE_COUNT = 4;
+
    /**
     * The present id.
     */
    uint64_t present_id{ 0 };
+   /**
+    * VkPresentTimingInfoEXT::timeDomainId, the domain the stage times are reported in.
+    */
+   uint64_t time_domain_id{ 0 };
+   /**
+    * Stages the application asked the time of, VkPresentTimingInfoEXT::presentStageQueries.
+    */
+   VkPresentStageFlagsEXT requested_stages{ 0 };
+   /**
+    * Requested stages whose time is known.
+    */
+   VkPresentStageFlagsEXT completed_stages{ 0 };
+   /**
+    * Set once the backend has no more stage times to report, even if some requested stages are missing, for
+    * instance because the present was discarded.
+    */
+   bool backend_done{ false };
+   /**
+    * Time of each completed stage, in the time domain of the stage.
+    */
+   std::array<uint64_t, STAGE_COUNT> stage_times{};
+
+   bool is_complete() const
+   {
+      return backend_done || (requested_stages & ~completed_stages) == 0;
+   }
 };
 
 /**
  * @brief Timings queue
  *
- * This structure is used to keep the parameters related to the presentation timing queue.
- *
+ * Fixed capacity ring of the outstanding presentation entries, oldest first. Its storage is only allocated when the
+ * application sets the queue size, queueing, completing and reporting entries never allocate.
  */
-struct timings_queue
+class timings_queue
 {
+public:
    timings_queue(const util::allocator &allocator)
-      : m_timings(allocator)
+      : m_slots(allocator)
+   {
+   }
+
+   /**
+    * @brief Change the capacity of the queue, keeping the queued entries.
+    *
+    * @return false when @p capacity is smaller than @ref size or the storage cannot be allocated, the queue is left
+    *         unchanged.
+    */
+   bool try_set_capacity(size_t capacity);
+
+   /**
+    * @brief Number of outstanding entries.
+    */
+   size_t size() const
+   {
+      return m_count;
+   }
+
+   /**
+    * @brief Number of outstanding entries that are complete, see @ref swapchain_presentation_entry::is_complete.
+    */
+   size_t complete_count() const
    {
+      return m_complete_count;
    }
 
-   util::vector<swapchain_presentation_entry> m_timings;
+   /**
+    * @brief Queue @p entry behind the others.
+    *
+    * @return false when the queue is full.
+    */
+   bool push(const swapchain_presentation_entry &entry);
+
+   /**
+    * @brief Update the entry of @p present_id with @p update, keeping the count of complete entries in step.
+    *
+    * Present IDs increase from one present to the next, the entry is found with a binary search of the ring.
+    * Nothing is done for a present ID without a queued entry.
+    */
+   template <typename update_fn>
+   void update(uint64_t present_id, update_fn update)
+   {
+      swapchain_presentation_entry *entry = find(present_id);
+      if (entry != nullptr)
+      {
+         const bool was_complete = entry->is_complete();
+         update(*entry);
+         m_complete_count += (entry->is_complete() && !was_complete) ? 1 : 0;
+      }
+   }
+
+   /**
+    * @brief Remove up to @p max_count complete entries, oldest first, passing each of them to @p report.
+    *
+    * Entries that are not complete keep their place in the queue.
+    *
+    * @return The number of entries reported.
+    */
+   template <typename report_fn>
+   size_t pop_complete(size_t max_count, report_fn report)
+   {
+      size_t reported = 0;
+      size_t kept = 0;
+      for (size_t i = 0; i < m_count; i++)
+      {
+         swapchain_presentation_entry &entry = at(i);
+         if (reported < max_count && entry.is_complete())
+         {
+            report(entry);
+            reported++;
+            continue;
+         }
+         if (kept != i)
+         {
+            at(kept) = entry;
+         }
+         kept++;
+      }
+      m_count = kept;
+      m_complete_count -= reported;
+      return reported;
+   }
+
+private:
+   swapchain_presentation_entry &at(size_t index)
+   {
+      return m_slots[(m_head + index) % m_slots.size()];
+   }
+
+   swapchain_presentation_entry *find(uint64_t present_id);
+
+   util::vector<swapchain_presentation_entry> m_slots;
+   /* Slot of the oldest entry. */
+   size_t m_head{ 0 };
+   size_t m_count{ 0 };
+   size_t m_complete_count{ 0 };
+};
+
+/**
+ * @brief Converts present stage times between the Vulkan time domains of a device.
+ *
+ * Each domain is related to CLOCK_MONOTONIC by an offset sampled with vkGetCalibratedTimestampsKHR. A sample is reused
+ * for @ref CALIBRATION_PERIOD_NS, with the drift measured between the last two samples extrapolated in between, so
+ * converting a time rarely calls down the chain.
+ */
+class time_domain_calibrator
+{
+public:
+   /**
+    * @brief Time a calibration is reused for, in nanoseconds.
+    */
+   static constexpr uint64_t CALIBRATION_PERIOD_NS = 1000000000;
+
+   /**
+    * @brief Convert @p time from the @p from domain to the @p to domain.
+    *
+    * Device times are in ticks of VkPhysicalDeviceLimits::timestampPeriod, host times in nanoseconds.
+    *
+    * @return false when either domain cannot be calibrated, as the present stage and swapchain local domains.
+    */
+   bool convert(const layer::device_private_data &device_data, VkTimeDomainKHR from, VkTimeDomainKHR to,
+                uint64_t time, uint64_t *converted);
+
+private:
+   struct calibration
+   {
+      /* CLOCK_MONOTONIC time of the last sample, 0 before the first one. */
+      uint64_t sample_ns{ 0 };
+      /* CLOCK_MONOTONIC minus the time of the domain in nanoseconds, at sample_ns. */
+      int64_t offset_ns{ 0 };
+      /* Change of offset_ns per nanosecond, measured between the last two samples. */
+      double drift{ 0.0 };
+   };
+
+   /**
+    * @brief Offset from @p domain to CLOCK_MONOTONIC at @p now_ns, sampled again when the cached one is stale.
+    */
+   bool get_offset(const layer::device_private_data &device_data, VkTimeDomainKHR domain, uint64_t now_ns,
+                   int64_t *offset_ns);
+
+   /**
+    * @brief Read @p domain, in nanoseconds, and CLOCK_MONOTONIC at the same time.
+    */
+   bool sample(const layer::device_private_data &device_data, VkTimeDomainKHR domain, uint64_t *domain_ns,
+               uint64_t *monotonic_ns);
+
+   calibration m_device;
+   calibration m_monotonic_raw;
+
+   /* Nanoseconds per device tick, 0 until the device limits are queried. */
+   double m_timestamp_period{ 0.0 };
 };
 
 // Predefined struct for calibrated time
@@ -101,6 +284,14 @@ public:
       return m_present_stages;
    }
 
+   /**
+    * @brief Domain the times of the stages are recorded in.
+    */
+   VkTimeDomainKHR get_time_domain()
+   {
+      return calibrate().time_domain;
+   }
+
 private:
    VkPresentStageFlagsEXT m_present_stages;
 };
@@ -147,9 +338,23 @@ public:
 
    VkResult calibrate(VkPresentStageFlagBitsEXT presentStages, swapchain_calibrated_time *calibrated_time);
 
+   /**
+    * @brief Time domain of the ID reported by @ref get_swapchain_time_domain_properties.
+    *
+    * @return VK_TIME_DOMAIN_PRESENT_STAGE_LOCAL_EXT for an unknown ID.
+    */
+   VkTimeDomainKHR get_time_domain(uint64_t time_domain_id);
+
+   /**
+    * @brief Number of IDs reported by @ref get_swapchain_time_domain_properties.
+    */
+   uint64_t get_time_domain_count();
+
    /**
     * @brief Get swapchain time domain properties.
     *
+    * Every distinct domain the stages are timed in is reported, its ID is its position in the list.
+    *
     * @param pSwapchainTimeDomainProperties time domain struct to be set
     * @param pTimeDomainsCounter size of the pSwapchainTimeDomainProperties
     *
@@ -159,6 +364,11 @@ public:
                                                  uint64_t *pTimeDomainsCounter);
 
 private:
+   /**
+    * @brief Whether the domain at @p index is the first one with its VkTimeDomainKHR, the ones reported.
+    */
+   bool is_first_of_its_kind(size_t index);
+
    util::vector<util::unique_ptr<swapchain_time_domain>> m_time_domains;
 };
 
@@ -238,6 +448,33 @@ public:
     */
    VkResult add_presentation_entry(const wsi::swapchain_presentation_entry &sc_presentation_entry);
 
+   /**
+    * @brief Record the time the present with @p present_id reached @p stage.
+    *
+    * Times of stages the application did not ask for, and of presents without a queued entry, are dropped.
+    *
+    * @param time Time in the domain of @p stage, see @ref get_swapchain_time_domains.
+    */
+   void set_stage_time(uint64_t present_id, VkPresentStageFlagBitsEXT stage, uint64_t time);
+
+   /**
+    * @brief Report the entry of @p present_id with the stage times it has, no more will be recorded for it.
+    */
+   void complete_presentation_entry(uint64_t present_id);
+
+   /**
+    * @brief Implementation of vkGetPastPresentationTimingEXT.
+    *
+    * Complete entries are returned oldest first and leave the queue. Their stage times are converted to the domain
+    * the present asked for. When some stage cannot be converted to it, the first swapchain domain all the stages
+    * convert to is used instead, and the entry reports the domain its times are in. Stages that convert to no common
+    * domain are left out.
+    *
+    * @return VK_INCOMPLETE when more complete entries are queued than @p properties has room for.
+    */
+   VkResult get_past_presentation_timing(const layer::device_private_data &device_data,
+                                         VkPastPresentationTimingPropertiesEXT &properties);
+
    /**
     * @brief Get the swapchain time domains
     */
@@ -262,7 +499,19 @@ protected:
 
 private:
    /**
-    * @brief The presentation timing queue.
+    * @brief Whether every completed stage of @p entry converts to @p time_domain. Called with @ref m_queue_mutex held.
+    */
+   bool converts_to(const layer::device_private_data &device_data, const swapchain_presentation_entry &entry,
+                    VkTimeDomainKHR time_domain);
+
+   /**
+    * @brief Guards @ref m_queue, entries are added on present and completed on the threads the
+    *        backends learn about the presents on.
+    */
+   std::mutex m_queue_mutex;
+
+   /**
+    * @brief The presentation timing queue, whose capacity is set with vkSetSwapchainPresentTimingQueueSizeEXT.
     */
    timings_queue m_queue;
 
@@ -270,6 +519,11 @@ private:
     *  @brief Handle the backend specific time domains for each present stage.
     */
    swapchain_time_domains m_time_domains;
+
+   /**
+    * @brief Converts the stage times to the domains the presents ask for, guarded by @ref m_queue_mutex.
+    */
+   time_domain_calibrator m_calibrator;
 };
 
 } /* namespace wsi */
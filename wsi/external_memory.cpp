@@ -25,7 +25,9 @@
 #include "external_memory.hpp"
 
 #include <cassert>
+#include <cinttypes>
 #include <cstdint>
+#include <fcntl.h>
 #include <unistd.h>
 #include <algorithm>
 
@@ -51,6 +53,7 @@ external_memory::~external_memory()
          break;
          
       case wsi_memory_type::HOST_VISIBLE:
+      case wsi_memory_type::EXTERNAL_HOST_POINTER:
          cleanup_host_visible_memory();
          break;
          
@@ -58,6 +61,35 @@ external_memory::~external_memory()
          // No cleanup needed for uninitialized memory
          break;
    }
+
+   if (m_recycle_fd >= 0)
+   {
+      close(m_recycle_fd);
+   }
+}
+
+void external_memory::keep_recycle_fd()
+{
+   if (m_recycle_fd < 0 && m_buffer_fds[0] >= 0)
+   {
+      m_recycle_fd = fcntl(m_buffer_fds[0], F_DUPFD_CLOEXEC, 0);
+   }
+}
+
+void external_memory::rebind_allocator(const util::allocator &allocator)
+{
+   if (m_host_memory_size != 0)
+   {
+      if (m_allocator.m_accounting != nullptr)
+      {
+         m_allocator.m_accounting->remove(util::memory_category::host_visible, m_host_memory_size);
+      }
+      if (allocator.m_accounting != nullptr)
+      {
+         allocator.m_accounting->add(util::memory_category::host_visible, m_host_memory_size);
+      }
+   }
+   m_allocator = allocator;
 }
 
 uint32_t external_memory::get_num_planes()
@@ -84,6 +116,9 @@ bool external_memory::is_valid() const
          
       case wsi_memory_type::HOST_VISIBLE:
          return m_required_props != 0;
+
+      case wsi_memory_type::EXTERNAL_HOST_POINTER:
+         return true;
          
       default:
          return false;
@@ -95,20 +130,24 @@ bool external_memory::is_host_visible() const
    return m_memory_type == wsi_memory_type::HOST_VISIBLE;
 }
 
+bool external_memory::is_host_pointer() const
+{
+   return m_memory_type == wsi_memory_type::EXTERNAL_HOST_POINTER;
+}
+
 wsi_memory_type external_memory::get_memory_type() const
 {
    return m_memory_type;
 }
 
 VkResult external_memory::configure_for_host_visible(const VkImageCreateInfo &image_info,
-                                                     VkMemoryPropertyFlags required_props,
-                                                     VkMemoryPropertyFlags optimal_props)
+                                                     VkMemoryPropertyFlags required_props, util::memory_access access)
 {
    UNUSED(image_info);
    
    m_memory_type = wsi_memory_type::HOST_VISIBLE;
    m_required_props = required_props;
-   m_optimal_props = optimal_props;
+   m_host_access = access;
    
    m_num_planes = 1;
    m_num_memories = 1;
@@ -116,25 +155,151 @@ VkResult external_memory::configure_for_host_visible(const VkImageCreateInfo &im
    return VK_SUCCESS;
 }
 
+void external_memory::configure_for_host_pointer()
+{
+   m_memory_type = wsi_memory_type::EXTERNAL_HOST_POINTER;
+   m_handle_type = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+   m_num_planes = 1;
+   m_num_memories = 1;
+}
+
+VkResult external_memory::import_host_pointer_and_bind(const VkImage &image, void *host_pointer, VkDeviceSize size)
+{
+   auto &device_data = layer::device_private_data::get(m_device);
+
+   VkMemoryRequirements mem_requirements;
+   device_data.disp.GetImageMemoryRequirements(m_device, image, &mem_requirements);
+   if (mem_requirements.size > size)
+   {
+      WSI_LOG_ERROR("Host allocation of %" PRIu64 " bytes is too small for the image (%" PRIu64 " bytes)",
+                    static_cast<uint64_t>(size), static_cast<uint64_t>(mem_requirements.size));
+      return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+   }
+
+   VkMemoryHostPointerPropertiesEXT host_pointer_props = {};
+   host_pointer_props.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+   TRY_LOG(device_data.disp.GetMemoryHostPointerPropertiesEXT(m_device, m_handle_type, host_pointer,
+                                                              &host_pointer_props),
+           "Failed to query host pointer properties");
+
+   /* Prefer coherent memory types so the X server sees the GPU writes without any flush. Other types must at least
+    * be host visible, so the layer can map them and invalidate the rows before handing the segment to the server. */
+   VkPhysicalDeviceMemoryProperties2 memory_props = {};
+   memory_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+   device_data.instance_data.disp.GetPhysicalDeviceMemoryProperties2KHR(device_data.physical_device, &memory_props);
+
+   const uint32_t type_bits = mem_requirements.memoryTypeBits & host_pointer_props.memoryTypeBits;
+   const VkMemoryPropertyFlags props_to_try[] = { VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT };
+   uint32_t memory_type_index = VK_MAX_MEMORY_TYPES;
+   for (VkMemoryPropertyFlags props : props_to_try)
+   {
+      for (uint32_t i = 0; i < memory_props.memoryProperties.memoryTypeCount; i++)
+      {
+         if ((type_bits & (1u << i)) && (memory_props.memoryProperties.memoryTypes[i].propertyFlags & props) == props)
+         {
+            memory_type_index = i;
+            break;
+         }
+      }
+      if (memory_type_index != VK_MAX_MEMORY_TYPES)
+      {
+         break;
+      }
+   }
+
+   if (memory_type_index == VK_MAX_MEMORY_TYPES)
+   {
+      WSI_LOG_ERROR("No memory type can import the host allocation for the image");
+      return VK_ERROR_FORMAT_NOT_SUPPORTED;
+   }
+
+   VkImportMemoryHostPointerInfoEXT import_info = {};
+   import_info.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+   import_info.handleType = m_handle_type;
+   import_info.pHostPointer = host_pointer;
+
+   VkMemoryAllocateInfo alloc_info = {};
+   alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+   alloc_info.pNext = &import_info;
+   alloc_info.allocationSize = size;
+   alloc_info.memoryTypeIndex = memory_type_index;
+
+   TRY_LOG(device_data.disp.AllocateMemory(m_device, &alloc_info, m_allocator.get_original_callbacks(), &m_host_memory),
+           "Failed to import host allocation");
+   m_host_memory_props = memory_props.memoryProperties.memoryTypes[memory_type_index].propertyFlags;
+
+   TRY_LOG(device_data.disp.BindImageMemory(m_device, image, m_host_memory, 0),
+           "Failed to bind imported host allocation to image");
+
+   query_host_layout(image);
+   return VK_SUCCESS;
+}
+
+void external_memory::release_host_pointer()
+{
+   if (is_host_pointer())
+   {
+      cleanup_host_visible_memory();
+   }
+}
+
+void external_memory::query_host_layout(const VkImage &image)
+{
+   auto &device_data = layer::device_private_data::get(m_device);
+
+   VkImageSubresource subresource = {};
+   subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+   subresource.mipLevel = 0;
+   subresource.arrayLayer = 0;
+
+   device_data.disp.GetImageSubresourceLayout(m_device, image, &subresource, &m_host_layout);
+}
+
 VkResult external_memory::get_fd_mem_type_index(int fd, uint32_t *mem_idx)
 {
    auto &device_data = layer::device_private_data::get(m_device);
+   auto &memory_types = device_data.get_import_memory_types();
+   if (m_memory_source != nullptr &&
+       memory_types.find(m_handle_type, m_memory_source, m_memory_source_flags, mem_idx))
+   {
+      return VK_SUCCESS;
+   }
+
    VkMemoryFdPropertiesKHR mem_props = {};
    mem_props.sType = VK_STRUCTURE_TYPE_MEMORY_FD_PROPERTIES_KHR;
 
    TRY_LOG(device_data.disp.GetMemoryFdPropertiesKHR(m_device, m_handle_type, fd, &mem_props),
            "Error querying file descriptor properties");
 
-   for (*mem_idx = 0; *mem_idx < VK_MAX_MEMORY_TYPES; (*mem_idx)++)
+   VkPhysicalDeviceMemoryProperties2 memory_props = {};
+   memory_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+   device_data.instance_data.disp.GetPhysicalDeviceMemoryProperties2KHR(device_data.physical_device, &memory_props);
+
+   /* Swapchain images are render targets, so are best in memory local to the GPU. */
+   *mem_idx = util::select_memory_type(memory_props.memoryProperties, mem_props.memoryTypeBits,
+                                       util::memory_access::scanout,
+                                       m_protected_memory ? VK_MEMORY_PROPERTY_PROTECTED_BIT : 0);
+   if (*mem_idx == VK_MAX_MEMORY_TYPES)
    {
-      if (mem_props.memoryTypeBits & (1 << *mem_idx))
+      /* The driver did accept the lowest type, even if the policy finds none suitable. */
+      for (*mem_idx = 0; *mem_idx < VK_MAX_MEMORY_TYPES; (*mem_idx)++)
       {
-         break;
+         if (mem_props.memoryTypeBits & (1u << *mem_idx))
+         {
+            break;
+         }
       }
    }
 
    assert(*mem_idx < VK_MAX_MEMORY_TYPES);
 
+   if (m_memory_source != nullptr)
+   {
+      memory_types.insert(m_handle_type, m_memory_source, m_memory_source_flags, *mem_idx);
+   }
+
    return VK_SUCCESS;
 }
 
@@ -181,15 +346,32 @@ VkResult external_memory::import_plane_memory(int fd, VkDeviceMemory *memory)
    alloc_info.memoryTypeIndex = mem_index;
 
    auto &device_data = layer::device_private_data::get(m_device);
+   const uint64_t import_start_ns = util::frame_stats::now_ns();
    TRY_LOG(device_data.disp.AllocateMemory(m_device, &alloc_info, m_allocator.get_original_callbacks(), memory),
            "Failed to import device memory");
+   device_data.get_allocation_stats().record(util::allocation_stage::memory_import, import_start_ns,
+                                             static_cast<uint64_t>(fd_size));
 
    return VK_SUCCESS;
 }
 
 VkResult external_memory::bind_swapchain_image_memory(const VkImage &image)
+{
+   const uint64_t bind_start_ns = util::frame_stats::now_ns();
+   TRY_LOG_CALL(bind_image_memory(image));
+   layer::device_private_data::get(m_device).get_allocation_stats().record(util::allocation_stage::memory_bind,
+                                                                          bind_start_ns, 0);
+   return VK_SUCCESS;
+}
+
+VkResult external_memory::bind_image_memory(const VkImage &image)
 {
    auto &device_data = layer::device_private_data::get(m_device);
+   if (m_memory_type == wsi_memory_type::HOST_VISIBLE || m_memory_type == wsi_memory_type::EXTERNAL_HOST_POINTER)
+   {
+      return device_data.disp.BindImageMemory(m_device, image, m_host_memory, 0);
+   }
+
    if (is_disjoint())
    {
       util::vector<VkBindImageMemoryInfo> bind_img_mem_infos(m_allocator);
@@ -271,22 +453,15 @@ VkResult external_memory::find_host_visible_memory_type(const VkMemoryRequiremen
    memory_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
    device_data.instance_data.disp.GetPhysicalDeviceMemoryProperties2KHR(device_data.physical_device, &memory_props);
    
-   VkMemoryPropertyFlags props_to_try[] = { m_optimal_props, m_required_props };
-   
-   for (VkMemoryPropertyFlags props : props_to_try)
+   *memory_type_index = util::select_memory_type(memory_props.memoryProperties, mem_requirements.memoryTypeBits,
+                                                 m_host_access, m_required_props);
+   if (*memory_type_index == VK_MAX_MEMORY_TYPES)
    {
-      for (uint32_t i = 0; i < memory_props.memoryProperties.memoryTypeCount; i++)
-      {
-         if ((mem_requirements.memoryTypeBits & (1 << i)) &&
-             (memory_props.memoryProperties.memoryTypes[i].propertyFlags & props) == props)
-         {
-            *memory_type_index = i;
-            return VK_SUCCESS;
-         }
-      }
+      return VK_ERROR_FORMAT_NOT_SUPPORTED;
    }
-   
-   return VK_ERROR_FORMAT_NOT_SUPPORTED;
+
+   m_host_memory_props = memory_props.memoryProperties.memoryTypes[*memory_type_index].propertyFlags;
+   return VK_SUCCESS;
 }
 
 VkResult external_memory::allocate_host_visible_and_bind(const VkImage &image, const VkImageCreateInfo &image_info)
@@ -307,23 +482,25 @@ VkResult external_memory::allocate_host_visible_and_bind(const VkImage &image, c
    
    TRY_LOG(device_data.disp.AllocateMemory(m_device, &alloc_info, m_allocator.get_original_callbacks(), &m_host_memory),
            "Failed to allocate host-visible memory");
+   m_host_memory_size = mem_requirements.size;
+   if (m_allocator.m_accounting != nullptr)
+   {
+      m_allocator.m_accounting->add(util::memory_category::host_visible, m_host_memory_size);
+   }
    
    TRY_LOG(device_data.disp.BindImageMemory(m_device, image, m_host_memory, 0),
            "Failed to bind host-visible memory to image");
    
-   VkImageSubresource subresource = {};
-   subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-   subresource.mipLevel = 0;
-   subresource.arrayLayer = 0;
-   
-   device_data.disp.GetImageSubresourceLayout(m_device, image, &subresource, &m_host_layout);
+   query_host_layout(image);
    
    return VK_SUCCESS;
 }
 
 VkResult external_memory::map_host_memory(void **mapped_ptr)
 {
-   if (m_memory_type != wsi_memory_type::HOST_VISIBLE || m_host_memory == VK_NULL_HANDLE)
+   const bool mappable = m_memory_type == wsi_memory_type::HOST_VISIBLE ||
+                         (is_host_pointer() && (m_host_memory_props & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0);
+   if (!mappable || m_host_memory == VK_NULL_HANDLE)
    {
       return VK_ERROR_MEMORY_MAP_FAILED;
    }
@@ -354,9 +531,33 @@ void external_memory::unmap_host_memory()
    }
 }
 
+VkResult external_memory::invalidate_host_memory(VkDeviceSize offset, VkDeviceSize size)
+{
+   if (m_host_mapped_ptr == nullptr || (m_host_memory_props & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0)
+   {
+      return VK_SUCCESS;
+   }
+
+   auto &device_data = layer::device_private_data::get(m_device);
+   VkPhysicalDeviceProperties device_props = {};
+   device_data.instance_data.disp.GetPhysicalDeviceProperties(device_data.physical_device, &device_props);
+   const VkDeviceSize atom = std::max<VkDeviceSize>(device_props.limits.nonCoherentAtomSize, 1);
+
+   VkMappedMemoryRange range = {};
+   range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+   range.memory = m_host_memory;
+   range.offset = offset - offset % atom;
+   const VkDeviceSize end = (offset + size + atom - 1) / atom * atom;
+   /* Ranges reaching the end of the allocation must use VK_WHOLE_SIZE, as it need not be a multiple of the atom. */
+   range.size = end >= m_host_memory_size ? VK_WHOLE_SIZE : end - range.offset;
+   return device_data.disp.InvalidateMappedMemoryRanges(m_device, 1, &range);
+}
+
 VkDeviceMemory external_memory::get_host_memory() const
 {
-   return m_memory_type == wsi_memory_type::HOST_VISIBLE ? m_host_memory : VK_NULL_HANDLE;
+   return (m_memory_type == wsi_memory_type::HOST_VISIBLE || m_memory_type == wsi_memory_type::EXTERNAL_HOST_POINTER) ?
+             m_host_memory :
+             VK_NULL_HANDLE;
 }
 
 const VkSubresourceLayout& external_memory::get_host_layout() const
@@ -394,6 +595,11 @@ void external_memory::cleanup_host_visible_memory()
       auto &device_data = layer::device_private_data::get(m_device);
       device_data.disp.FreeMemory(m_device, m_host_memory, m_allocator.get_original_callbacks());
       m_host_memory = VK_NULL_HANDLE;
+      if (m_allocator.m_accounting != nullptr && m_host_memory_size != 0)
+      {
+         m_allocator.m_accounting->remove(util::memory_category::host_visible, m_host_memory_size);
+      }
+      m_host_memory_size = 0;
    }
 }
 
@@ -32,12 +32,14 @@
 
 #include <array>
 #include <cstdint>
+#include <utility>
 #include <vulkan/vulkan.h>
 
 #include "wsi/synchronization.hpp"
 #include "layer/private_data.hpp"
 #include "util/custom_allocator.hpp"
 #include "util/helpers.hpp"
+#include "util/memory_type_policy.hpp"
 
 namespace wsi
 {
@@ -48,7 +50,7 @@ enum class wsi_memory_type
 {
    EXTERNAL_DMA_BUF,      // External file descriptors (current default)
    HOST_VISIBLE,          // Host-accessible memory
-   EXTERNAL_HOST_POINTER  // Future: external host pointers
+   EXTERNAL_HOST_POINTER  // Host allocation imported via VK_EXT_external_memory_host
 };
 
 class external_memory
@@ -94,6 +96,51 @@ public:
       std::copy(buffer_fds, buffer_fds + MAX_PLANES, m_buffer_fds.begin());
    }
 
+   /**
+    * @brief Identify where the buffers set with @ref set_buffer_fds were allocated.
+    *
+    * Buffers of the same source are imported with the same memory type, which is then only resolved for the first
+    * of them. Without a source the memory type is resolved for every buffer.
+    *
+    * @param source       Allocator the buffers come from, e.g. a wsialloc allocator.
+    * @param source_flags Flags the buffers were allocated with, which select where the allocator takes them from.
+    * @param is_protected Whether the image needs protected memory.
+    */
+   void set_memory_source(const void *source, uint64_t source_flags, bool is_protected)
+   {
+      m_memory_source = source;
+      m_memory_source_flags = source_flags;
+      m_protected_memory = is_protected;
+   }
+
+   /**
+    * @brief Keep a duplicate of the fd of a single buffer image, to give the buffer back to wsialloc once the image
+    *        is destroyed.
+    *
+    * The fds set with @ref set_buffer_fds are owned by the driver once imported, so the buffer cannot be recycled
+    * through them. Does nothing when no buffer was allocated.
+    */
+   void keep_recycle_fd();
+
+   /**
+    * @brief Take the fd kept by @ref keep_recycle_fd.
+    *
+    * @return The fd, owned by the caller, or -1 if none was kept.
+    */
+   int take_recycle_fd()
+   {
+      return std::exchange(m_recycle_fd, -1);
+   }
+
+   /**
+    * @brief Allocate and free through another allocator, moving the host visible memory to its accounting.
+    *
+    * For images a swapchain takes over from its ancestor, which outlives its allocator and accounting.
+    *
+    * @param allocator The allocator of the new owner.
+    */
+   void rebind_allocator(const util::allocator &allocator);
+
    /**
     * @brief Set the per plane stride values.
     */
@@ -149,13 +196,44 @@ public:
     * 
     * @param image_info       Image creation info for memory requirements
     * @param required_props   Required memory property flags
-    * @param optimal_props    Optimal memory property flags (fallback to required)
+    * @param access           How the memory is accessed, which selects the best memory type with the required flags
     * 
     * @return VK_SUCCESS on success, error code on failure
     */
    VkResult configure_for_host_visible(const VkImageCreateInfo &image_info,
                                        VkMemoryPropertyFlags required_props,
-                                       VkMemoryPropertyFlags optimal_props);
+                                       util::memory_access access);
+
+   /**
+    * @brief Configure for importing a host allocation with VK_EXT_external_memory_host.
+    *
+    * The image must be created with VkExternalMemoryImageCreateInfo using
+    * VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, see @ref fill_external_info.
+    */
+   void configure_for_host_pointer();
+
+   /**
+    * @brief Import a host allocation as device memory and bind it to the image.
+    *
+    * @param image        The swapchain image.
+    * @param host_pointer Start of the host allocation, aligned to minImportedHostPointerAlignment.
+    * @param size         Size of the host allocation, a multiple of minImportedHostPointerAlignment.
+    *
+    * @return VK_SUCCESS on success, error code on failure.
+    */
+   VkResult import_host_pointer_and_bind(const VkImage &image, void *host_pointer, VkDeviceSize size);
+
+   /**
+    * @brief Check if configured for an imported host allocation.
+    */
+   bool is_host_pointer() const;
+
+   /**
+    * @brief Free the device memory that aliases an imported host allocation.
+    *
+    * Must be called before the host allocation itself is released.
+    */
+   void release_host_pointer();
 
    /**
     * @brief Check if external_memory instance is properly configured.
@@ -243,6 +321,16 @@ public:
     */
    void unmap_host_memory();
 
+   /**
+    * @brief Make GPU writes to a range of the mapped host memory visible to the CPU.
+    *
+    * Does nothing for coherent memory. The range is widened to the device's nonCoherentAtomSize.
+    *
+    * @param offset Start of the range the CPU is about to read.
+    * @param size   Size of the range.
+    */
+   VkResult invalidate_host_memory(VkDeviceSize offset, VkDeviceSize size);
+
    /**
     * @brief Get host-visible memory handle.
     *
@@ -257,6 +345,18 @@ public:
     */
    const VkSubresourceLayout& get_host_layout() const;
 
+   /**
+    * @brief Property flags of the memory type of the host-visible memory.
+    *
+    * Memory without VK_MEMORY_PROPERTY_HOST_CACHED_BIT is usually write-combined, and best read with streaming loads.
+    *
+    * @return The flags, 0 when no host-visible memory was allocated.
+    */
+   VkMemoryPropertyFlags get_host_memory_properties() const
+   {
+      return m_host_memory_props;
+   }
+
    /**
     * @brief Fills out a list of VkSubresourceLayout for each plane using the stored planes layout data.
     *
@@ -292,14 +392,19 @@ private:
 
    VkResult import_plane_memory(int fd, VkDeviceMemory *memory);
 
+   VkResult bind_image_memory(const VkImage &image);
+
    // Host-visible memory methods
    VkResult allocate_host_visible_and_bind(const VkImage &image, const VkImageCreateInfo &image_info);
    VkResult find_host_visible_memory_type(const VkMemoryRequirements &mem_requirements, uint32_t *memory_type_index);
    void cleanup_host_visible_memory();
+   void query_host_layout(const VkImage &image);
    void cleanup_external_memory();
 
    // External DMA-BUF memory data
    std::array<int, MAX_PLANES> m_buffer_fds{ -1, -1, -1, -1 };
+   /* Duplicate of m_buffer_fds[0] for wsialloc_free, see @ref keep_recycle_fd. */
+   int m_recycle_fd{ -1 };
    std::array<int, MAX_PLANES> m_strides{ 0, 0, 0, 0 };
    std::array<uint32_t, MAX_PLANES> m_offsets{ 0, 0, 0, 0 };
    std::array<VkDeviceMemory, MAX_PLANES> m_memories = { VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE,
@@ -307,6 +412,10 @@ private:
    uint32_t m_num_planes{ 0 };
    uint32_t m_num_memories{ 0 };
    VkExternalMemoryHandleTypeFlagBits m_handle_type{ VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT };
+   /* See @ref set_memory_source. */
+   const void *m_memory_source{ nullptr };
+   uint64_t m_memory_source_flags{ 0 };
+   bool m_protected_memory{ false };
 
    wsi_memory_type m_memory_type = wsi_memory_type::EXTERNAL_DMA_BUF;
    
@@ -314,10 +423,14 @@ private:
    void* m_host_mapped_ptr = nullptr;
    VkSubresourceLayout m_host_layout = {};
    VkMemoryPropertyFlags m_required_props = 0;
-   VkMemoryPropertyFlags m_optimal_props = 0;
-
-   const VkDevice &m_device;
-   const util::allocator &m_allocator;
+   util::memory_access m_host_access = util::memory_access::cpu_readback;
+   /* Property flags of the memory type m_host_memory was allocated from. */
+   VkMemoryPropertyFlags m_host_memory_props = 0;
+   VkDeviceSize m_host_memory_size = 0;
+
+   /* Held by value, the swapchain that created the memory may be destroyed before it. */
+   const VkDevice m_device;
+   util::allocator m_allocator;
 };
 
 } // namespace wsi
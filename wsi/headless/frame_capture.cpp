@@ -0,0 +1,467 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file frame_capture.cpp
+ *
+ * @brief Implementation of the capture of the frames presented to a headless swapchain.
+ */
+
+#include "frame_capture.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "layer/private_data.hpp"
+#include "util/log.hpp"
+#include "util/macros.hpp"
+
+namespace wsi
+{
+namespace headless
+{
+
+/* Preferred first: coherent memory needs no invalidation before each write. */
+static constexpr VkMemoryPropertyFlags STAGING_MEMORY_PROPS[] = {
+   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+};
+
+static uint32_t find_staging_memory_type(layer::device_private_data &device_data, uint32_t type_bits,
+                                         VkMemoryPropertyFlags *found_props)
+{
+   VkPhysicalDeviceMemoryProperties2 memory_props = {};
+   memory_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+   device_data.instance_data.disp.GetPhysicalDeviceMemoryProperties2KHR(device_data.physical_device, &memory_props);
+
+   for (VkMemoryPropertyFlags props : STAGING_MEMORY_PROPS)
+   {
+      for (uint32_t i = 0; i < memory_props.memoryProperties.memoryTypeCount; i++)
+      {
+         if ((type_bits & (1u << i)) && (memory_props.memoryProperties.memoryTypes[i].propertyFlags & props) == props)
+         {
+            *found_props = memory_props.memoryProperties.memoryTypes[i].propertyFlags;
+            return i;
+         }
+      }
+   }
+
+   return VK_MAX_MEMORY_TYPES;
+}
+
+/**
+ * @brief Size of a pixel of the single plane color formats that can be captured, 0 for the others.
+ */
+static uint32_t get_bytes_per_pixel(VkFormat format)
+{
+   switch (format)
+   {
+   case VK_FORMAT_R5G6B5_UNORM_PACK16:
+   case VK_FORMAT_B5G6R5_UNORM_PACK16:
+   case VK_FORMAT_R4G4B4A4_UNORM_PACK16:
+   case VK_FORMAT_B4G4R4A4_UNORM_PACK16:
+   case VK_FORMAT_R5G5B5A1_UNORM_PACK16:
+   case VK_FORMAT_B5G5R5A1_UNORM_PACK16:
+   case VK_FORMAT_A1R5G5B5_UNORM_PACK16:
+      return 2;
+   case VK_FORMAT_R8G8B8A8_UNORM:
+   case VK_FORMAT_R8G8B8A8_SRGB:
+   case VK_FORMAT_B8G8R8A8_UNORM:
+   case VK_FORMAT_B8G8R8A8_SRGB:
+   case VK_FORMAT_A8B8G8R8_UNORM_PACK32:
+   case VK_FORMAT_A8B8G8R8_SRGB_PACK32:
+   case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+   case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+   case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+      return 4;
+   case VK_FORMAT_R16G16B16A16_UNORM:
+   case VK_FORMAT_R16G16B16A16_SFLOAT:
+      return 8;
+   default:
+      return 0;
+   }
+}
+
+frame_capture::~frame_capture()
+{
+   destroy();
+}
+
+bool frame_capture::is_requested()
+{
+   const char *prefix = std::getenv("WSI_HEADLESS_CAPTURE");
+   return prefix != nullptr && prefix[0] != '\0';
+}
+
+bool frame_capture::is_supported(layer::device_private_data &device_data, VkFormat format, VkImageTiling tiling,
+                                 VkImageUsageFlags usage)
+{
+   if (!device_data.get_single_queue_family().has_value() || get_bytes_per_pixel(format) == 0)
+   {
+      return false;
+   }
+
+   VkImageFormatProperties format_props = {};
+   if (device_data.instance_data.disp.GetPhysicalDeviceImageFormatProperties(
+          device_data.physical_device, format, VK_IMAGE_TYPE_2D, tiling, usage | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, 0,
+          &format_props) != VK_SUCCESS)
+   {
+      return false;
+   }
+
+   VkMemoryPropertyFlags props = 0;
+   return find_staging_memory_type(device_data, ~0u, &props) != VK_MAX_MEMORY_TYPES;
+}
+
+VkResult frame_capture::init(layer::device_private_data &device_data, const util::allocator &allocator,
+                             VkFormat format, VkExtent2D extent)
+{
+   m_device_data = &device_data;
+   m_callbacks = allocator.get_original_callbacks();
+   m_extent = extent;
+   m_bytes_per_pixel = get_bytes_per_pixel(format);
+   m_frame_size = static_cast<size_t>(extent.width) * extent.height * m_bytes_per_pixel;
+
+   const char *interval = std::getenv("WSI_HEADLESS_CAPTURE_INTERVAL");
+   if (interval != nullptr)
+   {
+      m_interval = std::max(static_cast<uint32_t>(std::strtoul(interval, nullptr, 10)), 1u);
+   }
+
+   VkCommandPoolCreateInfo pool_info = {};
+   pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+   pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+   pool_info.queueFamilyIndex = device_data.get_single_queue_family().value_or(0);
+   TRY_LOG(device_data.disp.CreateCommandPool(device_data.device, &pool_info, m_callbacks, &m_command_pool),
+           "Failed to create the capture command pool");
+
+   for (auto &slot : m_slots)
+   {
+      VkResult result = create_slot(slot, m_frame_size);
+      if (result != VK_SUCCESS)
+      {
+         destroy();
+         return result;
+      }
+   }
+
+   /* Each swapchain gets its own file, so recreated swapchains do not mix frame sizes. */
+   static std::atomic<uint32_t> capture_count{ 0 };
+   char path[4096];
+   std::snprintf(path, sizeof(path), "%s-%u-%ux%u-%d.raw", std::getenv("WSI_HEADLESS_CAPTURE"),
+                 capture_count.fetch_add(1, std::memory_order_relaxed), extent.width, extent.height,
+                 static_cast<int>(format));
+   util::fd_owner output{ open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+   if (!output.is_valid())
+   {
+      WSI_LOG_ERROR("Failed to open the capture file %s: %s.", path, std::strerror(errno));
+      destroy();
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+
+   m_output = std::move(output);
+
+   try
+   {
+      m_writer = std::thread(&frame_capture::writer_main, this);
+   }
+   catch (const std::system_error &)
+   {
+      WSI_LOG_ERROR("Failed to start the capture writer thread.");
+      destroy();
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
+
+   WSI_LOG_INFO("Capturing every %u presented frames to %s.", m_interval, path);
+   return VK_SUCCESS;
+}
+
+VkResult frame_capture::create_slot(staging_slot &slot, VkDeviceSize size)
+{
+   const VkDevice device = m_device_data->device;
+
+   VkBufferCreateInfo buffer_info = {};
+   buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+   buffer_info.size = size;
+   buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+   buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+   TRY_LOG(m_device_data->disp.CreateBuffer(device, &buffer_info, m_callbacks, &slot.buffer),
+           "Failed to create a capture staging buffer");
+
+   VkMemoryRequirements mem_requirements;
+   m_device_data->disp.GetBufferMemoryRequirements(device, slot.buffer, &mem_requirements);
+
+   VkMemoryPropertyFlags props = 0;
+   const uint32_t memory_type_index =
+      find_staging_memory_type(*m_device_data, mem_requirements.memoryTypeBits, &props);
+   if (memory_type_index == VK_MAX_MEMORY_TYPES)
+   {
+      WSI_LOG_ERROR("No host cached memory type for the capture staging buffers");
+      return VK_ERROR_FORMAT_NOT_SUPPORTED;
+   }
+   m_coherent = (props & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+   VkMemoryAllocateInfo alloc_info = {};
+   alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+   alloc_info.allocationSize = mem_requirements.size;
+   alloc_info.memoryTypeIndex = memory_type_index;
+   TRY_LOG(m_device_data->disp.AllocateMemory(device, &alloc_info, m_callbacks, &slot.memory),
+           "Failed to allocate a capture staging buffer memory");
+   TRY_LOG(m_device_data->disp.BindBufferMemory(device, slot.buffer, slot.memory, 0),
+           "Failed to bind a capture staging buffer memory");
+   TRY_LOG(m_device_data->disp.MapMemory(device, slot.memory, 0, VK_WHOLE_SIZE, 0, &slot.mapped),
+           "Failed to map a capture staging buffer memory");
+
+   VkCommandBufferAllocateInfo command_buffer_info = {};
+   command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+   command_buffer_info.commandPool = m_command_pool;
+   command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+   command_buffer_info.commandBufferCount = 1;
+   TRY_LOG(m_device_data->disp.AllocateCommandBuffers(device, &command_buffer_info, &slot.command_buffer),
+           "Failed to allocate a capture command buffer");
+
+   /* Command buffers are dispatchable, the loader has to know about the ones the layer creates. */
+   TRY_LOG_CALL(m_device_data->SetDeviceLoaderData(device, slot.command_buffer));
+   return VK_SUCCESS;
+}
+
+VkCommandBuffer frame_capture::record_copy(VkImage image, int &slot)
+{
+   slot = -1;
+
+   std::lock_guard<std::mutex> lock(m_mutex);
+   if (m_presents++ % m_interval != 0)
+   {
+      return VK_NULL_HANDLE;
+   }
+
+   uint32_t index = 0;
+   while (index < NUM_SLOTS && m_slots[index].status != staging_slot::state::FREE)
+   {
+      index++;
+   }
+   if (index == NUM_SLOTS)
+   {
+      /* The writer is behind, skip the frame rather than stall the present. */
+      m_dropped++;
+      return VK_NULL_HANDLE;
+   }
+   staging_slot &staging = m_slots[index];
+
+   VkCommandBufferBeginInfo begin_info = {};
+   begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+   begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+   if (m_device_data->disp.BeginCommandBuffer(staging.command_buffer, &begin_info) != VK_SUCCESS)
+   {
+      return VK_NULL_HANDLE;
+   }
+
+   /* The present semaphores are waited on at the transfer stage, which orders the barriers after the
+    * application's rendering. */
+   VkImageMemoryBarrier to_transfer = {};
+   to_transfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+   to_transfer.srcAccessMask = 0;
+   to_transfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+   to_transfer.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+   to_transfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+   to_transfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+   to_transfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+   to_transfer.image = image;
+   to_transfer.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+   m_device_data->disp.CmdPipelineBarrier(staging.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                          VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                                          &to_transfer);
+
+   VkBufferImageCopy region = {};
+   region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+   region.imageExtent = { m_extent.width, m_extent.height, 1 };
+   m_device_data->disp.CmdCopyImageToBuffer(staging.command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                            staging.buffer, 1, &region);
+
+   VkImageMemoryBarrier to_present = to_transfer;
+   to_present.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+   to_present.dstAccessMask = 0;
+   to_present.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+   to_present.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+   VkBufferMemoryBarrier to_host = {};
+   to_host.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+   to_host.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+   to_host.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+   to_host.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+   to_host.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+   to_host.buffer = staging.buffer;
+   to_host.offset = 0;
+   to_host.size = VK_WHOLE_SIZE;
+   m_device_data->disp.CmdPipelineBarrier(staging.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                          VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+                                          nullptr, 1, &to_host, 1, &to_present);
+
+   if (m_device_data->disp.EndCommandBuffer(staging.command_buffer) != VK_SUCCESS)
+   {
+      return VK_NULL_HANDLE;
+   }
+
+   staging.status = staging_slot::state::COPYING;
+   slot = static_cast<int>(index);
+   return staging.command_buffer;
+}
+
+void frame_capture::write(int slot)
+{
+   if (slot < 0)
+   {
+      return;
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_slots[slot].status = staging_slot::state::WRITING;
+      m_write_queue[(m_write_head + m_write_count) % NUM_SLOTS] = static_cast<uint32_t>(slot);
+      m_write_count++;
+   }
+   m_cond.notify_one();
+}
+
+void frame_capture::cancel(int slot)
+{
+   if (slot < 0)
+   {
+      return;
+   }
+
+   std::lock_guard<std::mutex> lock(m_mutex);
+   m_slots[slot].status = staging_slot::state::FREE;
+}
+
+void frame_capture::writer_main()
+{
+   std::unique_lock<std::mutex> lock(m_mutex);
+   while (true)
+   {
+      m_cond.wait(lock, [this]() { return m_stop || m_write_count > 0; });
+      if (m_write_count == 0)
+      {
+         /* Stopping, and every queued frame was written. */
+         return;
+      }
+
+      staging_slot &staging = m_slots[m_write_queue[m_write_head]];
+      m_write_head = (m_write_head + 1) % NUM_SLOTS;
+      m_write_count--;
+      lock.unlock();
+
+      bool readable = true;
+      if (!m_coherent)
+      {
+         VkMappedMemoryRange range = {};
+         range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+         range.memory = staging.memory;
+         range.offset = 0;
+         range.size = VK_WHOLE_SIZE;
+         readable = m_device_data->disp.InvalidateMappedMemoryRanges(m_device_data->device, 1, &range) == VK_SUCCESS;
+      }
+
+      const char *data = static_cast<const char *>(staging.mapped);
+      size_t remaining = readable ? m_frame_size : 0;
+      while (remaining > 0)
+      {
+         ssize_t written = ::write(m_output.get(), data, remaining);
+         if (written < 0 && errno == EINTR)
+         {
+            continue;
+         }
+         if (written <= 0)
+         {
+            WSI_LOG_ERROR("Failed to write a captured frame: %s.", std::strerror(errno));
+            break;
+         }
+         data += written;
+         remaining -= static_cast<size_t>(written);
+      }
+
+      lock.lock();
+      m_captured += remaining == 0 && readable ? 1 : 0;
+      staging.status = staging_slot::state::FREE;
+   }
+}
+
+void frame_capture::destroy()
+{
+   if (m_writer.joinable())
+   {
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         m_stop = true;
+      }
+      m_cond.notify_one();
+      m_writer.join();
+      WSI_LOG_INFO("Captured %lu frames, %lu dropped while the writer was behind.",
+                   static_cast<unsigned long>(m_captured), static_cast<unsigned long>(m_dropped));
+   }
+
+   if (m_device_data == nullptr)
+   {
+      return;
+   }
+
+   const VkDevice device = m_device_data->device;
+   for (auto &slot : m_slots)
+   {
+      if (slot.command_buffer != VK_NULL_HANDLE)
+      {
+         m_device_data->disp.FreeCommandBuffers(device, m_command_pool, 1, &slot.command_buffer);
+      }
+      if (slot.buffer != VK_NULL_HANDLE)
+      {
+         m_device_data->disp.DestroyBuffer(device, slot.buffer, m_callbacks);
+      }
+      if (slot.memory != VK_NULL_HANDLE)
+      {
+         if (slot.mapped != nullptr)
+         {
+            m_device_data->disp.UnmapMemory(device, slot.memory);
+         }
+         m_device_data->disp.FreeMemory(device, slot.memory, m_callbacks);
+      }
+      slot = {};
+   }
+   if (m_command_pool != VK_NULL_HANDLE)
+   {
+      m_device_data->disp.DestroyCommandPool(device, m_command_pool, m_callbacks);
+      m_command_pool = VK_NULL_HANDLE;
+   }
+   m_output = util::fd_owner{};
+   m_device_data = nullptr;
+}
+
+} /* namespace headless */
+} /* namespace wsi */
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file frame_capture.hpp
+ *
+ * @brief Asynchronous capture of the frames presented to a headless swapchain.
+ */
+
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include <vulkan/vulkan.h>
+
+#include "util/custom_allocator.hpp"
+#include "util/file_descriptor.hpp"
+#include "util/helpers.hpp"
+
+namespace layer
+{
+class device_private_data;
+}
+
+namespace wsi
+{
+namespace headless
+{
+
+/**
+ * @brief Writes presented frames to a raw video file without stalling presents.
+ *
+ * Enabled with WSI_HEADLESS_CAPTURE, the path prefix of the files. Each swapchain writes
+ * <prefix>-<n>-<width>x<height>-<VkFormat>.raw with the frames one after the other, rows tightly packed.
+ * WSI_HEADLESS_CAPTURE_INTERVAL=N only captures every Nth present.
+ *
+ * A captured present records a copy of its image into a free slot of a ring of host cached staging buffers, run
+ * as part of the present payload. Once the payload completed, a writer thread writes the slot to the file and
+ * frees it. Presents finding no free slot are not captured rather than waiting for the writer.
+ */
+class frame_capture : private util::noncopyable
+{
+public:
+   /**
+    * @brief Number of staging buffers, frames being copied or written at the same time.
+    */
+   static constexpr uint32_t NUM_SLOTS = 3;
+
+   frame_capture() = default;
+   ~frame_capture();
+
+   /**
+    * @brief Whether WSI_HEADLESS_CAPTURE asks for frames to be captured.
+    */
+   static bool is_requested();
+
+   /**
+    * @brief Check whether images of @p format with @p tiling can be captured on the device.
+    *
+    * The copies are recorded for the presenting queue, so every queue of the device must come from one family. A host
+    * cached memory type must be available and the images must allow VK_IMAGE_USAGE_TRANSFER_SRC_BIT.
+    */
+   static bool is_supported(layer::device_private_data &device_data, VkFormat format, VkImageTiling tiling,
+                            VkImageUsageFlags usage);
+
+   /**
+    * @brief Open the capture file and create the staging ring and the writer thread.
+    */
+   VkResult init(layer::device_private_data &device_data, const util::allocator &allocator, VkFormat format,
+                 VkExtent2D extent);
+
+   bool is_enabled() const
+   {
+      return m_output.is_valid();
+   }
+
+   /**
+    * @brief Record the copy of a presented image into a free slot, when the present is sampled.
+    *
+    * @param image    Image in VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, created with VK_IMAGE_USAGE_TRANSFER_SRC_BIT.
+    * @param[out] slot Slot the image is copied to, to be given to @ref write or @ref cancel. -1 when not captured.
+    * @return The command buffer to run after the present semaphores, VK_NULL_HANDLE when not captured.
+    */
+   VkCommandBuffer record_copy(VkImage image, int &slot);
+
+   /**
+    * @brief Write @p slot to the file on the writer thread, once the copy recorded into it completed.
+    */
+   void write(int slot);
+
+   /**
+    * @brief Free @p slot without writing it, when its copy was not submitted.
+    */
+   void cancel(int slot);
+
+private:
+   struct staging_slot
+   {
+      enum class state
+      {
+         FREE,
+         COPYING,
+         WRITING,
+      };
+
+      VkCommandBuffer command_buffer{ VK_NULL_HANDLE };
+      VkBuffer buffer{ VK_NULL_HANDLE };
+      VkDeviceMemory memory{ VK_NULL_HANDLE };
+      void *mapped{ nullptr };
+      state status{ state::FREE };
+   };
+
+   VkResult create_slot(staging_slot &slot, VkDeviceSize size);
+   void writer_main();
+   void destroy();
+
+   layer::device_private_data *m_device_data{ nullptr };
+   const VkAllocationCallbacks *m_callbacks{ nullptr };
+   VkCommandPool m_command_pool{ VK_NULL_HANDLE };
+   bool m_coherent{ false };
+   VkExtent2D m_extent{};
+   uint32_t m_bytes_per_pixel{ 0 };
+   size_t m_frame_size{ 0 };
+
+   uint32_t m_interval{ 1 };
+   uint64_t m_presents{ 0 };
+   uint64_t m_captured{ 0 };
+   uint64_t m_dropped{ 0 };
+
+   util::fd_owner m_output;
+   std::array<staging_slot, NUM_SLOTS> m_slots{};
+
+   /* Guards the slot states, the write queue and m_stop. */
+   std::mutex m_mutex;
+   std::condition_variable m_cond;
+   std::array<uint32_t, NUM_SLOTS> m_write_queue{};
+   uint32_t m_write_head{ 0 };
+   uint32_t m_write_count{ 0 };
+   bool m_stop{ false };
+   std::thread m_writer;
+};
+
+} /* namespace headless */
+} /* namespace wsi */
@@ -37,11 +37,14 @@ wsi_ext_present_timing_headless::wsi_ext_present_timing_headless(const util::all
 }
 
 util::unique_ptr<wsi_ext_present_timing_headless> wsi_ext_present_timing_headless::create(
-   const util::allocator &allocator)
+   const util::allocator &allocator, uint64_t refresh_ns)
 {
+   /* The simulated display reports when the presentation thread saw the queue operations end, on the host. */
+   const VkTimeDomainKHR queue_domain =
+      refresh_ns != 0 ? VK_TIME_DOMAIN_CLOCK_MONOTONIC_RAW_KHR : VK_TIME_DOMAIN_DEVICE_KHR;
+
    std::array<util::unique_ptr<wsi::vulkan_time_domain>, 4> time_domains_array = {
-      allocator.make_unique<wsi::vulkan_time_domain>(VK_PRESENT_STAGE_QUEUE_OPERATIONS_END_BIT_EXT,
-                                                     VK_TIME_DOMAIN_DEVICE_KHR),
+      allocator.make_unique<wsi::vulkan_time_domain>(VK_PRESENT_STAGE_QUEUE_OPERATIONS_END_BIT_EXT, queue_domain),
       allocator.make_unique<wsi::vulkan_time_domain>(VK_PRESENT_STAGE_IMAGE_LATCHED_BIT_EXT,
                                                      VK_TIME_DOMAIN_CLOCK_MONOTONIC_RAW_KHR),
       allocator.make_unique<wsi::vulkan_time_domain>(VK_PRESENT_STAGE_IMAGE_FIRST_PIXEL_OUT_BIT_EXT,
@@ -50,17 +53,22 @@ util::unique_ptr<wsi_ext_present_timing_headless> wsi_ext_present_timing_headles
                                                      VK_TIME_DOMAIN_CLOCK_MONOTONIC_RAW_KHR)
    };
 
-   return wsi_ext_present_timing::create<wsi_ext_present_timing_headless>(allocator, time_domains_array);
+   auto present_timing = wsi_ext_present_timing::create<wsi_ext_present_timing_headless>(allocator, time_domains_array);
+   if (present_timing != nullptr)
+   {
+      present_timing->m_refresh_ns = refresh_ns;
+   }
+   return present_timing;
 }
 
 VkResult wsi_ext_present_timing_headless::get_swapchain_timing_properties(
    uint64_t &timing_properties_counter, VkSwapchainTimingPropertiesEXT &timing_properties)
 {
-   /* Use a reasonable approximate (5ms) that most devices should be able to match. */
+   /* Without a simulated display, use a reasonable approximate (5ms) that most devices should be able to match. */
    const uint64_t fixed_refresh_duration_ns = 5e+6;
 
    timing_properties_counter = 1;
-   timing_properties.refreshDuration = fixed_refresh_duration_ns;
+   timing_properties.refreshDuration = m_refresh_ns != 0 ? m_refresh_ns : fixed_refresh_duration_ns;
    timing_properties.variableRefreshDelay = UINT64_MAX;
 
    return VK_SUCCESS;
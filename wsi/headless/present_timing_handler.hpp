@@ -41,7 +41,11 @@
 class wsi_ext_present_timing_headless : public wsi::wsi_ext_present_timing
 {
 public:
-   static util::unique_ptr<wsi_ext_present_timing_headless> create(const util::allocator &allocator);
+   /**
+    * @param refresh_ns Refresh period of the simulated display, 0 when presents are not simulated.
+    */
+   static util::unique_ptr<wsi_ext_present_timing_headless> create(const util::allocator &allocator,
+                                                                   uint64_t refresh_ns);
 
    VkResult get_swapchain_timing_properties(uint64_t &timing_properties_counter,
                                             VkSwapchainTimingPropertiesEXT &timing_properties) override;
@@ -49,6 +53,9 @@ public:
 private:
    wsi_ext_present_timing_headless(const util::allocator &allocator);
 
+   /* Refresh period of the simulated display, 0 when presents are not simulated. */
+   uint64_t m_refresh_ns{ 0 };
+
    /* Allow util::allocator to access the private constructor */
    friend util::allocator;
 };
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file simulated_display.cpp
+ *
+ * @brief Display timing simulated by headless swapchains.
+ */
+
+#include "simulated_display.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "util/log.hpp"
+
+namespace wsi
+{
+namespace headless
+{
+
+static uint64_t now_ns()
+{
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+/**
+ * @brief Parse a WSI_HEADLESS_DISPLAY list into @p config.
+ */
+static void parse_config(const char *spec, simulated_display_config &config)
+{
+   config = {};
+   if (std::strcmp(spec, "off") == 0)
+   {
+      return;
+   }
+
+   while (*spec != '\0')
+   {
+      const char *end = std::strchr(spec, ',');
+      const size_t length = end != nullptr ? static_cast<size_t>(end - spec) : std::strlen(spec);
+      const char *value = static_cast<const char *>(std::memchr(spec, '=', length));
+      if (value != nullptr)
+      {
+         const size_t key_length = static_cast<size_t>(value - spec);
+         value++;
+         auto is_key = [spec, key_length](const char *key) {
+            return std::strlen(key) == key_length && std::strncmp(spec, key, key_length) == 0;
+         };
+         const double number = std::max(std::strtod(value, nullptr), 0.0);
+         if (is_key("refresh"))
+         {
+            config.refresh_ns = number > 0.0 ? static_cast<uint64_t>(1e9 / number) : 0;
+         }
+         else if (is_key("jitter_us"))
+         {
+            config.jitter_ns = static_cast<uint64_t>(number * 1e3);
+         }
+         else if (is_key("compositor_us"))
+         {
+            config.compositor_latency_ns = static_cast<uint64_t>(number * 1e3);
+         }
+         else if (is_key("scanout_us"))
+         {
+            config.scanout_latency_ns = static_cast<uint64_t>(number * 1e3);
+         }
+         else if (is_key("panel_us"))
+         {
+            config.panel_latency_ns = static_cast<uint64_t>(number * 1e3);
+         }
+         else if (is_key("release_us"))
+         {
+            config.release_latency_ns = static_cast<uint64_t>(number * 1e3);
+         }
+         else if (is_key("seed"))
+         {
+            config.seed = std::strtoull(value, nullptr, 0);
+         }
+         else
+         {
+            WSI_LOG_WARNING("Unknown headless display setting %.*s.", static_cast<int>(key_length), spec);
+         }
+      }
+      spec += end != nullptr ? length + 1 : length;
+   }
+
+   /* Larger offsets could reorder vblanks. */
+   config.jitter_ns = std::min(config.jitter_ns, config.refresh_ns / 4);
+}
+
+simulated_display_config simulated_display_config::get(VkPresentModeKHR present_mode)
+{
+   const char *mode_env = nullptr;
+   switch (present_mode)
+   {
+   case VK_PRESENT_MODE_FIFO_KHR:
+      mode_env = "WSI_HEADLESS_DISPLAY_FIFO";
+      break;
+   case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+      mode_env = "WSI_HEADLESS_DISPLAY_FIFO_RELAXED";
+      break;
+   case VK_PRESENT_MODE_MAILBOX_KHR:
+      mode_env = "WSI_HEADLESS_DISPLAY_MAILBOX";
+      break;
+   case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      mode_env = "WSI_HEADLESS_DISPLAY_IMMEDIATE";
+      break;
+   default:
+      /* Shared presents are not queued to a presentation engine. */
+      return {};
+   }
+
+   const char *spec = std::getenv(mode_env);
+   if (spec == nullptr)
+   {
+      spec = std::getenv("WSI_HEADLESS_DISPLAY");
+   }
+
+   simulated_display_config config{};
+   if (spec != nullptr)
+   {
+      parse_config(spec, config);
+   }
+   return config;
+}
+
+simulated_display::simulated_display(const simulated_display_config &config, VkPresentModeKHR present_mode)
+   : m_config(config)
+   , m_present_mode(present_mode)
+   , m_epoch_ns(now_ns())
+{
+}
+
+void simulated_display::set_present_mode(VkPresentModeKHR present_mode)
+{
+   m_config = simulated_display_config::get(present_mode);
+   m_present_mode = present_mode;
+}
+
+uint64_t simulated_display::get_vblank_time(uint64_t vblank) const
+{
+   uint64_t time = m_epoch_ns + vblank * m_config.refresh_ns;
+   if (m_config.jitter_ns == 0)
+   {
+      return time;
+   }
+
+   /* splitmix64 of the vblank, the same offsets on every run with the same seed. */
+   uint64_t hash = m_config.seed + (vblank + 1) * 0x9e3779b97f4a7c15ull;
+   hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+   hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+   hash ^= hash >> 31;
+
+   const uint64_t offset = hash % (2 * m_config.jitter_ns + 1);
+   return time + offset - m_config.jitter_ns;
+}
+
+simulated_present simulated_display::schedule(uint64_t queue_time_ns, uint64_t target_visible_ns)
+{
+   const uint64_t latch_to_visible_ns = m_config.scanout_latency_ns + m_config.panel_latency_ns;
+   uint64_t ready_ns = queue_time_ns + m_config.compositor_latency_ns;
+   if (target_visible_ns > ready_ns + latch_to_visible_ns)
+   {
+      ready_ns = target_visible_ns - latch_to_visible_ns;
+   }
+
+   uint64_t latched_ns = ready_ns;
+   if (m_present_mode != VK_PRESENT_MODE_IMMEDIATE_KHR)
+   {
+      latched_ns = latch_on_vblank(ready_ns);
+   }
+
+   m_last_visible_ns = latched_ns + latch_to_visible_ns;
+   return { latched_ns, latched_ns + m_config.scanout_latency_ns, m_last_visible_ns };
+}
+
+uint64_t simulated_display::latch_on_vblank(uint64_t ready_ns)
+{
+   uint64_t vblank = 0;
+   if (ready_ns > m_epoch_ns)
+   {
+      vblank = (ready_ns - m_epoch_ns + m_config.refresh_ns - 1) / m_config.refresh_ns;
+   }
+   while (get_vblank_time(vblank) < ready_ns)
+   {
+      vblank++;
+   }
+
+   if (m_has_presented && vblank <= m_last_vblank)
+   {
+      vblank = m_last_vblank + 1;
+   }
+   else if (m_has_presented && m_present_mode == VK_PRESENT_MODE_FIFO_RELAXED_KHR && vblank > m_last_vblank + 1)
+   {
+      /* Late, the image tears in as soon as it is ready rather than waiting for the next vblank. */
+      m_last_vblank = vblank - 1;
+      return ready_ns;
+   }
+
+   m_last_vblank = vblank;
+   m_has_presented = true;
+   return get_vblank_time(vblank);
+}
+
+void simulated_display::sleep_until(uint64_t time_ns)
+{
+   timespec deadline;
+   deadline.tv_sec = static_cast<time_t>(time_ns / 1000000000ull);
+   deadline.tv_nsec = static_cast<long>(time_ns % 1000000000ull);
+   while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+   {
+   }
+}
+
+} /* namespace headless */
+} /* namespace wsi */
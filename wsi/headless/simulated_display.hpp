@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file simulated_display.hpp
+ *
+ * @brief Display timing simulated by headless swapchains, to measure the layer's pacing without a display.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+namespace wsi
+{
+namespace headless
+{
+
+/**
+ * @brief Timing of the display simulated for a present mode.
+ */
+struct simulated_display_config
+{
+   /**
+    * @brief Refresh period, 0 when presents are not simulated and complete as soon as they are processed.
+    */
+   uint64_t refresh_ns{ 0 };
+
+   /**
+    * @brief Vblanks are offset by up to this much either way. The offsets only depend on @ref seed, so runs are
+    *        reproducible.
+    */
+   uint64_t jitter_ns{ 0 };
+
+   /**
+    * @brief Time from a present being queued to its image being ready to be shown.
+    */
+   uint64_t compositor_latency_ns{ 0 };
+
+   /**
+    * @brief Time from an image being latched on a vblank to its first pixel being scanned out.
+    */
+   uint64_t scanout_latency_ns{ 0 };
+
+   /**
+    * @brief Time from the first pixel of an image being scanned out to it being visible on the panel.
+    */
+   uint64_t panel_latency_ns{ 0 };
+
+   /**
+    * @brief Time from an image being latched to it being released to the application.
+    */
+   uint64_t release_latency_ns{ 0 };
+
+   uint64_t seed{ 0 };
+
+   /**
+    * @brief Get the configuration of @p present_mode.
+    *
+    * It is read from WSI_HEADLESS_DISPLAY_<MODE>, with MODE one of FIFO, FIFO_RELAXED, MAILBOX or IMMEDIATE, or
+    * else from WSI_HEADLESS_DISPLAY. Both are comma separated key=value lists, with the keys refresh (Hz),
+    * jitter_us, compositor_us, scanout_us, panel_us, release_us and
+    * seed. "off" disables the simulation. Shared present modes are never
+    * simulated.
+    */
+   static simulated_display_config get(VkPresentModeKHR present_mode);
+};
+
+/**
+ * @brief CLOCK_MONOTONIC times of the stages of a present on the simulated display.
+ */
+struct simulated_present
+{
+   uint64_t latched_ns;
+   uint64_t first_pixel_out_ns;
+   uint64_t first_pixel_visible_ns;
+};
+
+/**
+ * @brief Schedules the presents of a swapchain on the vblanks of a simulated display.
+ *
+ * Vblanks are on a CLOCK_MONOTONIC timeline starting when the display is created. FIFO and MAILBOX presents are
+ * shown on the first vblank after their image is ready, at most one per vblank. FIFO_RELAXED presents that missed
+ * the vblank after the previous one are shown as soon as they are ready, as are IMMEDIATE presents. Presents with a
+ * target time are not shown before it.
+ */
+class simulated_display
+{
+public:
+   simulated_display() = default;
+
+   simulated_display(const simulated_display_config &config, VkPresentModeKHR present_mode);
+
+   bool is_enabled() const
+   {
+      return m_config.refresh_ns != 0;
+   }
+
+   const simulated_display_config &get_config() const
+   {
+      return m_config;
+   }
+
+   VkPresentModeKHR get_present_mode() const
+   {
+      return m_present_mode;
+   }
+
+   /**
+    * @brief Switch to the configuration of @p present_mode, keeping the vblank timeline.
+    */
+   void set_present_mode(VkPresentModeKHR present_mode);
+
+   /**
+    * @brief Schedule a present.
+    *
+    * @param queue_time_ns     CLOCK_MONOTONIC time the present was queued.
+    * @param target_visible_ns CLOCK_MONOTONIC time the image should not be visible before, 0 for none.
+    * @return The times of the stages of the present.
+    */
+   simulated_present schedule(uint64_t queue_time_ns, uint64_t target_visible_ns);
+
+   /**
+    * @brief Get the CLOCK_MONOTONIC time the last scheduled present becomes visible, 0 before the first one.
+    */
+   uint64_t get_last_visible_time() const
+   {
+      return m_last_visible_ns;
+   }
+
+   /**
+    * @brief Sleep until CLOCK_MONOTONIC time @p time_ns.
+    */
+   static void sleep_until(uint64_t time_ns);
+
+private:
+   uint64_t get_vblank_time(uint64_t vblank) const;
+
+   /**
+    * @brief Pick the vblank an image ready at @p ready_ns is latched on.
+    *
+    * @return The CLOCK_MONOTONIC latch time.
+    */
+   uint64_t latch_on_vblank(uint64_t ready_ns);
+
+   simulated_display_config m_config{};
+   VkPresentModeKHR m_present_mode{ VK_PRESENT_MODE_FIFO_KHR };
+   uint64_t m_epoch_ns{ 0 };
+
+   /**
+    * @brief Vblank the last present was shown on, or during for presents shown as soon as they are ready.
+    */
+   uint64_t m_last_vblank{ 0 };
+   bool m_has_presented{ false };
+   uint64_t m_last_visible_ns{ 0 };
+};
+
+} /* namespace headless */
+} /* namespace wsi */
@@ -28,12 +28,17 @@
  * @brief Contains the implementation for a headless swapchain.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdlib>
+#include <ctime>
 
 #include "swapchain.hpp"
 
 #include <util/custom_allocator.hpp>
+#include <util/log.hpp>
+#include <util/memory_type_policy.hpp>
 #include <util/timed_semaphore.hpp>
 
 #include <wsi/extensions/present_id.hpp>
@@ -48,11 +53,81 @@ namespace wsi
 namespace headless
 {
 
+/**
+ * @brief Difference between CLOCK_MONOTONIC_RAW and CLOCK_MONOTONIC.
+ */
+static int64_t get_monotonic_raw_offset_ns()
+{
+   timespec monotonic;
+   timespec raw;
+   clock_gettime(CLOCK_MONOTONIC, &monotonic);
+   clock_gettime(CLOCK_MONOTONIC_RAW, &raw);
+   return (static_cast<int64_t>(raw.tv_sec) - monotonic.tv_sec) * 1000000000ll +
+          (static_cast<int64_t>(raw.tv_nsec) - monotonic.tv_nsec);
+}
+
+/**
+ * @brief Device memory the images of a swapchain are suballocated from.
+ *
+ * Referenced by the swapchain filling it and by the images placed in it, so images adopted by a descendant swapchain
+ * keep it alive. The count is atomic as the images of different swapchains are destroyed concurrently.
+ */
+struct image_memory_block
+{
+   image_memory_block(layer::device_private_data &device_data, const util::allocator &allocator)
+      : device_data(device_data)
+      , allocator(allocator)
+   {
+   }
+
+   ~image_memory_block()
+   {
+      if (memory != VK_NULL_HANDLE)
+      {
+         device_data.disp.FreeMemory(device_data.device, memory, allocator.get_original_callbacks());
+      }
+   }
+
+   /**
+    * @brief Take a reference for an image placed in the block.
+    */
+   image_memory_block *acquire()
+   {
+      refcount.fetch_add(1, std::memory_order_relaxed);
+      return this;
+   }
+
+   /**
+    * @brief Drop a reference, freeing the memory and the block with the last one.
+    */
+   void release()
+   {
+      if (refcount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      {
+         /* The block is freed with its own allocator, keep a copy that outlives it. */
+         const util::allocator block_allocator = allocator;
+         block_allocator.destroy(1, this);
+      }
+   }
+
+   layer::device_private_data &device_data;
+   const util::allocator allocator;
+   VkDeviceMemory memory{ VK_NULL_HANDLE };
+   std::atomic<uint32_t> refcount{ 1 };
+};
+
 struct image_data
 {
-   /* Device memory backing the image. */
+   /* Device memory backing the image, owned by the image unless it comes from memory_block. */
    VkDeviceMemory memory{};
+   image_memory_block *memory_block{ nullptr };
+   /* Offset of the image in memory. */
+   VkDeviceSize memory_offset{ 0 };
    fence_sync present_fence;
+   /* Used instead of present_fence when the swapchain has a present timeline. */
+   timeline_sync present_point;
+   /* Capture slot the last present of the image is copied to, -1 when it is not captured. */
+   int capture_slot{ -1 };
 };
 
 swapchain::swapchain(layer::device_private_data &dev_data, const VkAllocationCallbacks *pAllocator)
@@ -64,6 +139,11 @@ swapchain::~swapchain()
 {
    /* Call the base's teardown */
    teardown();
+
+   if (m_memory_block != nullptr)
+   {
+      m_memory_block->release();
+   }
 }
 
 VkResult swapchain::add_required_extensions(VkDevice device, const VkSwapchainCreateInfoKHR *swapchain_create_info)
@@ -105,7 +185,8 @@ VkResult swapchain::add_required_extensions(VkDevice device, const VkSwapchainCr
    bool swapchain_support_enabled = swapchain_create_info->flags & VK_SWAPCHAIN_CREATE_PRESENT_TIMING_BIT_EXT;
    if (swapchain_support_enabled)
    {
-      if (!add_swapchain_extension(wsi_ext_present_timing_headless::create(m_allocator)))
+      const uint64_t refresh_ns = simulated_display_config::get(swapchain_create_info->presentMode).refresh_ns;
+      if (!add_swapchain_extension(wsi_ext_present_timing_headless::create(m_allocator, refresh_ns)))
       {
          return VK_ERROR_OUT_OF_HOST_MEMORY;
       }
@@ -128,6 +209,125 @@ VkResult swapchain::init_platform(VkDevice device, const VkSwapchainCreateInfoKH
       use_presentation_thread = true;
    }
 
+   /* Nothing consumes the payloads of this backend outside of Vulkan, so one timeline semaphore can replace
+    * the per-image fences when the application enabled the feature. */
+   if (m_device_data.is_timeline_semaphore_enabled())
+   {
+      m_present_timeline = timeline_semaphore::create(m_device_data);
+   }
+
+   m_display = simulated_display{ simulated_display_config::get(m_present_mode), m_present_mode };
+
+   /* A shared image is written by the application while it is presented, and refreshed without a payload to copy
+    * it with, so its frames are not captured. */
+   const bool shared_present_mode = m_present_mode == VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR ||
+                                    m_present_mode == VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR;
+   if (frame_capture::is_requested() && shared_present_mode)
+   {
+      WSI_LOG_WARNING("Frames of shared present mode swapchains are not captured.");
+   }
+   else if (frame_capture::is_requested())
+   {
+      if (!frame_capture::is_supported(m_device_data, swapchain_create_info->imageFormat, VK_IMAGE_TILING_OPTIMAL,
+                                       swapchain_create_info->imageUsage) ||
+          m_capture.init(m_device_data, m_allocator, swapchain_create_info->imageFormat,
+                         swapchain_create_info->imageExtent) != VK_SUCCESS)
+      {
+         WSI_LOG_WARNING("Presented frames of the swapchain cannot be captured.");
+      }
+   }
+
+   return VK_SUCCESS;
+}
+
+uint32_t swapchain::find_image_memory_type(uint32_t memory_type_bits)
+{
+   VkPhysicalDeviceMemoryProperties2 memory_props = {};
+   memory_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+   m_device_data.instance_data.disp.GetPhysicalDeviceMemoryProperties2KHR(m_device_data.physical_device,
+                                                                          &memory_props);
+
+   return util::select_memory_type(memory_props.memoryProperties, memory_type_bits, util::memory_access::gpu_only);
+}
+
+bool swapchain::get_image_memory_requirements(VkImage image, VkMemoryRequirements &memory_requirements)
+{
+   auto get_requirements2 = m_device_data.disp.get_GetImageMemoryRequirements2KHR();
+   if (get_requirements2 == nullptr)
+   {
+      m_device_data.disp.GetImageMemoryRequirements(m_device, image, &memory_requirements);
+      return false;
+   }
+
+   VkMemoryDedicatedRequirements dedicated_requirements = {};
+   dedicated_requirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+   VkMemoryRequirements2 requirements = {};
+   requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+   requirements.pNext = &dedicated_requirements;
+   VkImageMemoryRequirementsInfo2 requirements_info = {};
+   requirements_info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+   requirements_info.image = image;
+   get_requirements2(m_device, &requirements_info, &requirements);
+
+   memory_requirements = requirements.memoryRequirements;
+   return dedicated_requirements.requiresDedicatedAllocation;
+}
+
+VkResult swapchain::suballocate_image_memory(const VkMemoryRequirements &memory_requirements,
+                                             uint32_t memory_type_index, image_data &data)
+{
+   const VkDeviceSize stride =
+      (memory_requirements.size + memory_requirements.alignment - 1) & ~(memory_requirements.alignment - 1);
+   if (m_memory_block == nullptr || m_memory_block_used == m_memory_block_slots || stride != m_memory_block_stride)
+   {
+      /* Images without memory yet all need a slot, adopted images keep the block of their swapchain. */
+      uint32_t slots = 0;
+      for (const auto &image : m_swapchain_images)
+      {
+         slots += image.data == nullptr ? 1 : 0;
+      }
+      slots = std::max(slots, 1u);
+
+      if (m_memory_block != nullptr)
+      {
+         m_memory_block->release();
+         m_memory_block = nullptr;
+      }
+      m_memory_block = m_allocator.create<image_memory_block>(1, m_device_data, m_allocator);
+      if (m_memory_block == nullptr)
+      {
+         return VK_ERROR_OUT_OF_HOST_MEMORY;
+      }
+
+      VkMemoryAllocateInfo mem_info = {};
+      mem_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      mem_info.allocationSize = stride * slots;
+      mem_info.memoryTypeIndex = memory_type_index;
+      VkResult res = m_device_data.disp.AllocateMemory(m_device, &mem_info, get_allocation_callbacks(),
+                                                       &m_memory_block->memory);
+      if (res == VK_ERROR_OUT_OF_DEVICE_MEMORY && slots > 1)
+      {
+         /* Fragmented memory may still fit the image on its own. */
+         slots = 1;
+         mem_info.allocationSize = stride;
+         res = m_device_data.disp.AllocateMemory(m_device, &mem_info, get_allocation_callbacks(),
+                                                 &m_memory_block->memory);
+      }
+      if (res != VK_SUCCESS)
+      {
+         m_memory_block->release();
+         m_memory_block = nullptr;
+         return res;
+      }
+
+      m_memory_block_stride = stride;
+      m_memory_block_slots = slots;
+      m_memory_block_used = 0;
+   }
+
+   data.memory = m_memory_block->memory;
+   data.memory_block = m_memory_block->acquire();
+   data.memory_offset = stride * m_memory_block_used++;
    return VK_SUCCESS;
 }
 
@@ -138,45 +338,54 @@ VkResult swapchain::allocate_and_bind_swapchain_image(VkImageCreateInfo image_cr
    const std::lock_guard<std::recursive_mutex> lock(m_image_status_mutex);
 
    VkMemoryRequirements memory_requirements = {};
-   m_device_data.disp.GetImageMemoryRequirements(m_device, image.image, &memory_requirements);
+   const bool dedicated = get_image_memory_requirements(image.image, memory_requirements);
 
-   /* Find a memory type */
-   size_t mem_type_idx = 0;
-   for (; mem_type_idx < 8 * sizeof(memory_requirements.memoryTypeBits); ++mem_type_idx)
+   const uint32_t mem_type_idx = find_image_memory_type(memory_requirements.memoryTypeBits);
+   if (mem_type_idx == VK_MAX_MEMORY_TYPES)
    {
-      if (memory_requirements.memoryTypeBits & (1u << mem_type_idx))
-      {
-         break;
-      }
+      WSI_LOG_ERROR("No memory type for the swapchain images.");
+      m_device_data.disp.DestroyImage(m_device, image.image, get_allocation_callbacks());
+      image.image = VK_NULL_HANDLE;
+      return VK_ERROR_OUT_OF_DEVICE_MEMORY;
    }
 
-   assert(mem_type_idx <= 8 * sizeof(memory_requirements.memoryTypeBits) - 1);
-
-   VkMemoryAllocateInfo mem_info = {};
-   mem_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-   mem_info.allocationSize = memory_requirements.size;
-   mem_info.memoryTypeIndex = mem_type_idx;
-   image_data *data = nullptr;
-
    /* Create image_data */
-   data = m_allocator.create<image_data>(1);
+   image_data *data = m_allocator.create<image_data>(1);
    if (data == nullptr)
    {
       m_device_data.disp.DestroyImage(m_device, image.image, get_allocation_callbacks());
       return VK_ERROR_OUT_OF_HOST_MEMORY;
    }
+
+   if (dedicated)
+   {
+      VkMemoryDedicatedAllocateInfo dedicated_info = {};
+      dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+      dedicated_info.image = image.image;
+
+      VkMemoryAllocateInfo mem_info = {};
+      mem_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      mem_info.pNext = &dedicated_info;
+      mem_info.allocationSize = memory_requirements.size;
+      mem_info.memoryTypeIndex = mem_type_idx;
+      res = m_device_data.disp.AllocateMemory(m_device, &mem_info, get_allocation_callbacks(), &data->memory);
+   }
+   else
+   {
+      /* Checked before image.data is set, so the image still counts as needing a slot. */
+      res = suballocate_image_memory(memory_requirements, mem_type_idx, *data);
+   }
+
    image.data = reinterpret_cast<void *>(data);
-   image.status = wsi::swapchain_image::FREE;
+   set_image_status(image, wsi::swapchain_image::FREE);
 
-   res = m_device_data.disp.AllocateMemory(m_device, &mem_info, get_allocation_callbacks(), &data->memory);
-   assert(VK_SUCCESS == res);
    if (res != VK_SUCCESS)
    {
       destroy_image(image);
       return res;
    }
 
-   res = m_device_data.disp.BindImageMemory(m_device, image.image, data->memory, 0);
+   res = m_device_data.disp.BindImageMemory(m_device, image.image, data->memory, data->memory_offset);
    assert(VK_SUCCESS == res);
    if (res != VK_SUCCESS)
    {
@@ -184,6 +393,12 @@ VkResult swapchain::allocate_and_bind_swapchain_image(VkImageCreateInfo image_cr
       return res;
    }
 
+   if (m_present_timeline.has_value())
+   {
+      data->present_point = timeline_sync{ *m_present_timeline };
+      return res;
+   }
+
    /* Initialize presentation fence. */
    auto present_fence = fence_sync::create(m_device_data);
    if (!present_fence.has_value())
@@ -201,33 +416,97 @@ VkResult swapchain::create_swapchain_image(VkImageCreateInfo image_create_info,
    m_image_create_info = image_create_info;
    VkImageCompressionControlEXT image_compression_control = {};
 
-   if (m_device_data.is_swapchain_compression_control_enabled())
+   /* The extension is only added when the application enabled swapchain compression control and chained a
+    * VkImageCompressionControlEXT, or when the layer picked a fixed-rate compression for it. */
+   auto *ext = get_swapchain_extension<wsi_ext_image_compression_control>();
+   if (ext)
    {
-      auto *ext = get_swapchain_extension<wsi_ext_image_compression_control>();
-      /* For image compression control, additional requirements to be satisfied such as
-       * existence of VkImageCompressionControlEXT in swaphain_create_info for
-       * the ext to be added to the list. So we check whether we got a valid pointer
-       * and proceed if yes. */
-      if (ext)
-      {
-         image_compression_control = ext->get_compression_control_properties();
-         image_compression_control.pNext = m_image_create_info.pNext;
-         m_image_create_info.pNext = &image_compression_control;
-      }
+      image_compression_control = ext->get_compression_control_properties();
+      image_compression_control.pNext = m_image_create_info.pNext;
+      m_image_create_info.pNext = &image_compression_control;
+   }
+   if (m_capture.is_enabled())
+   {
+      m_image_create_info.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
    }
    return m_device_data.disp.CreateImage(m_device, &m_image_create_info, get_allocation_callbacks(), &image.image);
 }
 
 void swapchain::present_image(const pending_present_request &pending_present)
 {
+   /* VK_EXT_swapchain_maintenance1 can switch the present mode with a present. */
+   if (m_display.get_present_mode() != pending_present.present_mode)
+   {
+      m_display.set_present_mode(pending_present.present_mode);
+   }
+
+   /* The present stages are reported in CLOCK_MONOTONIC_RAW, the simulation runs on CLOCK_MONOTONIC. */
+   simulated_present stages = {};
+   int64_t raw_offset_ns = 0;
+   if (m_display.is_enabled())
+   {
+      raw_offset_ns = get_monotonic_raw_offset_ns();
+      const uint64_t target_visible_ns = get_target_visible_time(pending_present, raw_offset_ns);
+      stages = m_display.schedule(pending_present.queue_time_ns, target_visible_ns);
+      simulated_display::sleep_until(stages.latched_ns);
+   }
+
    if (m_device_data.is_present_id_enabled())
    {
       auto *ext = get_swapchain_extension<wsi_ext_present_id>(true);
       ext->set_present_id(pending_present.present_id);
    }
+   m_frame_stats.record(util::frame_stage::queue_to_screen, pending_present.queue_time_ns);
+#if VULKAN_WSI_LAYER_EXPERIMENTAL
+   auto *timing_ext = get_swapchain_extension<wsi_ext_present_timing_headless>();
+   if (timing_ext != nullptr && pending_present.present_id != 0)
+   {
+      if (m_display.is_enabled())
+      {
+         /* The payload completed before the present was processed, its queue operations ended no later than
+          * that. */
+         const uint64_t id = pending_present.present_id;
+         timing_ext->set_stage_time(id, VK_PRESENT_STAGE_QUEUE_OPERATIONS_END_BIT_EXT,
+                                    util::frame_stats::now_ns() + raw_offset_ns);
+         timing_ext->set_stage_time(id, VK_PRESENT_STAGE_IMAGE_LATCHED_BIT_EXT, stages.latched_ns + raw_offset_ns);
+         timing_ext->set_stage_time(id, VK_PRESENT_STAGE_IMAGE_FIRST_PIXEL_OUT_BIT_EXT,
+                                    stages.first_pixel_out_ns + raw_offset_ns);
+         timing_ext->set_stage_time(id, VK_PRESENT_STAGE_IMAGE_FIRST_PIXEL_VISIBLE_BIT_EXT,
+                                    stages.first_pixel_visible_ns + raw_offset_ns);
+      }
+      timing_ext->complete_presentation_entry(pending_present.present_id);
+   }
+#endif
+
+   /* Blocks the next present, whose time on the display only depends on when it was queued. */
+   if (m_display.is_enabled() && m_display.get_config().release_latency_ns != 0)
+   {
+      simulated_display::sleep_until(stages.latched_ns + m_display.get_config().release_latency_ns);
+   }
+   auto *data = reinterpret_cast<image_data *>(m_swapchain_images[pending_present.image_index].data);
+   m_capture.write(data->capture_slot);
+   data->capture_slot = -1;
+
    unpresent_image(pending_present.image_index);
 }
 
+uint64_t swapchain::get_target_visible_time(const pending_present_request &pending_present, int64_t raw_offset_ns)
+{
+   if (pending_present.target_time == 0)
+   {
+      return 0;
+   }
+
+   /* The stage the target is for is not kept with the present, it is taken as the first visible pixel, which all
+    * the other stages precede. */
+   if (pending_present.target_time_relative)
+   {
+      const uint64_t last_visible_ns = m_display.get_last_visible_time();
+      return last_visible_ns != 0 ? last_visible_ns + pending_present.target_time : 0;
+   }
+   return pending_present.target_time - raw_offset_ns;
+}
+
 void swapchain::destroy_image(wsi::swapchain_image &image)
 {
    std::unique_lock<std::recursive_mutex> image_status_lock(m_image_status_mutex);
@@ -239,7 +518,7 @@ void swapchain::destroy_image(wsi::swapchain_image &image)
          image.image = VK_NULL_HANDLE;
       }
 
-      image.status = wsi::swapchain_image::INVALID;
+      set_image_status(image, wsi::swapchain_image::INVALID);
    }
 
    image_status_lock.unlock();
@@ -247,26 +526,82 @@ void swapchain::destroy_image(wsi::swapchain_image &image)
    if (image.data != nullptr)
    {
       auto *data = reinterpret_cast<image_data *>(image.data);
-      if (data->memory != VK_NULL_HANDLE)
+      m_capture.cancel(data->capture_slot);
+      /* Suballocated memory is freed with the last image of its block. */
+      if (data->memory != VK_NULL_HANDLE && data->memory_block == nullptr)
       {
          m_device_data.disp.FreeMemory(m_device, data->memory, get_allocation_callbacks());
-         data->memory = VK_NULL_HANDLE;
+      }
+      data->memory = VK_NULL_HANDLE;
+      if (data->memory_block != nullptr)
+      {
+         data->memory_block->release();
+         data->memory_block = nullptr;
       }
       m_allocator.destroy(1, data);
       image.data = nullptr;
    }
 }
 
+bool swapchain::adopt_ancestor_image(swapchain_base &ancestor, swapchain_image &ancestor_image)
+{
+   auto &headless_ancestor = static_cast<swapchain &>(ancestor);
+   /* Captured images need VK_IMAGE_USAGE_TRANSFER_SRC_BIT and a slot of their own swapchain. */
+   if (m_present_timeline.has_value() != headless_ancestor.m_present_timeline.has_value() ||
+       m_capture.is_enabled() || headless_ancestor.m_capture.is_enabled())
+   {
+      return false;
+   }
+
+   /* The payload has completed, point the image at the timeline of this swapchain. */
+   if (m_present_timeline.has_value())
+   {
+      reinterpret_cast<image_data *>(ancestor_image.data)->present_point = timeline_sync{ *m_present_timeline };
+   }
+   move_image_data_accounting(ancestor, sizeof(image_data));
+   return true;
+}
+
 VkResult swapchain::image_set_present_payload(swapchain_image &image, VkQueue queue,
-                                              const queue_submit_semaphores &semaphores, const void *submission_pnext)
+                                              const queue_submit_semaphores &semaphores, const void *submission_pnext,
+                                              present_batch *batch)
 {
    auto data = reinterpret_cast<image_data *>(image.data);
-   return data->present_fence.set_payload(queue, semaphores, submission_pnext);
+
+   /* A slot still held by the image was copied for a mailbox present that got replaced, that frame was never shown. */
+   m_capture.cancel(data->capture_slot);
+   data->capture_slot = -1;
+
+   int capture_slot = -1;
+   const VkCommandBuffer capture_copy =
+      m_capture.is_enabled() ? m_capture.record_copy(image.image, capture_slot) : VK_NULL_HANDLE;
+
+   VkResult result = VK_SUCCESS;
+   if (m_present_timeline.has_value())
+   {
+      result = data->present_point.set_payload(queue, semaphores, submission_pnext, capture_copy, batch);
+   }
+   else
+   {
+      result = data->present_fence.set_payload(queue, semaphores, submission_pnext, capture_copy, batch);
+   }
+
+   if (result != VK_SUCCESS)
+   {
+      m_capture.cancel(capture_slot);
+      return result;
+   }
+   data->capture_slot = capture_slot;
+   return VK_SUCCESS;
 }
 
 VkResult swapchain::image_wait_present(swapchain_image &image, uint64_t timeout)
 {
    auto data = reinterpret_cast<image_data *>(image.data);
+   if (m_present_timeline.has_value())
+   {
+      return data->present_point.wait_payload(timeout);
+   }
    return data->present_fence.wait_payload(timeout);
 }
 
@@ -276,9 +611,9 @@ VkResult swapchain::bind_swapchain_image(VkDevice &device, const VkBindImageMemo
    auto &device_data = layer::device_private_data::get(device);
 
    const wsi::swapchain_image &swapchain_image = m_swapchain_images[bind_sc_info->imageIndex];
-   VkDeviceMemory memory = reinterpret_cast<image_data *>(swapchain_image.data)->memory;
+   const auto *data = reinterpret_cast<image_data *>(swapchain_image.data);
 
-   return device_data.disp.BindImageMemory(device, bind_image_mem_info->image, memory, 0);
+   return device_data.disp.BindImageMemory(device, bind_image_mem_info->image, data->memory, data->memory_offset);
 }
 
 } /* namespace headless */
@@ -30,23 +30,35 @@
 
 #pragma once
 
+#include <optional>
+
 #include <vulkan/vk_icd.h>
 #include <vulkan/vulkan.h>
 
 #include <wsi/swapchain_base.hpp>
 
+#include "frame_capture.hpp"
+#include "simulated_display.hpp"
+
 namespace wsi
 {
 namespace headless
 {
+
+struct image_data;
+struct image_memory_block;
+
 /**
  * @brief Headless swapchain class.
  *
  * This class is mostly empty, because all the swapchain stuff is handled by the swapchain class,
  * which we inherit. This class only provides a way to create an image and page-flip ops.
  */
-class swapchain : public wsi::swapchain_base
+class swapchain final : public wsi::swapchain_base
 {
+   /* Calls the present path directly when the layer is built with this backend only, see backend_swapchain.hpp. */
+   friend class wsi::swapchain_base;
+
 public:
    explicit swapchain(layer::device_private_data &dev_data, const VkAllocationCallbacks *pAllocator);
 
@@ -108,7 +120,7 @@ protected:
     * @return VK_SUCCESS on success or an error code otherwise.
     */
    VkResult image_set_present_payload(swapchain_image &image, VkQueue queue, const queue_submit_semaphores &semaphores,
-                                      const void *submission_pnext) override;
+                                      const void *submission_pnext, present_batch *batch) override;
 
    VkResult image_wait_present(swapchain_image &image, uint64_t timeout) override;
 
@@ -125,6 +137,11 @@ protected:
    VkResult bind_swapchain_image(VkDevice &device, const VkBindImageMemoryInfo *bind_image_mem_info,
                                  const VkBindImageMemorySwapchainInfoKHR *bind_sc_info) override;
 
+   /**
+    * @brief Take over the memory and present synchronization of an image of the swapchain being replaced.
+    */
+   bool adopt_ancestor_image(swapchain_base &ancestor, swapchain_image &ancestor_image) override;
+
 private:
    /**
     * @brief Adds required extensions to the extension list of the swapchain
@@ -134,6 +151,60 @@ private:
     * @return VK_SUCCESS on success, other result codes on failure
     */
    VkResult add_required_extensions(VkDevice device, const VkSwapchainCreateInfoKHR *swapchain_create_info) override;
+
+   /**
+    * @brief Find the memory type images are best placed in, preferring device local memory.
+    *
+    * @return The index of the memory type, VK_MAX_MEMORY_TYPES when none of @p memory_type_bits can be used.
+    */
+   uint32_t find_image_memory_type(uint32_t memory_type_bits);
+
+   /**
+    * @brief Get the memory requirements of @p image.
+    *
+    * @return Whether the image requires a dedicated allocation.
+    */
+   bool get_image_memory_requirements(VkImage image, VkMemoryRequirements &memory_requirements);
+
+   /**
+    * @brief Get the CLOCK_MONOTONIC time the image of @p pending_present should not be visible before, 0 for none.
+    *
+    * @param raw_offset_ns Difference between CLOCK_MONOTONIC_RAW, the time domain of the targets, and
+    *                      CLOCK_MONOTONIC.
+    */
+   uint64_t get_target_visible_time(const pending_present_request &pending_present, int64_t raw_offset_ns);
+
+   /**
+    * @brief Place an image in the memory block of the swapchain, allocating a block sized for all the images
+    *        still without memory when there is none or it is full.
+    */
+   VkResult suballocate_image_memory(const VkMemoryRequirements &memory_requirements, uint32_t memory_type_index,
+                                     image_data &data);
+
+   /**
+    * @brief Timeline semaphore signalled by the present payloads of all the images, when timeline semaphores are
+    *        enabled on the device.
+    */
+   std::optional<timeline_semaphore> m_present_timeline;
+
+   /**
+    * @brief Display the presents are shown on, disabled unless configured, see @ref simulated_display_config::get.
+    */
+   simulated_display m_display;
+
+   /**
+    * @brief Writes the presented frames to disk when WSI_HEADLESS_CAPTURE is set, see @ref frame_capture.
+    */
+   frame_capture m_capture;
+
+   /**
+    * @brief Block the next images are suballocated from, with room for @ref m_memory_block_slots images
+    *        @ref m_memory_block_stride bytes apart. Holds a reference to the block.
+    */
+   image_memory_block *m_memory_block{ nullptr };
+   VkDeviceSize m_memory_block_stride{ 0 };
+   uint32_t m_memory_block_slots{ 0 };
+   uint32_t m_memory_block_used{ 0 };
 };
 
 } /* namespace headless */
@@ -22,8 +22,12 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+
 #include "surface_properties.hpp"
 #include "layer/private_data.hpp"
+#include "util/format_modifiers.hpp"
+#include "util/tuning_profile.hpp"
 
 namespace wsi
 {
@@ -33,17 +37,12 @@ VkResult surface_format_properties::check_device_support(VkPhysicalDevice phys_d
 {
    VkImageFormatProperties2KHR image_format_props = { VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2_KHR, nullptr, {} };
 
-   auto &instance_data = layer::instance_private_data::get(phys_dev);
-
-   return instance_data.disp.GetPhysicalDeviceImageFormatProperties2KHR(phys_dev, &image_format_info,
-                                                                        &image_format_props);
+   return util::get_image_format_properties(phys_dev, image_format_info, image_format_props);
 }
 
 VkResult surface_format_properties::add_device_compression_support(
    VkPhysicalDevice phys_dev, VkPhysicalDeviceImageFormatInfo2KHR image_format_info)
 {
-   auto &instance_data = layer::instance_private_data::get(phys_dev);
-
    VkImageCompressionPropertiesEXT compression_props = { VK_STRUCTURE_TYPE_IMAGE_COMPRESSION_PROPERTIES_EXT, nullptr, 0,
                                                          0 };
    VkImageFormatProperties2KHR image_format_props{ VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2_KHR,
@@ -55,8 +54,7 @@ VkResult surface_format_properties::add_device_compression_support(
                                                      VK_IMAGE_COMPRESSION_FIXED_RATE_DEFAULT_EXT, 0, nullptr };
    image_format_info.pNext = &compression_control;
 
-   VkResult res =
-      instance_data.disp.GetPhysicalDeviceImageFormatProperties2KHR(phys_dev, &image_format_info, &image_format_props);
+   VkResult res = util::get_image_format_properties(phys_dev, image_format_info, image_format_props);
    if (res == VK_SUCCESS)
    {
       m_compression.imageCompressionFlags |= compression_props.imageCompressionFlags;
@@ -98,7 +96,8 @@ void get_surface_capabilities_common(VkPhysicalDevice physical_device, VkSurface
 {
    /* Image count limits */
    surface_capabilities->minImageCount = 1;
-   surface_capabilities->maxImageCount = surface_properties::MAX_SWAPCHAIN_IMAGE_COUNT;
+   surface_capabilities->maxImageCount =
+      std::min(surface_properties::MAX_SWAPCHAIN_IMAGE_COUNT, util::tuning_profile::get().max_swapchain_images);
 
    /* Surface extents */
    surface_capabilities->currentExtent = { 0xffffffff, 0xffffffff };
@@ -31,20 +31,28 @@
  * that is not specific to how images are created or presented.
  */
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cerrno>
 #include <cstdio>
+#include <chrono>
 #include <cstdlib>
+#include <ctime>
 #include <system_error>
 
 #include <unistd.h>
 #include <vulkan/vulkan.h>
 
 #include "util/log.hpp"
+#include "util/trace.hpp"
 #include "util/helpers.hpp"
+#include "util/thread_scheduling.hpp"
+#include "util/tuning_profile.hpp"
 
 #include "swapchain_base.hpp"
+#include "backend_swapchain.hpp"
+#include "sync_fd_waiter.hpp"
 #include "wsi_factory.hpp"
 
 #include "extensions/present_timing.hpp"
@@ -53,77 +61,370 @@
 namespace wsi
 {
 
+/* Acquires in a row waiting for the adaptive frames in flight limit before it is lowered, and not waiting before it
+ * is raised. The lowering window doubles on each raise, up to frames_in_flight_max_backoff times. */
+static constexpr uint32_t frames_in_flight_lower_after = 60;
+static constexpr uint32_t frames_in_flight_raise_after = 8;
+static constexpr uint32_t frames_in_flight_max_backoff = 32;
+
+/* Presents timed before the just-in-time acquire trusts its estimate of the render time. */
+static constexpr uint32_t jit_acquire_min_samples = 8;
+
+void present_damage::set(const VkPresentRegionKHR &region)
+{
+   rect_count = 0;
+   unchanged = false;
+   if (region.pRectangles == nullptr)
+   {
+      return;
+   }
+
+   VkRect2D bounds = {};
+   bool overflow = false;
+   bool all_empty = region.rectangleCount > 0;
+   for (uint32_t i = 0; i < region.rectangleCount; i++)
+   {
+      const VkRectLayerKHR &rect = region.pRectangles[i];
+      if (rect.extent.width == 0 || rect.extent.height == 0)
+      {
+         continue;
+      }
+      all_empty = false;
+      if (rect.layer != 0)
+      {
+         continue;
+      }
+
+      VkRect2D rect2d = { rect.offset, rect.extent };
+      if (rect_count == 0 && !overflow)
+      {
+         bounds = rect2d;
+      }
+      else
+      {
+         const int32_t x1 = std::max(bounds.offset.x + static_cast<int32_t>(bounds.extent.width),
+                                     rect.offset.x + static_cast<int32_t>(rect.extent.width));
+         const int32_t y1 = std::max(bounds.offset.y + static_cast<int32_t>(bounds.extent.height),
+                                     rect.offset.y + static_cast<int32_t>(rect.extent.height));
+         bounds.offset.x = std::min(bounds.offset.x, rect.offset.x);
+         bounds.offset.y = std::min(bounds.offset.y, rect.offset.y);
+         bounds.extent.width = static_cast<uint32_t>(x1 - bounds.offset.x);
+         bounds.extent.height = static_cast<uint32_t>(y1 - bounds.offset.y);
+      }
+
+      if (rect_count < MAX_RECTS && !overflow)
+      {
+         rects[rect_count++] = rect2d;
+      }
+      else
+      {
+         overflow = true;
+      }
+   }
+
+   if (overflow)
+   {
+      rects[0] = bounds;
+      rect_count = 1;
+   }
+   unchanged = all_empty;
+}
+
 void swapchain_base::page_flip_thread()
 {
    auto &sc_images = m_swapchain_images;
    VkResult vk_res = VK_SUCCESS;
-   uint64_t timeout = UINT64_MAX;
-   constexpr uint64_t SEMAPHORE_TIMEOUT = 250000000; /* 250 ms. */
+   /* Payload waits are sliced, so a payload whose submission failed does not block the thread forever. */
+   const uint64_t timeout = 1000000000;
+
+   util::configure_presentation_thread("wsi-page-flip");
 
    /* No mutex is needed for the accesses to m_page_flip_thread_run variable as after the variable is
     * initialized it is only ever changed to false. The while loop will make the thread read the
-    * value repeatedly, and the combination of semaphores and thread joins will force any changes to
-    * the variable to be visible to this thread.
+    * value repeatedly, and closing the pending buffer pool in teardown wakes the thread up to see it.
     */
    while (m_page_flip_thread_run)
    {
       pending_present_request submit_info{};
       if (m_present_mode == VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR)
       {
-         /* In continuous mode the application will only make one presentation request,
-          * therefore the page flip semaphore will only be signalled once. */
-         if (!m_first_present)
-         {
-            vk_res = VK_SUCCESS;
-         }
-         else if ((vk_res = m_page_flip_semaphore.wait(SEMAPHORE_TIMEOUT)) == VK_TIMEOUT)
+         /* In continuous mode the application only has to make one presentation request, the image is refreshed
+          * on every iteration after it. Later requests are still taken for their damage and present IDs. */
+         vk_res = m_pending_buffer_pool.wait(m_first_present ? UINT64_MAX : 0);
+         if (vk_res == VK_TIMEOUT)
          {
-            /* Image is not ready yet. */
+            /* Woken up without an image, the swapchain may be tearing down. */
             continue;
          }
-         assert(vk_res == VK_SUCCESS);
 
-         /* For continuous mode there will be only one image in the swapchain.
-          * This image will always be used, and there is no pending state in this case. */
-         submit_info.image_index = 0;
+         if (vk_res == VK_SUCCESS)
+         {
+            auto pending_submission = m_pending_buffer_pool.pop();
+            assert(pending_submission.has_value());
+            submit_info = *pending_submission;
+            if (m_pending_ring_overflowed.exchange(false))
+            {
+               submit_info.damage = present_damage{};
+            }
+         }
+         else
+         {
+            /* For continuous mode there will be only one image in the swapchain.
+             * This image will always be used, and there is no pending state in this case. */
+            submit_info.image_index = 0;
+            submit_info.present_mode = m_present_mode;
+            submit_info.refresh = true;
+         }
       }
       else
       {
-         /* Waiting for the page_flip_semaphore which will be signalled once there is an
-          * image to display.*/
-         if ((vk_res = m_page_flip_semaphore.wait(SEMAPHORE_TIMEOUT)) == VK_TIMEOUT)
+         /* Waiting for the pending buffer pool to receive an image to display. */
+         if ((vk_res = m_pending_buffer_pool.wait(UINT64_MAX)) == VK_TIMEOUT)
          {
-            /* Image is not ready yet. */
+            /* Woken up without an image, the swapchain may be tearing down. */
             continue;
          }
 
-         /* We want to present the oldest queued for present image from our present queue,
-          * which we can find at the sc->pending_buffer_pool.head index. */
-         std::unique_lock<std::recursive_mutex> image_status_lock(m_image_status_mutex);
+         wait_for_present_slot();
 
-         auto pending_submission = m_pending_buffer_pool.pop_front();
+         /* We want to present the oldest queued for present image from our present queue. The pool is a
+          * single-producer/single-consumer ring, popping it does not take m_image_status_mutex. */
+         auto pending_submission = m_pending_buffer_pool.pop();
          assert(pending_submission.has_value());
          submit_info = *pending_submission;
+         if (m_pending_ring_overflowed.exchange(false))
+         {
+            /* A later present of the image was dropped, see push_pending_present. */
+            submit_info.damage = present_damage{};
+         }
+
+         if (m_mailbox_slot_enabled)
+         {
+            /* In mailbox mode the popped request only wakes the thread up, present the latest frame instead. */
+            submit_info = take_mailbox_present();
+         }
       }
 
-      /* We may need to wait for the payload of the present sync of the oldest pending image to be finished. */
-      while ((vk_res = image_wait_present(sc_images[submit_info.image_index], timeout)) == VK_TIMEOUT)
+      /* We may need to wait for the payload of the present sync of the oldest pending image to be finished.
+       * Refreshes have no payload of their own, the one of the last request was waited for when it was taken. */
+      if (!presents_wait_for_payload() && !submit_info.refresh)
       {
-         WSI_LOG_WARNING("Timeout waiting for image's present fences, retrying..");
+         WSI_TRACE_SCOPE_ID("present_fence_wait", submit_info.present_id);
+         const uint64_t wait_start_ns = util::frame_stats::now_ns();
+         while ((vk_res = WSI_BACKEND_CALL(*this, image_wait_present)(sc_images[submit_info.image_index], timeout)) ==
+                VK_TIMEOUT)
+         {
+            if (m_payloads_abandoned.load())
+            {
+               vk_res = get_error_state();
+               break;
+            }
+            WSI_LOG_WARNING("Timeout waiting for image's present fences, retrying..");
+         }
+         m_frame_stats.record(util::frame_stage::present_fence_wait, wait_start_ns);
+         if (vk_res != VK_SUCCESS)
+         {
+            set_error_state(vk_res);
+            signal_present_fence(submit_info);
+            m_free_image_semaphore.post();
+            continue;
+         }
       }
-      if (vk_res != VK_SUCCESS)
+
+      /* Presents with a target time are handed over one refresh before the vblank they should show on. */
+      if (submit_info.target_time != 0)
       {
-         set_error_state(vk_res);
-         m_free_image_semaphore.post();
-         continue;
+         hold_present(get_present_release_time(submit_info));
       }
 
       call_present(submit_info);
    }
 }
 
+void swapchain_base::hold_present(uint64_t release_ns)
+{
+   WSI_TRACE_SCOPE("hold_present");
+   /* Slept in slices, so tearing down a swapchain does not wait for a target far ahead. */
+   constexpr uint64_t max_sleep_ns = 100000000;
+   while (m_page_flip_thread_run)
+   {
+      const uint64_t now_ns = util::frame_stats::now_ns();
+      if (now_ns >= release_ns)
+      {
+         break;
+      }
+
+      const uint64_t wake_ns = std::min(release_ns, now_ns + max_sleep_ns);
+      timespec wake_time;
+      wake_time.tv_sec = static_cast<time_t>(wake_ns / 1000000000ull);
+      wake_time.tv_nsec = static_cast<long>(wake_ns % 1000000000ull);
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_time, nullptr);
+   }
+}
+
+void swapchain_base::complete_hidden_present(const pending_present_request &pending_present)
+{
+   WSI_TRACE_SCOPE_ID("hidden_present", pending_present.present_id);
+   const uint64_t interval_ns = uint64_t{ util::tuning_profile::get().hidden_present_interval_ms } * 1000000;
+   const uint64_t release_ns = m_last_hidden_present_ns + interval_ns;
+   if (release_ns > util::frame_stats::now_ns())
+   {
+      timespec wake_time;
+      wake_time.tv_sec = static_cast<time_t>(release_ns / 1000000000ull);
+      wake_time.tv_nsec = static_cast<long>(release_ns % 1000000000ull);
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_time, nullptr) == EINTR)
+      {
+      }
+   }
+   m_last_hidden_present_ns = util::frame_stats::now_ns();
+
+   if (m_device_data.is_present_id_enabled())
+   {
+      auto *ext = get_swapchain_extension<wsi_ext_present_id>(true);
+      ext->set_present_id(pending_present.present_id);
+   }
+#if VULKAN_WSI_LAYER_EXPERIMENTAL
+   auto *timing_ext = get_swapchain_extension<wsi_ext_present_timing>();
+   if (timing_ext != nullptr && pending_present.present_id != 0)
+   {
+      timing_ext->complete_presentation_entry(pending_present.present_id);
+   }
+#endif
+
+   unpresent_image(pending_present.image_index);
+}
+
+void swapchain_base::delay_acquire(uint64_t acquire_start_ns, uint64_t timeout)
+{
+   uint64_t vblank_ns = 0;
+   uint64_t refresh_ns = 0;
+   if (m_render_time_samples.load(std::memory_order_relaxed) < jit_acquire_min_samples ||
+       !get_vblank_timing(&vblank_ns, &refresh_ns) || refresh_ns == 0)
+   {
+      return;
+   }
+
+   /* Most frames take less than the average and two mean deviations, which is what rendering is given. */
+   const uint64_t lead_ns = m_render_time_ns.load(std::memory_order_relaxed) +
+                            2 * m_render_time_dev_ns.load(std::memory_order_relaxed) +
+                            uint64_t{ util::tuning_profile::get().jit_acquire_margin_us } * 1000;
+
+   /* Aim for the first vblank the frame still makes when rendering starts now, and start as late as it allows. This
+    * is less than a refresh away. */
+   const uint64_t now_ns = util::frame_stats::now_ns();
+   const uint64_t ready_ns = now_ns + lead_ns;
+   const uint64_t refreshes = ready_ns > vblank_ns ? (ready_ns - vblank_ns + refresh_ns - 1) / refresh_ns : 0;
+   uint64_t start_ns = vblank_ns + refreshes * refresh_ns - lead_ns;
+
+   if (timeout != UINT64_MAX)
+   {
+      start_ns = std::min(start_ns, acquire_start_ns + timeout);
+   }
+   if (start_ns <= now_ns)
+   {
+      return;
+   }
+
+   WSI_TRACE_SCOPE("jit_acquire_delay");
+   timespec wake_time;
+   wake_time.tv_sec = static_cast<time_t>(start_ns / 1000000000ull);
+   wake_time.tv_nsec = static_cast<long>(start_ns % 1000000000ull);
+   while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_time, nullptr) == EINTR)
+   {
+   }
+}
+
+void swapchain_base::record_render_time(const pending_present_request &pending_present, uint64_t present_ns)
+{
+   /* Backends whose presentation engine waits for the payload are handed the image before the GPU is done, the time
+    * to the present would only cover the CPU side of the frame. */
+   if (presents_wait_for_payload())
+   {
+      return;
+   }
+
+   const uint64_t acquire_ns = m_acquire_return_ns[pending_present.image_index];
+   if (acquire_ns == 0 || present_ns < acquire_ns)
+   {
+      return;
+   }
+
+   /* Only the presenting thread writes the estimate. */
+   const auto sample = static_cast<int64_t>(present_ns - acquire_ns);
+   const auto mean = static_cast<int64_t>(m_render_time_ns.load(std::memory_order_relaxed));
+   const auto dev = static_cast<int64_t>(m_render_time_dev_ns.load(std::memory_order_relaxed));
+   if (m_render_time_samples.load(std::memory_order_relaxed) == 0)
+   {
+      m_render_time_ns.store(static_cast<uint64_t>(sample), std::memory_order_relaxed);
+   }
+   else
+   {
+      m_render_time_ns.store(static_cast<uint64_t>(mean + (sample - mean) / 8), std::memory_order_relaxed);
+      m_render_time_dev_ns.store(static_cast<uint64_t>(dev + (std::abs(sample - mean) - dev) / 8),
+                                 std::memory_order_relaxed);
+   }
+   m_render_time_samples.fetch_add(1, std::memory_order_relaxed);
+}
+
+void swapchain_base::signal_present_fence(const pending_present_request &pending_present)
+{
+   if (pending_present.present_fence == VK_NULL_HANDLE)
+   {
+      return;
+   }
+
+   const queue_submit_semaphores semaphores = {
+      &m_swapchain_images[pending_present.image_index].present_fence_wait, 1, nullptr, 0
+   };
+   m_present_fences_on_layer_queue = true;
+   std::lock_guard<std::mutex> queue_lock(m_device_data.get_layer_queue_lock());
+   VkResult res = sync_queue_submit(m_device_data, m_queue, pending_present.present_fence, semaphores, nullptr);
+   if (res != VK_SUCCESS)
+   {
+      WSI_LOG_ERROR("Failed to signal a present fence.");
+      set_error_state(res);
+   }
+}
+
+uint64_t swapchain_base::get_target_refresh_count(uint64_t vblank_ns, uint64_t refresh_ns, uint64_t target_ns,
+                                                  bool nearest)
+{
+   assert(refresh_ns != 0);
+   uint64_t count = 0;
+   if (target_ns > vblank_ns)
+   {
+      /* Without presentAtNearestRefreshCycle the present must not show before its target. */
+      count = (target_ns - vblank_ns + (nearest ? refresh_ns / 2 : refresh_ns - 1)) / refresh_ns;
+   }
+
+   const uint64_t now_ns = util::frame_stats::now_ns();
+   const uint64_t next_count = now_ns >= vblank_ns ? (now_ns - vblank_ns) / refresh_ns + 1 : 0;
+   return std::max(count, next_count);
+}
+
+uint64_t swapchain_base::get_release_time_for_refresh(uint64_t vblank_ns, uint64_t refresh_ns, uint64_t refresh_count)
+{
+   if (refresh_count == 0)
+   {
+      return 0;
+   }
+   /* A quarter of a refresh after the previous vblank by default, so a late wake up still makes the target vblank and
+    * an early one does not make the previous vblank. */
+   const uint64_t margin_ns = refresh_ns * util::tuning_profile::get().present_release_margin_percent / 100;
+   return vblank_ns + (refresh_count - 1) * refresh_ns + margin_ns;
+}
+
 void swapchain_base::call_present(const pending_present_request &pending_present)
 {
+   WSI_TRACE_SCOPE_ID("backend_present", pending_present.present_id);
+   const uint64_t present_start_ns = util::frame_stats::now_ns();
+
+   /* Held presents and refreshes would count their wait as rendering. */
+   if (m_jit_acquire && pending_present.target_time == 0 && !pending_present.refresh)
+   {
+      record_render_time(pending_present, present_start_ns);
+   }
+
    /* First present of the swapchain. If it has an ancestor, wait until all the
     * pending buffers from the ancestor have been presented. */
    if (m_first_present)
@@ -136,17 +437,153 @@ void swapchain_base::call_present(const pending_present_request &pending_present
 
       sem_post(&m_start_present_semaphore);
 
-      present_image(pending_present);
+      WSI_BACKEND_CALL(*this, present_image)(pending_present);
 
       m_first_present = false;
    }
    /* The swapchain has already started presenting. */
    else
    {
-      present_image(pending_present);
+      WSI_BACKEND_CALL(*this, present_image)(pending_present);
+   }
+
+   m_frame_stats.record(util::frame_stage::backend_present, present_start_ns);
+   WSI_TRACE_ASYNC_END("present", pending_present.present_id);
+   signal_present_fence(pending_present);
+   if (m_frame_stats.dump_if_due(this))
+   {
+      m_device_data.get_allocation_stats().dump(m_device);
+      if (util::memory_accounting::is_enabled())
+      {
+         m_memory_accounting.dump("swapchain", this);
+         m_device_data.get_memory_accounting().dump("device", m_device);
+         m_device_data.instance_data.get_memory_accounting().dump("instance", &m_device_data.instance_data);
+      }
+   }
+}
+
+void swapchain_base::post_to_mailbox(const pending_present_request &pending_present)
+{
+   std::optional<pending_present_request> replaced;
+   {
+      std::lock_guard<std::mutex> lock(m_mailbox_mutex);
+      replaced = m_mailbox_slot;
+      m_mailbox_slot = pending_present;
+
+      /* The replaced present never reaches the screen, what it changed has to be shown by this one. */
+      if (replaced.has_value() && !replaced->damage.unchanged)
+      {
+         if (pending_present.damage.unchanged)
+         {
+            m_mailbox_slot->damage = replaced->damage;
+         }
+         else if (!pending_present.damage.is_full())
+         {
+            m_mailbox_slot->damage = present_damage{};
+         }
+      }
+   }
+
+   if (!replaced.has_value())
+   {
+      /* The page flip thread empties the slot after popping, so the ring never holds more than one request. */
+      push_pending_present(pending_present);
+      return;
+   }
+
+   WSI_TRACE_ASYNC_END("present", replaced->present_id);
+   signal_present_fence(*replaced);
+
+   /* The replaced image is never presented. Free it without waiting when its rendering is done, so acquire can
+    * hand it out again, otherwise leave the wait to the page flip thread. */
+   if (WSI_BACKEND_CALL(*this, image_wait_present)(m_swapchain_images[replaced->image_index], 0) == VK_SUCCESS)
+   {
+      unpresent_image(replaced->image_index);
+      return;
+   }
+
+   /* Otherwise the waiter thread frees it as soon as it completes, rather than the page flip thread waiting for it
+    * before the next present, behind images the GPU may finish later. */
+   auto payload_fd = image_export_present_payload(m_swapchain_images[replaced->image_index]);
+   if (payload_fd.has_value())
+   {
+      sync_fd_waiter::get_instance().watch(std::move(*payload_fd), this, replaced->image_index,
+                                           on_replaced_image_complete);
+      return;
+   }
+
+   std::lock_guard<std::mutex> lock(m_mailbox_mutex);
+   m_dropped_mailbox_images |= 1u << replaced->image_index;
+}
+
+void swapchain_base::push_pending_present(const pending_present_request &pending_present)
+{
+   if (m_pending_buffer_pool.push(pending_present))
+   {
+      return;
+   }
+
+   /* Only a shared image can be presented again before the page flip thread took its previous present, so only the
+    * shared present modes fill the ring. The next present taken then covers the whole image, to show what the
+    * dropped one changed. The flag is set before pushing again in case the ring drained in between. */
+   m_pending_ring_overflowed.store(true);
+   if (m_pending_buffer_pool.push(pending_present))
+   {
+      return;
+   }
+
+   WSI_LOG_WARNING("Presentation queue full, dropping a present of image %u", pending_present.image_index);
+   WSI_TRACE_ASYNC_END("present", pending_present.present_id);
+   signal_present_fence(pending_present);
+
+   const bool shared_present_mode = m_present_mode == VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR ||
+                                    m_present_mode == VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR;
+   if (!shared_present_mode)
+   {
+      /* The image will not be presented, it is released once its rendering is done. */
+      while (WSI_BACKEND_CALL(*this, image_wait_present)(m_swapchain_images[pending_present.image_index],
+                                                         UINT64_MAX) == VK_TIMEOUT)
+      {
+      }
+      unpresent_image(pending_present.image_index);
    }
 }
 
+void swapchain_base::abandon_present_payloads(VkResult error)
+{
+   /* The error is set first, the page flip thread reports it once it sees the flag. */
+   set_error_state(error);
+   m_payloads_abandoned.store(true);
+}
+
+void swapchain_base::on_replaced_image_complete(void *swapchain, uint32_t image_index)
+{
+   static_cast<swapchain_base *>(swapchain)->unpresent_image(image_index);
+}
+
+pending_present_request swapchain_base::take_mailbox_present()
+{
+   std::unique_lock<std::mutex> lock(m_mailbox_mutex);
+   assert(m_mailbox_slot.has_value());
+   pending_present_request latest = *m_mailbox_slot;
+   m_mailbox_slot.reset();
+   uint32_t dropped = m_dropped_mailbox_images;
+   m_dropped_mailbox_images = 0;
+   lock.unlock();
+
+   for (; dropped != 0; dropped &= dropped - 1)
+   {
+      const uint32_t index = static_cast<uint32_t>(__builtin_ctz(dropped));
+      while (image_wait_present(m_swapchain_images[index], UINT64_MAX) == VK_TIMEOUT)
+      {
+         WSI_LOG_WARNING("Timeout waiting for replaced image's present fences, retrying..");
+      }
+      unpresent_image(index);
+   }
+
+   return latest;
+}
+
 bool swapchain_base::has_descendant_started_presenting()
 {
    if (m_descendant == VK_NULL_HANDLE)
@@ -161,7 +598,6 @@ bool swapchain_base::has_descendant_started_presenting()
 VkResult swapchain_base::init_page_flip_thread()
 {
    /* Setup semaphore for signaling pageflip thread */
-   TRY_LOG_CALL(m_page_flip_semaphore.init(0));
    m_thread_sem_defined = true;
 
    /* Launch page flipping thread */
@@ -183,22 +619,17 @@ VkResult swapchain_base::init_page_flip_thread()
 
 void swapchain_base::unpresent_image(uint32_t presented_index)
 {
-   std::unique_lock<std::recursive_mutex> image_status_lock(m_image_status_mutex);
-
-   if (m_present_mode == VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR ||
-       m_present_mode == VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR)
-   {
-      m_swapchain_images[presented_index].status = swapchain_image::ACQUIRED;
-   }
-   else
-   {
-      m_swapchain_images[presented_index].status = swapchain_image::FREE;
-   }
+   WSI_TRACE_SCOPE_ID("release_image", presented_index);
+   const bool shared_present_mode = m_present_mode == VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR ||
+                                    m_present_mode == VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR;
+   const auto released_status = shared_present_mode ? swapchain_image::ACQUIRED : swapchain_image::FREE;
 
-   image_status_lock.unlock();
+   const auto previous = replace_image_status(m_swapchain_images[presented_index], released_status);
+   assert(previous == swapchain_image::ACQUIRED || previous == swapchain_image::PENDING ||
+          previous == swapchain_image::PRESENTED);
+   UNUSED(previous);
 
-   if (m_present_mode != VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR &&
-       m_present_mode != VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR)
+   if (!shared_present_mode)
    {
       m_free_image_semaphore.post();
    }
@@ -211,7 +642,8 @@ swapchain_base::swapchain_base(layer::device_private_data &dev_data, const VkAll
    , m_thread_sem_defined(false)
    , m_first_present(true)
    , m_pending_buffer_pool()
-   , m_allocator(dev_data.get_allocator(), VK_SYSTEM_ALLOCATION_SCOPE_OBJECT, callbacks)
+   , m_allocator(dev_data.get_allocator(), VK_SYSTEM_ALLOCATION_SCOPE_OBJECT, callbacks,
+                 util::memory_accounting::is_enabled() ? &m_memory_accounting : nullptr)
    , m_swapchain_images(m_allocator)
    , m_surface(VK_NULL_HANDLE)
    , m_present_mode(VK_PRESENT_MODE_IMMEDIATE_KHR)
@@ -238,6 +670,18 @@ VkResult swapchain_base::init(VkDevice device, const VkSwapchainCreateInfoKHR *s
    m_surface = swapchain_create_info->surface;
    m_present_mode = swapchain_create_info->presentMode;
 
+   /* The image of the shared present modes stays in flight while the application renders to it. */
+   if (m_present_mode != VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR &&
+       m_present_mode != VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR)
+   {
+      const util::tuning_profile &profile = util::tuning_profile::get();
+      m_max_frames_in_flight = profile.max_frames_in_flight;
+      m_frames_in_flight_limit = m_max_frames_in_flight;
+      m_adaptive_frames_in_flight = profile.adaptive_frames_in_flight != 0;
+      m_frames_in_flight_lower_after = frames_in_flight_lower_after;
+      m_jit_acquire = profile.jit_acquire != 0;
+   }
+
    /* Register required extensions by the swapchain */
    TRY_LOG_CALL(add_required_extensions(device, swapchain_create_info));
 
@@ -290,17 +734,60 @@ VkResult swapchain_base::init(VkDevice device, const VkSwapchainCreateInfoKHR *s
 
    const bool image_deferred_allocation =
       swapchain_create_info->flags & VK_SWAPCHAIN_CREATE_DEFERRED_MEMORY_ALLOCATION_BIT_EXT;
-   for (auto &img : m_swapchain_images)
+
+   /* Deferred allocation does not change the images, only when they get memory. */
+   m_image_compatibility.format = swapchain_create_info->imageFormat;
+   m_image_compatibility.extent = swapchain_create_info->imageExtent;
+   m_image_compatibility.array_layers = swapchain_create_info->imageArrayLayers;
+   m_image_compatibility.usage = swapchain_create_info->imageUsage;
+   m_image_compatibility.flags =
+      swapchain_create_info->flags & ~VK_SWAPCHAIN_CREATE_DEFERRED_MEMORY_ALLOCATION_BIT_EXT;
+   m_image_compatibility.adoptable =
+      swapchain_create_info->imageSharingMode == VK_SHARING_MODE_EXCLUSIVE &&
+      util::find_extension<VkImageFormatListCreateInfo>(VK_STRUCTURE_TYPE_IMAGE_FORMAT_LIST_CREATE_INFO,
+                                                        swapchain_create_info->pNext) == nullptr &&
+      util::find_extension<VkImageCompressionControlEXT>(VK_STRUCTURE_TYPE_IMAGE_COMPRESSION_CONTROL_EXT,
+                                                         swapchain_create_info->pNext) == nullptr;
+
+   /* Recreating a swapchain with the same images, for example to switch present mode, takes over the ancestor's
+    * FREE images rather than allocating new ones while the old ones are still around. */
+   swapchain_base *image_donor = nullptr;
+   if (swapchain_create_info->oldSwapchain != VK_NULL_HANDLE)
    {
-      TRY(create_swapchain_image(image_create_info, img));
+      auto *ancestor = reinterpret_cast<swapchain_base *>(swapchain_create_info->oldSwapchain);
+      if (m_image_compatibility.adoptable && ancestor->m_image_compatibility.adoptable &&
+          m_image_compatibility == ancestor->m_image_compatibility &&
+          get_allocation_callbacks() == ancestor->get_allocation_callbacks())
+      {
+         ancestor->stop_image_allocator();
+         image_donor = ancestor;
+      }
+   }
 
-      if (image_deferred_allocation)
+   /* The images are created one by one, the first one selects the format and layout for all. Their memory is
+    * allocated afterwards, all at once. */
+   uint32_t allocation_mask = 0;
+   for (uint32_t i = 0; i < m_swapchain_images.size(); ++i)
+   {
+      auto &img = m_swapchain_images[i];
+      if (image_donor != nullptr && adopt_free_image(*image_donor, img))
       {
-         img.status = swapchain_image::UNALLOCATED;
+         /* Adopted images are FREE, with their memory bound. */
       }
       else
       {
-         TRY_LOG_CALL(allocate_and_bind_swapchain_image(image_create_info, img));
+         /* Once the ancestor runs out of FREE images, or refuses them, create the rest. */
+         image_donor = nullptr;
+         TRY(create_swapchain_image(image_create_info, img));
+
+         if (image_deferred_allocation)
+         {
+            set_image_status(img, swapchain_image::UNALLOCATED);
+         }
+         else
+         {
+            allocation_mask |= 1u << i;
+         }
       }
 
       VkSemaphoreCreateInfo semaphore_info = {};
@@ -312,8 +799,9 @@ VkResult swapchain_base::init(VkDevice device, const VkSwapchainCreateInfoKHR *s
                                                       &img.present_fence_wait));
    }
 
-   m_device_data.disp.GetDeviceQueue(m_device, 0, 0, &m_queue);
-   TRY_LOG_CALL(m_device_data.SetDeviceLoaderData(m_device, m_queue));
+   TRY_LOG_CALL(allocate_swapchain_images(image_create_info, allocation_mask));
+
+   m_queue = m_device_data.get_layer_queue();
 
    int res = sem_init(&m_start_present_semaphore, 0, 0);
    /* Only programming error can cause this to fail. */
@@ -339,10 +827,208 @@ VkResult swapchain_base::init(VkDevice device, const VkSwapchainCreateInfoKHR *s
       ancestor->deprecate(reinterpret_cast<VkSwapchainKHR>(this));
    }
 
+   if (m_unallocated_images != 0)
+   {
+      try
+      {
+         m_image_allocator_thread = std::thread(&swapchain_base::image_allocator_thread, this);
+      }
+      catch (const std::system_error &)
+      {
+         WSI_LOG_WARNING("Failed to start the image allocator thread, images are allocated on acquire.");
+      }
+   }
+
    set_error_state(VK_SUCCESS);
    return VK_SUCCESS;
 }
 
+VkResult swapchain_base::allocate_swapchain_images(const VkImageCreateInfo &image_create_info, uint32_t image_mask)
+{
+   constexpr uint32_t max_allocation_threads = 4;
+
+   {
+      std::lock_guard<std::recursive_mutex> image_status_lock(m_image_status_mutex);
+      m_pending_allocations = static_cast<uint32_t>(__builtin_popcount(image_mask));
+   }
+
+   std::atomic<uint32_t> remaining_images{ image_mask };
+   std::atomic<int32_t> first_error{ VK_SUCCESS };
+   const auto allocate_remaining_images = [&]() {
+      while (first_error.load() == VK_SUCCESS)
+      {
+         uint32_t mask = remaining_images.load();
+         do
+         {
+            if (mask == 0)
+            {
+               return;
+            }
+         } while (!remaining_images.compare_exchange_weak(mask, mask & (mask - 1)));
+
+         const uint32_t index = static_cast<uint32_t>(__builtin_ctz(mask));
+         const VkResult res = allocate_and_bind_swapchain_image(image_create_info, m_swapchain_images[index]);
+         if (res != VK_SUCCESS)
+         {
+            int32_t expected = VK_SUCCESS;
+            first_error.compare_exchange_strong(expected, res);
+         }
+      }
+   };
+
+   /* The calling thread allocates too, a failure to start a thread only leaves more images to it. */
+   const uint32_t thread_count = std::min<uint32_t>(__builtin_popcount(image_mask), max_allocation_threads);
+   std::array<std::thread, max_allocation_threads - 1> threads;
+   uint32_t started_threads = 0;
+   for (; started_threads + 1 < thread_count; ++started_threads)
+   {
+      try
+      {
+         threads[started_threads] = std::thread(allocate_remaining_images);
+      }
+      catch (const std::system_error &)
+      {
+         break;
+      }
+   }
+
+   allocate_remaining_images();
+   for (uint32_t i = 0; i < started_threads; ++i)
+   {
+      threads[i].join();
+   }
+
+   std::lock_guard<std::recursive_mutex> image_status_lock(m_image_status_mutex);
+   m_pending_allocations = 0;
+
+   /* Images the failure left out have no memory, but still need to be destroyed with the swapchain. */
+   for (uint32_t mask = remaining_images.load(); mask != 0; mask &= mask - 1)
+   {
+      set_image_status(m_swapchain_images[__builtin_ctz(mask)], swapchain_image::UNALLOCATED);
+   }
+
+   return static_cast<VkResult>(first_error.load());
+}
+
+bool swapchain_base::adopt_free_image(swapchain_base &ancestor, swapchain_image &image)
+{
+   std::lock_guard<std::recursive_mutex> ancestor_status_lock(ancestor.m_image_status_mutex);
+
+   uint32_t free_images = ancestor.m_acquirable_images & ~ancestor.m_unallocated_images;
+   while (free_images != 0)
+   {
+      const uint32_t index = static_cast<uint32_t>(__builtin_ctz(free_images));
+      free_images &= free_images - 1;
+
+      auto &ancestor_image = ancestor.m_swapchain_images[index];
+      /* Only take images the GPU is done with, the others are left for the ancestor to destroy. */
+      if (ancestor.image_wait_present(ancestor_image, 0) != VK_SUCCESS)
+      {
+         continue;
+      }
+      if (!adopt_ancestor_image(ancestor, ancestor_image))
+      {
+         return false;
+      }
+
+      image.image = ancestor_image.image;
+      image.data = ancestor_image.data;
+      set_image_status(image, swapchain_image::FREE);
+
+      ancestor_image.image = VK_NULL_HANDLE;
+      ancestor_image.data = nullptr;
+      ancestor.set_image_status(ancestor_image, swapchain_image::INVALID);
+      return true;
+   }
+   return false;
+}
+
+void swapchain_base::move_image_data_accounting(const swapchain_base &ancestor, size_t size)
+{
+   const util::allocator &ancestor_allocator = ancestor.m_allocator;
+   if (ancestor_allocator.m_accounting != nullptr)
+   {
+      ancestor_allocator.m_accounting->remove(static_cast<util::memory_category>(ancestor_allocator.m_scope), size);
+   }
+   if (m_allocator.m_accounting != nullptr)
+   {
+      m_allocator.m_accounting->add(static_cast<util::memory_category>(m_allocator.m_scope), size);
+   }
+}
+
+uint32_t swapchain_base::get_pending_allocation_count()
+{
+   std::lock_guard<std::recursive_mutex> image_status_lock(m_image_status_mutex);
+   if (m_pending_allocations == 0)
+   {
+      return 1;
+   }
+   return m_pending_allocations--;
+}
+
+void swapchain_base::image_allocator_thread()
+{
+   std::unique_lock<std::recursive_mutex> image_status_lock(m_image_status_mutex);
+   for (uint32_t i = 0; i < m_swapchain_images.size() && !m_image_allocator_stop; ++i)
+   {
+      auto &image = m_swapchain_images[i];
+      if (image.status != swapchain_image::UNALLOCATED)
+      {
+         /* Already allocated by acquire. */
+         continue;
+      }
+
+      m_allocating_images |= 1u << i;
+      image_status_lock.unlock();
+
+      VkResult res = allocate_and_bind_swapchain_image(m_image_create_info, image);
+
+      image_status_lock.lock();
+      m_allocating_images &= ~(1u << i);
+      if (res != VK_SUCCESS)
+      {
+         /* Backends mark the image FREE before allocating it, hand it back to acquire to retry and report. */
+         WSI_LOG_WARNING("Background allocation of swapchain image %u failed with %d.", i, res);
+         set_image_status(image, swapchain_image::UNALLOCATED);
+         m_image_allocator_stop = true;
+      }
+      m_image_allocated_cond.notify_all();
+   }
+}
+
+void swapchain_base::stop_image_allocator()
+{
+   if (m_image_allocator_thread.joinable())
+   {
+      {
+         std::lock_guard<std::recursive_mutex> image_status_lock(m_image_status_mutex);
+         m_image_allocator_stop = true;
+      }
+      m_image_allocator_thread.join();
+   }
+}
+
+VkResult swapchain_base::wait_for_allocated_image(uint64_t timeout,
+                                                  std::unique_lock<std::recursive_mutex> &image_status_lock)
+{
+   const auto image_available = [this]() {
+      return (m_acquirable_images & ~(m_unallocated_images | m_allocating_images)) != 0 || m_allocating_images == 0;
+   };
+
+   switch (timeout)
+   {
+   case 0:
+      return image_available() ? VK_SUCCESS : VK_NOT_READY;
+   case UINT64_MAX:
+      m_image_allocated_cond.wait(image_status_lock, image_available);
+      return VK_SUCCESS;
+   default:
+      /* Keep far off timeouts from overflowing the steady clock. */
+      const auto wait_time = std::chrono::nanoseconds(std::min<uint64_t>(timeout, INT64_MAX / 2));
+      return m_image_allocated_cond.wait_for(image_status_lock, wait_time, image_available) ? VK_SUCCESS : VK_TIMEOUT;
+   }
+}
+
 void swapchain_base::teardown()
 {
    /* This method will block until all resources associated with this swapchain
@@ -350,6 +1036,8 @@ void swapchain_base::teardown()
     * immediately. For images in the PENDING state, we will block until the
     * presentation engine is finished with them. */
 
+   stop_image_allocator();
+
    if (has_descendant_started_presenting())
    {
       /* Here we wait for the start_present_semaphore, once this semaphore is up,
@@ -364,17 +1052,12 @@ void swapchain_base::teardown()
       wait_for_pending_buffers();
    }
 
-   if (m_queue != VK_NULL_HANDLE)
-   {
-      /* Make sure the vkFences are done signaling. */
-      m_device_data.disp.QueueWaitIdle(m_queue);
-   }
-
    /* We are safe to destroy everything. */
    if (m_thread_sem_defined)
    {
       /* Tell flip thread to end. */
       m_page_flip_thread_run = false;
+      m_pending_buffer_pool.close();
 
       if (m_page_flip_thread.joinable())
       {
@@ -384,6 +1067,49 @@ void swapchain_base::teardown()
       {
          WSI_LOG_ERROR("m_page_flip_thread is not joinable");
       }
+
+      /* Presents the thread did not get to are never shown, their fences still have to signal. In mailbox mode
+       * the ring only holds wake ups, the present is the one in the slot. */
+      while (auto pending = m_pending_buffer_pool.pop())
+      {
+         if (!m_mailbox_slot_enabled)
+         {
+            signal_present_fence(*pending);
+         }
+      }
+      std::unique_lock<std::mutex> mailbox_lock(m_mailbox_mutex);
+      std::optional<pending_present_request> mailbox_present = m_mailbox_slot;
+      m_mailbox_slot.reset();
+      mailbox_lock.unlock();
+      if (mailbox_present.has_value())
+      {
+         signal_present_fence(*mailbox_present);
+      }
+   }
+
+   /* Payloads exported for replaced mailbox images are no longer seen by image_wait_present. */
+   sync_fd_waiter::get_instance().cancel(this);
+
+   /* Only wait for the layer's own submissions, application work on the same queues keeps running. The present
+    * payloads cover the application's wait semaphores and the layer work of every image. */
+   for (auto &img : m_swapchain_images)
+   {
+      if (img.data != nullptr && image_wait_payload(img, UINT64_MAX) != VK_SUCCESS)
+      {
+         WSI_LOG_ERROR("Failed to wait for the present payload of a swapchain image.");
+      }
+   }
+
+   /* Submissions signalling a VK_EXT_swapchain_maintenance1 present fence come after the payload and wait on
+    * present_fence_wait, only the queue they went to needs draining before the semaphores go. */
+   if (m_present_fence_queue != VK_NULL_HANDLE)
+   {
+      m_device_data.disp.QueueWaitIdle(m_present_fence_queue);
+   }
+   if (m_present_fences_on_layer_queue)
+   {
+      std::lock_guard<std::mutex> queue_lock(m_device_data.get_layer_queue_lock());
+      m_device_data.disp.QueueWaitIdle(m_queue);
    }
 
    int res = sem_destroy(&m_start_present_semaphore);
@@ -417,58 +1143,126 @@ void swapchain_base::teardown()
 VkResult swapchain_base::acquire_next_image(uint64_t timeout, VkSemaphore semaphore, VkFence fence,
                                             uint32_t *image_index)
 {
+   WSI_TRACE_SCOPE("acquire_next_image");
+   const uint64_t acquire_start_ns = util::frame_stats::now_ns();
    std::unique_lock<std::mutex> acquire_lock(m_image_acquire_lock);
 
+   if (m_max_frames_in_flight != 0)
+   {
+      TRY(wait_for_frames_in_flight(&timeout));
+      if (error_has_occured())
+      {
+         return get_error_state();
+      }
+   }
+
    TRY(wait_for_free_buffer(timeout));
    if (error_has_occured())
    {
       return get_error_state();
    }
 
-   std::unique_lock<std::recursive_mutex> image_status_lock(m_image_status_mutex);
-
-   size_t i;
-   for (i = 0; i < m_swapchain_images.size(); ++i)
+   /* The free image semaphore was taken, so at least one image is FREE or UNALLOCATED. Once every image is
+    * allocated, taking the lowest FREE one is all acquire has to do. */
+   if (!try_acquire_free_image(image_index))
    {
-      if (m_swapchain_images[i].status == swapchain_image::UNALLOCATED)
+      std::unique_lock<std::recursive_mutex> image_status_lock(m_image_status_mutex);
+
+      /* Wait for the image allocator when it is still working on the only candidates, and otherwise allocate the
+       * lowest UNALLOCATED image inline. */
+      if ((m_acquirable_images & ~(m_unallocated_images | m_allocating_images)) == 0 && m_allocating_images != 0)
       {
-         auto res = allocate_and_bind_swapchain_image(m_image_create_info, m_swapchain_images[i]);
+         VkResult res = wait_for_allocated_image(timeout, image_status_lock);
          if (res != VK_SUCCESS)
          {
-            WSI_LOG_ERROR("Failed to allocate swapchain image.");
-            return res != VK_ERROR_INITIALIZATION_FAILED ? res : VK_ERROR_OUT_OF_HOST_MEMORY;
+            /* Give back the image taken by wait_for_free_buffer. */
+            m_free_image_semaphore.post();
+            return res;
          }
       }
-
-      if (m_swapchain_images[i].status == swapchain_image::FREE)
+      const uint32_t acquirable_images = m_acquirable_images & ~m_allocating_images;
+      const uint32_t allocated_images = acquirable_images & ~m_unallocated_images;
+      const uint32_t all_images = m_swapchain_images.size() >= 32 ? ~0u : (1u << m_swapchain_images.size()) - 1;
+
+      /* The masks are updated after the statuses they follow, so a bit can be stale. The status of each candidate
+       * is checked here, under the mutex that UNALLOCATED images only leave with, and when no bit is current every
+       * image is tried, as the free image semaphore guarantees one of them can be acquired. */
+      bool acquired = false;
+      for (const uint32_t candidates : { allocated_images, acquirable_images & ~allocated_images, all_images })
       {
-         m_swapchain_images[i].status = swapchain_image::ACQUIRED;
-         *image_index = i;
-         break;
+         for (uint32_t mask = candidates; mask != 0 && !acquired; mask &= mask - 1)
+         {
+            const uint32_t i = static_cast<uint32_t>(__builtin_ctz(mask));
+            if (m_swapchain_images[i].status == swapchain_image::UNALLOCATED)
+            {
+               if ((m_allocating_images & (1u << i)) != 0)
+               {
+                  continue;
+               }
+               auto res = allocate_and_bind_swapchain_image(m_image_create_info, m_swapchain_images[i]);
+               if (res != VK_SUCCESS)
+               {
+                  WSI_LOG_ERROR("Failed to allocate swapchain image.");
+                  m_free_image_semaphore.post();
+                  return res != VK_ERROR_INITIALIZATION_FAILED ? res : VK_ERROR_OUT_OF_HOST_MEMORY;
+               }
+            }
+
+            if (transition_image_status(m_swapchain_images[i], swapchain_image::FREE, swapchain_image::ACQUIRED))
+            {
+               acquired = true;
+               *image_index = i;
+            }
+         }
+         if (acquired)
+         {
+            break;
+         }
+      }
+      if (!acquired)
+      {
+         WSI_LOG_ERROR("No swapchain image to acquire although one was available.");
+         m_free_image_semaphore.post();
+         return VK_ERROR_OUT_OF_DATE_KHR;
       }
    }
 
-   assert(i < m_swapchain_images.size());
+   if (m_jit_acquire)
+   {
+      delay_acquire(acquire_start_ns, timeout);
+      m_acquire_return_ns[*image_index] = util::frame_stats::now_ns();
+   }
 
-   image_status_lock.unlock();
+   m_frame_stats.record(util::frame_stage::acquire_wait, acquire_start_ns);
 
-   /* Try to signal fences/semaphores with a sync FD for optimal performance. */
-   if (m_device_data.disp.get_fn<PFN_vkImportFenceFdKHR>("vkImportFenceFdKHR").has_value() &&
-       m_device_data.disp.get_fn<PFN_vkImportSemaphoreFdKHR>("vkImportSemaphoreFdKHR").has_value())
+   /* Try to signal fences/semaphores with a sync FD for optimal performance, unless they wait for a release point. */
+   const image_release_point release_point = get_image_release_point(m_swapchain_images[*image_index]);
+   const bool wait_release_point = release_point.semaphore != VK_NULL_HANDLE;
+   if (!wait_release_point && m_device_data.is_sync_fd_import_supported())
    {
       if (fence != VK_NULL_HANDLE)
       {
-         int already_signalled_sentinel_fd = -1;
          auto info = VkImportFenceFdInfoKHR{};
          {
             info.sType = VK_STRUCTURE_TYPE_IMPORT_FENCE_FD_INFO_KHR;
             info.fence = fence;
             info.handleType = VK_EXTERNAL_FENCE_HANDLE_TYPE_SYNC_FD_BIT;
-            info.fd = already_signalled_sentinel_fd;
+            info.fd = get_signalled_import_fd();
             info.flags = VK_FENCE_IMPORT_TEMPORARY_BIT;
          }
 
          auto result = m_device_data.disp.ImportFenceFdKHR(m_device, &info);
+         if (result == VK_ERROR_INVALID_EXTERNAL_HANDLE && info.fd == -1 && reject_sync_fd_sentinel())
+         {
+            info.fd = get_signalled_import_fd();
+            result = m_device_data.disp.ImportFenceFdKHR(m_device, &info);
+         }
+         if (result != VK_SUCCESS && info.fd >= 0)
+         {
+            /* Ownership of the FD is only transferred on success. */
+            close(info.fd);
+         }
+
          switch (result)
          {
          case VK_SUCCESS:
@@ -484,17 +1278,27 @@ VkResult swapchain_base::acquire_next_image(uint64_t timeout, VkSemaphore semaph
 
       if (semaphore != VK_NULL_HANDLE)
       {
-         int already_signalled_sentinel_fd = -1;
          auto info = VkImportSemaphoreFdInfoKHR{};
          {
             info.sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR;
             info.semaphore = semaphore;
             info.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT;
             info.flags = VK_SEMAPHORE_IMPORT_TEMPORARY_BIT;
-            info.fd = already_signalled_sentinel_fd;
+            info.fd = get_signalled_import_fd();
          }
 
          auto result = m_device_data.disp.ImportSemaphoreFdKHR(m_device, &info);
+         if (result == VK_ERROR_INVALID_EXTERNAL_HANDLE && info.fd == -1 && reject_sync_fd_sentinel())
+         {
+            info.fd = get_signalled_import_fd();
+            result = m_device_data.disp.ImportSemaphoreFdKHR(m_device, &info);
+         }
+         if (result != VK_SUCCESS && info.fd >= 0)
+         {
+            /* Ownership of the FD is only transferred on success. */
+            close(info.fd);
+         }
+
          switch (result)
          {
          case VK_SUCCESS:
@@ -511,14 +1315,67 @@ VkResult swapchain_base::acquire_next_image(uint64_t timeout, VkSemaphore semaph
 
    /* Fallback for when importing fence/semaphore sync FDs is unsupported by the ICD. */
    queue_submit_semaphores semaphores = {
-      nullptr,
-      0,
+      wait_release_point ? &release_point.semaphore : nullptr,
+      wait_release_point ? 1u : 0,
       (semaphore != VK_NULL_HANDLE) ? &semaphore : nullptr,
       (semaphore != VK_NULL_HANDLE) ? 1u : 0,
    };
-   TRY(sync_queue_submit(m_device_data, m_queue, fence, semaphores));
+   /* The application's semaphore is binary, so only the wait needs a value. */
+   VkTimelineSemaphoreSubmitInfo timeline_info = {};
+   timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+   timeline_info.waitSemaphoreValueCount = 1;
+   timeline_info.pWaitSemaphoreValues = &release_point.value;
+   std::lock_guard<std::mutex> queue_lock(m_device_data.get_layer_queue_lock());
+   TRY(sync_queue_submit(m_device_data, m_queue, fence, semaphores, wait_release_point ? &timeline_info : nullptr));
+
+   return m_suboptimal.load(std::memory_order_relaxed) ? VK_SUBOPTIMAL_KHR : VK_SUCCESS;
+}
 
-   return VK_SUCCESS;
+int swapchain_base::get_signalled_import_fd()
+{
+   /* -1 is the already signalled sentinel, once rejected import copies of a sync FD that is known to signal. */
+   if (m_sync_fd_sentinel_rejected && m_signalled_sync_fd.is_valid())
+   {
+      return dup(m_signalled_sync_fd.get());
+   }
+   return -1;
+}
+
+bool swapchain_base::reject_sync_fd_sentinel()
+{
+   if (m_sync_fd_sentinel_rejected)
+   {
+      /* Creating the signalled sync FD failed before, keep using the fallback submission. */
+      return false;
+   }
+   m_sync_fd_sentinel_rejected = true;
+
+   /* A sync FD stays signalled once its fence has signalled, so a single empty submission serves every later
+    * acquire of the swapchain. */
+   auto fence = sync_fd_fence_sync::create(m_device_data);
+   if (!fence.has_value())
+   {
+      return false;
+   }
+
+   queue_submit_semaphores semaphores = { nullptr, 0, nullptr, 0 };
+   {
+      std::lock_guard<std::mutex> queue_lock(m_device_data.get_layer_queue_lock());
+      if (fence->set_payload(m_queue, semaphores) != VK_SUCCESS)
+      {
+         return false;
+      }
+   }
+
+   auto sync_fd = fence->export_sync_fd();
+   if (!sync_fd.has_value() || !sync_fd->is_valid())
+   {
+      WSI_LOG_WARNING("Failed to export a signalled sync FD, acquire falls back to empty queue submissions.");
+      return false;
+   }
+
+   m_signalled_sync_fd = std::move(*sync_fd);
+   return true;
 }
 
 VkResult swapchain_base::get_swapchain_images(uint32_t *swapchain_image_count, VkImage *swapchain_images)
@@ -568,12 +1425,29 @@ VkResult swapchain_base::create_aliased_image_handle(VkImage *image)
 
 VkResult swapchain_base::get_swapchain_status()
 {
+   if (!error_has_occured() && m_suboptimal.load(std::memory_order_relaxed))
+   {
+      return VK_SUBOPTIMAL_KHR;
+   }
    return get_error_state();
 }
 
+VkResult swapchain_base::wait_for_present(uint64_t present_id, uint64_t timeout)
+{
+   auto *ext = get_swapchain_extension<wsi_ext_present_id>();
+   if (ext == nullptr)
+   {
+      /* The presentId feature is not enabled, so no present ever completes an ID. */
+      WSI_LOG_ERROR("vkWaitForPresentKHR called on a swapchain without present IDs.");
+      return VK_ERROR_OUT_OF_DATE_KHR;
+   }
+   return ext->wait_for_present_id(present_id, timeout);
+}
+
 VkResult swapchain_base::notify_presentation_engine(const pending_present_request &pending_present)
 {
-   const std::lock_guard<std::recursive_mutex> lock(m_image_status_mutex);
+   WSI_TRACE_SCOPE_ID("notify_presentation_engine", pending_present.present_id);
+   auto &image = m_swapchain_images[pending_present.image_index];
 
    /* If the descendant has started presenting, we should release the image
     * however we do not want to block inside the main thread so we mark it
@@ -581,20 +1455,33 @@ VkResult swapchain_base::notify_presentation_engine(const pending_present_reques
    const bool descendant_started_presenting = has_descendant_started_presenting();
    if (descendant_started_presenting)
    {
-      m_swapchain_images[pending_present.image_index].status = swapchain_image::FREE;
+      signal_present_fence(pending_present);
+      replace_image_status(image, swapchain_image::FREE);
       m_free_image_semaphore.post();
+
+      /* No later present of this swapchain reaches the screen, so stop vkWaitForPresentKHR waiting for them. */
+      auto *ext = get_swapchain_extension<wsi_ext_present_id>();
+      if (ext != nullptr)
+      {
+         ext->set_error_state(VK_ERROR_OUT_OF_DATE_KHR);
+      }
       return VK_ERROR_OUT_OF_DATE_KHR;
    }
 
-   m_swapchain_images[pending_present.image_index].status = swapchain_image::PENDING;
+   /* In the shared present modes the image may still be PENDING from its previous present. */
+   replace_image_status(image, swapchain_image::PENDING);
    m_started_presenting = true;
+   WSI_TRACE_ASYNC_BEGIN("present", pending_present.present_id);
 
    if (m_page_flip_thread_run)
    {
-      bool buffer_pool_res = m_pending_buffer_pool.push_back(pending_present);
-      (void)buffer_pool_res;
-      assert(buffer_pool_res);
-      m_page_flip_semaphore.post();
+      if (m_mailbox_slot_enabled)
+      {
+         post_to_mailbox(pending_present);
+         return VK_SUCCESS;
+      }
+
+      push_pending_present(pending_present);
    }
    else
    {
@@ -607,12 +1494,16 @@ VkResult swapchain_base::notify_presentation_engine(const pending_present_reques
 VkResult swapchain_base::queue_present(VkQueue queue, const VkPresentInfoKHR *present_info,
                                        const swapchain_presentation_parameters &submit_info)
 {
+   WSI_TRACE_SCOPE_ID("queue_present", submit_info.pending_present.present_id);
 #if VULKAN_WSI_LAYER_EXPERIMENTAL
    auto *ext = get_swapchain_extension<wsi::wsi_ext_present_timing>();
-   if (ext)
+   /* Entries are matched to presentation results by present ID, without one there is nothing to report. */
+   if (ext && submit_info.m_present_timing_info.presentStageQueries != 0 && submit_info.pending_present.present_id != 0)
    {
       wsi::swapchain_presentation_entry presentation_entry = {};
       presentation_entry.present_id = submit_info.pending_present.present_id;
+      presentation_entry.time_domain_id = submit_info.m_present_timing_info.timeDomainId;
+      presentation_entry.requested_stages = submit_info.m_present_timing_info.presentStageQueries;
       TRY_LOG_CALL(ext->add_presentation_entry(presentation_entry));
    }
 #endif
@@ -624,6 +1515,7 @@ VkResult swapchain_base::queue_present(VkQueue queue, const VkPresentInfoKHR *pr
       if (ext)
       {
          TRY_LOG_CALL(ext->handle_switching_presentation_mode(submit_info.present_mode));
+         m_present_mode = submit_info.present_mode;
       }
    }
 
@@ -639,8 +1531,10 @@ VkResult swapchain_base::queue_present(VkQueue queue, const VkPresentInfoKHR *pr
    {
       /* If the page flip thread is not running, we need to wait for any present payload here, before setting a new present payload. */
       constexpr uint64_t WAIT_PRESENT_TIMEOUT = 1000000000; /* 1 second */
-      TRY_LOG_CALL(
-         image_wait_present(m_swapchain_images[submit_info.pending_present.image_index], WAIT_PRESENT_TIMEOUT));
+      const uint64_t wait_start_ns = util::frame_stats::now_ns();
+      TRY_LOG_CALL(WSI_BACKEND_CALL(*this, image_wait_present)(
+         m_swapchain_images[submit_info.pending_present.image_index], WAIT_PRESENT_TIMEOUT));
+      m_frame_stats.record(util::frame_stage::present_fence_wait, wait_start_ns);
    }
 
    void *submission_pnext = nullptr;
@@ -666,10 +1560,21 @@ VkResult swapchain_base::queue_present(VkQueue queue, const VkPresentInfoKHR *pr
          nullptr,
       (submit_info.present_fence != VK_NULL_HANDLE) ? 1u : 0,
    };
-   TRY_LOG_CALL(image_set_present_payload(m_swapchain_images[submit_info.pending_present.image_index], queue,
-                                          semaphores, submission_pnext));
-
-   if (submit_info.present_fence != VK_NULL_HANDLE)
+   TRY_LOG_CALL(WSI_BACKEND_CALL(*this, image_set_present_payload)(
+      m_swapchain_images[submit_info.pending_present.image_index], queue, semaphores, submission_pnext,
+      submit_info.batch));
+
+   /* In the shared present modes the image stays on screen, the present fence signals when its payload is done.
+    * Otherwise it signals once the presentation engine is done with the present, submitted from the threads
+    * presenting on the layer queue. Without a queue of its own the layer would race the application submitting to
+    * that queue, the fence then signals with the payload too. */
+   const bool shared_present_mode = m_present_mode == VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR ||
+                                    m_present_mode == VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR;
+   const bool fence_with_payload = shared_present_mode || !m_device_data.is_layer_queue_dedicated();
+   pending_present_request pending_present = submit_info.pending_present;
+   pending_present.present_mode = m_present_mode;
+   pending_present.present_fence = VK_NULL_HANDLE;
+   if (submit_info.present_fence != VK_NULL_HANDLE && fence_with_payload)
    {
       const queue_submit_semaphores wait_semaphores = {
          &m_swapchain_images[submit_info.pending_present.image_index].present_fence_wait, 1, nullptr, 0
@@ -677,16 +1582,122 @@ VkResult swapchain_base::queue_present(VkQueue queue, const VkPresentInfoKHR *pr
       /*
        * Here we chain wait_semaphores with present_fence through present_fence_wait.
        */
-      TRY(sync_queue_submit(m_device_data, queue, submit_info.present_fence, wait_semaphores));
+      TRY(sync_queue_submit(m_device_data, queue, submit_info.present_fence, wait_semaphores, nullptr,
+                            VK_NULL_HANDLE, submit_info.batch));
+      m_present_fence_queue = queue;
+   }
+   else if (submit_info.present_fence != VK_NULL_HANDLE)
+   {
+      pending_present.present_fence = submit_info.present_fence;
+      /* The layer queue waits for present_fence_wait, whose signal must be submitted first. */
+      if (submit_info.batch != nullptr)
+      {
+         TRY(submit_info.batch->flush());
+      }
    }
 
-   TRY(notify_presentation_engine(submit_info.pending_present));
+   /* Without the page flip thread the image is presented, and its payload waited for, before this returns. */
+   if (submit_info.batch != nullptr && !m_page_flip_thread_run)
+   {
+      TRY(submit_info.batch->flush());
+   }
 
-   return VK_SUCCESS;
+   TRY(notify_presentation_engine(pending_present));
+
+   return m_suboptimal.load(std::memory_order_relaxed) ? VK_SUBOPTIMAL_KHR : VK_SUCCESS;
+}
+
+void swapchain_base::update_image_masks(uint32_t index, enum swapchain_image::status status)
+{
+   const uint32_t bit = 1u << index;
+   if (status == swapchain_image::FREE || status == swapchain_image::UNALLOCATED)
+   {
+      m_acquirable_images.fetch_or(bit);
+   }
+   else
+   {
+      m_acquirable_images.fetch_and(~bit);
+   }
+
+   if (status == swapchain_image::UNALLOCATED)
+   {
+      m_unallocated_images.fetch_or(bit);
+   }
+   else
+   {
+      m_unallocated_images.fetch_and(~bit);
+   }
+
+   if (status == swapchain_image::PENDING || status == swapchain_image::PRESENTED)
+   {
+      m_in_flight_images.fetch_or(bit);
+   }
+   else if ((m_in_flight_images.fetch_and(~bit) & bit) != 0 && m_max_frames_in_flight != 0)
+   {
+      notify_frames_in_flight();
+   }
+}
+
+void swapchain_base::set_image_status(swapchain_image &image, enum swapchain_image::status status)
+{
+   const auto index = static_cast<uint32_t>(&image - m_swapchain_images.data());
+   assert(index < m_swapchain_images.size());
+
+   image.status.store(status);
+   update_image_masks(index, status);
+}
+
+bool swapchain_base::transition_image_status(swapchain_image &image, enum swapchain_image::status from,
+                                             enum swapchain_image::status to)
+{
+   const auto index = static_cast<uint32_t>(&image - m_swapchain_images.data());
+   assert(index < m_swapchain_images.size());
+
+   if (!image.status.compare_exchange_strong(from, to))
+   {
+      return false;
+   }
+   /* Only the owner of the image changes its bits, so they cannot be reordered with another transition's. */
+   update_image_masks(index, to);
+   return true;
+}
+
+enum swapchain_image::status swapchain_base::replace_image_status(swapchain_image &image,
+                                                                 enum swapchain_image::status status)
+{
+   const auto index = static_cast<uint32_t>(&image - m_swapchain_images.data());
+   assert(index < m_swapchain_images.size());
+
+   const auto previous = image.status.exchange(status);
+   update_image_masks(index, status);
+   return previous;
+}
+
+bool swapchain_base::try_acquire_free_image(uint32_t *image_index)
+{
+   /* Load m_allocating_images last: its bit is set before the backend marks the image FREE, so an image seen FREE
+    * here is seen as allocating if it is. */
+   uint32_t candidates = m_acquirable_images.load() & ~m_unallocated_images.load();
+   candidates &= ~m_allocating_images.load();
+   while (candidates != 0)
+   {
+      const uint32_t i = static_cast<uint32_t>(__builtin_ctz(candidates));
+      if (transition_image_status(m_swapchain_images[i], swapchain_image::FREE, swapchain_image::ACQUIRED))
+      {
+         *image_index = i;
+         return true;
+      }
+      candidates &= candidates - 1;
+   }
+   return false;
 }
 
 void swapchain_base::deprecate(VkSwapchainKHR descendant)
 {
+   /* Images not allocated yet are not needed anymore, and FREE ones are about to be destroyed. */
+   stop_image_allocator();
+
+   std::unique_lock<std::recursive_mutex> image_status_lock(m_image_status_mutex);
    for (auto &img : m_swapchain_images)
    {
       if (img.status == swapchain_image::FREE)
@@ -694,6 +1705,7 @@ void swapchain_base::deprecate(VkSwapchainKHR descendant)
          destroy_image(img);
       }
    }
+   image_status_lock.unlock();
 
    /* Set its descendant. */
    m_descendant = descendant;
@@ -704,8 +1716,8 @@ void swapchain_base::wait_for_pending_buffers()
    std::unique_lock<std::mutex> acquire_lock(m_image_acquire_lock);
    int wait;
    int acquired_images = 0;
-   std::unique_lock<std::recursive_mutex> image_status_lock(m_image_status_mutex);
 
+   /* The application does not acquire or release images concurrently with teardown, so the count is stable. */
    for (auto &img : m_swapchain_images)
    {
       if (img.status == swapchain_image::ACQUIRED)
@@ -718,7 +1730,6 @@ void swapchain_base::wait_for_pending_buffers()
     * compositor. The WSI backend may not necessarily know which pending image is presented to change its state. It may
     * be impossible to wait for that one presented image. */
    wait = static_cast<int>(m_swapchain_images.size()) - acquired_images - 1;
-   image_status_lock.unlock();
 
    while (wait > 0)
    {
@@ -749,7 +1760,7 @@ VkResult swapchain_base::wait_for_free_buffer(uint64_t timeout)
        * the swapchain implementation may be able to get a buffer without
        * waiting */
 
-      retval = get_free_buffer(&timeout);
+      retval = WSI_BACKEND_CALL(*this, get_free_buffer)(&timeout);
       if (retval == VK_SUCCESS)
       {
          /* the sub-implementation has done it's thing, so re-check the
@@ -761,6 +1772,87 @@ VkResult swapchain_base::wait_for_free_buffer(uint64_t timeout)
    return retval;
 }
 
+VkResult swapchain_base::wait_for_frames_in_flight(uint64_t *timeout)
+{
+   const auto below_limit = [this]() {
+      return static_cast<uint32_t>(__builtin_popcount(m_in_flight_images.load())) <= m_frames_in_flight_limit ||
+             error_has_occured();
+   };
+
+   if (below_limit())
+   {
+      adapt_frames_in_flight_limit(false);
+      return VK_SUCCESS;
+   }
+   if (*timeout == 0)
+   {
+      return VK_NOT_READY;
+   }
+
+   WSI_TRACE_SCOPE("frames_in_flight_wait");
+   std::unique_lock<std::mutex> lock(m_frames_in_flight_mutex);
+   if (*timeout == UINT64_MAX)
+   {
+      m_frames_in_flight_cond.wait(lock, below_limit);
+   }
+   else
+   {
+      const auto wait_start = std::chrono::steady_clock::now();
+      /* Keep far off timeouts from overflowing the steady clock. */
+      const auto wait_time = std::chrono::nanoseconds(std::min<uint64_t>(*timeout, INT64_MAX / 2));
+      if (!m_frames_in_flight_cond.wait_for(lock, wait_time, below_limit))
+      {
+         return VK_TIMEOUT;
+      }
+
+      const auto waited_ns = static_cast<uint64_t>(
+         std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wait_start).count());
+      *timeout -= std::min(*timeout, waited_ns);
+   }
+
+   adapt_frames_in_flight_limit(true);
+   return VK_SUCCESS;
+}
+
+void swapchain_base::adapt_frames_in_flight_limit(bool waited)
+{
+   if (!m_adaptive_frames_in_flight)
+   {
+      return;
+   }
+
+   if (waited)
+   {
+      /* The application keeps outrunning the display, it still does with one frame less in flight. */
+      m_frames_in_flight_skips = 0;
+      if (++m_frames_in_flight_waits >= m_frames_in_flight_lower_after && m_frames_in_flight_limit > 1)
+      {
+         m_frames_in_flight_limit--;
+         m_frames_in_flight_waits = 0;
+      }
+      return;
+   }
+
+   /* Frames no longer queue up, likely because rendering one after the other is slower than the display. Allow one
+    * more to overlap and probe the lower depth less often, so it does not cost a few slow frames every window. */
+   m_frames_in_flight_waits = 0;
+   if (++m_frames_in_flight_skips >= frames_in_flight_raise_after &&
+       m_frames_in_flight_limit < m_max_frames_in_flight)
+   {
+      m_frames_in_flight_limit++;
+      m_frames_in_flight_skips = 0;
+      m_frames_in_flight_lower_after =
+         std::min(m_frames_in_flight_lower_after * 2, frames_in_flight_lower_after * frames_in_flight_max_backoff);
+   }
+}
+
+void swapchain_base::notify_frames_in_flight()
+{
+   /* Taking the mutex orders the notification after the check of a waiter about to sleep. */
+   std::lock_guard<std::mutex> lock(m_frames_in_flight_mutex);
+   m_frames_in_flight_cond.notify_all();
+}
+
 void swapchain_base::release_images(uint32_t image_count, const uint32_t *indices)
 {
    for (uint32_t i = 0; i < image_count; i++)
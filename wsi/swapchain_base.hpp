@@ -35,10 +35,17 @@
 #include <vulkan/vulkan.h>
 #include <thread>
 #include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
 
 #include <util/custom_allocator.hpp>
+#include <util/file_descriptor.hpp>
+#include <util/frame_stats.hpp>
 #include <util/helpers.hpp>
 #include <util/ring_buffer.hpp>
+#include <util/spsc_ring.hpp>
 #include <util/timed_semaphore.hpp>
 #include <util/log.hpp>
 #include <layer/private_data.hpp>
@@ -47,6 +54,7 @@
 #include "synchronization.hpp"
 
 #include "extensions/frame_boundary.hpp"
+#include "extensions/present_id.hpp"
 #include "extensions/wsi_extension.hpp"
 #include "util/macros.hpp"
 
@@ -56,6 +64,7 @@ namespace wsi
 using util::MAX_PLANES;
 struct swapchain_image
 {
+   /* The member below hides this name, outside of the struct the type is spelled enum swapchain_image::status. */
    enum status
    {
       INVALID,
@@ -66,15 +75,60 @@ struct swapchain_image
       UNALLOCATED,
    };
 
+   swapchain_image() = default;
+
+   /* Only used while m_swapchain_images is sized, before any other thread can see the images. */
+   swapchain_image(swapchain_image &&other) noexcept
+      : data(other.data)
+      , image(other.image)
+      , status(other.status.load(std::memory_order_relaxed))
+      , present_semaphore(other.present_semaphore)
+      , present_fence_wait(other.present_fence_wait)
+   {
+   }
+
    /* Implementation specific data */
    void *data{ nullptr };
 
    VkImage image{ VK_NULL_HANDLE };
-   status status{ swapchain_image::INVALID };
+   std::atomic<enum status> status{ swapchain_image::INVALID };
    VkSemaphore present_semaphore{ VK_NULL_HANDLE };
    VkSemaphore present_fence_wait{ VK_NULL_HANDLE };
 };
 
+/**
+ * @brief Damaged area of a presented image, as given by VkPresentRegionsKHR.
+ */
+struct present_damage
+{
+   /* Regions with more rectangles are reduced to their bounding box. */
+   static constexpr uint32_t MAX_RECTS = 16;
+
+   /* Number of valid entries in rects. If 0, the whole image is damaged unless unchanged is set. */
+   uint32_t rect_count{ 0 };
+
+   std::array<VkRect2D, MAX_RECTS> rects{};
+
+   /* Set when the application gave rectangles that are all empty: nothing changed since the previous present.
+    * Backends that cannot skip a present treat it as the whole image. */
+   bool unchanged{ false };
+
+   bool is_full() const
+   {
+      return rect_count == 0;
+   }
+
+   /**
+    * @brief Set the damage from a VkPresentRegionKHR.
+    *
+    * Rectangles on layers other than 0 and empty rectangles are ignored. If nothing is left
+    * the whole image is treated as damaged, unless all the rectangles were empty.
+    *
+    * @param region The present region supplied by the application for this swapchain.
+    */
+   void set(const VkPresentRegionKHR &region);
+};
+
 struct pending_present_request
 {
    /* The index of the pending image to use for present. */
@@ -85,6 +139,44 @@ struct pending_present_request
     * If 0, no present ID has been assigned to this request.
     */
    uint64_t present_id;
+
+   /* Area of the image that changed since the previous present. */
+   present_damage damage;
+
+   /* util::frame_stats::now_ns() when vkQueuePresentKHR was called, for the queue to screen latency. */
+   uint64_t queue_time_ns;
+
+   /*
+    * VkPresentTimingInfoEXT target of the present, in the time domain of its target stage. 0 presents as soon as
+    * possible. Backends that cannot schedule presents ignore it.
+    */
+   uint64_t target_time;
+   /* Whether target_time is a duration after the previous present was shown rather than an absolute time. */
+   bool target_time_relative;
+   /* Whether the present may show on the refresh closest to target_time, even before it. */
+   bool target_time_nearest;
+
+   /* Present mode of the present, VkSwapchainPresentModeInfoEXT can switch it between presents. */
+   VkPresentModeKHR present_mode;
+
+   /*
+    * VkDisplayPresentInfoKHR rectangles of the image shown and of the area of the display it covers, an empty extent
+    * when not given. Only display swapchains use them.
+    */
+   VkRect2D display_src_rect;
+   VkRect2D display_dst_rect;
+   /*
+    * VkSwapchainPresentFenceInfoEXT fence signalled once the presentation engine is done with the present, see
+    * swapchain_base::signal_present_fence. VK_NULL_HANDLE when there is none or it already follows the payload.
+    */
+   VkFence present_fence;
+
+   /*
+    * Set for the refreshes the page flip thread makes of the shared image in
+    * VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR between presentation requests. The application did not report
+    * what changed, damage is left empty.
+    */
+   bool refresh;
 };
 
 struct swapchain_presentation_parameters
@@ -109,6 +201,9 @@ struct swapchain_presentation_parameters
    /* Contains details about the pending present request */
    pending_present_request pending_present{};
 
+   /* Batch the submissions of this present go to, nullptr to submit them right away. */
+   present_batch *batch{ nullptr };
+
    /**
     * Flag that indicates whether a frame boundary should be passed
     * to underlying layers/ICD if the feature is enabled.
@@ -196,6 +291,13 @@ public:
    VkResult queue_present(VkQueue queue, const VkPresentInfoKHR *present_info,
                           const swapchain_presentation_parameters &presentation_parameters);
 
+   /**
+    * @brief Report that the batched submission of payloads queued by @ref queue_present failed.
+    *
+    * The payloads never complete, so the page flip thread stops waiting for them and the swapchain takes @p error.
+    */
+   void abandon_present_payloads(VkResult error);
+
    /**
     * @brief Get the allocator
     *
@@ -258,6 +360,35 @@ public:
     */
    VkResult get_swapchain_status();
 
+   /**
+    * @brief Latency statistics of the frames of this swapchain.
+    */
+   const util::frame_stats &get_frame_stats() const
+   {
+      return m_frame_stats;
+   }
+
+   /**
+    * @brief Host memory held by this swapchain, see util::memory_accounting.
+    */
+   const util::memory_accounting &get_memory_accounting() const
+   {
+      return m_memory_accounting;
+   }
+
+   /**
+    * @brief Wait for the present with @p present_id, or a later one, to be on screen, see vkWaitForPresentKHR.
+    *
+    * Backends whose present completion events are only received while the waiting thread dispatches them
+    * override this.
+    *
+    * @param present_id The present ID to wait for.
+    * @param timeout    Timeout in nanoseconds.
+    *
+    * @return VK_SUCCESS once presented, VK_TIMEOUT or the error the swapchain entered otherwise.
+    */
+   virtual VkResult wait_for_present(uint64_t present_id, uint64_t timeout);
+
    /**
     * @brief Release all images not belonging to the device
     * by making them available to be acquired again
@@ -317,26 +448,27 @@ protected:
     */
    bool m_page_flip_thread_run;
 
-   /**
-    * @brief A semaphore to be signalled once a page flip event occurs.
-    */
-   util::timed_semaphore m_page_flip_semaphore;
-
    /**
     * @brief A semaphore to be signalled once the swapchain has one frame on screen.
     */
    sem_t m_start_present_semaphore;
 
    /**
-    * @brief A mutex to protect access to the statuses of the swapchain's images and
-    * any code paths that rely on this information. We use a recursive mutex as some
-    * functions such as 'destroy_image' both change an image's status and are called
-    * conditionally based on an image's status in some cases. A recursive mutex allows
-    * these functions to be called both with and without the mutex already locked in the
-    * same thread.
+    * @brief A mutex to serialize the structural changes of the swapchain's images: allocation, destruction,
+    * adoption by a descendant and deprecation. Acquire, present and release change the status with
+    * @ref transition_image_status and do not take it. We use a recursive mutex as some functions such as
+    * 'destroy_image' both change an image's status and are called conditionally based on an image's status in
+    * some cases. A recursive mutex allows these functions to be called both with and without the mutex already
+    * locked in the same thread.
     */
    std::recursive_mutex m_image_status_mutex;
 
+   /**
+    * @brief Serializes the backend state shared by the memory allocations of the images, such as the wsialloc
+    *        allocator and the allocated format, so allocations do not hold m_image_status_mutex.
+    */
+   std::mutex m_image_allocation_mutex;
+
    /**
     * @brief Defines if the pthread_t and sem_t members of the class are defined.
     *
@@ -352,12 +484,40 @@ protected:
 
    /**
     * @brief In order to present the images in a FIFO order we implement
-    * a ring buffer to hold the images queued for presentation. Since the
-    * two pointers (head and tail) are used by different
-    * threads and we do not allow the application to acquire more images
-    * than we have we eliminate race conditions.
+    * a ring buffer to hold the images queued for presentation. queue_present
+    * is the only producer, as the application synchronizes it externally, and
+    * the page flip thread the only consumer, so the ring is lock-free and the
+    * page flip thread sleeps on it until an image is queued.
+    */
+   util::spsc_ring<pending_present_request,
+                   util::next_power_of_two(wsi::surface_properties::MAX_SWAPCHAIN_IMAGE_COUNT)>
+      m_pending_buffer_pool;
+
+   /**
+    * @brief Set when a present was dropped because @ref m_pending_buffer_pool was full, the next present the page
+    *        flip thread takes is then made over the whole image.
+    */
+   std::atomic<bool> m_pending_ring_overflowed{ false };
+
+   /**
+    * @brief Whether the page flip thread presents the latest frame queued rather than every one of them.
+    *
+    * Set by backends in init_platform for VK_PRESENT_MODE_MAILBOX_KHR. A present then replaces the one still
+    * waiting for the page flip thread, see @ref post_to_mailbox, so vkQueuePresentKHR never waits for the
+    * presentation engine.
     */
-   util::ring_buffer<pending_present_request, wsi::surface_properties::MAX_SWAPCHAIN_IMAGE_COUNT> m_pending_buffer_pool;
+   bool m_mailbox_slot_enabled{ false };
+
+   /**
+    * @brief Latency statistics of the frames of this swapchain. Backends record util::frame_stage::queue_to_screen
+    *        where they learn that a present is on screen.
+    */
+   util::frame_stats m_frame_stats;
+
+   /**
+    * @brief Host memory held by this swapchain, counted by m_allocator when the memory_accounting tuning is on.
+    */
+   util::memory_accounting m_memory_accounting;
 
    /**
     * @brief User provided memory allocation callbacks.
@@ -369,6 +529,44 @@ protected:
     */
    util::vector<swapchain_image> m_swapchain_images;
 
+   /**
+    * @brief Bit i is set when m_swapchain_images[i] is FREE or UNALLOCATED, which lets acquire pick an image
+    * without scanning. Only changed through @ref set_image_status and @ref transition_image_status.
+    *
+    * The bit is updated right after the status, so it can briefly disagree with it. Readers take it as a hint and
+    * validate it with @ref transition_image_status.
+    */
+   std::atomic<uint32_t> m_acquirable_images{ 0 };
+   static_assert(wsi::surface_properties::MAX_SWAPCHAIN_IMAGE_COUNT <= 32,
+                 "m_acquirable_images needs a bit per swapchain image");
+
+   /**
+    * @brief Bit i is set when m_swapchain_images[i] is UNALLOCATED. Only changed through @ref set_image_status.
+    */
+   std::atomic<uint32_t> m_unallocated_images{ 0 };
+
+   /**
+    * @brief Swapchain creation parameters that must match for a descendant to adopt the images, see
+    *        @ref adopt_ancestor_image.
+    */
+   struct image_compatibility
+   {
+      VkFormat format{ VK_FORMAT_UNDEFINED };
+      VkExtent2D extent{};
+      uint32_t array_layers{ 0 };
+      VkImageUsageFlags usage{ 0 };
+      VkSwapchainCreateFlagsKHR flags{ 0 };
+      /* Images are never adopted when false, for example when the images have extra creation structures. */
+      bool adoptable{ false };
+
+      bool operator==(const image_compatibility &rhs) const
+      {
+         return format == rhs.format && extent.width == rhs.extent.width && extent.height == rhs.extent.height &&
+                array_layers == rhs.array_layers && usage == rhs.usage && flags == rhs.flags;
+      }
+   };
+   image_compatibility m_image_compatibility;
+
    /**
     * @brief Handle to the surface object this swapchain will present images to.
     */
@@ -376,8 +574,11 @@ protected:
 
    /**
     * @brief Present mode currently being used for this swapchain
+    *
+    * Changed by queue_present on a VK_EXT_swapchain_maintenance1 mode switch while the page flip thread and the
+    * backend threads read it.
     */
-   VkPresentModeKHR m_present_mode;
+   std::atomic<VkPresentModeKHR> m_present_mode;
 
    /**
     * @brief Possible presentation modes this swapchain is allowed to present with VkSwapchainPresentModesCreateInfoEXT
@@ -406,7 +607,7 @@ protected:
    VkDevice m_device;
 
    /**
-    *  @brief Handle to the queue used for signalling submissions
+    *  @brief Handle to the queue used for signalling submissions, see layer::device_private_data::get_layer_queue.
     */
    VkQueue m_queue;
 
@@ -428,6 +629,77 @@ protected:
     */
    void wait_for_pending_buffers();
 
+   /**
+    * @brief Whether the ICD rejected -1 as an already signalled sync FD payload.
+    */
+   bool m_sync_fd_sentinel_rejected{ false };
+
+   /**
+    * @brief Signalled sync FD imported by acquire instead of the -1 sentinel, see @ref reject_sync_fd_sentinel.
+    */
+   util::fd_owner m_signalled_sync_fd;
+
+   /**
+    * @brief Get the sync FD to import into the acquire fence or semaphore.
+    *
+    * @return -1 for the already signalled sentinel, or a new copy of @ref m_signalled_sync_fd owned by the caller.
+    */
+   int get_signalled_import_fd();
+
+   /**
+    * @brief Record that the ICD does not accept the -1 sentinel and create @ref m_signalled_sync_fd.
+    *
+    * This costs a single empty queue submission for the lifetime of the swapchain, instead of one per acquire.
+    *
+    * @return true if later imports can use @ref get_signalled_import_fd, false to keep using the fallback submission.
+    */
+   bool reject_sync_fd_sentinel();
+
+   /**
+    * @brief Change the status of a swapchain image, whatever its current status.
+    *
+    * For structural changes only, see @ref transition_image_status for the others. It must be called with
+    * m_image_status_mutex held, or before the swapchain threads are started.
+    *
+    * @param image  Image of m_swapchain_images.
+    * @param status New status of the image.
+    */
+   void set_image_status(swapchain_image &image, enum swapchain_image::status status);
+
+   /**
+    * @brief Check whether the presentation engine may still read an image of status @p status.
+    *
+    * Presented images are read until a newer present replaces them, their buffers cannot be reused before.
+    */
+   static bool is_image_in_use(enum swapchain_image::status status)
+   {
+      return status == swapchain_image::PENDING || status == swapchain_image::PRESENTED;
+   }
+
+   /**
+    * @brief Change the status of a swapchain image from @p from to @p to, without taking m_image_status_mutex.
+    *
+    * The thread whose transition succeeds owns the image until its next transition.
+    *
+    * @param image Image of m_swapchain_images.
+    * @param from  Status the image is expected to have.
+    * @param to    New status of the image.
+    *
+    * @return false, leaving the image unchanged, if its status was not @p from.
+    */
+   bool transition_image_status(swapchain_image &image, enum swapchain_image::status from,
+                                enum swapchain_image::status to);
+
+   /**
+    * @brief Change the status of an image owned by the caller, whatever it is, without taking m_image_status_mutex.
+    *
+    * For present and release, where the status the image leaves depends on the present mode and on how far the
+    * presentation engine got with it.
+    *
+    * @return The previous status of the image.
+    */
+   enum swapchain_image::status replace_image_status(swapchain_image &image, enum swapchain_image::status status);
+
    /**
     * @brief Remove cached ancestor.
     */
@@ -501,6 +773,16 @@ protected:
     */
    virtual VkResult allocate_and_bind_swapchain_image(VkImageCreateInfo image_create_info, swapchain_image &image) = 0;
 
+   /**
+    * @brief Number of images of @ref allocate_swapchain_images that still need memory, counting the one being
+    *        allocated, which it then no longer counts.
+    *
+    * Backends may allocate the memory of all these images at once when allocating the first of them. Deferred images
+    * are allocated one at a time, when acquire or the image allocator gets to them, so this is 1 outside of
+    * @ref allocate_swapchain_images.
+    */
+   uint32_t get_pending_allocation_count();
+
    /**
     * @brief Creates a new swapchain image.
     *
@@ -522,6 +804,72 @@ protected:
     */
    virtual void present_image(const pending_present_request &pending_present) = 0;
 
+   /**
+    * @brief Wait until the presentation engine can take the next present.
+    *
+    * Called by the page flip thread before it picks the next request. Backends with a bounded queue of presents
+    * block here rather than in @ref present_image, so in mailbox mode the latest frame is picked once there is room.
+    */
+   virtual void wait_for_present_slot()
+   {
+   }
+
+   /**
+    * @brief Time until which the page flip thread holds a present with a target time.
+    *
+    * Backends whose presentation engine takes the target time with the present, or that cannot predict their
+    * vblanks, return 0 and get the present as soon as its payload is done.
+    *
+    * @return CLOCK_MONOTONIC time in nanoseconds, see util::frame_stats::now_ns, or 0 not to hold the present.
+    */
+   virtual uint64_t get_present_release_time(const pending_present_request &)
+   {
+      return 0;
+   }
+
+   /**
+    * @brief A recent vblank of the presentation engine and its refresh interval, to predict the next vblanks.
+    *
+    * Used by the just-in-time acquire of the jit_acquire tuning. Backends that cannot predict their vblanks, for
+    * instance with variable refresh, return false and acquire is not delayed.
+    *
+    * @param[out] vblank_ns  CLOCK_MONOTONIC time of the vblank in nanoseconds, see util::frame_stats::now_ns.
+    * @param[out] refresh_ns Refresh interval in nanoseconds.
+    */
+   virtual bool get_vblank_timing(uint64_t *vblank_ns, uint64_t *refresh_ns)
+   {
+      UNUSED(vblank_ns);
+      UNUSED(refresh_ns);
+      return false;
+   }
+
+   /**
+    * @brief Number of refreshes after the vblank at @p vblank_ns until the one a present targeting @p target_ns
+    *        shows on.
+    *
+    * This is the first vblank at or after the target, or the closest one when @p nearest is set, and never a vblank
+    * that already passed.
+    */
+   static uint64_t get_target_refresh_count(uint64_t vblank_ns, uint64_t refresh_ns, uint64_t target_ns,
+                                            bool nearest);
+
+   /**
+    * @brief Release time of a present that should show @p refresh_count refreshes after the vblank at @p vblank_ns,
+    *        for presentation engines that show a present on the vblank after it is submitted.
+    */
+   static uint64_t get_release_time_for_refresh(uint64_t vblank_ns, uint64_t refresh_ns, uint64_t refresh_count);
+
+   /**
+    * @brief Whether the presentation engine waits for the present payload of an image itself.
+    *
+    * When true the page flip thread hands the image to @ref present_image without waiting with
+    * @ref image_wait_present first, the backend passes the payload on with the present instead.
+    */
+   virtual bool presents_wait_for_payload() const
+   {
+      return false;
+   }
+
    /**
     * @brief Transition a presented image to free.
     *
@@ -531,6 +879,21 @@ protected:
     */
    void unpresent_image(uint32_t presented_index);
 
+   /**
+    * @brief Complete a present the backend does not show, its surface being hidden.
+    *
+    * Waits until hidden_present_interval_ms after the previous hidden present, then completes the present ID and
+    * frees the image, so applications rendering to a hidden surface are throttled instead of blocked.
+    *
+    * @param pending_present The present request.
+    */
+   void complete_hidden_present(const pending_present_request &pending_present);
+
+   /**
+    * @brief sync_fd_waiter callback freeing an image replaced in the mailbox slot once its payload completes.
+    */
+   static void on_replaced_image_complete(void *swapchain, uint32_t image_index);
+
    /**
     * @brief Method to release a swapchain image
     *
@@ -540,6 +903,32 @@ protected:
     */
    virtual void destroy_image([[maybe_unused]] swapchain_image &image){};
 
+   /**
+    * @brief Take over an image of the swapchain being replaced instead of creating a new one.
+    *
+    * Only called when both swapchains were created with the same image parameters and allocation callbacks, with
+    * the ancestor's m_image_status_mutex held, for a FREE ancestor image whose present payload has completed.
+    * The implementation rebinds whatever ties the image data to @p ancestor, such as event queues or per
+    * swapchain synchronization objects. On success the image, including its data, belongs to this swapchain.
+    *
+    * @param ancestor       The swapchain being replaced, of the same implementation as this one.
+    * @param ancestor_image The image of @p ancestor to take over.
+    *
+    * @return true if the image can be used by this swapchain, false to create new images instead.
+    */
+   virtual bool adopt_ancestor_image(swapchain_base &ancestor, swapchain_image &ancestor_image)
+   {
+      UNUSED(ancestor);
+      UNUSED(ancestor_image);
+      return false;
+   }
+
+   /**
+    * @brief Move the @p size bytes of the data of an image adopted from @p ancestor to the accounting of this
+    *        swapchain, as the data is freed through its allocator from now on.
+    */
+   void move_image_data_accounting(const swapchain_base &ancestor, size_t size);
+
    /**
     * @brief Hook for any actions to free up a buffer for acquire
     *
@@ -566,12 +955,15 @@ protected:
     * @param     queue            A Vulkan queue that can be used for any Vulkan commands needed.
     * @param[in] semaphores       The wait and signal semaphores and their number of elements.
     * @param[in] submission_pnext Chain of pointers to attach to the payload submission.
+    * @param     batch            Batch of the present to add the payload submission to, or nullptr to submit it
+    *                             right away. Payloads that are waited for with a fence may submit it regardless.
     *
     * @return VK_SUCCESS on success or an error code otherwise.
     */
    virtual VkResult image_set_present_payload(swapchain_image &image, VkQueue queue,
                                               const queue_submit_semaphores &semaphores,
-                                              const void *submission_pnext = nullptr) = 0;
+                                              const void *submission_pnext = nullptr,
+                                              present_batch *batch = nullptr) = 0;
 
    /**
     * @brief Waits for the present payload of an image if necessary.
@@ -587,6 +979,61 @@ protected:
     */
    virtual VkResult image_wait_present(swapchain_image &image, uint64_t timeout) = 0;
 
+   /**
+    * @brief Waits for the present payload of an image to complete, even when the presentation engine waits for it
+    *        itself and @ref image_wait_present returns right away.
+    *
+    * @param[in] image   The swapchain image whose present payload to wait for.
+    * @param     timeout Timeout for the wait in nanoseconds.
+    *
+    * @return VK_SUCCESS once the payload completed. An error code otherwise.
+    */
+   virtual VkResult image_wait_payload(swapchain_image &image, uint64_t timeout)
+   {
+      return image_wait_present(image, timeout);
+   }
+
+   /**
+    * @brief Export the present payload of an image to a Sync FD, leaving nothing for @ref image_wait_present to wait
+    *        for.
+    *
+    * Lets images that will not be presented be freed by the sync_fd_waiter once their rendering completes. The
+    * payload must be pending.
+    *
+    * @return The Sync FD, invalid if the payload already completed, or an empty optional if the backend cannot export
+    *         its payloads.
+    */
+   virtual std::optional<util::fd_owner> image_export_present_payload(swapchain_image &image)
+   {
+      UNUSED(image);
+      return std::nullopt;
+   }
+
+   /**
+    * @brief Timeline semaphore value signalled once the presentation engine stopped reading an image.
+    */
+   struct image_release_point
+   {
+      VkSemaphore semaphore;
+      uint64_t value;
+   };
+
+   /**
+    * @brief Get the point acquires of an image have to wait for before the application writes to it.
+    *
+    * Presentation engines that signal a release point can return images as soon as they latched a newer one, the
+    * semaphore and fence of the acquire then wait for the point on the GPU.
+    *
+    * @param[in] image The acquired image.
+    *
+    * @return A point with a VK_NULL_HANDLE semaphore when the image can be used as soon as it is acquired.
+    */
+   virtual image_release_point get_image_release_point(const swapchain_image &image)
+   {
+      UNUSED(image);
+      return { VK_NULL_HANDLE, 0 };
+   }
+
    /**
     * @brief Returns true if an error has occurred.
     */
@@ -611,6 +1058,48 @@ protected:
    void set_error_state(VkResult state)
    {
       m_error_state = state;
+      if (state != VK_SUCCESS)
+      {
+         /* The pending presents will never complete, wake up vkWaitForPresentKHR. */
+         auto *ext = get_swapchain_extension<wsi_ext_present_id>();
+         if (ext != nullptr)
+         {
+            ext->set_error_state(state);
+         }
+
+         /* Nor will the images in flight be released, wake up an acquire waiting for them. */
+         notify_frames_in_flight();
+      }
+   }
+
+   /**
+    * @brief Wake up an acquire waiting for a free image that will never come, so it returns the error state.
+    *
+    * Only for backends whose images are freed by a thread that stopped on an error.
+    */
+   void wake_image_acquire_on_error()
+   {
+      assert(error_has_occured());
+      m_free_image_semaphore.post();
+   }
+
+   /**
+    * @brief Report VK_SUBOPTIMAL_KHR from the following acquires and presents.
+    *
+    * For backends whose presentation engine would show better suited images, e.g. in another format, when the
+    * application recreates the swapchain. Presents keep working as before.
+    */
+   void set_suboptimal()
+   {
+      m_suboptimal.store(true, std::memory_order_relaxed);
+   }
+
+   /**
+    * @brief Whether @ref set_suboptimal was called on this swapchain.
+    */
+   bool is_suboptimal() const
+   {
+      return m_suboptimal.load(std::memory_order_relaxed);
    }
 
 private:
@@ -624,6 +1113,11 @@ private:
     */
    VkResult m_error_state;
 
+   /**
+    * @brief Set by @ref abandon_present_payloads, the page flip thread then gives up on the payload it waits for.
+    */
+   std::atomic<bool> m_payloads_abandoned{ false };
+
    /**
     * @brief Wait for a buffer to become free.
     */
@@ -639,6 +1133,109 @@ private:
     */
    util::timed_semaphore m_free_image_semaphore;
 
+   /**
+    * @brief Wait until at most the frames in flight limit of images are PENDING or PRESENTED.
+    *
+    * @param[in,out] timeout Timeout in nanoseconds, lowered by the time waited.
+    *
+    * @return VK_SUCCESS, or VK_NOT_READY or VK_TIMEOUT when @p timeout expired.
+    */
+   VkResult wait_for_frames_in_flight(uint64_t *timeout);
+
+   /**
+    * @brief Move @ref m_frames_in_flight_limit towards the depth the application needs, with the
+    *        adaptive_frames_in_flight tuning.
+    *
+    * @param waited Whether the acquire had to wait for the limit.
+    */
+   void adapt_frames_in_flight_limit(bool waited);
+
+   /**
+    * @brief Wake up an acquire waiting in @ref wait_for_frames_in_flight.
+    */
+   void notify_frames_in_flight();
+
+   /**
+    * @brief Hold the acquire of @p image_index until the latest time rendering can start and make the next vblank,
+    *        with the jit_acquire tuning.
+    *
+    * @param acquire_start_ns When the acquire started, for its timeout.
+    * @param timeout          Timeout of the acquire in nanoseconds, the delay never exceeds it.
+    */
+   void delay_acquire(uint64_t acquire_start_ns, uint64_t timeout);
+
+   /**
+    * @brief Add the time from the acquire of the image of @p pending_present until its present to
+    *        @ref m_render_time_ns.
+    */
+   void record_render_time(const pending_present_request &pending_present, uint64_t present_ns);
+
+   /**
+    * @brief Whether acquire is delayed with @ref delay_acquire. Set in init.
+    */
+   bool m_jit_acquire{ false };
+
+   /**
+    * @brief Time each image was handed to the application, only set with @ref m_jit_acquire.
+    */
+   std::array<uint64_t, surface_properties::MAX_SWAPCHAIN_IMAGE_COUNT> m_acquire_return_ns{};
+
+   /**
+    * @brief Moving average and mean deviation of the time from acquire to the present being handed to the backend,
+    *        updated by the thread presenting and read by acquire.
+    */
+   std::atomic<uint64_t> m_render_time_ns{ 0 };
+   std::atomic<uint64_t> m_render_time_dev_ns{ 0 };
+   std::atomic<uint32_t> m_render_time_samples{ 0 };
+
+   /**
+    * @brief When the last present completed by @ref complete_hidden_present was, 0 before the first.
+    */
+   uint64_t m_last_hidden_present_ns{ 0 };
+
+   /**
+    * @brief Bit i is set while m_swapchain_images[i] is PENDING or PRESENTED, changed with
+    *        @ref m_acquirable_images.
+    */
+   std::atomic<uint32_t> m_in_flight_images{ 0 };
+
+   /**
+    * @brief The max_frames_in_flight tuning of the swapchain, 0 when acquire does not limit the frames in flight.
+    *        Set in init.
+    */
+   uint32_t m_max_frames_in_flight{ 0 };
+
+   /**
+    * @brief Current limit of the frames in flight, at most @ref m_max_frames_in_flight. Only used by acquire.
+    */
+   uint32_t m_frames_in_flight_limit{ 0 };
+
+   /**
+    * @brief Whether @ref m_frames_in_flight_limit adapts to the application, see @ref adapt_frames_in_flight_limit.
+    */
+   bool m_adaptive_frames_in_flight{ false };
+
+   /**
+    * @brief Consecutive acquires that waited, or did not wait, for the frames in flight limit.
+    */
+   uint32_t m_frames_in_flight_waits{ 0 };
+   uint32_t m_frames_in_flight_skips{ 0 };
+
+   /**
+    * @brief Consecutive acquires waiting for the limit before it is lowered, doubled each time it is raised back.
+    */
+   uint32_t m_frames_in_flight_lower_after{ 0 };
+
+   /**
+    * @brief Taken to wait on and signal @ref m_frames_in_flight_cond.
+    */
+   std::mutex m_frames_in_flight_mutex;
+
+   /**
+    * @brief Signalled when an image stops being in flight while acquire limits them.
+    */
+   std::condition_variable m_frames_in_flight_cond;
+
    /**
     * @brief Per swapchain thread function that handles page flipping.
     *
@@ -655,7 +1252,7 @@ private:
     *    descendant of the swapchain has started presenting so we
     *    should release the image and continue.
     *
-    * The function always waits on the page_flip_semaphore of the
+    * The function always waits on the pending buffer pool of the
     * swapchain. Once it passes that we must wait for the fence of the
     * oldest pending image to be signalled, this means that the gpu has
     * finished rendering to it and we can present it. From there on the
@@ -675,6 +1272,59 @@ private:
     */
    void call_present(const pending_present_request &pending_present);
 
+   /**
+    * @brief Sleep until @p release_ns, see @ref get_present_release_time.
+    *
+    * Returns early when the page flip thread is stopped.
+    */
+   void hold_present(uint64_t release_ns);
+
+   /**
+    * @brief Signal the present fence of @p pending_present, once its present has been handed to the backend or
+    *        dropped.
+    *
+    * The submission goes to the layer queue and waits for present_fence_wait, so the fence also covers the wait
+    * semaphores of the present. Only a dedicated layer queue is submitted to from outside queue_present, so the
+    * present fence is only deferred to here when the layer queue is dedicated.
+    */
+   void signal_present_fence(const pending_present_request &pending_present);
+
+   /**
+    * @brief Queue @p pending_present for the page flip thread.
+    *
+    * When the ring is full the present is dropped: its fence is signaled and, outside the shared present modes, its
+    * image is released once its rendering is done.
+    */
+   void push_pending_present(const pending_present_request &pending_present);
+
+   /**
+    * @brief Make @p pending_present the next present of the page flip thread, replacing the one still waiting.
+    *
+    * The replaced image is freed right away when its rendering is done, otherwise by the page flip thread.
+    */
+   void post_to_mailbox(const pending_present_request &pending_present);
+
+   /**
+    * @brief Take the latest present out of the mailbox slot, freeing the images it replaced.
+    */
+   pending_present_request take_mailbox_present();
+
+   /**
+    * @brief Guards @ref m_mailbox_slot and @ref m_dropped_mailbox_images.
+    */
+   std::mutex m_mailbox_mutex;
+
+   /**
+    * @brief Latest present for the page flip thread in mailbox mode, it always has a request in
+    *        @ref m_pending_buffer_pool while it is set.
+    */
+   std::optional<pending_present_request> m_mailbox_slot;
+
+   /**
+    * @brief Bitmask of the images replaced in the mailbox slot while their rendering was still in progress.
+    */
+   uint32_t m_dropped_mailbox_images{ 0 };
+
    /**
     * @brief Return true if the descendant has started presenting.
     */
@@ -687,6 +1337,91 @@ private:
     */
    VkResult init_page_flip_thread();
 
+   /**
+    * @brief Allocates the UNALLOCATED images of a swapchain created with deferred memory allocation in the
+    *        background, so acquire does not pay for the allocation inline.
+    *
+    * Images are allocated one at a time without holding m_image_status_mutex, acquire skips the image that is
+    * being allocated and waits for it only when no other image is ready. The thread stops at the first failure,
+    * leaving the remaining images to be allocated by acquire, which then reports the error.
+    */
+   void image_allocator_thread();
+
+   /**
+    * @brief Stop the image allocator thread and wait for the image it is allocating, if any.
+    */
+   void stop_image_allocator();
+
+   /**
+    * @brief Wait until an image that acquire can take without allocating is available, or until the image allocator
+    *        has nothing left in progress.
+    *
+    * @param timeout           Timeout for waiting in nanoseconds.
+    * @param image_status_lock Lock of m_image_status_mutex held by the caller, released while waiting.
+    *
+    * @return VK_SUCCESS, or VK_NOT_READY or VK_TIMEOUT when @p timeout expired.
+    */
+   VkResult wait_for_allocated_image(uint64_t timeout, std::unique_lock<std::recursive_mutex> &image_status_lock);
+
+   /**
+    * @brief Acquire the lowest FREE image that is not being allocated, without taking m_image_status_mutex.
+    *
+    * @return false if there is no such image, for instance because only UNALLOCATED images are left.
+    */
+   bool try_acquire_free_image(uint32_t *image_index);
+
+   /**
+    * @brief Update @ref m_acquirable_images, @ref m_unallocated_images and @ref m_in_flight_images for image
+    *        @p index changed to @p status.
+    */
+   void update_image_masks(uint32_t index, enum swapchain_image::status status);
+
+   /**
+    * @brief Allocate and bind the memory of the images in @p image_mask on a few threads.
+    *
+    * Each image waits for wsialloc, imports its buffers and creates the backend objects, most of which blocks in the
+    * kernel or on the compositor. Backends serialize the state shared between images under
+    * m_image_allocation_mutex, as they already do for the background allocation of deferred images.
+    *
+    * @return VK_SUCCESS, or the first error. Images not allocated on an error are left UNALLOCATED.
+    */
+   VkResult allocate_swapchain_images(const VkImageCreateInfo &image_create_info, uint32_t image_mask);
+
+   /**
+    * @brief Move a compatible FREE image of @p ancestor into @p image.
+    *
+    * @return true if an image was adopted, false if @p image must be created.
+    */
+   bool adopt_free_image(swapchain_base &ancestor, swapchain_image &image);
+
+   /**
+    * @brief Thread running @ref image_allocator_thread, only started for swapchains with deferred allocation.
+    */
+   std::thread m_image_allocator_thread;
+
+   /**
+    * @brief Set under m_image_status_mutex to stop the image allocator before the next image.
+    */
+   bool m_image_allocator_stop{ false };
+
+   /**
+    * @brief Bit i is set while the image allocator allocates m_swapchain_images[i], acquire does not take such an
+    *        image even though its backend may already have marked it FREE. Changed under m_image_status_mutex, and
+    *        set before the backend marks the image FREE.
+    */
+   std::atomic<uint32_t> m_allocating_images{ 0 };
+
+   /**
+    * @brief Images of @ref allocate_swapchain_images not handed memory yet, see @ref get_pending_allocation_count.
+    *        Changed under m_image_status_mutex.
+    */
+   uint32_t m_pending_allocations{ 0 };
+
+   /**
+    * @brief Signalled under m_image_status_mutex whenever the image allocator finishes an image.
+    */
+   std::condition_variable_any m_image_allocated_cond;
+
    /**
     * @brief Notify the presentation engine with the next image to be presented.
     *
@@ -703,7 +1438,22 @@ private:
    /**
     * @brief A flag to track if swapchain has started presenting.
     */
-   bool m_started_presenting;
+   std::atomic<bool> m_started_presenting;
+
+   /**
+    * @brief Set by @ref set_suboptimal, turns the VK_SUCCESS of acquires and presents into VK_SUBOPTIMAL_KHR.
+    */
+   std::atomic<bool> m_suboptimal{ false };
+
+   /**
+    * @brief Queue of the latest submission signalling a present fence, drained on teardown.
+    */
+   VkQueue m_present_fence_queue{ VK_NULL_HANDLE };
+
+   /**
+    * @brief Set once @ref signal_present_fence submitted to the layer queue, which teardown then drains as well.
+    */
+   std::atomic<bool> m_present_fences_on_layer_queue{ false };
 
    /**
     * @brief Holds the swapchain extensions and related functionalities.
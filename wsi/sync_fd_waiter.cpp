@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file sync_fd_waiter.cpp
+ *
+ * @brief Implementation of the epoll based Sync FD waiter.
+ */
+
+#include "sync_fd_waiter.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "util/log.hpp"
+#include "util/thread_scheduling.hpp"
+
+namespace wsi
+{
+
+/* Events handled per epoll_wait call. */
+static constexpr int MAX_EVENTS = 16;
+
+/* Epoll event id of the wake eventfd. */
+static constexpr uint64_t WAKE_ID = 0;
+
+sync_fd_waiter &sync_fd_waiter::get_instance()
+{
+   static sync_fd_waiter instance;
+   return instance;
+}
+
+sync_fd_waiter::~sync_fd_waiter()
+{
+   if (m_thread.joinable())
+   {
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         m_stop = true;
+      }
+      const uint64_t value = 1;
+      if (write(m_wake_fd, &value, sizeof(value)) == sizeof(value))
+      {
+         m_thread.join();
+      }
+      else
+      {
+         m_thread.detach();
+      }
+   }
+
+   for (const auto &watched : m_watched)
+   {
+      close(watched.fd);
+   }
+   if (m_wake_fd >= 0)
+   {
+      close(m_wake_fd);
+   }
+   if (m_epoll_fd >= 0)
+   {
+      close(m_epoll_fd);
+   }
+}
+
+bool sync_fd_waiter::start()
+{
+   m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+   if (m_epoll_fd < 0)
+   {
+      return false;
+   }
+
+   m_wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   if (m_wake_fd < 0)
+   {
+      return false;
+   }
+
+   epoll_event event = {};
+   event.events = EPOLLIN;
+   event.data.u64 = WAKE_ID;
+   if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &event) != 0)
+   {
+      return false;
+   }
+
+   try
+   {
+      m_thread = std::thread(&sync_fd_waiter::run, this);
+   }
+   catch (const std::system_error &)
+   {
+      return false;
+   }
+   return true;
+}
+
+void sync_fd_waiter::wait_fd(int fd)
+{
+   pollfd poll_fd = { fd, POLLIN, 0 };
+   while (poll(&poll_fd, 1, -1) < 0 && (errno == EINTR || errno == EAGAIN))
+   {
+   }
+}
+
+void sync_fd_waiter::watch(util::fd_owner sync_fd, void *owner, uint32_t data, completion_callback callback)
+{
+   if (!sync_fd.is_valid())
+   {
+      callback(owner, data);
+      return;
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_started)
+      {
+         m_started = true;
+         if (!start())
+         {
+            WSI_LOG_WARNING("Failed to start the Sync FD waiter, present payloads are waited for in place");
+         }
+      }
+
+      if (m_thread.joinable() && add_watch(watched_fd{ 0, sync_fd.get(), owner, data, callback }))
+      {
+         sync_fd.release();
+         return;
+      }
+   }
+
+   wait_fd(sync_fd.get());
+   callback(owner, data);
+}
+
+bool sync_fd_waiter::add_watch(watched_fd watched)
+{
+   watched.id = m_next_id++;
+   try
+   {
+      m_watched.push_back(watched);
+   }
+   catch (const std::bad_alloc &)
+   {
+      return false;
+   }
+
+   epoll_event event = {};
+   event.events = EPOLLIN;
+   event.data.u64 = watched.id;
+   if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, watched.fd, &event) != 0)
+   {
+      m_watched.pop_back();
+      return false;
+   }
+   return true;
+}
+
+void sync_fd_waiter::cancel(void *owner)
+{
+   std::vector<int> fds;
+   {
+      std::lock_guard<std::mutex> dispatch_lock(m_dispatch_mutex);
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto it = m_watched.begin();
+      while (it != m_watched.end())
+      {
+         if (it->owner != owner)
+         {
+            ++it;
+            continue;
+         }
+         epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, it->fd, nullptr);
+         /* Without room to remember it, the Sync FD is waited for while still holding the locks. */
+         try
+         {
+            fds.push_back(it->fd);
+         }
+         catch (const std::bad_alloc &)
+         {
+            wait_fd(it->fd);
+            close(it->fd);
+         }
+         it = m_watched.erase(it);
+      }
+   }
+
+   for (int fd : fds)
+   {
+      wait_fd(fd);
+      close(fd);
+   }
+}
+
+void sync_fd_waiter::run()
+{
+   util::configure_presentation_thread("wsi-sync-fd");
+
+   epoll_event events[MAX_EVENTS];
+   while (true)
+   {
+      const int count = epoll_wait(m_epoll_fd, events, MAX_EVENTS, -1);
+      if (count < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         WSI_LOG_ERROR("Sync FD waiter failed to wait with errno %d", errno);
+         return;
+      }
+
+      std::lock_guard<std::mutex> dispatch_lock(m_dispatch_mutex);
+      for (int i = 0; i < count; i++)
+      {
+         const uint64_t id = events[i].data.u64;
+         std::unique_lock<std::mutex> lock(m_mutex);
+         if (id == WAKE_ID)
+         {
+            if (m_stop)
+            {
+               return;
+            }
+            continue;
+         }
+
+         /* A Sync FD cancelled since epoll_wait returned is no longer in the list. Its fd number may already be
+          * watched again, which is why watches are found by id. */
+         auto it = std::find_if(m_watched.begin(), m_watched.end(),
+                                [id](const watched_fd &watched) { return watched.id == id; });
+         if (it == m_watched.end())
+         {
+            continue;
+         }
+         const watched_fd completed = *it;
+         m_watched.erase(it);
+         epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, completed.fd, nullptr);
+         lock.unlock();
+
+         close(completed.fd);
+         completed.callback(completed.owner, completed.data);
+      }
+   }
+}
+
+} /* namespace wsi */
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file sync_fd_waiter.hpp
+ *
+ * @brief Service waiting for the completion of many Sync FDs from a single thread.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "util/file_descriptor.hpp"
+
+namespace wsi
+{
+
+/**
+ * @brief Process wide thread that waits for exported present payloads with epoll.
+ *
+ * Sync FDs of any swapchain can be watched, each one's callback is called as soon as it signals, whatever the order
+ * the GPU completes them in. A single thread serves all the swapchains of the process.
+ */
+class sync_fd_waiter
+{
+public:
+   /**
+    * @brief Called on the waiter thread once a watched Sync FD signals.
+    *
+    * @param owner Owner the Sync FD was watched for.
+    * @param data  Value given to @ref watch.
+    */
+   using completion_callback = void (*)(void *owner, uint32_t data);
+
+   static sync_fd_waiter &get_instance();
+
+   sync_fd_waiter(const sync_fd_waiter &) = delete;
+   sync_fd_waiter &operator=(const sync_fd_waiter &) = delete;
+
+   ~sync_fd_waiter();
+
+   /**
+    * @brief Call @p callback once @p sync_fd signals.
+    *
+    * The callback is called right away when @p sync_fd is invalid, which is how an already signalled payload is
+    * exported, and on the calling thread after waiting for the Sync FD when the waiter thread cannot be started.
+    *
+    * @param sync_fd  Sync FD to watch, closed once it signals.
+    * @param owner    Passed to @p callback, see @ref cancel.
+    * @param data     Passed to @p callback.
+    * @param callback Function to call, must not call @ref cancel.
+    */
+   void watch(util::fd_owner sync_fd, void *owner, uint32_t data, completion_callback callback);
+
+   /**
+    * @brief Wait for the Sync FDs watched for @p owner without calling their callbacks.
+    *
+    * Once it returns no callback runs for @p owner anymore, which can then be destroyed.
+    */
+   void cancel(void *owner);
+
+private:
+   sync_fd_waiter() = default;
+
+   struct watched_fd
+   {
+      /* Identifies the watch in the epoll events, the fd number may be reused once the Sync FD is closed. */
+      uint64_t id;
+      int fd;
+      void *owner;
+      uint32_t data;
+      completion_callback callback;
+   };
+
+   bool start();
+   void run();
+
+   /* Adds @p watched to the list and the epoll set with a new id, with m_mutex held. */
+   bool add_watch(watched_fd watched);
+
+   /* Waits for @p fd to signal on the calling thread. */
+   static void wait_fd(int fd);
+
+   /* Held while callbacks run, before m_mutex, so @ref cancel can wait for the running ones. */
+   std::mutex m_dispatch_mutex;
+   std::mutex m_mutex;
+   std::vector<watched_fd> m_watched;
+   /* Id of the next watch, 0 identifies the wake eventfd. */
+   uint64_t m_next_id = 1;
+   int m_epoll_fd = -1;
+   /* eventfd waking the thread up to stop it. */
+   int m_wake_fd = -1;
+   bool m_started = false;
+   bool m_stop = false;
+   std::thread m_thread;
+};
+
+} /* namespace wsi */
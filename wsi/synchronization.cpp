@@ -37,6 +37,116 @@
 namespace wsi
 {
 
+present_batch::present_batch(const layer::device_private_data &device, VkQueue queue)
+   : m_device{ device }
+   , m_queue{ queue }
+   , m_submissions{ util::allocator(device.get_allocator(), VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) }
+   , m_semaphores{ util::allocator(device.get_allocator(), VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) }
+   , m_values{ util::allocator(device.get_allocator(), VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) }
+   , m_stages{ util::allocator(device.get_allocator(), VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) }
+   , m_submit_infos{ util::allocator(device.get_allocator(), VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) }
+   , m_timeline_infos{ util::allocator(device.get_allocator(), VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) }
+{
+}
+
+VkResult present_batch::add(VkFence fence, const queue_submit_semaphores &semaphores, const void *submission_pnext,
+                            VkCommandBuffer command_buffer, const uint64_t *wait_values,
+                            const uint64_t *signal_values)
+{
+   /* Same wait stages as sync_queue_submit. */
+   const VkPipelineStageFlags wait_stage =
+      command_buffer != VK_NULL_HANDLE ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+   const submission entry = { static_cast<uint32_t>(m_semaphores.size()),
+                              semaphores.wait_semaphores_count,
+                              semaphores.signal_semaphores_count,
+                              wait_values != nullptr || signal_values != nullptr,
+                              submission_pnext,
+                              command_buffer };
+   for (uint32_t i = 0; i < semaphores.wait_semaphores_count; ++i)
+   {
+      if (!m_semaphores.try_push_back(semaphores.wait_semaphores[i]) ||
+          !m_values.try_push_back(wait_values != nullptr ? wait_values[i] : 0) || !m_stages.try_push_back(wait_stage))
+      {
+         return VK_ERROR_OUT_OF_HOST_MEMORY;
+      }
+   }
+   for (uint32_t i = 0; i < semaphores.signal_semaphores_count; ++i)
+   {
+      if (!m_semaphores.try_push_back(semaphores.signal_semaphores[i]) ||
+          !m_values.try_push_back(signal_values != nullptr ? signal_values[i] : 0) || !m_stages.try_push_back(0))
+      {
+         return VK_ERROR_OUT_OF_HOST_MEMORY;
+      }
+   }
+   if (!m_submissions.try_push_back(entry))
+   {
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
+
+   /* The fence must signal right after this submission and the extension structures may not outlive the caller. */
+   if (fence != VK_NULL_HANDLE || submission_pnext != nullptr)
+   {
+      return flush(fence);
+   }
+   return VK_SUCCESS;
+}
+
+VkResult present_batch::flush(VkFence fence)
+{
+   if (m_submissions.empty() && fence == VK_NULL_HANDLE)
+   {
+      return VK_SUCCESS;
+   }
+
+   /* Sized before any pointer into them is taken. */
+   if (!m_submit_infos.try_resize(m_submissions.size()) || !m_timeline_infos.try_resize(m_submissions.size()))
+   {
+      m_error = (m_error == VK_SUCCESS) ? VK_ERROR_OUT_OF_HOST_MEMORY : m_error;
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
+
+   for (size_t i = 0; i < m_submissions.size(); ++i)
+   {
+      const submission &entry = m_submissions[i];
+      const void *pnext = entry.pnext;
+      if (entry.has_timeline_values)
+      {
+         VkTimelineSemaphoreSubmitInfo &timeline_info = m_timeline_infos[i];
+         timeline_info = {};
+         timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+         timeline_info.pNext = entry.pnext;
+         timeline_info.waitSemaphoreValueCount = entry.wait_count;
+         timeline_info.pWaitSemaphoreValues = m_values.data() + entry.offset;
+         timeline_info.signalSemaphoreValueCount = entry.signal_count;
+         timeline_info.pSignalSemaphoreValues = m_values.data() + entry.offset + entry.wait_count;
+         pnext = &timeline_info;
+      }
+
+      m_submit_infos[i] = { VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                            pnext,
+                            entry.wait_count,
+                            m_semaphores.data() + entry.offset,
+                            m_stages.data() + entry.offset,
+                            entry.command_buffer != VK_NULL_HANDLE ? 1u : 0u,
+                            &entry.command_buffer,
+                            entry.signal_count,
+                            m_semaphores.data() + entry.offset + entry.wait_count };
+   }
+
+   VkResult result = m_device.disp.QueueSubmit(m_queue, static_cast<uint32_t>(m_submit_infos.size()),
+                                               m_submit_infos.data(), fence);
+   m_submissions.clear();
+   m_semaphores.clear();
+   m_values.clear();
+   m_stages.clear();
+   if (result != VK_SUCCESS && m_error == VK_SUCCESS)
+   {
+      m_error = result;
+   }
+   return result;
+}
+
 fence_sync::fence_sync(layer::device_private_data &device, VkFence vk_fence)
    : fence{ vk_fence }
    , has_payload{ false }
@@ -94,7 +204,8 @@ VkResult fence_sync::wait_payload(uint64_t timeout)
    return res;
 }
 
-VkResult fence_sync::set_payload(VkQueue queue, const queue_submit_semaphores &semaphores, const void *submission_pnext)
+VkResult fence_sync::set_payload(VkQueue queue, const queue_submit_semaphores &semaphores, const void *submission_pnext,
+                                 VkCommandBuffer command_buffer, present_batch *batch)
 {
    VkResult result = dev->disp.ResetFences(dev->device, 1, &fence);
    if (result != VK_SUCCESS)
@@ -103,7 +214,8 @@ VkResult fence_sync::set_payload(VkQueue queue, const queue_submit_semaphores &s
    }
    has_payload = false;
 
-   result = sync_queue_submit(*dev, queue, fence, semaphores, submission_pnext);
+   /* The fence makes a batch flush, so the payload is submitted when this returns. */
+   result = sync_queue_submit(*dev, queue, fence, semaphores, submission_pnext, command_buffer, batch);
    if (result == VK_SUCCESS)
    {
       has_payload = true;
@@ -169,14 +281,278 @@ std::optional<util::fd_owner> sync_fd_fence_sync::export_sync_fd()
    return std::nullopt;
 }
 
+timeline_semaphore::timeline_semaphore(layer::device_private_data &device, VkSemaphore vk_semaphore,
+                                       PFN_vkWaitSemaphores wait_semaphores_fn,
+                                       PFN_vkGetSemaphoreCounterValue get_counter_value_fn)
+   : semaphore{ vk_semaphore }
+   , dev{ &device }
+   , wait_semaphores_fn{ wait_semaphores_fn }
+   , get_counter_value_fn{ get_counter_value_fn }
+{
+}
+
+std::optional<timeline_semaphore> timeline_semaphore::create(layer::device_private_data &device, bool exportable)
+{
+   /* The KHR entrypoints are the same functions as the core ones, only one of them may be resolved depending on
+    * how the application enabled the feature. */
+   auto wait_fn = device.disp.get_WaitSemaphores();
+   if (wait_fn == nullptr)
+   {
+      wait_fn = device.disp.get_WaitSemaphoresKHR();
+   }
+   auto counter_fn = device.disp.get_GetSemaphoreCounterValue();
+   if (counter_fn == nullptr)
+   {
+      counter_fn = device.disp.get_GetSemaphoreCounterValueKHR();
+   }
+   if (wait_fn == nullptr || counter_fn == nullptr)
+   {
+      return std::nullopt;
+   }
+
+   VkSemaphoreTypeCreateInfo type_info = {};
+   type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+   type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+   type_info.initialValue = 0;
+   VkExportSemaphoreCreateInfo export_info = {};
+   export_info.sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO;
+   export_info.handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT;
+   if (exportable)
+   {
+      type_info.pNext = &export_info;
+   }
+   VkSemaphoreCreateInfo semaphore_info = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, &type_info, 0 };
+   VkSemaphore semaphore = VK_NULL_HANDLE;
+   VkResult res = device.disp.CreateSemaphore(device.device, &semaphore_info,
+                                              device.get_allocator().get_original_callbacks(), &semaphore);
+   if (res != VK_SUCCESS)
+   {
+      return std::nullopt;
+   }
+   return timeline_semaphore{ device, semaphore, wait_fn, counter_fn };
+}
+
+bool timeline_semaphore::is_export_supported(const layer::device_private_data &device)
+{
+   VkSemaphoreTypeCreateInfo type_info = {};
+   type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+   type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+   VkPhysicalDeviceExternalSemaphoreInfo external_semaphore_info = {};
+   external_semaphore_info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_SEMAPHORE_INFO;
+   external_semaphore_info.pNext = &type_info;
+   external_semaphore_info.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT;
+   VkExternalSemaphoreProperties semaphore_properties = {};
+   semaphore_properties.sType = VK_STRUCTURE_TYPE_EXTERNAL_SEMAPHORE_PROPERTIES;
+   device.instance_data.disp.GetPhysicalDeviceExternalSemaphorePropertiesKHR(
+      device.physical_device, &external_semaphore_info, &semaphore_properties);
+   return semaphore_properties.externalSemaphoreFeatures & VK_EXTERNAL_SEMAPHORE_FEATURE_EXPORTABLE_BIT;
+}
+
+timeline_semaphore::timeline_semaphore(timeline_semaphore &&rhs)
+{
+   *this = std::move(rhs);
+}
+
+timeline_semaphore &timeline_semaphore::operator=(timeline_semaphore &&rhs)
+{
+   std::swap(semaphore, rhs.semaphore);
+   std::swap(dev, rhs.dev);
+   std::swap(wait_semaphores_fn, rhs.wait_semaphores_fn);
+   std::swap(get_counter_value_fn, rhs.get_counter_value_fn);
+   std::swap(last_queue, rhs.last_queue);
+   last_value.store(rhs.last_value.exchange(last_value.load()));
+   completed_value.store(rhs.completed_value.exchange(completed_value.load()));
+   return *this;
+}
+
+timeline_semaphore::~timeline_semaphore()
+{
+   if (semaphore != VK_NULL_HANDLE)
+   {
+      wait_all(UINT64_MAX);
+      dev->disp.DestroySemaphore(dev->device, semaphore, dev->get_allocator().get_original_callbacks());
+   }
+}
+
+std::optional<util::fd_owner> timeline_semaphore::export_opaque_fd()
+{
+   int exported_fd = -1;
+   VkSemaphoreGetFdInfoKHR semaphore_fd_info = {};
+   semaphore_fd_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR;
+   semaphore_fd_info.semaphore = semaphore;
+   semaphore_fd_info.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT;
+
+   VkResult result = dev->disp.GetSemaphoreFdKHR(dev->device, &semaphore_fd_info, &exported_fd);
+   if (result == VK_SUCCESS)
+   {
+      return util::fd_owner(exported_fd);
+   }
+   return std::nullopt;
+}
+
+VkResult timeline_semaphore::submit(VkQueue queue, const queue_submit_semaphores &semaphores,
+                                    const void *submission_pnext, VkCommandBuffer command_buffer,
+                                    present_batch *batch, uint64_t &value)
+{
+   const uint64_t previous_value = last_value.load(std::memory_order_relaxed);
+   const bool order_after_previous = previous_value != 0 && queue != last_queue;
+   const uint32_t wait_count = semaphores.wait_semaphores_count + (order_after_previous ? 1 : 0);
+   const uint32_t signal_count = semaphores.signal_semaphores_count + 1;
+
+   /* Semaphore values are ignored for binary semaphores, but the arrays must cover all the semaphores of the
+    * submission. Keep the common case of a few semaphores off the heap. */
+   constexpr uint32_t inline_semaphore_count = 4;
+   VkSemaphore inline_semaphores[2 * inline_semaphore_count];
+   uint64_t inline_values[2 * inline_semaphore_count] = {};
+   VkSemaphore *semaphore_data = inline_semaphores;
+   uint64_t *value_data = inline_values;
+
+   util::vector<VkSemaphore> semaphore_vector{ util::allocator(dev->get_allocator(),
+                                                               VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) };
+   util::vector<uint64_t> value_vector{ util::allocator(dev->get_allocator(), VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) };
+   if (wait_count > inline_semaphore_count || signal_count > inline_semaphore_count)
+   {
+      const uint32_t total_count = wait_count + signal_count;
+      if (!semaphore_vector.try_resize(total_count) || !value_vector.try_resize(total_count, 0))
+      {
+         return VK_ERROR_OUT_OF_HOST_MEMORY;
+      }
+      semaphore_data = semaphore_vector.data();
+      value_data = value_vector.data();
+   }
+
+   VkSemaphore *wait_semaphores = semaphore_data;
+   uint64_t *wait_values = value_data;
+   VkSemaphore *signal_semaphores = semaphore_data + wait_count;
+   uint64_t *signal_values = value_data + wait_count;
+
+   std::copy_n(semaphores.wait_semaphores, semaphores.wait_semaphores_count, wait_semaphores);
+   if (order_after_previous)
+   {
+      wait_semaphores[wait_count - 1] = semaphore;
+      wait_values[wait_count - 1] = previous_value;
+   }
+   std::copy_n(semaphores.signal_semaphores, semaphores.signal_semaphores_count, signal_semaphores);
+   signal_semaphores[signal_count - 1] = semaphore;
+   signal_values[signal_count - 1] = previous_value + 1;
+
+   const queue_submit_semaphores timeline_semaphores = { wait_semaphores, wait_count, signal_semaphores,
+                                                         signal_count };
+   if (batch != nullptr)
+   {
+      /* Host waits on the value are allowed before the batch is flushed. */
+      TRY(batch->add(VK_NULL_HANDLE, timeline_semaphores, submission_pnext, command_buffer, wait_values,
+                     signal_values));
+   }
+   else
+   {
+      VkTimelineSemaphoreSubmitInfo timeline_info = {};
+      timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+      timeline_info.pNext = submission_pnext;
+      timeline_info.waitSemaphoreValueCount = wait_count;
+      timeline_info.pWaitSemaphoreValues = wait_values;
+      timeline_info.signalSemaphoreValueCount = signal_count;
+      timeline_info.pSignalSemaphoreValues = signal_values;
+      TRY(sync_queue_submit(*dev, queue, VK_NULL_HANDLE, timeline_semaphores, &timeline_info, command_buffer));
+   }
+
+   last_queue = queue;
+   last_value.store(previous_value + 1, std::memory_order_release);
+   value = previous_value + 1;
+   return VK_SUCCESS;
+}
+
+VkResult timeline_semaphore::wait(uint64_t value, uint64_t timeout)
+{
+   uint64_t completed = completed_value.load(std::memory_order_acquire);
+   if (value <= completed)
+   {
+      return VK_SUCCESS;
+   }
+
+   if (timeout == 0)
+   {
+      TRY(get_counter_value_fn(dev->device, semaphore, &completed));
+      if (completed < value)
+      {
+         return VK_TIMEOUT;
+      }
+   }
+   else
+   {
+      VkSemaphoreWaitInfo wait_info = {};
+      wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+      wait_info.semaphoreCount = 1;
+      wait_info.pSemaphores = &semaphore;
+      wait_info.pValues = &value;
+      VkResult res = wait_semaphores_fn(dev->device, &wait_info, timeout);
+      if (res != VK_SUCCESS)
+      {
+         return res;
+      }
+      completed = value;
+   }
+
+   /* Another thread may have seen a later value already, only ever move the cached value forward. */
+   uint64_t cached = completed_value.load(std::memory_order_relaxed);
+   while (cached < completed && !completed_value.compare_exchange_weak(cached, completed, std::memory_order_release,
+                                                                       std::memory_order_relaxed))
+   {
+   }
+   return VK_SUCCESS;
+}
+
+timeline_sync::timeline_sync(timeline_sync &&rhs)
+{
+   *this = std::move(rhs);
+}
+
+timeline_sync &timeline_sync::operator=(timeline_sync &&rhs)
+{
+   std::swap(timeline, rhs.timeline);
+   std::swap(value, rhs.value);
+   return *this;
+}
+
+timeline_sync::~timeline_sync()
+{
+   wait_payload(UINT64_MAX);
+}
+
+VkResult timeline_sync::wait_payload(uint64_t timeout)
+{
+   if (value == 0)
+   {
+      return VK_SUCCESS;
+   }
+   return timeline->wait(value, timeout);
+}
+
+VkResult timeline_sync::set_payload(VkQueue queue, const queue_submit_semaphores &semaphores,
+                                    const void *submission_pnext, VkCommandBuffer command_buffer,
+                                    present_batch *batch)
+{
+   value = 0;
+   return timeline->submit(queue, semaphores, submission_pnext, command_buffer, batch, value);
+}
+
 VkResult sync_queue_submit(const layer::device_private_data &device, VkQueue queue, VkFence fence,
-                           const queue_submit_semaphores &semaphores, const void *submission_pnext)
+                           const queue_submit_semaphores &semaphores, const void *submission_pnext,
+                           VkCommandBuffer command_buffer, present_batch *batch)
 {
+   if (batch != nullptr)
+   {
+      /* The batch was made for the same queue. */
+      return batch->add(fence, semaphores, submission_pnext, command_buffer);
+   }
+
    /* When the semaphore that comes in is signalled, we know that all work is done. So, we do not
     * want to block any future Vulkan queue work on it. So, we pass in BOTTOM_OF_PIPE bit as the
-    * wait flag.
+    * wait flag. Layer transfer work must wait though, so it waits at the transfer stage.
     */
-   VkPipelineStageFlags pipeline_stage_flag = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+   const VkPipelineStageFlags wait_stage =
+      command_buffer != VK_NULL_HANDLE ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+   VkPipelineStageFlags pipeline_stage_flag = wait_stage;
    VkPipelineStageFlags *pipeline_stage_flag_data = &pipeline_stage_flag;
 
    util::vector<VkPipelineStageFlags> pipeline_stage_flags_vector{ util::allocator(
@@ -188,8 +564,7 @@ VkResult sync_queue_submit(const layer::device_private_data &device, VkQueue que
       {
          return VK_ERROR_OUT_OF_HOST_MEMORY;
       }
-      std::fill(pipeline_stage_flags_vector.begin(), pipeline_stage_flags_vector.end(),
-                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+      std::fill(pipeline_stage_flags_vector.begin(), pipeline_stage_flags_vector.end(), wait_stage);
       pipeline_stage_flag_data = pipeline_stage_flags_vector.data();
    }
 
@@ -198,8 +573,8 @@ VkResult sync_queue_submit(const layer::device_private_data &device, VkQueue que
                                 semaphores.wait_semaphores_count,
                                 semaphores.wait_semaphores,
                                 pipeline_stage_flag_data,
-                                0,
-                                nullptr,
+                                command_buffer != VK_NULL_HANDLE ? 1u : 0u,
+                                &command_buffer,
                                 semaphores.signal_semaphores_count,
                                 semaphores.signal_semaphores };
 
@@ -30,8 +30,10 @@
 
 #pragma once
 
+#include <atomic>
 #include <optional>
 
+#include "util/custom_allocator.hpp"
 #include "util/file_descriptor.hpp"
 
 #include <vulkan/vulkan.h>
@@ -53,6 +55,78 @@ struct queue_submit_semaphores
    uint32_t signal_semaphores_count;
 };
 
+/**
+ * Submissions of a vkQueuePresentKHR call, coalesced into as few vkQueueSubmit calls as possible.
+ *
+ * Submissions that signal a fence, or carry extension structures whose lifetime ends with the caller, cannot wait
+ * for the end of the present and flush the batch, in order, right away. The others wait for @ref flush.
+ */
+class present_batch
+{
+public:
+   /**
+    * @param device The device private data the submissions are for.
+    * @param queue  The queue all the submissions of the batch go to.
+    */
+   present_batch(const layer::device_private_data &device, VkQueue queue);
+
+   present_batch(const present_batch &) = delete;
+   present_batch &operator=(const present_batch &) = delete;
+
+   /**
+    * Adds a submission to the batch, see @ref sync_queue_submit for the parameters.
+    *
+    * @param wait_values   Timeline values for the wait semaphores, or nullptr if they are all binary.
+    * @param signal_values Timeline values for the signal semaphores, or nullptr if they are all binary.
+    *
+    * @return VK_SUCCESS on success, an appropriate error code otherwise.
+    */
+   VkResult add(VkFence fence, const queue_submit_semaphores &semaphores, const void *submission_pnext,
+                VkCommandBuffer command_buffer, const uint64_t *wait_values = nullptr,
+                const uint64_t *signal_values = nullptr);
+
+   /**
+    * Submits the pending submissions with a single vkQueueSubmit.
+    *
+    * @param fence Fence signalled once all of them complete, or VK_NULL_HANDLE.
+    *
+    * @return VK_SUCCESS on success, or the error of vkQueueSubmit.
+    */
+   VkResult flush(VkFence fence = VK_NULL_HANDLE);
+
+   /**
+    * @return The error of the first flush that failed, VK_SUCCESS if none did.
+    */
+   VkResult get_error() const
+   {
+      return m_error;
+   }
+
+private:
+   struct submission
+   {
+      /* Wait semaphores first, then signal semaphores, from offset in m_semaphores. */
+      uint32_t offset;
+      uint32_t wait_count;
+      uint32_t signal_count;
+      bool has_timeline_values;
+      const void *pnext;
+      VkCommandBuffer command_buffer;
+   };
+
+   const layer::device_private_data &m_device;
+   VkQueue m_queue;
+   util::vector<submission> m_submissions;
+   /* Semaphores, values and wait stages of all the submissions, one entry per semaphore. */
+   util::vector<VkSemaphore> m_semaphores;
+   util::vector<uint64_t> m_values;
+   util::vector<VkPipelineStageFlags> m_stages;
+   /* Built by flush, kept to reuse their storage. */
+   util::vector<VkSubmitInfo> m_submit_infos;
+   util::vector<VkTimelineSemaphoreSubmitInfo> m_timeline_infos;
+   VkResult m_error = VK_SUCCESS;
+};
+
 /**
  * Synchronization using a Vulkan Fence object.
  */
@@ -97,11 +171,14 @@ public:
     * @param     queue  The Vulkan queue that may be used to submit synchronization commands.
     * @param     semaphores The wait and signal semaphores.
     * @param     submission_pnext   Chain of pointers to attach to the payload submission.
+    * @param     command_buffer     Optional layer work to execute as part of the payload.
+    * @param     batch              Batch to add the payload submission to, or nullptr to submit it right away.
     *
     * @return VK_SUCCESS on success or other error code on failing to set the payload.
     */
    VkResult set_payload(VkQueue queue, const queue_submit_semaphores &semaphores,
-                        const void *submission_pnext = nullptr);
+                        const void *submission_pnext = nullptr, VkCommandBuffer command_buffer = VK_NULL_HANDLE,
+                        present_batch *batch = nullptr);
 
 protected:
    /**
@@ -185,7 +262,176 @@ private:
 };
 
 /**
- * @brief Submit an empty queue operation for synchronization.
+ * Timeline semaphore shared by all the presents of a swapchain. Each payload signals the next value of the timeline,
+ * so completion is a counter comparison and no per-image fence needs resetting.
+ */
+class timeline_semaphore
+{
+public:
+   /**
+    * Creates a new timeline semaphore with an initial value of 0.
+    *
+    * @param device     The device private data for which to create it. Timeline semaphores must be enabled on it,
+    *                   see layer::device_private_data::is_timeline_semaphore_enabled.
+    * @param exportable Whether the semaphore can be exported with @ref export_opaque_fd, see
+    *                   @ref is_export_supported.
+    *
+    * @return Empty optional on failure or initialized timeline semaphore.
+    */
+   static std::optional<timeline_semaphore> create(layer::device_private_data &device, bool exportable = false);
+
+   /**
+    * Checks if timeline semaphores of a device can be exported to opaque FDs.
+    *
+    * @param device The device private data to check support for. VK_KHR_external_semaphore_fd must be enabled on it.
+    *
+    * @return true if supported, false otherwise.
+    */
+   static bool is_export_supported(const layer::device_private_data &device);
+
+   timeline_semaphore() = default;
+   timeline_semaphore(const timeline_semaphore &) = delete;
+   timeline_semaphore &operator=(const timeline_semaphore &) = delete;
+
+   timeline_semaphore(timeline_semaphore &&rhs);
+   timeline_semaphore &operator=(timeline_semaphore &&rhs);
+
+   ~timeline_semaphore();
+
+   /**
+    * Submits a payload that signals the next value of the timeline.
+    *
+    * Submissions to a different queue than the previous one also wait for the previous value, so the
+    * timeline keeps increasing even when the application presents from several queues.
+    *
+    * @note This method is not threadsafe, it relies on the external synchronization of the swapchain in
+    *       vkQueuePresentKHR.
+    *
+    * @param      queue            The Vulkan queue to submit to.
+    * @param      semaphores       The wait and signal semaphores.
+    * @param      submission_pnext Chain of pointers to attach to the payload submission.
+    * @param      command_buffer   Optional layer work to execute as part of the payload.
+    * @param      batch            Batch to add the submission to, or nullptr to submit it right away.
+    * @param[out] value            Timeline value signalled once the payload completes.
+    *
+    * @return VK_SUCCESS on success or other error code on failing to submit the payload.
+    */
+   VkResult submit(VkQueue queue, const queue_submit_semaphores &semaphores, const void *submission_pnext,
+                   VkCommandBuffer command_buffer, present_batch *batch, uint64_t &value);
+
+   /**
+    * Waits for the timeline to reach @p value.
+    *
+    * @note This method may be called concurrently with @ref submit.
+    *
+    * @param value   Timeline value to wait for.
+    * @param timeout Timeout for waiting in nanoseconds.
+    *
+    * @return VK_SUCCESS once the value is reached, VK_TIMEOUT or other error code otherwise.
+    */
+   VkResult wait(uint64_t value, uint64_t timeout);
+
+   /**
+    * Waits for every payload submitted so far with a single wait.
+    *
+    * @param timeout Timeout for waiting in nanoseconds.
+    */
+   VkResult wait_all(uint64_t timeout)
+   {
+      return wait(last_value.load(std::memory_order_acquire), timeout);
+   }
+
+   /**
+    * Exports the semaphore to an opaque FD. On DRM drivers this is a DRM syncobj sharing the timeline.
+    *
+    * @note The semaphore must have been created exportable.
+    *
+    * @return The exported FD on success or empty optional on failure.
+    */
+   std::optional<util::fd_owner> export_opaque_fd();
+
+   VkSemaphore get_semaphore() const
+   {
+      return semaphore;
+   }
+
+private:
+   timeline_semaphore(layer::device_private_data &device, VkSemaphore vk_semaphore,
+                      PFN_vkWaitSemaphores wait_semaphores_fn, PFN_vkGetSemaphoreCounterValue get_counter_value_fn);
+
+   VkSemaphore semaphore{ VK_NULL_HANDLE };
+   layer::device_private_data *dev{ nullptr };
+   /* Resolved once, from the core or the VK_KHR_timeline_semaphore entrypoints, to keep waits off the dispatch
+    * table lookup. */
+   PFN_vkWaitSemaphores wait_semaphores_fn{ nullptr };
+   PFN_vkGetSemaphoreCounterValue get_counter_value_fn{ nullptr };
+   /* Queue of the previous submission, see @ref submit. */
+   VkQueue last_queue{ VK_NULL_HANDLE };
+   /* Value signalled by the latest submission. */
+   std::atomic<uint64_t> last_value{ 0 };
+   /* Highest value known to be reached, which lets waits for completed payloads skip the driver. */
+   std::atomic<uint64_t> completed_value{ 0 };
+};
+
+/**
+ * Synchronization using a value of a swapchain's timeline semaphore, with the same interface as @ref fence_sync.
+ */
+class timeline_sync
+{
+public:
+   timeline_sync() = default;
+
+   /**
+    * @param timeline Timeline semaphore of the swapchain, it must outlive this object.
+    */
+   explicit timeline_sync(timeline_semaphore &timeline)
+      : timeline{ &timeline }
+   {
+   }
+
+   timeline_sync(const timeline_sync &) = delete;
+   timeline_sync &operator=(const timeline_sync &) = delete;
+
+   timeline_sync(timeline_sync &&rhs);
+   timeline_sync &operator=(timeline_sync &&rhs);
+
+   ~timeline_sync();
+
+   /**
+    * Waits for any pending payload to complete execution.
+    *
+    * @param timeout Timeout for waiting in nanoseconds.
+    *
+    * @return VK_SUCCESS on success or if no payload or a completed payload is set.
+    *         Other error code on failure or timeout.
+    */
+   VkResult wait_payload(uint64_t timeout);
+
+   /**
+    * Sets the payload that would need to complete before operations that wait on it.
+    *
+    * @note This method is not threadsafe.
+    *
+    * @param     queue  The Vulkan queue that may be used to submit synchronization commands.
+    * @param     semaphores The wait and signal semaphores.
+    * @param     submission_pnext   Chain of pointers to attach to the payload submission.
+    * @param     command_buffer     Optional layer work to execute as part of the payload.
+    * @param     batch              Batch to add the payload submission to, or nullptr to submit it right away.
+    *
+    * @return VK_SUCCESS on success or other error code on failing to set the payload.
+    */
+   VkResult set_payload(VkQueue queue, const queue_submit_semaphores &semaphores,
+                        const void *submission_pnext = nullptr, VkCommandBuffer command_buffer = VK_NULL_HANDLE,
+                        present_batch *batch = nullptr);
+
+private:
+   timeline_semaphore *timeline{ nullptr };
+   /* Timeline value of the current payload, 0 when there is none. */
+   uint64_t value{ 0 };
+};
+
+/**
+ * @brief Submit a queue operation for synchronization.
  *
  * @param device     The device private data for the fence.
  * @param queue      The Vulkan queue that may be used to submit synchronization commands.
@@ -193,9 +439,13 @@ private:
  *                   of a fence to be signalled.
  * @param semaphores The wait and signal semaphores.
  * @param submission_pnext Chain of pointers to attach to the payload submission.
+ * @param command_buffer   Transfer work to run once the wait semaphores are signalled, or VK_NULL_HANDLE
+ *                         for an empty submission.
+ * @param batch            Batch to add the submission to, or nullptr to submit it right away.
  *
  * @return VK_SUCCESS on success, an appropiate error code otherwise.
  */
 VkResult sync_queue_submit(const layer::device_private_data &device, VkQueue queue, VkFence fence,
-                           const queue_submit_semaphores &semaphores, const void *submission_pnext = nullptr);
+                           const queue_submit_semaphores &semaphores, const void *submission_pnext = nullptr,
+                           VkCommandBuffer command_buffer = VK_NULL_HANDLE, present_batch *batch = nullptr);
 } /* namespace wsi */
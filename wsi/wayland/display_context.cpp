@@ -0,0 +1,425 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ * @file display_context.cpp
+ *
+ * @brief Implementation of the globals and formats shared by the surfaces of a Wayland display.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#include "display_context.hpp"
+#include "dmabuf_feedback.hpp"
+#include "util/log.hpp"
+
+namespace wsi
+{
+namespace wayland
+{
+
+struct formats_vector
+{
+   util::vector<drm_format_pair> *formats{ nullptr };
+   bool is_out_of_memory{ false };
+};
+
+namespace
+{
+/* Handler for format event of the zwp_linux_dmabuf_v1 interface. */
+VWL_CAPI_CALL(void)
+zwp_linux_dmabuf_v1_format_impl(void *data, struct zwp_linux_dmabuf_v1 *dma_buf, uint32_t drm_format) VWL_API_POST
+{
+   UNUSED(data);
+   UNUSED(dma_buf);
+   UNUSED(drm_format);
+}
+
+/* Handler for modifier event of the zwp_linux_dmabuf_v1 interface. */
+VWL_CAPI_CALL(void)
+zwp_linux_dmabuf_v1_modifier_impl(void *data, struct zwp_linux_dmabuf_v1 *dma_buf, uint32_t drm_format,
+                                  uint32_t modifier_hi, uint32_t modifier_low) VWL_API_POST
+{
+   UNUSED(dma_buf);
+   auto *drm_supported_formats = reinterpret_cast<formats_vector *>(data);
+
+   drm_format_pair format = {};
+   format.fourcc = drm_format;
+   format.modifier = (static_cast<uint64_t>(modifier_hi) << 32) | modifier_low;
+
+   if (!drm_supported_formats->is_out_of_memory)
+   {
+      drm_supported_formats->is_out_of_memory = !drm_supported_formats->formats->try_push_back(format);
+   }
+}
+} // namespace
+
+/*
+ * @brief Get supported formats and modifiers using the zwp_linux_dmabuf_v1 interface.
+ *
+ * @param[in]  display               The wl_display that is being used.
+ * @param[in]  queue                 The wl_event_queue set for the @p dmabuf_interface
+ * @param[in]  dmabuf_interface      Object of the zwp_linux_dmabuf_v1 interface.
+ * @param[out] supported_formats     Vector which will contain the supported drm
+ *                                   formats and their modifiers.
+ *
+ * @retval VK_SUCCESS                    Indicates success.
+ * @retval VK_ERROR_UNKNOWN              Indicates one of the Wayland functions failed.
+ * @retval VK_ERROR_OUT_OF_DEVICE_MEMORY Indicates the host went out of memory.
+ */
+static VkResult get_supported_formats_and_modifiers(wl_display *display, wl_event_queue *queue,
+                                                    zwp_linux_dmabuf_v1 *dmabuf_interface,
+                                                    util::vector<drm_format_pair> &supported_formats)
+{
+   formats_vector drm_supported_formats;
+   drm_supported_formats.formats = &supported_formats;
+
+   static const zwp_linux_dmabuf_v1_listener dma_buf_listener = {
+      .format = zwp_linux_dmabuf_v1_format_impl,
+      .modifier = zwp_linux_dmabuf_v1_modifier_impl,
+   };
+   int res = zwp_linux_dmabuf_v1_add_listener(dmabuf_interface, &dma_buf_listener, &drm_supported_formats);
+   if (res < 0)
+   {
+      WSI_LOG_ERROR("Failed to add zwp_linux_dmabuf_v1 listener.");
+      return VK_ERROR_UNKNOWN;
+   }
+
+   /* Get all modifier events. */
+   res = wl_display_roundtrip_queue(display, queue);
+   if (res < 0)
+   {
+      WSI_LOG_ERROR("Roundtrip failed.");
+      return VK_ERROR_UNKNOWN;
+   }
+
+   if (drm_supported_formats.is_out_of_memory)
+   {
+      WSI_LOG_ERROR("Host got out of memory.");
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
+
+   return VK_SUCCESS;
+}
+
+/*
+ * @brief Get supported formats and modifiers from the default zwp_linux_dmabuf_feedback_v1 of the compositor.
+ *
+ * From version 4 of zwp_linux_dmabuf_v1 the compositor no longer sends the modifier events, the formats are in the
+ * tranches of the feedback objects instead.
+ *
+ * @param[in]  display               The wl_display that is being used.
+ * @param[in]  queue                 The wl_event_queue set for the @p dmabuf_interface
+ * @param[in]  dmabuf_interface      Object of the zwp_linux_dmabuf_v1 interface.
+ * @param[out] supported_formats     Vector which will contain the supported drm
+ *                                   formats and their modifiers.
+ *
+ * @retval VK_SUCCESS                    Indicates success.
+ * @retval VK_ERROR_UNKNOWN              Indicates one of the Wayland functions failed.
+ * @retval VK_ERROR_OUT_OF_HOST_MEMORY   Indicates the host went out of memory.
+ */
+static VkResult get_default_feedback_formats(wl_display *display, wl_event_queue *queue,
+                                             zwp_linux_dmabuf_v1 *dmabuf_interface,
+                                             util::vector<drm_format_pair> &supported_formats)
+{
+   dmabuf_feedback feedback(
+      util::allocator(supported_formats.get_allocator().get_data(), VK_SYSTEM_ALLOCATION_SCOPE_COMMAND));
+   if (!feedback.init(zwp_linux_dmabuf_v1_get_default_feedback(dmabuf_interface)))
+   {
+      WSI_LOG_ERROR("Failed to get the default zwp_linux_dmabuf_feedback_v1.");
+      return VK_ERROR_UNKNOWN;
+   }
+
+   while (feedback.get_generation() == 0)
+   {
+      if (wl_display_roundtrip_queue(display, queue) < 0)
+      {
+         WSI_LOG_ERROR("Roundtrip failed.");
+         return VK_ERROR_UNKNOWN;
+      }
+   }
+
+   if (feedback.is_out_of_memory() || !feedback.get_formats(supported_formats))
+   {
+      WSI_LOG_ERROR("Host got out of memory.");
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
+
+   return VK_SUCCESS;
+}
+
+VWL_CAPI_CALL(void)
+presentation_clock_id(void *data, struct wp_presentation *presentation, uint32_t clk_id) VWL_API_POST
+{
+   UNUSED(presentation);
+   auto context = reinterpret_cast<wsi::wayland::display_context *>(data);
+   context->presentation_clock = static_cast<clockid_t>(clk_id);
+}
+
+static const struct wp_presentation_listener presentation_listener = { presentation_clock_id };
+
+VWL_CAPI_CALL(void)
+display_registry_handler(void *data, struct wl_registry *wl_registry, uint32_t name, const char *interface,
+                         uint32_t version) VWL_API_POST
+{
+   auto context = reinterpret_cast<wsi::wayland::display_context *>(data);
+
+   if (!strcmp(interface, zwp_linux_dmabuf_v1_interface.name) && version >= ZWP_LINUX_DMABUF_V1_MODIFIER_SINCE_VERSION)
+   {
+      /* Version 4 adds the feedback objects, which tell which formats the compositor can scan out. */
+      const uint32_t bind_version =
+         std::min(version, static_cast<uint32_t>(ZWP_LINUX_DMABUF_V1_GET_SURFACE_FEEDBACK_SINCE_VERSION));
+      zwp_linux_dmabuf_v1 *dmabuf_interface_obj = reinterpret_cast<zwp_linux_dmabuf_v1 *>(
+         wl_registry_bind(wl_registry, name, &zwp_linux_dmabuf_v1_interface, bind_version));
+
+      if (dmabuf_interface_obj == nullptr)
+      {
+         WSI_LOG_ERROR("Failed to get zwp_linux_dmabuf_v1 interface.");
+         return;
+      }
+
+      context->dmabuf_interface.reset(dmabuf_interface_obj);
+   }
+   else if (!strcmp(interface, zwp_linux_explicit_synchronization_v1_interface.name))
+   {
+      zwp_linux_explicit_synchronization_v1 *explicit_sync_interface_obj =
+         reinterpret_cast<zwp_linux_explicit_synchronization_v1 *>(
+            wl_registry_bind(wl_registry, name, &zwp_linux_explicit_synchronization_v1_interface, 1));
+
+      if (explicit_sync_interface_obj == nullptr)
+      {
+         WSI_LOG_ERROR("Failed to get zwp_linux_explicit_synchronization_v1 interface.");
+         return;
+      }
+
+      context->explicit_sync_interface.reset(explicit_sync_interface_obj);
+   }
+   else if (!strcmp(interface, wp_linux_drm_syncobj_manager_v1_interface.name))
+   {
+      wp_linux_drm_syncobj_manager_v1 *syncobj_manager_obj = reinterpret_cast<wp_linux_drm_syncobj_manager_v1 *>(
+         wl_registry_bind(wl_registry, name, &wp_linux_drm_syncobj_manager_v1_interface, 1));
+
+      if (syncobj_manager_obj == nullptr)
+      {
+         WSI_LOG_ERROR("Failed to get wp_linux_drm_syncobj_manager_v1 interface.");
+         return;
+      }
+
+      context->syncobj_manager_interface.reset(syncobj_manager_obj);
+   }
+   else if (!strcmp(interface, wp_fifo_manager_v1_interface.name))
+   {
+      wp_fifo_manager_v1 *fifo_manager_obj =
+         reinterpret_cast<wp_fifo_manager_v1 *>(wl_registry_bind(wl_registry, name, &wp_fifo_manager_v1_interface, 1));
+
+      if (fifo_manager_obj == nullptr)
+      {
+         WSI_LOG_ERROR("Failed to get wp_fifo_manager_v1 interface.");
+         return;
+      }
+
+      context->fifo_manager_interface.reset(fifo_manager_obj);
+   }
+   else if (!strcmp(interface, wp_commit_timing_manager_v1_interface.name))
+   {
+      wp_commit_timing_manager_v1 *commit_timing_manager_obj = reinterpret_cast<wp_commit_timing_manager_v1 *>(
+         wl_registry_bind(wl_registry, name, &wp_commit_timing_manager_v1_interface, 1));
+
+      if (commit_timing_manager_obj == nullptr)
+      {
+         WSI_LOG_ERROR("Failed to get wp_commit_timing_manager_v1 interface.");
+         return;
+      }
+
+      context->commit_timing_manager_interface.reset(commit_timing_manager_obj);
+   }
+   else if (!strcmp(interface, wp_tearing_control_manager_v1_interface.name))
+   {
+      wp_tearing_control_manager_v1 *tearing_control_manager_obj = reinterpret_cast<wp_tearing_control_manager_v1 *>(
+         wl_registry_bind(wl_registry, name, &wp_tearing_control_manager_v1_interface, 1));
+
+      if (tearing_control_manager_obj == nullptr)
+      {
+         WSI_LOG_ERROR("Failed to get wp_tearing_control_manager_v1 interface.");
+         return;
+      }
+
+      context->tearing_control_manager_interface.reset(tearing_control_manager_obj);
+   }
+   else if (!strcmp(interface, wp_viewporter_interface.name))
+   {
+      wp_viewporter *viewporter_obj =
+         reinterpret_cast<wp_viewporter *>(wl_registry_bind(wl_registry, name, &wp_viewporter_interface, 1));
+
+      if (viewporter_obj == nullptr)
+      {
+         WSI_LOG_ERROR("Failed to get wp_viewporter interface.");
+         return;
+      }
+
+      context->viewporter_interface.reset(viewporter_obj);
+   }
+   else if (!strcmp(interface, wp_presentation_interface.name))
+   {
+      wp_presentation *wp_presentation_obj =
+         reinterpret_cast<wp_presentation *>(wl_registry_bind(wl_registry, name, &wp_presentation_interface, 1));
+
+      if (wp_presentation_obj == nullptr)
+      {
+         WSI_LOG_ERROR("Failed to get wp_presentation interface.");
+         return;
+      }
+
+      /* The clock_id event follows the bind, it is dispatched by the next roundtrip of the display queue. */
+      wp_presentation_add_listener(wp_presentation_obj, &presentation_listener, context);
+      context->presentation_time_interface.reset(wp_presentation_obj);
+   }
+}
+
+std::shared_ptr<display_context> display_context::get(wl_display *display)
+{
+   /* The contexts are owned by the surfaces, the list only finds the context of a display while one is alive. */
+   static std::mutex contexts_mutex;
+   static util::vector<std::weak_ptr<display_context>> contexts(util::allocator::get_generic());
+
+   std::lock_guard<std::mutex> lock(contexts_mutex);
+   contexts.erase(std::remove_if(contexts.begin(), contexts.end(),
+                                 [](const std::weak_ptr<display_context> &entry) { return entry.expired(); }),
+                  contexts.end());
+   for (const auto &entry : contexts)
+   {
+      auto context = entry.lock();
+      if (context != nullptr && context->get_wl_display() == display)
+      {
+         return context;
+      }
+   }
+
+   std::shared_ptr<display_context> context;
+   try
+   {
+      context = std::make_shared<display_context>(display);
+   }
+   catch (const std::bad_alloc &)
+   {
+      WSI_LOG_ERROR("Failed to allocate the Wayland display context.");
+      return nullptr;
+   }
+
+   if (!context->init())
+   {
+      return nullptr;
+   }
+
+   if (!contexts.try_push_back(context))
+   {
+      /* The context still works, only the following surfaces of the display cannot share it. */
+      WSI_LOG_WARNING("Failed to record the Wayland display context.");
+   }
+
+   return context;
+}
+
+display_context::display_context(wl_display *display)
+   : wayland_display(display)
+   , display_queue(nullptr)
+   , supported_formats(util::allocator::get_generic())
+{
+}
+
+display_context::~display_context() = default;
+
+bool display_context::init()
+{
+   display_queue.reset(wl_display_create_queue(wayland_display));
+   if (display_queue.get() == nullptr)
+   {
+      WSI_LOG_ERROR("Failed to create wl display queue.");
+      return false;
+   }
+
+   auto display_proxy = make_proxy_with_queue(wayland_display, display_queue.get());
+   if (display_proxy == nullptr)
+   {
+      WSI_LOG_ERROR("Failed to create wl display proxy.");
+      return false;
+   };
+
+   auto registry = wayland_owner<wl_registry>{ wl_display_get_registry(display_proxy.get()) };
+   if (registry == nullptr)
+   {
+      WSI_LOG_ERROR("Failed to get wl display registry.");
+      return false;
+   }
+
+   static const wl_registry_listener registry_listener = { display_registry_handler, nullptr };
+   int res = wl_registry_add_listener(registry.get(), &registry_listener, this);
+   if (res < 0)
+   {
+      WSI_LOG_ERROR("Failed to add registry listener.");
+      return false;
+   }
+
+   res = wl_display_roundtrip_queue(wayland_display, display_queue.get());
+   if (res < 0)
+   {
+      WSI_LOG_ERROR("Roundtrip failed.");
+      return false;
+   }
+
+   if (dmabuf_interface.get() == nullptr)
+   {
+      WSI_LOG_ERROR("Failed to obtain zwp_linux_dma_buf_v1 interface.");
+      return false;
+   }
+
+   if (presentation_time_interface.get() == nullptr)
+   {
+      WSI_LOG_ERROR("Failed to obtain wp_presentation interface.");
+      //return false;
+   }
+
+   VkResult vk_res = VK_SUCCESS;
+   if (has_dmabuf_feedback())
+   {
+      vk_res = get_default_feedback_formats(wayland_display, display_queue.get(), dmabuf_interface.get(),
+                                            supported_formats);
+   }
+   else
+   {
+      vk_res = get_supported_formats_and_modifiers(wayland_display, display_queue.get(), dmabuf_interface.get(),
+                                                   supported_formats);
+   }
+   if (vk_res != VK_SUCCESS)
+   {
+      return false;
+   }
+
+   return true;
+}
+
+} // namespace wayland
+} // namespace wsi
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ * @file display_context.hpp
+ *
+ * @brief Globals and formats of a Wayland display, shared by all the surfaces created on it.
+ */
+
+#pragma once
+
+#include <ctime>
+#include <memory>
+
+#ifndef __STDC_VERSION__
+#define __STDC_VERSION__ 0
+#endif
+#include <wayland-client.h>
+
+#include "wsi/surface.hpp"
+#include "wl_object_owner.hpp"
+#include "util/custom_allocator.hpp"
+#include "util/macros.hpp"
+
+namespace wsi
+{
+namespace wayland
+{
+
+/**
+ * Wayland callback for global wl_registry events to handle global objects required by @ref wsi::wayland::surface
+ */
+VWL_CAPI_CALL(void)
+display_registry_handler(void *data, struct wl_registry *wl_registry, uint32_t name, const char *interface,
+                         uint32_t version) VWL_API_POST;
+
+/**
+ * Wayland callback for the clock_id event of wp_presentation, records the clock on the
+ * @ref wsi::wayland::display_context
+ */
+VWL_CAPI_CALL(void)
+presentation_clock_id(void *data, struct wp_presentation *presentation, uint32_t clk_id) VWL_API_POST;
+
+/**
+ * @brief The globals bound from the registry of a wl_display and the dma-buf formats of its compositor.
+ *
+ * Binding the globals and collecting the formats takes several roundtrips, which only the first surface of a display
+ * pays. The context lives as long as a surface of the display uses it, so it never outlives the display.
+ */
+class display_context
+{
+public:
+   /**
+    * @brief Get the context of @p display, creating it for the first surface of the display.
+    *
+    * @return The context, or nullptr on failure.
+    */
+   static std::shared_ptr<display_context> get(wl_display *display);
+
+   explicit display_context(wl_display *display);
+   ~display_context();
+
+   display_context(const display_context &) = delete;
+   display_context &operator=(const display_context &) = delete;
+
+   wl_display *get_wl_display() const
+   {
+      return wayland_display;
+   }
+
+   zwp_linux_dmabuf_v1 *get_dmabuf_interface() const
+   {
+      return dmabuf_interface.get();
+   }
+
+   /**
+    * @brief Whether the zwp_linux_dmabuf_v1 binding supports the feedback objects.
+    */
+   bool has_dmabuf_feedback() const
+   {
+      return zwp_linux_dmabuf_v1_get_version(dmabuf_interface.get()) >=
+             ZWP_LINUX_DMABUF_V1_GET_SURFACE_FEEDBACK_SINCE_VERSION;
+   }
+
+   zwp_linux_explicit_synchronization_v1 *get_explicit_sync_interface() const
+   {
+      return explicit_sync_interface.get();
+   }
+
+   wp_linux_drm_syncobj_manager_v1 *get_syncobj_manager() const
+   {
+      return syncobj_manager_interface.get();
+   }
+
+   wp_fifo_manager_v1 *get_fifo_manager() const
+   {
+      return fifo_manager_interface.get();
+   }
+
+   wp_commit_timing_manager_v1 *get_commit_timing_manager() const
+   {
+      return commit_timing_manager_interface.get();
+   }
+
+   wp_tearing_control_manager_v1 *get_tearing_control_manager() const
+   {
+      return tearing_control_manager_interface.get();
+   }
+
+   wp_viewporter *get_viewporter() const
+   {
+      return viewporter_interface.get();
+   }
+
+   wp_presentation *get_presentation_time_interface() const
+   {
+      return presentation_time_interface.get();
+   }
+
+   clockid_t get_presentation_clock() const
+   {
+      return presentation_clock;
+   }
+
+   /**
+    * @brief The DRM formats and modifiers the compositor imports.
+    */
+   const util::vector<drm_format_pair> &get_formats() const
+   {
+      return supported_formats;
+   }
+
+private:
+   /**
+    * @brief Bind the globals and collect the formats.
+    *
+    * @return true on success, false otherwise.
+    */
+   bool init();
+
+   friend void display_registry_handler(void *data, struct wl_registry *wl_registry, uint32_t name,
+                                        const char *interface, uint32_t version) VWL_API_POST;
+   friend void presentation_clock_id(void *data, struct wp_presentation *presentation, uint32_t clk_id) VWL_API_POST;
+
+   wl_display *wayland_display;
+
+   /**
+    * Container for a private queue the globals are bound on.
+    * It should be destroyed after the objects that attached to it.
+    */
+   wayland_owner<wl_event_queue> display_queue;
+
+   /** A list of DRM formats supported by the Wayland compositor */
+   util::vector<drm_format_pair> supported_formats;
+
+   /** Container for the zwp_linux_dmabuf_v1 interface binding */
+   wayland_owner<zwp_linux_dmabuf_v1> dmabuf_interface;
+   /** Container for the zwp_linux_explicit_synchronization_v1 interface binding */
+   wayland_owner<zwp_linux_explicit_synchronization_v1> explicit_sync_interface;
+   /** Container for the wp_linux_drm_syncobj_manager_v1 interface binding */
+   wayland_owner<wp_linux_drm_syncobj_manager_v1> syncobj_manager_interface;
+   /** Container for the wp_fifo_manager_v1 interface binding */
+   wayland_owner<wp_fifo_manager_v1> fifo_manager_interface;
+   /** Container for the wp_commit_timing_manager_v1 interface binding */
+   wayland_owner<wp_commit_timing_manager_v1> commit_timing_manager_interface;
+   /** Container for the wp_tearing_control_manager_v1 interface binding */
+   wayland_owner<wp_tearing_control_manager_v1> tearing_control_manager_interface;
+   /** Container for the wp_viewporter interface binding */
+   wayland_owner<wp_viewporter> viewporter_interface;
+   /** Container for the wp_presentation interface binding */
+   wayland_owner<wp_presentation> presentation_time_interface;
+   /** Clock of the presentation timestamps, sent by the compositor when wp_presentation is bound. */
+   clockid_t presentation_clock{ CLOCK_MONOTONIC };
+};
+
+} // namespace wayland
+} // namespace wsi
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ * @file dmabuf_feedback.cpp
+ *
+ * @brief Tracking of the zwp_linux_dmabuf_feedback_v1 tranches of a surface or of the compositor.
+ */
+
+#include "dmabuf_feedback.hpp"
+
+#include <algorithm>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "util/log.hpp"
+#include "util/macros.hpp"
+
+namespace wsi
+{
+namespace wayland
+{
+
+namespace
+{
+/* Bias of the ranks of the tranches that are not for scanout, so all scanout tranches come first. */
+constexpr uint32_t NON_SCANOUT_RANK_BIAS = 1u << 16;
+
+VWL_CAPI_CALL(void)
+dmabuf_feedback_done(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback) VWL_API_POST
+{
+   UNUSED(feedback);
+   reinterpret_cast<dmabuf_feedback *>(data)->handle_done();
+}
+
+VWL_CAPI_CALL(void)
+dmabuf_feedback_format_table(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback, int32_t fd,
+                             uint32_t size) VWL_API_POST
+{
+   UNUSED(feedback);
+   reinterpret_cast<dmabuf_feedback *>(data)->handle_format_table(fd, size);
+}
+
+VWL_CAPI_CALL(void)
+dmabuf_feedback_main_device(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback,
+                            struct wl_array *device) VWL_API_POST
+{
+   UNUSED(data);
+   UNUSED(feedback);
+   UNUSED(device);
+}
+
+VWL_CAPI_CALL(void)
+dmabuf_feedback_tranche_done(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback) VWL_API_POST
+{
+   UNUSED(feedback);
+   reinterpret_cast<dmabuf_feedback *>(data)->handle_tranche_done();
+}
+
+VWL_CAPI_CALL(void)
+dmabuf_feedback_tranche_target_device(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback,
+                                      struct wl_array *device) VWL_API_POST
+{
+   /* Buffers are allocated by the layer for the device of the swapchain, whichever device the tranche targets. */
+   UNUSED(data);
+   UNUSED(feedback);
+   UNUSED(device);
+}
+
+VWL_CAPI_CALL(void)
+dmabuf_feedback_tranche_formats(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback,
+                                struct wl_array *indices) VWL_API_POST
+{
+   UNUSED(feedback);
+   reinterpret_cast<dmabuf_feedback *>(data)->handle_tranche_formats(indices);
+}
+
+VWL_CAPI_CALL(void)
+dmabuf_feedback_tranche_flags(void *data, struct zwp_linux_dmabuf_feedback_v1 *feedback, uint32_t flags) VWL_API_POST
+{
+   UNUSED(feedback);
+   reinterpret_cast<dmabuf_feedback *>(data)->handle_tranche_flags(flags);
+}
+
+const zwp_linux_dmabuf_feedback_v1_listener dmabuf_feedback_listener = {
+   .done = dmabuf_feedback_done,
+   .format_table = dmabuf_feedback_format_table,
+   .main_device = dmabuf_feedback_main_device,
+   .tranche_done = dmabuf_feedback_tranche_done,
+   .tranche_target_device = dmabuf_feedback_tranche_target_device,
+   .tranche_formats = dmabuf_feedback_tranche_formats,
+   .tranche_flags = dmabuf_feedback_tranche_flags,
+};
+} // namespace
+
+dmabuf_feedback::dmabuf_feedback(const util::allocator &allocator)
+   : m_pending_formats(allocator)
+   , m_formats(allocator)
+{
+}
+
+dmabuf_feedback::~dmabuf_feedback()
+{
+   m_feedback.reset();
+   unmap_format_table();
+}
+
+bool dmabuf_feedback::init(zwp_linux_dmabuf_feedback_v1 *feedback)
+{
+   m_feedback.reset(feedback);
+   if (feedback == nullptr)
+   {
+      return false;
+   }
+   return zwp_linux_dmabuf_feedback_v1_add_listener(feedback, &dmabuf_feedback_listener, this) == 0;
+}
+
+void dmabuf_feedback::unmap_format_table()
+{
+   if (m_format_table != nullptr)
+   {
+      munmap(const_cast<format_table_entry *>(m_format_table), m_format_table_size * sizeof(format_table_entry));
+      m_format_table = nullptr;
+      m_format_table_size = 0;
+   }
+}
+
+void dmabuf_feedback::handle_format_table(int32_t fd, uint32_t size)
+{
+   /* A new table replaces the previous one, the following tranches index it. */
+   unmap_format_table();
+   void *table = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (table == MAP_FAILED)
+   {
+      WSI_LOG_ERROR("Failed to map the dmabuf feedback format table.");
+      return;
+   }
+   m_format_table = reinterpret_cast<const format_table_entry *>(table);
+   m_format_table_size = size / sizeof(format_table_entry);
+}
+
+void dmabuf_feedback::handle_tranche_flags(uint32_t flags)
+{
+   m_pending_tranche_scanout = (flags & ZWP_LINUX_DMABUF_FEEDBACK_V1_TRANCHE_FLAGS_SCANOUT) != 0;
+}
+
+void dmabuf_feedback::handle_tranche_formats(const wl_array *indices)
+{
+   const uint32_t rank = m_pending_tranche_count + (m_pending_tranche_scanout ? 0 : NON_SCANOUT_RANK_BIAS);
+   const auto *index = static_cast<const uint16_t *>(indices->data);
+   const size_t index_count = indices->size / sizeof(uint16_t);
+   for (size_t i = 0; i < index_count; i++)
+   {
+      if (index[i] >= m_format_table_size)
+      {
+         continue;
+      }
+      const format_table_entry &entry = m_format_table[index[i]];
+      if (!m_pending_formats.try_push_back(ranked_format{ { entry.format, entry.modifier }, rank }))
+      {
+         m_out_of_memory = true;
+         return;
+      }
+   }
+}
+
+void dmabuf_feedback::handle_tranche_done()
+{
+   m_pending_tranche_count++;
+   m_pending_tranche_scanout = false;
+}
+
+void dmabuf_feedback::handle_done()
+{
+   /* Every update resends all the tranches. */
+   {
+      std::lock_guard<std::mutex> lock(m_formats_mutex);
+      m_formats.swap(m_pending_formats);
+   }
+   m_pending_formats.clear();
+   m_pending_tranche_count = 0;
+   m_pending_tranche_scanout = false;
+   m_generation.fetch_add(1, std::memory_order_release);
+}
+
+uint32_t dmabuf_feedback::get_rank(const drm_format_pair &format)
+{
+   std::lock_guard<std::mutex> lock(m_formats_mutex);
+   uint32_t rank = RANK_UNSUPPORTED;
+   for (const auto &entry : m_formats)
+   {
+      if (entry.format.fourcc == format.fourcc && entry.format.modifier == format.modifier)
+      {
+         rank = std::min(rank, entry.rank);
+      }
+   }
+   return rank;
+}
+
+bool dmabuf_feedback::get_formats(util::vector<drm_format_pair> &formats)
+{
+   std::lock_guard<std::mutex> lock(m_formats_mutex);
+   for (const auto &entry : m_formats)
+   {
+      const bool duplicate = std::any_of(formats.begin(), formats.end(), [&entry](const drm_format_pair &format) {
+         return format.fourcc == entry.format.fourcc && format.modifier == entry.format.modifier;
+      });
+      if (!duplicate && !formats.try_push_back(entry.format))
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+} // namespace wayland
+} // namespace wsi
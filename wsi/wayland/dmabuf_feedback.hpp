@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ * @file dmabuf_feedback.hpp
+ *
+ * @brief Tracking of the zwp_linux_dmabuf_feedback_v1 tranches of a surface or of the compositor.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "wsi/surface.hpp"
+#include "util/custom_allocator.hpp"
+#include "wl_object_owner.hpp"
+
+namespace wsi
+{
+namespace wayland
+{
+
+/**
+ * @brief Formats a compositor prefers, from the tranches of a zwp_linux_dmabuf_feedback_v1 object.
+ *
+ * Tranches come in the compositor's order of preference. Tranches flagged SCANOUT hold the formats the compositor can
+ * put straight on a plane, buffers in one of them skip composition when the surface covers the output.
+ *
+ * The events may be dispatched on another thread than the one querying the formats.
+ */
+class dmabuf_feedback
+{
+public:
+   /** Rank of the formats that are in none of the tranches, see @ref get_rank. */
+   static constexpr uint32_t RANK_UNSUPPORTED = UINT32_MAX;
+
+   explicit dmabuf_feedback(const util::allocator &allocator);
+   ~dmabuf_feedback();
+
+   dmabuf_feedback(const dmabuf_feedback &) = delete;
+   dmabuf_feedback &operator=(const dmabuf_feedback &) = delete;
+
+   /**
+    * @brief Start listening to @p feedback, which this object takes the ownership of.
+    *
+    * The caller dispatches the queue of @p feedback until @ref get_generation is not 0 to get the first tranches.
+    *
+    * @return true on success, false otherwise.
+    */
+   bool init(zwp_linux_dmabuf_feedback_v1 *feedback);
+
+   /**
+    * @brief Number of feedback updates received so far, 0 until the first one is complete.
+    */
+   uint64_t get_generation() const
+   {
+      return m_generation.load(std::memory_order_acquire);
+   }
+
+   /**
+    * @brief Preference of the compositor for @p format, lower is better.
+    *
+    * Scanout tranches rank before every other tranche, then tranches keep the compositor's order.
+    *
+    * @return The rank, or @ref RANK_UNSUPPORTED when no tranche has @p format.
+    */
+   uint32_t get_rank(const drm_format_pair &format);
+
+   /**
+    * @brief Copy the formats of all the tranches, without duplicates, to @p formats.
+    *
+    * @return false when the host ran out of memory, true otherwise.
+    */
+   bool get_formats(util::vector<drm_format_pair> &formats);
+
+   /**
+    * @brief Whether an event could not be handled because the host ran out of memory.
+    */
+   bool is_out_of_memory() const
+   {
+      return m_out_of_memory;
+   }
+
+   /* Handlers of the zwp_linux_dmabuf_feedback_v1 events. */
+   void handle_format_table(int32_t fd, uint32_t size);
+   void handle_tranche_flags(uint32_t flags);
+   void handle_tranche_formats(const wl_array *indices);
+   void handle_tranche_done();
+   void handle_done();
+
+private:
+   /**
+    * @brief Entry of the format table shared by the compositor.
+    */
+   struct format_table_entry
+   {
+      uint32_t format;
+      uint32_t padding;
+      uint64_t modifier;
+   };
+
+   /**
+    * @brief Format of a tranche, with its rank.
+    */
+   struct ranked_format
+   {
+      drm_format_pair format;
+      uint32_t rank;
+   };
+
+   void unmap_format_table();
+
+   wayland_owner<zwp_linux_dmabuf_feedback_v1> m_feedback;
+
+   /* Only accessed by the thread dispatching the events. */
+   const format_table_entry *m_format_table{ nullptr };
+   size_t m_format_table_size{ 0 };
+   uint32_t m_pending_tranche_count{ 0 };
+   bool m_pending_tranche_scanout{ false };
+   util::vector<ranked_format> m_pending_formats;
+   bool m_out_of_memory{ false };
+
+   /* Formats of the last complete feedback, guarded by @ref m_formats_mutex. */
+   std::mutex m_formats_mutex;
+   util::vector<ranked_format> m_formats;
+   std::atomic<uint64_t> m_generation{ 0 };
+};
+
+} // namespace wayland
+} // namespace wsi
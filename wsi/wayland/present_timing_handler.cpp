@@ -36,11 +36,24 @@ wsi_ext_present_timing_wayland::wsi_ext_present_timing_wayland(const util::alloc
 }
 
 util::unique_ptr<wsi_ext_present_timing_wayland> wsi_ext_present_timing_wayland::create(
-   const util::allocator &allocator)
+   const util::allocator &allocator, clockid_t presentation_clock)
 {
-   std::array<util::unique_ptr<wsi::vulkan_time_domain>, 1> time_domains_array = {
+   /* Compositors normally use CLOCK_MONOTONIC, any other clock has no Vulkan time domain to calibrate against. */
+   VkTimeDomainKHR presentation_domain = VK_TIME_DOMAIN_PRESENT_STAGE_LOCAL_EXT;
+   if (presentation_clock == CLOCK_MONOTONIC)
+   {
+      presentation_domain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_KHR;
+   }
+   else if (presentation_clock == CLOCK_MONOTONIC_RAW)
+   {
+      presentation_domain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_RAW_KHR;
+   }
+
+   std::array<util::unique_ptr<wsi::vulkan_time_domain>, 2> time_domains_array = {
       allocator.make_unique<wsi::vulkan_time_domain>(VK_PRESENT_STAGE_QUEUE_OPERATIONS_END_BIT_EXT,
-                                                     VK_TIME_DOMAIN_DEVICE_KHR)
+                                                     VK_TIME_DOMAIN_DEVICE_KHR),
+      allocator.make_unique<wsi::vulkan_time_domain>(VK_PRESENT_STAGE_IMAGE_FIRST_PIXEL_VISIBLE_BIT_EXT,
+                                                     presentation_domain)
    };
 
    return wsi_ext_present_timing::create<wsi_ext_present_timing_wayland>(allocator, time_domains_array);
@@ -49,9 +62,21 @@ util::unique_ptr<wsi_ext_present_timing_wayland> wsi_ext_present_timing_wayland:
 VkResult wsi_ext_present_timing_wayland::get_swapchain_timing_properties(
    uint64_t &timing_properties_counter, VkSwapchainTimingPropertiesEXT &timing_properties)
 {
-   timing_properties_counter = 0;
-   timing_properties.refreshDuration = 0;
-   timing_properties.variableRefreshDelay = 0;
+   std::lock_guard<std::mutex> lock(m_refresh_mutex);
+   timing_properties_counter = m_timing_properties_counter;
+   timing_properties.refreshDuration = m_refresh_duration;
+   timing_properties.variableRefreshDelay = m_variable_refresh ? UINT64_MAX : 0;
 
    return VK_SUCCESS;
+}
+
+void wsi_ext_present_timing_wayland::update_refresh(uint64_t refresh_ns, bool vsync)
+{
+   std::lock_guard<std::mutex> lock(m_refresh_mutex);
+   if (refresh_ns != m_refresh_duration || !vsync != m_variable_refresh)
+   {
+      m_refresh_duration = refresh_ns;
+      m_variable_refresh = !vsync;
+      m_timing_properties_counter++;
+   }
 }
\ No newline at end of file
@@ -31,6 +31,9 @@
 
 #if VULKAN_WSI_LAYER_EXPERIMENTAL
 
+#include <ctime>
+#include <mutex>
+
 #include <wsi/extensions/present_timing.hpp>
 
 /**
@@ -41,14 +44,33 @@
 class wsi_ext_present_timing_wayland : public wsi::wsi_ext_present_timing
 {
 public:
-   static util::unique_ptr<wsi_ext_present_timing_wayland> create(const util::allocator &allocator);
+   /**
+    * @param presentation_clock Clock of the compositor's presentation timestamps, see surface::get_presentation_clock.
+    */
+   static util::unique_ptr<wsi_ext_present_timing_wayland> create(const util::allocator &allocator,
+                                                                  clockid_t presentation_clock);
 
    VkResult get_swapchain_timing_properties(uint64_t &timing_properties_counter,
                                             VkSwapchainTimingPropertiesEXT &timing_properties) override;
 
+   /**
+    * @brief Record the refresh interval reported with a presented commit.
+    *
+    * @param refresh_ns Refresh interval in nanoseconds, 0 when the compositor does not know it.
+    * @param vsync      Whether the commit was presented in sync with the refresh, WP_PRESENTATION_FEEDBACK_KIND_VSYNC.
+    */
+   void update_refresh(uint64_t refresh_ns, bool vsync);
+
 private:
    wsi_ext_present_timing_wayland(const util::allocator &allocator);
 
+   std::mutex m_refresh_mutex;
+   uint64_t m_refresh_duration{ 0 };
+   /* Whether presents are not tied to the refresh, so they may come variableRefreshDelay late. */
+   bool m_variable_refresh{ false };
+   /* Incremented whenever the timing properties change, starting from 0 for unknown properties. */
+   uint64_t m_timing_properties_counter{ 0 };
+
    /* Allow util::allocator to access the private constructor */
    friend util::allocator;
 };
@@ -26,223 +26,160 @@
  * @brief Implementation of a Wayland WSI Surface
  */
 
+#include <cassert>
+
 #include "surface.hpp"
 #include "swapchain.hpp"
 #include "surface_properties.hpp"
 #include "wl_object_owner.hpp"
 #include "wl_helpers.hpp"
 #include "util/log.hpp"
+#include "util/tuning_profile.hpp"
 
 namespace wsi
 {
 namespace wayland
 {
 
-struct formats_vector
-{
-   util::vector<drm_format_pair> *formats{ nullptr };
-   bool is_out_of_memory{ false };
-};
-
-namespace
-{
-/* Handler for format event of the zwp_linux_dmabuf_v1 interface. */
-VWL_CAPI_CALL(void)
-zwp_linux_dmabuf_v1_format_impl(void *data, struct zwp_linux_dmabuf_v1 *dma_buf, uint32_t drm_format) VWL_API_POST
-{
-   UNUSED(data);
-   UNUSED(dma_buf);
-   UNUSED(drm_format);
-}
-
-/* Handler for modifier event of the zwp_linux_dmabuf_v1 interface. */
-VWL_CAPI_CALL(void)
-zwp_linux_dmabuf_v1_modifier_impl(void *data, struct zwp_linux_dmabuf_v1 *dma_buf, uint32_t drm_format,
-                                  uint32_t modifier_hi, uint32_t modifier_low) VWL_API_POST
-{
-   UNUSED(dma_buf);
-   auto *drm_supported_formats = reinterpret_cast<formats_vector *>(data);
-
-   drm_format_pair format = {};
-   format.fourcc = drm_format;
-   format.modifier = (static_cast<uint64_t>(modifier_hi) << 32) | modifier_low;
-
-   if (!drm_supported_formats->is_out_of_memory)
-   {
-      drm_supported_formats->is_out_of_memory = !drm_supported_formats->formats->try_push_back(format);
-   }
-}
-} // namespace
-
-/*
- * @brief Get supported formats and modifiers using the zwp_linux_dmabuf_v1 interface.
- *
- * @param[in]  display               The wl_display that is being used.
- * @param[in]  queue                 The wl_event_queue set for the @p dmabuf_interface
- * @param[in]  dmabuf_interface      Object of the zwp_linux_dmabuf_v1 interface.
- * @param[out] supported_formats     Vector which will contain the supported drm
- *                                   formats and their modifiers.
- *
- * @retval VK_SUCCESS                    Indicates success.
- * @retval VK_ERROR_UNKNOWN              Indicates one of the Wayland functions failed.
- * @retval VK_ERROR_OUT_OF_DEVICE_MEMORY Indicates the host went out of memory.
- */
-static VkResult get_supported_formats_and_modifiers(wl_display *display, wl_event_queue *queue,
-                                                    zwp_linux_dmabuf_v1 *dmabuf_interface,
-                                                    util::vector<drm_format_pair> &supported_formats)
-{
-   formats_vector drm_supported_formats;
-   drm_supported_formats.formats = &supported_formats;
-
-   const zwp_linux_dmabuf_v1_listener dma_buf_listener = {
-      .format = zwp_linux_dmabuf_v1_format_impl,
-      .modifier = zwp_linux_dmabuf_v1_modifier_impl,
-   };
-   int res = zwp_linux_dmabuf_v1_add_listener(dmabuf_interface, &dma_buf_listener, &drm_supported_formats);
-   if (res < 0)
-   {
-      WSI_LOG_ERROR("Failed to add zwp_linux_dmabuf_v1 listener.");
-      return VK_ERROR_UNKNOWN;
-   }
-
-   /* Get all modifier events. */
-   res = wl_display_roundtrip_queue(display, queue);
-   if (res < 0)
-   {
-      WSI_LOG_ERROR("Roundtrip failed.");
-      return VK_ERROR_UNKNOWN;
-   }
-
-   if (drm_supported_formats.is_out_of_memory)
-   {
-      WSI_LOG_ERROR("Host got out of memory.");
-      return VK_ERROR_OUT_OF_HOST_MEMORY;
-   }
-
-   return VK_SUCCESS;
-}
-
 struct surface::init_parameters
 {
    const util::allocator &allocator;
-   wl_display *display;
    wl_surface *surf;
 };
 
 surface::surface(const init_parameters &params)
    : wsi::surface()
-   , wayland_display(params.display)
+   , context(nullptr)
    , surface_queue(nullptr)
    , wayland_surface(params.surf)
-   , supported_formats(params.allocator)
    , properties(this, params.allocator)
    , last_frame_callback(nullptr)
    , present_pending(false)
+   , frame_events_starved(false)
 {
 }
 
-VWL_CAPI_CALL(void)
-surface_registry_handler(void *data, struct wl_registry *wl_registry, uint32_t name, const char *interface,
-                         uint32_t version) VWL_API_POST
+bool surface::init(wl_display *display)
 {
-   auto wsi_surface = reinterpret_cast<wsi::wayland::surface *>(data);
-
-   if (!strcmp(interface, zwp_linux_dmabuf_v1_interface.name) && version >= ZWP_LINUX_DMABUF_V1_MODIFIER_SINCE_VERSION)
+   context = display_context::get(display);
+   if (context == nullptr)
    {
-      zwp_linux_dmabuf_v1 *dmabuf_interface_obj = reinterpret_cast<zwp_linux_dmabuf_v1 *>(wl_registry_bind(
-         wl_registry, name, &zwp_linux_dmabuf_v1_interface, ZWP_LINUX_DMABUF_V1_MODIFIER_SINCE_VERSION));
-
-      if (dmabuf_interface_obj == nullptr)
-      {
-         WSI_LOG_ERROR("Failed to get zwp_linux_dmabuf_v1 interface.");
-         return;
-      }
+      return false;
+   }
 
-      wsi_surface->dmabuf_interface.reset(dmabuf_interface_obj);
+   surface_queue.reset(wl_display_create_queue(context->get_wl_display()));
+   if (surface_queue.get() == nullptr)
+   {
+      WSI_LOG_ERROR("Failed to create wl surface queue.");
+      return false;
    }
-   else if (!strcmp(interface, zwp_linux_explicit_synchronization_v1_interface.name))
+
+   if (!init_surface_sync())
    {
-      zwp_linux_explicit_synchronization_v1 *explicit_sync_interface_obj =
-         reinterpret_cast<zwp_linux_explicit_synchronization_v1 *>(
-            wl_registry_bind(wl_registry, name, &zwp_linux_explicit_synchronization_v1_interface, 1));
+      return false;
+   }
 
-      if (explicit_sync_interface_obj == nullptr)
+   /* Neither object constrains commits until a request is made on it, so they can live as long as the surface.
+    * They must be created on the surface the buffers are committed to, and a wl_surface only has one of each, so
+    * an application creating its own for this surface gets a protocol error. The README documents it. */
+   if (context->get_fifo_manager() != nullptr)
+   {
+      fifo_interface.reset(wp_fifo_manager_v1_get_fifo(context->get_fifo_manager(), wayland_surface));
+      if (fifo_interface.get() == nullptr)
       {
-         WSI_LOG_ERROR("Failed to get zwp_linux_explicit_synchronization_v1 interface.");
-         return;
+         WSI_LOG_ERROR("Failed to retrieve surface fifo interface");
+         return false;
       }
-
-      wsi_surface->explicit_sync_interface.reset(explicit_sync_interface_obj);
    }
-   else if (!strcmp(interface, wp_presentation_interface.name))
-   {
-      wp_presentation *wp_presentation_obj =
-         reinterpret_cast<wp_presentation *>(wl_registry_bind(wl_registry, name, &wp_presentation_interface, 1));
 
-      if (wp_presentation_obj == nullptr)
+   if (context->get_commit_timing_manager() != nullptr)
+   {
+      commit_timer_interface.reset(
+         wp_commit_timing_manager_v1_get_timer(context->get_commit_timing_manager(), wayland_surface));
+      if (commit_timer_interface.get() == nullptr)
       {
-         WSI_LOG_ERROR("Failed to get wp_presentation interface.");
-         return;
+         WSI_LOG_ERROR("Failed to retrieve surface commit timer interface");
+         return false;
       }
-
-      wsi_surface->presentation_time_interface.reset(wp_presentation_obj);
    }
-}
 
-bool surface::init()
-{
-   surface_queue.reset(wl_display_create_queue(wayland_display));
-   if (surface_queue.get() == nullptr)
+   /* A surface has a single tearing control, the hint it holds is shared by all the swapchains of the surface. */
+   if (context->get_tearing_control_manager() != nullptr)
    {
-      WSI_LOG_ERROR("Failed to create wl surface queue.");
-      return false;
+      tearing_control_interface.reset(wp_tearing_control_manager_v1_get_tearing_control(
+         context->get_tearing_control_manager(), wayland_surface));
+      if (tearing_control_interface.get() == nullptr)
+      {
+         WSI_LOG_ERROR("Failed to retrieve surface tearing control interface");
+         return false;
+      }
    }
 
-   auto display_proxy = make_proxy_with_queue(wayland_display, surface_queue.get());
-   if (display_proxy == nullptr)
-   {
-      WSI_LOG_ERROR("Failed to create wl display proxy.");
-      return false;
-   };
-
-   auto registry = wayland_owner<wl_registry>{ wl_display_get_registry(display_proxy.get()) };
-   if (registry == nullptr)
+   /* Without a source or destination set the viewport leaves the surface as it is. */
+   if (context->get_viewporter() != nullptr)
    {
-      WSI_LOG_ERROR("Failed to get wl display registry.");
-      return false;
+      viewport_interface.reset(wp_viewporter_get_viewport(context->get_viewporter(), wayland_surface));
+      if (viewport_interface.get() == nullptr)
+      {
+         WSI_LOG_ERROR("Failed to retrieve surface viewport interface");
+         return false;
+      }
    }
 
-   const wl_registry_listener registry_listener = { surface_registry_handler, nullptr };
-   int res = wl_registry_add_listener(registry.get(), &registry_listener, this);
-   if (res < 0)
-   {
-      WSI_LOG_ERROR("Failed to add registry listener.");
-      return false;
-   }
+   return true;
+}
 
-   res = wl_display_roundtrip_queue(wayland_display, surface_queue.get());
-   if (res < 0)
+void surface::set_presentation_hint(bool async)
+{
+   if (tearing_control_interface.get() != nullptr && async != presentation_hint_async)
    {
-      WSI_LOG_ERROR("Roundtrip failed.");
-      return false;
+      wp_tearing_control_v1_set_presentation_hint(tearing_control_interface.get(),
+                                                  async ? WP_TEARING_CONTROL_V1_PRESENTATION_HINT_ASYNC :
+                                                          WP_TEARING_CONTROL_V1_PRESENTATION_HINT_VSYNC);
+      presentation_hint_async = async;
    }
+}
 
-   if (dmabuf_interface.get() == nullptr)
+void surface::set_viewport(const VkRect2D &source, const VkExtent2D &destination)
+{
+   assert(viewport_interface.get() != nullptr);
+   std::lock_guard<std::mutex> lock(viewport_mutex);
+   if (viewport_active && viewport_source.offset.x == source.offset.x && viewport_source.offset.y == source.offset.y &&
+       viewport_source.extent.width == source.extent.width && viewport_source.extent.height == source.extent.height &&
+       viewport_destination.width == destination.width && viewport_destination.height == destination.height)
    {
-      WSI_LOG_ERROR("Failed to obtain zwp_linux_dma_buf_v1 interface.");
-      return false;
+      return;
    }
 
-   if (presentation_time_interface.get() == nullptr)
+   wp_viewport_set_source(viewport_interface.get(), wl_fixed_from_int(source.offset.x),
+                          wl_fixed_from_int(source.offset.y), wl_fixed_from_int(source.extent.width),
+                          wl_fixed_from_int(source.extent.height));
+   wp_viewport_set_destination(viewport_interface.get(), destination.width, destination.height);
+   viewport_active = true;
+   viewport_source = source;
+   viewport_destination = destination;
+}
+
+void surface::clear_viewport()
+{
+   std::lock_guard<std::mutex> lock(viewport_mutex);
+   if (viewport_active)
    {
-      WSI_LOG_ERROR("Failed to obtain wp_presentation interface.");
-      //return false;
+      /* -1 unsets the source and the destination, the surface takes the buffer size again. */
+      wp_viewport_set_source(viewport_interface.get(), wl_fixed_from_int(-1), wl_fixed_from_int(-1),
+                             wl_fixed_from_int(-1), wl_fixed_from_int(-1));
+      wp_viewport_set_destination(viewport_interface.get(), -1, -1);
+      viewport_active = false;
    }
+}
 
-   if (explicit_sync_interface.get() != nullptr)
+bool surface::init_surface_sync()
+{
+   if (context->get_explicit_sync_interface() != nullptr)
    {
       auto surface_sync_obj =
-         zwp_linux_explicit_synchronization_v1_get_synchronization(explicit_sync_interface.get(), wayland_surface);
+         zwp_linux_explicit_synchronization_v1_get_synchronization(context->get_explicit_sync_interface(),
+                                                                   wayland_surface);
       if (surface_sync_obj == nullptr)
       {
          WSI_LOG_ERROR("Failed to retrieve surface synchronization interface");
@@ -251,24 +188,75 @@ bool surface::init()
 
       surface_sync_interface.reset(surface_sync_obj);
    }
+   return true;
+}
 
-   VkResult vk_res = get_supported_formats_and_modifiers(wayland_display, surface_queue.get(), dmabuf_interface.get(),
-                                                         supported_formats);
-   if (vk_res != VK_SUCCESS)
+zwp_linux_surface_synchronization_v1 *surface::get_surface_sync_interface()
+{
+   std::lock_guard<std::mutex> lock(syncobj_surface_mutex);
+   if (surface_sync_interface == nullptr)
    {
-      return false;
+      return nullptr;
    }
+   surface_sync_users++;
+   return surface_sync_interface.get();
+}
 
-   return true;
+void surface::put_surface_sync_interface()
+{
+   std::lock_guard<std::mutex> lock(syncobj_surface_mutex);
+   assert(surface_sync_users > 0);
+   surface_sync_users--;
+}
+
+wp_linux_drm_syncobj_surface_v1 *surface::get_syncobj_surface()
+{
+   std::lock_guard<std::mutex> lock(syncobj_surface_mutex);
+   if (syncobj_surface_users == 0)
+   {
+      /* The swapchains presenting with the surface synchronization interface still need it. */
+      if (context->get_syncobj_manager() == nullptr || surface_sync_users != 0)
+      {
+         return nullptr;
+      }
+
+      surface_sync_interface.reset();
+      auto syncobj_surface_obj = wp_linux_drm_syncobj_manager_v1_get_surface(context->get_syncobj_manager(),
+                                                                             wayland_surface);
+      if (syncobj_surface_obj == nullptr)
+      {
+         WSI_LOG_ERROR("Failed to retrieve syncobj surface interface");
+         init_surface_sync();
+         return nullptr;
+      }
+      syncobj_surface_interface.reset(syncobj_surface_obj);
+   }
+
+   syncobj_surface_users++;
+   return syncobj_surface_interface.get();
+}
+
+void surface::put_syncobj_surface()
+{
+   std::lock_guard<std::mutex> lock(syncobj_surface_mutex);
+   assert(syncobj_surface_users > 0);
+   if (--syncobj_surface_users == 0)
+   {
+      syncobj_surface_interface.reset();
+      if (!init_surface_sync())
+      {
+         WSI_LOG_WARNING("Failed to restore the surface synchronization interface, presents are implicitly synced.");
+      }
+   }
 }
 
 util::unique_ptr<surface> surface::make_surface(const util::allocator &allocator, wl_display *display, wl_surface *surf)
 {
-   init_parameters params{ allocator, display, surf };
+   init_parameters params{ allocator, surf };
    auto wsi_surface = allocator.make_unique<surface>(params);
    if (wsi_surface != nullptr)
    {
-      if (wsi_surface->init())
+      if (wsi_surface->init(display))
       {
          return wsi_surface;
       }
@@ -341,11 +329,15 @@ bool surface::wait_next_frame_event()
     * we sent. If the compositor isn't sending us frame events at least every second
     * we don't wait indefinitely so we don't block the next image presentation if
     * we are, e.g. minimised.
+    *
+    * With the hidden_present_interval_ms tuning a timeout instead marks the surface as hidden and keeps the frame
+    * request pending. Its event arrives once the surface is shown again, until then the queue is only polled.
     */
-   const int timeout = 1000;
+   const bool throttle_hidden = util::tuning_profile::get().hidden_present_interval_ms != 0;
+   const int timeout = (throttle_hidden && frame_events_starved) ? 0 : 1000;
    while (present_pending)
    {
-      int res = dispatch_queue(wayland_display, surface_queue.get(), timeout);
+      int res = dispatch_queue(context->get_wl_display(), surface_queue.get(), timeout);
       if (res < 0)
       {
          WSI_LOG_ERROR("Error while waiting for the compositor to send the next frame event.");
@@ -353,11 +345,22 @@ bool surface::wait_next_frame_event()
       }
       else if (res == 0)
       {
+         if (throttle_hidden)
+         {
+            if (!frame_events_starved)
+            {
+               WSI_LOG_INFO("Wait for frame event timed out, throttling presents until the surface is shown.");
+               frame_events_starved = true;
+            }
+            return true;
+         }
+
          WSI_LOG_INFO("Wait for frame event timed out, present anyway.");
          present_pending = false;
       }
    }
 
+   frame_events_starved = false;
    return true;
 }
 
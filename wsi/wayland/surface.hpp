@@ -28,12 +28,18 @@
 
 #pragma once
 
+#include <atomic>
+#include <ctime>
+#include <memory>
+#include <mutex>
+
 #ifndef __STDC_VERSION__
 #define __STDC_VERSION__ 0
 #endif
 #include <wayland-client.h>
 
 #include "wsi/surface.hpp"
+#include "display_context.hpp"
 #include "surface_properties.hpp"
 #include "wl_object_owner.hpp"
 #include "util/macros.hpp"
@@ -43,13 +49,6 @@ namespace wsi
 namespace wayland
 {
 
-/**
- * Wayland callback for global wl_registry events to handle global objects required by @ref wsi::wayland::surface
- */
-VWL_CAPI_CALL(void)
-surface_registry_handler(void *data, struct wl_registry *wl_registry, uint32_t name, const char *interface,
-                         uint32_t version) VWL_API_POST;
-
 class surface : public wsi::surface
 {
 public:
@@ -81,7 +80,7 @@ public:
    /** Returns the Wayland display */
    wl_display *get_wl_display() const
    {
-      return wayland_display;
+      return context->get_wl_display();
    }
 
    /** Returns the Wayland surface */
@@ -97,28 +96,164 @@ public:
     */
    zwp_linux_dmabuf_v1 *get_dmabuf_interface()
    {
-      return dmabuf_interface.get();
+      return context->get_dmabuf_interface();
+   }
+
+   /**
+    * @brief Whether the zwp_linux_dmabuf_v1 binding supports the feedback objects.
+    */
+   bool has_dmabuf_feedback() const
+   {
+      return context->has_dmabuf_feedback();
+   }
+
+   /**
+    * @brief Get the Wayland zwp_linux_surface_synchronization_v1 interface obtained for the wayland surface, nullptr
+    *        when there is none, for instance while swapchains use the syncobj surface.
+    *
+    * The interface is kept while it is used, @ref get_syncobj_surface fails in the meantime.
+    *
+    * @return The interface, to be given back with @ref put_surface_sync_interface unless nullptr.
+    */
+   zwp_linux_surface_synchronization_v1 *get_surface_sync_interface();
+
+   /**
+    * @brief Give back the zwp_linux_surface_synchronization_v1 of @ref get_surface_sync_interface.
+    */
+   void put_surface_sync_interface();
+
+   /**
+    * @brief Returns a pointer to the Wayland wp_linux_drm_syncobj_manager_v1 interface, nullptr when the compositor
+    *        does not support linux-drm-syncobj-v1.
+    *
+    * The raw pointer is valid for the lifetime of the surface.
+    */
+   wp_linux_drm_syncobj_manager_v1 *get_syncobj_manager()
+   {
+      return context->get_syncobj_manager();
+   }
+
+   /**
+    * @brief Get the wp_linux_drm_syncobj_surface_v1 of the surface, created by the first user.
+    *
+    * Every commit of the surface needs timeline points once it exists, so it is only kept while swapchains use it.
+    * Compositors reject surfaces with both explicit synchronization objects, the zwp_linux_surface_synchronization_v1
+    * is destroyed in the meantime and @ref get_surface_sync_interface returns nullptr. While a swapchain still uses
+    * the zwp_linux_surface_synchronization_v1 the syncobj surface cannot be created and nullptr is returned.
+    *
+    * @return The syncobj surface, to be given back with @ref put_syncobj_surface, or nullptr on failure.
+    */
+   wp_linux_drm_syncobj_surface_v1 *get_syncobj_surface();
+
+   /**
+    * @brief Give back the wp_linux_drm_syncobj_surface_v1 of @ref get_syncobj_surface. The last user destroys it and
+    *        restores the zwp_linux_surface_synchronization_v1 interface.
+    */
+   void put_syncobj_surface();
+
+   /**
+    * @brief Returns a pointer to the Wayland wp_fifo_v1 interface obtained for the wayland surface, nullptr when the
+    *        compositor does not support fifo-v1.
+    *
+    * The raw pointer is valid for the lifetime of the surface.
+    */
+   wp_fifo_v1 *get_fifo_interface()
+   {
+      return fifo_interface.get();
+   }
+
+   /**
+    * @brief Returns a pointer to the Wayland wp_commit_timer_v1 interface obtained for the wayland surface, nullptr
+    *        when the compositor does not support commit-timing-v1.
+    *
+    * The raw pointer is valid for the lifetime of the surface.
+    */
+   wp_commit_timer_v1 *get_commit_timer_interface()
+   {
+      return commit_timer_interface.get();
+   }
+
+   /**
+    * @brief Whether the compositor supports tearing-control-v1, which VK_PRESENT_MODE_IMMEDIATE_KHR needs.
+    */
+   bool supports_tearing() const
+   {
+      return tearing_control_interface.get() != nullptr;
    }
 
    /**
-    * @brief Returns a pointer to the Wayland zwp_linux_surface_synchronization_v1 interface obtained for the wayland
-    *        surface.
+    * @brief Set the wp_tearing_control_v1 presentation hint of the next commit, when tearing is supported.
+    *
+    * The hint is kept by the compositor across commits, so it is only sent when it changes. Only called by the
+    * swapchain presenting to the surface.
+    *
+    * @param async true to let the compositor flip the next commits without waiting for vertical blank.
+    */
+   void set_presentation_hint(bool async);
+
+   /**
+    * @brief Whether the compositor supports wp_viewporter, which scaled presents need.
+    */
+   bool supports_viewport() const
+   {
+      return viewport_interface.get() != nullptr;
+   }
+
+   /**
+    * @brief Show the @p source rectangle of the next buffers at the @p destination size. Needs @ref supports_viewport.
+    *
+    * Like the presentation hint, the viewport is kept across commits and only sent when it changes.
+    */
+   void set_viewport(const VkRect2D &source, const VkExtent2D &destination);
+
+   /**
+    * @brief Show the next buffers at their own size again.
+    */
+   void clear_viewport();
+
+   /**
+    * @brief Record the image extent of the latest swapchain created for the surface.
+    *
+    * Wayland surfaces take the size of their buffers, so this is the size the application wants the surface at.
+    * Scaling swapchains presenting images of another extent are scaled to it.
+    */
+   void set_swapchain_extent(const VkExtent2D &extent)
+   {
+      swapchain_extent.store((static_cast<uint64_t>(extent.width) << 32) | extent.height, std::memory_order_relaxed);
+   }
+
+   VkExtent2D get_swapchain_extent() const
+   {
+      const uint64_t extent = swapchain_extent.load(std::memory_order_relaxed);
+      return { static_cast<uint32_t>(extent >> 32), static_cast<uint32_t>(extent) };
+   }
+
+   /**
+    * @brief Returns a pointer to the Wayland wp_presentation interface obtained for the wayland display.
     *
     * The raw pointer is valid for the lifetime of the surface.
     */
-   zwp_linux_surface_synchronization_v1 *get_surface_sync_interface()
+   wp_presentation *get_presentation_time_interface()
    {
-      return surface_sync_interface.get();
+      return context->get_presentation_time_interface();
+   }
+
+   /**
+    * @brief Returns the clock of the wp_presentation_feedback timestamps, as announced by the compositor.
+    */
+   clockid_t get_presentation_clock() const
+   {
+      return context->get_presentation_clock();
    }
 
    /**
     * @brief Returns a reference to a list of DRM formats supported by the Wayland surface.
     *
-    * The reference is valid throughout the lifetime of this surface.
+    * The reference is valid throughout the lifetime of this surface, the list is shared by the surfaces of the display.
     */
    const util::vector<drm_format_pair> &get_formats() const
    {
-      return supported_formats;
+      return context->get_formats();
    }
 
    /**
@@ -138,19 +273,36 @@ public:
     */
    bool wait_next_frame_event();
 
+   /**
+    * @brief Whether the last wait for a frame event timed out and none has arrived since.
+    *
+    * The compositor stops sending frame events to surfaces that are not shown, e.g. minimised or on another
+    * workspace. With the hidden_present_interval_ms tuning, presents are then completed without being committed.
+    */
+   bool are_frame_events_starved() const
+   {
+      return frame_events_starved;
+   }
+
 private:
    /**
-    * @brief Initialize the WSI surface by creating Wayland queues and linking to Wayland protocols.
+    * @brief Initialize the WSI surface by creating its Wayland queue and the surface objects of the protocols.
+    *
+    * @param display The Wayland display used to create the VkSurface.
     *
     * @return true on success, false otherwise.
     */
-   bool init();
+   bool init(wl_display *display);
 
-   friend void surface_registry_handler(void *data, struct wl_registry *wl_registry, uint32_t name,
-                                        const char *interface, uint32_t version) VWL_API_POST;
+   /**
+    * @brief Create the zwp_linux_surface_synchronization_v1 object of the surface, when the compositor supports it.
+    *
+    * @return true on success or when unsupported, false otherwise.
+    */
+   bool init_surface_sync();
 
-   /** The native Wayland display */
-   wl_display *wayland_display;
+   /** The globals and formats of the display, bound by the first surface created on the display. */
+   std::shared_ptr<display_context> context;
 
    /**
     * Container for a private queue for surface events generated by the layer.
@@ -161,21 +313,41 @@ private:
 
    /** The native Wayland surface */
    wl_surface *wayland_surface;
-   /** A list of DRM formats supported by the Wayland compositor on this surface */
-   util::vector<drm_format_pair> supported_formats;
    /** Surface properties specific to the Wayland surface. */
    surface_properties properties;
 
-   /** Container for the zwp_linux_dmabuf_v1 interface binding */
-   wayland_owner<zwp_linux_dmabuf_v1> dmabuf_interface;
-
-   /** Container for the zwp_linux_explicit_synchronization_v1 interface binding */
-   wayland_owner<zwp_linux_explicit_synchronization_v1> explicit_sync_interface;
    /** Container for the surface specific zwp_linux_surface_synchronization_v1 interface. */
    wayland_owner<zwp_linux_surface_synchronization_v1> surface_sync_interface;
 
-   /** Container for the wp_presentation interface binding */
-   wayland_owner<wp_presentation> presentation_time_interface;
+   /** Container for the surface specific wp_linux_drm_syncobj_surface_v1 interface, see @ref get_syncobj_surface. */
+   wayland_owner<wp_linux_drm_syncobj_surface_v1> syncobj_surface_interface;
+   /** Number of swapchains using @ref syncobj_surface_interface. */
+   uint32_t syncobj_surface_users{ 0 };
+   /** Number of swapchains using @ref surface_sync_interface. */
+   uint32_t surface_sync_users{ 0 };
+   std::mutex syncobj_surface_mutex;
+
+   /** Container for the surface specific wp_fifo_v1 interface. */
+   wayland_owner<wp_fifo_v1> fifo_interface;
+
+   /** Container for the surface specific wp_commit_timer_v1 interface. */
+   wayland_owner<wp_commit_timer_v1> commit_timer_interface;
+
+   /** Container for the surface specific wp_tearing_control_v1 interface. */
+   wayland_owner<wp_tearing_control_v1> tearing_control_interface;
+   /** Presentation hint last set with @ref set_presentation_hint, the compositor starts with vsync. */
+   bool presentation_hint_async{ false };
+
+   /** Container for the surface specific wp_viewport interface. */
+   wayland_owner<wp_viewport> viewport_interface;
+   /** Viewport last set with @ref set_viewport, while @ref viewport_active. */
+   bool viewport_active{ false };
+   VkRect2D viewport_source{};
+   VkExtent2D viewport_destination{};
+   /** Guards the viewport state above, swapchains of the surface update it from their present paths. */
+   std::mutex viewport_mutex;
+   /** See @ref set_swapchain_extent, packed as width << 32 | height. */
+   std::atomic<uint64_t> swapchain_extent{ 0 };
 
    /**
     * Container for a callback object for the latest frame done event.
@@ -194,6 +366,13 @@ private:
     * callback to indicate the server is ready for the next buffer.
     */
    bool present_pending;
+
+   /**
+    * @brief true after a wait for a frame event timed out, until the pending frame event arrives.
+    *
+    * Only set with the hidden_present_interval_ms tuning, the frame request is then kept pending.
+    */
+   bool frame_events_starved;
 };
 
 } // namespace wayland
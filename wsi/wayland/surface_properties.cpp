@@ -58,12 +58,29 @@ void surface_properties::populate_present_mode_compatibilities()
       present_mode_compatibility{ VK_PRESENT_MODE_MAILBOX_KHR, 1, { VK_PRESENT_MODE_MAILBOX_KHR } }
    };
    m_compatible_present_modes = compatible_present_modes<2>(compatible_present_modes_list);
+
+   /* Presents in IMMEDIATE only differ from MAILBOX by the tearing hint, so a swapchain switches between them. */
+   std::array<present_mode_compatibility, 3> tearing_compatible_present_modes_list = {
+      present_mode_compatibility{ VK_PRESENT_MODE_FIFO_KHR, 1, { VK_PRESENT_MODE_FIFO_KHR } },
+      present_mode_compatibility{
+         VK_PRESENT_MODE_MAILBOX_KHR, 2, { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR } },
+      present_mode_compatibility{
+         VK_PRESENT_MODE_IMMEDIATE_KHR, 2, { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR } }
+   };
+   m_tearing_compatible_present_modes = compatible_present_modes<3>(tearing_compatible_present_modes_list);
+}
+
+bool surface_properties::supports_tearing() const
+{
+   return specific_surface != nullptr && specific_surface->supports_tearing();
 }
 
 surface_properties::surface_properties(surface *wsi_surface, const util::allocator &allocator)
    : specific_surface(wsi_surface)
    , supported_formats(allocator)
    , m_supported_modes({ VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR })
+   , m_tearing_supported_modes(
+        { VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR })
 {
    populate_present_mode_compatibilities();
 }
@@ -97,12 +114,27 @@ VkResult surface_properties::get_surface_capabilities(VkPhysicalDevice physical_
                                                       const VkPhysicalDeviceSurfaceInfo2KHR *pSurfaceInfo,
                                                       VkSurfaceCapabilities2KHR *pSurfaceCapabilities)
 {
-   TRY(check_surface_present_mode_query_is_supported(pSurfaceInfo, m_supported_modes));
+   if (supports_tearing())
+   {
+      TRY(check_surface_present_mode_query_is_supported(pSurfaceInfo, m_tearing_supported_modes));
+   }
+   else
+   {
+      TRY(check_surface_present_mode_query_is_supported(pSurfaceInfo, m_supported_modes));
+   }
 
    /* Image count limits */
    get_surface_capabilities(physical_device, &pSurfaceCapabilities->surfaceCapabilities);
 
-   m_compatible_present_modes.get_surface_present_mode_compatibility_common(pSurfaceInfo, pSurfaceCapabilities);
+   if (supports_tearing())
+   {
+      m_tearing_compatible_present_modes.get_surface_present_mode_compatibility_common(pSurfaceInfo,
+                                                                                      pSurfaceCapabilities);
+   }
+   else
+   {
+      m_compatible_present_modes.get_surface_present_mode_compatibility_common(pSurfaceInfo, pSurfaceCapabilities);
+   }
 
    auto surface_scaling_capabilities = util::find_extension<VkSurfacePresentScalingCapabilitiesEXT>(
       VK_STRUCTURE_TYPE_SURFACE_PRESENT_SCALING_CAPABILITIES_EXT, pSurfaceCapabilities);
@@ -243,6 +275,10 @@ VkResult surface_properties::get_surface_present_modes(VkPhysicalDevice physical
    UNUSED(physical_device);
    UNUSED(surface);
 
+   if (supports_tearing())
+   {
+      return get_surface_present_modes_common(pPresentModeCount, pPresentModes, m_tearing_supported_modes);
+   }
    return get_surface_present_modes_common(pPresentModeCount, pPresentModes, m_supported_modes);
 }
 
@@ -293,7 +329,8 @@ check_required_protocols(void *data, struct wl_registry *registry, uint32_t name
    {
       supported->dmabuf = true;
    }
-   else if (!strcmp(interface, zwp_linux_explicit_synchronization_v1_interface.name))
+   else if (!strcmp(interface, zwp_linux_explicit_synchronization_v1_interface.name) ||
+            !strcmp(interface, wp_linux_drm_syncobj_manager_v1_interface.name))
    {
       supported->explicit_sync = true;
    }
@@ -408,12 +445,22 @@ void surface_properties::get_surface_present_scaling_and_gravity(
    VkSurfacePresentScalingCapabilitiesEXT *scaling_capabilities)
 {
    scaling_capabilities->supportedPresentScaling = VK_PRESENT_SCALING_ONE_TO_ONE_BIT_EXT;
+   if (specific_surface != nullptr && specific_surface->supports_viewport())
+   {
+      /* The compositor scales with wp_viewport. The surface shrinks to the scaled image, which stays at its origin. */
+      scaling_capabilities->supportedPresentScaling |=
+         VK_PRESENT_SCALING_ASPECT_RATIO_STRETCH_BIT_EXT | VK_PRESENT_SCALING_STRETCH_BIT_EXT;
+   }
    scaling_capabilities->supportedPresentGravityX = VK_PRESENT_GRAVITY_MIN_BIT_EXT;
    scaling_capabilities->supportedPresentGravityY = VK_PRESENT_GRAVITY_MIN_BIT_EXT;
 }
 
 bool surface_properties::is_compatible_present_modes(VkPresentModeKHR present_mode_a, VkPresentModeKHR present_mode_b)
 {
+   if (supports_tearing())
+   {
+      return m_tearing_compatible_present_modes.is_compatible_present_modes(present_mode_a, present_mode_b);
+   }
    return m_compatible_present_modes.is_compatible_present_modes(present_mode_a, present_mode_b);
 }
 
@@ -421,11 +468,16 @@ bool surface_properties::is_compatible_present_modes(VkPresentModeKHR present_mo
 void surface_properties::get_present_timing_surface_caps(
    VkPresentTimingSurfaceCapabilitiesEXT *present_timing_surface_caps)
 {
+   /* Targets are scheduled with wp_commit_timer_v1, in the clock of the first pixel visible stage. */
+   const VkBool32 commit_timing_supported =
+      specific_surface != nullptr && specific_surface->get_commit_timer_interface() != nullptr;
    present_timing_surface_caps->presentTimingSupported = VK_TRUE;
-   present_timing_surface_caps->presentAtAbsoluteTimeSupported = VK_FALSE;
-   present_timing_surface_caps->presentAtRelativeTimeSupported = VK_FALSE;
-   present_timing_surface_caps->presentStageQueries = VK_PRESENT_STAGE_QUEUE_OPERATIONS_END_BIT_EXT;
-   present_timing_surface_caps->presentStageTargets = 0;
+   present_timing_surface_caps->presentAtAbsoluteTimeSupported = commit_timing_supported;
+   present_timing_surface_caps->presentAtRelativeTimeSupported = commit_timing_supported;
+   present_timing_surface_caps->presentStageQueries =
+      VK_PRESENT_STAGE_QUEUE_OPERATIONS_END_BIT_EXT | VK_PRESENT_STAGE_IMAGE_FIRST_PIXEL_VISIBLE_BIT_EXT;
+   present_timing_surface_caps->presentStageTargets =
+      commit_timing_supported ? VK_PRESENT_STAGE_IMAGE_FIRST_PIXEL_VISIBLE_BIT_EXT : 0;
 }
 #endif
 
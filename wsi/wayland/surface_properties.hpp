@@ -93,6 +93,15 @@ private:
    /* Stores compatible presentation modes */
    compatible_present_modes<2> m_compatible_present_modes;
 
+   /* Supported and compatible presentation modes of surfaces with tearing-control-v1, see @ref supports_tearing. */
+   std::array<VkPresentModeKHR, 3> m_tearing_supported_modes;
+   compatible_present_modes<3> m_tearing_compatible_present_modes;
+
+   /**
+    * @brief Whether @ref specific_surface can present with VK_PRESENT_MODE_IMMEDIATE_KHR.
+    */
+   bool supports_tearing() const;
+
    void populate_present_mode_compatibilities() override;
 
    void get_surface_present_scaling_and_gravity(VkSurfacePresentScalingCapabilitiesEXT *scaling_capabilities) override;
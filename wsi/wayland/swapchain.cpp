@@ -29,18 +29,26 @@
 #include <cstring>
 #include <cassert>
 #include <unistd.h>
+#include <sys/eventfd.h>
 #include <cstdlib>
 #include <cerrno>
 #include <cstdio>
 #include <climits>
 #include <functional>
+#include <algorithm>
+#include <chrono>
+#include <system_error>
 
 #include "swapchain.hpp"
 #include "util/drm/drm_utils.hpp"
 #include "util/format_modifiers.hpp"
 #include "util/helpers.hpp"
 #include "util/log.hpp"
+#include "util/trace.hpp"
 #include "util/macros.hpp"
+#include "util/scratch_allocator.hpp"
+#include "util/thread_scheduling.hpp"
+#include "util/tuning_profile.hpp"
 #include "wl_helpers.hpp"
 
 #include <wsi/extensions/image_compression_control.hpp>
@@ -54,6 +62,22 @@ namespace wsi
 namespace wayland
 {
 
+/**
+ * @brief The fourcc wl_buffers of @p fourcc images are created with, presented images are always opaque.
+ */
+static uint32_t get_wl_buffer_fourcc(uint32_t fourcc)
+{
+   if (fourcc == DRM_FORMAT_ARGB8888)
+   {
+      return DRM_FORMAT_XRGB8888;
+   }
+   if (fourcc == DRM_FORMAT_ABGR8888)
+   {
+      return DRM_FORMAT_XBGR8888;
+   }
+   return fourcc;
+}
+
 swapchain::swapchain(layer::device_private_data &dev_data, const VkAllocationCallbacks *pAllocator,
                      surface &wsi_surface)
    : swapchain_base(dev_data, pAllocator)
@@ -61,7 +85,10 @@ swapchain::swapchain(layer::device_private_data &dev_data, const VkAllocationCal
    , m_surface(wsi_surface.get_wl_surface())
    , m_wsi_surface(&wsi_surface)
    , m_buffer_queue(nullptr)
+   , m_presentation_feedbacks(m_allocator)
+   , m_compatible_formats(m_allocator)
    , m_wsi_allocator(nullptr)
+   , m_wsialloc_batch(m_allocator, m_device_data.get_allocation_stats())
    , m_image_creation_parameters({}, m_allocator, {}, {})
 {
    m_image_create_info.format = VK_FORMAT_UNDEFINED;
@@ -69,6 +96,8 @@ swapchain::swapchain(layer::device_private_data &dev_data, const VkAllocationCal
 
 swapchain::~swapchain()
 {
+   /* Teardown waits for the pending buffers by dispatching the queue itself. */
+   stop_buffer_release_thread();
    teardown();
 
    if (m_wsi_allocator != nullptr)
@@ -76,6 +105,27 @@ swapchain::~swapchain()
       wsialloc_delete(m_wsi_allocator);
    }
    m_wsi_allocator = nullptr;
+
+   if (m_syncobj_surface != nullptr)
+   {
+      /* Points set by the past commits stay valid, the compositor still signals the release points. */
+      m_acquire_timeline_obj.reset();
+      m_release_timeline_obj.reset();
+      m_wsi_surface->put_syncobj_surface();
+   }
+   if (m_surface_sync != nullptr)
+   {
+      m_wsi_surface->put_surface_sync_interface();
+   }
+
+   /* The feedback proxies have to go before the queue they are dispatched on. */
+   for (auto &pending : m_presentation_feedbacks)
+   {
+      wp_presentation_feedback_destroy(pending.feedback);
+   }
+   m_presentation_feedbacks.clear();
+   m_surface_feedback.reset();
+
    if (m_buffer_queue != nullptr)
    {
       wl_event_queue_destroy(m_buffer_queue);
@@ -121,7 +171,8 @@ VkResult swapchain::add_required_extensions(VkDevice device, const VkSwapchainCr
    bool swapchain_support_enabled = swapchain_create_info->flags & VK_SWAPCHAIN_CREATE_PRESENT_TIMING_BIT_EXT;
    if (swapchain_support_enabled)
    {
-      if (!add_swapchain_extension(wsi_ext_present_timing_wayland::create(m_allocator)))
+      if (!add_swapchain_extension(
+             wsi_ext_present_timing_wayland::create(m_allocator, m_wsi_surface->get_presentation_clock())))
       {
          return VK_ERROR_OUT_OF_HOST_MEMORY;
       }
@@ -135,7 +186,6 @@ VkResult swapchain::init_platform(VkDevice device, const VkSwapchainCreateInfoKH
                                   bool &use_presentation_thread)
 {
    UNUSED(device);
-   UNUSED(swapchain_create_info);
    UNUSED(use_presentation_thread);
 
    if ((m_display == nullptr) || (m_surface == nullptr) || (m_wsi_surface->get_dmabuf_interface() == nullptr))
@@ -143,6 +193,15 @@ VkResult swapchain::init_platform(VkDevice device, const VkSwapchainCreateInfoKH
       return VK_ERROR_INITIALIZATION_FAILED;
    }
 
+   /* The scaling behavior was checked against the surface capabilities, so a viewport is available. */
+   const auto *present_scaling_info = util::find_extension<VkSwapchainPresentScalingCreateInfoEXT>(
+      VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_SCALING_CREATE_INFO_EXT, swapchain_create_info->pNext);
+   if (present_scaling_info != nullptr && m_wsi_surface->supports_viewport())
+   {
+      m_present_scaling = present_scaling_info->scalingBehavior;
+   }
+   m_wsi_surface->set_swapchain_extent(swapchain_create_info->imageExtent);
+
    m_buffer_queue = wl_display_create_queue(m_display);
    if (m_buffer_queue == nullptr)
    {
@@ -158,16 +217,192 @@ VkResult swapchain::init_platform(VkDevice device, const VkSwapchainCreateInfoKH
    }
 
    /*
-    * When VK_PRESENT_MODE_MAILBOX_KHR has been chosen by the application we don't
-    * initialize the page flip thread so the present_image function can be called
-    * during vkQueuePresent.
+    * When VK_PRESENT_MODE_MAILBOX_KHR or VK_PRESENT_MODE_IMMEDIATE_KHR has been chosen
+    * by the application we don't initialize the page flip thread so the present_image
+    * function can be called during vkQueuePresent. With wp_fifo_v1 the compositor holds
+    * back FIFO commits itself, so presents never block and need no thread either.
     */
-   use_presentation_thread =
-      WAYLAND_FIFO_PRESENTATION_THREAD_ENABLED && (m_present_mode != VK_PRESENT_MODE_MAILBOX_KHR);
+   use_presentation_thread = WAYLAND_FIFO_PRESENTATION_THREAD_ENABLED &&
+                             util::tuning_profile::get().wayland_fifo_presentation_thread != 0 &&
+                             (m_present_mode == VK_PRESENT_MODE_FIFO_KHR) &&
+                             (m_wsi_surface->get_fifo_interface() == nullptr);
+
+   if (init_syncobj_timelines())
+   {
+      WSI_LOG_INFO("Using linux-drm-syncobj-v1 timelines for explicit synchronization.");
+   }
+   else
+   {
+      m_surface_sync = m_wsi_surface->get_surface_sync_interface();
+   }
+
+   if (m_wsi_surface->has_dmabuf_feedback() && !init_surface_feedback())
+   {
+      WSI_LOG_WARNING("Failed to get the surface dmabuf feedback, formats are picked without scanout preference.");
+      m_surface_feedback.reset();
+   }
+
+   if (start_buffer_release_thread() != VK_SUCCESS)
+   {
+      WSI_LOG_WARNING("Failed to start the buffer release thread, buffers are released on acquire.");
+   }
+
+   return VK_SUCCESS;
+}
+
+bool swapchain::init_syncobj_timelines()
+{
+   if (m_wsi_surface->get_syncobj_manager() == nullptr || !m_device_data.is_timeline_semaphore_enabled() ||
+       !m_device_data.is_device_extension_enabled(VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME) ||
+       !timeline_semaphore::is_export_supported(m_device_data))
+   {
+      return false;
+   }
+
+   m_acquire_timeline = timeline_semaphore::create(m_device_data, true);
+   m_release_timeline = timeline_semaphore::create(m_device_data, true);
+   if (m_acquire_timeline.has_value() && m_release_timeline.has_value())
+   {
+      m_acquire_timeline_obj = import_syncobj_timeline(*m_acquire_timeline);
+      m_release_timeline_obj = import_syncobj_timeline(*m_release_timeline);
+   }
+   if (m_acquire_timeline_obj != nullptr && m_release_timeline_obj != nullptr)
+   {
+      m_syncobj_surface = m_wsi_surface->get_syncobj_surface();
+   }
+
+   if (m_syncobj_surface == nullptr)
+   {
+      WSI_LOG_WARNING("Failed to set up syncobj timelines, falling back to sync FDs.");
+      m_acquire_timeline_obj.reset();
+      m_release_timeline_obj.reset();
+      m_acquire_timeline.reset();
+      m_release_timeline.reset();
+      return false;
+   }
+   return true;
+}
+
+wayland_owner<wp_linux_drm_syncobj_timeline_v1> swapchain::import_syncobj_timeline(timeline_semaphore &timeline)
+{
+   /* The FD is duplicated when the request is marshalled, it can be closed right after. */
+   auto timeline_fd = timeline.export_opaque_fd();
+   if (!timeline_fd.has_value())
+   {
+      return nullptr;
+   }
+   return wayland_owner<wp_linux_drm_syncobj_timeline_v1>(
+      wp_linux_drm_syncobj_manager_v1_import_timeline(m_wsi_surface->get_syncobj_manager(), timeline_fd->get()));
+}
+
+bool swapchain::init_surface_feedback()
+{
+   m_surface_feedback = m_allocator.make_unique<dmabuf_feedback>(m_allocator);
+   if (m_surface_feedback == nullptr)
+   {
+      return false;
+   }
+
+   /* Created on the buffer queue, so the updates are dispatched with the buffer releases. */
+   auto dmabuf_proxy = make_proxy_with_queue(m_wsi_surface->get_dmabuf_interface(), m_buffer_queue);
+   if (dmabuf_proxy == nullptr ||
+       !m_surface_feedback->init(zwp_linux_dmabuf_v1_get_surface_feedback(dmabuf_proxy.get(), m_surface)))
+   {
+      return false;
+   }
+
+   /* The compositor sends the initial tranches right away. */
+   while (m_surface_feedback->get_generation() == 0)
+   {
+      if (wl_display_roundtrip_queue(m_display, m_buffer_queue) < 0)
+      {
+         return false;
+      }
+   }
+   return !m_surface_feedback->is_out_of_memory();
+}
+
+uint32_t swapchain::get_feedback_rank(const wsialloc_format &format)
+{
+   return m_surface_feedback->get_rank({ get_wl_buffer_fourcc(format.fourcc), format.modifier });
+}
+
+void swapchain::check_surface_feedback()
+{
+   const uint64_t generation = m_surface_feedback->get_generation();
+   std::lock_guard<std::mutex> feedback_lock(m_feedback_mutex);
+   if (generation == m_feedback_generation)
+   {
+      return;
+   }
+   m_feedback_generation = generation;
+
+   /* Images cannot change format, the application has to recreate the swapchain to get the preferred one. */
+   const uint32_t allocated_rank = get_feedback_rank(m_image_creation_parameters.m_allocated_format);
+   for (const auto &format : m_compatible_formats)
+   {
+      if (get_feedback_rank(format) < allocated_rank)
+      {
+         WSI_LOG_INFO("Surface dmabuf feedback prefers another format, the swapchain is suboptimal.");
+         set_suboptimal();
+         return;
+      }
+   }
+}
+
+VkResult swapchain::start_buffer_release_thread()
+{
+   m_buffer_release_wake_fd = util::fd_owner(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+   if (!m_buffer_release_wake_fd.is_valid())
+   {
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
 
+   m_buffer_release_thread_run = true;
+   try
+   {
+      m_buffer_release_thread = std::thread(&swapchain::buffer_release_thread, this);
+   }
+   catch (const std::system_error &)
+   {
+      m_buffer_release_thread_run = false;
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
    return VK_SUCCESS;
 }
 
+void swapchain::stop_buffer_release_thread()
+{
+   if (!m_buffer_release_thread.joinable())
+   {
+      return;
+   }
+
+   m_buffer_release_thread_run = false;
+   const uint64_t wake = 1;
+   if (write(m_buffer_release_wake_fd.get(), &wake, sizeof(wake)) != sizeof(wake))
+   {
+      WSI_LOG_ERROR("Failed to wake up the buffer release thread.");
+   }
+   m_buffer_release_thread.join();
+}
+
+void swapchain::buffer_release_thread()
+{
+   util::configure_presentation_thread("wsi-wl-release");
+
+   while (m_buffer_release_thread_run)
+   {
+      if (dispatch_queue(m_display, m_buffer_queue, -1, m_buffer_release_wake_fd.get()) < 0)
+      {
+         WSI_LOG_ERROR("Failed to dispatch the buffer queue.");
+         set_error_state(VK_ERROR_SURFACE_LOST_KHR);
+         wake_image_acquire_on_error();
+         m_buffer_release_thread_run = false;
+      }
+   }
+}
+
 VWL_CAPI_CALL(void) buffer_release(void *data, struct wl_buffer *wayl_buffer) VWL_API_POST
 {
    auto sc = reinterpret_cast<swapchain *>(data);
@@ -182,6 +417,8 @@ void swapchain::release_buffer(struct wl_buffer *wayl_buffer)
       auto data = reinterpret_cast<wayland_image_data *>(m_swapchain_images[i].data);
       if (data && data->buffer == wayl_buffer)
       {
+         /* The compositor used the buffer, so its creation succeeded. */
+         data->buffer_params.reset();
          unpresent_image(i);
          break;
       }
@@ -193,6 +430,215 @@ void swapchain::release_buffer(struct wl_buffer *wayl_buffer)
 
 static struct wl_buffer_listener buffer_listener = { buffer_release };
 
+VWL_CAPI_CALL(void)
+buffer_params_created(void *data, struct zwp_linux_buffer_params_v1 *params, struct wl_buffer *buffer) VWL_API_POST
+{
+   /* Only sent for zwp_linux_buffer_params_v1.create, buffers are created with create_immed. */
+   UNUSED(data);
+   UNUSED(params);
+   UNUSED(buffer);
+}
+
+VWL_CAPI_CALL(void) buffer_params_failed(void *data, struct zwp_linux_buffer_params_v1 *params) VWL_API_POST
+{
+   auto sc = reinterpret_cast<swapchain *>(data);
+   sc->buffer_creation_failed(params);
+}
+
+static const struct zwp_linux_buffer_params_v1_listener buffer_params_listener = { buffer_params_created,
+                                                                                   buffer_params_failed };
+
+void swapchain::buffer_creation_failed(zwp_linux_buffer_params_v1 *params)
+{
+   UNUSED(params);
+
+   /* Presents of the image would show nothing, and the wl_buffer is never released. */
+   WSI_LOG_ERROR("Compositor failed to create a wl_buffer from the swapchain image.");
+   set_error_state(VK_ERROR_SURFACE_LOST_KHR);
+   wake_image_acquire_on_error();
+}
+
+VWL_CAPI_CALL(void)
+presentation_feedback_sync_output(void *data, struct wp_presentation_feedback *feedback,
+                                  struct wl_output *output) VWL_API_POST
+{
+   UNUSED(data);
+   UNUSED(feedback);
+   UNUSED(output);
+}
+
+VWL_CAPI_CALL(void)
+presentation_feedback_presented(void *data, struct wp_presentation_feedback *feedback, uint32_t tv_sec_hi,
+                                uint32_t tv_sec_lo, uint32_t tv_nsec, uint32_t refresh, uint32_t seq_hi,
+                                uint32_t seq_lo, uint32_t flags) VWL_API_POST
+{
+   UNUSED(seq_hi);
+   UNUSED(seq_lo);
+   const uint64_t tv_sec = (static_cast<uint64_t>(tv_sec_hi) << 32) | tv_sec_lo;
+   const swapchain::presentation_time presented = { tv_sec * 1000000000ull + tv_nsec, refresh, flags };
+   auto sc = reinterpret_cast<swapchain *>(data);
+   sc->complete_presentation_feedback(feedback, &presented);
+}
+
+VWL_CAPI_CALL(void)
+presentation_feedback_discarded(void *data, struct wp_presentation_feedback *feedback) VWL_API_POST
+{
+   /* A later commit replaced the present before it reached the screen, it will not be presented at all. */
+   auto sc = reinterpret_cast<swapchain *>(data);
+   sc->complete_presentation_feedback(feedback, nullptr);
+}
+
+static const struct wp_presentation_feedback_listener presentation_feedback_listener = {
+   presentation_feedback_sync_output,
+   presentation_feedback_presented,
+   presentation_feedback_discarded,
+};
+
+void swapchain::complete_presentation_feedback(struct wp_presentation_feedback *feedback,
+                                               const presentation_time *presented)
+{
+   uint64_t present_id = 0;
+   std::optional<uint64_t> queue_time_ns;
+   {
+      std::lock_guard<std::mutex> lock(m_presentation_feedbacks_mutex);
+      auto it = std::find_if(m_presentation_feedbacks.begin(), m_presentation_feedbacks.end(),
+                             [feedback](const presentation_feedback &pending) { return pending.feedback == feedback; });
+      if (it != m_presentation_feedbacks.end())
+      {
+         present_id = it->present_id;
+         queue_time_ns = it->queue_time_ns;
+         m_presentation_feedbacks.erase(it);
+      }
+   }
+   wp_presentation_feedback_destroy(feedback);
+
+   if (presented != nullptr)
+   {
+      m_last_presentation_time_ns.store(presented->time_ns, std::memory_order_relaxed);
+      m_last_refresh_ns.store(presented->refresh_ns, std::memory_order_relaxed);
+      if (queue_time_ns.has_value())
+      {
+         m_frame_stats.record(util::frame_stage::queue_to_screen, *queue_time_ns);
+      }
+   }
+
+#if VULKAN_WSI_LAYER_EXPERIMENTAL
+   auto *timing_ext = get_swapchain_extension<wsi_ext_present_timing_wayland>();
+   if (timing_ext != nullptr && present_id != 0)
+   {
+      if (presented != nullptr)
+      {
+         timing_ext->set_stage_time(present_id, VK_PRESENT_STAGE_IMAGE_FIRST_PIXEL_VISIBLE_BIT_EXT, presented->time_ns);
+         timing_ext->update_refresh(presented->refresh_ns, presented->flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC);
+      }
+      timing_ext->complete_presentation_entry(present_id);
+   }
+#endif
+
+   if (m_device_data.is_present_id_enabled())
+   {
+      auto *ext = get_swapchain_extension<wsi_ext_present_id>(true);
+      ext->set_present_id(present_id);
+   }
+}
+
+bool swapchain::get_vblank_timing(uint64_t *vblank_ns, uint64_t *refresh_ns)
+{
+   if (m_wsi_surface->get_presentation_clock() != CLOCK_MONOTONIC)
+   {
+      return false;
+   }
+
+   *vblank_ns = m_last_presentation_time_ns.load(std::memory_order_relaxed);
+   *refresh_ns = m_last_refresh_ns.load(std::memory_order_relaxed);
+   return *vblank_ns != 0 && *refresh_ns != 0;
+}
+
+bool swapchain::request_presentation_feedback(uint64_t present_id, uint64_t queue_time_ns)
+{
+   /* Created through a wrapper so no event can be dispatched on the surface queue before the proxy is moved. */
+   auto presentation_proxy = make_proxy_with_queue(m_wsi_surface->get_presentation_time_interface(), m_buffer_queue);
+   if (presentation_proxy == nullptr)
+   {
+      return false;
+   }
+
+   std::lock_guard<std::mutex> lock(m_presentation_feedbacks_mutex);
+   if (!m_presentation_feedbacks.try_reserve(m_presentation_feedbacks.size() + 1))
+   {
+      return false;
+   }
+
+   struct wp_presentation_feedback *feedback = wp_presentation_feedback(presentation_proxy.get(), m_surface);
+   if (feedback == nullptr)
+   {
+      return false;
+   }
+   wp_presentation_feedback_add_listener(feedback, &presentation_feedback_listener, this);
+
+   bool pushed = m_presentation_feedbacks.try_push_back(presentation_feedback{ feedback, present_id, queue_time_ns });
+   assert(pushed);
+   UNUSED(pushed);
+   return true;
+}
+
+VkResult swapchain::wait_for_present(uint64_t present_id, uint64_t timeout)
+{
+   auto *ext = get_swapchain_extension<wsi_ext_present_id>();
+   if (ext == nullptr)
+   {
+      return swapchain_base::wait_for_present(present_id, timeout);
+   }
+
+   if (m_buffer_release_thread_run)
+   {
+      /* The feedback events are dispatched by the buffer release thread. */
+      return ext->wait_for_present_id(present_id, timeout);
+   }
+
+   /* Keep far off timeouts from overflowing the steady clock. */
+   const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::nanoseconds(std::min<uint64_t>(timeout, INT64_MAX / 2));
+   while (true)
+   {
+      std::unique_lock<std::mutex> dispatch_lock(m_present_wait_mutex, std::try_to_lock);
+      if (!dispatch_lock.owns_lock())
+      {
+         /* Another thread dispatches the feedback events, sleep until it made progress. */
+         VkResult result = ext->wait_for_update(present_id, deadline);
+         if (result != VK_NOT_READY)
+         {
+            return result;
+         }
+         continue;
+      }
+
+      VkResult result = ext->wait_for_present_id(present_id, 0);
+      if (result != VK_TIMEOUT)
+      {
+         return result;
+      }
+
+      const auto remaining = deadline - std::chrono::steady_clock::now();
+      if (remaining <= std::chrono::steady_clock::duration::zero())
+      {
+         return VK_TIMEOUT;
+      }
+      const auto remaining_ms = std::chrono::ceil<std::chrono::milliseconds>(remaining).count();
+      const int ms_timeout = static_cast<int>(std::min<decltype(remaining_ms)>(remaining_ms, INT_MAX));
+
+      int res = dispatch_queue(m_display, m_buffer_queue, ms_timeout);
+      dispatch_lock.unlock();
+      /* Let a waiting thread take over dispatching, or return if its present completed. */
+      ext->notify();
+      if (res < 0)
+      {
+         set_error_state(VK_ERROR_SURFACE_LOST_KHR);
+         return VK_ERROR_SURFACE_LOST_KHR;
+      }
+   }
+}
+
 VkResult swapchain::get_surface_compatible_formats(const VkImageCreateInfo &info,
                                                    util::vector<wsialloc_format> &importable_formats,
                                                    util::vector<uint64_t> &exportable_modifers,
@@ -251,19 +697,15 @@ VkResult swapchain::get_surface_compatible_formats(const VkImageCreateInfo &info
 
          VkImageCompressionControlEXT compression_control = {};
 
-         if (m_device_data.is_swapchain_compression_control_enabled())
+         auto *ext = get_swapchain_extension<wsi_ext_image_compression_control>();
+         if (ext)
          {
-            auto *ext = get_swapchain_extension<wsi_ext_image_compression_control>();
-            if (ext)
-            {
-               compression_control = ext->get_compression_control_properties();
-               compression_control.pNext = image_info.pNext;
-               image_info.pNext = &compression_control;
-            }
+            compression_control = ext->get_compression_control_properties();
+            compression_control.pNext = image_info.pNext;
+            image_info.pNext = &compression_control;
          }
 
-         result = m_device_data.instance_data.disp.GetPhysicalDeviceImageFormatProperties2KHR(
-            m_device_data.physical_device, &image_info, &format_props);
+         result = util::get_image_format_properties(m_device_data.physical_device, image_info, format_props);
       }
       if (result != VK_SUCCESS)
       {
@@ -307,6 +749,20 @@ VkResult swapchain::get_surface_compatible_formats(const VkImageCreateInfo &info
       }
    }
 
+   if (m_surface_feedback != nullptr)
+   {
+      /* wsialloc picks the first format it can allocate, so put the scanout formats, then the compositor's
+       * preferred ones first. */
+      {
+         std::lock_guard<std::mutex> feedback_lock(m_feedback_mutex);
+         m_feedback_generation = m_surface_feedback->get_generation();
+      }
+      std::stable_sort(importable_formats.begin(), importable_formats.end(),
+                       [this](const wsialloc_format &a, const wsialloc_format &b) {
+                          return get_feedback_rank(a) < get_feedback_rank(b);
+                       });
+   }
+
    return VK_SUCCESS;
 }
 
@@ -321,20 +777,14 @@ VkResult swapchain::allocate_wsialloc(VkImageCreateInfo &image_create_info, wayl
       allocation_flags |= WSIALLOC_ALLOCATE_NO_MEMORY;
    }
 
-   if (m_device_data.is_swapchain_compression_control_enabled())
+   /* The extension is only added when the application enabled swapchain compression control and chained a
+    * VkImageCompressionControlEXT, or when the layer picked a fixed-rate compression for it. wsialloc then prefers
+    * the fixed-rate compressed modifiers the compositor imports, and allocates another one when it imports none. */
+   auto *ext = get_swapchain_extension<wsi_ext_image_compression_control>();
+   if (ext != nullptr &&
+       (ext->get_bitmask_for_image_compression_flags() & VK_IMAGE_COMPRESSION_FIXED_RATE_EXPLICIT_EXT))
    {
-      auto *ext = get_swapchain_extension<wsi_ext_image_compression_control>();
-      /* For Image compression control, additional requirements to be satisfied such as
-         existence of VkImageCompressionControlEXT in swaphain_create_info for
-         the ext to be added to the list. so we check whether we got a valid pointer
-         and proceed if yes. */
-      if (ext)
-      {
-         if (ext->get_bitmask_for_image_compression_flags() & VK_IMAGE_COMPRESSION_FIXED_RATE_EXPLICIT_EXT)
-         {
-            allocation_flags |= WSIALLOC_ALLOCATE_HIGHEST_FIXED_RATE_COMPRESSION;
-         }
-      }
+      allocation_flags |= WSIALLOC_ALLOCATE_HIGHEST_FIXED_RATE_COMPRESSION;
    }
 
    wsialloc_allocate_info alloc_info = { importable_formats.data(), static_cast<unsigned>(importable_formats.size()),
@@ -348,7 +798,8 @@ VkResult swapchain::allocate_wsialloc(VkImageCreateInfo &image_create_info, wayl
       alloc_result.buffer_fds[i] = -1;
       alloc_result.average_row_strides[i] = -1;
    }
-   const auto res = wsialloc_alloc(m_wsi_allocator, &alloc_info, &alloc_result);
+   const uint32_t batch_size = avoid_allocation ? 1 : get_pending_allocation_count();
+   const auto res = m_wsialloc_batch.allocate(m_wsi_allocator, alloc_info, batch_size, &alloc_result);
    if (res != WSIALLOC_ERROR_NONE)
    {
       WSI_LOG_ERROR("Failed allocation of DMA Buffer. WSI error: %d", static_cast<int>(res));
@@ -363,6 +814,11 @@ VkResult swapchain::allocate_wsialloc(VkImageCreateInfo &image_create_info, wayl
    external_memory.set_strides(alloc_result.average_row_strides);
    external_memory.set_buffer_fds(alloc_result.buffer_fds);
    external_memory.set_offsets(alloc_result.offsets);
+   external_memory.set_memory_source(m_wsi_allocator, allocation_flags, is_protected_memory);
+   if (!alloc_result.is_disjoint)
+   {
+      external_memory.keep_recycle_fd();
+   }
 
    uint32_t num_planes = util::drm::drm_fourcc_format_get_num_planes(alloc_result.format.fourcc);
 
@@ -411,7 +867,8 @@ static VkResult fill_image_create_info(VkImageCreateInfo &image_create_info,
 
 VkResult swapchain::allocate_image(wayland_image_data *image_data)
 {
-   util::vector<wsialloc_format> importable_formats(util::allocator(m_allocator, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND));
+   util::scratch_scope scratch(m_allocator);
+   util::vector<wsialloc_format> importable_formats(scratch.get_allocator());
    auto &m_allocated_format = m_image_creation_parameters.m_allocated_format;
    if (!importable_formats.try_push_back(m_allocated_format))
    {
@@ -422,11 +879,61 @@ VkResult swapchain::allocate_image(wayland_image_data *image_data)
    return VK_SUCCESS;
 }
 
+void swapchain::update_viewport()
+{
+   const VkExtent2D image_extent = { m_image_create_info.extent.width, m_image_create_info.extent.height };
+   const VkExtent2D surface_extent = m_wsi_surface->get_swapchain_extent();
+   /* A viewport left by a scaling swapchain of the surface is undone as well. */
+   if (m_present_scaling == 0 ||
+       (image_extent.width == surface_extent.width && image_extent.height == surface_extent.height))
+   {
+      m_wsi_surface->clear_viewport();
+      return;
+   }
+
+   VkRect2D source = { { 0, 0 }, image_extent };
+   VkExtent2D destination = surface_extent;
+   if (m_present_scaling & VK_PRESENT_SCALING_ONE_TO_ONE_BIT_EXT)
+   {
+      /* Unscaled, the part of the image that fits the surface is shown. */
+      source.extent.width = std::min(image_extent.width, surface_extent.width);
+      source.extent.height = std::min(image_extent.height, surface_extent.height);
+      destination = source.extent;
+   }
+   else if (m_present_scaling & VK_PRESENT_SCALING_ASPECT_RATIO_STRETCH_BIT_EXT)
+   {
+      /* Fit the image in the surface along the dimension that is scaled the least. */
+      const uint64_t scaled_width = static_cast<uint64_t>(image_extent.width) * surface_extent.height;
+      const uint64_t scaled_height = static_cast<uint64_t>(image_extent.height) * surface_extent.width;
+      if (scaled_width < scaled_height)
+      {
+         destination.width = std::max<uint32_t>(1, static_cast<uint32_t>(scaled_width / image_extent.height));
+      }
+      else
+      {
+         destination.height = std::max<uint32_t>(1, static_cast<uint32_t>(scaled_height / image_extent.width));
+      }
+   }
+   m_wsi_surface->set_viewport(source, destination);
+}
+
 VkResult swapchain::create_wl_buffer(const VkImageCreateInfo &image_create_info, swapchain_image &image,
                                      wayland_image_data *image_data)
 {
-   /* create a wl_buffer using the dma_buf protocol */
-   zwp_linux_buffer_params_v1 *params = zwp_linux_dmabuf_v1_create_params(m_wsi_surface->get_dmabuf_interface());
+   /* Create a wl_buffer using the dma_buf protocol. The params are made on the buffer queue, so the buffer is
+    * created there too and a failure is dispatched with the releases. */
+   auto dmabuf_proxy = make_proxy_with_queue(m_wsi_surface->get_dmabuf_interface(), m_buffer_queue);
+   if (dmabuf_proxy == nullptr)
+   {
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
+   image_data->buffer_params.reset(zwp_linux_dmabuf_v1_create_params(dmabuf_proxy.get()));
+   zwp_linux_buffer_params_v1 *params = image_data->buffer_params.get();
+   if (params == nullptr || zwp_linux_buffer_params_v1_add_listener(params, &buffer_params_listener, this) < 0)
+   {
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+
    uint32_t modifier_hi = m_image_creation_parameters.m_allocated_format.modifier >> 32;
    uint32_t modifier_low = m_image_creation_parameters.m_allocated_format.modifier & 0xFFFFFFFF;
    for (uint32_t plane = 0; plane < image_data->external_mem.get_num_planes(); plane++)
@@ -436,16 +943,17 @@ VkResult swapchain::create_wl_buffer(const VkImageCreateInfo &image_create_info,
                                      image_data->external_mem.get_strides()[plane], modifier_hi, modifier_low);
    }
 
-   auto fourcc = util::drm::vk_to_drm_format(image_create_info.format);
+   auto fourcc = get_wl_buffer_fourcc(util::drm::vk_to_drm_format(image_create_info.format));
    assert(image_create_info.extent.width <= INT32_MAX);
    assert(image_create_info.extent.height <= INT32_MAX);
-   if (fourcc == DRM_FORMAT_ARGB8888) fourcc = DRM_FORMAT_XRGB8888;
-   if (fourcc == DRM_FORMAT_ABGR8888) fourcc = DRM_FORMAT_XBGR8888;
+   /* create_immed needs no roundtrip, a failure comes later as the params failed event. */
    image_data->buffer = zwp_linux_buffer_params_v1_create_immed(params, image_create_info.extent.width,
                                                                 image_create_info.extent.height, fourcc, 0);
-   zwp_linux_buffer_params_v1_destroy(params);
+   if (image_data->buffer == nullptr)
+   {
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
 
-   wl_proxy_set_queue(reinterpret_cast<wl_proxy *>(image_data->buffer), m_buffer_queue);
    auto res = wl_buffer_add_listener(image_data->buffer, &buffer_listener, this);
    if (res < 0)
    {
@@ -457,13 +965,17 @@ VkResult swapchain::create_wl_buffer(const VkImageCreateInfo &image_create_info,
 
 VkResult swapchain::allocate_and_bind_swapchain_image(VkImageCreateInfo image_create_info, swapchain_image &image)
 {
-   std::unique_lock<std::recursive_mutex> image_status_lock(m_image_status_mutex);
-   image.status = swapchain_image::FREE;
+   {
+      std::lock_guard<std::recursive_mutex> image_status_lock(m_image_status_mutex);
+      set_image_status(image, swapchain_image::FREE);
+   }
 
    assert(image.data != nullptr);
    auto image_data = static_cast<wayland_image_data *>(image.data);
-   TRY_LOG(allocate_image(image_data), "Failed to allocate image");
-   image_status_lock.unlock();
+   {
+      std::lock_guard<std::mutex> allocation_lock(m_image_allocation_mutex);
+      TRY_LOG(allocate_image(image_data), "Failed to allocate image");
+   }
 
    TRY_LOG(create_wl_buffer(image_create_info, image, image_data), "Failed to create wl_buffer");
 
@@ -493,13 +1005,13 @@ VkResult swapchain::create_swapchain_image(VkImageCreateInfo image_create_info,
 
    if (m_image_create_info.format == VK_FORMAT_UNDEFINED)
    {
-      util::vector<wsialloc_format> importable_formats(
-         util::allocator(m_allocator, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND));
-      util::vector<uint64_t> exportable_modifiers(util::allocator(m_allocator, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND));
+      /* The format lists only live for the allocation of the first image. */
+      util::scratch_scope scratch(m_allocator);
+      util::vector<wsialloc_format> importable_formats(scratch.get_allocator());
+      util::vector<uint64_t> exportable_modifiers(scratch.get_allocator());
 
       /* Query supported modifers. */
-      util::vector<VkDrmFormatModifierPropertiesEXT> drm_format_props(
-         util::allocator(m_allocator, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND));
+      util::vector<VkDrmFormatModifierPropertiesEXT> drm_format_props(scratch.get_allocator());
 
       TRY_LOG_CALL(
          get_surface_compatible_formats(image_create_info, importable_formats, exportable_modifiers, drm_format_props));
@@ -514,6 +1026,17 @@ VkResult swapchain::create_swapchain_image(VkImageCreateInfo image_create_info,
       wsialloc_format allocated_format = { 0, 0, 0 };
       TRY_LOG_CALL(allocate_wsialloc(image_create_info, image_data, importable_formats, &allocated_format, true));
 
+      if (m_surface_feedback != nullptr)
+      {
+         std::lock_guard<std::mutex> feedback_lock(m_feedback_mutex);
+         m_compatible_formats.clear();
+         if (!m_compatible_formats.try_push_back_many(importable_formats.data(),
+                                                      importable_formats.data() + importable_formats.size()))
+         {
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+         }
+      }
+
       for (auto &prop : drm_format_props)
       {
          if (prop.drmFormatModifier == allocated_format.modifier)
@@ -533,6 +1056,51 @@ VkResult swapchain::create_swapchain_image(VkImageCreateInfo image_create_info,
    return m_device_data.disp.CreateImage(m_device, &m_image_create_info, get_allocation_callbacks(), &image.image);
 }
 
+void swapchain::damage_surface(const present_damage &damage)
+{
+   const bool damage_buffer_supported =
+      wl_proxy_get_version(reinterpret_cast<wl_proxy *>(m_surface)) >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION;
+   if (damage.is_full() || !damage_buffer_supported || !m_committed)
+   {
+      wl_surface_damage(m_surface, 0, 0, INT32_MAX, INT32_MAX);
+      return;
+   }
+
+   /* Present regions are relative to the previous present, which is the buffer the compositor compares against. */
+   for (uint32_t i = 0; i < damage.rect_count; i++)
+   {
+      const VkRect2D &rect = damage.rects[i];
+      wl_surface_damage_buffer(m_surface, rect.offset.x, rect.offset.y, static_cast<int32_t>(rect.extent.width),
+                               static_cast<int32_t>(rect.extent.height));
+   }
+}
+
+void swapchain::set_commit_target_time(const pending_present_request &pending_present)
+{
+   wp_commit_timer_v1 *timer = m_wsi_surface->get_commit_timer_interface();
+   if (timer == nullptr || pending_present.target_time == 0)
+   {
+      return;
+   }
+
+   /* Timestamps are in the presentation clock, the time domain present timing reports on Wayland. */
+   uint64_t target_ns = pending_present.target_time;
+   if (pending_present.target_time_relative)
+   {
+      const uint64_t last_presentation_ns = m_last_presentation_time_ns.load(std::memory_order_relaxed);
+      if (last_presentation_ns == 0)
+      {
+         return;
+      }
+      target_ns += last_presentation_ns;
+   }
+
+   constexpr uint64_t ns_per_second = 1000000000;
+   const uint64_t target_sec = target_ns / ns_per_second;
+   wp_commit_timer_v1_set_timestamp(timer, static_cast<uint32_t>(target_sec >> 32), static_cast<uint32_t>(target_sec),
+                                    static_cast<uint32_t>(target_ns % ns_per_second));
+}
+
 void swapchain::present_image(const pending_present_request &pending_present)
 {
    int res;
@@ -540,14 +1108,33 @@ void swapchain::present_image(const pending_present_request &pending_present)
       reinterpret_cast<wayland_image_data *>(m_swapchain_images[pending_present.image_index].data);
 
    /* if a frame is already pending, wait for a hint to present again */
-   if (!m_wsi_surface->wait_next_frame_event())
+   wp_fifo_v1 *fifo = m_wsi_surface->get_fifo_interface();
+   if (fifo == nullptr && !m_wsi_surface->wait_next_frame_event())
    {
       set_error_state(VK_ERROR_SURFACE_LOST_KHR);
    }
 
+   /* The compositor stopped sending frame events, the surface is not shown. The buffer is not committed and the
+    * earlier frame request stays pending until the surface is shown again. */
+   if (fifo == nullptr && m_wsi_surface->are_frame_events_starved())
+   {
+      return complete_hidden_present(pending_present);
+   }
+
    wl_surface_attach(m_surface, image_data->buffer, 0, 0);
 
-   if (m_wsi_surface->get_surface_sync_interface() != nullptr)
+   if (m_syncobj_surface != nullptr)
+   {
+      /* The compositor waits for the payload's timeline point, no sync FD needs exporting. */
+      wp_linux_drm_syncobj_surface_v1_set_acquire_point(m_syncobj_surface, m_acquire_timeline_obj.get(),
+                                                        static_cast<uint32_t>(image_data->acquire_point >> 32),
+                                                        static_cast<uint32_t>(image_data->acquire_point));
+      image_data->release_point = ++m_release_point;
+      wp_linux_drm_syncobj_surface_v1_set_release_point(m_syncobj_surface, m_release_timeline_obj.get(),
+                                                        static_cast<uint32_t>(image_data->release_point >> 32),
+                                                        static_cast<uint32_t>(image_data->release_point));
+   }
+   else if (m_surface_sync != nullptr)
    {
       auto present_sync_fd = image_data->present_fence.export_sync_fd();
       if (!present_sync_fd.has_value())
@@ -557,24 +1144,58 @@ void swapchain::present_image(const pending_present_request &pending_present)
       }
       else if (present_sync_fd->is_valid())
       {
-         zwp_linux_surface_synchronization_v1_set_acquire_fence(m_wsi_surface->get_surface_sync_interface(),
-                                                                present_sync_fd->get());
+         zwp_linux_surface_synchronization_v1_set_acquire_fence(m_surface_sync, present_sync_fd->get());
       }
    }
 
-   /* TODO: work out damage */
-   wl_surface_damage(m_surface, 0, 0, INT32_MAX, INT32_MAX);
+   damage_surface(pending_present.damage);
+   update_viewport();
+
+   if (m_surface_feedback != nullptr)
+   {
+      check_surface_feedback();
+   }
 
-   if (m_present_mode == VK_PRESENT_MODE_FIFO_KHR)
+   /* Completing the present ID and its timing waits for the compositor to report the commit on screen. */
+   bool present_timing_enabled = false;
+#if VULKAN_WSI_LAYER_EXPERIMENTAL
+   auto *timing_ext = get_swapchain_extension<wsi_ext_present_timing_wayland>();
+   present_timing_enabled = timing_ext != nullptr;
+#endif
+   bool present_id_pending = false;
+   if ((m_device_data.is_present_id_enabled() || present_timing_enabled) && pending_present.present_id != 0)
    {
-      if (!m_wsi_surface->set_frame_callback())
+      present_id_pending = request_presentation_feedback(pending_present.present_id, pending_present.queue_time_ns);
+      if (!present_id_pending)
+      {
+         WSI_LOG_WARNING("Failed to request presentation feedback, the present ID completes on commit.");
+      }
+   }
+
+   /* Only IMMEDIATE presents may tear, the hint is sent again when a present switches mode. */
+   m_wsi_surface->set_presentation_hint(pending_present.present_mode == VK_PRESENT_MODE_IMMEDIATE_KHR);
+
+   if (pending_present.present_mode == VK_PRESENT_MODE_FIFO_KHR)
+   {
+      if (fifo != nullptr)
+      {
+         /* The commit is held until the barrier of the previous one cleared on a refresh, then sets its own. */
+         wp_fifo_v1_wait_barrier(fifo);
+         wp_fifo_v1_set_barrier(fifo);
+      }
+      else if (!m_wsi_surface->set_frame_callback())
       {
          set_error_state(VK_ERROR_SURFACE_LOST_KHR);
       }
    }
+   set_commit_target_time(pending_present);
 
-   wl_surface_commit(m_surface);
-   res = wl_display_flush(m_display);
+   {
+      WSI_TRACE_SCOPE_ID("wl_surface_commit", pending_present.present_id);
+      wl_surface_commit(m_surface);
+      m_committed = true;
+      res = wl_display_flush(m_display);
+   }
    if (res < 0)
    {
       WSI_LOG_ERROR("error flushing the display");
@@ -582,16 +1203,29 @@ void swapchain::present_image(const pending_present_request &pending_present)
       set_error_state(VK_ERROR_SURFACE_LOST_KHR);
    }
 
-   if (m_device_data.is_present_id_enabled())
+   /* Without a feedback the commit is the last point the layer sees of the present. */
+   if (!present_id_pending)
    {
-      auto *ext = get_swapchain_extension<wsi_ext_present_id>(true);
-      ext->set_present_id(pending_present.present_id);
+      m_frame_stats.record(util::frame_stage::queue_to_screen, pending_present.queue_time_ns);
+      if (m_device_data.is_present_id_enabled())
+      {
+         auto *ext = get_swapchain_extension<wsi_ext_present_id>(true);
+         ext->set_present_id(pending_present.present_id);
+      }
+#if VULKAN_WSI_LAYER_EXPERIMENTAL
+      if (timing_ext != nullptr && pending_present.present_id != 0)
+      {
+         timing_ext->complete_presentation_entry(pending_present.present_id);
+      }
+#endif
    }
 }
 
 void swapchain::destroy_image(swapchain_image &image)
 {
    std::unique_lock<std::recursive_mutex> image_status_lock(m_image_status_mutex);
+   /* Buffers the presentation engine may still read are not handed to the allocation cache. */
+   bool buffer_reusable = !is_image_in_use(image.status);
 
    if (image.status != swapchain_image::INVALID)
    {
@@ -601,7 +1235,7 @@ void swapchain::destroy_image(swapchain_image &image)
          image.image = VK_NULL_HANDLE;
       }
 
-      image.status = swapchain_image::INVALID;
+      set_image_status(image, swapchain_image::INVALID);
    }
 
    image_status_lock.unlock();
@@ -613,11 +1247,60 @@ void swapchain::destroy_image(swapchain_image &image)
       {
          wl_buffer_destroy(image_data->buffer);
       }
+      if (m_release_timeline.has_value() && image_data->release_point != 0 &&
+          m_release_timeline->wait(image_data->release_point, 0) != VK_SUCCESS)
+      {
+         buffer_reusable = false;
+      }
+      const int recycle_fd = buffer_reusable ? image_data->external_mem.take_recycle_fd() : -1;
       m_allocator.destroy(1, image_data);
       image.data = nullptr;
+
+      /* The buffer is only handed back once the image memory imported from it is freed. */
+      if (recycle_fd >= 0)
+      {
+         wsialloc_free(m_wsi_allocator, recycle_fd);
+      }
    }
 }
 
+bool swapchain::adopt_ancestor_image(swapchain_base &ancestor, swapchain_image &ancestor_image)
+{
+   auto image_data = reinterpret_cast<wayland_image_data *>(ancestor_image.data);
+   auto &ancestor_swapchain = static_cast<swapchain &>(ancestor);
+
+   /* A suboptimal ancestor is usually replaced to get images in the format the compositor now prefers. */
+   if (ancestor_swapchain.is_suboptimal())
+   {
+      return false;
+   }
+
+   /* The release point of the ancestor's timeline cannot be waited for once the ancestor is gone. */
+   if (image_data->release_point != 0 && ancestor_swapchain.m_release_timeline.has_value())
+   {
+      if (ancestor_swapchain.m_release_timeline->wait(image_data->release_point, 0) != VK_SUCCESS)
+      {
+         return false;
+      }
+   }
+   image_data->acquire_point = 0;
+   image_data->release_point = 0;
+
+   /* FREE buffers were released by the compositor, so no release event is left on the ancestor's queue. Route the
+    * next ones to this swapchain. The wl_buffer goes with the image, so recreating the swapchain creates none. */
+   wl_proxy_set_user_data(reinterpret_cast<wl_proxy *>(image_data->buffer), this);
+   wl_proxy_set_queue(reinterpret_cast<wl_proxy *>(image_data->buffer), m_buffer_queue);
+   if (image_data->buffer_params != nullptr)
+   {
+      /* Never presented, a failure of its creation may still come. */
+      wl_proxy_set_user_data(reinterpret_cast<wl_proxy *>(image_data->buffer_params.get()), this);
+      wl_proxy_set_queue(reinterpret_cast<wl_proxy *>(image_data->buffer_params.get()), m_buffer_queue);
+   }
+   move_image_data_accounting(ancestor, sizeof(wayland_image_data));
+   image_data->external_mem.rebind_allocator(m_allocator);
+   return true;
+}
+
 bool swapchain::free_image_found()
 {
    for (auto &img : m_swapchain_images)
@@ -632,6 +1315,12 @@ bool swapchain::free_image_found()
 
 VkResult swapchain::get_free_buffer(uint64_t *timeout)
 {
+   if (m_buffer_release_thread_run)
+   {
+      /* The buffer release thread frees the images, the free image semaphore can be waited on directly. */
+      return error_has_occured() ? get_error_state() : VK_SUCCESS;
+   }
+
    int ms_timeout, res;
 
    if (*timeout >= INT_MAX * 1000llu * 1000llu)
@@ -675,15 +1364,21 @@ VkResult swapchain::get_free_buffer(uint64_t *timeout)
 }
 
 VkResult swapchain::image_set_present_payload(swapchain_image &image, VkQueue queue,
-                                              const queue_submit_semaphores &semaphores, const void *submission_pnext)
+                                              const queue_submit_semaphores &semaphores, const void *submission_pnext,
+                                              present_batch *batch)
 {
    auto image_data = reinterpret_cast<wayland_image_data *>(image.data);
-   return image_data->present_fence.set_payload(queue, semaphores, submission_pnext);
+   if (m_syncobj_surface != nullptr)
+   {
+      return m_acquire_timeline->submit(queue, semaphores, submission_pnext, VK_NULL_HANDLE, batch,
+                                        image_data->acquire_point);
+   }
+   return image_data->present_fence.set_payload(queue, semaphores, submission_pnext, VK_NULL_HANDLE, batch);
 }
 
 VkResult swapchain::image_wait_present(swapchain_image &image, uint64_t timeout)
 {
-   if (m_wsi_surface->get_surface_sync_interface() == nullptr)
+   if (m_syncobj_surface == nullptr && m_surface_sync == nullptr)
    {
       auto data = reinterpret_cast<wayland_image_data *>(image.data);
       return data->present_fence.wait_payload(timeout);
@@ -694,6 +1389,33 @@ VkResult swapchain::image_wait_present(swapchain_image &image, uint64_t timeout)
    return VK_SUCCESS;
 }
 
+VkResult swapchain::image_wait_payload(swapchain_image &image, uint64_t timeout)
+{
+   auto data = reinterpret_cast<wayland_image_data *>(image.data);
+   /* The payloads of synced presents signal the acquire timeline, which image_wait_present leaves to the compositor. */
+   if (m_syncobj_surface != nullptr)
+   {
+      return data->acquire_point == 0 ? VK_SUCCESS : m_acquire_timeline->wait(data->acquire_point, timeout);
+   }
+   return data->present_fence.wait_payload(timeout);
+}
+
+std::optional<util::fd_owner> swapchain::image_export_present_payload(swapchain_image &image)
+{
+   auto data = reinterpret_cast<wayland_image_data *>(image.data);
+   return data->present_fence.export_sync_fd();
+}
+
+swapchain_base::image_release_point swapchain::get_image_release_point(const swapchain_image &image)
+{
+   auto image_data = reinterpret_cast<const wayland_image_data *>(image.data);
+   if (m_syncobj_surface == nullptr || image_data->release_point == 0)
+   {
+      return { VK_NULL_HANDLE, 0 };
+   }
+   return { m_release_timeline->get_semaphore(), image_data->release_point };
+}
+
 VkResult swapchain::bind_swapchain_image(VkDevice &device, const VkBindImageMemoryInfo *bind_image_mem_info,
                                          const VkBindImageMemorySwapchainInfoKHR *bind_sc_info)
 {
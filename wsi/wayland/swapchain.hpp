@@ -37,7 +37,9 @@ extern "C" {
 #include <wayland-client.h>
 #include <linux-dmabuf-unstable-v1-client-protocol.h>
 #include "surface.hpp"
+#include "dmabuf_feedback.hpp"
 #include "util/wsialloc/wsialloc.h"
+#include "wsi/wsialloc_batch.hpp"
 #include "util/custom_allocator.hpp"
 #include "wl_object_owner.hpp"
 
@@ -58,7 +60,13 @@ struct wayland_image_data
 
    external_memory external_mem;
    wl_buffer *buffer;
+   /* Params @ref buffer was created from, kept until the compositor released the buffer once so a failed
+    * create_immed is still reported. */
+   wayland_owner<zwp_linux_buffer_params_v1> buffer_params;
    sync_fd_fence_sync present_fence;
+   /* Points of the syncobj timelines of the latest present, when the swapchain uses linux-drm-syncobj-v1. */
+   uint64_t acquire_point{ 0 };
+   uint64_t release_point{ 0 };
 };
 
 struct image_creation_parameters
@@ -79,8 +87,11 @@ struct image_creation_parameters
    }
 };
 
-class swapchain : public wsi::swapchain_base
+class swapchain final : public wsi::swapchain_base
 {
+   /* Calls the present path directly when the layer is built with this backend only, see backend_swapchain.hpp. */
+   friend class wsi::swapchain_base;
+
 public:
    explicit swapchain(layer::device_private_data &dev_data, const VkAllocationCallbacks *allocator,
                       surface &wsi_surface);
@@ -90,6 +101,32 @@ public:
    /* TODO: make the buffer destructor a friend? so this can be protected */
    void release_buffer(struct wl_buffer *wl_buffer);
 
+   /**
+    * @brief Handle the compositor failing to import the dma-bufs of a wl_buffer created with create_immed.
+    */
+   void buffer_creation_failed(zwp_linux_buffer_params_v1 *params);
+
+   /**
+    * @brief Time a commit reached the screen, from the wp_presentation_feedback presented event.
+    */
+   struct presentation_time
+   {
+      /* Timestamp in the compositor's presentation clock, see surface::get_presentation_clock. */
+      uint64_t time_ns;
+      /* Refresh interval of the output, 0 when unknown. */
+      uint32_t refresh_ns;
+      /* wp_presentation_feedback_kind flags. */
+      uint32_t flags;
+   };
+
+   /**
+    * @brief Complete the present ID and present timing entry of @p feedback, on its presented or discarded event.
+    *
+    * @param presented When the commit reached the screen, nullptr when it was discarded. Only presented
+    *                  commits have their latency and timing recorded.
+    */
+   void complete_presentation_feedback(struct wp_presentation_feedback *feedback, const presentation_time *presented);
+
 protected:
    /**
     * @brief Initialize platform specifics.
@@ -135,6 +172,11 @@ protected:
     */
    void destroy_image(swapchain_image &image) override;
 
+   /**
+    * @brief Take over an image of the swapchain being replaced, see swapchain_base::adopt_ancestor_image.
+    */
+   bool adopt_ancestor_image(swapchain_base &ancestor, swapchain_image &ancestor_image) override;
+
    /**
     * @brief Method to check if there are any free images
     *
@@ -164,10 +206,45 @@ protected:
     * @return VK_SUCCESS on success or an error code otherwise.
     */
    VkResult image_set_present_payload(swapchain_image &image, VkQueue queue, const queue_submit_semaphores &semaphores,
-                                      const void *submission_pnext) override;
+                                      const void *submission_pnext, present_batch *batch) override;
 
    VkResult image_wait_present(swapchain_image &image, uint64_t timeout) override;
 
+   /**
+    * @brief With explicit sync the compositor waits for the payload rather than the page flip thread.
+    */
+   bool presents_wait_for_payload() const override
+   {
+      return m_syncobj_surface != nullptr || m_surface_sync != nullptr;
+   }
+
+   /**
+    * @brief Wait for the present payload of an image, see swapchain_base::image_wait_payload.
+    */
+   VkResult image_wait_payload(swapchain_image &image, uint64_t timeout) override;
+
+   std::optional<util::fd_owner> image_export_present_payload(swapchain_image &image) override;
+
+   /**
+    * @brief Get the release point of the latest present of @p image, when the swapchain uses linux-drm-syncobj-v1.
+    */
+   image_release_point get_image_release_point(const swapchain_image &image) override;
+
+   /**
+    * @brief Wait for a present by dispatching the presentation feedback events on the buffer queue.
+    *
+    * One waiting thread dispatches at a time, the others sleep until it made progress.
+    */
+   VkResult wait_for_present(uint64_t present_id, uint64_t timeout) override;
+
+   /**
+    * @brief The last commit presented and the refresh of its output, from wp_presentation_feedback.
+    *
+    * Feedback is only requested for presents with an ID, and compositors with another presentation clock than
+    * CLOCK_MONOTONIC cannot be compared with the time of acquire.
+    */
+   bool get_vblank_timing(uint64_t *vblank_ns, uint64_t *refresh_ns) override;
+
    /**
     * @brief Bind image to a swapchain
     *
@@ -198,6 +275,41 @@ private:
     */
    VkResult add_required_extensions(VkDevice device, const VkSwapchainCreateInfoKHR *swapchain_create_info) override;
 
+   /**
+    * @brief Damage the surface for the next commit with the area that changed since the previous present.
+    *
+    * The rectangles are given in buffer coordinates with wl_surface.damage_buffer. Compositors without it, and the
+    * first commit of the swapchain, damage the whole surface.
+    */
+   void damage_surface(const present_damage &damage);
+
+   /**
+    * @brief Scale the next commit to the surface extent with wp_viewport, following
+    *        VkSwapchainPresentScalingCreateInfoEXT.
+    *
+    * The surface extent is the one of the latest swapchain created for the surface, see
+    * surface::set_swapchain_extent. Images of a replaced swapchain that are still presented are scaled to it.
+    */
+   void update_viewport();
+
+   /* Scaling behavior from VkSwapchainPresentScalingCreateInfoEXT, 0 leaves the viewport unset. */
+   VkPresentScalingFlagsEXT m_present_scaling{ 0 };
+
+   /**
+    * @brief Set up timeline explicit synchronization with linux-drm-syncobj-v1.
+    *
+    * Needs timeline semaphores exportable to DRM syncobjs. When unavailable presents fall back to
+    * zwp_linux_explicit_synchronization_v1, or implicit synchronization.
+    *
+    * @return true when the swapchain uses syncobj timelines.
+    */
+   bool init_syncobj_timelines();
+
+   /**
+    * @brief Share @p timeline with the compositor.
+    */
+   wayland_owner<wp_linux_drm_syncobj_timeline_v1> import_syncobj_timeline(timeline_semaphore &timeline);
+
    struct wl_display *m_display;
    struct wl_surface *m_surface;
    /** Raw pointer to the WSI Surface that this swapchain was created from. The Vulkan specification ensures that the
@@ -207,11 +319,137 @@ private:
    /* The queue on which we dispatch buffer related events, mostly buffer_release */
    struct wl_event_queue *m_buffer_queue;
 
+   /**
+    * @brief Syncobj surface of @ref m_wsi_surface, nullptr when the swapchain does not use linux-drm-syncobj-v1.
+    *
+    * Present payloads then signal the next point of @ref m_acquire_timeline, which the compositor waits for before
+    * reading the buffer, and the compositor signals a point of @ref m_release_timeline once it is done with it.
+    */
+   wp_linux_drm_syncobj_surface_v1 *m_syncobj_surface{ nullptr };
+   /**
+    * @brief Surface synchronization interface of @ref m_wsi_surface presents set their acquire fence with when there
+    *        is no @ref m_syncobj_surface, nullptr when the compositor has none.
+    */
+   zwp_linux_surface_synchronization_v1 *m_surface_sync{ nullptr };
+   std::optional<timeline_semaphore> m_acquire_timeline;
+   wayland_owner<wp_linux_drm_syncobj_timeline_v1> m_acquire_timeline_obj;
+   std::optional<timeline_semaphore> m_release_timeline;
+   wayland_owner<wp_linux_drm_syncobj_timeline_v1> m_release_timeline_obj;
+   /* Latest release point handed to the compositor, only used from present_image. */
+   uint64_t m_release_point{ 0 };
+
+   /**
+    * @brief Presentation clock time the latest presented commit reached the screen, 0 until a feedback reported one.
+    *        Relative present targets are scheduled from it.
+    */
+   std::atomic<uint64_t> m_last_presentation_time_ns{ 0 };
+
+   /**
+    * @brief Refresh interval of the output the latest presented commit reached, 0 when unknown.
+    */
+   std::atomic<uint32_t> m_last_refresh_ns{ 0 };
+
+   /**
+    * @brief Schedule the next commit for the target time of @p pending_present with wp_commit_timer_v1.
+    */
+   void set_commit_target_time(const pending_present_request &pending_present);
+
+   /**
+    * @brief Whether a buffer of this swapchain was committed. Before that the surface shows a buffer of another
+    *        swapchain, or none, so present regions do not describe what changed.
+    */
+   bool m_committed{ false };
+
+   /**
+    * @brief wp_presentation_feedback of a present with an ID, dispatched on the buffer queue.
+    */
+   struct presentation_feedback
+   {
+      struct wp_presentation_feedback *feedback;
+      uint64_t present_id;
+      uint64_t queue_time_ns;
+   };
+
+   /**
+    * @brief Feedback of the presents that have not been presented or discarded yet, guarded by
+    *        @ref m_presentation_feedbacks_mutex.
+    */
+   util::vector<presentation_feedback> m_presentation_feedbacks;
+   std::mutex m_presentation_feedbacks_mutex;
+
+   /**
+    * @brief Held by the thread of @ref wait_for_present that dispatches the buffer queue.
+    */
+   std::mutex m_present_wait_mutex;
+
+   /**
+    * @brief Dispatches @ref m_buffer_queue until the swapchain is destroyed, so buffer releases mark images FREE as
+    *        soon as they arrive rather than on the next acquire.
+    *
+    * Until the thread runs, and after it stopped, acquire and vkWaitForPresentKHR dispatch the queue themselves.
+    */
+   std::thread m_buffer_release_thread;
+   std::atomic<bool> m_buffer_release_thread_run{ false };
+
+   /**
+    * @brief eventfd written to stop @ref m_buffer_release_thread while it waits for events.
+    */
+   util::fd_owner m_buffer_release_wake_fd;
+
+   void buffer_release_thread();
+   VkResult start_buffer_release_thread();
+   void stop_buffer_release_thread();
+
+   /**
+    * @brief Request a presentation feedback for the next commit, to complete @p present_id when it is presented.
+    *
+    * @param queue_time_ns Time the present was queued, see @ref util::frame_stats::now_ns.
+    *
+    * @return false if the feedback could not be requested.
+    */
+   bool request_presentation_feedback(uint64_t present_id, uint64_t queue_time_ns);
+
+   /**
+    * @brief Listen to the dmabuf feedback of the surface, when zwp_linux_dmabuf_v1 is version 4 or later.
+    *
+    * @return false when the feedback could not be set up, formats are then picked without the compositor's preference.
+    */
+   bool init_surface_feedback();
+
+   /**
+    * @brief Rank of @p format in @ref m_surface_feedback, for the fourcc the wl_buffers are created with.
+    */
+   uint32_t get_feedback_rank(const wsialloc_format &format);
+
+   /**
+    * @brief Mark the swapchain suboptimal when the latest surface feedback prefers another compatible format.
+    */
+   void check_surface_feedback();
+
+   /**
+    * @brief Dmabuf feedback of the surface, dispatched on @ref m_buffer_queue. nullptr when unsupported.
+    *
+    * Tranches change e.g. when the surface goes fullscreen, and can then move a format to a scanout tranche.
+    */
+   util::unique_ptr<dmabuf_feedback> m_surface_feedback;
+   /* Guards @ref m_feedback_generation and @ref m_compatible_formats, written by the image allocations and read by
+    * presents. */
+   std::mutex m_feedback_mutex;
+   /* Generation of @ref m_surface_feedback last checked against the allocated format. */
+   uint64_t m_feedback_generation{ 0 };
+   /* Formats the images could be allocated with, checked again on feedback changes. */
+   util::vector<wsialloc_format> m_compatible_formats;
+
    /**
     * @brief Handle to the WSI allocator.
     */
    wsialloc_allocator *m_wsi_allocator;
 
+   /**
+    * @brief Buffers allocated ahead for the images that are not allocated yet.
+    */
+   wsialloc_batch m_wsialloc_batch;
+
    /**
     * @brief Image creation parameters used for all swapchain images.
     */
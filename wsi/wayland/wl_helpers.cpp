@@ -34,10 +34,12 @@
 
 #include "util/log.hpp"
 
-int dispatch_queue(struct wl_display *display, struct wl_event_queue *queue, int timeout)
+int dispatch_queue(struct wl_display *display, struct wl_event_queue *queue, int timeout, int wake_fd)
 {
    int err;
-   struct pollfd pfd = {};
+   /* poll ignores the negative wake_fd. */
+   struct pollfd pfds[2] = {};
+   struct pollfd &pfd = pfds[0];
    int retval;
 
    /* Before we sleep, dispatch any pending events. prepare_read_queue will return 0 whilst there are pending
@@ -57,6 +59,8 @@ int dispatch_queue(struct wl_display *display, struct wl_event_queue *queue, int
    /* wl_display_read_events performs a non-blocking read. */
    pfd.fd = wl_display_get_fd(display);
    pfd.events = POLLIN;
+   pfds[1].fd = wake_fd;
+   pfds[1].events = POLLIN;
    while (true)
    {
       /* Timeout is given in milliseconds. A return value of 0, or -1 with errno set to EINTR means that we
@@ -64,7 +68,7 @@ int dispatch_queue(struct wl_display *display, struct wl_event_queue *queue, int
        * return value of 1 means that something happened, and we should inspect the pollfd structure to see
        * just what that was.
        */
-      err = poll(&pfd, 1, timeout);
+      err = poll(pfds, 2, timeout);
       if (0 == err)
       {
          /* Timeout. */
@@ -87,7 +91,13 @@ int dispatch_queue(struct wl_display *display, struct wl_event_queue *queue, int
       }
       else
       {
-         if (POLLIN == pfd.revents)
+         if (pfds[1].revents != 0)
+         {
+            /* Woken up, leave any events to the next dispatch. */
+            wl_display_cancel_read(display);
+            return 0;
+         }
+         else if (POLLIN == pfd.revents)
          {
             /* We have data to read, and no errors; proceed to read_events. */
             break;
@@ -29,6 +29,7 @@
 
 #include "wsi_factory.hpp"
 #include "surface.hpp"
+#include "util/tuning_profile.hpp"
 
 #if BUILD_WSI_HEADLESS
 #include "headless/surface_properties.hpp"
@@ -186,6 +187,15 @@ VkResult add_device_extensions_required_by_layer(VkPhysicalDevice phys_dev,
          VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME,
 #if ENABLE_INSTRUMENTATION
          VK_EXT_FRAME_BOUNDARY_EXTENSION_NAME,
+#endif
+#if BUILD_WSI_X11
+         /* Needed by the X11 DRI3 presenter, which falls back to MIT-SHM when these are missing. */
+         VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME,
+         VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME,
+         /* Lets the MIT-SHM presenter render straight into the shared segments. */
+         VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME,
+         /* Tells the DRI3 presenter whether the X server displays from another GPU, see image_present_copy. */
+         VK_EXT_PHYSICAL_DEVICE_DRM_EXTENSION_NAME,
 #endif
       };
 
@@ -198,6 +208,13 @@ VkResult add_device_extensions_required_by_layer(VkPhysicalDevice phys_dev,
       }
    }
 
+   /* Lets swapchains compress their images when the application does not, see auto_fixed_rate_compression. */
+   if (util::tuning_profile::get().auto_fixed_rate_compression != 0 &&
+       available_device_extensions.contains(VK_EXT_IMAGE_COMPRESSION_CONTROL_EXTENSION_NAME))
+   {
+      TRY_LOG_CALL(extensions_to_enable.add(VK_EXT_IMAGE_COMPRESSION_CONTROL_EXTENSION_NAME));
+   }
+
    for (const auto &wsi_ext : supported_wsi_extensions)
    {
       /* Skip iterating over platforms not enabled in the instance. */
@@ -302,19 +319,10 @@ void set_swapchain_maintenance1_state(VkPhysicalDevice physicalDevice,
 {
    if (swapchain_maintenance1_features != nullptr)
    {
-      if (swapchain_maintenance1_features->swapchainMaintenance1)
-      {
-         auto &instance = layer::instance_private_data::get(physicalDevice);
-         if (instance.is_instance_extension_enabled(VK_KHR_DISPLAY_EXTENSION_NAME))
-         {
-            swapchain_maintenance1_features->swapchainMaintenance1 = false;
-         }
-      }
-      else
-      {
-         swapchain_maintenance1_features->swapchainMaintenance1 =
-            layer::instance_private_data::get(physicalDevice).get_maintainance1_support();
-      }
+      /* Every backend implements the extension, it is only unavailable when the instance enables surfaces the
+       * layer does not implement. */
+      swapchain_maintenance1_features->swapchainMaintenance1 =
+         layer::instance_private_data::get(physicalDevice).get_maintainance1_support();
    }
 }
 
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file wsialloc_batch.hpp
+ *
+ * @brief Allocation of the buffers of a swapchain in one wsialloc call.
+ */
+
+#pragma once
+
+#include <unistd.h>
+
+#include "util/allocation_stats.hpp"
+#include "util/custom_allocator.hpp"
+#include "util/wsialloc/wsialloc.h"
+
+namespace wsi
+{
+
+/**
+ * @brief Buffers allocated ahead with wsialloc_alloc_batch, for swapchain images that are allocated one at a time.
+ *
+ * All the images of a swapchain are allocated with the same description, so the first allocation allocates the
+ * buffers of the images that follow as well, and they only make one format selection.
+ */
+class wsialloc_batch
+{
+public:
+   /**
+    * @param stats Statistics the allocations are recorded to.
+    */
+   wsialloc_batch(const util::allocator &allocator, util::allocation_stats &stats)
+      : m_buffers(allocator)
+      , m_stats(stats)
+   {
+   }
+
+   ~wsialloc_batch()
+   {
+      clear();
+   }
+
+   wsialloc_batch(const wsialloc_batch &) = delete;
+   wsialloc_batch &operator=(const wsialloc_batch &) = delete;
+
+   /**
+    * @brief Allocate a buffer like wsialloc_alloc, taking it from the buffers allocated ahead when there are any.
+    *
+    * @param batch_size Number of buffers to allocate with @p info when none is left, including the returned one.
+    */
+   wsialloc_error allocate(wsialloc_allocator *wsi_allocator, const wsialloc_allocate_info &info, uint32_t batch_size,
+                           wsialloc_allocate_result *result)
+   {
+      /* Only allocations of a single format have a description that can be compared. */
+      if ((info.flags & WSIALLOC_ALLOCATE_NO_MEMORY) || info.format_count != 1)
+      {
+         return allocate_one(wsi_allocator, info, result);
+      }
+
+      if (!m_buffers.empty() && !matches(info))
+      {
+         clear();
+      }
+
+      if (m_buffers.empty() && batch_size > 1 && m_buffers.try_resize(batch_size))
+      {
+         for (auto &buffer : m_buffers)
+         {
+            buffer = *result;
+         }
+         const uint64_t start_ns = util::frame_stats::now_ns();
+         if (wsialloc_alloc_batch(wsi_allocator, &info, batch_size, m_buffers.data()) == WSIALLOC_ERROR_NONE)
+         {
+            uint64_t bytes = 0;
+            for (const auto &buffer : m_buffers)
+            {
+               bytes += get_size(buffer);
+            }
+            m_stats.record_buffer_allocation(info.formats[0].fourcc, info.flags, start_ns, bytes);
+
+            m_format = info.formats[0];
+            m_width = info.width;
+            m_height = info.height;
+            m_flags = info.flags;
+         }
+         else
+         {
+            /* Fewer buffers may still fit. */
+            m_buffers.clear();
+         }
+      }
+
+      if (m_buffers.empty())
+      {
+         return allocate_one(wsi_allocator, info, result);
+      }
+
+      *result = m_buffers.back();
+      m_buffers.pop_back();
+      return WSIALLOC_ERROR_NONE;
+   }
+
+private:
+   wsialloc_error allocate_one(wsialloc_allocator *wsi_allocator, const wsialloc_allocate_info &info,
+                               wsialloc_allocate_result *result)
+   {
+      const uint64_t start_ns = util::frame_stats::now_ns();
+      const wsialloc_error err = wsialloc_alloc(wsi_allocator, &info, result);
+      if (err == WSIALLOC_ERROR_NONE && !(info.flags & WSIALLOC_ALLOCATE_NO_MEMORY))
+      {
+         m_stats.record_buffer_allocation(result->format.fourcc, info.flags, start_ns, get_size(*result));
+      }
+      return err;
+   }
+
+   /**
+    * @brief Size of the memory of @p buffer, adding up the planes with a file descriptor of their own.
+    */
+   static uint64_t get_size(const wsialloc_allocate_result &buffer)
+   {
+      uint64_t size = 0;
+      for (int plane = 0; plane < WSIALLOC_MAX_PLANES; plane++)
+      {
+         const int fd = buffer.buffer_fds[plane];
+         const off_t fd_size = fd >= 0 && is_first_use(buffer, plane) ? lseek(fd, 0, SEEK_END) : 0;
+         size += fd_size > 0 ? static_cast<uint64_t>(fd_size) : 0;
+      }
+      return size;
+   }
+
+   static bool is_first_use(const wsialloc_allocate_result &buffer, int plane)
+   {
+      for (int other = 0; other < plane; other++)
+      {
+         if (buffer.buffer_fds[other] == buffer.buffer_fds[plane])
+         {
+            return false;
+         }
+      }
+      return true;
+   }
+
+   bool matches(const wsialloc_allocate_info &info) const
+   {
+      return info.formats[0].fourcc == m_format.fourcc && info.formats[0].modifier == m_format.modifier &&
+             info.width == m_width && info.height == m_height && info.flags == m_flags;
+   }
+
+   /**
+    * @brief Close the buffers that were not handed out.
+    */
+   void clear()
+   {
+      for (const auto &buffer : m_buffers)
+      {
+         for (int plane = 0; plane < WSIALLOC_MAX_PLANES; plane++)
+         {
+            if (buffer.buffer_fds[plane] >= 0 && is_first_use(buffer, plane))
+            {
+               close(buffer.buffer_fds[plane]);
+            }
+         }
+      }
+      m_buffers.clear();
+   }
+
+   util::vector<wsialloc_allocate_result> m_buffers;
+   util::allocation_stats &m_stats;
+   wsialloc_format m_format{};
+   uint32_t m_width{ 0 };
+   uint32_t m_height{ 0 };
+   uint64_t m_flags{ 0 };
+};
+
+} /* namespace wsi */
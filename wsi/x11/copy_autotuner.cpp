@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file copy_autotuner.cpp
+ *
+ * @brief Implementation of the SHM copy strategy autotuner.
+ */
+
+#include "copy_autotuner.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+
+#include "util/log.hpp"
+
+namespace wsi
+{
+namespace x11
+{
+
+bool copy_autotuner::add_candidate(const copy_strategy &strategy)
+{
+   if (m_candidate_count == MAX_CANDIDATES)
+   {
+      return false;
+   }
+   m_candidates[m_candidate_count] = strategy;
+   m_best_ns[m_candidate_count] = UINT64_MAX;
+   m_candidate_count++;
+   return true;
+}
+
+void copy_autotuner::start_trial(const copy_shape &shape, uint32_t max_bands)
+{
+   m_shape = shape;
+   m_max_bands = max_bands;
+   m_candidate_count = 0;
+   m_current = 0;
+   m_trial_frame = 0;
+   m_locked = false;
+
+   /* memcpy reads uncached memory no faster than the row kernels, which use streaming loads for it. */
+   if (shape.src_stride_pixels == shape.width && !shape.uncached_source)
+   {
+      add_candidate({ copy_strategy::method::memcpy_frame, 1, 0 });
+   }
+   add_candidate({ copy_strategy::method::kernel, 1, 0 });
+
+   if (max_bands > 1 && shape.height >= 2)
+   {
+      /* Doubling thread counts, then all of them, each thread with one contiguous band. */
+      for (uint32_t bands = 2; bands < max_bands && m_candidate_count < MAX_CANDIDATES - 2; bands *= 2)
+      {
+         add_candidate({ copy_strategy::method::threaded, bands, 0 });
+      }
+      add_candidate({ copy_strategy::method::threaded, max_bands, 0 });
+
+      /* Short interleaved chunks even out threads that run at different speeds. */
+      if (shape.height > max_bands * INTERLEAVED_CHUNK_ROWS)
+      {
+         add_candidate({ copy_strategy::method::threaded, max_bands, INTERLEAVED_CHUNK_ROWS });
+      }
+   }
+
+   m_locked = m_candidate_count == 1;
+}
+
+const copy_strategy &copy_autotuner::select(const copy_shape &shape, uint32_t max_bands)
+{
+   if (m_candidate_count == 0 || !(shape == m_shape) || max_bands != m_max_bands)
+   {
+      start_trial(shape, max_bands);
+   }
+   return m_candidates[m_current];
+}
+
+void copy_autotuner::record(uint64_t duration_ns)
+{
+   if (m_locked)
+   {
+      return;
+   }
+
+   m_best_ns[m_current] = std::min(m_best_ns[m_current], duration_ns);
+   if (++m_current < m_candidate_count)
+   {
+      return;
+   }
+
+   m_current = 0;
+   if (++m_trial_frame < TRIAL_FRAMES)
+   {
+      return;
+   }
+
+   for (uint32_t i = 1; i < m_candidate_count; i++)
+   {
+      if (m_best_ns[i] < m_best_ns[m_current])
+      {
+         m_current = i;
+      }
+   }
+   m_locked = true;
+
+   static const char *const method_names[] = { "memcpy", "kernel", "threaded" };
+   const copy_strategy &winner = m_candidates[m_current];
+   WSI_LOG_INFO("SHM copies of %ux%u frames use %s on %u thread(s), in chunks of %u rows (0: one band each), %" PRIu64
+                " us",
+                m_shape.width, m_shape.height, method_names[static_cast<uint32_t>(winner.kind)], winner.bands,
+                winner.chunk_rows, m_best_ns[m_current] / 1000);
+}
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file copy_autotuner.hpp
+ *
+ * @brief Picks the fastest way to copy frames of a given shape by timing the candidates on the first frames.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace wsi
+{
+namespace x11
+{
+
+/**
+ * @brief Way a whole frame is copied into its SHM segment.
+ */
+struct copy_strategy
+{
+   enum class method : uint8_t
+   {
+      /** One memcpy of the whole frame, only for a source as tightly packed as the destination. */
+      memcpy_frame,
+      /** The row kernel on the presenting thread. */
+      kernel,
+      /** The row kernel split across @ref bands threads of the copy worker pool. */
+      threaded,
+   };
+
+   method kind = method::kernel;
+   /** Threads the rows are split across, including the presenting one. */
+   uint32_t bands = 1;
+   /** Rows handed to a thread at a time, round robin. 0 gives each thread one contiguous band. */
+   uint32_t chunk_rows = 0;
+};
+
+/**
+ * @brief Frames that are copied alike: their size, source stride and source memory.
+ */
+struct copy_shape
+{
+   uint32_t width = 0;
+   uint32_t height = 0;
+   uint32_t src_stride_pixels = 0;
+   bool uncached_source = false;
+
+   bool operator==(const copy_shape &other) const
+   {
+      return width == other.width && height == other.height && src_stride_pixels == other.src_stride_pixels &&
+             uncached_source == other.uncached_source;
+   }
+};
+
+/**
+ * @brief Times every candidate copy strategy for a few frames and then keeps the fastest.
+ *
+ * The best choice depends on the core count and memory of the machine as much as on the frame, so it is measured
+ * rather than guessed. Each frame of the trial is a real copy, made with the next candidate, and the fastest of
+ * the @ref TRIAL_FRAMES copies of a candidate stands for it, which leaves out cold caches and preemptions. A frame
+ * of another shape, for example after a resize, starts a new trial.
+ */
+class copy_autotuner
+{
+public:
+   static constexpr uint32_t TRIAL_FRAMES = 3;
+   static constexpr uint32_t MAX_CANDIDATES = 12;
+   /** Rows per chunk of the interleaved threaded candidate. */
+   static constexpr uint32_t INTERLEAVED_CHUNK_ROWS = 16;
+
+   /**
+    * @brief Strategy to copy the next frame of @p shape with.
+    *
+    * @param max_bands Threads the copy worker pool can split a copy across, including the presenting one.
+    */
+   const copy_strategy &select(const copy_shape &shape, uint32_t max_bands);
+
+   /**
+    * @brief Record how long the copy made with the last strategy @ref select returned took.
+    */
+   void record(uint64_t duration_ns);
+
+private:
+   void start_trial(const copy_shape &shape, uint32_t max_bands);
+   bool add_candidate(const copy_strategy &strategy);
+
+   copy_shape m_shape;
+   uint32_t m_max_bands = 0;
+
+   std::array<copy_strategy, MAX_CANDIDATES> m_candidates{};
+   /* Fastest copy measured for each candidate, UINT64_MAX until measured. */
+   std::array<uint64_t, MAX_CANDIDATES> m_best_ns{};
+   uint32_t m_candidate_count = 0;
+
+   /* Trial position: candidate the next frame is copied with, and the number of frames each one was timed. */
+   uint32_t m_current = 0;
+   uint32_t m_trial_frame = 0;
+
+   /* Whether the trial is over, @ref m_current being the winner. */
+   bool m_locked = false;
+};
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file copy_kernels.cpp
+ *
+ * @brief Row copy kernels used by the SHM presenter, selected at runtime for the host CPU.
+ */
+
+#include "copy_kernels.hpp"
+
+#include <cstring>
+
+#ifdef ENABLE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace wsi
+{
+namespace x11
+{
+
+static void copy_rows_generic(const uint32_t *src_pixels, uint32_t *dst_pixels, uint32_t src_stride_pixels,
+                              uint32_t dst_width, uint32_t height)
+{
+   if (src_stride_pixels == dst_width)
+   {
+      std::memcpy(dst_pixels, src_pixels, static_cast<size_t>(dst_width) * height * sizeof(uint32_t));
+      return;
+   }
+
+   for (uint32_t row = 0; row < height; row++)
+   {
+      std::memcpy(dst_pixels + static_cast<size_t>(row) * dst_width,
+                  src_pixels + static_cast<size_t>(row) * src_stride_pixels, dst_width * sizeof(uint32_t));
+   }
+}
+
+#ifdef ENABLE_X86_SIMD
+
+/* Each kernel copies 4 vectors per iteration, then single vectors, then the remaining pixels one at a time. */
+
+__attribute__((target("sse2"))) static void copy_rows_sse2(const uint32_t *src_pixels, uint32_t *dst_pixels,
+                                                           uint32_t src_stride_pixels, uint32_t dst_width,
+                                                           uint32_t height)
+{
+   constexpr uint32_t lanes = sizeof(__m128i) / sizeof(uint32_t);
+   for (uint32_t row = 0; row < height; row++)
+   {
+      const uint32_t *src_row = src_pixels + static_cast<size_t>(row) * src_stride_pixels;
+      uint32_t *dst_row = dst_pixels + static_cast<size_t>(row) * dst_width;
+      if (row + 1 < height)
+      {
+         __builtin_prefetch(src_row + src_stride_pixels, 0, 3);
+      }
+
+      uint32_t x = 0;
+      for (; x + 4 * lanes <= dst_width; x += 4 * lanes)
+      {
+         const __m128i *src = reinterpret_cast<const __m128i *>(src_row + x);
+         __m128i *dst = reinterpret_cast<__m128i *>(dst_row + x);
+         __m128i v0 = _mm_loadu_si128(src + 0);
+         __m128i v1 = _mm_loadu_si128(src + 1);
+         __m128i v2 = _mm_loadu_si128(src + 2);
+         __m128i v3 = _mm_loadu_si128(src + 3);
+         _mm_storeu_si128(dst + 0, v0);
+         _mm_storeu_si128(dst + 1, v1);
+         _mm_storeu_si128(dst + 2, v2);
+         _mm_storeu_si128(dst + 3, v3);
+      }
+      for (; x + lanes <= dst_width; x += lanes)
+      {
+         _mm_storeu_si128(reinterpret_cast<__m128i *>(dst_row + x),
+                          _mm_loadu_si128(reinterpret_cast<const __m128i *>(src_row + x)));
+      }
+      for (; x < dst_width; x++)
+      {
+         dst_row[x] = src_row[x];
+      }
+   }
+}
+
+__attribute__((target("avx2"))) static void copy_rows_avx2(const uint32_t *src_pixels, uint32_t *dst_pixels,
+                                                           uint32_t src_stride_pixels, uint32_t dst_width,
+                                                           uint32_t height)
+{
+   constexpr uint32_t lanes = sizeof(__m256i) / sizeof(uint32_t);
+   for (uint32_t row = 0; row < height; row++)
+   {
+      const uint32_t *src_row = src_pixels + static_cast<size_t>(row) * src_stride_pixels;
+      uint32_t *dst_row = dst_pixels + static_cast<size_t>(row) * dst_width;
+      if (row + 1 < height)
+      {
+         __builtin_prefetch(src_row + src_stride_pixels, 0, 3);
+      }
+
+      uint32_t x = 0;
+      for (; x + 4 * lanes <= dst_width; x += 4 * lanes)
+      {
+         const __m256i *src = reinterpret_cast<const __m256i *>(src_row + x);
+         __m256i *dst = reinterpret_cast<__m256i *>(dst_row + x);
+         __m256i v0 = _mm256_loadu_si256(src + 0);
+         __m256i v1 = _mm256_loadu_si256(src + 1);
+         __m256i v2 = _mm256_loadu_si256(src + 2);
+         __m256i v3 = _mm256_loadu_si256(src + 3);
+         _mm256_storeu_si256(dst + 0, v0);
+         _mm256_storeu_si256(dst + 1, v1);
+         _mm256_storeu_si256(dst + 2, v2);
+         _mm256_storeu_si256(dst + 3, v3);
+      }
+      for (; x + lanes <= dst_width; x += lanes)
+      {
+         _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst_row + x),
+                             _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src_row + x)));
+      }
+      for (; x < dst_width; x++)
+      {
+         dst_row[x] = src_row[x];
+      }
+   }
+   _mm256_zeroupper();
+}
+
+__attribute__((target("avx512f"))) static void copy_rows_avx512(const uint32_t *src_pixels, uint32_t *dst_pixels,
+                                                                uint32_t src_stride_pixels, uint32_t dst_width,
+                                                                uint32_t height)
+{
+   constexpr uint32_t lanes = sizeof(__m512i) / sizeof(uint32_t);
+   for (uint32_t row = 0; row < height; row++)
+   {
+      const uint32_t *src_row = src_pixels + static_cast<size_t>(row) * src_stride_pixels;
+      uint32_t *dst_row = dst_pixels + static_cast<size_t>(row) * dst_width;
+      if (row + 1 < height)
+      {
+         __builtin_prefetch(src_row + src_stride_pixels, 0, 3);
+      }
+
+      uint32_t x = 0;
+      for (; x + 4 * lanes <= dst_width; x += 4 * lanes)
+      {
+         __m512i v0 = _mm512_loadu_si512(src_row + x);
+         __m512i v1 = _mm512_loadu_si512(src_row + x + lanes);
+         __m512i v2 = _mm512_loadu_si512(src_row + x + 2 * lanes);
+         __m512i v3 = _mm512_loadu_si512(src_row + x + 3 * lanes);
+         _mm512_storeu_si512(dst_row + x, v0);
+         _mm512_storeu_si512(dst_row + x + lanes, v1);
+         _mm512_storeu_si512(dst_row + x + 2 * lanes, v2);
+         _mm512_storeu_si512(dst_row + x + 3 * lanes, v3);
+      }
+      for (; x + lanes <= dst_width; x += lanes)
+      {
+         _mm512_storeu_si512(dst_row + x, _mm512_loadu_si512(src_row + x));
+      }
+      if (x < dst_width)
+      {
+         /* Masked load/store for the remaining pixels of the row. */
+         const __mmask16 mask = static_cast<__mmask16>((1u << (dst_width - x)) - 1u);
+         _mm512_mask_storeu_epi32(dst_row + x, mask, _mm512_maskz_loadu_epi32(mask, src_row + x));
+      }
+   }
+}
+
+/*
+ * Streaming kernels read write-combined memory with MOVNTDQA, which fetches a whole line into a streaming load buffer
+ * instead of making one uncached read per load. The loads need aligned addresses, so the pixels before the first
+ * aligned one are copied one at a time. Each iteration reads a 64 byte line.
+ */
+
+__attribute__((target("sse4.1"))) static void copy_rows_stream_sse41(const uint32_t *src_pixels,
+                                                                     uint32_t *dst_pixels, uint32_t src_stride_pixels,
+                                                                     uint32_t dst_width, uint32_t height)
+{
+   constexpr uint32_t lanes = sizeof(__m128i) / sizeof(uint32_t);
+   for (uint32_t row = 0; row < height; row++)
+   {
+      const uint32_t *src_row = src_pixels + static_cast<size_t>(row) * src_stride_pixels;
+      uint32_t *dst_row = dst_pixels + static_cast<size_t>(row) * dst_width;
+
+      uint32_t x = 0;
+      for (; x < dst_width && (reinterpret_cast<uintptr_t>(src_row + x) % sizeof(__m128i)) != 0; x++)
+      {
+         dst_row[x] = src_row[x];
+      }
+      for (; x + 4 * lanes <= dst_width; x += 4 * lanes)
+      {
+         __m128i *src = const_cast<__m128i *>(reinterpret_cast<const __m128i *>(src_row + x));
+         __m128i *dst = reinterpret_cast<__m128i *>(dst_row + x);
+         __m128i v0 = _mm_stream_load_si128(src + 0);
+         __m128i v1 = _mm_stream_load_si128(src + 1);
+         __m128i v2 = _mm_stream_load_si128(src + 2);
+         __m128i v3 = _mm_stream_load_si128(src + 3);
+         _mm_storeu_si128(dst + 0, v0);
+         _mm_storeu_si128(dst + 1, v1);
+         _mm_storeu_si128(dst + 2, v2);
+         _mm_storeu_si128(dst + 3, v3);
+      }
+      for (; x + lanes <= dst_width; x += lanes)
+      {
+         _mm_storeu_si128(reinterpret_cast<__m128i *>(dst_row + x),
+                          _mm_stream_load_si128(const_cast<__m128i *>(reinterpret_cast<const __m128i *>(src_row + x))));
+      }
+      for (; x < dst_width; x++)
+      {
+         dst_row[x] = src_row[x];
+      }
+   }
+}
+
+__attribute__((target("avx2"))) static void copy_rows_stream_avx2(const uint32_t *src_pixels, uint32_t *dst_pixels,
+                                                                  uint32_t src_stride_pixels, uint32_t dst_width,
+                                                                  uint32_t height)
+{
+   constexpr uint32_t lanes = sizeof(__m256i) / sizeof(uint32_t);
+   for (uint32_t row = 0; row < height; row++)
+   {
+      const uint32_t *src_row = src_pixels + static_cast<size_t>(row) * src_stride_pixels;
+      uint32_t *dst_row = dst_pixels + static_cast<size_t>(row) * dst_width;
+
+      uint32_t x = 0;
+      for (; x < dst_width && (reinterpret_cast<uintptr_t>(src_row + x) % sizeof(__m256i)) != 0; x++)
+      {
+         dst_row[x] = src_row[x];
+      }
+      for (; x + 2 * lanes <= dst_width; x += 2 * lanes)
+      {
+         __m256i *src = const_cast<__m256i *>(reinterpret_cast<const __m256i *>(src_row + x));
+         __m256i *dst = reinterpret_cast<__m256i *>(dst_row + x);
+         __m256i v0 = _mm256_stream_load_si256(src + 0);
+         __m256i v1 = _mm256_stream_load_si256(src + 1);
+         _mm256_storeu_si256(dst + 0, v0);
+         _mm256_storeu_si256(dst + 1, v1);
+      }
+      for (; x < dst_width; x++)
+      {
+         dst_row[x] = src_row[x];
+      }
+   }
+   _mm256_zeroupper();
+}
+
+#endif /* ENABLE_X86_SIMD */
+
+#if defined(ENABLE_ARM_NEON) && defined(__aarch64__)
+
+/*
+ * LDNP and STNP hint that the data is not reused, so copying a frame out of uncached memory neither evicts the
+ * caller's working set nor allocates the destination lines the X server reads next.
+ */
+static void copy_rows_stream_ldnp(const uint32_t *src_pixels, uint32_t *dst_pixels, uint32_t src_stride_pixels,
+                                  uint32_t dst_width, uint32_t height)
+{
+   constexpr uint32_t pixels_per_iteration = 64 / sizeof(uint32_t);
+   for (uint32_t row = 0; row < height; row++)
+   {
+      const uint32_t *src_row = src_pixels + static_cast<size_t>(row) * src_stride_pixels;
+      uint32_t *dst_row = dst_pixels + static_cast<size_t>(row) * dst_width;
+
+      uint32_t x = 0;
+      for (; x + pixels_per_iteration <= dst_width; x += pixels_per_iteration)
+      {
+         __asm__ volatile("ldnp q0, q1, [%[src]]\n"
+                          "ldnp q2, q3, [%[src], #32]\n"
+                          "stnp q0, q1, [%[dst]]\n"
+                          "stnp q2, q3, [%[dst], #32]\n"
+                          :
+                          : [src] "r"(src_row + x), [dst] "r"(dst_row + x)
+                          : "v0", "v1", "v2", "v3", "memory");
+      }
+      for (; x < dst_width; x++)
+      {
+         dst_row[x] = src_row[x];
+      }
+   }
+}
+
+#endif
+
+copy_kernel select_copy_kernel()
+{
+#ifdef ENABLE_X86_SIMD
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f"))
+   {
+      return { copy_rows_avx512, "AVX-512" };
+   }
+   if (__builtin_cpu_supports("avx2"))
+   {
+      return { copy_rows_avx2, "AVX2" };
+   }
+   if (__builtin_cpu_supports("sse2"))
+   {
+      return { copy_rows_sse2, "SSE2" };
+   }
+#endif
+   return { copy_rows_generic, "generic" };
+}
+
+copy_kernel select_streaming_copy_kernel()
+{
+#ifdef ENABLE_X86_SIMD
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2"))
+   {
+      return { copy_rows_stream_avx2, "AVX2 streaming" };
+   }
+   if (__builtin_cpu_supports("sse4.1"))
+   {
+      return { copy_rows_stream_sse41, "SSE4.1 streaming" };
+   }
+#elif defined(ENABLE_ARM_NEON) && defined(__aarch64__)
+   return { copy_rows_stream_ldnp, "LDNP/STNP streaming" };
+#endif
+   return select_copy_kernel();
+}
+
+} /* namespace x11 */
+} /* namespace wsi */
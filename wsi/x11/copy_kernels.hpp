@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file copy_kernels.hpp
+ *
+ * @brief Row copy kernels used by the SHM presenter, selected at runtime for the host CPU.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace wsi
+{
+namespace x11
+{
+
+/**
+ * @brief Copy an unscaled block of 32bpp pixels, repacking rows from the source stride to a tightly packed destination.
+ *
+ * @param src_pixels        First pixel of the source block.
+ * @param dst_pixels        First pixel of the destination block.
+ * @param src_stride_pixels Distance in pixels between two consecutive source rows.
+ * @param dst_width         Width in pixels of a row, which is also the destination stride.
+ * @param height            Number of rows to copy.
+ */
+using copy_rows_function = void (*)(const uint32_t *src_pixels, uint32_t *dst_pixels, uint32_t src_stride_pixels,
+                                    uint32_t dst_width, uint32_t height);
+
+/**
+ * @brief Description of a copy kernel.
+ */
+struct copy_kernel
+{
+   /** Kernel entry point. */
+   copy_rows_function copy_rows;
+   /** Human readable name of the instruction set used by the kernel. */
+   const char *name;
+};
+
+/**
+ * @brief Select the widest copy kernel supported by the CPU the layer is running on.
+ *
+ * The choice is made with cpuid on x86 when the layer is built with ENABLE_X86_SIMD, so a single binary can take
+ * advantage of AVX-512 or AVX2 where available. Other configurations get a portable memcpy based kernel.
+ *
+ * @return The selected kernel. The entry point is never nullptr.
+ */
+copy_kernel select_copy_kernel();
+
+/**
+ * @brief Select a copy kernel for sources in uncached or write-combined memory.
+ *
+ * Plain loads from such memory each wait for the bus, which prefetching does not help. The returned kernel uses
+ * streaming loads instead: MOVNTDQA on x86 with SSE4.1, LDNP/STNP on AArch64 builds with ENABLE_ARM_NEON.
+ *
+ * @return The selected kernel, the one of @ref select_copy_kernel when the CPU has no streaming loads.
+ */
+copy_kernel select_streaming_copy_kernel();
+
+} /* namespace x11 */
+} /* namespace wsi */
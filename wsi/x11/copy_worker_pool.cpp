@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file copy_worker_pool.cpp
+ *
+ * @brief Persistent worker threads used by the SHM presenter to copy row bands in parallel.
+ */
+
+#include "copy_worker_pool.hpp"
+#include "util/log.hpp"
+#include "util/thread_scheduling.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+#include <sched.h>
+
+namespace wsi
+{
+namespace x11
+{
+
+/* Capacity sysfs reports for the fastest CPUs, used when the kernel does not report capacities. */
+static constexpr uint32_t DEFAULT_CPU_CAPACITY = 1024;
+
+/* NUMA nodes probed in sysfs, beyond the node ids of any supported system. */
+static constexpr int MAX_NUMA_NODES = 64;
+
+/**
+ * @brief A CPU the workers may be pinned to.
+ */
+struct cpu_placement
+{
+   int cpu;
+   uint32_t capacity;
+   int node;
+};
+
+/**
+ * @brief Read a single unsigned value from a sysfs file.
+ *
+ * @return true if the file exists and starts with a number.
+ */
+static bool read_sysfs_value(const char *path, unsigned long &value)
+{
+   FILE *file = std::fopen(path, "r");
+   if (file == nullptr)
+   {
+      return false;
+   }
+   const bool found = std::fscanf(file, "%lu", &value) == 1;
+   std::fclose(file);
+   return found;
+}
+
+/**
+ * @brief Set the CPUs of a sysfs cpulist such as "0-3,8-11" in @p cpus.
+ *
+ * @return true if the file exists.
+ */
+static bool read_sysfs_cpulist(const char *path, cpu_set_t &cpus)
+{
+   FILE *file = std::fopen(path, "r");
+   if (file == nullptr)
+   {
+      return false;
+   }
+
+   CPU_ZERO(&cpus);
+   int first = 0;
+   while (std::fscanf(file, "%d", &first) == 1)
+   {
+      int last = first;
+      int separator = std::fgetc(file);
+      if (separator == '-')
+      {
+         if (std::fscanf(file, "%d", &last) != 1)
+         {
+            break;
+         }
+         separator = std::fgetc(file);
+      }
+      for (int cpu = std::max(first, 0); cpu <= last && cpu < CPU_SETSIZE; cpu++)
+      {
+         CPU_SET(cpu, &cpus);
+      }
+      if (separator != ',')
+      {
+         break;
+      }
+   }
+   std::fclose(file);
+   return true;
+}
+
+/**
+ * @brief Set the NUMA node of each CPU, leaving -1 for CPUs no node lists or when the system has no NUMA information.
+ */
+static void read_cpu_nodes(std::vector<cpu_placement> &cpus)
+{
+   for (int node = 0; node < MAX_NUMA_NODES; node++)
+   {
+      char path[64];
+      std::snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+      cpu_set_t node_cpus;
+      if (!read_sysfs_cpulist(path, node_cpus))
+      {
+         continue;
+      }
+      for (auto &cpu : cpus)
+      {
+         if (CPU_ISSET(cpu.cpu, &node_cpus))
+         {
+            cpu.node = node;
+         }
+      }
+   }
+}
+
+/**
+ * @brief CPUs the calling thread may run on, within WSI_PRESENT_THREAD_AFFINITY when it is set, with their capacity
+ *        and NUMA node.
+ */
+static std::vector<cpu_placement> read_cpu_topology()
+{
+   std::vector<cpu_placement> cpus;
+
+   cpu_set_t allowed;
+   CPU_ZERO(&allowed);
+   if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+   {
+      return cpus;
+   }
+
+   /* The workers run the presentation work of the thread dispatching to them, keep them on its configured CPUs.
+    * A configuration the calling thread cannot run on at all is ignored rather than leaving the workers nowhere. */
+   cpu_set_t configured;
+   if (util::get_presentation_thread_affinity(configured))
+   {
+      cpu_set_t within;
+      CPU_AND(&within, &allowed, &configured);
+      if (CPU_COUNT(&within) > 0)
+      {
+         allowed = within;
+      }
+   }
+
+   cpus.reserve(static_cast<size_t>(CPU_COUNT(&allowed)));
+   for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+   {
+      if (!CPU_ISSET(cpu, &allowed))
+      {
+         continue;
+      }
+
+      char path[64];
+      std::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpu_capacity", cpu);
+      unsigned long capacity = DEFAULT_CPU_CAPACITY;
+      if (!read_sysfs_value(path, capacity) || capacity == 0)
+      {
+         capacity = DEFAULT_CPU_CAPACITY;
+      }
+      cpus.push_back({ cpu, static_cast<uint32_t>(capacity), -1 });
+   }
+
+   read_cpu_nodes(cpus);
+   return cpus;
+}
+
+copy_worker_pool::~copy_worker_pool()
+{
+   stop();
+}
+
+bool copy_worker_pool::start(uint32_t worker_count)
+{
+   stop();
+
+   const uint32_t band_count = worker_count + 1;
+   const uint64_t generation = m_generation;
+   try
+   {
+      m_workers.reserve(worker_count);
+      for (uint32_t i = 0; i < worker_count; i++)
+      {
+         m_workers.emplace_back(&copy_worker_pool::worker_main, this, i + 1, band_count, generation);
+      }
+   }
+   catch (const std::exception &e)
+   {
+      WSI_LOG_WARNING("Failed to create SHM copy worker threads: %s", e.what());
+      stop();
+      return false;
+   }
+
+   /* Placed by the first dispatch, from the thread that runs band 0. */
+   m_placed_from = std::thread::id();
+   return true;
+}
+
+void copy_worker_pool::place_workers()
+{
+   /* Placement is best effort only: without topology information the workers float and the bands are even. */
+   std::vector<cpu_placement> cpus;
+   try
+   {
+      cpus = read_cpu_topology();
+      m_band_weights.assign(get_band_count(), DEFAULT_CPU_CAPACITY);
+   }
+   catch (const std::bad_alloc &)
+   {
+      m_band_weights.clear();
+      return;
+   }
+   if (cpus.size() < 2)
+   {
+      return;
+   }
+
+   /* The presenting thread runs band 0. Leave it its current CPU and weight its band by that CPU. */
+   const int current_cpu = sched_getcpu();
+   auto current = std::find_if(cpus.begin(), cpus.end(), [&](const cpu_placement &c) { return c.cpu == current_cpu; });
+   const int home_node = current != cpus.end() ? current->node : -1;
+   if (current != cpus.end())
+   {
+      m_band_weights[0] = current->capacity;
+      cpus.erase(current);
+   }
+
+   /* Local node first so the bands do not read and write across the interconnect, then the fastest CPUs. */
+   std::stable_sort(cpus.begin(), cpus.end(), [home_node](const cpu_placement &a, const cpu_placement &b) {
+      const bool a_local = a.node == home_node;
+      const bool b_local = b.node == home_node;
+      if (a_local != b_local)
+      {
+         return a_local;
+      }
+      return a.capacity > b.capacity;
+   });
+
+   for (size_t i = 0; i < m_workers.size(); i++)
+   {
+      const cpu_placement &placement = cpus[i % cpus.size()];
+      m_band_weights[i + 1] = placement.capacity;
+
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      CPU_SET(placement.cpu, &cpu_set);
+      int res = pthread_setaffinity_np(m_workers[i].native_handle(), sizeof(cpu_set), &cpu_set);
+      if (res != 0)
+      {
+         WSI_LOG_INFO("Could not pin SHM copy worker %zu: error %d", i, res);
+         m_band_weights[i + 1] = m_band_weights[0];
+      }
+      else
+      {
+         WSI_LOG_INFO("SHM copy worker %zu on CPU %d, capacity %u, node %d", i, placement.cpu, placement.capacity,
+                      placement.node);
+      }
+   }
+}
+
+void copy_worker_pool::get_band_rows(uint32_t band_index, uint32_t band_count, uint32_t rows, uint32_t &start_row,
+                                     uint32_t &end_row) const
+{
+   if (band_count > m_band_weights.size())
+   {
+      const uint32_t rows_per_band = rows / band_count;
+      start_row = band_index * rows_per_band;
+      end_row = (band_index == band_count - 1) ? rows : start_row + rows_per_band;
+      return;
+   }
+
+   uint64_t total_weight = 0;
+   uint64_t weight_before = 0;
+   for (uint32_t i = 0; i < band_count; i++)
+   {
+      total_weight += m_band_weights[i];
+      if (i < band_index)
+      {
+         weight_before += m_band_weights[i];
+      }
+   }
+
+   start_row = static_cast<uint32_t>(rows * weight_before / total_weight);
+   end_row = (band_index == band_count - 1) ?
+                rows :
+                static_cast<uint32_t>(rows * (weight_before + m_band_weights[band_index]) / total_weight);
+}
+
+void copy_worker_pool::stop()
+{
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_exit = true;
+   }
+   m_work_cond.notify_all();
+
+   for (auto &worker : m_workers)
+   {
+      if (worker.joinable())
+      {
+         worker.join();
+      }
+   }
+   m_workers.clear();
+   m_band_weights.clear();
+
+   std::lock_guard<std::mutex> lock(m_mutex);
+   m_exit = false;
+   m_pending = 0;
+   m_failed = false;
+}
+
+bool copy_worker_pool::run(band_function function, void *context)
+{
+   if (m_workers.empty())
+   {
+      return false;
+   }
+
+   /* The node and capacity of band 0 are those of the thread running it, which may not be the one that started
+    * the pool. Workers are idle between dispatches, so they can be moved here. */
+   if (m_placed_from != std::this_thread::get_id())
+   {
+      m_placed_from = std::this_thread::get_id();
+      place_workers();
+   }
+
+   const uint32_t band_count = get_band_count();
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_function = function;
+      m_context = context;
+      m_pending = band_count - 1;
+      m_failed = false;
+      m_generation++;
+   }
+   m_work_cond.notify_all();
+
+   function(context, 0, band_count);
+
+   std::unique_lock<std::mutex> lock(m_mutex);
+   m_done_cond.wait(lock, [this]() { return m_pending == 0; });
+   return !m_failed;
+}
+
+void copy_worker_pool::worker_main(uint32_t band_index, uint32_t band_count, uint64_t seen_generation)
+{
+   std::unique_lock<std::mutex> lock(m_mutex);
+   while (true)
+   {
+      m_work_cond.wait(lock, [&]() { return m_exit || m_generation != seen_generation; });
+      if (m_exit)
+      {
+         return;
+      }
+      seen_generation = m_generation;
+
+      band_function function = m_function;
+      void *context = m_context;
+      lock.unlock();
+
+      bool failed = false;
+      try
+      {
+         function(context, band_index, band_count);
+      }
+      catch (...)
+      {
+         failed = true;
+      }
+
+      lock.lock();
+      m_failed = m_failed || failed;
+      if (--m_pending == 0)
+      {
+         m_done_cond.notify_one();
+      }
+   }
+}
+
+} /* namespace x11 */
+} /* namespace wsi */
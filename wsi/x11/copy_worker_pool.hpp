@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file copy_worker_pool.hpp
+ *
+ * @brief Persistent worker threads used by the SHM presenter to copy row bands in parallel.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "util/helpers.hpp"
+
+namespace wsi
+{
+namespace x11
+{
+
+/**
+ * @brief Fixed set of long-lived worker threads with a per-dispatch fork/join barrier.
+ *
+ * The threads are created once by @ref start and then sleep on a condition variable between dispatches, so
+ * dispatching work does not create threads or allocate memory. The thread calling @ref run executes band 0
+ * itself and the workers execute the remaining bands.
+ *
+ * Workers are pinned to the CPUs of the NUMA node of the thread running band 0, the highest capacity ones first, and
+ * each band is weighted by the capacity of its CPU so that on heterogeneous (big.LITTLE) systems the bands of
+ * @ref get_band_rows finish at about the same time.
+ */
+class copy_worker_pool : private util::noncopyable
+{
+public:
+   /**
+    * @brief Function executed for each band of a dispatch.
+    *
+    * @param context    Opaque pointer passed to @ref run.
+    * @param band_index Index of the band to process, in the range [0, band_count).
+    * @param band_count Total number of bands in the dispatch.
+    */
+   using band_function = void (*)(void *context, uint32_t band_index, uint32_t band_count);
+
+   copy_worker_pool() = default;
+   ~copy_worker_pool();
+
+   /**
+    * @brief Create the worker threads, pinned to CPUs by the first @ref run.
+    *
+    * @param worker_count Number of threads to create in addition to the calling thread.
+    *
+    * @return true if all the threads were created, false otherwise. On failure the pool is left empty and
+    *         @ref run returns false.
+    */
+   bool start(uint32_t worker_count);
+
+   /**
+    * @brief Wake up and join all the worker threads.
+    */
+   void stop();
+
+   /**
+    * @brief Number of bands a dispatch is split into, including the band run by the calling thread.
+    */
+   uint32_t get_band_count() const
+   {
+      return static_cast<uint32_t>(m_workers.size()) + 1;
+   }
+
+   /**
+    * @brief Rows of band @p band_index when @p rows are split across the first @p band_count bands.
+    *
+    * Bands get a share of the rows proportional to the capacity of the CPU they run on, and together cover
+    * [0, @p rows) exactly.
+    *
+    * @param band_index Band to get the rows of, less than @p band_count.
+    * @param band_count Number of bands the rows are split across, at most @ref get_band_count.
+    * @param rows       Total number of rows.
+    * @param start_row  Set to the first row of the band.
+    * @param end_row    Set to one past the last row of the band.
+    */
+   void get_band_rows(uint32_t band_index, uint32_t band_count, uint32_t rows, uint32_t &start_row,
+                      uint32_t &end_row) const;
+
+   /**
+    * @brief Run @p function on all the bands and wait for every band to complete.
+    *
+    * The first dispatch from a thread pins the workers for it. The CPU topology is read from sysfs: cpu_capacity for
+    * the relative speed of each CPU, and the NUMA node cpulists to keep the workers on the node of the calling thread,
+    * which is also the node the SHM segments are first touched from. CPUs outside the affinity mask of the calling
+    * thread, or outside WSI_PRESENT_THREAD_AFFINITY when it is set, are never used.
+    *
+    * @param function Function to execute for each band.
+    * @param context  Opaque pointer forwarded to @p function.
+    *
+    * @return true if all the bands completed, false if the pool has no workers or a worker failed. On failure the
+    *         caller is expected to redo the work on its own thread.
+    */
+   bool run(band_function function, void *context);
+
+private:
+   /**
+    * @brief Body of a worker thread.
+    *
+    * @param band_index      Band processed by this worker on every dispatch.
+    * @param band_count      Total number of bands of the pool.
+    * @param seen_generation Dispatch generation at the time the pool was started.
+    */
+   void worker_main(uint32_t band_index, uint32_t band_count, uint64_t seen_generation);
+
+   /**
+    * @brief Pin the workers and set the band weights from the CPU topology, see @ref run.
+    */
+   void place_workers();
+
+   std::vector<std::thread> m_workers;
+
+   /* Capacity of the CPU each band runs on, indexed by band. Empty splits the rows evenly. */
+   std::vector<uint32_t> m_band_weights;
+
+   /* Thread the workers were placed for, the one running band 0 of the dispatches. */
+   std::thread::id m_placed_from;
+
+   std::mutex m_mutex;
+   std::condition_variable m_work_cond;
+   std::condition_variable m_done_cond;
+
+   /* State below is protected by m_mutex. */
+   band_function m_function = nullptr;
+   void *m_context = nullptr;
+   uint64_t m_generation = 0;
+   uint32_t m_pending = 0;
+   bool m_failed = false;
+   bool m_exit = false;
+};
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file dri3_presenter.cpp
+ *
+ * @brief DRI3/Present based zero-copy X11 presenter implementation.
+ */
+
+#include "dri3_presenter.hpp"
+#include "surface.hpp"
+#include "swapchain.hpp"
+#include "util/file_descriptor.hpp"
+#include "util/log.hpp"
+#include "util/trace.hpp"
+#include "util/macros.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace wsi
+{
+namespace x11
+{
+
+/* DRI3 1.2 is the first version with multi-planar pixmaps and modifiers. */
+static constexpr uint32_t DRI3_REQUIRED_MAJOR = 1;
+static constexpr uint32_t DRI3_REQUIRED_MINOR = 2;
+static constexpr uint32_t PRESENT_REQUIRED_MAJOR = 1;
+static constexpr uint32_t PRESENT_REQUIRED_MINOR = 2;
+
+/* DRI3 1.4 imports DRM syncobjs and Present 1.4 presents with points on them. Older xcb headers lack the requests. */
+#if XCB_DRI3_MAJOR_VERSION > 1 || XCB_DRI3_MINOR_VERSION >= 4
+#define DRI3_SYNCOBJ_AVAILABLE (XCB_PRESENT_MAJOR_VERSION > 1 || XCB_PRESENT_MINOR_VERSION >= 4)
+#else
+#define DRI3_SYNCOBJ_AVAILABLE 0
+#endif
+static constexpr uint32_t SYNCOBJ_REQUIRED_MINOR = 4;
+
+static uint8_t bits_per_pixel_for_depth(int depth)
+{
+   return (depth == 16) ? 16 : 32;
+}
+
+dri3_presenter::~dri3_presenter()
+{
+   if (m_special_event != nullptr)
+   {
+      xcb_present_select_input(m_connection, m_event_id, m_window, XCB_PRESENT_EVENT_MASK_NO_EVENT);
+      xcb_unregister_for_special_event(m_connection, m_special_event);
+      xcb_flush(m_connection);
+   }
+}
+
+bool dri3_presenter::is_available(xcb_connection_t *connection, surface *wsi_surface)
+{
+   UNUSED(connection);
+   return wsi_surface->has_dri3(DRI3_REQUIRED_MAJOR, DRI3_REQUIRED_MINOR) &&
+          wsi_surface->has_present(PRESENT_REQUIRED_MAJOR, PRESENT_REQUIRED_MINOR);
+}
+
+VkResult dri3_presenter::init(xcb_connection_t *connection, xcb_window_t window, surface *wsi_surface)
+{
+   m_connection = connection;
+   m_window = window;
+
+   uint32_t width = 0, height = 0;
+   int depth = 24;
+   if (!wsi_surface->get_size_and_depth(&width, &height, &depth))
+   {
+      WSI_LOG_WARNING("Could not get surface depth, using default: %d", depth);
+   }
+
+   auto modifiers_cookie =
+      xcb_dri3_get_supported_modifiers(m_connection, m_window, static_cast<uint8_t>(depth),
+                                       bits_per_pixel_for_depth(depth));
+   auto *modifiers_reply = xcb_dri3_get_supported_modifiers_reply(m_connection, modifiers_cookie, nullptr);
+   if (modifiers_reply == nullptr)
+   {
+      WSI_LOG_ERROR("Failed to query the DRI3 supported modifiers");
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+
+   /* Prefer the window modifiers as they may allow direct scanout. */
+   const uint64_t *modifiers = xcb_dri3_get_supported_modifiers_window_modifiers(modifiers_reply);
+   int num_modifiers = xcb_dri3_get_supported_modifiers_window_modifiers_length(modifiers_reply);
+   m_window_modifiers = num_modifiers != 0;
+   if (num_modifiers == 0)
+   {
+      modifiers = xcb_dri3_get_supported_modifiers_screen_modifiers(modifiers_reply);
+      num_modifiers = xcb_dri3_get_supported_modifiers_screen_modifiers_length(modifiers_reply);
+   }
+
+   try
+   {
+      m_modifiers.assign(modifiers, modifiers + num_modifiers);
+   }
+   catch (const std::bad_alloc &)
+   {
+      free(modifiers_reply);
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
+   free(modifiers_reply);
+
+   if (m_modifiers.empty())
+   {
+      WSI_LOG_ERROR("X server does not report any DRI3 modifiers");
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+
+   m_event_id = xcb_generate_id(m_connection);
+   m_special_event = xcb_register_for_special_xge(m_connection, &xcb_present_id, m_event_id, nullptr);
+   if (m_special_event == nullptr)
+   {
+      WSI_LOG_ERROR("Failed to register for Present events");
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+
+   auto select_cookie = xcb_present_select_input_checked(
+      m_connection, m_event_id, m_window,
+      XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY | XCB_PRESENT_EVENT_MASK_IDLE_NOTIFY);
+   xcb_generic_error_t *error = xcb_request_check(m_connection, select_cookie);
+   if (error != nullptr)
+   {
+      WSI_LOG_ERROR("Failed to select Present events: error %d", error->error_code);
+      free(error);
+      xcb_unregister_for_special_event(m_connection, m_special_event);
+      m_special_event = nullptr;
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+
+   m_syncobj_supported = DRI3_SYNCOBJ_AVAILABLE && wsi_surface->has_dri3(1, SYNCOBJ_REQUIRED_MINOR) &&
+                         wsi_surface->has_present(1, SYNCOBJ_REQUIRED_MINOR);
+   return VK_SUCCESS;
+}
+
+uint32_t dri3_presenter::import_syncobj(int syncobj_fd)
+{
+#if DRI3_SYNCOBJ_AVAILABLE
+   /* XCB closes the file descriptor once the request is sent. */
+   const xcb_dri3_syncobj_t syncobj = xcb_generate_id(m_connection);
+   auto cookie = xcb_dri3_import_syncobj_checked(m_connection, syncobj, m_window, syncobj_fd);
+   xcb_generic_error_t *error = xcb_request_check(m_connection, cookie);
+   if (error != nullptr)
+   {
+      WSI_LOG_ERROR("Failed to import a DRM syncobj: error %d", error->error_code);
+      free(error);
+      return 0;
+   }
+   return syncobj;
+#else
+   close(syncobj_fd);
+   return 0;
+#endif
+}
+
+void dri3_presenter::free_syncobj(uint32_t syncobj)
+{
+#if DRI3_SYNCOBJ_AVAILABLE
+   if (syncobj != 0)
+   {
+      xcb_dri3_free_syncobj(m_connection, syncobj);
+      xcb_flush(m_connection);
+   }
+#else
+   UNUSED(syncobj);
+#endif
+}
+
+bool dri3_presenter::get_device(dev_t *device) const
+{
+   auto cookie = xcb_dri3_open(m_connection, m_window, XCB_NONE);
+   auto *reply = xcb_dri3_open_reply(m_connection, cookie, nullptr);
+   if (reply == nullptr)
+   {
+      return false;
+   }
+
+   util::fd_owner drm_fd{ reply->nfd == 1 ? xcb_dri3_open_reply_fds(m_connection, reply)[0] : -1 };
+   free(reply);
+
+   struct stat drm_stat = {};
+   if (!drm_fd.is_valid() || fstat(drm_fd.get(), &drm_stat) != 0 || !S_ISCHR(drm_stat.st_mode))
+   {
+      return false;
+   }
+
+   *device = drm_stat.st_rdev;
+   return true;
+}
+
+bool dri3_presenter::is_modifier_supported(uint64_t modifier) const
+{
+   return std::find(m_modifiers.begin(), m_modifiers.end(), modifier) != m_modifiers.end();
+}
+
+VkResult dri3_presenter::create_image_resources(x11_image_data *image_data, uint32_t width, uint32_t height, int depth,
+                                                uint64_t modifier)
+{
+   auto &external_mem = image_data->external_mem;
+   const uint32_t num_planes = external_mem.get_num_planes();
+   const auto &buffer_fds = external_mem.get_buffer_fds();
+   const auto &strides = external_mem.get_strides();
+   const auto &offsets = external_mem.get_offsets();
+
+   /* XCB takes ownership of the file descriptors passed in a request and closes them once sent. */
+   int32_t fds[MAX_PLANES] = { -1, -1, -1, -1 };
+   uint32_t plane_strides[MAX_PLANES] = {};
+   uint32_t plane_offsets[MAX_PLANES] = {};
+   for (uint32_t plane = 0; plane < num_planes; plane++)
+   {
+      fds[plane] = dup(buffer_fds[plane]);
+      if (fds[plane] < 0)
+      {
+         WSI_LOG_ERROR("Failed to duplicate dma-buf fd for plane %u", plane);
+         for (uint32_t i = 0; i < plane; i++)
+         {
+            close(fds[i]);
+         }
+         return VK_ERROR_OUT_OF_HOST_MEMORY;
+      }
+      plane_strides[plane] = static_cast<uint32_t>(strides[plane]);
+      plane_offsets[plane] = offsets[plane];
+   }
+
+   image_data->width = width;
+   image_data->height = height;
+   image_data->depth = depth;
+   image_data->stride = plane_strides[0];
+
+   image_data->pixmap = xcb_generate_id(m_connection);
+   auto cookie = xcb_dri3_pixmap_from_buffers_checked(
+      m_connection, image_data->pixmap, m_window, static_cast<uint8_t>(num_planes), static_cast<uint16_t>(width),
+      static_cast<uint16_t>(height), plane_strides[0], plane_offsets[0], plane_strides[1], plane_offsets[1],
+      plane_strides[2], plane_offsets[2], plane_strides[3], plane_offsets[3], static_cast<uint8_t>(depth),
+      bits_per_pixel_for_depth(depth), modifier, fds);
+
+   xcb_generic_error_t *error = xcb_request_check(m_connection, cookie);
+   if (error != nullptr)
+   {
+      WSI_LOG_ERROR("Failed to create DRI3 pixmap: error %d", error->error_code);
+      free(error);
+      image_data->pixmap = XCB_PIXMAP_NONE;
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
+
+   return VK_SUCCESS;
+}
+
+VkResult dri3_presenter::present_image(x11_image_data *image_data, uint32_t serial, uint64_t target_msc, bool async,
+                                       const dri3_sync_points *sync)
+{
+   WSI_TRACE_SCOPE_ID("dri3_present_pixmap", serial);
+   /* Suboptimal lets CompleteNotify report copies that a pixmap with the window modifiers would have flipped. */
+   const uint32_t options =
+      (async ? XCB_PRESENT_OPTION_ASYNC : XCB_PRESENT_OPTION_NONE) | XCB_PRESENT_OPTION_SUBOPTIMAL;
+
+   /* A target MSC of 0 with no divisor presents at the next vblank, or immediately when async. */
+#if DRI3_SYNCOBJ_AVAILABLE
+   if (sync != nullptr)
+   {
+      /* The X server waits for the rendering on the GPU, nothing here waits for it on the CPU. */
+      xcb_present_pixmap_synced(m_connection, m_window, image_data->pixmap, serial, XCB_NONE, XCB_NONE, 0, 0,
+                                XCB_NONE, sync->acquire_syncobj, sync->release_syncobj, sync->acquire_point,
+                                sync->release_point, options, target_msc, 0, 0, 0, nullptr);
+   }
+   else
+#else
+   UNUSED(sync);
+#endif
+   {
+      xcb_present_pixmap(m_connection, m_window, image_data->pixmap, serial, XCB_NONE, XCB_NONE, 0, 0, XCB_NONE,
+                         XCB_NONE, XCB_NONE, options, target_msc, 0, 0, 0, nullptr);
+   }
+
+   int flush_result = xcb_flush(m_connection);
+   if (flush_result <= 0)
+   {
+      WSI_LOG_ERROR("DRI3 presenter xcb_flush failed: result=%d", flush_result);
+      return VK_ERROR_SURFACE_LOST_KHR;
+   }
+
+   return VK_SUCCESS;
+}
+
+void dri3_presenter::destroy_image_resources(x11_image_data *image_data)
+{
+   if (image_data->pixmap != XCB_PIXMAP_NONE)
+   {
+      xcb_free_pixmap(m_connection, image_data->pixmap);
+      xcb_flush(m_connection);
+      image_data->pixmap = XCB_PIXMAP_NONE;
+   }
+}
+
+xcb_present_generic_event_t *dri3_presenter::poll_event()
+{
+   return reinterpret_cast<xcb_present_generic_event_t *>(xcb_poll_for_special_event(m_connection, m_special_event));
+}
+
+xcb_present_generic_event_t *dri3_presenter::wait_for_event()
+{
+   return reinterpret_cast<xcb_present_generic_event_t *>(xcb_wait_for_special_event(m_connection, m_special_event));
+}
+
+void dri3_presenter::wake_event_waiter()
+{
+   xcb_present_notify_msc(m_connection, m_window, 0, 0, 0, 0);
+   xcb_flush(m_connection);
+}
+
+} /* namespace x11 */
+} /* namespace wsi */
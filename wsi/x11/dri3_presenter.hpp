@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file dri3_presenter.hpp
+ *
+ * @brief DRI3/Present based zero-copy X11 presenter implementation.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+#include <xcb/xcb.h>
+#include <xcb/dri3.h>
+#include <xcb/present.h>
+
+#include "util/helpers.hpp"
+
+namespace wsi
+{
+namespace x11
+{
+
+class surface;
+struct x11_image_data;
+
+/**
+ * @brief DRM syncobj timeline points a present is synchronized with, see dri3_presenter::import_syncobj.
+ */
+struct dri3_sync_points
+{
+   /** Syncobj the X server waits on before reading the pixmap, and the point it waits for. */
+   uint32_t acquire_syncobj;
+   uint64_t acquire_point;
+
+   /** Syncobj the X server signals once it no longer reads the pixmap, and the point it signals. */
+   uint32_t release_syncobj;
+   uint64_t release_point;
+};
+
+/**
+ * @brief Presents dma-buf backed swapchain images by wrapping them in DRI3 pixmaps and handing them to the Present
+ *        extension, so the X server scans out or composites the GPU buffer directly without any CPU copy.
+ */
+class dri3_presenter : private util::noncopyable
+{
+public:
+   dri3_presenter() = default;
+   ~dri3_presenter();
+
+   /**
+    * @brief Check whether the X server supports the DRI3 and Present versions needed by this presenter.
+    */
+   static bool is_available(xcb_connection_t *connection, surface *wsi_surface);
+
+   /**
+    * @brief Select Present events for the window and query the modifiers the X server accepts for it.
+    *
+    * @param connection  The XCB connection of the surface.
+    * @param window      The window to present to.
+    * @param wsi_surface The X11 surface the swapchain is created for.
+    *
+    * @return VK_SUCCESS on success, otherwise an error code. On failure the SHM presenter should be used instead.
+    */
+   VkResult init(xcb_connection_t *connection, xcb_window_t window, surface *wsi_surface);
+
+   /**
+    * @brief Check whether the X server can import buffers with the given modifier for this window.
+    */
+   bool is_modifier_supported(uint64_t modifier) const;
+
+   /**
+    * @brief Whether the modifiers are the window's own, which the X server gives for windows it can flip.
+    */
+   bool has_window_modifiers() const
+   {
+      return m_window_modifiers;
+   }
+
+   /**
+    * @brief Get the DRM device the X server displays the window from, as opened by DRI3Open.
+    *
+    * @param[out] device Device number of the DRM node.
+    *
+    * @return false if the X server did not hand out a DRM node.
+    */
+   bool get_device(dev_t *device) const;
+
+   /**
+    * @brief Import the dma-buf planes of an image into a DRI3 pixmap.
+    *
+    * @param image_data Image data holding the allocated external memory. The pixmap is stored in it.
+    * @param width      Width of the image.
+    * @param height     Height of the image.
+    * @param depth      Depth of the window.
+    * @param modifier   DRM format modifier the planes were allocated with.
+    *
+    * @return VK_SUCCESS on success, otherwise an error code.
+    */
+   VkResult create_image_resources(x11_image_data *image_data, uint32_t width, uint32_t height, int depth,
+                                   uint64_t modifier);
+
+   /**
+    * @brief Whether presents can be synchronized on the GPU with DRM syncobj timelines, which needs DRI3 1.4 and
+    *        Present 1.4 on both the X server and the xcb the layer is built with.
+    */
+   bool supports_syncobj() const
+   {
+      return m_syncobj_supported;
+   }
+
+   /**
+    * @brief Share a DRM syncobj with the X server.
+    *
+    * @param syncobj_fd File descriptor of the syncobj, which this takes ownership of.
+    *
+    * @return Identifier of the syncobj for @ref present_image, 0 on failure.
+    */
+   uint32_t import_syncobj(int syncobj_fd);
+
+   /**
+    * @brief Drop a syncobj of @ref import_syncobj. Points of past presents are still signalled.
+    */
+   void free_syncobj(uint32_t syncobj);
+
+   /**
+    * @brief Queue the image pixmap for presentation.
+    *
+    * @param image_data Image to present.
+    * @param serial     Serial identifying this present in the Present events.
+    * @param target_msc MSC of the vblank the X server holds the pixmap until, 0 for the next vblank.
+    * @param async      Whether to present immediately rather than at the next vblank.
+    * @param sync       Timeline points the X server waits for and signals, nullptr when the rendering of the image
+    *                   already completed and its release is only reported by IdleNotify.
+    *
+    * @return VK_SUCCESS on success, otherwise an error code.
+    */
+   VkResult present_image(x11_image_data *image_data, uint32_t serial, uint64_t target_msc, bool async,
+                          const dri3_sync_points *sync = nullptr);
+
+   /**
+    * @brief Free the pixmap of an image.
+    */
+   void destroy_image_resources(x11_image_data *image_data);
+
+   /**
+    * @brief Get the next Present event for the window without blocking.
+    *
+    * @return The event, which the caller must free(), or nullptr if no event is queued.
+    */
+   xcb_present_generic_event_t *poll_event();
+
+   /**
+    * @brief Block until the next Present event for the window arrives.
+    *
+    * @return The event, which the caller must free(), or nullptr if the connection failed.
+    */
+   xcb_present_generic_event_t *wait_for_event();
+
+   /**
+    * @brief Make a thread blocked in @ref wait_for_event return.
+    *
+    * Asks for an immediate MSC notification, which arrives as a CompleteNotify of kind
+    * XCB_PRESENT_COMPLETE_KIND_NOTIFY_MSC.
+    */
+   void wake_event_waiter();
+
+private:
+   xcb_connection_t *m_connection = nullptr;
+   xcb_window_t m_window = 0;
+
+   /** Identifier of the Present event context for the window. */
+   xcb_present_event_t m_event_id = 0;
+
+   /** Queue receiving the Present events selected for the window. */
+   xcb_special_event_t *m_special_event = nullptr;
+
+   /** Modifiers accepted by the X server for this window, either window or screen specific. */
+   std::vector<uint64_t> m_modifiers;
+   bool m_window_modifiers = false;
+
+   /** Whether @ref present_image can be given syncobj timeline points. */
+   bool m_syncobj_supported = false;
+};
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -224,7 +224,13 @@ std::optional<drm_display> drm_display::make_display(const util::allocator &allo
    int crtc_id = -1;
    for (int i = 0; i < resources->count_connectors; ++i)
    {
-      drm_connector_owner temp_connector{ drmModeGetConnector(drm_fd.get(), resources->connectors[i]) };
+      /* The X server keeps the connectors probed, so their current state is used rather than reading the EDIDs
+       * again, which takes tens of milliseconds per connector. */
+      drm_connector_owner temp_connector{ drmModeGetConnectorCurrent(drm_fd.get(), resources->connectors[i]) };
+      if (temp_connector == nullptr || temp_connector->connection == DRM_MODE_UNKNOWNCONNECTION)
+      {
+         temp_connector = drm_connector_owner{ drmModeGetConnector(drm_fd.get(), resources->connectors[i]) };
+      }
       if (temp_connector != nullptr && temp_connector->connection == DRM_MODE_CONNECTED)
       {
          crtc_id = find_compatible_crtc(drm_fd.get(), resources, temp_connector);
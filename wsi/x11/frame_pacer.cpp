@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file frame_pacer.cpp
+ *
+ * @brief Absolute deadline frame pacing for the SHM presenter.
+ */
+
+#include "frame_pacer.hpp"
+
+#include <cerrno>
+#include <ctime>
+
+namespace wsi
+{
+namespace x11
+{
+
+/* Vblank timestamps further than this from the local clock are not trusted. */
+static constexpr uint64_t MAX_RESYNC_DISTANCE_NS = 1000000000ull;
+
+/* A measured interval is only accepted within this percentage of the current one. */
+static constexpr uint64_t MAX_INTERVAL_CHANGE_PERCENT = 25;
+
+static uint64_t monotonic_now_ns()
+{
+   timespec now = {};
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+}
+
+void frame_pacer::set_interval(uint64_t interval_ns)
+{
+   m_interval_ns = interval_ns;
+   if (interval_ns == 0)
+   {
+      reset();
+   }
+}
+
+void frame_pacer::reset()
+{
+   m_next_deadline_ns = 0;
+   m_last_ust_ns = 0;
+   m_last_msc = 0;
+}
+
+void frame_pacer::wait_for_next_deadline()
+{
+   if (m_interval_ns == 0)
+   {
+      return;
+   }
+
+   const uint64_t now = monotonic_now_ns();
+   if (m_next_deadline_ns == 0)
+   {
+      m_next_deadline_ns = now + m_interval_ns;
+      return;
+   }
+
+   if (now >= m_next_deadline_ns)
+   {
+      /* Late: keep the phase and move to the first deadline still ahead. */
+      const uint64_t missed = (now - m_next_deadline_ns) / m_interval_ns + 1;
+      m_next_deadline_ns += missed * m_interval_ns;
+      return;
+   }
+
+   timespec deadline = {};
+   deadline.tv_sec = static_cast<time_t>(m_next_deadline_ns / 1000000000ull);
+   deadline.tv_nsec = static_cast<long>(m_next_deadline_ns % 1000000000ull);
+   while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+   {
+   }
+
+   m_next_deadline_ns += m_interval_ns;
+}
+
+void frame_pacer::resync(uint64_t ust_us, uint64_t msc)
+{
+   const uint64_t ust_ns = ust_us * 1000ull;
+   const uint64_t now = monotonic_now_ns();
+   const uint64_t distance = (ust_ns > now) ? ust_ns - now : now - ust_ns;
+   if (ust_ns == 0 || distance > MAX_RESYNC_DISTANCE_NS)
+   {
+      return;
+   }
+
+   if (m_last_msc != 0 && msc > m_last_msc && ust_ns > m_last_ust_ns)
+   {
+      const uint64_t measured = (ust_ns - m_last_ust_ns) / (msc - m_last_msc);
+      const uint64_t delta = (measured > m_interval_ns) ? measured - m_interval_ns : m_interval_ns - measured;
+      if (delta * 100 <= m_interval_ns * MAX_INTERVAL_CHANGE_PERCENT)
+      {
+         /* Smooth out the scheduling jitter of the notifications. */
+         m_interval_ns = (m_interval_ns * 7 + measured) / 8;
+      }
+   }
+   m_last_ust_ns = ust_ns;
+   m_last_msc = msc;
+
+   if (m_interval_ns == 0 || m_next_deadline_ns == 0)
+   {
+      return;
+   }
+
+   /* Move the next deadline to the closest point of the vblank grid. */
+   const uint64_t phase = (m_next_deadline_ns >= ust_ns) ?
+                             (m_next_deadline_ns - ust_ns) % m_interval_ns :
+                             m_interval_ns - (ust_ns - m_next_deadline_ns) % m_interval_ns;
+   if (phase * 2 > m_interval_ns)
+   {
+      m_next_deadline_ns += m_interval_ns - phase;
+   }
+   else
+   {
+      m_next_deadline_ns -= phase;
+   }
+}
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file frame_pacer.hpp
+ *
+ * @brief Absolute deadline frame pacing for the SHM presenter.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace wsi
+{
+namespace x11
+{
+
+/**
+ * @brief Paces presents on a fixed timeline of CLOCK_MONOTONIC deadlines.
+ *
+ * Deadlines are spaced by the refresh interval and slept on with clock_nanosleep(TIMER_ABSTIME), so the
+ * timeline does not drift with the time spent presenting and the waiting thread does not wake up early.
+ * When vblank timestamps are available, see @ref resync, the deadlines are phase locked to the display.
+ */
+class frame_pacer
+{
+public:
+   /**
+    * @brief Set the distance between two deadlines.
+    *
+    * @param interval_ns Refresh interval in nanoseconds. 0 disables pacing.
+    */
+   void set_interval(uint64_t interval_ns);
+
+   uint64_t get_interval() const
+   {
+      return m_interval_ns;
+   }
+
+   /**
+    * @brief Sleep until the next deadline and move the timeline one interval forward.
+    *
+    * The first call only starts the timeline. When a deadline has already passed, the timeline skips the
+    * missed intervals instead of trying to catch up.
+    */
+   void wait_for_next_deadline();
+
+   /**
+    * @brief Lock the timeline to a vblank reported by the X server.
+    *
+    * @param ust_us Time of the vblank as a CLOCK_MONOTONIC timestamp in microseconds.
+    * @param msc    Media stream counter of the vblank.
+    */
+   void resync(uint64_t ust_us, uint64_t msc);
+
+   /**
+    * @brief Time of the last vblank received through @ref resync, in CLOCK_MONOTONIC nanoseconds, 0 when none was.
+    */
+   uint64_t get_last_vblank() const
+   {
+      return m_last_ust_ns;
+   }
+
+   /**
+    * @brief Forget the timeline, the next call to @ref wait_for_next_deadline does not sleep.
+    */
+   void reset();
+
+private:
+   uint64_t m_interval_ns = 0;
+
+   /* Next deadline in CLOCK_MONOTONIC nanoseconds, 0 when the timeline is not started. */
+   uint64_t m_next_deadline_ns = 0;
+
+   /* Last vblank received through resync, used to refine the interval. */
+   uint64_t m_last_ust_ns = 0;
+   uint64_t m_last_msc = 0;
+};
+
+} /* namespace x11 */
+} /* namespace wsi */
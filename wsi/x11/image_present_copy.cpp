@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file image_present_copy.cpp
+ *
+ * @brief Implementation of the GPU copy of DRI3 presented images into buffers the X server can display.
+ */
+
+#include "image_present_copy.hpp"
+#include "image_readback.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/sysmacros.h>
+
+#include "layer/private_data.hpp"
+#include "util/log.hpp"
+#include "util/memory_type_policy.hpp"
+
+namespace wsi
+{
+namespace x11
+{
+
+image_present_copy::~image_present_copy()
+{
+   destroy();
+}
+
+bool image_present_copy::is_other_device(layer::device_private_data &device_data, dev_t display_device)
+{
+   if (!device_data.is_device_extension_enabled(VK_EXT_PHYSICAL_DEVICE_DRM_EXTENSION_NAME))
+   {
+      return false;
+   }
+
+   VkPhysicalDeviceDrmPropertiesEXT drm_props = {};
+   drm_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DRM_PROPERTIES_EXT;
+   VkPhysicalDeviceProperties2KHR device_props = {};
+   device_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+   device_props.pNext = &drm_props;
+   device_data.instance_data.disp.GetPhysicalDeviceProperties2KHR(device_data.physical_device, &device_props);
+
+   /* X servers hand out the render node of the display GPU, older ones its primary node. */
+   if (drm_props.hasPrimary &&
+       makedev(static_cast<unsigned>(drm_props.primaryMajor), static_cast<unsigned>(drm_props.primaryMinor)) ==
+          display_device)
+   {
+      return false;
+   }
+   if (drm_props.hasRender &&
+       makedev(static_cast<unsigned>(drm_props.renderMajor), static_cast<unsigned>(drm_props.renderMinor)) ==
+          display_device)
+   {
+      return false;
+   }
+
+   /* A device without DRM nodes, e.g. a software rasterizer, cannot be told apart from the display GPU. */
+   return drm_props.hasPrimary || drm_props.hasRender;
+}
+
+VkFormat image_present_copy::get_presentable_format(VkFormat format)
+{
+   switch (format)
+   {
+   case VK_FORMAT_B8G8R8A8_UNORM:
+   case VK_FORMAT_B8G8R8A8_SRGB:
+      return format;
+   /* Blits decode and encode sRGB formats, which leaves the values as rendered. */
+   case VK_FORMAT_R8G8B8A8_SRGB:
+      return VK_FORMAT_B8G8R8A8_SRGB;
+   case VK_FORMAT_R8G8B8A8_UNORM:
+   case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+   case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+   case VK_FORMAT_R16G16B16A16_SFLOAT:
+      return VK_FORMAT_B8G8R8A8_UNORM;
+   default:
+      return VK_FORMAT_UNDEFINED;
+   }
+}
+
+bool image_present_copy::is_conversion_supported(VkPhysicalDevice physical_device, VkFormat format)
+{
+   const VkFormat presentable_format = get_presentable_format(format);
+   if (presentable_format == VK_FORMAT_UNDEFINED)
+   {
+      return false;
+   }
+   if (presentable_format == format)
+   {
+      return true;
+   }
+
+   auto &instance_data = layer::instance_private_data::get(physical_device);
+   VkFormatProperties2KHR format_props = {};
+   format_props.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2_KHR;
+   instance_data.disp.GetPhysicalDeviceFormatProperties2KHR(physical_device, format, &format_props);
+   return (format_props.formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT) != 0;
+}
+
+bool image_present_copy::is_conversion_only_format(VkFormat format)
+{
+   return format == VK_FORMAT_A2B10G10R10_UNORM_PACK32 || format == VK_FORMAT_A2R10G10B10_UNORM_PACK32 ||
+          format == VK_FORMAT_R16G16B16A16_SFLOAT;
+}
+
+bool image_present_copy::is_conversion_enabled()
+{
+   const char *conversion_env = std::getenv("WSI_X11_GPU_CONVERSION");
+   return conversion_env == nullptr || std::strcmp(conversion_env, "0") != 0;
+}
+
+bool image_present_copy::is_supported(layer::device_private_data &device_data, VkFormat format,
+                                    VkImageUsageFlags usage)
+{
+   const std::optional<uint32_t> queue_family = device_data.get_single_queue_family();
+   if (!queue_family.has_value())
+   {
+      return false;
+   }
+
+   VkImageFormatProperties format_props = {};
+   if (device_data.instance_data.disp.GetPhysicalDeviceImageFormatProperties(
+          device_data.physical_device, format, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_OPTIMAL,
+          usage | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, 0, &format_props) != VK_SUCCESS)
+   {
+      return false;
+   }
+
+   return image_readback::is_transfer_capable(device_data, *queue_family);
+}
+
+VkResult image_present_copy::init(layer::device_private_data &device_data, const util::allocator &allocator,
+                                VkCommandPool command_pool, VkImage image, VkFormat image_format,
+                                const VkImageCreateInfo &target_info, external_memory &target_memory)
+{
+   m_device_data = &device_data;
+   m_callbacks = allocator.get_original_callbacks();
+   m_command_pool = command_pool;
+
+   VkResult result = device_data.disp.CreateImage(device_data.device, &target_info, m_callbacks, &m_target);
+   if (result == VK_SUCCESS)
+   {
+      result = target_memory.import_memory_and_bind_swapchain_image(m_target);
+   }
+   if (result == VK_SUCCESS)
+   {
+      result = allocate_memory(image);
+   }
+   if (result == VK_SUCCESS)
+   {
+      result = record(image, image_format != target_info.format, target_info.extent.width, target_info.extent.height);
+   }
+
+   if (result != VK_SUCCESS)
+   {
+      destroy();
+   }
+   return result;
+}
+
+VkResult image_present_copy::allocate_memory(VkImage image)
+{
+   const VkDevice device = m_device_data->device;
+
+   VkMemoryRequirements mem_requirements;
+   m_device_data->disp.GetImageMemoryRequirements(device, image, &mem_requirements);
+
+   VkPhysicalDeviceMemoryProperties2 memory_props = {};
+   memory_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+   m_device_data->instance_data.disp.GetPhysicalDeviceMemoryProperties2KHR(m_device_data->physical_device,
+                                                                          &memory_props);
+   const uint32_t memory_type_index = util::select_memory_type(
+      memory_props.memoryProperties, mem_requirements.memoryTypeBits, util::memory_access::gpu_only);
+   if (memory_type_index == VK_MAX_MEMORY_TYPES)
+   {
+      WSI_LOG_ERROR("No memory type for the present copy source image");
+      return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+   }
+
+   VkMemoryAllocateInfo alloc_info = {};
+   alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+   alloc_info.allocationSize = mem_requirements.size;
+   alloc_info.memoryTypeIndex = memory_type_index;
+   TRY_LOG(m_device_data->disp.AllocateMemory(device, &alloc_info, m_callbacks, &m_memory),
+           "Failed to allocate the present copy source image memory");
+   TRY_LOG(bind_image_memory(image), "Failed to bind the present copy source image memory");
+
+   return VK_SUCCESS;
+}
+
+VkResult image_present_copy::bind_image_memory(VkImage image) const
+{
+   return m_device_data->disp.BindImageMemory(m_device_data->device, image, m_memory, 0);
+}
+
+VkResult image_present_copy::record(VkImage image, bool convert, uint32_t width, uint32_t height)
+{
+   const VkDevice device = m_device_data->device;
+
+   VkCommandBufferAllocateInfo alloc_info = {};
+   alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+   alloc_info.commandPool = m_command_pool;
+   alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+   alloc_info.commandBufferCount = 1;
+   TRY_LOG(m_device_data->disp.AllocateCommandBuffers(device, &alloc_info, &m_command_buffer),
+           "Failed to allocate the present copy command buffer");
+
+   /* Command buffers are dispatchable, the loader has to know about the ones the layer creates. */
+   TRY_LOG_CALL(m_device_data->SetDeviceLoaderData(device, m_command_buffer));
+
+   VkCommandBufferBeginInfo begin_info = {};
+   begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+   TRY_LOG_CALL(m_device_data->disp.BeginCommandBuffer(m_command_buffer, &begin_info));
+
+   VkImageMemoryBarrier to_transfer[2] = {};
+   to_transfer[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+   to_transfer[0].srcAccessMask = 0;
+   to_transfer[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+   to_transfer[0].oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+   to_transfer[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+   to_transfer[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+   to_transfer[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+   to_transfer[0].image = image;
+   to_transfer[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+   /* The X server and the display GPU read the dma-buf between presents, take it back without keeping the
+    * contents, the whole image is overwritten. */
+   to_transfer[1] = to_transfer[0];
+   to_transfer[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+   to_transfer[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+   to_transfer[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+   to_transfer[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_FOREIGN_EXT;
+   to_transfer[1].dstQueueFamilyIndex = 0;
+   to_transfer[1].image = m_target;
+   m_device_data->disp.CmdPipelineBarrier(m_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                          VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, to_transfer);
+
+   if (convert)
+   {
+      /* An unscaled blit converts each texel on its own, nearest filtering keeps it exact. */
+      VkImageBlit region = {};
+      region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+      region.srcOffsets[1] = { static_cast<int32_t>(width), static_cast<int32_t>(height), 1 };
+      region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+      region.dstOffsets[1] = region.srcOffsets[1];
+      m_device_data->disp.CmdBlitImage(m_command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_target,
+                                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_NEAREST);
+   }
+   else
+   {
+      VkImageCopy region = {};
+      region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+      region.srcOffset = { 0, 0, 0 };
+      region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+      region.dstOffset = { 0, 0, 0 };
+      region.extent = { width, height, 1 };
+      m_device_data->disp.CmdCopyImage(m_command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_target,
+                                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+   }
+
+   VkImageMemoryBarrier to_present[2] = { to_transfer[0], to_transfer[1] };
+   to_present[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+   to_present[0].dstAccessMask = 0;
+   to_present[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+   to_present[0].newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+   /* Hand the dma-buf over to the X server. */
+   to_present[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+   to_present[1].dstAccessMask = 0;
+   to_present[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+   to_present[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+   to_present[1].srcQueueFamilyIndex = 0;
+   to_present[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_FOREIGN_EXT;
+   m_device_data->disp.CmdPipelineBarrier(m_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                          VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 2,
+                                          to_present);
+
+   TRY_LOG_CALL(m_device_data->disp.EndCommandBuffer(m_command_buffer));
+   return VK_SUCCESS;
+}
+
+void image_present_copy::destroy()
+{
+   if (m_device_data == nullptr)
+   {
+      return;
+   }
+
+   const VkDevice device = m_device_data->device;
+   if (m_command_buffer != VK_NULL_HANDLE)
+   {
+      m_device_data->disp.FreeCommandBuffers(device, m_command_pool, 1, &m_command_buffer);
+      m_command_buffer = VK_NULL_HANDLE;
+   }
+   /* The dma-buf memory belongs to the external_memory it was imported by. */
+   if (m_target != VK_NULL_HANDLE)
+   {
+      m_device_data->disp.DestroyImage(device, m_target, m_callbacks);
+      m_target = VK_NULL_HANDLE;
+   }
+   if (m_memory != VK_NULL_HANDLE)
+   {
+      m_device_data->disp.FreeMemory(device, m_memory, m_callbacks);
+      m_memory = VK_NULL_HANDLE;
+   }
+}
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file image_present_copy.hpp
+ *
+ * @brief GPU copy of DRI3 presented images into buffers the X server can display.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <sys/types.h>
+#include <vulkan/vulkan.h>
+
+#include "util/custom_allocator.hpp"
+#include "util/helpers.hpp"
+#include "wsi/external_memory.hpp"
+
+namespace wsi
+{
+namespace x11
+{
+
+/**
+ * @brief Copy of a swapchain image into the dma-buf of its DRI3 pixmap, for images the X server cannot display as
+ *        they are rendered.
+ *
+ * This covers two cases:
+ * - PRIME setups, where the device renders on another GPU than the one the X server displays from. Buffers in the
+ *   rendering device's own tiling are either rejected by the display GPU or composited through a slow shadow copy
+ *   by the X server, so the dma-buf is linear.
+ * - Swapchain formats without a matching visual, such as RGBA or 16 bit float, which the copy converts to the
+ *   format of @ref get_presentable_format.
+ *
+ * The swapchain image lives in device local memory with optimal tiling, and a command buffer recorded once per image
+ * copies or blits it into an image bound to the dma-buf. It runs after the application's present semaphores as part
+ * of the present payload, like image_readback.
+ */
+class image_present_copy : private util::noncopyable
+{
+public:
+   image_present_copy() = default;
+   ~image_present_copy();
+
+   /**
+    * @brief Check whether the device renders on another GPU than @p display_device.
+    *
+    * Needs VK_EXT_physical_device_drm, without it the devices are assumed to be the same.
+    */
+   static bool is_other_device(layer::device_private_data &device_data, dev_t display_device);
+
+   /**
+    * @brief Get the format the dma-buf of a @p format swapchain image is allocated with.
+    *
+    * @return @p format when the X server displays it, VK_FORMAT_UNDEFINED when the copy cannot convert it.
+    */
+   static VkFormat get_presentable_format(VkFormat format);
+
+   /**
+    * @brief Check whether @p physical_device can convert @p format to its presentable format.
+    */
+   static bool is_conversion_supported(VkPhysicalDevice physical_device, VkFormat format);
+
+   /**
+    * @brief Check whether @p format can only be presented through the conversion of the copy, the SHM presenter
+    *        only swizzles 8 bit per channel formats.
+    */
+   static bool is_conversion_only_format(VkFormat format);
+
+   /**
+    * @brief Check whether the conversion copy is allowed, WSI_X11_GPU_CONVERSION=0 leaves the conversion to the SHM
+    *        presenter.
+    */
+   static bool is_conversion_enabled();
+
+   /**
+    * @brief Check whether the device can run the copy.
+    *
+    * The command buffers are allocated from the only queue family of the device, see image_readback::is_supported,
+    * and optimal images of @p format must allow @p usage plus VK_IMAGE_USAGE_TRANSFER_SRC_BIT.
+    */
+   static bool is_supported(layer::device_private_data &device_data, VkFormat format, VkImageUsageFlags usage);
+
+   /**
+    * @brief Back @p image with device local memory and record its copy into the dma-buf of @p target_memory.
+    *
+    * @param image         Swapchain image in VK_IMAGE_LAYOUT_PRESENT_SRC_KHR when it is presented, created with
+    *                      optimal tiling and VK_IMAGE_USAGE_TRANSFER_SRC_BIT.
+    * @param image_format  Format of @p image. The copy is a blit when it differs from the target format.
+    * @param target_info   Create info of the image the dma-buf is imported as.
+    * @param target_memory The dma-buf, allocated on the display GPU.
+    */
+   VkResult init(layer::device_private_data &device_data, const util::allocator &allocator,
+                 VkCommandPool command_pool, VkImage image, VkFormat image_format, const VkImageCreateInfo &target_info,
+                 external_memory &target_memory);
+
+   /**
+    * @brief Bind an image aliasing the swapchain image, see VkBindImageMemorySwapchainInfoKHR.
+    */
+   VkResult bind_image_memory(VkImage image) const;
+
+   bool is_valid() const
+   {
+      return m_command_buffer != VK_NULL_HANDLE;
+   }
+
+   VkCommandBuffer get_command_buffer() const
+   {
+      return m_command_buffer;
+   }
+
+private:
+   VkResult allocate_memory(VkImage image);
+   VkResult record(VkImage image, bool convert, uint32_t width, uint32_t height);
+   void destroy();
+
+   layer::device_private_data *m_device_data = nullptr;
+   const VkAllocationCallbacks *m_callbacks = nullptr;
+   VkCommandPool m_command_pool = VK_NULL_HANDLE;
+   VkCommandBuffer m_command_buffer = VK_NULL_HANDLE;
+   VkDeviceMemory m_memory = VK_NULL_HANDLE;
+   VkImage m_target = VK_NULL_HANDLE;
+};
+
+} /* namespace x11 */
+} /* namespace wsi */
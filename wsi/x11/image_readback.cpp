@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file image_readback.cpp
+ *
+ * @brief Implementation of the GPU readback of SHM presented images.
+ */
+
+#include "image_readback.hpp"
+
+#include "layer/private_data.hpp"
+#include "util/log.hpp"
+#include "util/memory_type_policy.hpp"
+
+namespace wsi
+{
+namespace x11
+{
+
+static uint32_t find_readback_memory_type(layer::device_private_data &device_data, uint32_t type_bits,
+                                          VkMemoryPropertyFlags *found_props)
+{
+   VkPhysicalDeviceMemoryProperties2 memory_props = {};
+   memory_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+   device_data.instance_data.disp.GetPhysicalDeviceMemoryProperties2KHR(device_data.physical_device, &memory_props);
+
+   /* Reads must go through the CPU caches, among cached types the policy prefers coherent ones. */
+   const uint32_t index =
+      util::select_memory_type(memory_props.memoryProperties, type_bits, util::memory_access::cpu_readback,
+                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+   if (index != VK_MAX_MEMORY_TYPES)
+   {
+      *found_props = memory_props.memoryProperties.memoryTypes[index].propertyFlags;
+   }
+   return index;
+}
+
+bool image_readback::is_transfer_capable(layer::device_private_data &device_data, uint32_t queue_family)
+{
+   uint32_t family_count = 0;
+   device_data.instance_data.disp.GetPhysicalDeviceQueueFamilyProperties2KHR(device_data.physical_device,
+                                                                            &family_count, nullptr);
+   if (queue_family >= family_count)
+   {
+      return false;
+   }
+
+   /* A count one past the family fills in just the families up to it. */
+   VkQueueFamilyProperties2KHR empty_props = {};
+   empty_props.sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_PROPERTIES_2_KHR;
+   util::vector<VkQueueFamilyProperties2KHR> family_props(
+      util::allocator(device_data.get_allocator(), VK_SYSTEM_ALLOCATION_SCOPE_COMMAND));
+   if (!family_props.try_resize(queue_family + 1, empty_props))
+   {
+      return false;
+   }
+   family_count = queue_family + 1;
+   device_data.instance_data.disp.GetPhysicalDeviceQueueFamilyProperties2KHR(device_data.physical_device,
+                                                                            &family_count, family_props.data());
+
+   /* Graphics and compute queues support transfers without advertising it. */
+   const VkQueueFlags transfer_capable = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+   return (family_props[queue_family].queueFamilyProperties.queueFlags & transfer_capable) != 0;
+}
+
+image_readback::~image_readback()
+{
+   destroy();
+}
+
+bool image_readback::is_supported(layer::device_private_data &device_data, VkFormat format, VkImageUsageFlags usage)
+{
+   const std::optional<uint32_t> queue_family = device_data.get_single_queue_family();
+   if (!queue_family.has_value())
+   {
+      return false;
+   }
+
+   VkImageFormatProperties format_props = {};
+   if (device_data.instance_data.disp.GetPhysicalDeviceImageFormatProperties(
+          device_data.physical_device, format, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_LINEAR,
+          usage | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, 0, &format_props) != VK_SUCCESS)
+   {
+      return false;
+   }
+
+   if (!is_transfer_capable(device_data, *queue_family))
+   {
+      return false;
+   }
+
+   VkMemoryPropertyFlags props = 0;
+   return find_readback_memory_type(device_data, ~0u, &props) != VK_MAX_MEMORY_TYPES;
+}
+
+VkResult image_readback::create_command_pool(layer::device_private_data &device_data,
+                                             const util::allocator &allocator, VkCommandPool *command_pool)
+{
+   VkCommandPoolCreateInfo pool_info = {};
+   pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+   /* The copies are submitted to the presenting queue, which belongs to the only family of the device. */
+   pool_info.queueFamilyIndex = device_data.get_single_queue_family().value_or(0);
+
+   TRY_LOG(device_data.disp.CreateCommandPool(device_data.device, &pool_info, allocator.get_original_callbacks(),
+                                              command_pool),
+           "Failed to create the readback command pool");
+   return VK_SUCCESS;
+}
+
+VkResult image_readback::init(layer::device_private_data &device_data, const util::allocator &allocator,
+                              VkCommandPool command_pool, VkImage image, uint32_t width, uint32_t height,
+                              uint32_t bytes_per_pixel, uint32_t stride)
+{
+   m_device_data = &device_data;
+   m_callbacks = allocator.get_original_callbacks();
+   m_command_pool = command_pool;
+   m_stride = stride;
+
+   VkResult result = allocate_memory(static_cast<VkDeviceSize>(stride) * height);
+   if (result == VK_SUCCESS)
+   {
+      result = record(image, width, height, bytes_per_pixel);
+   }
+
+   if (result != VK_SUCCESS)
+   {
+      destroy();
+   }
+   return result;
+}
+
+VkResult image_readback::allocate_memory(VkDeviceSize size)
+{
+   const VkDevice device = m_device_data->device;
+
+   VkBufferCreateInfo buffer_info = {};
+   buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+   buffer_info.size = size;
+   buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+   buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+   TRY_LOG(m_device_data->disp.CreateBuffer(device, &buffer_info, m_callbacks, &m_buffer),
+           "Failed to create the readback buffer");
+
+   VkMemoryRequirements mem_requirements;
+   m_device_data->disp.GetBufferMemoryRequirements(device, m_buffer, &mem_requirements);
+
+   VkMemoryPropertyFlags props = 0;
+   const uint32_t memory_type_index =
+      find_readback_memory_type(*m_device_data, mem_requirements.memoryTypeBits, &props);
+   if (memory_type_index == VK_MAX_MEMORY_TYPES)
+   {
+      WSI_LOG_ERROR("No host cached memory type for the readback buffer");
+      return VK_ERROR_FORMAT_NOT_SUPPORTED;
+   }
+   m_coherent = (props & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+   VkMemoryAllocateInfo alloc_info = {};
+   alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+   alloc_info.allocationSize = mem_requirements.size;
+   alloc_info.memoryTypeIndex = memory_type_index;
+   TRY_LOG(m_device_data->disp.AllocateMemory(device, &alloc_info, m_callbacks, &m_memory),
+           "Failed to allocate the readback buffer memory");
+   TRY_LOG(m_device_data->disp.BindBufferMemory(device, m_buffer, m_memory, 0),
+           "Failed to bind the readback buffer memory");
+   TRY_LOG(m_device_data->disp.MapMemory(device, m_memory, 0, VK_WHOLE_SIZE, 0, &m_mapped),
+           "Failed to map the readback buffer memory");
+
+   return VK_SUCCESS;
+}
+
+VkResult image_readback::record(VkImage image, uint32_t width, uint32_t height, uint32_t bytes_per_pixel)
+{
+   const VkDevice device = m_device_data->device;
+
+   VkCommandBufferAllocateInfo alloc_info = {};
+   alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+   alloc_info.commandPool = m_command_pool;
+   alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+   alloc_info.commandBufferCount = 1;
+   TRY_LOG(m_device_data->disp.AllocateCommandBuffers(device, &alloc_info, &m_command_buffer),
+           "Failed to allocate the readback command buffer");
+
+   /* Command buffers are dispatchable, the loader has to know about the ones the layer creates. */
+   TRY_LOG_CALL(m_device_data->SetDeviceLoaderData(device, m_command_buffer));
+
+   VkCommandBufferBeginInfo begin_info = {};
+   begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+   TRY_LOG_CALL(m_device_data->disp.BeginCommandBuffer(m_command_buffer, &begin_info));
+
+   /* The present semaphores are waited on at the transfer stage, which orders the barriers after the
+    * application's rendering. */
+   VkImageMemoryBarrier to_transfer = {};
+   to_transfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+   to_transfer.srcAccessMask = 0;
+   to_transfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+   to_transfer.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+   to_transfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+   to_transfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+   to_transfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+   to_transfer.image = image;
+   to_transfer.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+   m_device_data->disp.CmdPipelineBarrier(m_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                          VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                                          &to_transfer);
+
+   VkBufferImageCopy region = {};
+   region.bufferOffset = 0;
+   region.bufferRowLength = m_stride / bytes_per_pixel;
+   region.bufferImageHeight = height;
+   region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+   region.imageOffset = { 0, 0, 0 };
+   region.imageExtent = { width, height, 1 };
+   m_device_data->disp.CmdCopyImageToBuffer(m_command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_buffer,
+                                            1, &region);
+
+   VkImageMemoryBarrier to_present = to_transfer;
+   to_present.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+   to_present.dstAccessMask = 0;
+   to_present.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+   to_present.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+   VkBufferMemoryBarrier to_host = {};
+   to_host.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+   to_host.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+   to_host.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+   to_host.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+   to_host.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+   to_host.buffer = m_buffer;
+   to_host.offset = 0;
+   to_host.size = VK_WHOLE_SIZE;
+   m_device_data->disp.CmdPipelineBarrier(m_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                          VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+                                          nullptr, 1, &to_host, 1, &to_present);
+
+   TRY_LOG_CALL(m_device_data->disp.EndCommandBuffer(m_command_buffer));
+   return VK_SUCCESS;
+}
+
+const void *image_readback::map_for_read()
+{
+   if (m_mapped == nullptr)
+   {
+      return nullptr;
+   }
+
+   if (!m_coherent)
+   {
+      VkMappedMemoryRange range = {};
+      range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+      range.memory = m_memory;
+      range.offset = 0;
+      range.size = VK_WHOLE_SIZE;
+      if (m_device_data->disp.InvalidateMappedMemoryRanges(m_device_data->device, 1, &range) != VK_SUCCESS)
+      {
+         return nullptr;
+      }
+   }
+
+   return m_mapped;
+}
+
+void image_readback::destroy()
+{
+   if (m_device_data == nullptr)
+   {
+      return;
+   }
+
+   const VkDevice device = m_device_data->device;
+   if (m_command_buffer != VK_NULL_HANDLE)
+   {
+      m_device_data->disp.FreeCommandBuffers(device, m_command_pool, 1, &m_command_buffer);
+      m_command_buffer = VK_NULL_HANDLE;
+   }
+   if (m_buffer != VK_NULL_HANDLE)
+   {
+      m_device_data->disp.DestroyBuffer(device, m_buffer, m_callbacks);
+      m_buffer = VK_NULL_HANDLE;
+   }
+   if (m_memory != VK_NULL_HANDLE)
+   {
+      if (m_mapped != nullptr)
+      {
+         m_device_data->disp.UnmapMemory(device, m_memory);
+         m_mapped = nullptr;
+      }
+      m_device_data->disp.FreeMemory(device, m_memory, m_callbacks);
+      m_memory = VK_NULL_HANDLE;
+   }
+}
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file image_readback.hpp
+ *
+ * @brief GPU copy of SHM presented images into host cached buffers.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+#include "util/custom_allocator.hpp"
+#include "util/helpers.hpp"
+
+namespace layer
+{
+class device_private_data;
+}
+
+namespace wsi
+{
+namespace x11
+{
+
+/**
+ * @brief Linear copy of a swapchain image, written by the GPU as part of the present payload.
+ *
+ * Reading the image memory from the CPU is slow when the driver hands out uncached or write-combined
+ * memory. Instead, a command buffer recorded once per image copies the image into a HOST_CACHED buffer
+ * with the stride of the X11 image, and runs after the application's present semaphores, see
+ * fence_sync::set_payload. The presenter then reads the buffer through the CPU caches.
+ */
+class image_readback : private util::noncopyable
+{
+public:
+   image_readback() = default;
+   ~image_readback();
+
+   /**
+    * @brief Check whether the device can run the readback.
+    *
+    * The command buffers are submitted to the presenting queue, so every queue of the device must come from
+    * the one family they are allocated from, and that family must support transfers. A host cached memory type
+    * must also be available, and linear images of @p format must allow @p usage plus
+    * VK_IMAGE_USAGE_TRANSFER_SRC_BIT.
+    */
+   static bool is_supported(layer::device_private_data &device_data, VkFormat format, VkImageUsageFlags usage);
+
+   /**
+    * @brief Check whether the queues of @p queue_family can record copies.
+    */
+   static bool is_transfer_capable(layer::device_private_data &device_data, uint32_t queue_family);
+
+   /**
+    * @brief Create the command pool the readback command buffers are allocated from, for the queue family of the
+    *        device.
+    */
+   static VkResult create_command_pool(layer::device_private_data &device_data, const util::allocator &allocator,
+                                       VkCommandPool *command_pool);
+
+   /**
+    * @brief Create the buffer for @p image and record the copy into it.
+    *
+    * @param image  Swapchain image in VK_IMAGE_LAYOUT_PRESENT_SRC_KHR when it is presented, created with
+    *               VK_IMAGE_USAGE_TRANSFER_SRC_BIT.
+    * @param stride Row pitch of the buffer in bytes, a multiple of @p bytes_per_pixel.
+    */
+   VkResult init(layer::device_private_data &device_data, const util::allocator &allocator,
+                 VkCommandPool command_pool, VkImage image, uint32_t width, uint32_t height, uint32_t bytes_per_pixel,
+                 uint32_t stride);
+
+   bool is_valid() const
+   {
+      return m_command_buffer != VK_NULL_HANDLE;
+   }
+
+   VkCommandBuffer get_command_buffer() const
+   {
+      return m_command_buffer;
+   }
+
+   uint32_t get_stride() const
+   {
+      return m_stride;
+   }
+
+   /**
+    * @brief Get the copied pixels, once the present payload has completed.
+    *
+    * @return nullptr if the buffer could not be made visible to the host.
+    */
+   const void *map_for_read();
+
+private:
+   VkResult allocate_memory(VkDeviceSize size);
+   VkResult record(VkImage image, uint32_t width, uint32_t height, uint32_t bytes_per_pixel);
+   void destroy();
+
+   layer::device_private_data *m_device_data = nullptr;
+   const VkAllocationCallbacks *m_callbacks = nullptr;
+   VkCommandPool m_command_pool = VK_NULL_HANDLE;
+   VkCommandBuffer m_command_buffer = VK_NULL_HANDLE;
+   VkBuffer m_buffer = VK_NULL_HANDLE;
+   VkDeviceMemory m_memory = VK_NULL_HANDLE;
+   void *m_mapped = nullptr;
+   bool m_coherent = false;
+   uint32_t m_stride = 0;
+};
+
+} /* namespace x11 */
+} /* namespace wsi */
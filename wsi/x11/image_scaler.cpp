@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file image_scaler.cpp
+ *
+ * @brief Scaling stage of the SHM presenter, implementing VK_EXT_swapchain_maintenance1 present scaling.
+ */
+
+#include "image_scaler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace wsi
+{
+namespace x11
+{
+
+/* Masks selecting two of the four 8 bit channels, leaving a 16 bit lane for each of them. */
+static constexpr uint32_t CHANNELS_02 = 0x00FF00FFu;
+static constexpr uint32_t CHANNELS_13 = 0xFF00FF00u;
+
+/* Fixed point precision of the bilinear weights. */
+static constexpr uint32_t WEIGHT_BITS = 8;
+static constexpr uint32_t WEIGHT_ONE = 1u << WEIGHT_BITS;
+
+/**
+ * @brief Blend two pixels, @p w being the weight of @p b in [0, WEIGHT_ONE].
+ *
+ * Each 16 bit lane holds at most 255 * WEIGHT_ONE, so the lanes never carry into each other.
+ */
+static inline uint32_t lerp_pixel(uint32_t a, uint32_t b, uint32_t w)
+{
+   const uint32_t iw = WEIGHT_ONE - w;
+   const uint32_t ch02 = (((a & CHANNELS_02) * iw + (b & CHANNELS_02) * w) >> WEIGHT_BITS) & CHANNELS_02;
+   const uint32_t ch13 = (((a >> 8) & CHANNELS_02) * iw + ((b >> 8) & CHANNELS_02) * w) & CHANNELS_13;
+   return ch02 | ch13;
+}
+
+/**
+ * @brief Rounded average of four pixels.
+ */
+static inline uint32_t average_4_pixels(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+   const uint32_t ch02 = (a & CHANNELS_02) + (b & CHANNELS_02) + (c & CHANNELS_02) + (d & CHANNELS_02) + 0x00020002u;
+   const uint32_t ch13 = ((a >> 8) & CHANNELS_02) + ((b >> 8) & CHANNELS_02) + ((c >> 8) & CHANNELS_02) +
+                         ((d >> 8) & CHANNELS_02) + 0x00020002u;
+   return ((ch02 >> 2) & CHANNELS_02) | (((ch13 >> 2) & CHANNELS_02) << 8);
+}
+
+/**
+ * @brief Offset of a span of @p size inside @p room according to a gravity, @p size being at most @p room.
+ */
+static uint32_t apply_gravity(VkPresentGravityFlagsEXT gravity, uint32_t size, uint32_t room)
+{
+   if (gravity & VK_PRESENT_GRAVITY_MAX_BIT_EXT)
+   {
+      return room - size;
+   }
+   if (gravity & VK_PRESENT_GRAVITY_CENTERED_BIT_EXT)
+   {
+      return (room - size) / 2;
+   }
+   return 0;
+}
+
+scale_layout compute_scale_layout(VkPresentScalingFlagsEXT scaling, VkPresentGravityFlagsEXT gravity_x,
+                                  VkPresentGravityFlagsEXT gravity_y, uint32_t image_width, uint32_t image_height,
+                                  uint32_t window_width, uint32_t window_height)
+{
+   scale_layout layout = {};
+   if (image_width == 0 || image_height == 0 || window_width == 0 || window_height == 0)
+   {
+      return layout;
+   }
+
+   layout.src_width = image_width;
+   layout.src_height = image_height;
+
+   if (scaling & VK_PRESENT_SCALING_STRETCH_BIT_EXT)
+   {
+      layout.dst_width = window_width;
+      layout.dst_height = window_height;
+   }
+   else if (scaling & VK_PRESENT_SCALING_ASPECT_RATIO_STRETCH_BIT_EXT)
+   {
+      const uint64_t scaled_width = static_cast<uint64_t>(image_width) * window_height;
+      const uint64_t scaled_height = static_cast<uint64_t>(image_height) * window_width;
+      if (scaled_width <= scaled_height)
+      {
+         layout.dst_height = window_height;
+         layout.dst_width = static_cast<uint32_t>((scaled_width + image_height / 2) / image_height);
+      }
+      else
+      {
+         layout.dst_width = window_width;
+         layout.dst_height = static_cast<uint32_t>((scaled_height + image_width / 2) / image_width);
+      }
+      layout.dst_width = std::min(std::max(layout.dst_width, 1u), window_width);
+      layout.dst_height = std::min(std::max(layout.dst_height, 1u), window_height);
+   }
+   else
+   {
+      /* One to one: the part of the image that does not fit is cropped on the side opposite to the gravity. */
+      layout.src_width = layout.dst_width = std::min(image_width, window_width);
+      layout.src_height = layout.dst_height = std::min(image_height, window_height);
+      layout.src_x = apply_gravity(gravity_x, layout.src_width, image_width);
+      layout.src_y = apply_gravity(gravity_y, layout.src_height, image_height);
+   }
+
+   layout.dst_x = apply_gravity(gravity_x, layout.dst_width, window_width);
+   layout.dst_y = apply_gravity(gravity_y, layout.dst_height, window_height);
+   return layout;
+}
+
+/**
+ * @brief Fill the source index and weight of each destination position for a pixel center aligned mapping.
+ */
+static void build_bilinear_table(uint32_t src_size, uint32_t dst_size, std::vector<uint32_t> &index,
+                                 std::vector<uint16_t> &weight)
+{
+   index.resize(dst_size);
+   weight.resize(dst_size);
+
+   const int64_t max_pos = static_cast<int64_t>(src_size - 1) << WEIGHT_BITS;
+   for (uint32_t i = 0; i < dst_size; i++)
+   {
+      /* Source position of the destination pixel center, (i + 0.5) * src / dst - 0.5, in fixed point. */
+      const int64_t scaled_center = (static_cast<int64_t>(2 * i + 1) * src_size) << WEIGHT_BITS;
+      int64_t pos = scaled_center / (2 * static_cast<int64_t>(dst_size)) - (WEIGHT_ONE / 2);
+      pos = std::min(std::max<int64_t>(pos, 0), max_pos);
+
+      uint32_t idx = static_cast<uint32_t>(pos >> WEIGHT_BITS);
+      uint32_t w = static_cast<uint32_t>(pos & (WEIGHT_ONE - 1));
+      if (idx + 1 >= src_size && src_size > 1)
+      {
+         /* Keep idx + 1 in bounds for the last position. */
+         idx = src_size - 2;
+         w = WEIGHT_ONE;
+      }
+      index[i] = idx;
+      weight[i] = static_cast<uint16_t>(w);
+   }
+}
+
+static void build_nearest_table(uint32_t src_size, uint32_t dst_size, std::vector<uint32_t> &index)
+{
+   index.resize(dst_size);
+   for (uint32_t i = 0; i < dst_size; i++)
+   {
+      const uint64_t scaled_center = static_cast<uint64_t>(2 * i + 1) * src_size;
+      index[i] = static_cast<uint32_t>(scaled_center / (2 * static_cast<uint64_t>(dst_size)));
+   }
+}
+
+bool image_scaler::configure(uint32_t src_width, uint32_t src_height, uint32_t dst_width, uint32_t dst_height)
+{
+   if (src_width == m_src_width && src_height == m_src_height && dst_width == m_dst_width &&
+       dst_height == m_dst_height)
+   {
+      return true;
+   }
+
+   m_src_width = m_src_height = m_dst_width = m_dst_height = 0;
+   m_kernel = kernel::COPY;
+
+   if (src_width == dst_width && src_height == dst_height)
+   {
+      m_kernel = kernel::COPY;
+   }
+   else if (dst_width == 2 * src_width && dst_height == 2 * src_height)
+   {
+      m_kernel = kernel::UPSCALE_2X;
+   }
+   else if (src_width == 2 * dst_width && src_height == 2 * dst_height)
+   {
+      m_kernel = kernel::DOWNSCALE_2X;
+   }
+   else if (dst_width % src_width == 0 && dst_height % src_height == 0)
+   {
+      /* Integer upscales are exact with nearest, bilinear would only blur them. */
+      m_kernel = kernel::NEAREST;
+   }
+   else
+   {
+      m_kernel = kernel::BILINEAR;
+   }
+
+   try
+   {
+      if (m_kernel == kernel::NEAREST)
+      {
+         build_nearest_table(src_width, dst_width, m_x_index);
+         build_nearest_table(src_height, dst_height, m_y_index);
+      }
+      else if (m_kernel == kernel::BILINEAR)
+      {
+         build_bilinear_table(src_width, dst_width, m_x_index, m_x_weight);
+         build_bilinear_table(src_height, dst_height, m_y_index, m_y_weight);
+      }
+   }
+   catch (const std::bad_alloc &)
+   {
+      return false;
+   }
+
+   m_src_width = src_width;
+   m_src_height = src_height;
+   m_dst_width = dst_width;
+   m_dst_height = dst_height;
+   return true;
+}
+
+const char *image_scaler::get_kernel_name() const
+{
+   switch (m_kernel)
+   {
+   case kernel::COPY:
+      return "copy";
+   case kernel::UPSCALE_2X:
+      return "2x";
+   case kernel::DOWNSCALE_2X:
+      return "0.5x";
+   case kernel::NEAREST:
+      return "nearest";
+   case kernel::BILINEAR:
+      return "bilinear";
+   }
+   return "unknown";
+}
+
+void image_scaler::scale_row_nearest(const uint32_t *__restrict src_row, uint32_t *__restrict dst_row) const
+{
+   const uint32_t *x_index = m_x_index.data();
+   for (uint32_t x = 0; x < m_dst_width; x++)
+   {
+      dst_row[x] = src_row[x_index[x]];
+   }
+}
+
+void image_scaler::scale_row_bilinear(const uint32_t *__restrict src_row0, const uint32_t *__restrict src_row1,
+                                      uint32_t weight_y, uint32_t *__restrict dst_row) const
+{
+   const uint32_t *x_index = m_x_index.data();
+   const uint16_t *x_weight = m_x_weight.data();
+   if (m_src_width == 1)
+   {
+      const uint32_t pixel = lerp_pixel(src_row0[0], src_row1[0], weight_y);
+      std::fill(dst_row, dst_row + m_dst_width, pixel);
+      return;
+   }
+
+   for (uint32_t x = 0; x < m_dst_width; x++)
+   {
+      const uint32_t idx = x_index[x];
+      const uint32_t wx = x_weight[x];
+      const uint32_t top = lerp_pixel(src_row0[idx], src_row0[idx + 1], wx);
+      const uint32_t bottom = lerp_pixel(src_row1[idx], src_row1[idx + 1], wx);
+      dst_row[x] = lerp_pixel(top, bottom, weight_y);
+   }
+}
+
+void image_scaler::scale_rows(const uint32_t *src, uint32_t src_stride_pixels, uint32_t *dst,
+                              uint32_t dst_stride_pixels, uint32_t row_begin, uint32_t row_end) const
+{
+   row_end = std::min(row_end, m_dst_height);
+   for (uint32_t y = row_begin; y < row_end; y++)
+   {
+      uint32_t *__restrict dst_row = dst + static_cast<size_t>(y) * dst_stride_pixels;
+      switch (m_kernel)
+      {
+      case kernel::COPY:
+         std::memcpy(dst_row, src + static_cast<size_t>(y) * src_stride_pixels, m_dst_width * sizeof(uint32_t));
+         break;
+      case kernel::UPSCALE_2X:
+      {
+         const uint32_t *__restrict src_row = src + static_cast<size_t>(y / 2) * src_stride_pixels;
+         for (uint32_t x = 0; x < m_src_width; x++)
+         {
+            dst_row[2 * x] = src_row[x];
+            dst_row[2 * x + 1] = src_row[x];
+         }
+         break;
+      }
+      case kernel::DOWNSCALE_2X:
+      {
+         const uint32_t *__restrict src_row0 = src + static_cast<size_t>(2 * y) * src_stride_pixels;
+         const uint32_t *__restrict src_row1 = src_row0 + src_stride_pixels;
+         for (uint32_t x = 0; x < m_dst_width; x++)
+         {
+            dst_row[x] = average_4_pixels(src_row0[2 * x], src_row0[2 * x + 1], src_row1[2 * x], src_row1[2 * x + 1]);
+         }
+         break;
+      }
+      case kernel::NEAREST:
+         scale_row_nearest(src + static_cast<size_t>(m_y_index[y]) * src_stride_pixels, dst_row);
+         break;
+      case kernel::BILINEAR:
+      {
+         const uint32_t *src_row0 = src + static_cast<size_t>(m_y_index[y]) * src_stride_pixels;
+         const uint32_t *src_row1 = (m_src_height > 1) ? src_row0 + src_stride_pixels : src_row0;
+         scale_row_bilinear(src_row0, src_row1, m_y_weight[y], dst_row);
+         break;
+      }
+      }
+   }
+}
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file image_scaler.hpp
+ *
+ * @brief Scaling stage of the SHM presenter, implementing VK_EXT_swapchain_maintenance1 present scaling.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace wsi
+{
+namespace x11
+{
+
+/**
+ * @brief Placement of a swapchain image in a window of a different size.
+ *
+ * The source rectangle of the image is scaled to the destination rectangle of the window. Window pixels
+ * outside the destination rectangle are left black.
+ */
+struct scale_layout
+{
+   uint32_t src_x;
+   uint32_t src_y;
+   uint32_t src_width;
+   uint32_t src_height;
+
+   uint32_t dst_x;
+   uint32_t dst_y;
+   uint32_t dst_width;
+   uint32_t dst_height;
+
+   bool operator==(const scale_layout &other) const
+   {
+      return src_x == other.src_x && src_y == other.src_y && src_width == other.src_width &&
+             src_height == other.src_height && dst_x == other.dst_x && dst_y == other.dst_y &&
+             dst_width == other.dst_width && dst_height == other.dst_height;
+   }
+
+   bool operator!=(const scale_layout &other) const
+   {
+      return !(*this == other);
+   }
+};
+
+/**
+ * @brief Compute where an image goes in a window, following VkSwapchainPresentScalingCreateInfoEXT.
+ *
+ * A scaling behavior of 0 behaves as VK_PRESENT_SCALING_ONE_TO_ONE_BIT_EXT and a gravity of 0 as
+ * VK_PRESENT_GRAVITY_MIN_BIT_EXT, which is what the X server does with an unscaled image.
+ */
+scale_layout compute_scale_layout(VkPresentScalingFlagsEXT scaling, VkPresentGravityFlagsEXT gravity_x,
+                                  VkPresentGravityFlagsEXT gravity_y, uint32_t image_width, uint32_t image_height,
+                                  uint32_t window_width, uint32_t window_height);
+
+/**
+ * @brief Scales 32 bit pixels from a source rectangle to a destination rectangle.
+ *
+ * @ref configure picks a kernel for the ratio: plain copies, 2x and 0.5x fast paths, nearest for other
+ * integer upscales and bilinear otherwise. The kernels work on two 8 bit channels per 32 bit operation and
+ * are written so the compiler can vectorize the inner loops. @ref scale_rows only reads the state set up by
+ * @ref configure and can run on several threads at once.
+ */
+class image_scaler
+{
+public:
+   /**
+    * @brief Prepare the lookup tables for a ratio. Does nothing if the ratio did not change.
+    *
+    * @return false if the tables could not be allocated.
+    */
+   bool configure(uint32_t src_width, uint32_t src_height, uint32_t dst_width, uint32_t dst_height);
+
+   /**
+    * @brief Produce destination rows [row_begin, row_end).
+    *
+    * @param src               First pixel of the source rectangle.
+    * @param src_stride_pixels Source row pitch in pixels.
+    * @param dst               First pixel of the destination rectangle.
+    * @param dst_stride_pixels Destination row pitch in pixels.
+    */
+   void scale_rows(const uint32_t *src, uint32_t src_stride_pixels, uint32_t *dst, uint32_t dst_stride_pixels,
+                   uint32_t row_begin, uint32_t row_end) const;
+
+   uint32_t get_dst_height() const
+   {
+      return m_dst_height;
+   }
+
+   const char *get_kernel_name() const;
+
+private:
+   enum class kernel
+   {
+      COPY,
+      UPSCALE_2X,
+      DOWNSCALE_2X,
+      NEAREST,
+      BILINEAR,
+   };
+
+   void scale_row_nearest(const uint32_t *src_row, uint32_t *dst_row) const;
+   void scale_row_bilinear(const uint32_t *src_row0, const uint32_t *src_row1, uint32_t weight_y,
+                           uint32_t *dst_row) const;
+
+   kernel m_kernel = kernel::COPY;
+   uint32_t m_src_width = 0;
+   uint32_t m_src_height = 0;
+   uint32_t m_dst_width = 0;
+   uint32_t m_dst_height = 0;
+
+   /* Per destination column: source column and, for bilinear, the weight of the next column in [0, 256]. */
+   std::vector<uint32_t> m_x_index;
+   std::vector<uint16_t> m_x_weight;
+
+   /* Same per destination row. */
+   std::vector<uint32_t> m_y_index;
+   std::vector<uint16_t> m_y_weight;
+};
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file pixel_convert.cpp
+ *
+ * @brief Conversion kernels from the swapchain format to the pixmap format of non-XRGB8888 X11 visuals.
+ */
+
+#include "pixel_convert.hpp"
+
+#include <cstring>
+
+#ifdef ENABLE_X86_SIMD
+#include <immintrin.h>
+#endif
+#ifdef ENABLE_ARM_NEON
+#include <arm_neon.h>
+#endif
+
+namespace wsi
+{
+namespace x11
+{
+
+shm_pixel_format get_shm_pixel_format(int depth, uint32_t bits_per_pixel)
+{
+   if ((depth == 24 || depth == 32) && bits_per_pixel == 32)
+   {
+      return shm_pixel_format::XRGB8888;
+   }
+   if (depth == 16 && bits_per_pixel == 16)
+   {
+      return shm_pixel_format::RGB565;
+   }
+   if (depth == 30 && bits_per_pixel == 32)
+   {
+      return shm_pixel_format::XRGB2101010;
+   }
+   return shm_pixel_format::UNSUPPORTED;
+}
+
+/* Scalar per pixel conversions, also used for the tails of the vector kernels. The source pixel is read as a little
+ * endian 32 bit word, so BGRA memory order is 0xAARRGGBB and RGBA memory order is 0xAABBGGRR. */
+
+template <bool swap_rb>
+static inline uint32_t to_argb8888(uint32_t pixel)
+{
+   if (!swap_rb)
+   {
+      return pixel;
+   }
+   return (pixel & 0xFF00FF00u) | ((pixel >> 16) & 0xFFu) | ((pixel & 0xFFu) << 16);
+}
+
+template <bool swap_rb>
+static inline uint16_t to_rgb565(uint32_t pixel)
+{
+   const uint32_t argb = to_argb8888<swap_rb>(pixel);
+   return static_cast<uint16_t>(((argb >> 8) & 0xF800u) | ((argb >> 5) & 0x07E0u) | ((argb >> 3) & 0x001Fu));
+}
+
+/* Replicate the top bits into the new low bits so that 0xFF maps to 0x3FF. */
+static inline uint32_t expand_8_to_10(uint32_t channel)
+{
+   return (channel << 2) | (channel >> 6);
+}
+
+template <bool swap_rb>
+static inline uint32_t to_xrgb2101010(uint32_t pixel)
+{
+   const uint32_t argb = to_argb8888<swap_rb>(pixel);
+   return (expand_8_to_10((argb >> 16) & 0xFFu) << 20) | (expand_8_to_10((argb >> 8) & 0xFFu) << 10) |
+          expand_8_to_10(argb & 0xFFu);
+}
+
+template <typename dst_type, dst_type (*convert_pixel)(uint32_t)>
+static inline void convert_span_scalar(const uint8_t *src, uint8_t *dst, uint32_t first, uint32_t width)
+{
+   for (uint32_t x = first; x < width; x++)
+   {
+      uint32_t pixel;
+      std::memcpy(&pixel, src + x * sizeof(uint32_t), sizeof(pixel));
+      const dst_type out = convert_pixel(pixel);
+      std::memcpy(dst + x * sizeof(dst_type), &out, sizeof(out));
+   }
+}
+
+template <typename dst_type, dst_type (*convert_pixel)(uint32_t)>
+static void convert_rows_generic(const uint8_t *src, size_t src_stride, uint8_t *dst, size_t dst_stride,
+                                 uint32_t width, uint32_t height)
+{
+   for (uint32_t row = 0; row < height; row++)
+   {
+      convert_span_scalar<dst_type, convert_pixel>(src + row * src_stride, dst + row * dst_stride, 0, width);
+   }
+}
+
+#ifdef ENABLE_X86_SIMD
+
+template <bool swap_rb>
+__attribute__((target("sse2"))) static inline __m128i to_argb8888_sse2(__m128i pixels)
+{
+   if (!swap_rb)
+   {
+      return pixels;
+   }
+   const __m128i ag = _mm_and_si128(pixels, _mm_set1_epi32(static_cast<int>(0xFF00FF00u)));
+   const __m128i r = _mm_and_si128(_mm_srli_epi32(pixels, 16), _mm_set1_epi32(0xFF));
+   const __m128i b = _mm_slli_epi32(_mm_and_si128(pixels, _mm_set1_epi32(0xFF)), 16);
+   return _mm_or_si128(ag, _mm_or_si128(r, b));
+}
+
+template <bool swap_rb>
+__attribute__((target("sse2"))) static inline __m128i to_xrgb2101010_sse2(__m128i pixels)
+{
+   const __m128i argb = to_argb8888_sse2<swap_rb>(pixels);
+   const __m128i mask = _mm_set1_epi32(0xFF);
+   const __m128i r = _mm_and_si128(_mm_srli_epi32(argb, 16), mask);
+   const __m128i g = _mm_and_si128(_mm_srli_epi32(argb, 8), mask);
+   const __m128i b = _mm_and_si128(argb, mask);
+   const __m128i r10 = _mm_or_si128(_mm_slli_epi32(r, 2), _mm_srli_epi32(r, 6));
+   const __m128i g10 = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 6));
+   const __m128i b10 = _mm_or_si128(_mm_slli_epi32(b, 2), _mm_srli_epi32(b, 6));
+   return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r10, 20), _mm_slli_epi32(g10, 10)), b10);
+}
+
+/* 565 values of 4 pixels, one per 32 bit lane. */
+template <bool swap_rb>
+__attribute__((target("sse2"))) static inline __m128i to_rgb565_sse2(__m128i pixels)
+{
+   const __m128i argb = to_argb8888_sse2<swap_rb>(pixels);
+   const __m128i r = _mm_and_si128(_mm_srli_epi32(argb, 8), _mm_set1_epi32(0xF800));
+   const __m128i g = _mm_and_si128(_mm_srli_epi32(argb, 5), _mm_set1_epi32(0x07E0));
+   const __m128i b = _mm_and_si128(_mm_srli_epi32(argb, 3), _mm_set1_epi32(0x001F));
+   const __m128i rgb = _mm_or_si128(r, _mm_or_si128(g, b));
+   /* Sign extend the low half so the signed saturating pack keeps the 16 bit pattern unchanged. */
+   return _mm_srai_epi32(_mm_slli_epi32(rgb, 16), 16);
+}
+
+template <bool swap_rb>
+__attribute__((target("sse2"))) static void convert_rows_argb8888_sse2(const uint8_t *src, size_t src_stride,
+                                                                       uint8_t *dst, size_t dst_stride,
+                                                                       uint32_t width, uint32_t height)
+{
+   for (uint32_t row = 0; row < height; row++)
+   {
+      const uint8_t *src_row = src + row * src_stride;
+      uint8_t *dst_row = dst + row * dst_stride;
+      uint32_t x = 0;
+      for (; x + 4 <= width; x += 4)
+      {
+         const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src_row + x * 4));
+         _mm_storeu_si128(reinterpret_cast<__m128i *>(dst_row + x * 4), to_argb8888_sse2<swap_rb>(pixels));
+      }
+      convert_span_scalar<uint32_t, to_argb8888<swap_rb>>(src_row, dst_row, x, width);
+   }
+}
+
+template <bool swap_rb>
+__attribute__((target("sse2"))) static void convert_rows_xrgb2101010_sse2(const uint8_t *src, size_t src_stride,
+                                                                          uint8_t *dst, size_t dst_stride,
+                                                                          uint32_t width, uint32_t height)
+{
+   for (uint32_t row = 0; row < height; row++)
+   {
+      const uint8_t *src_row = src + row * src_stride;
+      uint8_t *dst_row = dst + row * dst_stride;
+      uint32_t x = 0;
+      for (; x + 4 <= width; x += 4)
+      {
+         const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src_row + x * 4));
+         _mm_storeu_si128(reinterpret_cast<__m128i *>(dst_row + x * 4), to_xrgb2101010_sse2<swap_rb>(pixels));
+      }
+      convert_span_scalar<uint32_t, to_xrgb2101010<swap_rb>>(src_row, dst_row, x, width);
+   }
+}
+
+template <bool swap_rb>
+__attribute__((target("sse2"))) static void convert_rows_rgb565_sse2(const uint8_t *src, size_t src_stride,
+                                                                     uint8_t *dst, size_t dst_stride, uint32_t width,
+                                                                     uint32_t height)
+{
+   for (uint32_t row = 0; row < height; row++)
+   {
+      const uint8_t *src_row = src + row * src_stride;
+      uint8_t *dst_row = dst + row * dst_stride;
+      uint32_t x = 0;
+      for (; x + 8 <= width; x += 8)
+      {
+         const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src_row + x * 4));
+         const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src_row + x * 4 + 16));
+         const __m128i packed = _mm_packs_epi32(to_rgb565_sse2<swap_rb>(lo), to_rgb565_sse2<swap_rb>(hi));
+         _mm_storeu_si128(reinterpret_cast<__m128i *>(dst_row + x * 2), packed);
+      }
+      convert_span_scalar<uint16_t, to_rgb565<swap_rb>>(src_row, dst_row, x, width);
+   }
+}
+
+#endif /* ENABLE_X86_SIMD */
+
+#ifdef ENABLE_ARM_NEON
+
+/* NEON kernels deinterleave 16 pixels into one vector per channel. */
+
+static void convert_rows_swizzle_neon(const uint8_t *src, size_t src_stride, uint8_t *dst, size_t dst_stride,
+                                      uint32_t width, uint32_t height)
+{
+   for (uint32_t row = 0; row < height; row++)
+   {
+      const uint8_t *src_row = src + row * src_stride;
+      uint8_t *dst_row = dst + row * dst_stride;
+      uint32_t x = 0;
+      for (; x + 16 <= width; x += 16)
+      {
+         uint8x16x4_t pixels = vld4q_u8(src_row + x * 4);
+         const uint8x16_t first = pixels.val[0];
+         pixels.val[0] = pixels.val[2];
+         pixels.val[2] = first;
+         vst4q_u8(dst_row + x * 4, pixels);
+      }
+      convert_span_scalar<uint32_t, to_argb8888<true>>(src_row, dst_row, x, width);
+   }
+}
+
+template <bool swap_rb>
+static void convert_rows_rgb565_neon(const uint8_t *src, size_t src_stride, uint8_t *dst, size_t dst_stride,
+                                     uint32_t width, uint32_t height)
+{
+   /* Memory order of the channels is B, G, R, A for BGRA and R, G, B, A for RGBA. */
+   constexpr int red = swap_rb ? 0 : 2;
+   constexpr int blue = swap_rb ? 2 : 0;
+   for (uint32_t row = 0; row < height; row++)
+   {
+      const uint8_t *src_row = src + row * src_stride;
+      uint16_t *dst_row = reinterpret_cast<uint16_t *>(dst + row * dst_stride);
+      uint32_t x = 0;
+      for (; x + 16 <= width; x += 16)
+      {
+         const uint8x16x4_t pixels = vld4q_u8(src_row + x * 4);
+         uint16x8_t lo = vshll_n_u8(vget_low_u8(pixels.val[red]), 8);
+         uint16x8_t hi = vshll_n_u8(vget_high_u8(pixels.val[red]), 8);
+         lo = vsriq_n_u16(lo, vshll_n_u8(vget_low_u8(pixels.val[1]), 8), 5);
+         hi = vsriq_n_u16(hi, vshll_n_u8(vget_high_u8(pixels.val[1]), 8), 5);
+         lo = vsriq_n_u16(lo, vshll_n_u8(vget_low_u8(pixels.val[blue]), 8), 11);
+         hi = vsriq_n_u16(hi, vshll_n_u8(vget_high_u8(pixels.val[blue]), 8), 11);
+         vst1q_u16(dst_row + x, lo);
+         vst1q_u16(dst_row + x + 8, hi);
+      }
+      convert_span_scalar<uint16_t, to_rgb565<swap_rb>>(src_row, reinterpret_cast<uint8_t *>(dst_row), x, width);
+   }
+}
+
+#endif /* ENABLE_ARM_NEON */
+
+static bool is_rgba_format(VkFormat format)
+{
+   return format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+static bool is_bgra_format(VkFormat format)
+{
+   return format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+}
+
+bool select_pixel_converter(VkFormat format, shm_pixel_format pixel_format, pixel_converter *converter)
+{
+   const bool swap_rb = is_rgba_format(format);
+   if (!swap_rb && !is_bgra_format(format))
+   {
+      return false;
+   }
+
+   switch (pixel_format)
+   {
+   case shm_pixel_format::XRGB8888:
+      if (!swap_rb)
+      {
+         *converter = { nullptr, 4, "none" };
+      }
+      else
+      {
+#if defined(ENABLE_X86_SIMD)
+         *converter = { convert_rows_argb8888_sse2<true>, 4, "RGBA to BGRA (SSE2)" };
+#elif defined(ENABLE_ARM_NEON)
+         *converter = { convert_rows_swizzle_neon, 4, "RGBA to BGRA (NEON)" };
+#else
+         *converter = { convert_rows_generic<uint32_t, to_argb8888<true>>, 4, "RGBA to BGRA" };
+#endif
+      }
+      return true;
+
+   case shm_pixel_format::RGB565:
+#if defined(ENABLE_X86_SIMD)
+      *converter = { swap_rb ? convert_rows_rgb565_sse2<true> : convert_rows_rgb565_sse2<false>, 2,
+                     "RGB565 (SSE2)" };
+#elif defined(ENABLE_ARM_NEON)
+      *converter = { swap_rb ? convert_rows_rgb565_neon<true> : convert_rows_rgb565_neon<false>, 2,
+                     "RGB565 (NEON)" };
+#else
+      *converter = { swap_rb ? convert_rows_generic<uint16_t, to_rgb565<true>> :
+                               convert_rows_generic<uint16_t, to_rgb565<false>>,
+                     2, "RGB565" };
+#endif
+      return true;
+
+   case shm_pixel_format::XRGB2101010:
+#if defined(ENABLE_X86_SIMD)
+      *converter = { swap_rb ? convert_rows_xrgb2101010_sse2<true> : convert_rows_xrgb2101010_sse2<false>, 4,
+                     "XRGB2101010 (SSE2)" };
+#else
+      *converter = { swap_rb ? convert_rows_generic<uint32_t, to_xrgb2101010<true>> :
+                               convert_rows_generic<uint32_t, to_xrgb2101010<false>>,
+                     4, "XRGB2101010" };
+#endif
+      return true;
+
+   case shm_pixel_format::UNSUPPORTED:
+      break;
+   }
+
+   return false;
+}
+
+} /* namespace x11 */
+} /* namespace wsi */
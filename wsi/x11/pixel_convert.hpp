@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file pixel_convert.hpp
+ *
+ * @brief Conversion kernels from the swapchain format to the pixmap format of non-XRGB8888 X11 visuals.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+namespace wsi
+{
+namespace x11
+{
+
+/**
+ * @brief Pixel layout the X server expects in a Z pixmap for a given depth.
+ */
+enum class shm_pixel_format
+{
+   XRGB8888,    /* depth 24 and 32 */
+   RGB565,      /* depth 16 */
+   XRGB2101010, /* depth 30 */
+   UNSUPPORTED,
+};
+
+/**
+ * @brief Pick the pixmap layout for a window depth.
+ *
+ * @param depth          Depth of the window.
+ * @param bits_per_pixel Bits per pixel the X server uses for pixmaps of that depth.
+ */
+shm_pixel_format get_shm_pixel_format(int depth, uint32_t bits_per_pixel);
+
+/**
+ * @brief Convert a block of 32bpp swapchain pixels to the pixmap layout.
+ *
+ * @param src        First source pixel.
+ * @param src_stride Distance in bytes between two consecutive source rows.
+ * @param dst        First destination pixel.
+ * @param dst_stride Distance in bytes between two consecutive destination rows.
+ * @param width      Number of pixels per row.
+ * @param height     Number of rows.
+ */
+using convert_rows_function = void (*)(const uint8_t *src, size_t src_stride, uint8_t *dst, size_t dst_stride,
+                                       uint32_t width, uint32_t height);
+
+/**
+ * @brief Description of a conversion kernel.
+ */
+struct pixel_converter
+{
+   /** Kernel entry point, nullptr when the swapchain pixels can be copied as they are. */
+   convert_rows_function convert_rows;
+   /** Bytes per destination pixel. */
+   uint32_t dst_bytes_per_pixel;
+   /** Human readable name of the conversion. */
+   const char *name;
+};
+
+/**
+ * @brief Select the converter between a swapchain format and a pixmap layout.
+ *
+ * Both 8 bit per channel BGRA and RGBA swapchain formats are handled. SSE2 kernels are used on x86 builds with
+ * ENABLE_X86_SIMD and NEON kernels on ENABLE_ARM_NEON builds, other builds get portable scalar kernels.
+ *
+ * @param format       Format of the swapchain images.
+ * @param pixel_format Pixmap layout of the window.
+ * @param converter    Set to the selected converter.
+ *
+ * @return false if the combination cannot be converted.
+ */
+bool select_pixel_converter(VkFormat format, shm_pixel_format pixel_format, pixel_converter *converter);
+
+} /* namespace x11 */
+} /* namespace wsi */
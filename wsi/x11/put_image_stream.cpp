@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file put_image_stream.cpp
+ *
+ * @brief Implementation of the core protocol PutImage uploads.
+ */
+
+#include "put_image_stream.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "util/log.hpp"
+
+namespace wsi
+{
+namespace x11
+{
+
+/* Size of the PutImage request without its data. */
+static constexpr size_t PUT_IMAGE_HEADER_BYTES = 24;
+
+put_image_stream::~put_image_stream()
+{
+   for (uint32_t i = 0; i < m_fence_count; i++)
+   {
+      xcb_discard_reply(m_connection, m_fences[(m_fence_head + i) % MAX_OUTSTANDING_CHUNKS].sequence);
+   }
+}
+
+bool put_image_stream::init(xcb_connection_t *connection)
+{
+   m_connection = connection;
+
+   /* In units of 4 bytes, and as large as BIG-REQUESTS allows when the server supports it. */
+   const size_t max_request_bytes = static_cast<size_t>(xcb_get_maximum_request_length(connection)) * 4;
+   m_chunk_bytes = std::min(max_request_bytes - PUT_IMAGE_HEADER_BYTES, MAX_CHUNK_BYTES);
+
+   try
+   {
+      m_pack_buffer.resize(m_chunk_bytes);
+   }
+   catch (const std::bad_alloc &)
+   {
+      return false;
+   }
+
+   WSI_LOG_INFO("PutImage presentation in chunks of up to %zu bytes", m_chunk_bytes);
+   return true;
+}
+
+uint32_t put_image_stream::get_scanline_pad(uint8_t depth) const
+{
+   const xcb_setup_t *setup = xcb_get_setup(m_connection);
+   for (auto it = xcb_setup_pixmap_formats_iterator(setup); it.rem; xcb_format_next(&it))
+   {
+      if (it.data->depth == depth)
+      {
+         return it.data->scanline_pad / 8;
+      }
+   }
+   return setup->bitmap_format_scanline_pad / 8;
+}
+
+void put_image_stream::queue_fence()
+{
+   if (m_fence_count == MAX_OUTSTANDING_CHUNKS)
+   {
+      free(xcb_get_input_focus_reply(m_connection, m_fences[m_fence_head], nullptr));
+      m_fence_head = (m_fence_head + 1) % MAX_OUTSTANDING_CHUNKS;
+      m_fence_count--;
+   }
+
+   m_fences[(m_fence_head + m_fence_count) % MAX_OUTSTANDING_CHUNKS] = xcb_get_input_focus(m_connection);
+   m_fence_count++;
+}
+
+void put_image_stream::put(xcb_drawable_t drawable, xcb_gcontext_t gc, uint8_t depth, uint8_t bits_per_pixel,
+                           const char *base, size_t stride, const VkRect2D &rect)
+{
+   const size_t bytes_per_pixel = bits_per_pixel / 8;
+   const size_t pad = std::max<uint32_t>(get_scanline_pad(depth), 1);
+
+   /* Rows wider than a chunk are sent in strips of columns. */
+   const uint32_t max_strip_width =
+      static_cast<uint32_t>(std::max<size_t>((m_chunk_bytes - pad) / bytes_per_pixel, 1));
+
+   for (uint32_t strip_x = 0; strip_x < rect.extent.width; strip_x += max_strip_width)
+   {
+      const uint32_t strip_width = std::min(rect.extent.width - strip_x, max_strip_width);
+      const size_t row_bytes = strip_width * bytes_per_pixel;
+      const size_t padded_row_bytes = (row_bytes + pad - 1) / pad * pad;
+      const uint32_t rows_per_chunk = static_cast<uint32_t>(std::max<size_t>(m_chunk_bytes / padded_row_bytes, 1));
+      const size_t x = static_cast<size_t>(rect.offset.x) + strip_x;
+
+      for (uint32_t chunk_y = 0; chunk_y < rect.extent.height; chunk_y += rows_per_chunk)
+      {
+         const uint32_t rows = std::min(rect.extent.height - chunk_y, rows_per_chunk);
+         const size_t y = static_cast<size_t>(rect.offset.y) + chunk_y;
+         const char *src = base + y * stride + x * bytes_per_pixel;
+
+         /* Full rows of an unpadded image are already laid out as the request wants them. */
+         const char *data = src;
+         if (x != 0 || stride != padded_row_bytes)
+         {
+            char *dst = m_pack_buffer.data();
+            for (uint32_t row = 0; row < rows; row++)
+            {
+               std::memcpy(dst + row * padded_row_bytes, src + row * stride, row_bytes);
+            }
+            data = dst;
+         }
+
+         xcb_put_image(m_connection, XCB_IMAGE_FORMAT_Z_PIXMAP, drawable, gc, static_cast<uint16_t>(strip_width),
+                       static_cast<uint16_t>(rows), static_cast<int16_t>(x), static_cast<int16_t>(y), 0, depth,
+                       static_cast<uint32_t>(rows * padded_row_bytes), reinterpret_cast<const uint8_t *>(data));
+         queue_fence();
+      }
+   }
+}
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file put_image_stream.hpp
+ *
+ * @brief Core protocol PutImage uploads for X servers the MIT-SHM segments cannot be attached to.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include <xcb/xcb.h>
+
+namespace wsi
+{
+namespace x11
+{
+
+/**
+ * @brief Sends rectangles of client memory to a drawable as a pipeline of PutImage requests.
+ *
+ * Remote and forwarded displays cannot map the client's SHM segments, so the pixels have to travel in the requests
+ * themselves. Each rectangle is split into chunks of rows that fit in a request, below the maximum request length
+ * of the connection, and a round trip is queued after each chunk. The next chunk is only sent once the server has
+ * answered the round trip of the chunk MAX_OUTSTANDING_CHUNKS before it, which keeps the link busy without
+ * queueing more than a few chunks of latency in front of the other requests of the application.
+ */
+class put_image_stream
+{
+public:
+   /* Chunks sent ahead of the oldest one the server has not processed yet. */
+   static constexpr uint32_t MAX_OUTSTANDING_CHUNKS = 4;
+
+   /* Largest payload of a request, small enough for the server to draw a chunk while the next one arrives. */
+   static constexpr size_t MAX_CHUNK_BYTES = 256 * 1024;
+
+   ~put_image_stream();
+
+   /**
+    * @brief Size the chunks for @p connection.
+    *
+    * @return false when the buffer rows are packed into cannot be allocated.
+    */
+   bool init(xcb_connection_t *connection);
+
+   /**
+    * @brief Put a rectangle of an image held in client memory on @p drawable, at the same position.
+    *
+    * Returns once every chunk has been queued, @p base can be written again straight away.
+    *
+    * @param base            Pixel (0, 0) of the image.
+    * @param stride          Bytes between rows of the image.
+    * @param bits_per_pixel  Bits per pixel of the Z pixmap format of @p depth.
+    * @param rect            Part of the image to put.
+    */
+   void put(xcb_drawable_t drawable, xcb_gcontext_t gc, uint8_t depth, uint8_t bits_per_pixel, const char *base,
+            size_t stride, const VkRect2D &rect);
+
+private:
+   /**
+    * @brief Wait for the oldest chunk when MAX_OUTSTANDING_CHUNKS are in flight, then track a new one.
+    */
+   void queue_fence();
+
+   /**
+    * @brief Padding of the rows of a Z pixmap of @p depth, in bytes.
+    */
+   uint32_t get_scanline_pad(uint8_t depth) const;
+
+   xcb_connection_t *m_connection = nullptr;
+   size_t m_chunk_bytes = 0;
+
+   std::array<xcb_get_input_focus_cookie_t, MAX_OUTSTANDING_CHUNKS> m_fences{};
+   uint32_t m_fence_head = 0;
+   uint32_t m_fence_count = 0;
+
+   /* Rows that are not contiguous in the image are packed here before being sent. */
+   std::vector<char> m_pack_buffer;
+};
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file randr_topology.cpp
+ *
+ * @brief Implementation of the RandR topology cache.
+ */
+
+#include "randr_topology.hpp"
+#include "window_visibility.hpp"
+
+#include <cstdlib>
+#include <xcb/randr.h>
+
+#include "util/log.hpp"
+
+namespace wsi
+{
+namespace x11
+{
+
+/* RRGetScreenResourcesCurrent was added in RandR 1.3. */
+static constexpr uint32_t RANDR_MAJOR_VERSION = 1;
+static constexpr uint32_t RANDR_MINOR_VERSION = 3;
+
+static double get_mode_refresh_rate(const xcb_randr_mode_info_t &mode)
+{
+   double vtotal = mode.vtotal;
+   if (mode.mode_flags & XCB_RANDR_MODE_FLAG_DOUBLE_SCAN)
+   {
+      vtotal *= 2.0;
+   }
+   if (mode.mode_flags & XCB_RANDR_MODE_FLAG_INTERLACE)
+   {
+      vtotal /= 2.0;
+   }
+
+   if (mode.htotal == 0 || vtotal == 0.0)
+   {
+      return 0.0;
+   }
+   return static_cast<double>(mode.dot_clock) / (static_cast<double>(mode.htotal) * vtotal);
+}
+
+randr_topology &randr_topology::get_instance(xcb_connection_t *application)
+{
+   static randr_topology unavailable(nullptr);
+   static std::mutex instances_mutex;
+   static std::vector<std::unique_ptr<randr_topology>> instances;
+
+   char display_name[window_visibility::DISPLAY_NAME_SIZE];
+   if (!window_visibility::get_display_name(application, display_name, sizeof(display_name)))
+   {
+      WSI_LOG_WARNING("Failed to find the display of the X connection, refresh rates cannot be detected");
+      return unavailable;
+   }
+
+   std::lock_guard<std::mutex> lock(instances_mutex);
+   for (const auto &instance : instances)
+   {
+      if (instance->m_display_name == display_name)
+      {
+         return *instance;
+      }
+   }
+   instances.push_back(std::unique_ptr<randr_topology>(new randr_topology(display_name)));
+   return *instances.back();
+}
+
+randr_topology::randr_topology(const char *display_name)
+{
+   if (display_name == nullptr)
+   {
+      return;
+   }
+
+   m_display_name = display_name;
+   int screen_number = 0;
+   m_connection = xcb_connect(display_name, &screen_number);
+   if (xcb_connection_has_error(m_connection))
+   {
+      WSI_LOG_WARNING("Failed to connect to X server %s, refresh rates cannot be detected", display_name);
+      xcb_disconnect(m_connection);
+      m_connection = nullptr;
+      return;
+   }
+
+   xcb_screen_iterator_t screens = xcb_setup_roots_iterator(xcb_get_setup(m_connection));
+   for (int i = 0; i < screen_number && screens.rem > 0; i++)
+   {
+      xcb_screen_next(&screens);
+   }
+   m_root = screens.data->root;
+
+   const xcb_query_extension_reply_t *extension = xcb_get_extension_data(m_connection, &xcb_randr_id);
+   if (extension == nullptr || !extension->present)
+   {
+      WSI_LOG_WARNING("XRandR extension not available");
+      return;
+   }
+
+   xcb_randr_query_version_reply_t *version = xcb_randr_query_version_reply(
+      m_connection, xcb_randr_query_version(m_connection, RANDR_MAJOR_VERSION, RANDR_MINOR_VERSION), nullptr);
+   if (version == nullptr ||
+       (version->major_version == RANDR_MAJOR_VERSION && version->minor_version < RANDR_MINOR_VERSION))
+   {
+      WSI_LOG_WARNING("XRandR %u.%u is required for refresh rate detection", RANDR_MAJOR_VERSION,
+                      RANDR_MINOR_VERSION);
+      free(version);
+      return;
+   }
+   free(version);
+
+   m_randr_available = true;
+   m_randr_event_base = extension->first_event;
+   xcb_randr_select_input(m_connection, m_root,
+                          XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE | XCB_RANDR_NOTIFY_MASK_CRTC_CHANGE);
+   xcb_flush(m_connection);
+}
+
+randr_topology::~randr_topology()
+{
+   if (m_connection != nullptr)
+   {
+      xcb_disconnect(m_connection);
+   }
+}
+
+void randr_topology::watch_window(xcb_window_t window)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   if (!m_randr_available)
+   {
+      return;
+   }
+
+   /* Event masks are per client, selecting on the private connection leaves the application's mask alone. */
+   const uint32_t event_mask = XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+   xcb_change_window_attributes(m_connection, window, XCB_CW_EVENT_MASK, &event_mask);
+   xcb_flush(m_connection);
+}
+
+void randr_topology::process_events_locked()
+{
+   xcb_generic_event_t *event = nullptr;
+   while ((event = xcb_poll_for_event(m_connection)) != nullptr)
+   {
+      const uint8_t type = event->response_type & ~0x80;
+      if (type == m_randr_event_base + XCB_RANDR_SCREEN_CHANGE_NOTIFY ||
+          type == m_randr_event_base + XCB_RANDR_NOTIFY)
+      {
+         m_stale = true;
+         m_generation++;
+      }
+      else if (type == XCB_CONFIGURE_NOTIFY)
+      {
+         m_generation++;
+      }
+      free(event);
+   }
+}
+
+void randr_topology::refresh_locked()
+{
+   m_stale = false;
+   m_crtcs.clear();
+
+   xcb_randr_get_screen_resources_current_reply_t *resources = xcb_randr_get_screen_resources_current_reply(
+      m_connection, xcb_randr_get_screen_resources_current(m_connection, m_root), nullptr);
+   if (resources == nullptr)
+   {
+      WSI_LOG_WARNING("Failed to get XRandR screen resources");
+      return;
+   }
+
+   const xcb_randr_crtc_t *crtc_ids = xcb_randr_get_screen_resources_current_crtcs(resources);
+   const int crtc_count = xcb_randr_get_screen_resources_current_crtcs_length(resources);
+   const xcb_randr_mode_info_t *modes = xcb_randr_get_screen_resources_current_modes(resources);
+   const int mode_count = xcb_randr_get_screen_resources_current_modes_length(resources);
+
+   /* Send every CRTC query before waiting for the first reply. */
+   std::vector<xcb_randr_get_crtc_info_cookie_t> cookies(crtc_count);
+   for (int i = 0; i < crtc_count; i++)
+   {
+      cookies[i] = xcb_randr_get_crtc_info(m_connection, crtc_ids[i], resources->config_timestamp);
+   }
+
+   for (int i = 0; i < crtc_count; i++)
+   {
+      xcb_randr_get_crtc_info_reply_t *info = xcb_randr_get_crtc_info_reply(m_connection, cookies[i], nullptr);
+      if (info == nullptr)
+      {
+         continue;
+      }
+
+      if (info->mode != XCB_NONE && info->num_outputs > 0)
+      {
+         for (int j = 0; j < mode_count; j++)
+         {
+            if (modes[j].id == info->mode)
+            {
+               m_crtcs.push_back({ info->x, info->y, info->width, info->height, get_mode_refresh_rate(modes[j]) });
+               break;
+            }
+         }
+      }
+      free(info);
+   }
+
+   free(resources);
+}
+
+uint64_t randr_topology::poll_generation()
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   if (m_randr_available)
+   {
+      process_events_locked();
+   }
+   return m_generation;
+}
+
+double randr_topology::get_refresh_rate(xcb_window_t window)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   if (!m_randr_available)
+   {
+      return 0.0;
+   }
+
+   process_events_locked();
+   if (m_stale)
+   {
+      refresh_locked();
+   }
+
+   if (m_crtcs.empty())
+   {
+      return 0.0;
+   }
+   if (m_crtcs.size() == 1)
+   {
+      return m_crtcs[0].refresh_hz;
+   }
+
+   xcb_translate_coordinates_reply_t *origin = xcb_translate_coordinates_reply(
+      m_connection, xcb_translate_coordinates(m_connection, window, m_root, 0, 0), nullptr);
+   if (origin == nullptr)
+   {
+      return m_crtcs[0].refresh_hz;
+   }
+
+   const int32_t window_x = origin->dst_x;
+   const int32_t window_y = origin->dst_y;
+   free(origin);
+
+   for (const crtc &c : m_crtcs)
+   {
+      if (window_x >= c.x && window_x < c.x + static_cast<int32_t>(c.width) && window_y >= c.y &&
+          window_y < c.y + static_cast<int32_t>(c.height))
+      {
+         return c.refresh_hz;
+      }
+   }
+
+   /* Off every monitor, pace to the first one. */
+   return m_crtcs[0].refresh_hz;
+}
+
+} /* namespace x11 */
+} /* namespace wsi */
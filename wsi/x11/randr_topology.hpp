@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file randr_topology.hpp
+ *
+ * @brief Process wide caches of the RandR CRTC layouts, used to pace presents to the right monitor.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <xcb/xcb.h>
+
+namespace wsi
+{
+namespace x11
+{
+
+/**
+ * @brief Cached CRTC positions and refresh rates of the X display.
+ *
+ * The layout is read once with RRGetScreenResourcesCurrent, which does not probe the outputs, and read
+ * again only after RandR reports a screen or CRTC change. RandR and ConfigureNotify events are core
+ * events, so the cache owns a private connection to the display to receive them without taking events
+ * from the application's queue. It connects to the server at the other end of the application's
+ * connection, see window_visibility::get_display_name, not to $DISPLAY, which may name another server.
+ */
+class randr_topology
+{
+public:
+   /**
+    * @brief Cache of the server @p application is connected to, shared by every presenter of the process
+    *        that presents to it.
+    *
+    * @return The cache, one that reports no refresh rate when the server cannot be found.
+    */
+   static randr_topology &get_instance(xcb_connection_t *application);
+
+   ~randr_topology();
+
+   /**
+    * @brief Refresh rate of the monitor showing the origin of @p window.
+    *
+    * @return The rate in Hz, or 0 when it cannot be determined.
+    */
+   double get_refresh_rate(xcb_window_t window);
+
+   /**
+    * @brief Report moves of @p window through @ref poll_generation.
+    */
+   void watch_window(xcb_window_t window);
+
+   /**
+    * @brief Read the pending events without blocking.
+    *
+    * @return A counter that changes whenever the monitor layout changes or a watched window is moved or
+    *         resized. Presenters compare it against the value they last saw to know when to re-pace.
+    */
+   uint64_t poll_generation();
+
+private:
+   struct crtc
+   {
+      int32_t x;
+      int32_t y;
+      uint32_t width;
+      uint32_t height;
+      double refresh_hz;
+   };
+
+   /* Connects to @p display_name, or to nothing when it is nullptr. */
+   explicit randr_topology(const char *display_name);
+
+   randr_topology(const randr_topology &) = delete;
+   randr_topology &operator=(const randr_topology &) = delete;
+
+   void process_events_locked();
+   void refresh_locked();
+
+   std::mutex m_mutex;
+   std::string m_display_name;
+   xcb_connection_t *m_connection = nullptr;
+   xcb_window_t m_root = XCB_NONE;
+   uint8_t m_randr_event_base = 0;
+   bool m_randr_available = false;
+
+   std::vector<crtc> m_crtcs;
+   bool m_stale = true;
+   uint64_t m_generation = 0;
+};
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file shared_image_tracker.cpp
+ *
+ * @brief Implementation of the shared presentable image change tracker.
+ */
+
+#include "shared_image_tracker.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#include "wsi/swapchain_base.hpp"
+
+namespace wsi
+{
+namespace x11
+{
+
+static constexpr uint64_t HASH_MULTIPLIER = 0x9e3779b97f4a7c15ull;
+
+static inline uint64_t mix(uint64_t hash, uint64_t value)
+{
+   hash = (hash ^ value) * HASH_MULTIPLIER;
+   return (hash << 29) | (hash >> 35);
+}
+
+bool shared_image_tracker::init(uint32_t width, uint32_t height, uint32_t bytes_per_pixel)
+{
+   m_width = width;
+   m_height = height;
+   m_bytes_per_pixel = bytes_per_pixel;
+   m_tiles_x = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+   m_tiles_y = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+
+   try
+   {
+      /* Nothing was put yet, so every tile is found changed until marked put. */
+      m_hashes.assign(static_cast<size_t>(m_tiles_x) * m_tiles_y, 0);
+   }
+   catch (const std::bad_alloc &)
+   {
+      m_hashes.clear();
+      return false;
+   }
+   return true;
+}
+
+uint64_t shared_image_tracker::hash_tile(const char *src_base, size_t src_stride, uint32_t tile_x,
+                                         uint32_t tile_y) const
+{
+   const uint32_t x0 = tile_x * TILE_WIDTH;
+   const uint32_t y0 = tile_y * TILE_HEIGHT;
+   const size_t row_bytes = static_cast<size_t>(std::min(TILE_WIDTH, m_width - x0)) * m_bytes_per_pixel;
+   const uint32_t y_end = std::min(y0 + TILE_HEIGHT, m_height);
+
+   /* Four independent lanes, so the multiplies of consecutive words overlap. */
+   uint64_t lanes[4] = { 1, 2, 3, 4 };
+   for (uint32_t row = y0; row < y_end; row++)
+   {
+      const char *src = src_base + row * src_stride + static_cast<size_t>(x0) * m_bytes_per_pixel;
+      size_t offset = 0;
+      for (; offset + 4 * sizeof(uint64_t) <= row_bytes; offset += 4 * sizeof(uint64_t))
+      {
+         uint64_t words[4];
+         std::memcpy(words, src + offset, sizeof(words));
+         lanes[0] = mix(lanes[0], words[0]);
+         lanes[1] = mix(lanes[1], words[1]);
+         lanes[2] = mix(lanes[2], words[2]);
+         lanes[3] = mix(lanes[3], words[3]);
+      }
+      for (; offset < row_bytes; offset += sizeof(uint32_t))
+      {
+         uint32_t word;
+         std::memcpy(&word, src + offset, sizeof(word));
+         lanes[0] = mix(lanes[0], word);
+      }
+   }
+
+   /* 0 is left for tiles that were never put. */
+   const uint64_t hash = mix(mix(lanes[0], lanes[1]), mix(lanes[2], lanes[3]));
+   return hash != 0 ? hash : 1;
+}
+
+void shared_image_tracker::mark_put(const char *src_base, size_t src_stride, const VkRect2D *rects,
+                                    uint32_t rect_count)
+{
+   if (rect_count == 0)
+   {
+      for (uint32_t tile_y = 0; tile_y < m_tiles_y; tile_y++)
+      {
+         for (uint32_t tile_x = 0; tile_x < m_tiles_x; tile_x++)
+         {
+            m_hashes[tile_y * m_tiles_x + tile_x] = hash_tile(src_base, src_stride, tile_x, tile_y);
+         }
+      }
+      return;
+   }
+
+   /* Rectangles are clipped to the image by the caller. */
+   for (uint32_t i = 0; i < rect_count; i++)
+   {
+      const uint32_t x0 = static_cast<uint32_t>(rects[i].offset.x) / TILE_WIDTH;
+      const uint32_t y0 = static_cast<uint32_t>(rects[i].offset.y) / TILE_HEIGHT;
+      const uint32_t x1 = (static_cast<uint32_t>(rects[i].offset.x) + rects[i].extent.width + TILE_WIDTH - 1) /
+                          TILE_WIDTH;
+      const uint32_t y1 = (static_cast<uint32_t>(rects[i].offset.y) + rects[i].extent.height + TILE_HEIGHT - 1) /
+                          TILE_HEIGHT;
+      for (uint32_t tile_y = y0; tile_y < std::min(y1, m_tiles_y); tile_y++)
+      {
+         for (uint32_t tile_x = x0; tile_x < std::min(x1, m_tiles_x); tile_x++)
+         {
+            m_hashes[tile_y * m_tiles_x + tile_x] = hash_tile(src_base, src_stride, tile_x, tile_y);
+         }
+      }
+   }
+}
+
+bool shared_image_tracker::find_changes(const char *src_base, size_t src_stride, present_damage &damage)
+{
+   damage.rect_count = 0;
+   bool overflow = false;
+   VkRect2D bounds = {};
+   /* Run of consecutive rows of tiles with changes, in tiles. */
+   bool in_run = false;
+   uint32_t run_y0 = 0;
+   uint32_t run_x0 = 0;
+   uint32_t run_x1 = 0;
+
+   auto end_run = [&](uint32_t run_y1) {
+      const uint32_t x = run_x0 * TILE_WIDTH;
+      const uint32_t y = run_y0 * TILE_HEIGHT;
+      VkRect2D rect = {};
+      rect.offset = { static_cast<int32_t>(x), static_cast<int32_t>(y) };
+      rect.extent = { std::min(run_x1 * TILE_WIDTH, m_width) - x, std::min(run_y1 * TILE_HEIGHT, m_height) - y };
+
+      if (damage.rect_count == 0 && !overflow)
+      {
+         bounds = rect;
+      }
+      else
+      {
+         const int32_t bx1 = std::max(bounds.offset.x + static_cast<int32_t>(bounds.extent.width),
+                                      rect.offset.x + static_cast<int32_t>(rect.extent.width));
+         bounds.offset.x = std::min(bounds.offset.x, rect.offset.x);
+         bounds.extent.width = static_cast<uint32_t>(bx1 - bounds.offset.x);
+         bounds.extent.height = static_cast<uint32_t>(rect.offset.y + static_cast<int32_t>(rect.extent.height) -
+                                                      bounds.offset.y);
+      }
+
+      if (damage.rect_count < present_damage::MAX_RECTS && !overflow)
+      {
+         damage.rects[damage.rect_count++] = rect;
+      }
+      else
+      {
+         overflow = true;
+      }
+      in_run = false;
+   };
+
+   for (uint32_t tile_y = 0; tile_y < m_tiles_y; tile_y++)
+   {
+      bool row_changed = false;
+      uint32_t row_x0 = 0;
+      uint32_t row_x1 = 0;
+      for (uint32_t tile_x = 0; tile_x < m_tiles_x; tile_x++)
+      {
+         const uint64_t hash = hash_tile(src_base, src_stride, tile_x, tile_y);
+         uint64_t &stored = m_hashes[tile_y * m_tiles_x + tile_x];
+         if (hash == stored)
+         {
+            continue;
+         }
+
+         stored = hash;
+         if (!row_changed)
+         {
+            row_x0 = tile_x;
+            row_changed = true;
+         }
+         row_x1 = tile_x + 1;
+      }
+
+      if (!row_changed)
+      {
+         if (in_run)
+         {
+            end_run(tile_y);
+         }
+         continue;
+      }
+
+      if (!in_run)
+      {
+         in_run = true;
+         run_y0 = tile_y;
+         run_x0 = row_x0;
+         run_x1 = row_x1;
+      }
+      else
+      {
+         run_x0 = std::min(run_x0, row_x0);
+         run_x1 = std::max(run_x1, row_x1);
+      }
+   }
+
+   if (in_run)
+   {
+      end_run(m_tiles_y);
+   }
+
+   if (overflow)
+   {
+      damage.rects[0] = bounds;
+      damage.rect_count = 1;
+   }
+
+   return damage.rect_count != 0;
+}
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file shared_image_tracker.hpp
+ *
+ * @brief Tracks which parts of a shared presentable image changed since they were last put on the window.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace wsi
+{
+
+struct present_damage;
+
+namespace x11
+{
+
+/**
+ * @brief Finds the tiles of a shared presentable image that changed since they were put.
+ *
+ * In VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR the application renders into the image on screen without saying
+ * what changed. Each tile keeps a hash of the pixels last put from it, so a refresh only copies and puts the tiles
+ * whose hash differs. Hashing reads the image once but writes nothing, which is far cheaper than copying the whole
+ * image and having the X server read it again every refresh.
+ *
+ * Tiles are hashed before they are copied, so pixels written during the copy make the tile differ on the next
+ * refresh rather than being missed. A hash collision delays the update of a tile until it changes again.
+ */
+class shared_image_tracker
+{
+public:
+   static constexpr uint32_t TILE_WIDTH = 64;
+   static constexpr uint32_t TILE_HEIGHT = 16;
+
+   /**
+    * @brief Size the tiles for an image, forgetting what was put before.
+    *
+    * @return false when the hashes cannot be allocated.
+    */
+   bool init(uint32_t width, uint32_t height, uint32_t bytes_per_pixel);
+
+   /**
+    * @brief Whether the tiles are sized for an image of @p width by @p height.
+    */
+   bool is_sized_for(uint32_t width, uint32_t height) const
+   {
+      return !m_hashes.empty() && m_width == width && m_height == height;
+   }
+
+   /**
+    * @brief Record the tiles overlapping @p rects as put with their current pixels.
+    *
+    * @param rect_count Number of rectangles, 0 records the whole image.
+    */
+   void mark_put(const char *src_base, size_t src_stride, const VkRect2D *rects, uint32_t rect_count);
+
+   /**
+    * @brief Find the tiles that changed since they were put, and record them as put.
+    *
+    * @param[out] damage Rectangles covering the changed tiles, one per run of rows of tiles. Reduced to their
+    *                    bounding box when there are more runs than present_damage::MAX_RECTS.
+    *
+    * @return false when no tile changed.
+    */
+   bool find_changes(const char *src_base, size_t src_stride, present_damage &damage);
+
+private:
+   uint64_t hash_tile(const char *src_base, size_t src_stride, uint32_t tile_x, uint32_t tile_y) const;
+
+   uint32_t m_width = 0;
+   uint32_t m_height = 0;
+   uint32_t m_bytes_per_pixel = 0;
+   uint32_t m_tiles_x = 0;
+   uint32_t m_tiles_y = 0;
+   std::vector<uint64_t> m_hashes;
+};
+
+} /* namespace x11 */
+} /* namespace wsi */
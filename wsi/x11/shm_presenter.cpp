@@ -29,9 +29,14 @@
  */
 
 #include "shm_presenter.hpp"
+#include "randr_topology.hpp"
 #include "surface.hpp"
 #include "swapchain.hpp"
+#include "util/frame_stats.hpp"
+#include "util/helpers.hpp"
 #include "util/log.hpp"
+#include "util/trace.hpp"
+#include "util/tuning_profile.hpp"
 
 #include <sys/shm.h>
 #include <sys/ipc.h>
@@ -39,43 +44,39 @@
 #include <cstring>
 #include <algorithm>
 #include <thread>
-#include <future>
 #include <vector>
 #include <chrono>
 #include <cmath>
 #ifdef ENABLE_ARM_NEON
 #include <arm_neon.h>
 #endif
-#include <X11/Xlib.h>
-#include <X11/extensions/Xrandr.h>
-#include <xcb/sync.h>
+#include <xcb/present.h>
 
 namespace wsi
 {
 namespace x11
 {
 
-static constexpr uint32_t THREADING_PIXEL_THRESHOLD = 400 * 400;
-static constexpr uint32_t MAX_WORKER_THREADS = 8u;
+#ifdef ENABLE_ARM_NEON
 static constexpr uint32_t SIMD_VECTOR_SIZE = 4;
 static constexpr uint32_t LOOP_UNROLL_BOUNDARY = 3;
-static constexpr int SHM_PERMISSIONS = 0666;
+#endif
 static constexpr uint32_t GC_COLOR_MASK = XCB_GC_BACKGROUND | XCB_GC_FOREGROUND;
+/* Damage covering more than this share of the image is presented as a full update. */
+static constexpr uint32_t PARTIAL_UPDATE_MAX_AREA_PERCENT = 50;
 
 shm_presenter::shm_presenter()
-   : m_sync_pending(false)
-   , m_frame_interval(std::chrono::microseconds(16667))
+   : m_frame_interval(std::chrono::microseconds(16667))
    , m_refresh_rate_hz(60.0)
 {
 }
 
 shm_presenter::~shm_presenter()
 {
-   if (m_sync_pending)
-   {
-      ensure_sync_completion();
-   }
-   cleanup_fence_sync();
+   m_copy_workers.stop();
+   m_segment_ring.destroy();
+   m_scaled_ring.destroy();
+   cleanup_present_events();
 }
 
 bool shm_presenter::is_aligned(const void *ptr, size_t alignment)
@@ -93,121 +94,11 @@ bool shm_presenter::are_pointers_neon_aligned(const void *src, void *dst)
 
 double shm_presenter::get_window_refresh_rate()
 {
-   double detected_refresh_rate = 60.0;
-   bool found_refresh_rate = false;
-
-   Display *display = XOpenDisplay(nullptr);
-   if (!display)
-   {
-      WSI_LOG_WARNING("Failed to open X11 display, using 60Hz default");
-      return detected_refresh_rate;
-   }
-
-   Window root = DefaultRootWindow(display);
-
-   int event_base, error_base;
-   if (XRRQueryExtension(display, &event_base, &error_base))
-   {
-      XRRScreenResources *resources = XRRGetScreenResources(display, root);
-      if (resources)
-      {
-         int active_crtc_count = 0;
-         for (int i = 0; i < resources->ncrtc; i++)
-         {
-            XRRCrtcInfo *crtc_info = XRRGetCrtcInfo(display, resources, resources->crtcs[i]);
-            if (crtc_info && crtc_info->mode != None && crtc_info->noutput > 0)
-            {
-               active_crtc_count++;
-            }
-            if (crtc_info)
-               XRRFreeCrtcInfo(crtc_info);
-         }
-
-         bool single_screen = (active_crtc_count == 1);
-
-         int window_x = 0, window_y = 0;
-
-         if (!single_screen)
-         {
-            xcb_screen_t *screen = xcb_setup_roots_iterator(xcb_get_setup(m_connection)).data;
-            xcb_window_t root_window = screen->root;
-
-            xcb_translate_coordinates_cookie_t translate_cookie =
-               xcb_translate_coordinates(m_connection, m_window, root_window, 0, 0);
-            xcb_translate_coordinates_reply_t *translate_reply =
-               xcb_translate_coordinates_reply(m_connection, translate_cookie, nullptr);
-
-            if (translate_reply)
-            {
-               window_x = translate_reply->dst_x;
-               window_y = translate_reply->dst_y;
-               free(translate_reply);
-            }
-         }
-
-         for (int i = 0; i < resources->ncrtc; i++)
-         {
-            XRRCrtcInfo *crtc_info = XRRGetCrtcInfo(display, resources, resources->crtcs[i]);
-            if (crtc_info && crtc_info->mode != None && crtc_info->noutput > 0)
-            {
-               bool window_on_crtc = false;
-
-               if (single_screen)
-               {
-                  window_on_crtc = true;
-               }
-               else
-               {
-                  window_on_crtc = (window_x >= crtc_info->x && window_x < crtc_info->x + (int)crtc_info->width &&
-                                    window_y >= crtc_info->y && window_y < crtc_info->y + (int)crtc_info->height);
-               }
-
-               for (int j = 0; j < resources->nmode; j++)
-               {
-                  XRRModeInfo *mode = &resources->modes[j];
-                  if (mode->id == crtc_info->mode)
-                  {
-                     double refresh = (double)mode->dotClock / ((double)mode->hTotal * (double)mode->vTotal);
-
-                     if (window_on_crtc)
-                     {
-                        detected_refresh_rate = refresh;
-                        found_refresh_rate = true;
-                        break;
-                     }
-                     else if (!found_refresh_rate)
-                     {
-                        detected_refresh_rate = refresh;
-                        found_refresh_rate = true;
-                     }
-                     break;
-                  }
-               }
-
-               if (crtc_info)
-                  XRRFreeCrtcInfo(crtc_info);
-               if (found_refresh_rate && window_on_crtc)
-                  break;
-            }
-         }
-
-         XRRFreeScreenResources(resources);
-      }
-      else
-      {
-         WSI_LOG_WARNING("Failed to get XRandR screen resources");
-      }
-   }
-   else
-   {
-      WSI_LOG_WARNING("XRandR extension not available");
-   }
-
-   XCloseDisplay(display);
-
-   if (!found_refresh_rate)
+   double detected_refresh_rate = m_topology->get_refresh_rate(m_window);
+   if (detected_refresh_rate == 0.0)
    {
       WSI_LOG_WARNING("Could not detect refresh rate, using 60Hz default");
+      return 60.0;
    }
 
    // Reasonable bounds for display refresh rates
@@ -223,650 +114,887 @@ double shm_presenter::get_window_refresh_rate()
 void shm_presenter::detect_refresh_rate()
 {
    double detected_refresh_rate = get_window_refresh_rate();
-
-   m_refresh_rate_hz = detected_refresh_rate;
-   auto interval_us = static_cast<long>(1000000.0 / detected_refresh_rate);
-   m_frame_interval = std::chrono::microseconds(interval_us);
-}
-
-void shm_presenter::precompute_scaling_lut(uint32_t gpu_width, uint32_t display_width)
-{
-   if (m_last_gpu_width == gpu_width && m_last_display_width == display_width)
+   if (m_pacer.get_interval() != 0 && std::abs(detected_refresh_rate - m_refresh_rate_hz) < 0.5)
    {
       return;
    }
 
-   m_scaling_lut.reserve(display_width);
-   m_scaling_lut.resize(display_width);
-
-   for (uint32_t dst_x = 0; dst_x < display_width; dst_x++)
+   if (m_pacer.get_interval() != 0)
    {
-      uint32_t src_x = (dst_x * gpu_width) / display_width;
-      if (src_x >= gpu_width)
-         src_x = gpu_width - 1;
-      m_scaling_lut[dst_x] = src_x;
+      WSI_LOG_INFO("SHM presenter re-pacing from %.2f Hz to %.2f Hz", m_refresh_rate_hz, detected_refresh_rate);
+      /* The phase of the previous monitor means nothing on the new one. */
+      m_pacer.reset();
    }
 
-   m_last_gpu_width = gpu_width;
-   m_last_display_width = display_width;
+   m_refresh_rate_hz = detected_refresh_rate;
+   auto interval_us = static_cast<long>(1000000.0 / detected_refresh_rate);
+   m_frame_interval = std::chrono::microseconds(interval_us);
+   m_pacer.set_interval(static_cast<uint64_t>(1000000000.0 / detected_refresh_rate));
 }
 
 #ifdef ENABLE_ARM_NEON
 void shm_presenter::copy_pixels_simd(const uint32_t *src_pixels, uint32_t *dst_pixels, uint32_t src_stride_pixels,
                                      uint32_t dst_width, uint32_t height)
 {
-   if (m_scaling_lut.empty() || m_scaling_lut[dst_width - 1] == dst_width - 1)
+   for (uint32_t row = 0; row < height; row++)
    {
-      for (uint32_t row = 0; row < height; row++)
-      {
-         const uint32_t *src_row = src_pixels + (row * src_stride_pixels);
-         uint32_t *dst_row = dst_pixels + (row * dst_width);
+      const uint32_t *src_row = src_pixels + (row * src_stride_pixels);
+      uint32_t *dst_row = dst_pixels + (row * dst_width);
 
-         uint32_t x = 0;
-         bool use_aligned_simd = are_pointers_neon_aligned(&src_row[0], &dst_row[0]);
+      uint32_t x = 0;
+      bool use_aligned_simd = are_pointers_neon_aligned(&src_row[0], &dst_row[0]);
 
-         if (use_aligned_simd)
+      if (use_aligned_simd)
+      {
+         for (; x + LOOP_UNROLL_BOUNDARY < dst_width; x += SIMD_VECTOR_SIZE)
          {
-            for (; x + LOOP_UNROLL_BOUNDARY < dst_width; x += SIMD_VECTOR_SIZE)
-            {
-               uint32x4_t pixels = vld1q_u32(&src_row[x]);
-               vst1q_u32(&dst_row[x], pixels);
-            }
+            uint32x4_t pixels = vld1q_u32(&src_row[x]);
+            vst1q_u32(&dst_row[x], pixels);
          }
-         else
+      }
+      else
+      {
+         for (; x + LOOP_UNROLL_BOUNDARY < dst_width; x += SIMD_VECTOR_SIZE)
          {
-            for (; x + LOOP_UNROLL_BOUNDARY < dst_width; x += SIMD_VECTOR_SIZE)
-            {
-               uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t *>(&src_row[x]));
-               vst1q_u8(reinterpret_cast<uint8_t *>(&dst_row[x]), bytes);
-            }
+            uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t *>(&src_row[x]));
+            vst1q_u8(reinterpret_cast<uint8_t *>(&dst_row[x]), bytes);
          }
+      }
 
-         for (; x < dst_width; x++)
-         {
-            dst_row[x] = src_row[x];
-         }
+      for (; x < dst_width; x++)
+      {
+         dst_row[x] = src_row[x];
       }
    }
-   else
-   {
-      copy_pixels_scalar(src_pixels, dst_pixels, src_stride_pixels, dst_width, height);
-   }
 }
 #endif
 
-void shm_presenter::copy_pixels_scalar(const uint32_t *src_pixels, uint32_t *dst_pixels, uint32_t src_stride_pixels,
-                                       uint32_t dst_width, uint32_t height)
+/**
+ * @brief Arguments of a banded pixel copy dispatched to the copy worker pool.
+ */
+struct shm_copy_job
 {
-   uint32_t src_width = src_stride_pixels;
-
-   if (src_width == dst_width &&
-       (m_scaling_lut.empty() || (dst_width > 0 && m_scaling_lut[dst_width - 1] == dst_width - 1)))
+   shm_presenter *presenter;
+   const uint32_t *src_pixels;
+   uint32_t *dst_pixels;
+   uint32_t src_stride_pixels;
+   uint32_t dst_width;
+   uint32_t height;
+   bool uncached_source;
+   /* Bands the rows are split across, the workers past them have nothing to do. */
+   uint32_t bands;
+   /* Rows handed out round robin, 0 for one contiguous band per thread. */
+   uint32_t chunk_rows;
+};
+
+void shm_presenter::copy_band(void *context, uint32_t band_index, uint32_t /*band_count*/)
+{
+   const auto *job = static_cast<const shm_copy_job *>(context);
+   if (band_index >= job->bands)
    {
-      size_t copy_size = dst_width * sizeof(uint32_t);
-      for (uint32_t row = 0; row < height; row++)
-      {
-         const uint32_t *src_row = src_pixels + (row * src_stride_pixels);
-         uint32_t *dst_row = dst_pixels + (row * dst_width);
-
-         if (row + 1 < height)
-         {
-            __builtin_prefetch(src_row + src_stride_pixels, 0, 3);
-         }
-
-         memcpy(dst_row, src_row, copy_size);
-      }
       return;
    }
 
-   for (uint32_t row = 0; row < height; row++)
-   {
-      const uint32_t *src_row = src_pixels + (row * src_stride_pixels);
-      uint32_t *dst_row = dst_pixels + (row * dst_width);
-
-      if (row + 1 < height)
-      {
-         __builtin_prefetch(src_row + src_stride_pixels, 0, 3);
-      }
+   auto copy_rows = [job](uint32_t start_row, uint32_t end_row) {
+      job->presenter->copy_pixels_optimized_single_thread(job->src_pixels + (start_row * job->src_stride_pixels),
+                                                          job->dst_pixels + (start_row * job->dst_width),
+                                                          job->src_stride_pixels, job->dst_width,
+                                                          end_row - start_row, job->uncached_source);
+   };
 
-      uint32_t dst_x = 0;
-      for (; dst_x + LOOP_UNROLL_BOUNDARY < dst_width; dst_x += SIMD_VECTOR_SIZE)
+   if (job->chunk_rows != 0)
+   {
+      for (uint32_t row = band_index * job->chunk_rows; row < job->height; row += job->bands * job->chunk_rows)
       {
-         dst_row[dst_x] = src_row[m_scaling_lut[dst_x]];
-         dst_row[dst_x + 1] = src_row[m_scaling_lut[dst_x + 1]];
-         dst_row[dst_x + 2] = src_row[m_scaling_lut[dst_x + 2]];
-         dst_row[dst_x + 3] = src_row[m_scaling_lut[dst_x + 3]];
+         copy_rows(row, std::min(row + job->chunk_rows, job->height));
       }
+      return;
+   }
 
-      for (; dst_x < dst_width; dst_x++)
-      {
-         dst_row[dst_x] = src_row[m_scaling_lut[dst_x]];
-      }
+   uint32_t start_row = 0;
+   uint32_t end_row = 0;
+   job->presenter->m_copy_workers.get_band_rows(band_index, job->bands, job->height, start_row, end_row);
+   if (start_row < end_row)
+   {
+      copy_rows(start_row, end_row);
    }
 }
 
 void shm_presenter::copy_pixels_threaded(const uint32_t *src_pixels, uint32_t *dst_pixels, uint32_t src_stride_pixels,
-                                         uint32_t dst_width, uint32_t height)
+                                         uint32_t dst_width, uint32_t height, bool uncached_source, uint32_t bands,
+                                         uint32_t chunk_rows)
 {
    if (!src_pixels || !dst_pixels || dst_width == 0 || height == 0)
    {
       return;
    }
 
-   const uint32_t total_pixels = dst_width * height;
-
-   if (total_pixels > THREADING_PIXEL_THRESHOLD)
+   if (bands > 1 && m_copy_workers.get_band_count() > 1)
    {
-      const uint32_t num_threads = std::min(std::thread::hardware_concurrency(), MAX_WORKER_THREADS);
-      if (num_threads > 1)
+      const uint32_t job_bands = std::min(bands, m_copy_workers.get_band_count());
+      shm_copy_job job = {
+         this, src_pixels, dst_pixels, src_stride_pixels, dst_width, height, uncached_source, job_bands, chunk_rows
+      };
+      if (m_copy_workers.run(copy_band, &job))
       {
-         const uint32_t rows_per_thread = height / num_threads;
-         std::vector<std::future<void>> futures;
-         futures.reserve(num_threads);
-
-         try
-         {
-            for (uint32_t t = 0; t < num_threads; t++)
-            {
-               uint32_t start_row = t * rows_per_thread;
-               uint32_t end_row = (t == num_threads - 1) ? height : (t + 1) * rows_per_thread;
-
-               if (start_row >= height)
-                  break;
-               if (end_row > height)
-                  end_row = height;
-
-               futures.emplace_back(std::async(std::launch::async, [=]() {
-                  try
-                  {
-                     const uint32_t *thread_src = src_pixels + (start_row * src_stride_pixels);
-                     uint32_t *thread_dst = dst_pixels + (start_row * dst_width);
-                     uint32_t thread_height = end_row - start_row;
-
-                     if (thread_height > 0)
-                     {
-#ifdef ENABLE_ARM_NEON
-                        copy_pixels_simd(thread_src, thread_dst, src_stride_pixels, dst_width, thread_height);
-#else
-                        copy_pixels_scalar(thread_src, thread_dst, src_stride_pixels, dst_width, thread_height);
-#endif
-                     }
-                  }
-                  catch (const std::exception &e)
-                  {
-                     WSI_LOG_ERROR("Thread pixel copy failed with exception: %s", e.what());
-                     m_thread_error_occurred.store(true, std::memory_order_release);
-                  }
-                  catch (...)
-                  {
-                     WSI_LOG_ERROR("Thread pixel copy failed with unknown exception");
-                     m_thread_error_occurred.store(true, std::memory_order_release);
-                  }
-               }));
-            }
-
-            for (auto &future : futures)
-            {
-               if (future.valid())
-               {
-                  future.wait();
-               }
-            }
-
-            if (m_thread_error_occurred.load(std::memory_order_acquire))
-            {
-               std::lock_guard<std::mutex> lock(m_error_recovery_mutex);
-               WSI_LOG_ERROR("Thread errors detected, falling back to single-threaded processing");
-               m_thread_error_occurred.store(false, std::memory_order_release);
-               copy_pixels_optimized_single_thread(src_pixels, dst_pixels, src_stride_pixels, dst_width, height);
-            }
-         }
-         catch (...)
-         {
-            std::lock_guard<std::mutex> lock(m_error_recovery_mutex);
-            WSI_LOG_ERROR("Threading setup failed, falling back to single-threaded processing");
-            copy_pixels_optimized_single_thread(src_pixels, dst_pixels, src_stride_pixels, dst_width, height);
-         }
          return;
       }
+
+      WSI_LOG_ERROR("Copy worker failed, falling back to single-threaded processing");
    }
 
-   copy_pixels_optimized_single_thread(src_pixels, dst_pixels, src_stride_pixels, dst_width, height);
+   copy_pixels_optimized_single_thread(src_pixels, dst_pixels, src_stride_pixels, dst_width, height, uncached_source);
 }
 
 void shm_presenter::copy_pixels_optimized_single_thread(const uint32_t *src_pixels, uint32_t *dst_pixels,
-                                                        uint32_t src_stride_pixels, uint32_t dst_width, uint32_t height)
+                                                        uint32_t src_stride_pixels, uint32_t dst_width, uint32_t height,
+                                                        bool uncached_source)
 {
+   if (uncached_source)
+   {
+      m_stream_copy_kernel.copy_rows(src_pixels, dst_pixels, src_stride_pixels, dst_width, height);
+      return;
+   }
 #ifdef ENABLE_ARM_NEON
    copy_pixels_simd(src_pixels, dst_pixels, src_stride_pixels, dst_width, height);
 #else
-   copy_pixels_scalar(src_pixels, dst_pixels, src_stride_pixels, dst_width, height);
+   m_copy_kernel.copy_rows(src_pixels, dst_pixels, src_stride_pixels, dst_width, height);
 #endif
 }
 
 void shm_presenter::copy_pixels_optimized(const uint32_t *src_pixels, uint32_t *dst_pixels, uint32_t src_stride_pixels,
-                                          uint32_t dst_width, uint32_t height)
+                                          uint32_t dst_width, uint32_t height, bool uncached_source)
 {
-   if (src_stride_pixels == dst_width && m_scaling_lut.empty())
+   copy_strategy strategy;
+   if (m_copy_autotune)
    {
-      const size_t copy_size = dst_width * height * sizeof(uint32_t);
-      std::memcpy(dst_pixels, src_pixels, copy_size);
-      return;
+      const copy_shape shape = { dst_width, height, src_stride_pixels, uncached_source };
+      strategy = m_copy_autotuner.select(shape, m_copy_workers.get_band_count());
+   }
+   else if (src_stride_pixels == dst_width && !uncached_source)
+   {
+      /* memcpy reads uncached memory no faster than the row kernels, which use streaming loads for it. */
+      strategy.kind = copy_strategy::method::memcpy_frame;
+   }
+   else if (dst_width * height > m_threading_pixel_threshold)
+   {
+      strategy.kind = copy_strategy::method::threaded;
+      strategy.bands = m_copy_workers.get_band_count();
    }
 
-   copy_pixels_threaded(src_pixels, dst_pixels, src_stride_pixels, dst_width, height);
+   const uint64_t start_ns = m_copy_autotune ? util::frame_stats::now_ns() : 0;
+   switch (strategy.kind)
+   {
+   case copy_strategy::method::memcpy_frame:
+      std::memcpy(dst_pixels, src_pixels, static_cast<size_t>(dst_width) * height * sizeof(uint32_t));
+      break;
+   case copy_strategy::method::kernel:
+      copy_pixels_optimized_single_thread(src_pixels, dst_pixels, src_stride_pixels, dst_width, height,
+                                          uncached_source);
+      break;
+   case copy_strategy::method::threaded:
+      copy_pixels_threaded(src_pixels, dst_pixels, src_stride_pixels, dst_width, height, uncached_source,
+                           strategy.bands, strategy.chunk_rows);
+      break;
+   }
+
+   if (m_copy_autotune)
+   {
+      m_copy_autotuner.record(util::frame_stats::now_ns() - start_ns);
+   }
 }
 
-void shm_presenter::start_async_sync()
+/**
+ * @brief Arguments of a banded pixel format conversion dispatched to the copy worker pool.
+ */
+struct shm_convert_job
+{
+   const copy_worker_pool *workers;
+   convert_rows_function convert_rows;
+   const uint8_t *src;
+   size_t src_stride;
+   uint8_t *dst;
+   size_t dst_stride;
+   uint32_t width;
+   uint32_t height;
+};
+
+void shm_presenter::convert_band(void *context, uint32_t band_index, uint32_t band_count)
 {
-   if (m_sync_pending)
+   const auto *job = static_cast<const shm_convert_job *>(context);
+
+   uint32_t start_row = 0;
+   uint32_t end_row = 0;
+   job->workers->get_band_rows(band_index, band_count, job->height, start_row, end_row);
+   if (start_row >= end_row)
    {
       return;
    }
 
-   m_pending_sync_cookie = xcb_get_geometry(m_connection, m_window);
-   m_sync_pending = true;
+   job->convert_rows(job->src + start_row * job->src_stride, job->src_stride, job->dst + start_row * job->dst_stride,
+                     job->dst_stride, job->width, end_row - start_row);
 }
 
-bool shm_presenter::check_pending_sync()
+void shm_presenter::convert_pixels(const char *src_base, size_t src_stride, char *dst_base, size_t dst_stride,
+                                   uint32_t width, uint32_t height, const VkRect2D *rects, uint32_t rect_count)
 {
-   if (!m_sync_pending)
+   const auto *src = reinterpret_cast<const uint8_t *>(src_base);
+   auto *dst = reinterpret_cast<uint8_t *>(dst_base);
+
+   if (rect_count > 0)
    {
-      return true;
+      constexpr size_t src_bytes_per_pixel = 4;
+      for (uint32_t i = 0; i < rect_count; i++)
+      {
+         const size_t x = rects[i].offset.x;
+         const size_t y = rects[i].offset.y;
+         m_converter.convert_rows(src + y * src_stride + x * src_bytes_per_pixel, src_stride,
+                                  dst + y * dst_stride + x * m_converter.dst_bytes_per_pixel, dst_stride,
+                                  rects[i].extent.width, rects[i].extent.height);
+      }
+      return;
    }
 
-   xcb_generic_error_t *error = nullptr;
-   xcb_get_geometry_reply_t *sync_reply = xcb_get_geometry_reply(m_connection, m_pending_sync_cookie, &error);
-
-   if (sync_reply)
+   if (width * height > m_threading_pixel_threshold && m_copy_workers.get_band_count() > 1)
    {
-      free(sync_reply);
-      m_sync_pending = false;
-      return true;
+      shm_convert_job job = {
+         &m_copy_workers, m_converter.convert_rows, src, src_stride, dst, dst_stride, width, height
+      };
+      if (m_copy_workers.run(convert_band, &job))
+      {
+         return;
+      }
+
+      WSI_LOG_ERROR("Copy worker failed, falling back to single-threaded conversion");
    }
-   else if (error)
+
+   m_converter.convert_rows(src, src_stride, dst, dst_stride, width, height);
+}
+
+void shm_presenter::cache_x11_formats()
+{
+   const xcb_setup_t *setup = xcb_get_setup(m_connection);
+   xcb_format_iterator_t format_iter = xcb_setup_pixmap_formats_iterator(setup);
+
+   for (; format_iter.rem; xcb_format_next(&format_iter))
    {
-      free(error);
-      m_sync_pending = false;
-      return false;
+      xcb_format_t *format = format_iter.data;
+      m_depth_to_bpp_cache[format->depth] = format->bits_per_pixel;
    }
-
-   return false;
 }
 
-void shm_presenter::ensure_sync_completion()
+uint8_t shm_presenter::get_bits_per_pixel_for_depth(int depth)
 {
-   if (!m_sync_pending)
+   auto it = m_depth_to_bpp_cache.find(depth);
+   if (it != m_depth_to_bpp_cache.end())
    {
-      return;
+      return it->second;
    }
 
-   xcb_generic_error_t *error = nullptr;
-   xcb_get_geometry_reply_t *sync_reply = xcb_get_geometry_reply(m_connection, m_pending_sync_cookie, &error);
+   return (depth == 24) ? 32 : depth;
+}
 
-   if (sync_reply)
+VkResult shm_presenter::set_image_format(VkFormat format, int depth)
+{
+   const shm_pixel_format pixel_format = get_shm_pixel_format(depth, get_bits_per_pixel_for_depth(depth));
+   if (!select_pixel_converter(format, pixel_format, &m_converter))
    {
-      free(sync_reply);
+      WSI_LOG_ERROR("SHM presenter cannot convert format %d to a depth %d visual", static_cast<int>(format), depth);
+      return VK_ERROR_FORMAT_NOT_SUPPORTED;
    }
-   else if (error)
+
+   if (m_converter.convert_rows != nullptr)
    {
-      free(error);
+      WSI_LOG_INFO("SHM presenter converting to %s", m_converter.name);
    }
+   return VK_SUCCESS;
+}
 
-   m_sync_pending = false;
+bool shm_presenter::needs_conversion() const
+{
+   return m_converter.convert_rows != nullptr;
 }
 
-bool shm_presenter::init_fence_sync()
+VkResult shm_presenter::init(xcb_connection_t *connection, xcb_window_t window, surface *wsi_surface,
+                             std::shared_ptr<shm_segment_pool> segment_pool)
 {
-   if (m_fence_available)
+   m_connection = connection;
+   m_window = window;
+   m_wsi_surface = wsi_surface;
+
+   if (segment_pool == nullptr)
    {
-      return true;
+      try
+      {
+         segment_pool = create_segment_pool();
+      }
+      catch (const std::bad_alloc &)
+      {
+         return VK_ERROR_OUT_OF_HOST_MEMORY;
+      }
    }
+   m_segment_pool = std::move(segment_pool);
 
-   const xcb_query_extension_reply_t *sync_ext = xcb_get_extension_data(m_connection, &xcb_sync_id);
-   if (!sync_ext || !sync_ext->present)
+   if (m_segment_pool->is_local_only())
    {
-      WSI_LOG_WARNING("XSync extension not available, falling back to geometry-based sync");
-      return false;
+      if (!m_put_stream.init(m_connection))
+      {
+         return VK_ERROR_OUT_OF_HOST_MEMORY;
+      }
+      WSI_LOG_WARNING("MIT-SHM is unavailable, presenting with PutImage requests");
    }
 
-   m_presentation_fence = xcb_generate_id(m_connection);
-   xcb_void_cookie_t fence_cookie = xcb_sync_create_fence_checked(m_connection, m_window, m_presentation_fence, 0);
+   m_topology = &randr_topology::get_instance(m_connection);
+   m_topology->watch_window(m_window);
+   m_topology_generation = m_topology->poll_generation();
+   detect_refresh_rate();
+
+   cache_x11_formats();
 
-   xcb_generic_error_t *fence_error = xcb_request_check(m_connection, fence_cookie);
-   if (fence_error)
+   m_copy_kernel = select_copy_kernel();
+   m_stream_copy_kernel = select_streaming_copy_kernel();
+   WSI_LOG_INFO("SHM presenter using %s copy kernel, %s for uncached memory", m_copy_kernel.name,
+                m_stream_copy_kernel.name);
+
+   /* Frames too small to be worth splitting, and the number of bands, come from the tuning profile. */
+   const util::tuning_profile &profile = util::tuning_profile::get();
+   m_threading_pixel_threshold = profile.x11_threading_pixel_threshold;
+   m_copy_autotune = profile.x11_copy_autotune != 0;
+   m_skip_unchanged = profile.x11_skip_unchanged != 0;
+   const uint32_t band_count = std::min(std::thread::hardware_concurrency(), profile.x11_max_copy_threads);
+   if (band_count > 1 && !m_copy_workers.start(band_count - 1))
    {
-      WSI_LOG_WARNING("Failed to create XSync fence: error %d, falling back to geometry-based sync",
-                      fence_error->error_code);
-      free(fence_error);
-      if (m_presentation_fence != XCB_NONE)
-      {
-         m_presentation_fence = XCB_NONE;
-      }
-      return false;
+      WSI_LOG_WARNING("SHM pixel copies will run on the presenting thread only");
    }
 
-   int fence_flush_result = xcb_flush(m_connection);
-   if (fence_flush_result <= 0)
+   VkResult result = create_graphics_context();
+   if (result != VK_SUCCESS)
+   {
+      WSI_LOG_ERROR("Failed to create graphics context for SHM presentation");
+      return result;
+   }
+
+   if (!init_present_events())
    {
-      WSI_LOG_ERROR("SHM presenter xcb_flush failed: result=%d", fence_flush_result);
+      WSI_LOG_INFO("Present extension unavailable, SHM frame pacing is not locked to vblank");
    }
 
-   xcb_get_input_focus_cookie_t sync_cookie = xcb_get_input_focus(m_connection);
-   xcb_get_input_focus_reply_t *sync_reply = xcb_get_input_focus_reply(m_connection, sync_cookie, nullptr);
+   return VK_SUCCESS;
+}
 
-   if (sync_reply)
+std::shared_ptr<shm_segment_pool> shm_presenter::create_segment_pool()
+{
+   if (!m_wsi_surface->has_shm())
    {
-      free(sync_reply);
-      m_fence_available = true;
-      return true;
+      return std::make_shared<shm_segment_pool>(m_connection, false, true);
    }
-   else
+
+   /* Forwarded and remote servers advertise MIT-SHM but cannot attach the segments of this machine. The segment
+    * stays in the pool for the first images to reuse. */
+   auto pool = std::make_shared<shm_segment_pool>(m_connection, m_wsi_surface->has_shm_fd_passing(), false);
+   shm_segment probe;
+   if (pool->acquire(1, 1, &probe) != 1)
+   {
+      return std::make_shared<shm_segment_pool>(m_connection, false, true);
+   }
+   pool->release(&probe, 1);
+   return pool;
+}
+
+VkResult shm_presenter::create_image_resources(x11_image_data *image_data, uint32_t width, uint32_t height, int depth)
+{
+   image_data->width = width;
+   image_data->height = height;
+   image_data->depth = depth;
+
+   uint8_t bits_per_pixel = get_bits_per_pixel_for_depth(depth);
+   image_data->stride = width * (bits_per_pixel / 8);
+   image_data->shm_size = static_cast<size_t>(image_data->stride) * height;
+
+   /* Copied images do not own a segment, every present takes the next one of the presenter's ring. */
+   if (m_segment_ring.get_count() == 0 || m_segment_ring.get_segment_size() < image_data->shm_size)
    {
-      WSI_LOG_WARNING("Failed to synchronize XSync fence setup, falling back to geometry-based sync");
-      if (m_presentation_fence != XCB_NONE)
+      VkResult result =
+         m_segment_ring.init(m_segment_pool, image_data->shm_size, shm_segment_ring::get_configured_count());
+      if (result != VK_SUCCESS)
       {
-         xcb_sync_destroy_fence(m_connection, m_presentation_fence);
-         m_presentation_fence = XCB_NONE;
+         return result;
       }
-      return false;
+      WSI_LOG_INFO("SHM presenter using a ring of %u segments", m_segment_ring.get_count());
    }
+
+   return VK_SUCCESS;
 }
 
-void shm_presenter::cleanup_fence_sync()
+VkResult shm_presenter::create_host_import_resources(x11_image_data *image_data, uint32_t width, uint32_t height,
+                                                     int depth, size_t size)
 {
-   if (m_presentation_fence != XCB_NONE)
+   image_data->width = width;
+   image_data->height = height;
+   image_data->depth = depth;
+   image_data->shm_size = size;
+
+   /* shmat() and mmap() return page aligned addresses, which satisfies minImportedHostPointerAlignment on every
+    * known driver.
+    * The image does not use the segment ring: it is the only copy of the frame. */
+   shm_segment segment;
+   if (m_segment_pool->acquire(size, 1, &segment) != 1)
    {
-      xcb_sync_destroy_fence(m_connection, m_presentation_fence);
-      m_presentation_fence = XCB_NONE;
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
    }
-   m_fence_available = false;
+
+   image_data->shm_seg = segment.shm_seg;
+   image_data->shm_id = segment.shm_id;
+   image_data->shm_addr = segment.shm_addr;
+   image_data->shm_segment_size = segment.size;
+   image_data->shm_imported = true;
+   return VK_SUCCESS;
 }
 
-void shm_presenter::wait_for_presentation_fence()
+/**
+ * @brief Clip the damage rectangles to the image.
+ *
+ * @return Number of rectangles written to @p clipped, or 0 if the whole image should be updated.
+ */
+static uint32_t clip_damage(const present_damage &damage, uint32_t width, uint32_t height,
+                            std::array<VkRect2D, present_damage::MAX_RECTS> &clipped)
 {
-   if (!m_fence_available || m_presentation_fence == XCB_NONE)
+   uint64_t damaged_area = 0;
+   uint32_t count = 0;
+   for (uint32_t i = 0; i < damage.rect_count; i++)
    {
-      return;
+      const VkRect2D &rect = damage.rects[i];
+      const int64_t x0 = std::max<int64_t>(rect.offset.x, 0);
+      const int64_t y0 = std::max<int64_t>(rect.offset.y, 0);
+      const int64_t x1 = std::min<int64_t>(static_cast<int64_t>(rect.offset.x) + rect.extent.width, width);
+      const int64_t y1 = std::min<int64_t>(static_cast<int64_t>(rect.offset.y) + rect.extent.height, height);
+      if (x1 <= x0 || y1 <= y0)
+      {
+         continue;
+      }
+
+      clipped[count].offset = { static_cast<int32_t>(x0), static_cast<int32_t>(y0) };
+      clipped[count].extent = { static_cast<uint32_t>(x1 - x0), static_cast<uint32_t>(y1 - y0) };
+      damaged_area += static_cast<uint64_t>(clipped[count].extent.width) * clipped[count].extent.height;
+      count++;
    }
 
-   xcb_sync_await_fence(m_connection, 1, &m_presentation_fence);
-   int flush_result = xcb_flush(m_connection);
-   if (flush_result <= 0)
+   /* Overlapping rectangles are counted twice, which only makes the full update more likely. */
+   const uint64_t full_area = static_cast<uint64_t>(width) * height;
+   if (damaged_area * 100 >= full_area * PARTIAL_UPDATE_MAX_AREA_PERCENT)
    {
-      WSI_LOG_ERROR("SHM presenter xcb_flush failed: result=%d", flush_result);
+      return 0;
    }
-   xcb_sync_reset_fence(m_connection, m_presentation_fence);
-   int flush_result2 = xcb_flush(m_connection);
-   if (flush_result2 <= 0)
+
+   return count;
+}
+
+static void copy_damage(const char *src_base, char *dst_base, size_t src_stride, size_t dst_stride,
+                        size_t bytes_per_pixel, const VkRect2D *rects, uint32_t rect_count)
+{
+   for (uint32_t i = 0; i < rect_count; i++)
    {
-      WSI_LOG_ERROR("SHM presenter xcb_flush failed: result=%d", flush_result2);
+      const size_t x_offset = rects[i].offset.x * bytes_per_pixel;
+      const size_t span = rects[i].extent.width * bytes_per_pixel;
+      const uint32_t y_end = rects[i].offset.y + rects[i].extent.height;
+      for (uint32_t row = rects[i].offset.y; row < y_end; row++)
+      {
+         std::memcpy(dst_base + row * dst_stride + x_offset, src_base + row * src_stride + x_offset, span);
+      }
    }
 }
 
-void shm_presenter::trigger_presentation_fence()
+void shm_presenter::put_image(const x11_image_data *image_data, const shm_segment &segment, uint32_t total_width,
+                              uint32_t offset, const VkRect2D *rects, uint32_t rect_count)
 {
-   if (!m_fence_available || m_presentation_fence == XCB_NONE)
+   if (m_segment_pool->is_local_only())
    {
+      const uint8_t bits_per_pixel = get_bits_per_pixel_for_depth(image_data->depth);
+      const char *base = static_cast<const char *>(segment.shm_addr) + offset;
+      const size_t stride = static_cast<size_t>(total_width) * (bits_per_pixel / 8);
+      const VkRect2D full = { { 0, 0 }, { image_data->width, image_data->height } };
+      for (uint32_t i = 0; i < std::max(rect_count, 1u); i++)
+      {
+         m_put_stream.put(m_window, m_gc, static_cast<uint8_t>(image_data->depth), bits_per_pixel, base, stride,
+                          rect_count == 0 ? full : rects[i]);
+      }
       return;
    }
 
-   xcb_sync_trigger_fence(m_connection, m_presentation_fence);
-   int trigger_flush_result = xcb_flush(m_connection);
-   if (trigger_flush_result <= 0)
+   if (rect_count == 0)
    {
-      WSI_LOG_ERROR("SHM presenter xcb_flush failed: result=%d", trigger_flush_result);
+      xcb_shm_put_image(m_connection, m_window, m_gc, total_width, image_data->height, 0, 0, image_data->width,
+                        image_data->height, 0, 0, image_data->depth, XCB_IMAGE_FORMAT_Z_PIXMAP, 0, segment.shm_seg,
+                        offset);
+      return;
+   }
+
+   for (uint32_t i = 0; i < rect_count; i++)
+   {
+      const auto x = static_cast<uint16_t>(rects[i].offset.x);
+      const auto y = static_cast<uint16_t>(rects[i].offset.y);
+      const auto w = static_cast<uint16_t>(rects[i].extent.width);
+      const auto h = static_cast<uint16_t>(rects[i].extent.height);
+      xcb_shm_put_image(m_connection, m_window, m_gc, total_width, image_data->height, x, y, w, h, x, y,
+                        image_data->depth, XCB_IMAGE_FORMAT_Z_PIXMAP, 0, segment.shm_seg, offset);
    }
 }
 
-void shm_presenter::cache_x11_formats()
+VkResult shm_presenter::present_image(x11_image_data *image_data, uint32_t /*serial*/, const present_damage &damage)
 {
-   const xcb_setup_t *setup = xcb_get_setup(m_connection);
-   xcb_format_iterator_t format_iter = xcb_setup_pixmap_formats_iterator(setup);
+   WSI_TRACE_SCOPE("shm_copy");
+   /* The first frame has to fill the whole window, whatever the application says changed. */
+   std::array<VkRect2D, present_damage::MAX_RECTS> damage_rects;
+   uint32_t damage_rect_count =
+      m_first_frame ? 0 : clip_damage(damage, image_data->width, image_data->height, damage_rects);
 
-   for (; format_iter.rem; xcb_format_next(&format_iter))
+   const bool first_frame = m_first_frame;
+   m_first_frame = false;
+
+   /* The application said nothing changed, the window already shows the frame. */
+   if (damage.unchanged && !first_frame)
    {
-      xcb_format_t *format = format_iter.data;
-      m_depth_to_bpp_cache[format->depth] = format->bits_per_pixel;
+      process_present_events();
+      m_pacer.wait_for_next_deadline();
+      return VK_SUCCESS;
    }
-}
 
-uint8_t shm_presenter::get_bits_per_pixel_for_depth(int depth)
-{
-   auto it = m_depth_to_bpp_cache.find(depth);
-   if (it != m_depth_to_bpp_cache.end())
+   /* Over PutImage every byte crosses the connection, so frames without damage only send the tiles that differ
+    * from what was put before. With x11_skip_unchanged frames put through MIT-SHM do the same, hashing a frame
+    * being cheaper than copying it and having the X server read it. */
+   const bool hash_frames = m_segment_pool->is_local_only() || m_skip_unchanged;
+   const bool put_changes_only = hash_frames && !first_frame && damage_rect_count == 0;
+   if (m_track_changes || hash_frames)
    {
-      return it->second;
+      /* Hashed before the copy, see shared_image_tracker. */
+      const char *src_base = nullptr;
+      size_t source_stride = 0;
+      TRY(prepare_change_tracker(image_data, &src_base, &source_stride));
+      if (!put_changes_only)
+      {
+         m_change_tracker.mark_put(src_base, source_stride, damage_rects.data(), damage_rect_count);
+      }
+      else
+      {
+         present_damage changes;
+         if (!m_change_tracker.find_changes(src_base, source_stride, changes))
+         {
+            process_present_events();
+            m_pacer.wait_for_next_deadline();
+            return VK_SUCCESS;
+         }
+         damage_rect_count = clip_damage(changes, image_data->width, image_data->height, damage_rects);
+      }
    }
 
-   return (depth == 24) ? 32 : depth;
+   return put_frame(image_data, damage_rects.data(), damage_rect_count);
 }
 
-VkResult shm_presenter::init(xcb_connection_t *connection, xcb_window_t window, surface *wsi_surface)
+VkResult shm_presenter::refresh_image(x11_image_data *image_data)
 {
-   m_connection = connection;
-   m_window = window;
-   m_wsi_surface = wsi_surface;
-
-   detect_refresh_rate();
+   WSI_TRACE_SCOPE("shm_refresh");
+   const char *src_base = nullptr;
+   size_t source_stride = 0;
+   TRY(prepare_change_tracker(image_data, &src_base, &source_stride));
 
-   cache_x11_formats();
-
-   VkResult result = create_graphics_context();
-   if (result != VK_SUCCESS)
+   present_damage changes;
+   if (!m_change_tracker.find_changes(src_base, source_stride, changes))
    {
-      WSI_LOG_ERROR("Failed to create graphics context for SHM presentation");
-      return result;
+      /* Nothing to put, only keep refreshing at the display rate. */
+      process_present_events();
+      m_pacer.wait_for_next_deadline();
+      return VK_SUCCESS;
    }
 
-   init_fence_sync();
-
-   return VK_SUCCESS;
+   std::array<VkRect2D, present_damage::MAX_RECTS> damage_rects;
+   const uint32_t damage_rect_count = clip_damage(changes, image_data->width, image_data->height, damage_rects);
+   return put_frame(image_data, damage_rects.data(), damage_rect_count);
 }
 
-VkResult shm_presenter::create_image_resources(x11_image_data *image_data, uint32_t width, uint32_t height, int depth)
+VkResult shm_presenter::prepare_change_tracker(x11_image_data *image_data, const char **src_base,
+                                               size_t *src_stride)
 {
-   image_data->width = width;
-   image_data->height = height;
-   image_data->depth = depth;
-
-   uint8_t bits_per_pixel = (depth == 24) ? 32 : depth;
-   image_data->stride = width * (bits_per_pixel / 8);
-
-   size_t shm_size = image_data->stride * height;
-   image_data->shm_size = shm_size;
-
-   image_data->shm_id = shmget(IPC_PRIVATE, shm_size, IPC_CREAT | SHM_PERMISSIONS);
-   if (image_data->shm_id < 0)
+   constexpr uint32_t bytes_per_pixel = 4;
+   if (!m_change_tracker.is_sized_for(image_data->width, image_data->height) &&
+       !m_change_tracker.init(image_data->width, image_data->height, bytes_per_pixel))
    {
-      WSI_LOG_ERROR("Failed to create shared memory segment of size %zu", shm_size);
       return VK_ERROR_OUT_OF_HOST_MEMORY;
    }
+   return get_source_pixels(image_data, 0, image_data->height, src_base, src_stride);
+}
 
-   image_data->shm_addr = shmat(image_data->shm_id, nullptr, 0);
-   if (image_data->shm_addr == (void *)-1)
+VkResult shm_presenter::put_frame(x11_image_data *image_data, const VkRect2D *damage_rects,
+                                  uint32_t damage_rect_count)
+{
+   if (m_present_scaling != 0 && m_converter.convert_rows == nullptr)
    {
-      WSI_LOG_ERROR("Failed to attach shared memory segment");
-      shmctl(image_data->shm_id, IPC_RMID, nullptr);
-      image_data->shm_id = -1;
-      return VK_ERROR_OUT_OF_HOST_MEMORY;
+      uint32_t window_width = 0;
+      uint32_t window_height = 0;
+      if (m_wsi_surface->get_size_async(&window_width, &window_height) &&
+          (window_width != image_data->width || window_height != image_data->height))
+      {
+         return present_scaled(image_data, window_width, window_height);
+      }
    }
 
-   image_data->shm_seg = xcb_generate_id(m_connection);
-   xcb_shm_attach(m_connection, image_data->shm_seg, image_data->shm_id, 0);
-
-   image_data->shm_id_alt = shmget(IPC_PRIVATE, shm_size, IPC_CREAT | SHM_PERMISSIONS);
-   if (image_data->shm_id_alt < 0)
+   /* Only the damaged rows are read, and so need to be made visible to the CPU. */
+   uint32_t first_row = 0;
+   uint32_t end_row = damage_rect_count > 0 ? 0 : image_data->height;
+   for (uint32_t i = 0; i < damage_rect_count; i++)
    {
-      WSI_LOG_ERROR("Failed to create alternate shared memory segment");
+      const uint32_t rect_top = static_cast<uint32_t>(damage_rects[i].offset.y);
+      first_row = i == 0 ? rect_top : std::min(first_row, rect_top);
+      end_row = std::max(end_row, rect_top + damage_rects[i].extent.height);
    }
-   else
+
+   if (image_data->shm_imported)
    {
-      image_data->shm_addr_alt = shmat(image_data->shm_id_alt, nullptr, 0);
-      if (image_data->shm_addr_alt == (void *)-1)
-      {
-         WSI_LOG_ERROR("Failed to attach alternate shared memory segment");
-         shmctl(image_data->shm_id_alt, IPC_RMID, nullptr);
-         image_data->shm_id_alt = -1;
-         image_data->shm_addr_alt = nullptr;
-      }
-      else
+      /* The GPU rendered straight into the segment, hand it to the server as is. */
+      const auto &vulkan_layout = image_data->external_mem.get_host_layout();
+      if ((image_data->external_mem.get_host_memory_properties() & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0 &&
+          end_row > first_row)
       {
-         image_data->shm_seg_alt = xcb_generate_id(m_connection);
-         xcb_shm_attach(m_connection, image_data->shm_seg_alt, image_data->shm_id_alt, 0);
+         /* The server reads the segment through the CPU caches, which may still hold stale lines. */
+         void *mapped_memory = nullptr;
+         TRY_LOG(image_data->external_mem.map_host_memory(&mapped_memory), "Failed to map the imported segment");
+         const VkDeviceSize first_byte = vulkan_layout.offset + first_row * vulkan_layout.rowPitch;
+         const VkDeviceSize byte_count = (end_row - first_row) * vulkan_layout.rowPitch;
+         TRY_LOG(image_data->external_mem.invalidate_host_memory(first_byte, byte_count),
+                 "Failed to invalidate the imported segment");
       }
+      const uint32_t bytes_per_pixel = get_bits_per_pixel_for_depth(image_data->depth) / 8;
+      const uint32_t total_width = static_cast<uint32_t>(vulkan_layout.rowPitch / bytes_per_pixel);
+
+      shm_segment segment;
+      segment.shm_seg = image_data->shm_seg;
+      segment.shm_addr = image_data->shm_addr;
+      put_image(image_data, segment, total_width, static_cast<uint32_t>(vulkan_layout.offset), damage_rects,
+                damage_rect_count);
+
+      /* PutImage requests carry the pixels themselves, the server never reads the segment afterwards. */
+      return finish_present(!m_segment_pool->is_local_only());
    }
 
-   int create_resources_flush_result = xcb_flush(m_connection);
-   if (create_resources_flush_result <= 0)
+   const char *src_base = nullptr;
+   size_t source_stride = 0;
+   TRY(get_source_pixels(image_data, first_row, end_row - first_row, &src_base, &source_stride));
+   if (image_data->shm_size > m_segment_ring.get_segment_size())
    {
-      WSI_LOG_ERROR("SHM presenter xcb_flush failed: result=%d", create_resources_flush_result);
+      return VK_ERROR_UNKNOWN;
    }
 
-   xcb_get_input_focus_cookie_t sync_cookie = xcb_get_input_focus(m_connection);
-   xcb_get_input_focus_reply_t *sync_reply = xcb_get_input_focus_reply(m_connection, sync_cookie, nullptr);
-   if (sync_reply)
+   /* Only waits for the put that used this segment get_count() frames ago, so filling it overlaps the X server
+    * reading the frames in between. */
+   shm_segment_ring::segment &segment = m_segment_ring.acquire();
+
+   const size_t dest_stride = image_data->stride;
+   const size_t bytes_per_pixel = dest_stride / image_data->width;
+
+   char *dst_base = static_cast<char *>(segment.shm_addr);
+
+   if (m_converter.convert_rows != nullptr)
    {
-      free(sync_reply);
+      convert_pixels(src_base, source_stride, dst_base, dest_stride, image_data->width, image_data->height,
+                     damage_rects, damage_rect_count);
    }
-
-   shmctl(image_data->shm_id, IPC_RMID, nullptr);
-   if (image_data->shm_id_alt >= 0)
+   else if (damage_rect_count > 0)
    {
-      shmctl(image_data->shm_id_alt, IPC_RMID, nullptr);
+      /* Only the damaged spans are sent below, so the rest of the segment may stay stale. */
+      copy_damage(src_base, dst_base, source_stride, dest_stride, bytes_per_pixel, damage_rects, damage_rect_count);
+   }
+   else if (bytes_per_pixel == 4)
+   {
+      copy_pixels_optimized(reinterpret_cast<const uint32_t *>(src_base), reinterpret_cast<uint32_t *>(dst_base),
+                            static_cast<uint32_t>(source_stride / bytes_per_pixel), image_data->width,
+                            image_data->height, is_source_uncached(image_data));
+   }
+   else
+   {
+      const size_t copy_size = std::min(source_stride, dest_stride);
+      for (uint32_t row = 0; row < image_data->height; row++)
+      {
+         std::memcpy(dst_base + row * dest_stride, src_base + row * source_stride, copy_size);
+      }
    }
 
-   return VK_SUCCESS;
+   put_image(image_data, segment, image_data->width, 0, damage_rects, damage_rect_count);
+   m_segment_ring.mark_in_flight(segment);
+
+   return finish_present(false);
 }
 
+void shm_presenter::set_present_scaling(VkPresentScalingFlagsEXT scaling, VkPresentGravityFlagsEXT gravity_x,
+                                        VkPresentGravityFlagsEXT gravity_y)
+{
+   m_present_scaling = scaling;
+   m_present_gravity_x = gravity_x;
+   m_present_gravity_y = gravity_y;
+}
+
+/**
+ * @brief Arguments of a banded scale dispatched to the copy worker pool.
+ */
+struct shm_scale_job
+{
+   const copy_worker_pool *workers;
+   const image_scaler *scaler;
+   const uint32_t *src_pixels;
+   uint32_t src_stride_pixels;
+   uint32_t *dst_pixels;
+   uint32_t dst_stride_pixels;
+};
+
+void shm_presenter::scale_band(void *context, uint32_t band_index, uint32_t band_count)
+{
+   const auto *job = static_cast<const shm_scale_job *>(context);
 
+   uint32_t start_row = 0;
+   uint32_t end_row = 0;
+   job->workers->get_band_rows(band_index, band_count, job->scaler->get_dst_height(), start_row, end_row);
 
+   job->scaler->scale_rows(job->src_pixels, job->src_stride_pixels, job->dst_pixels, job->dst_stride_pixels,
+                           start_row, end_row);
+}
 
-VkResult shm_presenter::present_image(x11_image_data *image_data, uint32_t /*serial*/)
+bool shm_presenter::ensure_scaled_target(uint32_t width, uint32_t height, const scale_layout &layout)
 {
-
-   if (m_fence_available && !m_first_frame)
+   if (m_scaled_ring.get_count() != 0 && m_scaled_width == width && m_scaled_height == height)
    {
-      wait_for_presentation_fence();
-   }
-   else if (!m_fence_available)
-   {
-      if (m_sync_pending)
+      if (m_scaled_layout != layout)
       {
-         ensure_sync_completion();
+         /* Clear the bars left uncovered by the new layout. */
+         m_scaled_ring.clear();
+         m_scaled_layout = layout;
       }
+      return true;
    }
-   m_first_frame = false;
 
-   int present_flush_result = xcb_flush(m_connection);
-   if (present_flush_result <= 0)
+   const size_t size = static_cast<size_t>(width) * height * sizeof(uint32_t);
+   if (m_scaled_ring.init(m_segment_pool, size, shm_segment_ring::MIN_SEGMENTS) != VK_SUCCESS)
    {
-      WSI_LOG_ERROR("SHM presenter xcb_flush failed: result=%d", present_flush_result);
+      WSI_LOG_ERROR("Failed to create scaling segments of size %zu", size);
+      return false;
    }
+   /* Pooled segments hold old frames, the bars must start out black. */
+   m_scaled_ring.clear();
 
-   image_data->use_alt_buffer = !image_data->use_alt_buffer;
-   xcb_shm_seg_t active_seg =
-      image_data->use_alt_buffer && image_data->shm_seg_alt != XCB_NONE ? image_data->shm_seg_alt : image_data->shm_seg;
-   void *active_addr = image_data->use_alt_buffer && image_data->shm_addr_alt != nullptr ? image_data->shm_addr_alt :
-                                                                                           image_data->shm_addr;
+   m_scaled_width = width;
+   m_scaled_height = height;
+   m_scaled_layout = layout;
+   return true;
+}
 
-   if (active_addr && image_data->shm_size > 0)
+VkResult shm_presenter::get_source_pixels(x11_image_data *image_data, uint32_t first_row, uint32_t row_count,
+                                          const char **src_base, size_t *src_stride)
+{
+   const auto &vulkan_layout = image_data->external_mem.get_host_layout();
+   if (image_data->shm_imported)
    {
-      if (image_data->external_mem.is_host_visible())
-      {
-         void *mapped_memory = nullptr;
-         if (image_data->external_mem.map_host_memory(&mapped_memory) == VK_SUCCESS && mapped_memory != nullptr)
-         {
-            const auto &vulkan_layout = image_data->external_mem.get_host_layout();
-            size_t source_stride = vulkan_layout.rowPitch;
-            size_t dest_stride = image_data->stride;
-            size_t source_offset = vulkan_layout.offset;
-
-            size_t bytes_per_pixel = dest_stride / image_data->width;
-            size_t gpu_pixels_per_row = image_data->width;
-            size_t display_pixels_per_row = image_data->width;
-
-            char *src_base = (char *)mapped_memory + source_offset;
-
-            if (gpu_pixels_per_row != display_pixels_per_row)
-            {
-               precompute_scaling_lut(gpu_pixels_per_row, display_pixels_per_row);
-            }
-            else
-            {
-               m_scaling_lut.clear();
-            }
-
-            char *dst_base = (char *)active_addr;
-
-            if (bytes_per_pixel == 4)
-            {
-               uint32_t *src_pixels = (uint32_t *)src_base;
-               uint32_t *dst_pixels = (uint32_t *)dst_base;
-               uint32_t src_stride_pixels = source_stride / bytes_per_pixel;
-
-               copy_pixels_optimized(src_pixels, dst_pixels, src_stride_pixels, display_pixels_per_row,
-                                     image_data->height);
-            }
-            else
-            {
-               for (uint32_t row = 0; row < image_data->height; row++)
-               {
-                  char *src_row = src_base + (row * source_stride);
-                  char *dst_row = dst_base + (row * dest_stride);
-                  size_t copy_size = std::min(source_stride, dest_stride);
-                  std::memcpy(dst_row, src_row, copy_size);
-               }
-            }
-         }
-         else
-         {
-            return VK_ERROR_UNKNOWN;
-         }
-      }
-      else
-      {
-         WSI_LOG_ERROR("GPU memory not available for SHM presentation");
-         return VK_ERROR_DEVICE_LOST;
-      }
+      *src_base = static_cast<const char *>(image_data->shm_addr) + vulkan_layout.offset;
+      *src_stride = vulkan_layout.rowPitch;
+      return VK_SUCCESS;
    }
-   else
+
+   if (image_data->readback.is_valid())
    {
-      return VK_ERROR_UNKNOWN;
+      /* The present payload copied the image here, through memory the CPU can cache. */
+      *src_base = static_cast<const char *>(image_data->readback.map_for_read());
+      *src_stride = image_data->readback.get_stride();
+      return *src_base != nullptr ? VK_SUCCESS : VK_ERROR_UNKNOWN;
+   }
+
+   if (!image_data->external_mem.is_host_visible())
+   {
+      WSI_LOG_ERROR("GPU memory not available for SHM presentation");
+      return VK_ERROR_DEVICE_LOST;
    }
 
-   xcb_shm_put_image(m_connection, m_window, m_gc, image_data->width, image_data->height, 0, 0, image_data->width,
-                     image_data->height, 0, 0, image_data->depth, XCB_IMAGE_FORMAT_Z_PIXMAP, 0, active_seg, 0);
+   void *mapped_memory = nullptr;
+   if (image_data->external_mem.map_host_memory(&mapped_memory) != VK_SUCCESS || mapped_memory == nullptr)
+   {
+      return VK_ERROR_UNKNOWN;
+   }
+   if (row_count > 0)
+   {
+      TRY_LOG(image_data->external_mem.invalidate_host_memory(vulkan_layout.offset + first_row * vulkan_layout.rowPitch,
+                                                              row_count * vulkan_layout.rowPitch),
+              "Failed to invalidate the image memory");
+   }
+   *src_base = static_cast<const char *>(mapped_memory) + vulkan_layout.offset;
+   *src_stride = vulkan_layout.rowPitch;
+   return VK_SUCCESS;
+}
 
-   auto current_time = std::chrono::steady_clock::now();
-   auto time_since_last = std::chrono::duration_cast<std::chrono::microseconds>(current_time - m_last_frame_time);
+bool shm_presenter::is_source_uncached(const x11_image_data *image_data) const
+{
+   if (image_data->shm_imported || image_data->readback.is_valid())
+   {
+      return false;
+   }
+   return (image_data->external_mem.get_host_memory_properties() & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) == 0;
+}
 
-   if (m_last_frame_time.time_since_epoch().count() > 0 && time_since_last < m_frame_interval)
+VkResult shm_presenter::present_scaled(x11_image_data *image_data, uint32_t window_width, uint32_t window_height)
+{
+   const char *src_base = nullptr;
+   size_t source_stride = 0;
+   TRY(get_source_pixels(image_data, 0, image_data->height, &src_base, &source_stride));
+
+   const scale_layout layout =
+      compute_scale_layout(m_present_scaling, m_present_gravity_x, m_present_gravity_y, image_data->width,
+                           image_data->height, window_width, window_height);
+   if (!ensure_scaled_target(window_width, window_height, layout))
    {
-      auto sleep_time = m_frame_interval - time_since_last;
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
+   shm_segment_ring::segment &segment = m_scaled_ring.acquire();
 
-      if (sleep_time > std::chrono::microseconds(500))
-      {
-         auto conservative_sleep = sleep_time - std::chrono::microseconds(200);
-         std::this_thread::sleep_for(conservative_sleep);
-      }
+   if (!m_scaler.configure(layout.src_width, layout.src_height, layout.dst_width, layout.dst_height))
+   {
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
 
-      auto target_time = m_last_frame_time + m_frame_interval;
-      while (std::chrono::steady_clock::now() < target_time)
-      {
-         std::this_thread::sleep_for(std::chrono::microseconds(10));
-      }
-      current_time = std::chrono::steady_clock::now();
+   const uint32_t src_stride_pixels = static_cast<uint32_t>(source_stride / sizeof(uint32_t));
+   shm_scale_job job = {
+      &m_copy_workers,
+      &m_scaler,
+      reinterpret_cast<const uint32_t *>(src_base) + static_cast<size_t>(layout.src_y) * src_stride_pixels +
+         layout.src_x,
+      src_stride_pixels,
+      static_cast<uint32_t *>(segment.shm_addr) + static_cast<size_t>(layout.dst_y) * window_width +
+         layout.dst_x,
+      window_width,
+   };
+
+   const uint32_t total_pixels = layout.dst_width * layout.dst_height;
+   if (total_pixels <= m_threading_pixel_threshold || m_copy_workers.get_band_count() == 1 ||
+       !m_copy_workers.run(scale_band, &job))
+   {
+      scale_band(&job, 0, 1);
    }
-   m_last_frame_time = current_time;
 
-   if (m_fence_available)
+   if (m_segment_pool->is_local_only())
    {
-      trigger_presentation_fence();
+      const VkRect2D window_rect = { { 0, 0 }, { window_width, window_height } };
+      m_put_stream.put(m_window, m_gc, static_cast<uint8_t>(image_data->depth), 32,
+                       static_cast<const char *>(segment.shm_addr), window_width * sizeof(uint32_t), window_rect);
    }
    else
    {
-      start_async_sync();
+      xcb_shm_put_image(m_connection, m_window, m_gc, window_width, window_height, 0, 0, window_width,
+                        window_height, 0, 0, image_data->depth, XCB_IMAGE_FORMAT_Z_PIXMAP, 0, segment.shm_seg, 0);
+   }
+   m_scaled_ring.mark_in_flight(segment);
+
+   return finish_present(false);
+}
+
+VkResult shm_presenter::finish_present(bool wait_for_server)
+{
+   if (m_present_events != nullptr)
+   {
+      /* Ask for the next vblank timestamp to keep the pacer phase locked to the display. */
+      xcb_present_notify_msc(m_connection, m_window, ++m_notify_serial, 0, 1, 0);
    }
 
    int final_flush_result = xcb_flush(m_connection);
@@ -875,67 +1003,114 @@ VkResult shm_presenter::present_image(x11_image_data *image_data, uint32_t /*ser
       WSI_LOG_ERROR("SHM presenter xcb_flush failed: result=%d", final_flush_result);
    }
 
+   if (wait_for_server)
+   {
+      /* The segment goes back to the application once we return, so the server must be done reading it. */
+      free(xcb_get_input_focus_reply(m_connection, xcb_get_input_focus(m_connection), nullptr));
+   }
+
+   process_present_events();
+
+   /* The window moved or the monitors changed, it may now be shown on a monitor with another rate. */
+   const uint64_t topology_generation = m_topology->poll_generation();
+   if (topology_generation != m_topology_generation)
+   {
+      m_topology_generation = topology_generation;
+      detect_refresh_rate();
+   }
+
+   m_pacer.wait_for_next_deadline();
+
    return VK_SUCCESS;
 }
-void shm_presenter::destroy_image_resources(x11_image_data *image_data)
+
+void shm_presenter::process_present_events()
 {
-   if (image_data->shm_seg != XCB_NONE)
+   if (m_present_events == nullptr)
    {
-      xcb_generic_error_t *error = xcb_request_check(m_connection, 
-          xcb_shm_detach_checked(m_connection, image_data->shm_seg));
-      if (error)
-      {
-         WSI_LOG_ERROR("SHM detach failed: error_code=%d, sequence=%d", 
-                      error->error_code, error->sequence);
-         free(error);
-      }
-      
-      image_data->shm_seg = XCB_NONE;
+      return;
    }
 
-   if (image_data->shm_seg_alt != XCB_NONE)
+   while (xcb_generic_event_t *event = xcb_poll_for_special_event(m_connection, m_present_events))
    {
-      xcb_generic_error_t *error = xcb_request_check(m_connection, 
-          xcb_shm_detach_checked(m_connection, image_data->shm_seg_alt));
-      if (error)
+      auto *present_event = reinterpret_cast<xcb_present_generic_event_t *>(event);
+      if (present_event->evtype == XCB_PRESENT_EVENT_COMPLETE_NOTIFY)
       {
-         WSI_LOG_ERROR("SHM alt detach failed: error_code=%d, sequence=%d", 
-                      error->error_code, error->sequence);
-         free(error);
+         auto *complete = reinterpret_cast<xcb_present_complete_notify_event_t *>(event);
+         if (complete->kind == XCB_PRESENT_COMPLETE_KIND_NOTIFY_MSC)
+         {
+            m_pacer.resync(complete->ust, complete->msc);
+         }
       }
-      
-      image_data->shm_seg_alt = XCB_NONE;
+      free(event);
    }
+}
 
-   if (image_data->shm_addr && image_data->shm_addr != (void *)-1)
+bool shm_presenter::init_present_events()
+{
+   if (!m_wsi_surface->has_present(1, 0))
    {
-      int detach_result = shmdt(image_data->shm_addr);
-      if (detach_result != 0)
-      {
-         WSI_LOG_ERROR("Failed to detach shared memory: errno=%d", errno);
-      }
-      image_data->shm_addr = nullptr;
+      return false;
    }
 
-   if (image_data->shm_addr_alt && image_data->shm_addr_alt != (void *)-1)
+   m_present_event_id = xcb_generate_id(m_connection);
+   m_present_events = xcb_register_for_special_xge(m_connection, &xcb_present_id, m_present_event_id, nullptr);
+   if (m_present_events == nullptr)
    {
-      int detach_result = shmdt(image_data->shm_addr_alt);
-      if (detach_result != 0)
-      {
-         WSI_LOG_ERROR("Failed to detach alternate shared memory: errno=%d", errno);
-      }
-      image_data->shm_addr_alt = nullptr;
+      return false;
    }
 
-   image_data->shm_id = -1;
-   image_data->shm_id_alt = -1;
-   image_data->shm_size = 0;
-   image_data->use_alt_buffer = false;
+   auto select_cookie = xcb_present_select_input_checked(m_connection, m_present_event_id, m_window,
+                                                         XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY);
+   xcb_generic_error_t *error = xcb_request_check(m_connection, select_cookie);
+   if (error != nullptr)
+   {
+      free(error);
+      xcb_unregister_for_special_event(m_connection, m_present_events);
+      m_present_events = nullptr;
+      return false;
+   }
+
+   return true;
 }
 
-bool shm_presenter::is_available(xcb_connection_t * /*connection*/, surface *wsi_surface)
+void shm_presenter::cleanup_present_events()
+{
+   if (m_present_events != nullptr)
+   {
+      xcb_present_select_input(m_connection, m_present_event_id, m_window, XCB_PRESENT_EVENT_MASK_NO_EVENT);
+      xcb_unregister_for_special_event(m_connection, m_present_events);
+      m_present_events = nullptr;
+   }
+}
+
+void shm_presenter::destroy_image_resources(x11_image_data *image_data)
 {
-   return wsi_surface->has_shm();
+   if (image_data->shm_imported)
+   {
+      /* The device memory aliases the segment and must go before the segment is detached. */
+      image_data->external_mem.release_host_pointer();
+      image_data->shm_imported = false;
+   }
+
+   if (image_data->shm_seg != XCB_NONE)
+   {
+      /* The put of the last present was waited for, the server no longer reads the segment. */
+      shm_segment segment;
+      segment.shm_seg = image_data->shm_seg;
+      segment.shm_id = image_data->shm_id;
+      segment.shm_addr = image_data->shm_addr;
+      segment.size = image_data->shm_segment_size;
+      segment.fd_backed = image_data->shm_id < 0;
+      m_segment_pool->release(&segment, 1);
+
+      image_data->shm_seg = XCB_NONE;
+      image_data->shm_addr = nullptr;
+      image_data->shm_segment_size = 0;
+   }
+
+   image_data->shm_id = -1;
+   image_data->shm_size = 0;
 }
 
 VkResult shm_presenter::create_graphics_context()
@@ -39,15 +39,27 @@
 #include <cstdint>
 #include <unordered_map>
 #include <chrono>
-#include <atomic>
-#include <mutex>
-#include <xcb/sync.h>
+
+#include "copy_autotuner.hpp"
+#include "copy_kernels.hpp"
+#include "copy_worker_pool.hpp"
+#include "frame_pacer.hpp"
+#include "image_scaler.hpp"
+#include "pixel_convert.hpp"
+#include "put_image_stream.hpp"
+#include "shared_image_tracker.hpp"
+#include "shm_segment_pool.hpp"
+#include "shm_segment_ring.hpp"
 
 namespace wsi
 {
+
+struct present_damage;
+
 namespace x11
 {
 
+class randr_topology;
 class surface;
 struct x11_image_data;
 
@@ -58,15 +70,103 @@ public:
 
    shm_presenter();
 
-   VkResult init(xcb_connection_t *connection, xcb_window_t window, surface *wsi_surface);
+   /**
+    * @brief Prepare presenting to @p window.
+    *
+    * @param segment_pool Pool of the presenter of the swapchain being replaced, see @ref get_segment_pool.
+    *                     nullptr creates a new pool.
+    */
+   VkResult init(xcb_connection_t *connection, xcb_window_t window, surface *wsi_surface,
+                 std::shared_ptr<shm_segment_pool> segment_pool = nullptr);
+
+   /**
+    * @brief Pool the segments of this presenter go back to, to be shared with the presenter of a descendant swapchain.
+    */
+   const std::shared_ptr<shm_segment_pool> &get_segment_pool() const
+   {
+      return m_segment_pool;
+   }
 
    VkResult create_image_resources(x11_image_data *image_data, uint32_t width, uint32_t height, int depth);
 
-   VkResult present_image(x11_image_data *image_data, uint32_t serial);
+   /**
+    * @brief Create a single SHM segment for an image whose memory is imported from it.
+    *
+    * The caller imports @p image_data->shm_addr with VK_EXT_external_memory_host, so the GPU renders
+    * straight into the segment and @ref present_image skips the CPU copy.
+    *
+    * @param size Segment size, already rounded up to minImportedHostPointerAlignment.
+    */
+   VkResult create_host_import_resources(x11_image_data *image_data, uint32_t width, uint32_t height, int depth,
+                                         size_t size);
+
+   /**
+    * @brief Copy the image into the next segment of the ring and put it on the window.
+    *
+    * Returns once the copy is done, the image can be reused while the X server still reads the segment.
+    *
+    * @param damage Area that changed since the previous present. Small damage is copied and put
+    *               rectangle by rectangle, anything else updates the whole window. Nothing is copied nor put
+    *               for unchanged frames, or with x11_skip_unchanged for frames hashing the same as the last one.
+    */
+   VkResult present_image(x11_image_data *image_data, uint32_t serial, const present_damage &damage);
+
+   /**
+    * @brief Refresh the window from the shared presentable image of VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR.
+    *
+    * Only the parts of the image that changed since they were put are copied, see @ref set_change_tracking. When
+    * nothing changed this only waits for the next refresh.
+    */
+   VkResult refresh_image(x11_image_data *image_data);
+
+   /**
+    * @brief Track what is put from the image, as needed by @ref refresh_image.
+    */
+   void set_change_tracking(bool enable)
+   {
+      m_track_changes = enable;
+   }
 
    void destroy_image_resources(x11_image_data *image_data);
 
-   bool is_available(xcb_connection_t *connection, surface *wsi_surface);
+   /**
+    * @brief Scale presented images to the window, as requested with VkSwapchainPresentScalingCreateInfoEXT.
+    *
+    * @param scaling   Scaling behavior, 0 keeps the images unscaled.
+    * @param gravity_x Horizontal placement of the scaled image.
+    * @param gravity_y Vertical placement of the scaled image.
+    */
+   void set_present_scaling(VkPresentScalingFlagsEXT scaling, VkPresentGravityFlagsEXT gravity_x,
+                            VkPresentGravityFlagsEXT gravity_y);
+
+   /**
+    * @brief Select how images of @p format are written to a window of @p depth.
+    *
+    * @return VK_ERROR_FORMAT_NOT_SUPPORTED when the window's pixmap format cannot be produced from @p format.
+    */
+   VkResult set_image_format(VkFormat format, int depth);
+
+   /**
+    * @brief Whether presents convert pixels rather than copy them, which rules out scaling and host imports.
+    */
+   bool needs_conversion() const;
+
+   /**
+    * @brief Timeline of the presents, phase locked to the vblanks of the window when the X server reports them.
+    */
+   const frame_pacer &get_pacer() const
+   {
+      return m_pacer;
+   }
+
+   /**
+    * @brief Count the segments of the copy and scaling rings in @p accounting, set before the first image.
+    */
+   void set_memory_accounting(util::memory_accounting *accounting)
+   {
+      m_segment_ring.set_memory_accounting(accounting);
+      m_scaled_ring.set_memory_accounting(accounting);
+   }
 
 private:
    xcb_connection_t *m_connection = nullptr;
@@ -74,51 +174,119 @@ private:
    surface *m_wsi_surface = nullptr;
    xcb_gcontext_t m_gc = XCB_NONE;
 
-   std::vector<uint32_t> m_scaling_lut;
-   uint32_t m_last_gpu_width = 0;
-   uint32_t m_last_display_width = 0;
-
-   xcb_get_geometry_cookie_t m_pending_sync_cookie;
-   bool m_sync_pending = false;
-
-   xcb_sync_fence_t m_presentation_fence = XCB_NONE;
-   bool m_fence_available = false;
    bool m_first_frame = true;
 
    std::unordered_map<int, uint8_t> m_depth_to_bpp_cache;
 
-   std::chrono::steady_clock::time_point m_last_frame_time;
    std::chrono::microseconds m_frame_interval;
    double m_refresh_rate_hz;
+   /* Topology cache of the server the window is on, looked up once as it costs a system call. */
+   randr_topology *m_topology = nullptr;
+   /* Last value of randr_topology::poll_generation the refresh rate was detected for. */
+   uint64_t m_topology_generation = 0;
+
+   frame_pacer m_pacer;
+   xcb_special_event_t *m_present_events = nullptr;
+   uint32_t m_present_event_id = 0;
+   uint32_t m_notify_serial = 0;
 
-   std::atomic<bool> m_thread_error_occurred{ false };
-   std::mutex m_error_recovery_mutex;
+   VkPresentScalingFlagsEXT m_present_scaling = 0;
+   VkPresentGravityFlagsEXT m_present_gravity_x = 0;
+   VkPresentGravityFlagsEXT m_present_gravity_y = 0;
+   image_scaler m_scaler;
 
+   /* Declared before the rings, which give their segments back to it. */
+   std::shared_ptr<shm_segment_pool> m_segment_pool;
 
+   /* Window sized segments the scaled frames are written to, two so scaling overlaps the previous put. */
+   shm_segment_ring m_scaled_ring;
+   uint32_t m_scaled_width = 0;
+   uint32_t m_scaled_height = 0;
+   scale_layout m_scaled_layout = {};
+
+   /* Segments copied images are presented from, see @ref create_image_resources. */
+   shm_segment_ring m_segment_ring;
+
+   /* Sends the frames when the segment pool is local only, the X server cannot read the segments. */
+   put_image_stream m_put_stream;
+
+   bool m_track_changes = false;
+   /* Whether full frames put through MIT-SHM are hashed to only copy and put the tiles that changed. */
+   bool m_skip_unchanged = false;
+   shared_image_tracker m_change_tracker;
+
+   copy_worker_pool m_copy_workers;
+   /* Frames with more pixels are split across m_copy_workers when not autotuning, see util::tuning_profile. */
+   uint32_t m_threading_pixel_threshold = 400 * 400;
+   /* Whether whole frame copies use the strategy m_copy_autotuner measured fastest. */
+   bool m_copy_autotune = true;
+   copy_autotuner m_copy_autotuner;
+   copy_kernel m_copy_kernel{};
+   /* Kernel for images read from uncached memory, see @ref is_source_uncached. */
+   copy_kernel m_stream_copy_kernel{};
+   pixel_converter m_converter{ nullptr, 4, "none" };
+
+   /**
+    * @brief Create the segment pool of a window, local only when the server cannot attach the segments.
+    */
+   std::shared_ptr<shm_segment_pool> create_segment_pool();
    VkResult create_graphics_context();
+   VkResult finish_present(bool wait_for_server);
+
+   /**
+    * @brief Copy and put the damaged part of the image, all of it when @p damage_rect_count is 0.
+    */
+   VkResult put_frame(x11_image_data *image_data, const VkRect2D *damage_rects, uint32_t damage_rect_count);
+
+   /**
+    * @brief Size the change tracker for @p image_data and locate all of its pixels to hash.
+    */
+   VkResult prepare_change_tracker(x11_image_data *image_data, const char **src_base, size_t *src_stride);
+
+   /**
+    * @brief Locate the pixels of a presented image: the imported segment, the readback buffer or the mapped image.
+    *
+    * @param first_row First row that will be read.
+    * @param row_count Number of rows that will be read, which non-coherent image memory is invalidated for.
+    */
+   VkResult get_source_pixels(x11_image_data *image_data, uint32_t first_row, uint32_t row_count,
+                              const char **src_base, size_t *src_stride);
+
+   /**
+    * @brief Whether @ref get_source_pixels reads the image from host memory the CPU does not cache.
+    */
+   bool is_source_uncached(const x11_image_data *image_data) const;
+
+   VkResult present_scaled(x11_image_data *image_data, uint32_t window_width, uint32_t window_height);
+   bool ensure_scaled_target(uint32_t width, uint32_t height, const scale_layout &layout);
+   static void scale_band(void *context, uint32_t band_index, uint32_t band_count);
+
+   bool init_present_events();
+   void cleanup_present_events();
+   void process_present_events();
+
+   /**
+    * @brief Put the image from @p segment, with ShmPutImage or through @ref m_put_stream for a local only pool.
+    */
+   void put_image(const x11_image_data *image_data, const shm_segment &segment, uint32_t total_width,
+                  uint32_t offset, const VkRect2D *rects, uint32_t rect_count);
 
-   void precompute_scaling_lut(uint32_t gpu_width, uint32_t display_width);
    void copy_pixels_optimized(const uint32_t *src_pixels, uint32_t *dst_pixels, uint32_t src_stride_pixels,
-                              uint32_t dst_width, uint32_t height);
+                              uint32_t dst_width, uint32_t height, bool uncached_source);
    void copy_pixels_threaded(const uint32_t *src_pixels, uint32_t *dst_pixels, uint32_t src_stride_pixels,
-                             uint32_t dst_width, uint32_t height);
+                             uint32_t dst_width, uint32_t height, bool uncached_source, uint32_t bands,
+                             uint32_t chunk_rows);
+   static void copy_band(void *context, uint32_t band_index, uint32_t band_count);
+   void convert_pixels(const char *src_base, size_t src_stride, char *dst_base, size_t dst_stride, uint32_t width,
+                       uint32_t height, const VkRect2D *rects, uint32_t rect_count);
+   static void convert_band(void *context, uint32_t band_index, uint32_t band_count);
    void copy_pixels_optimized_single_thread(const uint32_t *src_pixels, uint32_t *dst_pixels,
-                                            uint32_t src_stride_pixels, uint32_t dst_width, uint32_t height);
+                                            uint32_t src_stride_pixels, uint32_t dst_width, uint32_t height,
+                                            bool uncached_source);
 #ifdef ENABLE_ARM_NEON
    void copy_pixels_simd(const uint32_t *src_pixels, uint32_t *dst_pixels, uint32_t src_stride_pixels,
                          uint32_t dst_width, uint32_t height);
 #endif
-   void copy_pixels_scalar(const uint32_t *src_pixels, uint32_t *dst_pixels, uint32_t src_stride_pixels,
-                           uint32_t dst_width, uint32_t height);
-
-   void start_async_sync();
-   bool check_pending_sync();
-   void ensure_sync_completion();
-
-   bool init_fence_sync();
-   void cleanup_fence_sync();
-   void wait_for_presentation_fence();
-   void trigger_presentation_fence();
 
    void cache_x11_formats();
    uint8_t get_bits_per_pixel_for_depth(int depth);
@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file shm_segment_pool.cpp
+ *
+ * @brief Implementation of the SHM segment pool.
+ */
+
+#include "shm_segment_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <unistd.h>
+
+#include "util/log.hpp"
+
+namespace wsi
+{
+namespace x11
+{
+
+static constexpr int SHM_PERMISSIONS = 0666;
+
+/* Largest batch of segments created at once. */
+static constexpr uint32_t MAX_BATCH = 16;
+
+/* Default huge page size of x86-64 and arm64, which MFD_HUGETLB allocates from. */
+static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+/**
+ * @brief Round @p size up to its bucket, which wastes at most an eighth of the segment.
+ */
+size_t shm_segment_pool::get_bucket_size(size_t size) const
+{
+   size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+   if (m_hugepages == hugepage_mode::hugetlb || (m_hugepages == hugepage_mode::transparent && size >= HUGE_PAGE_SIZE))
+   {
+      page_size = HUGE_PAGE_SIZE;
+   }
+   size = (size + page_size - 1) / page_size * page_size;
+
+   size_t step = page_size;
+   while (step * 16 <= size)
+   {
+      step *= 2;
+   }
+   return (size + step - 1) / step * step;
+}
+
+shm_segment_pool::shm_segment_pool(xcb_connection_t *connection, bool fd_passing, bool local_only)
+   : m_connection(connection)
+   , m_fd_passing(fd_passing && !local_only)
+   , m_local_only(local_only)
+{
+   const char *env = std::getenv("WSI_X11_SHM_HUGEPAGES");
+   if (env == nullptr || !m_fd_passing)
+   {
+      return;
+   }
+
+   if (std::strcmp(env, "thp") == 0)
+   {
+      m_hugepages = hugepage_mode::transparent;
+   }
+   else if (std::strcmp(env, "hugetlb") == 0)
+   {
+      m_hugepages = hugepage_mode::hugetlb;
+   }
+   else if (std::strcmp(env, "0") != 0)
+   {
+      WSI_LOG_WARNING("Unknown WSI_X11_SHM_HUGEPAGES value '%s', expected thp or hugetlb", env);
+   }
+}
+
+bool shm_segment_pool::create_memfd_segment(size_t size, shm_segment &segment, int &fd)
+{
+   unsigned int flags = MFD_CLOEXEC;
+   if (m_hugepages == hugepage_mode::hugetlb)
+   {
+      flags |= MFD_HUGETLB;
+   }
+
+   void *addr = MAP_FAILED;
+   fd = memfd_create("wsi-x11-shm", flags);
+   if (fd >= 0 && ftruncate(fd, static_cast<off_t>(size)) == 0)
+   {
+      addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   }
+   if (addr == MAP_FAILED)
+   {
+      if (fd >= 0)
+      {
+         close(fd);
+         fd = -1;
+      }
+
+      if (m_hugepages == hugepage_mode::hugetlb)
+      {
+         /* No huge pages reserved, or not enough: use transparent huge pages instead. */
+         WSI_LOG_WARNING("Failed to allocate a hugetlb SHM segment of size %zu: errno=%d", size, errno);
+         m_hugepages = hugepage_mode::transparent;
+         return create_memfd_segment(size, segment, fd);
+      }
+
+      WSI_LOG_ERROR("Failed to create a memfd SHM segment of size %zu: errno=%d", size, errno);
+      return false;
+   }
+
+   if (m_hugepages == hugepage_mode::transparent && madvise(addr, size, MADV_HUGEPAGE) != 0)
+   {
+      WSI_LOG_WARNING("MADV_HUGEPAGE failed on a SHM segment: errno=%d", errno);
+   }
+
+   segment.shm_addr = addr;
+   segment.size = size;
+   segment.fd_backed = true;
+   return true;
+}
+
+bool shm_segment_pool::create_local_segment(size_t size, shm_segment &segment)
+{
+   void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (addr == MAP_FAILED)
+   {
+      WSI_LOG_ERROR("Failed to map a local segment of size %zu: errno=%d", size, errno);
+      return false;
+   }
+
+   /* Unmapped like a memfd segment, and there is no server side to detach. */
+   segment.shm_addr = addr;
+   segment.size = size;
+   segment.fd_backed = true;
+   return true;
+}
+
+shm_segment_pool::~shm_segment_pool()
+{
+   for (const shm_segment &segment : m_idle)
+   {
+      detach(segment);
+   }
+   xcb_flush(m_connection);
+}
+
+void shm_segment_pool::detach(const shm_segment &segment)
+{
+   /* Unchecked, the detach is queued with the next requests instead of costing a round trip. */
+   if (segment.shm_seg != XCB_NONE)
+   {
+      xcb_shm_detach(m_connection, segment.shm_seg);
+   }
+   if (segment.fd_backed)
+   {
+      munmap(segment.shm_addr, segment.size);
+   }
+   else if (shmdt(segment.shm_addr) != 0)
+   {
+      WSI_LOG_ERROR("Failed to detach shared memory: errno=%d", errno);
+   }
+}
+
+uint32_t shm_segment_pool::acquire(size_t size, uint32_t count, shm_segment *segments)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+
+   uint32_t acquired = 0;
+   while (acquired < count)
+   {
+      /* Smallest idle segment that fits without wasting more than half of it. */
+      auto best = m_idle.end();
+      for (auto it = m_idle.begin(); it != m_idle.end(); ++it)
+      {
+         if (it->size >= size && it->size / 2 <= size && (best == m_idle.end() || it->size < best->size))
+         {
+            best = it;
+         }
+      }
+      if (best == m_idle.end())
+      {
+         break;
+      }
+      segments[acquired++] = *best;
+      m_idle.erase(best);
+   }
+
+   const size_t bucket_size = get_bucket_size(size);
+   while (m_local_only && acquired < count)
+   {
+      segments[acquired] = shm_segment{};
+      if (!create_local_segment(bucket_size, segments[acquired]))
+      {
+         return acquired;
+      }
+      acquired++;
+   }
+
+   while (acquired < count)
+   {
+      const uint32_t batch = std::min(count - acquired, MAX_BATCH);
+      shm_segment *created = segments + acquired;
+
+      /* File descriptors of the memfd segments, xcb closes them once the attach is sent. */
+      std::array<int, MAX_BATCH> fds{};
+      uint32_t created_count = 0;
+      for (; created_count < batch; created_count++)
+      {
+         shm_segment &segment = created[created_count];
+         segment = shm_segment{};
+         fds[created_count] = -1;
+         if (m_fd_passing)
+         {
+            if (create_memfd_segment(bucket_size, segment, fds[created_count]))
+            {
+               continue;
+            }
+            WSI_LOG_WARNING("Falling back to SysV SHM segments");
+            m_fd_passing = false;
+         }
+
+         segment.shm_id = shmget(IPC_PRIVATE, bucket_size, IPC_CREAT | SHM_PERMISSIONS);
+         if (segment.shm_id < 0)
+         {
+            WSI_LOG_ERROR("Failed to create shared memory segment of size %zu", bucket_size);
+            break;
+         }
+
+         segment.shm_addr = shmat(segment.shm_id, nullptr, 0);
+         if (segment.shm_addr == (void *)-1)
+         {
+            WSI_LOG_ERROR("Failed to attach shared memory segment");
+            shmctl(segment.shm_id, IPC_RMID, nullptr);
+            segment = shm_segment{};
+            break;
+         }
+         segment.size = bucket_size;
+      }
+
+      /* Issue every attach before checking any, so the whole batch costs a single round trip. */
+      std::array<xcb_void_cookie_t, MAX_BATCH> attach_cookies{};
+      for (uint32_t i = 0; i < created_count; i++)
+      {
+         created[i].shm_seg = xcb_generate_id(m_connection);
+         if (created[i].fd_backed)
+         {
+            attach_cookies[i] = xcb_shm_attach_fd_checked(m_connection, created[i].shm_seg, fds[i], 0);
+         }
+         else
+         {
+            attach_cookies[i] = xcb_shm_attach_checked(m_connection, created[i].shm_seg, created[i].shm_id, 0);
+         }
+      }
+
+      uint32_t attached = 0;
+      for (uint32_t i = 0; i < created_count; i++)
+      {
+         const shm_segment segment = created[i];
+         xcb_generic_error_t *error = xcb_request_check(m_connection, attach_cookies[i]);
+
+         if (!segment.fd_backed)
+         {
+            /* Both sides are attached (or the attach failed), the segment can be marked for removal. */
+            shmctl(segment.shm_id, IPC_RMID, nullptr);
+         }
+
+         if (error)
+         {
+            WSI_LOG_ERROR("SHM attach failed: error_code=%d", error->error_code);
+            free(error);
+            if (segment.fd_backed)
+            {
+               munmap(segment.shm_addr, segment.size);
+            }
+            else
+            {
+               shmdt(segment.shm_addr);
+            }
+            continue;
+         }
+         created[attached++] = segment;
+      }
+
+      acquired += attached;
+      if (attached < batch)
+      {
+         break;
+      }
+   }
+
+   return acquired;
+}
+
+void shm_segment_pool::release(const shm_segment *segments, uint32_t count)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   for (uint32_t i = 0; i < count; i++)
+   {
+      m_idle.push_back(segments[i]);
+   }
+
+   if (m_idle.size() > MAX_IDLE_SEGMENTS)
+   {
+      const size_t evicted = m_idle.size() - MAX_IDLE_SEGMENTS;
+      for (size_t i = 0; i < evicted; i++)
+      {
+         detach(m_idle[i]);
+      }
+      m_idle.erase(m_idle.begin(), m_idle.begin() + static_cast<std::ptrdiff_t>(evicted));
+      xcb_flush(m_connection);
+   }
+}
+
+} /* namespace x11 */
+} /* namespace wsi */
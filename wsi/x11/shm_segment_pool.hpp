@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file shm_segment_pool.hpp
+ *
+ * @brief Pool of attached SHM segments shared along a chain of swapchains.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <xcb/xcb.h>
+#include <xcb/shm.h>
+
+namespace wsi
+{
+namespace x11
+{
+
+/**
+ * @brief SHM segment attached on both the client and the X server side.
+ *
+ * Segments of a local only pool are private memory the server does not know about, shm_seg is XCB_NONE.
+ */
+struct shm_segment
+{
+   xcb_shm_seg_t shm_seg = XCB_NONE;
+   int shm_id = -1;
+   void *shm_addr = nullptr;
+
+   /* Usable size, at least the size the segment was requested with. */
+   size_t size = 0;
+
+   /* The segment is a memfd mapping passed to the server rather than a SysV segment, shm_id is -1. */
+   bool fd_backed = false;
+};
+
+/**
+ * @brief Keeps released segments attached so that recreated swapchains can reuse them.
+ *
+ * Creating a segment costs shmget, shmat and a server round trip to check the attach, which adds up when
+ * interactive resizing recreates the swapchain many times per second. Segments are sized in buckets, eight
+ * per power of two, so a window that changes size slightly can still reuse them. The pool is created by the
+ * first presenter of a window and handed to the presenters of its descendant swapchains.
+ *
+ * When the server supports MIT-SHM 1.2 the segments are memfds passed with ShmAttachFd, which are not
+ * bound by the SysV shmmax/shmall limits and cannot leak when the process dies. SysV segments are the
+ * fallback. WSI_X11_SHM_HUGEPAGES=thp asks for transparent huge pages on the memfd mappings, which needs
+ * /sys/kernel/mm/transparent_hugepage/shmem_enabled set to advise. WSI_X11_SHM_HUGEPAGES=hugetlb allocates
+ * them from the reserved hugetlbfs pages instead.
+ *
+ * A local only pool hands out anonymous mappings instead, for presenters that send the pixels in core protocol
+ * requests because the server cannot attach segments, see put_image_stream.
+ */
+class shm_segment_pool
+{
+public:
+   /* Released segments beyond this count are detached, the oldest first. */
+   static constexpr size_t MAX_IDLE_SEGMENTS = 8;
+
+   /**
+    * @param connection Connection the segments are attached to.
+    * @param fd_passing Whether the server accepts ShmAttachFd, see surface::has_shm_fd_passing.
+    * @param local_only Whether the segments stay private to the client instead of being attached to the server.
+    */
+   shm_segment_pool(xcb_connection_t *connection, bool fd_passing, bool local_only);
+   ~shm_segment_pool();
+
+   shm_segment_pool(const shm_segment_pool &) = delete;
+   shm_segment_pool &operator=(const shm_segment_pool &) = delete;
+
+   /**
+    * @brief Take @p count segments of at least @p size bytes, creating the ones the pool does not hold.
+    *
+    * All the new segments are attached with a single round trip.
+    *
+    * @return Number of segments written to @p segments, lower than @p count when creating them failed.
+    */
+   uint32_t acquire(size_t size, uint32_t count, shm_segment *segments);
+
+   /**
+    * @brief Give segments back to the pool. The X server must no longer read them.
+    */
+   void release(const shm_segment *segments, uint32_t count);
+
+   xcb_connection_t *get_connection() const
+   {
+      return m_connection;
+   }
+
+   bool is_local_only() const
+   {
+      return m_local_only;
+   }
+
+private:
+   enum class hugepage_mode
+   {
+      none,
+      transparent,
+      hugetlb,
+   };
+
+   bool create_memfd_segment(size_t size, shm_segment &segment, int &fd);
+   bool create_local_segment(size_t size, shm_segment &segment);
+   size_t get_bucket_size(size_t size) const;
+   void detach(const shm_segment &segment);
+
+   xcb_connection_t *m_connection;
+   bool m_fd_passing;
+   bool m_local_only;
+   hugepage_mode m_hugepages = hugepage_mode::none;
+
+   std::mutex m_mutex;
+
+   /* Released segments, oldest first. */
+   std::vector<shm_segment> m_idle;
+};
+
+} /* namespace x11 */
+} /* namespace wsi */
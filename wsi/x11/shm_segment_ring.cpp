@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file shm_segment_ring.cpp
+ *
+ * @brief Implementation of the SHM segment ring.
+ */
+
+#include "shm_segment_ring.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "util/log.hpp"
+#include "util/tuning_profile.hpp"
+
+namespace wsi
+{
+namespace x11
+{
+
+shm_segment_ring::~shm_segment_ring()
+{
+   destroy();
+}
+
+uint32_t shm_segment_ring::get_configured_count()
+{
+   const char *env = std::getenv("WSI_X11_SHM_SEGMENTS");
+   if (env == nullptr)
+   {
+      return util::tuning_profile::get().x11_reduced_footprint != 0 ? MIN_SEGMENTS : DEFAULT_SEGMENTS;
+   }
+
+   const long count = std::strtol(env, nullptr, 10);
+   return static_cast<uint32_t>(std::clamp<long>(count, MIN_SEGMENTS, MAX_SEGMENTS));
+}
+
+VkResult shm_segment_ring::init(const std::shared_ptr<shm_segment_pool> &pool, size_t segment_size, uint32_t count)
+{
+   destroy();
+
+   m_pool = pool;
+   m_connection = pool->get_connection();
+   m_segment_size = segment_size;
+   count = std::clamp(count, MIN_SEGMENTS, MAX_SEGMENTS);
+
+   std::array<shm_segment, MAX_SEGMENTS> acquired{};
+   m_count = m_pool->acquire(segment_size, count, acquired.data());
+   for (uint32_t i = 0; i < m_count; i++)
+   {
+      static_cast<shm_segment &>(m_segments[i]) = acquired[i];
+   }
+   if (m_accounting != nullptr && m_count != 0)
+   {
+      m_accounting->add(util::memory_category::shm, m_count * m_segment_size);
+   }
+
+   if (m_count < MIN_SEGMENTS)
+   {
+      destroy();
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   }
+
+   if (m_count < count)
+   {
+      WSI_LOG_WARNING("SHM segment ring limited to %u of %u segments", m_count, count);
+   }
+
+   m_next = 0;
+   return VK_SUCCESS;
+}
+
+void shm_segment_ring::wait_for_release(segment &seg)
+{
+   if (!seg.in_flight)
+   {
+      return;
+   }
+
+   xcb_get_input_focus_reply_t *reply = xcb_get_input_focus_reply(m_connection, seg.release_cookie, nullptr);
+   free(reply);
+   seg.in_flight = false;
+}
+
+shm_segment_ring::segment &shm_segment_ring::acquire()
+{
+   segment &seg = m_segments[m_next];
+   m_next = (m_next + 1) % m_count;
+
+   wait_for_release(seg);
+   return seg;
+}
+
+void shm_segment_ring::mark_in_flight(segment &seg)
+{
+   seg.release_cookie = xcb_get_input_focus(m_connection);
+   seg.in_flight = true;
+}
+
+void shm_segment_ring::drain()
+{
+   for (uint32_t i = 0; i < m_count; i++)
+   {
+      wait_for_release(m_segments[i]);
+   }
+}
+
+void shm_segment_ring::clear()
+{
+   drain();
+
+   for (uint32_t i = 0; i < m_count; i++)
+   {
+      std::memset(m_segments[i].shm_addr, 0, m_segment_size);
+   }
+}
+
+void shm_segment_ring::destroy()
+{
+   if (m_count == 0)
+   {
+      return;
+   }
+
+   drain();
+
+   std::array<shm_segment, MAX_SEGMENTS> released{};
+   for (uint32_t i = 0; i < m_count; i++)
+   {
+      released[i] = m_segments[i];
+      m_segments[i] = segment{};
+   }
+   m_pool->release(released.data(), m_count);
+   if (m_accounting != nullptr)
+   {
+      m_accounting->remove(util::memory_category::shm, m_count * m_segment_size);
+   }
+
+   m_pool.reset();
+   m_count = 0;
+   m_next = 0;
+   m_segment_size = 0;
+}
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file shm_segment_ring.hpp
+ *
+ * @brief Ring of MIT-SHM segments that lets the SHM presenter fill one segment while the X server reads others.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vulkan/vulkan.h>
+#include <xcb/xcb.h>
+#include <xcb/shm.h>
+
+#include "shm_segment_pool.hpp"
+#include "util/memory_accounting.hpp"
+
+namespace wsi
+{
+namespace x11
+{
+
+/**
+ * @brief Fixed ring of equally sized SHM segments with per segment completion tracking.
+ *
+ * X servers process ShmPutImage synchronously, so a segment is free again once a round trip issued after
+ * its last put has been answered. The ring keeps that reply cookie per segment and only waits for it
+ * when the segment comes round again, so the copy of a frame overlaps the server reading the previous
+ * @ref get_count - 1 frames.
+ */
+class shm_segment_ring
+{
+public:
+   static constexpr uint32_t MIN_SEGMENTS = 2;
+   static constexpr uint32_t MAX_SEGMENTS = 8;
+   static constexpr uint32_t DEFAULT_SEGMENTS = 3;
+
+   struct segment : shm_segment
+   {
+      /* Round trip issued after the last put from this segment. */
+      xcb_get_input_focus_cookie_t release_cookie = {};
+      bool in_flight = false;
+   };
+
+   ~shm_segment_ring();
+
+   /**
+    * @brief Take the segments from @p pool.
+    *
+    * @param pool         Pool the segments are taken from, and given back to by @ref destroy.
+    * @param segment_size Size of each segment in bytes.
+    * @param count        Number of segments, clamped to [MIN_SEGMENTS, MAX_SEGMENTS].
+    */
+   VkResult init(const std::shared_ptr<shm_segment_pool> &pool, size_t segment_size, uint32_t count);
+
+   /**
+    * @brief Take the next segment of the ring, waiting until the X server has stopped reading it.
+    */
+   segment &acquire();
+
+   /**
+    * @brief Record that @p seg has been put, after the put request has been issued.
+    */
+   void mark_in_flight(segment &seg);
+
+   /**
+    * @brief Wait until the X server is done with every segment.
+    */
+   void drain();
+
+   /**
+    * @brief Drain and zero fill every segment.
+    */
+   void clear();
+
+   /**
+    * @brief Drain and give all segments back to the pool.
+    */
+   void destroy();
+
+   size_t get_segment_size() const
+   {
+      return m_segment_size;
+   }
+
+   uint32_t get_count() const
+   {
+      return m_count;
+   }
+
+   /**
+    * @brief Count the segments of the ring in @p accounting from the next @ref init.
+    */
+   void set_memory_accounting(util::memory_accounting *accounting)
+   {
+      m_accounting = accounting;
+   }
+
+   /**
+    * @brief Number of segments to use, WSI_X11_SHM_SEGMENTS overrides DEFAULT_SEGMENTS, or MIN_SEGMENTS with the
+    * x11_reduced_footprint tuning.
+    */
+   static uint32_t get_configured_count();
+
+private:
+   void wait_for_release(segment &seg);
+
+   std::shared_ptr<shm_segment_pool> m_pool;
+   xcb_connection_t *m_connection = nullptr;
+   std::array<segment, MAX_SEGMENTS> m_segments{};
+   uint32_t m_count = 0;
+   uint32_t m_next = 0;
+   size_t m_segment_size = 0;
+   util::memory_accounting *m_accounting = nullptr;
+};
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -29,6 +29,8 @@
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
 #include <xcb/shm.h>
+#include <xcb/dri3.h>
+#include <xcb/present.h>
 #include "surface.hpp"
 #include "swapchain.hpp"
 #include "surface_properties.hpp"
@@ -55,6 +57,20 @@ surface::surface(const init_parameters &params)
 
 surface::~surface()
 {
+   if (m_configure_events != nullptr)
+   {
+      /* The window may be gone already, the error of the request is discarded rather than sent to the
+       * application. */
+      auto cookie = xcb_present_select_input_checked(m_connection, m_configure_event_id, m_window,
+                                                     XCB_PRESENT_EVENT_MASK_NO_EVENT);
+      xcb_discard_reply(m_connection, cookie.sequence);
+      xcb_unregister_for_special_event(m_connection, m_configure_events);
+      xcb_flush(m_connection);
+   }
+   if (m_geometry_pending)
+   {
+      xcb_discard_reply(m_connection, m_pending_geometry.sequence);
+   }
 }
 
 bool surface::init()
@@ -63,12 +79,110 @@ bool surface::init()
    auto shm_reply = xcb_shm_query_version_reply(m_connection, shm_cookie, nullptr);
 
    m_has_shm = shm_reply != nullptr;
+   if (shm_reply != nullptr)
+   {
+      m_shm_major = shm_reply->major_version;
+      m_shm_minor = shm_reply->minor_version;
+   }
    free(shm_reply);
+
+   /* Query DRI3 and Present so the zero-copy presenter can be selected when the X server supports it. */
+   const xcb_query_extension_reply_t *dri3_ext = xcb_get_extension_data(m_connection, &xcb_dri3_id);
+   const xcb_query_extension_reply_t *present_ext = xcb_get_extension_data(m_connection, &xcb_present_id);
+   if (dri3_ext != nullptr && dri3_ext->present && present_ext != nullptr && present_ext->present)
+   {
+      auto dri3_cookie = xcb_dri3_query_version(m_connection, XCB_DRI3_MAJOR_VERSION, XCB_DRI3_MINOR_VERSION);
+      auto present_cookie =
+         xcb_present_query_version(m_connection, XCB_PRESENT_MAJOR_VERSION, XCB_PRESENT_MINOR_VERSION);
+
+      auto *dri3_reply = xcb_dri3_query_version_reply(m_connection, dri3_cookie, nullptr);
+      if (dri3_reply != nullptr)
+      {
+         m_dri3_major = dri3_reply->major_version;
+         m_dri3_minor = dri3_reply->minor_version;
+         free(dri3_reply);
+      }
+
+      auto *present_reply = xcb_present_query_version_reply(m_connection, present_cookie, nullptr);
+      if (present_reply != nullptr)
+      {
+         m_present_major = present_reply->major_version;
+         m_present_minor = present_reply->minor_version;
+         free(present_reply);
+      }
+   }
+
+   init_extent_cache();
    return true;
 }
 
+void surface::init_extent_cache()
+{
+   const xcb_query_extension_reply_t *present_ext = xcb_get_extension_data(m_connection, &xcb_present_id);
+   if (present_ext == nullptr || !present_ext->present)
+   {
+      return;
+   }
+
+   m_configure_event_id = xcb_generate_id(m_connection);
+   m_configure_events =
+      xcb_register_for_special_event(m_connection, &xcb_present_id, m_configure_event_id, nullptr);
+   if (m_configure_events == nullptr)
+   {
+      return;
+   }
+
+   /* Selected before the geometry is queried, so no change is missed in between. */
+   auto select_cookie = xcb_present_select_input_checked(m_connection, m_configure_event_id, m_window,
+                                                         XCB_PRESENT_EVENT_MASK_CONFIGURE_NOTIFY);
+   auto geometry_cookie = xcb_get_geometry(m_connection, m_window);
+   xcb_generic_error_t *error = xcb_request_check(m_connection, select_cookie);
+   auto *geometry = xcb_get_geometry_reply(m_connection, geometry_cookie, nullptr);
+   if (error != nullptr || geometry == nullptr)
+   {
+      free(error);
+      free(geometry);
+      xcb_unregister_for_special_event(m_connection, m_configure_events);
+      m_configure_events = nullptr;
+      return;
+   }
+
+   m_extent_sequence = geometry_cookie.sequence;
+   m_width = geometry->width;
+   m_height = geometry->height;
+   m_depth = geometry->depth;
+   free(geometry);
+}
+
+void surface::process_configure_events()
+{
+   while (auto *event = xcb_poll_for_special_event(m_connection, m_configure_events))
+   {
+      auto *configure = reinterpret_cast<xcb_present_configure_notify_event_t *>(event);
+      /* Sequence numbers wrap around, compare their difference. */
+      if (configure->event_type == XCB_PRESENT_EVENT_CONFIGURE_NOTIFY &&
+          static_cast<int32_t>(configure->full_sequence - m_extent_sequence) >= 0)
+      {
+         m_width = configure->width;
+         m_height = configure->height;
+      }
+      free(event);
+   }
+}
+
 bool surface::get_size_and_depth(uint32_t *width, uint32_t *height, int *depth)
 {
+   std::unique_lock<std::mutex> lock(m_extent_mutex);
+   if (m_configure_events != nullptr)
+   {
+      process_configure_events();
+      *width = m_width;
+      *height = m_height;
+      *depth = m_depth;
+      return true;
+   }
+   lock.unlock();
+
    auto cookie = xcb_get_geometry(m_connection, m_window);
    if (auto *geom = xcb_get_geometry_reply(m_connection, cookie, nullptr))
    {
@@ -81,6 +195,37 @@ bool surface::get_size_and_depth(uint32_t *width, uint32_t *height, int *depth)
    return false;
 }
 
+bool surface::get_size_async(uint32_t *width, uint32_t *height)
+{
+   std::lock_guard<std::mutex> lock(m_extent_mutex);
+   if (m_configure_events != nullptr)
+   {
+      process_configure_events();
+      *width = m_width;
+      *height = m_height;
+      return true;
+   }
+
+   /* The first call has no earlier query to use and waits for its own. The next query is sent with the requests
+    * of the present that follows, so its reply is usually there by the next call. */
+   if (!m_geometry_pending)
+   {
+      m_pending_geometry = xcb_get_geometry(m_connection, m_window);
+   }
+   auto *geometry = xcb_get_geometry_reply(m_connection, m_pending_geometry, nullptr);
+   m_pending_geometry = xcb_get_geometry(m_connection, m_window);
+   m_geometry_pending = true;
+   if (geometry == nullptr)
+   {
+      return false;
+   }
+
+   *width = geometry->width;
+   *height = geometry->height;
+   free(geometry);
+   return true;
+}
+
 wsi::surface_properties &surface::get_properties()
 {
    return properties;
@@ -27,9 +27,11 @@
  */
 
 #pragma once
+#include <mutex>
 #include <vulkan/vk_icd.h>
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
+#include <xcb/present.h>
 #include <xcb/shm.h>
 #include "wsi/surface.hpp"
 #include "surface_properties.hpp"
@@ -61,8 +63,26 @@ public:
    static util::unique_ptr<surface> make_surface(const util::allocator &allocator, xcb_connection_t *conn,
                                                  xcb_window_t window);
 
+   /**
+    * @brief Get the size and depth of the window.
+    *
+    * The size is kept up to date from Present ConfigureNotify events, so only X servers without Present cost a
+    * round trip per call. A destroyed window keeps reporting its last size, its presents fail instead.
+    *
+    * @return false if the geometry of the window could not be queried.
+    */
    bool get_size_and_depth(uint32_t *width, uint32_t *height, int *depth);
 
+   /**
+    * @brief Get the size of the window for a present, without a round trip per call.
+    *
+    * Same as @ref get_size_and_depth when the size is kept from ConfigureNotify events. Otherwise the reply to the
+    * geometry query sent by the previous call is used, so a resize is seen one call late.
+    *
+    * @return false if the geometry of the window could not be queried.
+    */
+   bool get_size_async(uint32_t *width, uint32_t *height);
+
    xcb_connection_t *get_connection()
    {
       return m_connection;
@@ -78,6 +98,30 @@ public:
       return m_has_shm;
    }
 
+   /**
+    * @brief Check whether SHM segments can be passed as file descriptors, which MIT-SHM 1.2 added.
+    */
+   bool has_shm_fd_passing() const
+   {
+      return m_has_shm && (m_shm_major > 1 || (m_shm_major == 1 && m_shm_minor >= 2));
+   }
+
+   /**
+    * @brief Check whether the X server supports at least the given DRI3 version.
+    */
+   bool has_dri3(uint32_t major, uint32_t minor) const
+   {
+      return m_dri3_major > major || (m_dri3_major == major && m_dri3_minor >= minor);
+   }
+
+   /**
+    * @brief Check whether the X server supports at least the given Present version.
+    */
+   bool has_present(uint32_t major, uint32_t minor) const
+   {
+      return m_present_major > major || (m_present_major == major && m_present_minor >= minor);
+   }
+
 private:
    xcb_connection_t *m_connection;
    xcb_window_t m_window;
@@ -86,6 +130,37 @@ private:
 
    /** X11 extension capabilities */
    bool m_has_shm = false;
+   uint32_t m_shm_major = 0;
+   uint32_t m_shm_minor = 0;
+   uint32_t m_dri3_major = 0;
+   uint32_t m_dri3_minor = 0;
+   uint32_t m_present_major = 0;
+   uint32_t m_present_minor = 0;
+
+   /**
+    * @brief Select Present ConfigureNotify events for the window and query its geometry once, to answer
+    *        @ref get_size_and_depth from then on without a round trip.
+    */
+   void init_extent_cache();
+
+   /**
+    * @brief Apply the ConfigureNotify events received since the last call. Called with @ref m_extent_mutex held.
+    */
+   void process_configure_events();
+
+   /** Guards the extent cache below, and the order in which its events are applied. */
+   std::mutex m_extent_mutex;
+   /** Queue of the ConfigureNotify events of the window, nullptr when the size is queried on every call. */
+   xcb_special_event_t *m_configure_events = nullptr;
+   xcb_present_event_t m_configure_event_id = 0;
+   /** Sequence of the geometry query, events generated before it are older than the cached size. */
+   uint32_t m_extent_sequence = 0;
+   uint32_t m_width = 0;
+   uint32_t m_height = 0;
+   int m_depth = 0;
+   /** Geometry query answering the next @ref get_size_async without ConfigureNotify events. */
+   xcb_get_geometry_cookie_t m_pending_geometry = {};
+   bool m_geometry_pending = false;
 };
 
 } /* namespace x11 */
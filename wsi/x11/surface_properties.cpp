@@ -40,6 +40,8 @@
 
 #include "surface_properties.hpp"
 #include "surface.hpp"
+#include "dri3_presenter.hpp"
+#include "image_present_copy.hpp"
 #include "util/macros.hpp"
 
 namespace wsi
@@ -49,16 +51,21 @@ namespace x11
 
 void surface_properties::populate_present_mode_compatibilities()
 {
-   std::array<present_mode_compatibility, 2> compatible_present_modes_list = {
+   std::array<present_mode_compatibility, 4> compatible_present_modes_list = {
       present_mode_compatibility{ VK_PRESENT_MODE_FIFO_KHR, 1, { VK_PRESENT_MODE_FIFO_KHR } },
-      present_mode_compatibility{ VK_PRESENT_MODE_MAILBOX_KHR, 1, { VK_PRESENT_MODE_MAILBOX_KHR } }
+      present_mode_compatibility{ VK_PRESENT_MODE_MAILBOX_KHR, 1, { VK_PRESENT_MODE_MAILBOX_KHR } },
+      present_mode_compatibility{
+         VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR, 1, { VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR } },
+      present_mode_compatibility{
+         VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR, 1, { VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR } }
    };
-   m_compatible_present_modes = compatible_present_modes<2>(compatible_present_modes_list);
+   m_compatible_present_modes = compatible_present_modes<4>(compatible_present_modes_list);
 }
 
 surface_properties::surface_properties(surface *wsi_surface, const util::allocator &allocator)
    : specific_surface(wsi_surface)
-   , m_supported_modes({ VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR })
+   , m_supported_modes({ VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR,
+                         VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR, VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR })
 {
    UNUSED(allocator);
    populate_present_mode_compatibilities();
@@ -117,26 +124,47 @@ VkResult surface_properties::get_surface_capabilities(VkPhysicalDevice physical_
    return VK_SUCCESS;
 }
 
-std::vector<VkFormat> support_formats {
-   VK_FORMAT_B8G8R8A8_UNORM, 
-   VK_FORMAT_B8G8R8A8_SRGB
+/* RGBA images are converted by the DRI3 present copy or swizzled by the SHM presenter. Formats are reported in
+ * reverse, so BGRA stays preferred. */
+static const std::array<VkFormat, 4> support_formats = {
+   VK_FORMAT_R8G8B8A8_UNORM,
+   VK_FORMAT_R8G8B8A8_SRGB,
+   VK_FORMAT_B8G8R8A8_UNORM,
+   VK_FORMAT_B8G8R8A8_SRGB,
+};
+
+/* Formats only the DRI3 presenter shows, through a converting GPU copy, see image_present_copy. Swapchains that
+ * cannot use it, e.g. protected, shared or scaled ones, fail to create with them. */
+static const VkFormat gpu_conversion_formats[] = {
+   VK_FORMAT_A2B10G10R10_UNORM_PACK32,
+   VK_FORMAT_A2R10G10B10_UNORM_PACK32,
+   VK_FORMAT_R16G16B16A16_SFLOAT,
 };
 
 VkResult surface_properties::get_surface_formats(VkPhysicalDevice physical_device, uint32_t *surface_format_count,
                                                  VkSurfaceFormatKHR *surface_formats,
                                                  VkSurfaceFormat2KHR *extended_surface_formats)
 {
-   UNUSED(physical_device);
-   std::vector<surface_format_properties> formats;
-   for (auto &format : support_formats)
+   std::array<surface_format_properties, std::size(support_formats) + std::size(gpu_conversion_formats)> formats{};
+   size_t format_count = 0;
+   for (auto it = support_formats.rbegin(); it != support_formats.rend(); ++it)
+   {
+      formats[format_count++] = surface_format_properties{ *it };
+   }
+
+   if (specific_surface != nullptr && image_present_copy::is_conversion_enabled() &&
+       dri3_presenter::is_available(specific_surface->get_connection(), specific_surface))
    {
-      if (format != VK_FORMAT_UNDEFINED)
+      for (auto format : gpu_conversion_formats)
       {
-         formats.insert(formats.begin(), (surface_format_properties){ format });
+         if (image_present_copy::is_conversion_supported(physical_device, format))
+         {
+            formats[format_count++] = surface_format_properties{ format };
+         }
       }
    }
-   return surface_properties_formats_helper(formats.begin(), formats.end(), surface_format_count, surface_formats,
-                                            extended_surface_formats);
+   return surface_properties_formats_helper(formats.begin(), formats.begin() + format_count, surface_format_count,
+                                            surface_formats, extended_surface_formats);
 }
 
 VkResult surface_properties::get_surface_present_modes(VkPhysicalDevice physical_device, VkSurfaceKHR surface,
@@ -337,9 +365,14 @@ bool surface_properties::is_surface_extension_enabled(const layer::instance_priv
 void surface_properties::get_surface_present_scaling_and_gravity(
    VkSurfacePresentScalingCapabilitiesEXT *scaling_capabilities)
 {
-   scaling_capabilities->supportedPresentScaling = 0;
-   scaling_capabilities->supportedPresentGravityX = 0;
-   scaling_capabilities->supportedPresentGravityY = 0;
+   /* Scaling is done on the CPU by the SHM presenter. */
+   scaling_capabilities->supportedPresentScaling = VK_PRESENT_SCALING_ONE_TO_ONE_BIT_EXT |
+                                                   VK_PRESENT_SCALING_ASPECT_RATIO_STRETCH_BIT_EXT |
+                                                   VK_PRESENT_SCALING_STRETCH_BIT_EXT;
+   scaling_capabilities->supportedPresentGravityX =
+      VK_PRESENT_GRAVITY_MIN_BIT_EXT | VK_PRESENT_GRAVITY_MAX_BIT_EXT | VK_PRESENT_GRAVITY_CENTERED_BIT_EXT;
+   scaling_capabilities->supportedPresentGravityY =
+      VK_PRESENT_GRAVITY_MIN_BIT_EXT | VK_PRESENT_GRAVITY_MAX_BIT_EXT | VK_PRESENT_GRAVITY_CENTERED_BIT_EXT;
 }
 
 bool surface_properties::is_compatible_present_modes(VkPresentModeKHR present_mode_a, VkPresentModeKHR present_mode_b)
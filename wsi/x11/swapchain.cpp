@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2017-2022 Arm Limited.
+ * Copyright (c) 2017-2022, 2025 Arm Limited.
  *
  * SPDX-License-Identifier: MIT
  *
@@ -28,34 +28,45 @@
  * @brief Contains the implementation for a x11 swapchain.
  */
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <condition_variable>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <system_error>
 #include <thread>
 
 #include <dlfcn.h>
+#include <drm_fourcc.h>
 #include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <util/timed_semaphore.hpp>
 #include <vulkan/vulkan_core.h>
 
 #include <xcb/dri3.h>
+#include <xcb/present.h>
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
 
 #include "drm_display.hpp"
+#include "randr_topology.hpp"
 #include "swapchain.hpp"
+#include "window_visibility.hpp"
 #include "util/log.hpp"
 #include "util/macros.hpp"
+#include "util/scratch_allocator.hpp"
+#include "util/thread_scheduling.hpp"
+#include "util/tuning_profile.hpp"
 #include "wsi/external_memory.hpp"
 #include "wsi/swapchain_base.hpp"
 #include "wsi/extensions/present_id.hpp"
+#include "wsi/extensions/swapchain_maintenance.hpp"
 #include "shm_presenter.hpp"
 
 namespace wsi
@@ -63,8 +74,6 @@ namespace wsi
 namespace x11
 {
 
-#define X11_SWAPCHAIN_MAX_PENDING_COMPLETIONS 128
-
 swapchain::swapchain(layer::device_private_data &dev_data, const VkAllocationCallbacks *pAllocator,
                      surface &wsi_surface)
    : swapchain_base(dev_data, pAllocator)
@@ -72,9 +81,13 @@ swapchain::swapchain(layer::device_private_data &dev_data, const VkAllocationCal
    , m_window(wsi_surface.get_window())
    , m_wsi_surface(&wsi_surface)
    , m_wsi_allocator(nullptr)
+   , m_wsialloc_batch(m_allocator, m_device_data.get_allocation_stats())
    , m_image_creation_parameters({}, m_allocator, {}, {})
    , m_send_sbc(0)
-   , m_target_msc(0)
+   , m_last_vblank_msc(0)
+   , m_last_vblank_ns(0)
+   , m_refresh_ns(0)
+   , m_last_shm_visible_ns(0)
    , m_thread_status_lock()
    , m_thread_status_cond()
 {
@@ -91,6 +104,12 @@ swapchain::~swapchain()
       m_thread_status_cond.notify_all();
       thread_status_lock.unlock();
 
+      if (m_dri3_presenter != nullptr)
+      {
+         /* The event thread may be blocked on the Present event queue rather than on the condition variable. */
+         m_dri3_presenter->wake_event_waiter();
+      }
+
       if (m_present_event_thread.joinable())
       {
          m_present_event_thread.join();
@@ -103,13 +122,29 @@ swapchain::~swapchain()
 
    /* Call the base's teardown */
    teardown();
+
+   if (m_throttle_hidden)
+   {
+      window_visibility::get_instance().unwatch_window(m_connection, m_window);
+   }
+
+   if (m_dri3_presenter != nullptr)
+   {
+      /* Points set by the past presents stay valid, the X server still signals the release points. */
+      m_dri3_presenter->free_syncobj(m_acquire_syncobj);
+      m_dri3_presenter->free_syncobj(m_release_syncobj);
+   }
+
+   if (m_copy_pool != VK_NULL_HANDLE)
+   {
+      m_device_data.disp.DestroyCommandPool(m_device, m_copy_pool, get_allocation_callbacks());
+   }
 }
 
 VkResult swapchain::init_platform(VkDevice device, const VkSwapchainCreateInfoKHR *swapchain_create_info,
                                   bool &use_presentation_thread)
 {
    UNUSED(device);
-   UNUSED(swapchain_create_info);
    m_device_data.instance_data.disp.GetPhysicalDeviceMemoryProperties2KHR(m_device_data.physical_device,
                                                                           &m_memory_props);
    if (m_wsi_surface == nullptr)
@@ -125,21 +160,143 @@ VkResult swapchain::init_platform(VkDevice device, const VkSwapchainCreateInfoKH
       return VK_ERROR_INITIALIZATION_FAILED;
    }
 
+   /* Only the SHM presenter can scale, DRI3 pixmaps are shown as they are. */
+   const auto *present_scaling_info = util::find_extension<VkSwapchainPresentScalingCreateInfoEXT>(
+      VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_SCALING_CREATE_INFO_EXT, swapchain_create_info->pNext);
+   const bool present_scaling = present_scaling_info != nullptr && present_scaling_info->scalingBehavior != 0;
+
+   /* DRI3 pixmaps are scanned out in the visual's channel order and depth, other formats are converted by the GPU
+    * copy of image_present_copy, or swizzled by the SHM presenter. Protected images cannot be copied into the
+    * unprotected dma-bufs. WSI_X11_GPU_CONVERSION=0 leaves the conversion to the SHM presenter. */
+   const VkFormat presentable_format = image_present_copy::get_presentable_format(swapchain_create_info->imageFormat);
+   const bool convert_format = presentable_format != swapchain_create_info->imageFormat;
+   const bool protected_images = (swapchain_create_info->flags & VK_SWAPCHAIN_CREATE_PROTECTED_BIT_KHR) != 0;
+   const bool gpu_conversion =
+      convert_format && !protected_images && image_present_copy::is_conversion_enabled() &&
+      image_present_copy::is_conversion_supported(m_device_data.physical_device, swapchain_create_info->imageFormat) &&
+      image_present_copy::is_supported(m_device_data, swapchain_create_info->imageFormat,
+                                       swapchain_create_info->imageUsage);
+
+   /* A shared image is put by the SHM presenter from where it is rendered, damage by damage, DRI3 would scan out
+    * the pixmap while it is written. */
+   const bool shared_present_mode = m_present_mode == VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR ||
+                                    m_present_mode == VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR;
+
    try
    {
-      m_shm_presenter = std::make_unique<shm_presenter>();
+      if (!present_scaling && (!convert_format || gpu_conversion) && !shared_present_mode &&
+          is_dri3_presentation_supported())
+      {
+         /* Before querying the modifiers, which are the window's own once the compositor unredirected it. */
+         request_compositor_bypass();
 
-      if (!m_shm_presenter->is_available(m_connection, m_wsi_surface))
+         m_dri3_presenter = std::make_unique<dri3_presenter>();
+         if (m_dri3_presenter->init(m_connection, m_window, m_wsi_surface) != VK_SUCCESS)
+         {
+            WSI_LOG_WARNING("Failed to initialize DRI3 presenter, falling back to SHM");
+            m_dri3_presenter.reset();
+         }
+         else
+         {
+            const double refresh_rate = randr_topology::get_instance(m_connection).get_refresh_rate(m_window);
+            m_refresh_ns = refresh_rate > 0.0 ? static_cast<uint64_t>(1000000000.0 / refresh_rate) : 0;
+
+            m_linear_present_copy = !protected_images && is_prime_copy_needed() &&
+                                    image_present_copy::is_supported(m_device_data, swapchain_create_info->imageFormat,
+                                                                     swapchain_create_info->imageUsage);
+            if ((gpu_conversion || m_linear_present_copy) &&
+                image_readback::create_command_pool(m_device_data, m_allocator, &m_copy_pool) == VK_SUCCESS)
+            {
+               m_present_copy = true;
+               WSI_LOG_INFO("DRI3 presenter copies frames into %s buffers of format %d",
+                            m_linear_present_copy ? "linear display GPU" : "presentable",
+                            static_cast<int>(presentable_format));
+            }
+            else if (convert_format)
+            {
+               WSI_LOG_WARNING("DRI3 presenter cannot convert the swapchain format, falling back to SHM");
+               m_dri3_presenter.reset();
+               m_refresh_ns = 0;
+            }
+            m_linear_present_copy = m_linear_present_copy && m_present_copy;
+            m_convert_format = convert_format && m_present_copy;
+         }
+      }
+
+      /* Advertised because the DRI3 presenter is available, but this swapchain cannot use it and the SHM presenter
+       * cannot convert the format. */
+      if (m_dri3_presenter == nullptr &&
+          image_present_copy::is_conversion_only_format(swapchain_create_info->imageFormat))
       {
-         WSI_LOG_ERROR("SHM presenter is not available");
+         WSI_LOG_ERROR("Format %d can only be presented by the DRI3 presenter, which this swapchain cannot use",
+                       static_cast<int>(swapchain_create_info->imageFormat));
          return VK_ERROR_INITIALIZATION_FAILED;
       }
 
-      VkResult init_result = m_shm_presenter->init(m_connection, m_window, m_wsi_surface);
-      if (init_result != VK_SUCCESS)
+      if (m_dri3_presenter == nullptr)
       {
-         WSI_LOG_ERROR("Failed to initialize SHM presenter");
-         return init_result;
+         /* Without MIT-SHM, on remote and forwarded displays, the presenter sends the frames in PutImage requests. */
+         m_shm_presenter = std::make_unique<shm_presenter>();
+         m_shm_presenter->set_memory_accounting(m_allocator.m_accounting);
+
+         /* Segments released by the swapchain being replaced are reused rather than created again. */
+         std::shared_ptr<shm_segment_pool> segment_pool;
+         if (swapchain_create_info->oldSwapchain != VK_NULL_HANDLE)
+         {
+            auto *ancestor = reinterpret_cast<swapchain *>(swapchain_create_info->oldSwapchain);
+            if (ancestor->m_shm_presenter != nullptr)
+            {
+               segment_pool = ancestor->m_shm_presenter->get_segment_pool();
+            }
+         }
+
+         VkResult init_result = m_shm_presenter->init(m_connection, m_window, m_wsi_surface, std::move(segment_pool));
+         if (init_result != VK_SUCCESS)
+         {
+            WSI_LOG_ERROR("Failed to initialize SHM presenter");
+            return init_result;
+         }
+
+         uint32_t window_width = 0;
+         uint32_t window_height = 0;
+         int depth = 0;
+         if (!m_wsi_surface->get_size_and_depth(&window_width, &window_height, &depth))
+         {
+            WSI_LOG_ERROR("Failed to query the window depth for SHM presentation");
+            return VK_ERROR_SURFACE_LOST_KHR;
+         }
+         TRY(m_shm_presenter->set_image_format(swapchain_create_info->imageFormat, depth));
+
+         if (present_scaling)
+         {
+            m_shm_presenter->set_present_scaling(present_scaling_info->scalingBehavior,
+                                                 present_scaling_info->presentGravityX,
+                                                 present_scaling_info->presentGravityY);
+         }
+
+         /* Imported images are put as they were rendered, which leaves no room for a conversion. */
+         m_shm_host_import =
+            !m_shm_presenter->needs_conversion() && is_shm_host_import_supported(swapchain_create_info);
+         if (m_shm_host_import)
+         {
+            WSI_LOG_INFO("SHM presenter imports the segments as image memory");
+         }
+
+         /* Without an import the CPU reads every presented frame, let the GPU copy it to cached memory first.
+          * WSI_X11_GPU_READBACK=0 keeps the CPU reading the image memory directly. A shared image is read where it
+          * is rendered, continuous refreshes have no payload to copy it with and the damage is small. */
+         const char *readback_env = std::getenv("WSI_X11_GPU_READBACK");
+         if (!m_shm_host_import && !shared_present_mode &&
+             (readback_env == nullptr || std::strcmp(readback_env, "0") != 0) &&
+             image_readback::is_supported(m_device_data, swapchain_create_info->imageFormat,
+                                          swapchain_create_info->imageUsage) &&
+             image_readback::create_command_pool(m_device_data, m_allocator, &m_copy_pool) == VK_SUCCESS)
+         {
+            m_gpu_readback = true;
+            WSI_LOG_INFO("SHM presenter reads frames back through host cached buffers");
+         }
+
+         m_shm_presenter->set_change_tracking(m_present_mode == VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR);
       }
    }
    catch (const std::exception &e)
@@ -149,6 +306,25 @@ VkResult swapchain::init_platform(VkDevice device, const VkSwapchainCreateInfoKH
       return VK_ERROR_INITIALIZATION_FAILED;
    }
 
+   if (m_dri3_presenter != nullptr && init_syncobj_timelines())
+   {
+      WSI_LOG_INFO("DRI3 presents synchronized with DRM syncobj timelines");
+   }
+
+   /* Otherwise payloads are only waited for on the host, never exported, so one timeline semaphore can replace the
+    * per-image fences when the application enabled the feature. */
+   if (!m_syncobj_timelines && m_device_data.is_timeline_semaphore_enabled())
+   {
+      m_present_timeline = timeline_semaphore::create(m_device_data);
+   }
+
+   /* A shared image is never released by a present, there is nothing to throttle. */
+   if (util::tuning_profile::get().hidden_present_interval_ms != 0 && !shared_present_mode)
+   {
+      window_visibility::get_instance().watch_window(m_connection, m_window);
+      m_throttle_hidden = true;
+   }
+
    try
    {
       m_present_event_thread = std::thread(&swapchain::present_event_thread, this);
@@ -163,15 +339,227 @@ VkResult swapchain::init_platform(VkDevice device, const VkSwapchainCreateInfoKH
    }
 
    /*
-    * When VK_PRESENT_MODE_MAILBOX_KHR has been chosen by the application we don't
-    * initialize the page flip thread so the present_image function can be called
-    * during vkQueuePresent.
+    * Presents always go through the page flip thread, so vkQueuePresent never waits for rendering, the copy or the
+    * pacing. In VK_PRESENT_MODE_MAILBOX_KHR the MIT-SHM presenter only copies the latest frame queued when the
+    * thread gets to it, DRI3 leaves replacing queued frames to the X server.
     */
-   use_presentation_thread = (m_present_mode != VK_PRESENT_MODE_MAILBOX_KHR);
+   use_presentation_thread = true;
+   m_mailbox_slot_enabled = (m_dri3_presenter == nullptr) && (m_present_mode == VK_PRESENT_MODE_MAILBOX_KHR);
 
    return VK_SUCCESS;
 }
 
+bool swapchain::is_dri3_presentation_supported()
+{
+   if (!dri3_presenter::is_available(m_connection, m_wsi_surface))
+   {
+      return false;
+   }
+
+   return m_device_data.is_device_extension_enabled(VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME) &&
+          m_device_data.is_device_extension_enabled(VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME);
+}
+
+/**
+ * @brief Intern an atom, XCB_ATOM_NONE on failure.
+ */
+static xcb_atom_t intern_atom(xcb_connection_t *connection, const char *name)
+{
+   auto cookie = xcb_intern_atom(connection, 0, static_cast<uint16_t>(std::strlen(name)), name);
+   auto *reply = xcb_intern_atom_reply(connection, cookie, nullptr);
+   if (reply == nullptr)
+   {
+      return XCB_ATOM_NONE;
+   }
+   const xcb_atom_t atom = reply->atom;
+   free(reply);
+   return atom;
+}
+
+void swapchain::request_compositor_bypass()
+{
+   const char *bypass_env = std::getenv("WSI_X11_BYPASS_COMPOSITOR");
+   if (bypass_env != nullptr && std::strcmp(bypass_env, "0") == 0)
+   {
+      return;
+   }
+
+   const xcb_atom_t bypass_atom = intern_atom(m_connection, "_NET_WM_BYPASS_COMPOSITOR");
+   const xcb_atom_t state_atom = intern_atom(m_connection, "_NET_WM_STATE");
+   const xcb_atom_t fullscreen_atom = intern_atom(m_connection, "_NET_WM_STATE_FULLSCREEN");
+   if (bypass_atom == XCB_ATOM_NONE || state_atom == XCB_ATOM_NONE || fullscreen_atom == XCB_ATOM_NONE)
+   {
+      return;
+   }
+
+   auto bypass_cookie = xcb_get_property(m_connection, 0, m_window, bypass_atom, XCB_ATOM_CARDINAL, 0, 1);
+   auto state_cookie = xcb_get_property(m_connection, 0, m_window, state_atom, XCB_ATOM_ATOM, 0, 64);
+   auto geometry_cookie = xcb_get_geometry(m_connection, m_window);
+
+   auto *bypass_reply = xcb_get_property_reply(m_connection, bypass_cookie, nullptr);
+   const bool hint_set = bypass_reply != nullptr && bypass_reply->type != XCB_ATOM_NONE;
+   free(bypass_reply);
+
+   /* Fullscreen as managed by the window manager, or covering the whole root window as override-redirect windows
+    * do. */
+   bool fullscreen = false;
+   auto *state_reply = xcb_get_property_reply(m_connection, state_cookie, nullptr);
+   if (state_reply != nullptr)
+   {
+      const auto *states = static_cast<const xcb_atom_t *>(xcb_get_property_value(state_reply));
+      const int count = xcb_get_property_value_length(state_reply) / static_cast<int>(sizeof(xcb_atom_t));
+      fullscreen = std::find(states, states + count, fullscreen_atom) != states + count;
+      free(state_reply);
+   }
+
+   auto *geometry = xcb_get_geometry_reply(m_connection, geometry_cookie, nullptr);
+   if (geometry != nullptr && !fullscreen)
+   {
+      auto *root = xcb_get_geometry_reply(m_connection, xcb_get_geometry(m_connection, geometry->root), nullptr);
+      fullscreen = root != nullptr && geometry->width == root->width && geometry->height == root->height;
+      free(root);
+   }
+   free(geometry);
+
+   if (hint_set || !fullscreen)
+   {
+      return;
+   }
+
+   const uint32_t bypass = 1;
+   xcb_change_property(m_connection, XCB_PROP_MODE_REPLACE, m_window, bypass_atom, XCB_ATOM_CARDINAL, 32, 1,
+                       &bypass);
+   xcb_flush(m_connection);
+   WSI_LOG_INFO("Asked the compositor to unredirect the fullscreen window");
+}
+
+bool swapchain::is_prime_copy_needed()
+{
+   const char *prime_env = std::getenv("WSI_X11_PRIME");
+   if (prime_env != nullptr)
+   {
+      return std::strcmp(prime_env, "0") != 0;
+   }
+
+   /* The X server names the GPU it displays from, servers without DRI3Open support fall back to the DRM display. */
+   dev_t display_device = 0;
+   if (!m_dri3_presenter->get_device(&display_device))
+   {
+      const auto &display = drm_display::get_display();
+      struct stat drm_stat = {};
+      if (!display.has_value() || fstat(display->get_drm_fd(), &drm_stat) != 0)
+      {
+         return false;
+      }
+      display_device = drm_stat.st_rdev;
+   }
+
+   return image_present_copy::is_other_device(m_device_data, display_device);
+}
+
+bool swapchain::init_syncobj_timelines()
+{
+   if (!m_dri3_presenter->supports_syncobj() || !m_device_data.is_timeline_semaphore_enabled() ||
+       !m_device_data.is_device_extension_enabled(VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME) ||
+       !timeline_semaphore::is_export_supported(m_device_data))
+   {
+      return false;
+   }
+
+   m_acquire_timeline = timeline_semaphore::create(m_device_data, true);
+   m_release_timeline = timeline_semaphore::create(m_device_data, true);
+   if (m_acquire_timeline.has_value() && m_release_timeline.has_value())
+   {
+      auto acquire_fd = m_acquire_timeline->export_opaque_fd();
+      auto release_fd = m_release_timeline->export_opaque_fd();
+      if (acquire_fd.has_value() && release_fd.has_value())
+      {
+         m_acquire_syncobj = m_dri3_presenter->import_syncobj(acquire_fd->release());
+         m_release_syncobj = m_dri3_presenter->import_syncobj(release_fd->release());
+      }
+   }
+
+   if (m_acquire_syncobj == 0 || m_release_syncobj == 0)
+   {
+      WSI_LOG_WARNING("Failed to set up syncobj timelines, waiting for present payloads on the CPU.");
+      m_dri3_presenter->free_syncobj(m_acquire_syncobj);
+      m_dri3_presenter->free_syncobj(m_release_syncobj);
+      m_acquire_syncobj = 0;
+      m_release_syncobj = 0;
+      m_acquire_timeline.reset();
+      m_release_timeline.reset();
+      return false;
+   }
+
+   m_syncobj_timelines = true;
+   return true;
+}
+
+bool swapchain::is_shm_host_import_supported(const VkSwapchainCreateInfoKHR *swapchain_create_info)
+{
+   if (!m_device_data.is_device_extension_enabled(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME))
+   {
+      return false;
+   }
+
+   VkPhysicalDeviceExternalMemoryHostPropertiesEXT host_props = {};
+   host_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+   VkPhysicalDeviceProperties2KHR device_props = {};
+   device_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+   device_props.pNext = &host_props;
+   m_device_data.instance_data.disp.GetPhysicalDeviceProperties2KHR(m_device_data.physical_device, &device_props);
+
+   /* Segments come from shmat(), so they are only guaranteed to be page aligned. */
+   const long page_size = sysconf(_SC_PAGESIZE);
+   const VkDeviceSize alignment = host_props.minImportedHostPointerAlignment;
+   if (alignment == 0 || page_size <= 0 || alignment > static_cast<VkDeviceSize>(page_size) ||
+       (alignment & (alignment - 1)) != 0)
+   {
+      return false;
+   }
+
+   VkPhysicalDeviceExternalImageFormatInfoKHR external_info = {};
+   external_info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_IMAGE_FORMAT_INFO_KHR;
+   external_info.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+   VkPhysicalDeviceImageFormatInfo2KHR image_info = {};
+   image_info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2_KHR;
+   image_info.pNext = &external_info;
+   image_info.format = swapchain_create_info->imageFormat;
+   image_info.type = VK_IMAGE_TYPE_2D;
+   image_info.tiling = VK_IMAGE_TILING_LINEAR;
+   image_info.usage = swapchain_create_info->imageUsage;
+   image_info.flags = 0;
+
+   VkExternalImageFormatPropertiesKHR external_props = {};
+   external_props.sType = VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES_KHR;
+   VkImageFormatProperties2KHR format_props = {};
+   format_props.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2_KHR;
+   format_props.pNext = &external_props;
+
+   VkResult result = util::get_image_format_properties(m_device_data.physical_device, image_info, format_props);
+   if (result != VK_SUCCESS)
+   {
+      return false;
+   }
+
+   if (format_props.imageFormatProperties.maxExtent.width < swapchain_create_info->imageExtent.width ||
+       format_props.imageFormatProperties.maxExtent.height < swapchain_create_info->imageExtent.height ||
+       format_props.imageFormatProperties.maxArrayLayers < swapchain_create_info->imageArrayLayers)
+   {
+      return false;
+   }
+
+   if ((external_props.externalMemoryProperties.externalMemoryFeatures &
+        VK_EXTERNAL_MEMORY_FEATURE_IMPORTABLE_BIT_KHR) == 0)
+   {
+      return false;
+   }
+
+   m_host_import_alignment = alignment;
+   return true;
+}
+
 VkResult swapchain::get_surface_compatible_formats(const VkImageCreateInfo &info,
                                                    util::vector<wsialloc_format> &importable_formats,
                                                    util::vector<uint64_t> &exportable_modifers,
@@ -180,8 +568,7 @@ VkResult swapchain::get_surface_compatible_formats(const VkImageCreateInfo &info
    TRY_LOG(util::get_drm_format_properties(m_device_data.physical_device, info.format, drm_format_props),
            "Failed to get format properties");
 
-   auto &display = drm_display::get_display();
-   if (!display.has_value())
+   if (m_dri3_presenter == nullptr && !drm_display::get_display().has_value())
    {
       WSI_LOG_ERROR("DRM display not available.");
       return VK_ERROR_OUT_OF_HOST_MEMORY;
@@ -191,7 +578,23 @@ VkResult swapchain::get_surface_compatible_formats(const VkImageCreateInfo &info
    {
       drm_format_pair drm_format{ util::drm::vk_to_drm_format(info.format), prop.drmFormatModifier };
 
-      if (!display->is_format_supported(drm_format))
+      /* The display GPU only reliably reads the copies of PRIME presents in linear layout. */
+      if (m_linear_present_copy && drm_format.modifier != DRM_FORMAT_MOD_LINEAR)
+      {
+         continue;
+      }
+
+      /* Converting copies are blits. */
+      if (m_convert_format && (prop.drmFormatModifierTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT) == 0)
+      {
+         continue;
+      }
+
+      /* With DRI3 the X server reports the modifiers it can import, otherwise ask the DRM display. */
+      const bool supported = (m_dri3_presenter != nullptr) ?
+                                m_dri3_presenter->is_modifier_supported(drm_format.modifier) :
+                                drm_display::get_display()->is_format_supported(drm_format);
+      if (!supported)
       {
          continue;
       }
@@ -234,14 +637,13 @@ VkResult swapchain::get_surface_compatible_formats(const VkImageCreateInfo &info
             m_image_compression_control_params.compression_control_plane_count;
          compression_control.pFixedRateFlags = m_image_compression_control_params.fixed_rate_flags.data();
 
-         if (m_device_data.is_swapchain_compression_control_enabled())
+         if (m_device_data.is_swapchain_compression_control_enabled() && !m_present_copy)
          {
             compression_control.pNext = image_info.pNext;
             image_info.pNext = &compression_control;
          }
 #endif
-         result = m_device_data.instance_data.disp.GetPhysicalDeviceImageFormatProperties2KHR(
-            m_device_data.physical_device, &image_info, &format_props);
+         result = util::get_image_format_properties(m_device_data.physical_device, image_info, format_props);
       }
       if (result != VK_SUCCESS)
       {
@@ -306,6 +708,9 @@ VkResult swapchain::allocate_wsialloc(VkImageCreateInfo &image_create_info, x11_
    }
 #endif
 
+   util::drm::sort_formats_by_scanout_cost(importable_formats.data(), importable_formats.size(),
+                                           (allocation_flags & WSIALLOC_ALLOCATE_HIGHEST_FIXED_RATE_COMPRESSION) != 0);
+
    wsialloc_allocate_info alloc_info = { importable_formats.data(), static_cast<unsigned>(importable_formats.size()),
                                          image_create_info.extent.width, image_create_info.extent.height,
                                          allocation_flags };
@@ -317,7 +722,8 @@ VkResult swapchain::allocate_wsialloc(VkImageCreateInfo &image_create_info, x11_
       alloc_result.buffer_fds[i] = -1;
       alloc_result.average_row_strides[i] = -1;
    }
-   const auto res = wsialloc_alloc(m_wsi_allocator, &alloc_info, &alloc_result);
+   const uint32_t batch_size = avoid_allocation ? 1 : get_pending_allocation_count();
+   const auto res = m_wsialloc_batch.allocate(m_wsi_allocator, alloc_info, batch_size, &alloc_result);
    if (res != WSIALLOC_ERROR_NONE)
    {
       WSI_LOG_ERROR("Failed allocation of DMA Buffer. WSI error: %d", static_cast<int>(res));
@@ -332,6 +738,11 @@ VkResult swapchain::allocate_wsialloc(VkImageCreateInfo &image_create_info, x11_
    external_memory.set_strides(alloc_result.average_row_strides);
    external_memory.set_buffer_fds(alloc_result.buffer_fds);
    external_memory.set_offsets(alloc_result.offsets);
+   external_memory.set_memory_source(m_wsi_allocator, allocation_flags, is_protected_memory);
+   if (!alloc_result.is_disjoint)
+   {
+      external_memory.keep_recycle_fd();
+   }
 
    uint32_t num_planes = util::drm::drm_fourcc_format_get_num_planes(alloc_result.format.fourcc);
 
@@ -358,29 +769,57 @@ VkResult swapchain::allocate_wsialloc(VkImageCreateInfo &image_create_info, x11_
    return VK_SUCCESS;
 }
 
+static VkResult fill_image_create_info(VkImageCreateInfo &image_create_info,
+                                       util::vector<VkSubresourceLayout> &image_plane_layouts,
+                                       VkImageDrmFormatModifierExplicitCreateInfoEXT &drm_mod_info,
+                                       VkExternalMemoryImageCreateInfoKHR &external_info,
+                                       x11_image_data &image_data, uint64_t modifier)
+{
+   TRY_LOG_CALL(image_data.external_mem.fill_image_plane_layouts(image_plane_layouts));
+
+   if (image_data.external_mem.is_disjoint())
+   {
+      image_create_info.flags |= VK_IMAGE_CREATE_DISJOINT_BIT;
+   }
+
+   image_data.external_mem.fill_drm_mod_info(image_create_info.pNext, drm_mod_info, image_plane_layouts, modifier);
+   image_data.external_mem.fill_external_info(external_info, &drm_mod_info);
+   image_create_info.pNext = &external_info;
+   image_create_info.tiling = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT;
+   return VK_SUCCESS;
+}
+
 VkResult swapchain::allocate_image(VkImageCreateInfo &image_create_info, x11_image_data *image_data)
 {
    UNUSED(image_create_info);
-   util::vector<wsialloc_format> importable_formats(util::allocator(m_allocator, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND));
+   util::scratch_scope scratch(m_allocator);
+   util::vector<wsialloc_format> importable_formats(scratch.get_allocator());
    auto &m_allocated_format = m_image_creation_parameters.m_allocated_format;
    if (!importable_formats.try_push_back(m_allocated_format))
    {
       return VK_ERROR_OUT_OF_HOST_MEMORY;
    }
-   TRY_LOG_CALL(allocate_wsialloc(m_image_create_info, image_data, importable_formats, &m_allocated_format, false));
+   VkImageCreateInfo &buffer_info =
+      m_present_copy ? m_image_creation_parameters.m_present_image_info : m_image_create_info;
+   TRY_LOG_CALL(allocate_wsialloc(buffer_info, image_data, importable_formats, &m_allocated_format, false));
 
    return VK_SUCCESS;
 }
 
 VkResult swapchain::allocate_and_bind_swapchain_image(VkImageCreateInfo image_create_info, swapchain_image &image)
 {
-   std::unique_lock<std::recursive_mutex> image_status_lock(m_image_status_mutex);
-   image.status = swapchain_image::FREE;
+   {
+      std::lock_guard<std::recursive_mutex> image_status_lock(m_image_status_mutex);
+      set_image_status(image, swapchain_image::FREE);
+   }
 
    assert(image.data != nullptr);
    auto image_data = static_cast<x11_image_data *>(image.data);
-
-   image_status_lock.unlock();
+   if (m_dri3_presenter)
+   {
+      std::lock_guard<std::mutex> allocation_lock(m_image_allocation_mutex);
+      TRY_LOG(allocate_image(image_create_info, image_data), "Failed to allocate image");
+   }
 
    uint32_t width = image_create_info.extent.width;
    uint32_t height = image_create_info.extent.height;
@@ -392,8 +831,69 @@ VkResult swapchain::allocate_and_bind_swapchain_image(VkImageCreateInfo image_cr
       WSI_LOG_WARNING("Could not get surface depth, using default: %d", depth);
    }
    
-   TRY_LOG(m_shm_presenter->create_image_resources(image_data, width, height, depth),
-           "Failed to create presentation image resources");
+   if (m_dri3_presenter)
+   {
+      TRY_LOG(m_dri3_presenter->create_image_resources(image_data, width, height, depth,
+                                                       m_image_creation_parameters.m_allocated_format.modifier),
+              "Failed to create presentation image resources");
+      if (m_present_copy)
+      {
+         std::lock_guard<std::mutex> copy_pool_lock(m_copy_pool_mutex);
+         TRY_LOG(image_data->present_copy.init(m_device_data, m_allocator, m_copy_pool, image.image,
+                                               m_image_create_info.format,
+                                               m_image_creation_parameters.m_present_image_info,
+                                               image_data->external_mem),
+                 "Failed to set up the present copy of a swapchain image");
+      }
+      else
+      {
+         TRY_LOG(image_data->external_mem.import_memory_and_bind_swapchain_image(image.image),
+                 "Failed to import memory and bind swapchain image");
+      }
+   }
+   else if (m_shm_host_import)
+   {
+      VkMemoryRequirements mem_requirements;
+      m_device_data.disp.GetImageMemoryRequirements(m_device, image.image, &mem_requirements);
+      const VkDeviceSize size =
+         (mem_requirements.size + m_host_import_alignment - 1) & ~(m_host_import_alignment - 1);
+
+      TRY_LOG(m_shm_presenter->create_host_import_resources(image_data, width, height, depth,
+                                                            static_cast<size_t>(size)),
+              "Failed to create presentation image resources");
+      TRY_LOG(image_data->external_mem.import_host_pointer_and_bind(image.image, image_data->shm_addr, size),
+              "Failed to import SHM segment as image memory");
+      image_data->stride = static_cast<uint32_t>(image_data->external_mem.get_host_layout().rowPitch);
+   }
+   else
+   {
+      /* The first image sets up the presenter's segment ring for all of them. */
+      image_status_lock.lock();
+      TRY_LOG(m_shm_presenter->create_image_resources(image_data, width, height, depth),
+              "Failed to create presentation image resources");
+      image_status_lock.unlock();
+
+      /* With a reduced footprint, images the CPU reads through its caches go without the readback buffer, a second
+       * host copy of each of them that would be read no faster. */
+      const bool skip_readback = util::tuning_profile::get().x11_reduced_footprint != 0 &&
+                                 (image_data->external_mem.get_host_memory_properties() &
+                                  VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0;
+
+      constexpr uint32_t bytes_per_pixel = 4;
+      std::lock_guard<std::mutex> copy_pool_lock(m_copy_pool_mutex);
+      if (m_gpu_readback && !skip_readback &&
+          image_data->readback.init(m_device_data, m_allocator, m_copy_pool, image.image, width, height,
+                                    bytes_per_pixel, width * bytes_per_pixel) != VK_SUCCESS)
+      {
+         WSI_LOG_WARNING("GPU readback unavailable for a swapchain image, the CPU reads it directly");
+      }
+   }
+
+   if (m_present_timeline.has_value())
+   {
+      image_data->present_point = timeline_sync{ *m_present_timeline };
+      return VK_SUCCESS;
+   }
 
    /* Initialize presentation fence. */
    auto present_fence = sync_fd_fence_sync::create(m_device_data);
@@ -418,28 +918,101 @@ VkResult swapchain::create_swapchain_image(VkImageCreateInfo image_create_info,
    image_data->device = m_device;
    image_data->device_data = &m_device_data;
 
-   if (m_shm_presenter)
+   if (m_dri3_presenter)
    {
-      VkMemoryPropertyFlags optimal = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
-                                      VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
-      VkMemoryPropertyFlags required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+      if (m_image_create_info.format == VK_FORMAT_UNDEFINED)
+      {
+         /* With present copies the dma-bufs only receive the copies, the application renders into local images. */
+         VkImageCreateInfo buffer_info = image_create_info;
+         if (m_present_copy)
+         {
+            buffer_info.pNext = nullptr;
+            buffer_info.flags = 0;
+            buffer_info.format = image_present_copy::get_presentable_format(image_create_info.format);
+            buffer_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+         }
 
-      TRY_LOG_CALL(image_data->external_mem.configure_for_host_visible(image_create_info, required, optimal));
+         /* The format lists only live for the allocation of the first image. */
+         util::scratch_scope scratch(m_allocator);
+         util::vector<wsialloc_format> importable_formats(scratch.get_allocator());
+         util::vector<uint64_t> exportable_modifiers(scratch.get_allocator());
+         util::vector<VkDrmFormatModifierPropertiesEXT> drm_format_props(scratch.get_allocator());
+
+         TRY_LOG_CALL(get_surface_compatible_formats(buffer_info, importable_formats, exportable_modifiers,
+                                                     drm_format_props));
+
+         if (importable_formats.empty())
+         {
+            WSI_LOG_ERROR("Export/Import not supported.");
+            return VK_ERROR_INITIALIZATION_FAILED;
+         }
+
+         wsialloc_format allocated_format = { 0, 0, 0 };
+         TRY_LOG_CALL(allocate_wsialloc(buffer_info, image_data, importable_formats, &allocated_format, true));
+
+         for (auto &prop : drm_format_props)
+         {
+            if (prop.drmFormatModifier == allocated_format.modifier)
+            {
+               image_data->external_mem.set_num_memories(prop.drmFormatModifierPlaneCount);
+            }
+         }
 
+         TRY_LOG_CALL(fill_image_create_info(
+            buffer_info, m_image_creation_parameters.m_image_layout, m_image_creation_parameters.m_drm_mod_info,
+            m_image_creation_parameters.m_external_info, *image_data, allocated_format.modifier));
+
+         if (m_present_copy)
+         {
+            m_image_creation_parameters.m_present_image_info = buffer_info;
+            image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+            image_create_info.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            m_image_create_info = image_create_info;
+         }
+         else
+         {
+            m_image_create_info = buffer_info;
+         }
+         m_image_creation_parameters.m_allocated_format = allocated_format;
+      }
+
+      return m_device_data.disp.CreateImage(m_device, &m_image_create_info, get_allocation_callbacks(), &image.image);
+   }
+   else if (m_shm_host_import)
+   {
+      /* Memory is imported from the SHM segment in allocate_and_bind_swapchain_image. */
+      image_data->external_mem.configure_for_host_pointer();
+      image_data->external_mem.fill_external_info(m_image_creation_parameters.m_external_info, nullptr);
+
+      image_create_info.pNext = &m_image_creation_parameters.m_external_info;
       image_create_info.tiling = VK_IMAGE_TILING_LINEAR;
       TRY_LOG(m_device_data.disp.CreateImage(m_device, &image_create_info, get_allocation_callbacks(), &image.image),
               "Failed to create image for SHM");
 
-      return image_data->external_mem.allocate_and_bind_image(image.image, image_create_info);
+      return VK_SUCCESS;
    }
    else
    {
-      return allocate_image(image_create_info, image_data);
+      /* The presenter reads every frame back on the CPU, non-coherent memory is invalidated before each read. */
+      TRY_LOG_CALL(image_data->external_mem.configure_for_host_visible(
+         image_create_info, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, util::memory_access::cpu_readback));
+
+      image_create_info.tiling = VK_IMAGE_TILING_LINEAR;
+      if (m_gpu_readback)
+      {
+         image_create_info.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+      }
+      TRY_LOG(m_device_data.disp.CreateImage(m_device, &image_create_info, get_allocation_callbacks(), &image.image),
+              "Failed to create image for SHM");
+
+      return image_data->external_mem.allocate_and_bind_image(image.image, image_create_info);
    }
 }
 
 void swapchain::present_event_thread()
 {
+   util::configure_presentation_thread("wsi-x11-present");
+
    auto thread_status_lock = std::unique_lock<std::mutex>(m_thread_status_lock);
    m_present_event_thread_run = true;
 
@@ -452,8 +1025,10 @@ void swapchain::present_event_thread()
          if (image.status == swapchain_image::INVALID)
             continue;
 
+         /* With DRI3 a presented image is only released once the X server sends IdleNotify for its pixmap. */
          auto data = reinterpret_cast<x11_image_data *>(image.data);
-         if (data->pending_completions.size() != 0)
+         if (data->pending_completions.size() != 0 ||
+             (m_dri3_presenter != nullptr && image.status == swapchain_image::PENDING))
          {
             assume_forward_progress = true;
             break;
@@ -471,22 +1046,165 @@ void swapchain::present_event_thread()
          break;
       }
 
-      thread_status_lock.unlock();
+      if (m_dri3_presenter == nullptr)
+      {
+         /* Only DRI3 presents complete through Present events, anything else is signalled on the condition. */
+         m_thread_status_cond.wait(thread_status_lock);
+         continue;
+      }
 
+      /* Sleep on the event queue itself, so images are released as soon as the X server is done with them.
+       * The destructor wakes this up with a dummy MSC notification. */
+      thread_status_lock.unlock();
+      auto *event = m_dri3_presenter->wait_for_event();
       thread_status_lock.lock();
-      std::this_thread::sleep_for(std::chrono::milliseconds(1)); // Short polling interval
+
+      if (event == nullptr)
+      {
+         WSI_LOG_ERROR("X11 connection failed while waiting for Present events");
+         set_error_state(VK_ERROR_SURFACE_LOST_KHR);
+         break;
+      }
+
+      do
+      {
+         handle_present_event(event);
+         free(event);
+      } while ((event = m_dri3_presenter->poll_event()) != nullptr);
+
+      m_thread_status_cond.notify_all();
    }
 
    m_present_event_thread_run = false;
    m_thread_status_cond.notify_all();
 }
 
+void swapchain::handle_present_event(const xcb_present_generic_event_t *event)
+{
+   switch (event->evtype)
+   {
+   case XCB_PRESENT_EVENT_COMPLETE_NOTIFY:
+   {
+      auto complete = reinterpret_cast<const xcb_present_complete_notify_event_t *>(event);
+      if (complete->kind != XCB_PRESENT_COMPLETE_KIND_PIXMAP)
+      {
+         break;
+      }
+
+      for (auto &image : m_swapchain_images)
+      {
+         if (image.data == nullptr)
+            continue;
+
+         auto &completions = reinterpret_cast<x11_image_data *>(image.data)->pending_completions;
+         auto completed = std::remove_if(completions.begin(), completions.end(),
+                                         [complete](const pending_completion &pending) {
+                                            return pending.serial == complete->serial;
+                                         });
+         /* The pixmap is on screen now, which is what vkWaitForPresentKHR waits for. */
+         if (completed != completions.end())
+         {
+            m_frame_stats.record(util::frame_stage::queue_to_screen, completed->queue_time_ns);
+            if (m_device_data.is_present_id_enabled())
+            {
+               auto *ext = get_swapchain_extension<wsi_ext_present_id>(true);
+               ext->set_present_id(completed->present_id);
+            }
+         }
+         completions.erase(completed, completions.end());
+      }
+      m_last_vblank_msc = complete->msc;
+      m_last_vblank_ns = complete->ust * 1000;
+
+      const bool flipped = complete->mode == XCB_PRESENT_COMPLETE_MODE_FLIP;
+      if (flipped != m_flipping)
+      {
+         WSI_LOG_INFO(flipped ? "DRI3 presents flip to the screen" : "DRI3 presents are copied");
+         m_flipping = flipped;
+      }
+
+      /* The X server would flip a pixmap with the modifiers it gives for the window, which recreating the swapchain
+       * picks up. Images copied for PRIME, or already with these modifiers, would not do better. */
+      if (complete->mode == XCB_PRESENT_COMPLETE_MODE_SUBOPTIMAL_COPY && !m_linear_present_copy &&
+          !m_dri3_presenter->has_window_modifiers())
+      {
+         set_suboptimal();
+      }
+      break;
+   }
+   case XCB_PRESENT_EVENT_IDLE_NOTIFY:
+   {
+      auto idle = reinterpret_cast<const xcb_present_idle_notify_event_t *>(event);
+      bool pushed = m_free_buffer_pool.push_back(idle->pixmap);
+      (void)pushed;
+      assert(pushed);
+      break;
+   }
+   default:
+      break;
+   }
+}
+
+uint64_t swapchain::get_absolute_target_time(const pending_present_request &pending_present) const
+{
+   if (pending_present.target_time == 0 || !pending_present.target_time_relative)
+   {
+      return pending_present.target_time;
+   }
+
+   /* Relative to when the previous present was shown, CompleteNotify reports it for DRI3 presents. */
+   const uint64_t last_visible_ns = (m_dri3_presenter != nullptr) ? m_last_vblank_ns : m_last_shm_visible_ns;
+   return last_visible_ns != 0 ? last_visible_ns + pending_present.target_time : 0;
+}
+
+bool swapchain::get_vblank_timing(uint64_t *vblank_ns, uint64_t *refresh_ns)
+{
+   std::lock_guard<std::mutex> lock(m_thread_status_lock);
+   const bool dri3 = m_dri3_presenter != nullptr;
+   *vblank_ns = dri3 ? m_last_vblank_ns : m_shm_presenter->get_pacer().get_last_vblank();
+   *refresh_ns = dri3 ? m_refresh_ns : m_shm_presenter->get_pacer().get_interval();
+   return *vblank_ns != 0 && *refresh_ns != 0;
+}
+
+uint64_t swapchain::get_present_release_time(const pending_present_request &pending_present)
+{
+   std::lock_guard<std::mutex> lock(m_thread_status_lock);
+   const uint64_t target_ns = get_absolute_target_time(pending_present);
+   if (target_ns == 0)
+   {
+      return 0;
+   }
+
+   /* DRI3 presents are given a target MSC instead, once CompleteNotify reported a vblank. */
+   const bool dri3 = m_dri3_presenter != nullptr;
+   const uint64_t vblank_ns = dri3 ? m_last_vblank_ns : m_shm_presenter->get_pacer().get_last_vblank();
+   const uint64_t refresh_ns = dri3 ? m_refresh_ns : m_shm_presenter->get_pacer().get_interval();
+   if (vblank_ns == 0 || refresh_ns == 0)
+   {
+      /* Without the vblanks of the window the present is held until its target, so it does not show earlier. */
+      return target_ns;
+   }
+   if (dri3)
+   {
+      return 0;
+   }
+
+   const uint64_t count =
+      get_target_refresh_count(vblank_ns, refresh_ns, target_ns, pending_present.target_time_nearest);
+   return get_release_time_for_refresh(vblank_ns, refresh_ns, count);
+}
+
 void swapchain::present_image(const pending_present_request &pending_present)
 {
    auto image_data = reinterpret_cast<x11_image_data *>(m_swapchain_images[pending_present.image_index].data);
+   if (image_data->hidden_present)
+   {
+      return complete_hidden_present(pending_present);
+   }
+
    auto thread_status_lock = std::unique_lock<std::mutex>(m_thread_status_lock);
 
-   while (image_data->pending_completions.size() == X11_SWAPCHAIN_MAX_PENDING_COMPLETIONS)
+   while (image_data->pending_completions.size() >= util::tuning_profile::get().x11_max_pending_completions)
    {
       if (!m_present_event_thread_run)
       {
@@ -503,13 +1221,113 @@ void swapchain::present_image(const pending_present_request &pending_present)
    m_send_sbc++;
    uint32_t serial = (uint32_t)m_send_sbc;
 
-   VkResult present_result = m_shm_presenter->present_image(image_data, serial);
+   if (m_dri3_presenter)
+   {
+      /* In FIFO mode wait for the previous present to complete so that no queued frame gets skipped by the X server. */
+      while (m_present_mode != VK_PRESENT_MODE_MAILBOX_KHR && m_present_event_thread_run &&
+             std::any_of(m_swapchain_images.begin(), m_swapchain_images.end(), [](const swapchain_image &image) {
+                return image.data != nullptr &&
+                       !reinterpret_cast<x11_image_data *>(image.data)->pending_completions.empty();
+             }))
+      {
+         m_thread_status_cond.wait(thread_status_lock);
+      }
+
+      /* The X server holds the pixmap until the vblank of its target time. */
+      uint64_t target_msc = 0;
+      const uint64_t target_ns = get_absolute_target_time(pending_present);
+      if (target_ns != 0 && m_last_vblank_ns != 0 && m_refresh_ns != 0)
+      {
+         target_msc = m_last_vblank_msc + get_target_refresh_count(m_last_vblank_ns, m_refresh_ns, target_ns,
+                                                                   pending_present.target_time_nearest);
+      }
+
+      /* Immediate mode presents are flipped without waiting for the vblank, and may tear. */
+      const bool async = m_present_mode == VK_PRESENT_MODE_IMMEDIATE_KHR;
+      VkResult present_result = VK_SUCCESS;
+      if (m_syncobj_timelines)
+      {
+         image_data->release_point = ++m_release_point;
+         const dri3_sync_points sync = { m_acquire_syncobj, image_data->acquire_point, m_release_syncobj,
+                                         image_data->release_point };
+         present_result = m_dri3_presenter->present_image(image_data, serial, target_msc, async, &sync);
+      }
+      else
+      {
+         present_result = m_dri3_presenter->present_image(image_data, serial, target_msc, async);
+      }
+      bool completion_tracked = false;
+      if (present_result != VK_SUCCESS)
+      {
+         WSI_LOG_ERROR("Failed to present image using DRI3: %d", present_result);
+         set_error_state(present_result);
+         /* The X server never got the release point, the next acquire of the image must not wait for it. Its
+          * previous release point was waited for when it was acquired for this present. */
+         image_data->release_point = 0;
+      }
+      else
+      {
+         try
+         {
+            image_data->pending_completions.push_back(
+               { serial, pending_present.present_id, std::nullopt, pending_present.queue_time_ns });
+            completion_tracked = true;
+         }
+         catch (const std::bad_alloc &)
+         {
+            WSI_LOG_WARNING("Failed to track present completion for serial %u", serial);
+         }
+      }
+
+      /* Tracked presents complete their ID on CompleteNotify, see handle_present_event. */
+      if (!completion_tracked && m_device_data.is_present_id_enabled())
+      {
+         auto *ext = get_swapchain_extension<wsi_ext_present_id>(true);
+         ext->set_present_id(pending_present.present_id);
+      }
+
+      m_thread_status_cond.notify_all();
+      thread_status_lock.unlock();
+
+      /* The image is released when the X server sends IdleNotify for its pixmap. */
+      if (present_result != VK_SUCCESS)
+      {
+         unpresent_image(pending_present.image_index);
+      }
+      return;
+   }
+
+   /* Continuous refreshes only put what changed in the shared image since the last put. */
+   VkResult present_result = pending_present.refresh ?
+                                m_shm_presenter->refresh_image(image_data) :
+                                m_shm_presenter->present_image(image_data, serial, pending_present.damage);
    if (present_result != VK_SUCCESS)
    {
       WSI_LOG_ERROR("Failed to present image using presentation strategy: %d", present_result);
    }
 
-   if (m_device_data.is_present_id_enabled())
+   if (present_result == VK_SUCCESS)
+   {
+      if (!pending_present.refresh)
+      {
+         m_frame_stats.record(util::frame_stage::queue_to_screen, pending_present.queue_time_ns);
+      }
+
+      const frame_pacer &pacer = m_shm_presenter->get_pacer();
+      const uint64_t now_ns = util::frame_stats::now_ns();
+      if (pacer.get_last_vblank() != 0 && pacer.get_interval() != 0)
+      {
+         /* The put image shows on the next vblank. */
+         const uint64_t count = get_target_refresh_count(pacer.get_last_vblank(), pacer.get_interval(), now_ns, false);
+         m_last_shm_visible_ns = pacer.get_last_vblank() + count * pacer.get_interval();
+      }
+      else
+      {
+         m_last_shm_visible_ns = now_ns;
+      }
+   }
+
+   if (m_device_data.is_present_id_enabled() && !pending_present.refresh)
    {
       auto *ext = get_swapchain_extension<wsi_ext_present_id>(true);
       ext->set_present_id(pending_present.present_id);
@@ -607,6 +1425,8 @@ VkResult swapchain::get_free_buffer(uint64_t *timeout)
 void swapchain::destroy_image(wsi::swapchain_image &image)
 {
    std::unique_lock<std::recursive_mutex> image_status_lock(m_image_status_mutex);
+   /* Buffers the presentation engine may still read are not handed to the allocation cache. */
+   bool buffer_reusable = !is_image_in_use(image.status);
    if (image.status != wsi::swapchain_image::INVALID)
    {
       if (image.image != VK_NULL_HANDLE)
@@ -615,7 +1435,7 @@ void swapchain::destroy_image(wsi::swapchain_image &image)
          image.image = VK_NULL_HANDLE;
       }
 
-      image.status = wsi::swapchain_image::INVALID;
+      set_image_status(image, wsi::swapchain_image::INVALID);
    }
 
    image_status_lock.unlock();
@@ -624,35 +1444,140 @@ void swapchain::destroy_image(wsi::swapchain_image &image)
    {
       auto data = reinterpret_cast<x11_image_data *>(image.data);
 
-      if (m_shm_presenter && data != nullptr)
+      if (m_dri3_presenter && data != nullptr)
+      {
+         m_dri3_presenter->destroy_image_resources(data);
+      }
+      else if (m_shm_presenter && data != nullptr)
       {
          m_shm_presenter->destroy_image_resources(data);
       }
 
+      if (m_syncobj_timelines && data->release_point != 0 &&
+          m_release_timeline->wait(data->release_point, 0) != VK_SUCCESS)
+      {
+         buffer_reusable = false;
+      }
+      const int recycle_fd = buffer_reusable ? data->external_mem.take_recycle_fd() : -1;
       m_allocator.destroy(1, data);
       image.data = nullptr;
+
+      /* The buffer is only handed back once the image memory imported from it is freed. */
+      if (recycle_fd >= 0)
+      {
+         wsialloc_free(m_wsi_allocator, recycle_fd);
+      }
    }
 }
 
+bool swapchain::adopt_ancestor_image(swapchain_base &ancestor, swapchain_image &ancestor_image)
+{
+   auto &x11_ancestor = static_cast<swapchain &>(ancestor);
+   /* DRI3 pixmaps belong to the presenter of their swapchain and readback command buffers to its pool, only SHM
+    * images without a readback move over. */
+   if (m_shm_presenter == nullptr || x11_ancestor.m_shm_presenter == nullptr || m_gpu_readback ||
+       x11_ancestor.m_gpu_readback || m_shm_host_import != x11_ancestor.m_shm_host_import ||
+       m_present_timeline.has_value() != x11_ancestor.m_present_timeline.has_value())
+   {
+      return false;
+   }
+
+   auto image_data = reinterpret_cast<x11_image_data *>(ancestor_image.data);
+   /* Imported segments come from the pool both presenters share, copied images need this presenter's ring. */
+   if (!image_data->shm_imported &&
+       m_shm_presenter->create_image_resources(image_data, image_data->width, image_data->height,
+                                               image_data->depth) != VK_SUCCESS)
+   {
+      return false;
+   }
+
+   if (m_present_timeline.has_value())
+   {
+      image_data->present_point = timeline_sync{ *m_present_timeline };
+   }
+
+   move_image_data_accounting(ancestor, sizeof(x11_image_data));
+   image_data->external_mem.rebind_allocator(m_allocator);
+   return true;
+}
+
 VkResult swapchain::image_set_present_payload(swapchain_image &image, VkQueue queue,
-                                              const queue_submit_semaphores &semaphores, const void *submission_pnext)
+                                              const queue_submit_semaphores &semaphores, const void *submission_pnext,
+                                              present_batch *batch)
 {
    auto data = reinterpret_cast<x11_image_data *>(image.data);
-   return data->present_fence.set_payload(queue, semaphores, submission_pnext);
+
+   /* Decided with the payload, so an image is not put from a copy that was skipped. */
+   data->hidden_present = m_throttle_hidden && window_visibility::get_instance().is_hidden(m_connection, m_window);
+
+   /* The readback and present copy are never both used, the command buffer is VK_NULL_HANDLE when neither is, which
+    * keeps the payload an empty submission. Neither is needed by a present that is not shown. */
+   VkCommandBuffer copy_commands =
+      data->present_copy.is_valid() ? data->present_copy.get_command_buffer() : data->readback.get_command_buffer();
+   if (data->hidden_present)
+   {
+      copy_commands = VK_NULL_HANDLE;
+   }
+   if (m_syncobj_timelines)
+   {
+      return m_acquire_timeline->submit(queue, semaphores, submission_pnext, copy_commands, batch,
+                                        data->acquire_point);
+   }
+
+   if (m_present_timeline.has_value())
+   {
+      return data->present_point.set_payload(queue, semaphores, submission_pnext, copy_commands, batch);
+   }
+   return data->present_fence.set_payload(queue, semaphores, submission_pnext, copy_commands, batch);
 }
 
 VkResult swapchain::image_wait_present(swapchain_image &image, uint64_t timeout)
 {
+   /* The X server waits for the acquire point of a synced present itself. */
+   if (m_syncobj_timelines)
+   {
+      return VK_SUCCESS;
+   }
+
    auto data = reinterpret_cast<x11_image_data *>(image.data);
+   if (m_present_timeline.has_value())
+   {
+      return data->present_point.wait_payload(timeout);
+   }
    return data->present_fence.wait_payload(timeout);
 }
 
+VkResult swapchain::image_wait_payload(swapchain_image &image, uint64_t timeout)
+{
+   auto data = reinterpret_cast<x11_image_data *>(image.data);
+   /* The payloads of synced presents signal the acquire timeline, which image_wait_present leaves to the X server. */
+   if (m_syncobj_timelines)
+   {
+      return data->acquire_point == 0 ? VK_SUCCESS : m_acquire_timeline->wait(data->acquire_point, timeout);
+   }
+   return image_wait_present(image, timeout);
+}
+
+swapchain_base::image_release_point swapchain::get_image_release_point(const swapchain_image &image)
+{
+   auto image_data = reinterpret_cast<const x11_image_data *>(image.data);
+   if (!m_syncobj_timelines || image_data->release_point == 0)
+   {
+      return { VK_NULL_HANDLE, 0 };
+   }
+   return { m_release_timeline->get_semaphore(), image_data->release_point };
+}
+
 VkResult swapchain::bind_swapchain_image(VkDevice &device, const VkBindImageMemoryInfo *bind_image_mem_info,
                                          const VkBindImageMemorySwapchainInfoKHR *bind_sc_info)
 {
    UNUSED(device);
    const wsi::swapchain_image &swapchain_image = m_swapchain_images[bind_sc_info->imageIndex];
    auto image_data = reinterpret_cast<x11_image_data *>(swapchain_image.data);
+   if (m_present_copy)
+   {
+      return image_data->present_copy.bind_image_memory(bind_image_mem_info->image);
+   }
    return image_data->external_mem.bind_swapchain_image_memory(bind_image_mem_info->image);
 }
 
@@ -669,6 +1594,14 @@ VkResult swapchain::add_required_extensions(VkDevice device, const VkSwapchainCr
       }
    }
 
+   if (m_device_data.is_swapchain_maintenance1_enabled())
+   {
+      if (!add_swapchain_extension(m_allocator.make_unique<wsi_ext_swapchain_maintenance1>(m_allocator)))
+      {
+         return VK_ERROR_OUT_OF_HOST_MEMORY;
+      }
+   }
+
    return VK_SUCCESS;
 }
 
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2017-2019, 2021-2022 Arm Limited.
+ * Copyright (c) 2017-2019, 2021-2022, 2025 Arm Limited.
  *
  * SPDX-License-Identifier: MIT
  *
@@ -53,8 +53,12 @@ extern "C" {
 
 #include "surface.hpp"
 #include "util/wsialloc/wsialloc.h"
+#include "wsi/wsialloc_batch.hpp"
 #include "wsi/external_memory.hpp"
 #include "shm_presenter.hpp"
+#include "dri3_presenter.hpp"
+#include "image_readback.hpp"
+#include "image_present_copy.hpp"
 
 namespace wsi
 {
@@ -66,6 +70,7 @@ struct pending_completion
    uint32_t serial;
    uint64_t present_id;
    std::optional<std::chrono::steady_clock::time_point> timestamp;
+   uint64_t queue_time_ns;
 };
 
 struct x11_image_data
@@ -79,17 +84,32 @@ struct x11_image_data
    xcb_pixmap_t pixmap = XCB_PIXMAP_NONE;
    std::vector<pending_completion> pending_completions;
 
+   /* Declared before present_fence and present_point, so the payload is waited for before the command buffer is
+    * freed. */
+   image_readback readback;
+   image_present_copy present_copy;
+
    fence_sync present_fence;
+   /* Used instead of present_fence when the swapchain has a present timeline. */
+   timeline_sync present_point;
+
+   /* Points of the syncobj timelines of the latest present, when DRI3 presents are synchronized on the GPU. */
+   uint64_t acquire_point = 0;
+   uint64_t release_point = 0;
 
    xcb_shm_seg_t shm_seg = XCB_NONE;
    int shm_id = -1;
    void *shm_addr = nullptr;
    size_t shm_size = 0;
+   /* Size of the pooled segment, which may be larger than shm_size. */
+   size_t shm_segment_size = 0;
 
-   xcb_shm_seg_t shm_seg_alt = XCB_NONE;
-   int shm_id_alt = -1;
-   void *shm_addr_alt = nullptr;
-   bool use_alt_buffer = false;
+   /* The image memory is the SHM segment itself, imported with VK_EXT_external_memory_host. */
+   bool shm_imported = false;
+
+   /* The window was hidden when the payload of the latest present was set, the present is completed without being
+    * copied or sent to the X server. */
+   bool hidden_present = false;
 
    uint32_t width = 0;
    uint32_t height = 0;
@@ -109,6 +129,8 @@ struct image_creation_parameters
    util::vector<VkSubresourceLayout> m_image_layout;
    VkExternalMemoryImageCreateInfoKHR m_external_info;
    VkImageDrmFormatModifierExplicitCreateInfoEXT m_drm_mod_info;
+   /* Create info of the linear images the dma-bufs are imported as, when presenting through image_present_copy. */
+   VkImageCreateInfo m_present_image_info = {};
 
    image_creation_parameters(wsialloc_format allocated_format, util::allocator allocator,
                              VkExternalMemoryImageCreateInfoKHR external_info,
@@ -127,8 +149,11 @@ struct image_creation_parameters
  * This class is mostly empty, because all the swapchain stuff is handled by the swapchain class,
  * which we inherit. This class only provides a way to create an image and page-flip ops.
  */
-class swapchain : public wsi::swapchain_base
+class swapchain final : public wsi::swapchain_base
 {
+   /* Calls the present path directly when the layer is built with this backend only, see backend_swapchain.hpp. */
+   friend class wsi::swapchain_base;
+
 public:
    explicit swapchain(layer::device_private_data &dev_data, const VkAllocationCallbacks *pAllocator,
                       surface &wsi_surface);
@@ -172,6 +197,19 @@ protected:
     */
    void present_image(const pending_present_request &pending_present) override;
 
+   /**
+    * @brief Hold presents with a target time until the refresh before their target vblank.
+    *
+    * DRI3 presents are only held when the vblanks of the window are not known yet, otherwise the X server holds
+    * them until their target MSC.
+    */
+   uint64_t get_present_release_time(const pending_present_request &pending_present) override;
+
+   /**
+    * @brief The vblanks DRI3 CompleteNotify events report, or the ones the SHM presenter paces with.
+    */
+   bool get_vblank_timing(uint64_t *vblank_ns, uint64_t *refresh_ns) override;
+
    /**
     * @brief Method to release a swapchain image
     *
@@ -179,6 +217,11 @@ protected:
     */
    void destroy_image(wsi::swapchain_image &image) override;
 
+   /**
+    * @brief Take over an image of the swapchain being replaced, see swapchain_base::adopt_ancestor_image.
+    */
+   bool adopt_ancestor_image(swapchain_base &ancestor, swapchain_image &ancestor_image) override;
+
    /**
     * @brief Sets the present payload for a swapchain image.
     *
@@ -190,10 +233,28 @@ protected:
     * @return VK_SUCCESS on success or an error code otherwise.
     */
    VkResult image_set_present_payload(swapchain_image &image, VkQueue queue, const queue_submit_semaphores &semaphores,
-                                      const void *submission_pnext) override;
+                                      const void *submission_pnext, present_batch *batch) override;
 
    VkResult image_wait_present(swapchain_image &image, uint64_t timeout) override;
 
+   /**
+    * @brief Synced DRI3 presents carry the acquire point, the X server waits for it rather than the page flip thread.
+    */
+   bool presents_wait_for_payload() const override
+   {
+      return m_syncobj_timelines;
+   }
+
+   /**
+    * @brief Wait for the present payload of an image, see swapchain_base::image_wait_payload.
+    */
+   VkResult image_wait_payload(swapchain_image &image, uint64_t timeout) override;
+
+   /**
+    * @brief Get the release point of the latest present of @p image, when DRI3 presents use syncobj timelines.
+    */
+   image_release_point get_image_release_point(const swapchain_image &image) override;
+
    /**
     * @brief Bind image to a swapchain
     *
@@ -254,10 +315,97 @@ private:
    wsialloc_allocator *m_wsi_allocator;
 
    /**
-    * @brief Presentation strategy for this swapchain.
+    * @brief Buffers allocated ahead for the images that are not allocated yet.
+    */
+   wsialloc_batch m_wsialloc_batch;
+
+   /**
+    * @brief Zero-copy DRI3/Present presenter, used when the X server and the device support it.
+    */
+   std::unique_ptr<dri3_presenter> m_dri3_presenter;
+
+   /**
+    * @brief MIT-SHM presenter, used when @ref m_dri3_presenter is not available.
     */
    std::unique_ptr<shm_presenter> m_shm_presenter;
 
+   /**
+    * @brief Whether the SHM segments are imported as the image memory, so presenting needs no CPU copy.
+    */
+   bool m_shm_host_import = false;
+
+   /**
+    * @brief minImportedHostPointerAlignment of the device, valid when @ref m_shm_host_import is set.
+    */
+   VkDeviceSize m_host_import_alignment = 0;
+
+   /**
+    * @brief Whether SHM presented images are copied by the GPU into host cached buffers, see image_readback.
+    */
+   bool m_gpu_readback = false;
+
+   /**
+    * @brief Whether DRI3 presented images are copied into the dma-bufs of their pixmaps, see image_present_copy.
+    */
+   bool m_present_copy = false;
+
+   /**
+    * @brief Whether the present copies go to linear dma-bufs, for a display GPU other than the rendering one.
+    */
+   bool m_linear_present_copy = false;
+
+   /**
+    * @brief Whether the present copies convert the swapchain format, see image_present_copy::get_presentable_format.
+    */
+   bool m_convert_format = false;
+
+   /**
+    * @brief Check whether the X server displays the window from another GPU than the device renders on.
+    *
+    * WSI_X11_PRIME=1 or 0 overrides the check.
+    */
+   bool is_prime_copy_needed();
+
+   /**
+    * @brief Pool of the readback or PRIME copy command buffers, valid when @ref m_gpu_readback or
+    *        @ref m_present_copy is set.
+    */
+   VkCommandPool m_copy_pool = VK_NULL_HANDLE;
+
+   /**
+    * @brief Guards @ref m_copy_pool, which is externally synchronized, while images are allocated on several threads.
+    */
+   std::mutex m_copy_pool_mutex;
+
+   /**
+    * @brief Timeline semaphore signalled by the present payloads of all the images, when timeline semaphores are
+    *        enabled on the device.
+    */
+   std::optional<timeline_semaphore> m_present_timeline;
+
+   /**
+    * @brief Set up GPU side synchronization of the DRI3 presents with DRM syncobj timelines.
+    *
+    * Needs timeline semaphores exportable to DRM syncobjs, and DRI3 1.4 and Present 1.4. When unavailable the page
+    * flip thread waits for the present payloads before presenting.
+    *
+    * @return true when the DRI3 presents use syncobj timelines.
+    */
+   bool init_syncobj_timelines();
+
+   /**
+    * @brief Syncobj timelines of the DRI3 presents, valid when @ref m_syncobj_timelines is set.
+    *
+    * Present payloads signal the next point of @ref m_acquire_timeline, which the X server waits for before reading
+    * the pixmap, and the X server signals a point of @ref m_release_timeline once it is done with it.
+    */
+   bool m_syncobj_timelines = false;
+   std::optional<timeline_semaphore> m_acquire_timeline;
+   uint32_t m_acquire_syncobj = 0;
+   std::optional<timeline_semaphore> m_release_timeline;
+   uint32_t m_release_syncobj = 0;
+   uint64_t m_release_point = 0;
+
    /**
     * @brief Image creation parameters used for all swapchain images.
     */
@@ -278,10 +426,71 @@ private:
                                            util::vector<VkDrmFormatModifierPropertiesEXT> &drm_format_props);
 
    uint64_t m_send_sbc;
-   uint64_t m_target_msc;
+
+   /**
+    * @brief Vblank the last DRI3 present completed on, from its CompleteNotify event.
+    */
+   uint64_t m_last_vblank_msc;
+   uint64_t m_last_vblank_ns;
+
+   /**
+    * @brief Refresh interval of the monitor showing the window when the DRI3 presenter was created, 0 if unknown.
+    */
+   uint64_t m_refresh_ns;
+
+   /**
+    * @brief Time the last SHM present is expected to be shown, the base of relative target times.
+    */
+   uint64_t m_last_shm_visible_ns;
+
+   /**
+    * @brief Whether presents to the window are completed without being shown while it is hidden, with the
+    *        hidden_present_interval_ms tuning. The window is then watched by @ref window_visibility.
+    */
+   bool m_throttle_hidden = false;
+
+   /**
+    * @brief CLOCK_MONOTONIC target of @p pending_present, 0 when it is relative to a present not shown yet.
+    *
+    * @note Must be called with @ref m_thread_status_lock held.
+    */
+   uint64_t get_absolute_target_time(const pending_present_request &pending_present) const;
 
    VkPhysicalDeviceMemoryProperties2 m_memory_props;
 
+   /**
+    * @brief Check whether the swapchain can present through DRI3/Present.
+    */
+   bool is_dri3_presentation_supported();
+
+   /**
+    * @brief Ask the compositor to unredirect the window when it is fullscreen, by setting _NET_WM_BYPASS_COMPOSITOR,
+    *        so the X server can flip the DRI3 pixmaps to the screen instead of the compositor copying them.
+    *
+    * Windows already carrying the hint keep the choice of the application. WSI_X11_BYPASS_COMPOSITOR=0 disables it.
+    */
+   void request_compositor_bypass();
+
+   /**
+    * @brief Whether the last DRI3 present completed as a flip, only used by the present event thread.
+    */
+   bool m_flipping = false;
+
+   /**
+    * @brief Check whether the SHM segments can be imported as swapchain image memory.
+    *
+    * Requires VK_EXT_external_memory_host and a linear image of the swapchain format and usage
+    * that is importable from a host allocation. Sets @ref m_host_import_alignment on success.
+    */
+   bool is_shm_host_import_supported(const VkSwapchainCreateInfoKHR *swapchain_create_info);
+
+   /**
+    * @brief Process a Present event received for the window.
+    *
+    * @note Must be called with @ref m_thread_status_lock held.
+    */
+   void handle_present_event(const xcb_present_generic_event_t *event);
+
    void present_event_thread();
    bool m_present_event_thread_run;
    std::thread m_present_event_thread;
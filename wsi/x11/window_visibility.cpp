@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file window_visibility.cpp
+ *
+ * @brief Implementation of the window visibility tracker.
+ */
+
+#include "window_visibility.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <new>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "util/log.hpp"
+
+namespace wsi
+{
+namespace x11
+{
+
+/* Directory the local X servers listen in, the socket of display N is named XN. */
+static constexpr char X11_UNIX_SOCKET_PREFIX[] = "/tmp/.X11-unix/X";
+
+/* TCP port of display 0, display N listens on X11_TCP_PORT + N. */
+static constexpr int X11_TCP_PORT = 6000;
+
+bool window_visibility::get_display_name(xcb_connection_t *connection, char *name, size_t size)
+{
+   sockaddr_storage address = {};
+   socklen_t length = sizeof(address);
+   if (getpeername(xcb_get_file_descriptor(connection), reinterpret_cast<sockaddr *>(&address), &length) != 0)
+   {
+      return false;
+   }
+
+   if (address.ss_family == AF_UNIX)
+   {
+      /* The abstract socket has the same name as the file system one, after a NUL and not NUL terminated. */
+      const auto *unix_address = reinterpret_cast<const sockaddr_un *>(&address);
+      const char *path = unix_address->sun_path;
+      size_t path_length = length > offsetof(sockaddr_un, sun_path) ? length - offsetof(sockaddr_un, sun_path) : 0;
+      if (path_length > 0 && path[0] == '\0')
+      {
+         path++;
+         path_length--;
+      }
+      path_length = strnlen(path, path_length);
+
+      const size_t prefix_length = sizeof(X11_UNIX_SOCKET_PREFIX) - 1;
+      if (path_length <= prefix_length || std::strncmp(path, X11_UNIX_SOCKET_PREFIX, prefix_length) != 0)
+      {
+         return false;
+      }
+      const int written = std::snprintf(name, size, ":%.*s", static_cast<int>(path_length - prefix_length),
+                                        path + prefix_length);
+      return written > 0 && static_cast<size_t>(written) < size;
+   }
+
+   char host[INET6_ADDRSTRLEN];
+   int written = -1;
+   if (address.ss_family == AF_INET)
+   {
+      const auto *inet_address = reinterpret_cast<const sockaddr_in *>(&address);
+      if (inet_ntop(AF_INET, &inet_address->sin_addr, host, sizeof(host)) != nullptr)
+      {
+         written = std::snprintf(name, size, "%s:%d", host, ntohs(inet_address->sin_port) - X11_TCP_PORT);
+      }
+   }
+   else if (address.ss_family == AF_INET6)
+   {
+      const auto *inet6_address = reinterpret_cast<const sockaddr_in6 *>(&address);
+      if (inet_ntop(AF_INET6, &inet6_address->sin6_addr, host, sizeof(host)) != nullptr)
+      {
+         written = std::snprintf(name, size, "[%s]:%d", host, ntohs(inet6_address->sin6_port) - X11_TCP_PORT);
+      }
+   }
+   return written > 0 && static_cast<size_t>(written) < size;
+}
+
+window_visibility &window_visibility::get_instance()
+{
+   static window_visibility instance;
+   return instance;
+}
+
+window_visibility::~window_visibility()
+{
+   for (const auto &server : m_servers)
+   {
+      xcb_disconnect(server.connection);
+   }
+}
+
+xcb_connection_t *window_visibility::connect_to_server_of(xcb_connection_t *application)
+{
+   char display_name[DISPLAY_NAME_SIZE];
+   if (!get_display_name(application, display_name, sizeof(display_name)))
+   {
+      WSI_LOG_WARNING("Failed to find the display of the X connection, hidden windows cannot be detected");
+      return nullptr;
+   }
+
+   xcb_connection_t *connection = xcb_connect(display_name, nullptr);
+   if (xcb_connection_has_error(connection))
+   {
+      WSI_LOG_WARNING("Failed to connect to X server %s, hidden windows cannot be detected", display_name);
+      xcb_disconnect(connection);
+      return nullptr;
+   }
+   return connection;
+}
+
+window_visibility::server_connection *window_visibility::find_server_locked(xcb_connection_t *application)
+{
+   auto it = std::find_if(m_servers.begin(), m_servers.end(),
+                          [application](const server_connection &server) { return server.application == application; });
+   return it != m_servers.end() ? &*it : nullptr;
+}
+
+window_visibility::window_state *window_visibility::find_locked(xcb_connection_t *application, xcb_window_t window)
+{
+   auto it = std::find_if(m_windows.begin(), m_windows.end(), [application, window](const window_state &state) {
+      return state.application == application && state.window == window;
+   });
+   return it != m_windows.end() ? &*it : nullptr;
+}
+
+void window_visibility::watch_window(xcb_connection_t *connection, xcb_window_t window)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   window_state *state = find_locked(connection, window);
+   if (state != nullptr)
+   {
+      state->watchers++;
+      return;
+   }
+
+   try
+   {
+      m_windows.reserve(m_windows.size() + 1);
+      m_servers.reserve(m_servers.size() + 1);
+   }
+   catch (const std::bad_alloc &)
+   {
+      WSI_LOG_WARNING("Failed to track the visibility of window %u", window);
+      return;
+   }
+
+   server_connection *server = find_server_locked(connection);
+   if (server == nullptr)
+   {
+      xcb_connection_t *private_connection = connect_to_server_of(connection);
+      if (private_connection == nullptr)
+      {
+         return;
+      }
+      m_servers.push_back({ connection, private_connection, 0 });
+      server = &m_servers.back();
+   }
+
+   /* Event masks are per client, selecting on the private connection leaves the application's mask alone. */
+   const uint32_t event_mask = XCB_EVENT_MASK_STRUCTURE_NOTIFY | XCB_EVENT_MASK_VISIBILITY_CHANGE;
+   xcb_change_window_attributes(server->connection, window, XCB_CW_EVENT_MASK, &event_mask);
+
+   /* Queried after selecting the events, so no change is missed in between. */
+   xcb_get_window_attributes_reply_t *attributes = xcb_get_window_attributes_reply(
+      server->connection, xcb_get_window_attributes(server->connection, window), nullptr);
+   const bool viewable = attributes == nullptr || attributes->map_state == XCB_MAP_STATE_VIEWABLE;
+   free(attributes);
+
+   server->windows++;
+   m_windows.push_back({ connection, window, 1, viewable, false });
+}
+
+void window_visibility::unwatch_window(xcb_connection_t *connection, xcb_window_t window)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   window_state *state = find_locked(connection, window);
+   if (state == nullptr || --state->watchers != 0)
+   {
+      return;
+   }
+   m_windows.erase(m_windows.begin() + (state - m_windows.data()));
+
+   server_connection *server = find_server_locked(connection);
+   if (--server->windows == 0)
+   {
+      xcb_disconnect(server->connection);
+      m_servers.erase(m_servers.begin() + (server - m_servers.data()));
+      return;
+   }
+
+   /* The window may already be destroyed, the error is dropped with the events. */
+   const uint32_t event_mask = XCB_EVENT_MASK_NO_EVENT;
+   xcb_change_window_attributes(server->connection, window, XCB_CW_EVENT_MASK, &event_mask);
+   xcb_flush(server->connection);
+}
+
+void window_visibility::process_events_locked(const server_connection &server)
+{
+   xcb_generic_event_t *event = nullptr;
+   while ((event = xcb_poll_for_event(server.connection)) != nullptr)
+   {
+      const uint8_t type = event->response_type & ~0x80;
+      window_state *state = nullptr;
+      if (type == XCB_MAP_NOTIFY)
+      {
+         state = find_locked(server.application, reinterpret_cast<xcb_map_notify_event_t *>(event)->window);
+         if (state != nullptr)
+         {
+            state->viewable = true;
+         }
+      }
+      else if (type == XCB_UNMAP_NOTIFY)
+      {
+         state = find_locked(server.application, reinterpret_cast<xcb_unmap_notify_event_t *>(event)->window);
+         if (state != nullptr)
+         {
+            state->viewable = false;
+         }
+      }
+      else if (type == XCB_VISIBILITY_NOTIFY)
+      {
+         const auto *visibility = reinterpret_cast<xcb_visibility_notify_event_t *>(event);
+         state = find_locked(server.application, visibility->window);
+         if (state != nullptr)
+         {
+            state->obscured = visibility->state == XCB_VISIBILITY_FULLY_OBSCURED;
+         }
+      }
+      free(event);
+   }
+}
+
+bool window_visibility::is_hidden(xcb_connection_t *connection, xcb_window_t window)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   const server_connection *server = find_server_locked(connection);
+   if (server == nullptr)
+   {
+      return false;
+   }
+
+   xcb_flush(server->connection);
+   process_events_locked(*server);
+   const window_state *state = find_locked(connection, window);
+   return state != nullptr && (!state->viewable || state->obscured);
+}
+
+} /* namespace x11 */
+} /* namespace wsi */
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2025 Arm Limited.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file window_visibility.hpp
+ *
+ * @brief Process wide tracking of whether the windows presented to can be seen.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <xcb/xcb.h>
+
+namespace wsi
+{
+namespace x11
+{
+
+/**
+ * @brief Map state and visibility of the windows of the swapchains throttling hidden presents.
+ *
+ * A window is hidden while it is unmapped, e.g. minimized, or fully obscured by other windows. MapNotify, UnmapNotify
+ * and VisibilityNotify are core events, so the tracker opens a private connection to receive them without changing
+ * the event mask of the application's window or taking events from its queue. It connects to the server at the other
+ * end of the application's connection, not to $DISPLAY, which may name another server. One private connection is
+ * kept per application connection with watched windows.
+ *
+ * Compositing window managers redirect the windows offscreen, which are then never reported obscured. A window that
+ * is not mapped itself but whose ancestor gets unmapped after it is watched is not seen as hidden.
+ */
+class window_visibility
+{
+public:
+   /**
+    * @brief Tracker shared by every swapchain of the process.
+    */
+   static window_visibility &get_instance();
+
+   /**
+    * @brief Start tracking @p window, once per swapchain presenting to it.
+    *
+    * @param connection Application connection the window belongs to.
+    * @param window     Window to track.
+    */
+   void watch_window(xcb_connection_t *connection, xcb_window_t window);
+
+   /**
+    * @brief Stop tracking @p window for one of the swapchains that called @ref watch_window.
+    */
+   void unwatch_window(xcb_connection_t *connection, xcb_window_t window);
+
+   /**
+    * @brief Read the pending events without blocking and check whether @p window can be seen.
+    *
+    * @return true when the watched @p window is unmapped or fully obscured.
+    */
+   bool is_hidden(xcb_connection_t *connection, xcb_window_t window);
+
+   /* Room for the longest display name of a TCP server, a bracketed IPv6 address and the display number. */
+   static constexpr size_t DISPLAY_NAME_SIZE = 64;
+
+   /**
+    * @brief Write the name of the display at the other end of @p connection to @p name.
+    *
+    * The name connects to the server the application talks to, which $DISPLAY may not name.
+    *
+    * @return false when the server address is not one a display name can be built from.
+    */
+   static bool get_display_name(xcb_connection_t *connection, char *name, size_t size);
+
+private:
+   struct server_connection
+   {
+      /* Connection of the application the private one was opened for. */
+      xcb_connection_t *application;
+      xcb_connection_t *connection;
+      /* Watched windows on the connection, it is closed with the last one. */
+      uint32_t windows;
+   };
+
+   struct window_state
+   {
+      xcb_connection_t *application;
+      xcb_window_t window;
+      uint32_t watchers;
+      bool viewable;
+      bool obscured;
+   };
+
+   window_visibility() = default;
+   ~window_visibility();
+
+   window_visibility(const window_visibility &) = delete;
+   window_visibility &operator=(const window_visibility &) = delete;
+
+   /* Opens a new connection to the server @p application is connected to, or returns nullptr. */
+   static xcb_connection_t *connect_to_server_of(xcb_connection_t *application);
+
+   server_connection *find_server_locked(xcb_connection_t *application);
+   window_state *find_locked(xcb_connection_t *application, xcb_window_t window);
+   void process_events_locked(const server_connection &server);
+
+   std::mutex m_mutex;
+   std::vector<server_connection> m_servers;
+   std::vector<window_state> m_windows;
+};
+
+} /* namespace x11 */
+} /* namespace wsi */